@@ -14,9 +14,18 @@ let package = Package(
         ),
     ],
     targets: [
+        // The math model: parsing, the math list and its archives. Foundation only, so
+        // that it can be built and measured without the renderer. Its headers are
+        // published through the module of `iosMath`.
+        .target(
+            name: "iosMathLib",
+            path: "iosMath/lib"
+        ),
         .target(
             name: "iosMath",
+            dependencies: ["iosMathLib"],
             path: "iosMath",
+            exclude: ["lib"],
             resources: [
                 .copy("fonts"),
             ],
@@ -54,6 +63,37 @@ let package = Package(
                 .swiftLanguageMode(.v5),
             ]
         ),
+        // Speed and allocation benchmarks, skipped unless MT_BENCHMARK is set.
+        // Run with `swift test -c release --filter Benchmarks`.
+        .target(
+            name: "iosMathBenchmarkSupport",
+            dependencies: ["iosMathLib"],
+            path: "iosMathBenchmarks/Support",
+            publicHeadersPath: ".",
+            cSettings: [
+                .headerSearchPath("../../iosMath/lib"),
+            ]
+        ),
+        // The parse and finalize stages, built against the math model alone.
+        .testTarget(
+            name: "iosMathModelBenchmarks",
+            dependencies: ["iosMathLib", "iosMathBenchmarkSupport"],
+            path: "iosMathBenchmarks/Model",
+            cSettings: [
+                .headerSearchPath("../../iosMath/lib"),
+            ]
+        ),
+        .testTarget(
+            name: "iosMathRenderBenchmarks",
+            dependencies: ["iosMath", "iosMathBenchmarkSupport"],
+            path: "iosMathBenchmarks/Render",
+            cSettings: [
+                .headerSearchPath("../../iosMath"),
+                .headerSearchPath("../../iosMath/lib"),
+                .headerSearchPath("../../iosMath/render"),
+                .headerSearchPath("../../iosMath/render/internal"),
+            ]
+        ),
         // Regression guard for issue #215. Imports `iosMath` purely as a Clang
         // module with NO header search paths, reproducing how an external SPM
         // consumer builds the module. If a public header reintroduces a bare
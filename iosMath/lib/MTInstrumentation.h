@@ -0,0 +1,112 @@
+//
+//  MTInstrumentation.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import Foundation;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ @typedef MTLayoutPhase
+ @brief A timed phase of the layout pipeline.
+
+ Phases nest: the lists inside a formula are preprocessed during the typesetting of their
+ parent. Each phase is timed once per thread however deeply it recurses.
+ */
+typedef NS_ENUM(NSUInteger, MTLayoutPhase) {
+    /// Parsing LaTeX with `MTMathListBuilder`.
+    kMTLayoutPhaseParse,
+    /// `-[MTMathList finalized]`.
+    kMTLayoutPhaseFinalize,
+    /// Preprocessing a finalized list for the typesetter.
+    kMTLayoutPhasePreprocess,
+    /// Typesetting the preprocessed atoms into displays.
+    kMTLayoutPhaseCreateDisplayAtoms,
+    /// Drawing a display tree, its draw commands or a cached raster image into a context.
+    kMTLayoutPhaseDraw,
+};
+
+/// The number of phases. Not a case of the enum, so that switches over it stay exhaustive.
+static const NSUInteger kMTLayoutPhaseCount __attribute__((unused)) = kMTLayoutPhaseDraw + 1;
+
+/**
+ @typedef MTLayoutCounter
+ @brief An event counted by the instrumentation.
+ */
+typedef NS_ENUM(NSUInteger, MTLayoutCounter) {
+    /// Typesetters created, one per laid out list.
+    kMTLayoutCounterTypesetters,
+    /// Fonts created by `-[MTFont copyFontWithSize:]`.
+    kMTLayoutCounterFontCopies,
+    /// CTLines created for the displays.
+    kMTLayoutCounterCTLines,
+    /// Lookups of the size variants of a glyph in the math table.
+    kMTLayoutCounterGlyphVariantLookups,
+    /// Glyphs built from the parts of a glyph assembly.
+    kMTLayoutCounterGlyphAssemblies,
+    /// Atoms created.
+    kMTLayoutCounterAtoms,
+    /// Displays created.
+    kMTLayoutCounterDisplays,
+};
+
+/// The number of counters.
+static const NSUInteger kMTLayoutCounterCount __attribute__((unused)) = kMTLayoutCounterDisplays + 1;
+
+/**
+ Receives the phases as they run, e.g. to forward them to a profiler. The methods are called on
+ the thread of the phase, for its outermost occurrence on that thread, and must be thread safe.
+ */
+@protocol MTTraceSink <NSObject>
+
+- (void) beginPhase:(MTLayoutPhase) phase;
+- (void) endPhase:(MTLayoutPhase) phase duration:(NSTimeInterval) duration;
+
+@end
+
+/** A snapshot of the statistics gathered since they were last reset. */
+@interface MTLayoutStatistics : NSObject
+
+- (instancetype) init NS_UNAVAILABLE;
+
+/** The total time spent in a phase, summed over the threads it ran on. */
+- (NSTimeInterval) durationOfPhase:(MTLayoutPhase) phase;
+/** The number of times a phase ran. */
+- (NSUInteger) countOfPhase:(MTLayoutPhase) phase;
+- (NSUInteger) valueOfCounter:(MTLayoutCounter) counter;
+
+@end
+
+/**
+ Optional instrumentation of the layout pipeline: per phase timings, event counters and a trace
+ sink. It is off by default, and costs a relaxed atomic load per event while off. Building with
+ `MT_INSTRUMENTATION=0` removes the instrumentation entirely, the statistics are then all zero.
+ */
+@interface MTInstrumentation : NSObject
+
+- (instancetype) init NS_UNAVAILABLE;
+
+@property (class, nonatomic, getter=isEnabled) BOOL enabled;
+
+/** Receives the phases while the instrumentation is enabled. */
+@property (class, nonatomic, nullable) id<MTTraceSink> traceSink;
+
++ (MTLayoutStatistics*) statistics;
++ (void) resetStatistics;
+
+@end
+
+/** A trace sink that emits an os_signpost interval for each phase, shown by Instruments. */
+@interface MTSignpostTraceSink : NSObject <MTTraceSink>
+
+/** A sink logging to the `Layout` category of the `iosMath` subsystem. */
+- (instancetype) init;
+- (instancetype) initWithSubsystem:(NSString*) subsystem category:(NSString*) category NS_DESIGNATED_INITIALIZER;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,270 @@
+//
+//  MTInstrumentation.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#include <os/lock.h>
+#include <os/signpost.h>
+#include <pthread.h>
+#include <time.h>
+
+#import "MTInstrumentationInternal.h"
+
+// The counts as constant expressions, for the sizes of the arrays.
+enum {
+    MTPhaseCount = kMTLayoutPhaseDraw + 1,
+    MTCounterCount = kMTLayoutCounterDisplays + 1,
+};
+
+#if MT_INSTRUMENTATION
+
+_Atomic(bool) MTInstrumentationOn = false;
+
+static _Atomic(uint64_t) sCounters[MTCounterCount];
+static _Atomic(uint64_t) sPhaseNanoseconds[MTPhaseCount];
+static _Atomic(uint64_t) sPhaseCounts[MTPhaseCount];
+// How deep each phase is on this thread, so that recursion is timed once.
+static _Thread_local uint32_t sPhaseDepth[MTPhaseCount];
+
+// The sink is read under the lock, and only looked for when one is set.
+static os_unfair_lock sSinkLock = OS_UNFAIR_LOCK_INIT;
+static id<MTTraceSink> sSink;
+static _Atomic(bool) sHasSink = false;
+
+static id<MTTraceSink> MTCurrentSink(void)
+{
+    if (!atomic_load_explicit(&sHasSink, memory_order_relaxed)) {
+        return nil;
+    }
+    os_unfair_lock_lock(&sSinkLock);
+    id<MTTraceSink> sink = sSink;
+    os_unfair_lock_unlock(&sSinkLock);
+    return sink;
+}
+
+void MTInstrumentationCount(MTLayoutCounter counter)
+{
+    atomic_fetch_add_explicit(&sCounters[counter], 1, memory_order_relaxed);
+}
+
+MTPhaseInterval MTInstrumentationBeginPhase(MTLayoutPhase phase)
+{
+    if (sPhaseDepth[phase]++ > 0) {
+        return (MTPhaseInterval) { phase, 1, 0 };
+    }
+    [MTCurrentSink() beginPhase:phase];
+    return (MTPhaseInterval) { phase, 2, clock_gettime_nsec_np(CLOCK_UPTIME_RAW) };
+}
+
+void MTInstrumentationFinishPhase(MTPhaseInterval* interval)
+{
+    MTLayoutPhase phase = interval->phase;
+    sPhaseDepth[phase]--;
+    if (interval->state != 2) {
+        return;
+    }
+    uint64_t elapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - interval->start;
+    atomic_fetch_add_explicit(&sPhaseNanoseconds[phase], elapsed, memory_order_relaxed);
+    atomic_fetch_add_explicit(&sPhaseCounts[phase], 1, memory_order_relaxed);
+    [MTCurrentSink() endPhase:phase duration:elapsed / (NSTimeInterval) NSEC_PER_SEC];
+}
+
+#endif
+
+#pragma mark - MTLayoutStatistics
+
+@implementation MTLayoutStatistics {
+    uint64_t _counters[MTCounterCount];
+    uint64_t _phaseNanoseconds[MTPhaseCount];
+    uint64_t _phaseCounts[MTPhaseCount];
+}
+
+- (instancetype) initWithCurrentValues
+{
+    self = [super init];
+    if (self) {
+#if MT_INSTRUMENTATION
+        for (NSUInteger i = 0; i < kMTLayoutCounterCount; i++) {
+            _counters[i] = atomic_load_explicit(&sCounters[i], memory_order_relaxed);
+        }
+        for (NSUInteger i = 0; i < kMTLayoutPhaseCount; i++) {
+            _phaseNanoseconds[i] = atomic_load_explicit(&sPhaseNanoseconds[i], memory_order_relaxed);
+            _phaseCounts[i] = atomic_load_explicit(&sPhaseCounts[i], memory_order_relaxed);
+        }
+#endif
+    }
+    return self;
+}
+
+- (NSTimeInterval) durationOfPhase:(MTLayoutPhase) phase
+{
+    NSParameterAssert(phase < kMTLayoutPhaseCount);
+    return _phaseNanoseconds[phase] / (NSTimeInterval) NSEC_PER_SEC;
+}
+
+- (NSUInteger) countOfPhase:(MTLayoutPhase) phase
+{
+    NSParameterAssert(phase < kMTLayoutPhaseCount);
+    return (NSUInteger) _phaseCounts[phase];
+}
+
+- (NSUInteger) valueOfCounter:(MTLayoutCounter) counter
+{
+    NSParameterAssert(counter < kMTLayoutCounterCount);
+    return (NSUInteger) _counters[counter];
+}
+
+- (NSString *)description
+{
+    static NSString* const phaseNames[] = { @"parse", @"finalize", @"preprocess", @"createDisplayAtoms", @"draw" };
+    static NSString* const counterNames[] = { @"typesetters", @"fontCopies", @"ctLines", @"glyphVariantLookups",
+                                              @"glyphAssemblies", @"atoms", @"displays" };
+    NSMutableString* str = [NSMutableString stringWithFormat:@"<%@:", self.class];
+    for (NSUInteger i = 0; i < kMTLayoutPhaseCount; i++) {
+        [str appendFormat:@" %@=%.3fms/%llu", phaseNames[i], _phaseNanoseconds[i] / 1e6, _phaseCounts[i]];
+    }
+    for (NSUInteger i = 0; i < kMTLayoutCounterCount; i++) {
+        [str appendFormat:@" %@=%llu", counterNames[i], _counters[i]];
+    }
+    [str appendString:@">"];
+    return str;
+}
+
+@end
+
+#pragma mark - MTInstrumentation
+
+@implementation MTInstrumentation
+
++ (BOOL) isEnabled
+{
+#if MT_INSTRUMENTATION
+    return MTInstrumentationIsOn();
+#else
+    return NO;
+#endif
+}
+
++ (void) setEnabled:(BOOL) enabled
+{
+#if MT_INSTRUMENTATION
+    atomic_store_explicit(&MTInstrumentationOn, enabled, memory_order_relaxed);
+#endif
+}
+
++ (id<MTTraceSink>) traceSink
+{
+#if MT_INSTRUMENTATION
+    return MTCurrentSink();
+#else
+    return nil;
+#endif
+}
+
++ (void) setTraceSink:(id<MTTraceSink>) traceSink
+{
+#if MT_INSTRUMENTATION
+    os_unfair_lock_lock(&sSinkLock);
+    sSink = traceSink;
+    atomic_store_explicit(&sHasSink, traceSink != nil, memory_order_relaxed);
+    os_unfair_lock_unlock(&sSinkLock);
+#endif
+}
+
++ (MTLayoutStatistics*) statistics
+{
+    return [[MTLayoutStatistics alloc] initWithCurrentValues];
+}
+
++ (void) resetStatistics
+{
+#if MT_INSTRUMENTATION
+    for (NSUInteger i = 0; i < kMTLayoutCounterCount; i++) {
+        atomic_store_explicit(&sCounters[i], 0, memory_order_relaxed);
+    }
+    for (NSUInteger i = 0; i < kMTLayoutPhaseCount; i++) {
+        atomic_store_explicit(&sPhaseNanoseconds[i], 0, memory_order_relaxed);
+        atomic_store_explicit(&sPhaseCounts[i], 0, memory_order_relaxed);
+    }
+#endif
+}
+
+@end
+
+#pragma mark - MTSignpostTraceSink
+
+@implementation MTSignpostTraceSink {
+    os_log_t _log;
+}
+
+- (instancetype) init
+{
+    return [self initWithSubsystem:@"iosMath" category:@"Layout"];
+}
+
+- (instancetype) initWithSubsystem:(NSString*) subsystem category:(NSString*) category
+{
+    NSParameterAssert(subsystem);
+    NSParameterAssert(category);
+    self = [super init];
+    if (self) {
+        _log = os_log_create(subsystem.UTF8String, category.UTF8String);
+    }
+    return self;
+}
+
+// The intervals of a thread are told apart from those of the others by the thread.
+- (os_signpost_id_t) signpostID
+{
+    return os_signpost_id_make_with_pointer(_log, pthread_self());
+}
+
+// The names of the signposts have to be string literals.
+- (void) beginPhase:(MTLayoutPhase) phase
+{
+    os_signpost_id_t signpostID = [self signpostID];
+    switch (phase) {
+        case kMTLayoutPhaseParse:
+            os_signpost_interval_begin(_log, signpostID, "Parse");
+            break;
+        case kMTLayoutPhaseFinalize:
+            os_signpost_interval_begin(_log, signpostID, "Finalize");
+            break;
+        case kMTLayoutPhasePreprocess:
+            os_signpost_interval_begin(_log, signpostID, "Preprocess");
+            break;
+        case kMTLayoutPhaseCreateDisplayAtoms:
+            os_signpost_interval_begin(_log, signpostID, "CreateDisplayAtoms");
+            break;
+        case kMTLayoutPhaseDraw:
+            os_signpost_interval_begin(_log, signpostID, "Draw");
+            break;
+    }
+}
+
+- (void) endPhase:(MTLayoutPhase) phase duration:(NSTimeInterval) duration
+{
+    os_signpost_id_t signpostID = [self signpostID];
+    switch (phase) {
+        case kMTLayoutPhaseParse:
+            os_signpost_interval_end(_log, signpostID, "Parse");
+            break;
+        case kMTLayoutPhaseFinalize:
+            os_signpost_interval_end(_log, signpostID, "Finalize");
+            break;
+        case kMTLayoutPhasePreprocess:
+            os_signpost_interval_end(_log, signpostID, "Preprocess");
+            break;
+        case kMTLayoutPhaseCreateDisplayAtoms:
+            os_signpost_interval_end(_log, signpostID, "CreateDisplayAtoms");
+            break;
+        case kMTLayoutPhaseDraw:
+            os_signpost_interval_end(_log, signpostID, "Draw");
+            break;
+    }
+}
+
+@end
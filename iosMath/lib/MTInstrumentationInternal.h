@@ -0,0 +1,61 @@
+//
+//  MTInstrumentationInternal.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#include <stdatomic.h>
+
+#import "MTInstrumentation.h"
+
+// Set to 0 to compile the instrumentation out.
+#ifndef MT_INSTRUMENTATION
+#define MT_INSTRUMENTATION 1
+#endif
+
+#if MT_INSTRUMENTATION
+
+// Whether the instrumentation is enabled, read on every event.
+FOUNDATION_EXTERN _Atomic(bool) MTInstrumentationOn;
+
+typedef struct {
+    MTLayoutPhase phase;
+    // 0 if the instrumentation was off when the phase began, 1 for a nested occurrence and 2
+    // for the outermost one on the thread.
+    uint8_t state;
+    uint64_t start;
+} MTPhaseInterval;
+
+FOUNDATION_EXTERN void MTInstrumentationCount(MTLayoutCounter counter);
+FOUNDATION_EXTERN MTPhaseInterval MTInstrumentationBeginPhase(MTLayoutPhase phase);
+FOUNDATION_EXTERN void MTInstrumentationFinishPhase(MTPhaseInterval* interval);
+
+static inline BOOL MTInstrumentationIsOn(void)
+{
+    return atomic_load_explicit(&MTInstrumentationOn, memory_order_relaxed);
+}
+
+static inline void MTInstrumentationEndPhase(MTPhaseInterval* interval)
+{
+    if (interval->state) {
+        MTInstrumentationFinishPhase(interval);
+    }
+}
+
+/// Counts an event.
+#define MTCountEvent(counter) \
+    do { if (MTInstrumentationIsOn()) { MTInstrumentationCount(counter); } } while (0)
+
+/// Times the rest of the enclosing scope as the given phase.
+#define MTTracePhase(phase) \
+    __attribute__((cleanup(MTInstrumentationEndPhase), unused)) MTPhaseInterval _mtPhaseInterval = \
+        (MTInstrumentationIsOn() ? MTInstrumentationBeginPhase(phase) : (MTPhaseInterval) { (phase), 0, 0 })
+
+#else
+
+#define MTCountEvent(counter) do { } while (0)
+#define MTTracePhase(phase) do { } while (0)
+
+#endif
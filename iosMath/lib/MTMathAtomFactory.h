@@ -89,6 +89,11 @@ FOUNDATION_EXPORT NSString *const MTSymbolDegree;
  */
 + (nullable MTMathAtom*) atomForCharacter:(unichar) ch;
 
+/** The atom of `atomForCharacter:`, shared by every caller instead of made anew. The atom is frozen:
+ its setters raise an exception, in every build. Copy it to get one that can be changed. Lists can hold shared atoms, see
+ `-[MTMathList atoms]`. */
++ (nullable MTMathAtom*) sharedAtomForCharacter:(unichar) ch;
+
 /** Returns a `MTMathList` with one atom per character in the given string. This function
  does not do any LaTeX conversion or interpretation. It simply uses `atomForCharacter` to
  convert the characters to atoms. Any character that cannot be converted is ignored. */
@@ -100,6 +105,11 @@ FOUNDATION_EXPORT NSString *const MTSymbolDegree;
 + (nullable MTMathAtom*) atomForLatexSymbolName:(NSString*) symbolName
     NS_SWIFT_NAME(atom(forLatexSymbol:));
 
+/** The atom of `atomForLatexSymbolName:`, shared by every caller instead of copied. The atom is frozen:
+ its setters raise an exception, in every build. Copy it to get one that can be changed. */
++ (nullable MTMathAtom*) sharedAtomForLatexSymbolName:(NSString*) symbolName
+    NS_SWIFT_NAME(sharedAtom(forLatexSymbol:));
+
 /** Finds the name of the LaTeX symbol name for the given atom. This function is a reverse
  of the above function. If no latex symbol name corresponds to the atom, then this returns `nil`
  If nucleus of the atom is empty, then this will return `nil`.
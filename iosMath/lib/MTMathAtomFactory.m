@@ -11,6 +11,7 @@
 
 #import "MTMathAtomFactory.h"
 #import "MTMathListBuilder.h"
+#import "MTMathListInternal.h"
 
 NSString *const MTSymbolMultiplication = @"\u00D7";
 NSString *const MTSymbolDivision = @"\u00F7";
@@ -149,6 +150,29 @@ static const CGFloat kSmallMatrixInterColumnSpacing = 5;
     }
 }
 
++ (nullable MTMathAtom *)sharedAtomForCharacter:(unichar)ch
+{
+    // One frozen atom for each ASCII character, or NSNull if it has none.
+    static NSArray* atoms = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSMutableArray* array = [NSMutableArray arrayWithCapacity:128];
+        for (unichar c = 0; c < 128; c++) {
+            MTMathAtom* atom = [self atomForCharacter:c];
+            if (atom) {
+                MTMathAtomFreeze(atom);
+            }
+            [array addObject:atom ?: [NSNull null]];
+        }
+        atoms = [array copy];
+    });
+    if (ch >= atoms.count) {
+        return nil;
+    }
+    id atom = atoms[ch];
+    return (atom == [NSNull null]) ? nil : atom;
+}
+
 + (MTMathList *)mathListForCharacters:(NSString *)chars
 {
     NSParameterAssert(chars);
@@ -168,6 +192,12 @@ static const CGFloat kSmallMatrixInterColumnSpacing = 5;
 }
 
 + (nullable MTMathAtom *)atomForLatexSymbolName:(NSString *)symbolName
+{
+    // Return a copy of the atom since atoms are mutable.
+    return [[self sharedAtomForLatexSymbolName:symbolName] copy];
+}
+
++ (nullable MTMathAtom *)sharedAtomForLatexSymbolName:(NSString *)symbolName
 {
     NSParameterAssert(symbolName);
     NSDictionary* aliases = [MTMathAtomFactory aliases];
@@ -179,12 +209,7 @@ static const CGFloat kSmallMatrixInterColumnSpacing = 5;
     }
 
     NSDictionary* commands = [self supportedLatexSymbols];
-    MTMathAtom* atom = commands[symbolName];
-    if (atom) {
-        // Return a copy of the atom since atoms are mutable.
-        return [atom copy];
-    }
-    return nil;
+    return commands[symbolName];
 }
 
 + (nullable NSString*) latexSymbolNameForAtom:(MTMathAtom*) atom
@@ -192,7 +217,11 @@ static const CGFloat kSmallMatrixInterColumnSpacing = 5;
     if (atom.nucleus.length == 0) {
         return nil;
     }
-    NSDictionary<NSString*, NSDictionary<NSNumber*, NSString*>*>* dict = [MTMathAtomFactory textToLatexSymbolNames];
+    return [self latexSymbolNameForAtom:atom table:[MTMathAtomFactory textToLatexSymbolNames]];
+}
+
++ (nullable NSString*) latexSymbolNameForAtom:(MTMathAtom*) atom table:(NSDictionary<NSString*, NSDictionary<NSNumber*, NSString*>*>*) dict
+{
     NSDictionary<NSNumber*, NSString*>* inner = dict[atom.nucleus];
     if (!inner) {
         return nil;
@@ -220,8 +249,10 @@ static const CGFloat kSmallMatrixInterColumnSpacing = 5;
     // they are only read, and concurrent reads of an unmutated dictionary are
     // safe. Do not call this while parsing on another thread.
     NSMutableDictionary<NSString*, MTMathAtom*>* commands = [self supportedLatexSymbols];
-    commands[name] = [atom copy];   // copy on write — symmetric with the read side, which
-                                    // copies because atoms are mutable
+    // A frozen copy, as the built-in symbols are, since it is shared by the lists the parser makes.
+    MTMathAtom* shared = [atom copy];
+    MTMathAtomFreeze(shared);
+    commands[name] = shared;
     if (atom.nucleus.length != 0) {
         NSMutableDictionary<NSString*, NSMutableDictionary<NSNumber*, NSString*>*>* dict = [self textToLatexSymbolNames];
         NSMutableDictionary<NSNumber*, NSString*>* inner = dict[atom.nucleus];
@@ -585,7 +616,17 @@ static const CGFloat kSmallMatrixInterColumnSpacing = 5;
     static NSMutableDictionary<NSString*, MTMathAtom*>* commands = nil;
     static dispatch_once_t onceToken;
     dispatch_once(&onceToken, ^{
-        commands = [NSMutableDictionary dictionaryWithDictionary:@{
+        commands = [[self builtinLatexSymbols] mutableCopy];
+    });
+    return commands;
+}
+
++ (NSDictionary<NSString*, MTMathAtom*>*) builtinLatexSymbols
+{
+    static NSDictionary<NSString*, MTMathAtom*>* commands = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        commands = @{
                      // Greek characters
                      @"alpha" : [MTMathAtom atomWithType:kMTMathAtomVariable value:@"\u03B1"],
                      @"beta" : [MTMathAtom atomWithType:kMTMathAtomVariable value:@"\u03B2"],
@@ -992,7 +1033,11 @@ static const CGFloat kSmallMatrixInterColumnSpacing = 5;
                      @"textstyle" : [[MTMathStyle alloc] initWithStyle:kMTLineStyleText],
                      @"scriptstyle" : [[MTMathStyle alloc] initWithStyle:kMTLineStyleScript],
                      @"scriptscriptstyle" : [[MTMathStyle alloc] initWithStyle:kMTLineStyleScriptScript],
-                     }];
+                     };
+        // The atoms are shared, see sharedAtomForLatexSymbolName:.
+        for (MTMathAtom* atom in commands.objectEnumerator) {
+            MTMathAtomFreeze(atom);
+        }
     });
     return commands;
 }
@@ -1039,36 +1084,51 @@ static const CGFloat kSmallMatrixInterColumnSpacing = 5;
     static NSMutableDictionary<NSString*, NSMutableDictionary<NSNumber*, NSString*>*>* textToCommands = nil;
     static dispatch_once_t onceToken;
     dispatch_once(&onceToken, ^{
-        NSDictionary* commands = [self supportedLatexSymbols];
-        textToCommands = [NSMutableDictionary dictionaryWithCapacity:commands.count];
-        for (NSString* command in commands) {
-            MTMathAtom* atom = commands[command];
-            if (atom.nucleus.length == 0) {
-                continue;
-            }
-            NSNumber* typeKey = @(atom.type);
+        textToCommands = [self textToLatexSymbolNamesForSymbols:[self supportedLatexSymbols]];
+    });
+    return textToCommands;
+}
 
-            NSMutableDictionary<NSNumber*, NSString*>* inner = textToCommands[atom.nucleus];
-            if (!inner) {
-                inner = [NSMutableDictionary dictionaryWithCapacity:1];
-                textToCommands[atom.nucleus] = inner;
-            }
++ (NSDictionary<NSString*, NSDictionary<NSNumber*, NSString*>*>*) builtinTextToLatexSymbolNames
+{
+    static NSDictionary<NSString*, NSDictionary<NSNumber*, NSString*>*>* textToCommands = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        textToCommands = [self textToLatexSymbolNamesForSymbols:[self builtinLatexSymbols]];
+    });
+    return textToCommands;
+}
 
-            NSString* existingCommand = inner[typeKey];
-            if (existingCommand) {
-                // If there are 2 commands for the same (nucleus, type), choose
-                // one deterministically: shorter wins, alphabetical ascending breaks ties.
-                if (command.length > existingCommand.length) {
++ (NSMutableDictionary<NSString*, NSMutableDictionary<NSNumber*, NSString*>*>*) textToLatexSymbolNamesForSymbols:(NSDictionary<NSString*, MTMathAtom*>*) commands
+{
+    NSMutableDictionary<NSString*, NSMutableDictionary<NSNumber*, NSString*>*>* textToCommands = [NSMutableDictionary dictionaryWithCapacity:commands.count];
+    for (NSString* command in commands) {
+        MTMathAtom* atom = commands[command];
+        if (atom.nucleus.length == 0) {
+            continue;
+        }
+        NSNumber* typeKey = @(atom.type);
+
+        NSMutableDictionary<NSNumber*, NSString*>* inner = textToCommands[atom.nucleus];
+        if (!inner) {
+            inner = [NSMutableDictionary dictionaryWithCapacity:1];
+            textToCommands[atom.nucleus] = inner;
+        }
+
+        NSString* existingCommand = inner[typeKey];
+        if (existingCommand) {
+            // If there are 2 commands for the same (nucleus, type), choose
+            // one deterministically: shorter wins, alphabetical ascending breaks ties.
+            if (command.length > existingCommand.length) {
+                continue;
+            } else if (command.length == existingCommand.length) {
+                if ([command compare:existingCommand] == NSOrderedDescending) {
                     continue;
-                } else if (command.length == existingCommand.length) {
-                    if ([command compare:existingCommand] == NSOrderedDescending) {
-                        continue;
-                    }
                 }
             }
-            inner[typeKey] = command;
         }
-    });
+        inner[typeKey] = command;
+    }
     return textToCommands;
 }
 
@@ -1285,8 +1345,8 @@ static const CGFloat kSmallMatrixInterColumnSpacing = 5;
 {
     // Option I: inherit a lone Bin/Rel base atom's INTRINSIC class (read before
     // finalize's Bin->Ord reclassification, matching amsmath \binrel@); else Ordinary.
-    if (base.atoms.count == 1) {
-        MTMathAtomType t = ((MTMathAtom*)base.atoms[0]).type;
+    if (base.atomsForReading.count == 1) {
+        MTMathAtomType t = ((MTMathAtom*)base.atomsForReading[0]).type;
         if (t == kMTMathAtomBinaryOperator || t == kMTMathAtomRelation) {
             return t;
         }
@@ -12,6 +12,9 @@
 @import Foundation;
 @import CoreGraphics;
 
+#import "MTRGBAColor.h"
+#import "MTMathListIndex.h"
+
 NS_ASSUME_NONNULL_BEGIN
 
 @class MTMathList;
@@ -209,6 +212,24 @@ typedef NS_ENUM(NSUInteger, MTTextStyle)
 /// Returns a finalized copy of the atom
 - (instancetype) finalized;
 
+/// Whether the atom is part of a `-[MTMathList frozenCopy]`, or is one of the shared atoms of
+/// `MTMathAtomFactory`. A frozen atom can not be changed: its setters raise an exception.
+@property (nonatomic, readonly, getter=isFrozen) BOOL frozen;
+
+/** A 64-bit structural hash of the atom and everything below it: its type, nucleus, font style and
+ the fields of its class, its scripts and inner lists, table cells, colors and stack constructions,
+ i.e. everything that `archivedData` keeps. Atoms with the same fingerprint are equal but for a chance
+ of about 2^-64, so it can key caches and find duplicate subtrees. It is computed from the
+ fingerprints of the lists below the atom and cached on it.
+
+ Changing an atom or list whose fingerprint was computed invalidates its cached fingerprint and those
+ of the lists and atoms above it, which are computed again on their next use. An atom or list that is
+ held by more than one list or atom, like the lists that the versions of an `MTPersistentMathList`
+ share, invalidates every cached fingerprint instead. Atoms and lists that are built without being
+ fingerprinted invalidate nothing. Fingerprints are the same in every launch of the process, but may
+ change with the version of the library. */
+@property (nonatomic, readonly) uint64_t fingerprint;
+
 @end
 
 /**
@@ -600,8 +621,13 @@ typedef NS_ENUM(NSUInteger, MTMathStackConstructionKind) {
 /// Creates an empty color with a nil environment
 - (instancetype) init NS_DESIGNATED_INITIALIZER;
 
-/** The style represented by this object. */
-@property (nonatomic, nullable) NSString* colorString;
+/** The color as spelled in the LaTeX: `#RGB`, `#RRGGBB` or a color name (see
+ `MTRGBAColorFromString`). Setting it decodes `rgbaColor`. */
+@property (nonatomic, nullable, copy) NSString* colorString;
+
+/** The decoded `colorString`, or 0 if it is nil or not a color. Decoded colors are opaque, so
+ 0 never stands for a color. */
+@property (nonatomic, readonly) MTRGBAColor rgbaColor;
 
 /// The inner math list
 @property (nonatomic, nullable) MTMathList* innerList;
@@ -617,8 +643,13 @@ typedef NS_ENUM(NSUInteger, MTMathStackConstructionKind) {
 /// Creates an empty color with a nil environment
 - (instancetype) init NS_DESIGNATED_INITIALIZER;
 
-/** The style represented by this object. */
-@property (nonatomic, nullable) NSString* colorString;
+/** The color as spelled in the LaTeX: `#RGB`, `#RRGGBB` or a color name (see
+ `MTRGBAColorFromString`). Setting it decodes `rgbaColor`. */
+@property (nonatomic, nullable, copy) NSString* colorString;
+
+/** The decoded `colorString`, or 0 if it is nil or not a color. Decoded colors are opaque, so
+ 0 never stands for a color. */
+@property (nonatomic, readonly) MTRGBAColor rgbaColor;
 
 /// The inner math list
 @property (nonatomic, nullable) MTMathList* innerList;
@@ -788,9 +819,17 @@ typedef NS_ENUM(NSInteger, MTColumnAlignment) {
 /** Create a `MTMathList` given a list of atoms. */
 + (instancetype) mathListWithAtomsArray:(NSArray<MTMathAtom*>*) atoms;
 
-/// A list of MathAtoms
+/** A list of MathAtoms. A list that is not frozen may hold frozen atoms that it shares with other
+ lists, such as the shared atoms of `MTMathAtomFactory` that the parser uses. The first time this is
+ called the list replaces them with copies of its own, so the atoms returned can be changed. The atoms
+ of a frozen list are never copied. */
 @property (nonatomic, readonly) NSArray<__kindof MTMathAtom*>* atoms;
 
+/** The atoms, including the shared atoms that `atoms` would replace with copies. Nothing is copied,
+ so this is what code that reads the list without changing its atoms should use. The shared atoms
+ are frozen and throw if they are changed. */
+@property (nonatomic, readonly) NSArray<__kindof MTMathAtom*>* atomsForReading;
+
 /** Initializes an empty math list. */
 - (instancetype) init NS_DESIGNATED_INITIALIZER;
 
@@ -833,12 +872,49 @@ typedef NS_ENUM(NSInteger, MTColumnAlignment) {
 
 /// Create a new math list as a final expression and update atoms
 /// by combining like atoms that occur together and converting unary operators to binary operators.
-/// This function does not modify the current MTMathList
+/// This function does not modify the current MTMathList. A frozen list is already final and is returned as it is.
 - (MTMathList*) finalized;
 
+/** A finalized snapshot of the list that can not be changed. Every list and atom in it is frozen, and
+ changing one raises an exception. The typesetter only reads a frozen list, and does not copy it
+ before the layout as it does other lists, so one snapshot can be typeset on any number of threads at
+ once, e.g. at several sizes. `copy` gives back a list that can be changed. Returns the list itself if it
+ is frozen. */
+- (MTMathList*) frozenCopy;
+
+/// Whether the list is part of a `frozenCopy`.
+@property (nonatomic, readonly, getter=isFrozen) BOOL frozen;
+
 /// Makes a deep copy of the list
 - (id)copyWithZone:(nullable NSZone *)zone;
 
+/** Encodes the list in a compact, versioned binary format, e.g. to store or send it without
+ going through LaTeX. Every atom is kept with all of its fields, including the index ranges
+ and fused atoms of a finalized list. Returns nil if the list holds an atom of a class that
+ is not part of the library. */
+- (nullable NSData*) archivedData;
+
+/** Decodes a list from `archivedData`. Returns nil if the data is corrupt or was written by
+ another version of the format. */
++ (nullable instancetype) mathListWithArchivedData:(NSData*) data;
+
+/** The approximate number of bytes of memory held by the list: its atoms, their strings, and
+ their scripts and inner lists. */
+- (NSUInteger) retainedSize;
+
+/** The atom that `index` points at, following its subindexes into scripts, fractions, radicals and
+ inner lists, in time proportional to its depth. An index into the nucleus of an atom gives the atom.
+ Returns nil if there is no atom at the index. The lists are read with `atomsForReading`, so the atom
+ may be a frozen atom that its list shares. */
+- (nullable MTMathAtom*) atomAtListIndex:(MTMathListIndex*) index;
+
+/** Same as `atomAtListIndex:` for an index path. Does not allocate. */
+- (nullable MTMathAtom*) atomAtIndexPath:(MTMathListIndexPath) path;
+
+/** The structural hash of the list: its atom count and the fingerprints of its atoms, see
+ `-[MTMathAtom fingerprint]`. */
+@property (nonatomic, readonly) uint64_t fingerprint;
+
 @end
 
 NS_ASSUME_NONNULL_END
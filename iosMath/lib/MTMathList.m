@@ -10,8 +10,16 @@
 //
 
 #import "MTMathList.h"
+#import "MTMathListInternal.h"
 #import "MTMathListBuilder.h"
 #import "MTMathAtomFactory.h"
+#import "MTMathParserContextInternal.h"
+#import "MTMathListArchiver.h"
+#import "MTMathListHasher.h"
+#import "MTInstrumentationInternal.h"
+#import "MTRetainedSize.h"
+#include <stdatomic.h>
+#include <os/lock.h>
 
 // Returns true if the current binary operator is not really binary.
 static BOOL isNotBinaryOperator(MTMathAtom* prevNode)
@@ -107,20 +115,154 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return [NSString stringWithFormat:@"atopwithdelims%@%@", leftDelimiter, rightDelimiter];
 }
 
+#pragma mark - Fingerprints
+
+// The fingerprint of an atom or list is computed from the fingerprints of its children and cached on it,
+// so a change clears the cache of the node changed and of the nodes above it. The hasher links each
+// child to the node it is fingerprinted under, its parent. A cached node has only cached children, so
+// clearing stops at the first node that is not cached: the lists and atoms that are built without being
+// fingerprinted clear nothing.
+//
+// A node that is fingerprinted under a second parent, like the lists that the versions of an
+// `MTPersistentMathList` share, does not know all the nodes above it. A change to it starts a new epoch,
+// which invalidates every cached fingerprint.
+static _Atomic(uint64_t) MTFingerprintEpoch = 1;
+
+typedef struct {
+    _Atomic(uint64_t) value;
+    // The epoch the value was computed in, 0 if it is not cached.
+    _Atomic(uint64_t) epoch;
+    // Whether the node was fingerprinted under more than one parent.
+    _Atomic(bool) shared;
+} MTFingerprintCache;
+
+// The atoms and lists.
+@protocol MTFingerprintNode <NSObject>
+
+@property (nonatomic, readonly) MTFingerprintCache* fingerprintCache;
+// The node whose fingerprint was last computed from the one of this node.
+@property (nonatomic, weak) id<MTFingerprintNode> fingerprintParent;
+@property (nonatomic, readonly, getter=isFrozen) BOOL frozen;
+
+@end
+
+static inline uint64_t MTCurrentFingerprintEpoch(void)
+{
+    return atomic_load_explicit(&MTFingerprintEpoch, memory_order_relaxed);
+}
+
+// Within an epoch the fingerprint of an atom or list is the same for every thread that computes it.
+static inline BOOL MTFingerprintCacheGet(MTFingerprintCache* cache, uint64_t epoch, uint64_t* value)
+{
+    if (atomic_load_explicit(&cache->epoch, memory_order_acquire) != epoch) {
+        return NO;
+    }
+    *value = atomic_load_explicit(&cache->value, memory_order_relaxed);
+    return YES;
+}
+
+static inline void MTFingerprintCacheSet(MTFingerprintCache* cache, uint64_t epoch, uint64_t value)
+{
+    atomic_store_explicit(&cache->value, value, memory_order_relaxed);
+    atomic_store_explicit(&cache->epoch, epoch, memory_order_release);
+}
+
+// Clears the cached fingerprints of `node` and of the nodes above it.
+static void MTFingerprintInvalidate(id<MTFingerprintNode> node)
+{
+    uint64_t epoch = MTCurrentFingerprintEpoch();
+    while (node) {
+        MTFingerprintCache* cache = node.fingerprintCache;
+        if (atomic_load_explicit(&cache->epoch, memory_order_relaxed) != epoch) {
+            return;
+        }
+        atomic_store_explicit(&cache->epoch, 0, memory_order_relaxed);
+        if (atomic_load_explicit(&cache->shared, memory_order_relaxed)) {
+            atomic_fetch_add_explicit(&MTFingerprintEpoch, 1, memory_order_relaxed);
+            return;
+        }
+        node = node.fingerprintParent;
+    }
+}
+
+// Guards the links from a child to its parent, which the threads that fingerprint a tree all set.
+static os_unfair_lock MTFingerprintParentLock = OS_UNFAIR_LOCK_INIT;
+
+void MTFingerprintLinkParent(id child, id parent)
+{
+    id<MTFingerprintNode> node = child;
+    if (node.frozen || node.fingerprintParent == parent) {
+        // A frozen node never changes.
+        return;
+    }
+    os_unfair_lock_lock(&MTFingerprintParentLock);
+    id<MTFingerprintNode> current = node.fingerprintParent;
+    if (!current) {
+        node.fingerprintParent = parent;
+    } else if (current != parent) {
+        atomic_store_explicit(&node.fingerprintCache->shared, true, memory_order_relaxed);
+    }
+    os_unfair_lock_unlock(&MTFingerprintParentLock);
+}
+
+// Called when `child` is taken out of `parent`, so that it can be linked to another parent.
+static void MTFingerprintUnlinkParent(id<MTFingerprintNode> child, id parent)
+{
+    if (!child || child.frozen || child.fingerprintParent != parent) {
+        return;
+    }
+    os_unfair_lock_lock(&MTFingerprintParentLock);
+    if (child.fingerprintParent == parent) {
+        child.fingerprintParent = nil;
+    }
+    os_unfair_lock_unlock(&MTFingerprintParentLock);
+}
+
+// A setter of a field that the fingerprint covers.
+#define MT_FINGERPRINTED_SETTER(Type, setter, ivar) \
+    - (void) setter:(Type) value \
+    { \
+        [self invalidateFingerprint]; \
+        ivar = value; \
+    }
+
+// A setter of a child list that the fingerprint covers.
+#define MT_FINGERPRINTED_CHILD_SETTER(Type, setter, ivar) \
+    - (void) setter:(Type) value \
+    { \
+        [self invalidateFingerprint]; \
+        MTFingerprintUnlinkParent((id) ivar, self); \
+        ivar = value; \
+    }
+
 #pragma mark - MTMathAtom
 
-@interface MTMathAtom ()
+@interface MTMathAtom () <MTRetainedSizeWalking, MTFingerprintNode>
 
 @property (nonatomic) NSRange indexRange;
 
+// Called before a field that the fingerprint covers changes.
+- (void) invalidateFingerprint;
+
+// Makes the atom frozen. Only for the atoms of a frozen copy.
+- (void) freeze;
+
 - (instancetype)initWithType:(MTMathAtomType)type value:(NSString *)value NS_DESIGNATED_INITIALIZER;
 
 @end
 
 @implementation MTMathAtom {
     NSMutableArray* _fusedAtoms;
+    MTFingerprintCache _fingerprintCache;
+    BOOL _frozen;
 }
 
+@synthesize fingerprintParent = _fingerprintParent;
+
+MT_FINGERPRINTED_SETTER(MTMathAtomType, setType, _type)
+MT_FINGERPRINTED_SETTER(MTFontStyle, setFontStyle, _fontStyle)
+MT_FINGERPRINTED_SETTER(NSRange, setIndexRange, _indexRange)
+
 + (instancetype)atomWithType:(MTMathAtomType)type value:(NSString *)value
 {
     switch (type) {
@@ -181,6 +323,7 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 {
     self = [super init];
     if (self) {
+        MTCountEvent(kMTLayoutCounterAtoms);
         _type = type;
         _nucleus = [value copy];
     }
@@ -219,6 +362,84 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return atom;
 }
 
+#pragma mark Archiving
+
+- (void) encodeWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeUInteger:self.type];
+    [archiver encodeString:self.nucleus];
+    [self encodeContentsWithArchiver:archiver];
+    [archiver encodeUInteger:self.fontStyle];
+    [archiver encodeRange:self.indexRange];
+    [archiver encodeMathList:self.superScript];
+    [archiver encodeMathList:self.subScript];
+    [archiver encodeUInteger:_fusedAtoms.count];
+    for (MTMathAtom* atom in _fusedAtoms) {
+        [archiver encodeAtom:atom];
+    }
+}
+
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+}
+
+// Whether `type` is one of the values of MTMathAtomType.
+static BOOL MTIsMathAtomType(NSUInteger type)
+{
+    return (type >= kMTMathAtomOrdinary && type <= kMTMathAtomOrdGroup)
+        || type == kMTMathAtomBoundary
+        || (type >= kMTMathAtomSpace && type <= kMTMathAtomColorbox)
+        || type == kMTMathAtomTable;
+}
+
++ (instancetype) atomWithUnarchiver:(MTMathListUnarchiver*) unarchiver
+{
+    MTMathAtomType type = [unarchiver decodeUInteger];
+    NSString* nucleus = [unarchiver decodeString];
+    if (!MTIsMathAtomType(type)) {
+        [unarchiver fail];
+    }
+    if (unarchiver.failed) {
+        return nil;
+    }
+    MTMathAtom* atom = [self decodeContentsWithUnarchiver:unarchiver type:type nucleus:nucleus];
+    if (!atom || unarchiver.failed) {
+        return nil;
+    }
+    // As in copyWithZone:, the subclasses are created with their own type and nucleus.
+    atom.type = type;
+    if (nucleus) {
+        atom.nucleus = nucleus;
+    }
+    atom.fontStyle = [unarchiver decodeUIntegerUpTo:kMTFontStyleBoldItalic];
+    atom.indexRange = [unarchiver decodeRange];
+    MTMathList* superScript = [unarchiver decodeMathList];
+    MTMathList* subScript = [unarchiver decodeMathList];
+    if ((superScript || subScript) && !atom.scriptsAllowed) {
+        [unarchiver fail];
+        return nil;
+    }
+    atom.superScript = superScript;
+    atom.subScript = subScript;
+    NSUInteger fusedCount = [unarchiver decodeUInteger];
+    if (fusedCount > 0) {
+        NSMutableArray* fusedAtoms = [NSMutableArray array];
+        for (NSUInteger i = 0; i < fusedCount && !unarchiver.failed; i++) {
+            MTMathAtom* fused = [unarchiver decodeAtom];
+            if (fused) {
+                [fusedAtoms addObject:fused];
+            }
+        }
+        atom->_fusedAtoms = fusedAtoms;
+    }
+    return unarchiver.failed ? nil : atom;
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    return [[self alloc] initWithType:type value:nucleus];
+}
+
 - (bool)scriptsAllowed
 {
     return (self.type < kMTMathAtomBoundary);
@@ -231,6 +452,8 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
                                           reason:[NSString stringWithFormat:@"Subscripts not allowed for atom of type %@", typeToText(self.type)]
                                         userInfo:nil];
     }
+    [self invalidateFingerprint];
+    MTFingerprintUnlinkParent(_subScript, self);
     _subScript = subScript;
 }
 
@@ -241,9 +464,60 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
                                           reason:[NSString stringWithFormat:@"Superscripts not allowed for atom of type %@", typeToText(self.type)]
                                         userInfo:nil];
     }
+    [self invalidateFingerprint];
+    MTFingerprintUnlinkParent(_superScript, self);
     _superScript = superScript;
 }
 
+- (void)setNucleus:(NSString *)nucleus
+{
+    [self invalidateFingerprint];
+    _nucleus = [nucleus copy];
+}
+
+- (uint64_t)fingerprint
+{
+    return [self fingerprintWithHasher:nil];
+}
+
+- (uint64_t) fingerprintWithHasher:(MTMathListHasher*) hasher
+{
+    uint64_t epoch = MTCurrentFingerprintEpoch();
+    uint64_t fingerprint;
+    if (MTFingerprintCacheGet(&_fingerprintCache, epoch, &fingerprint)) {
+        return fingerprint;
+    }
+    fingerprint = [(hasher ?: [MTMathListHasher new]) hashOfAtom:self];
+    MTFingerprintCacheSet(&_fingerprintCache, epoch, fingerprint);
+    return fingerprint;
+}
+
+- (void) invalidateFingerprint
+{
+    if (_frozen) {
+        // Not an assertion: a frozen atom may be read on other threads, in release builds too.
+        @throw [[NSException alloc] initWithName:@"Error"
+                                          reason:[NSString stringWithFormat:@"A frozen atom can not be changed: %@", self]
+                                        userInfo:nil];
+    }
+    MTFingerprintInvalidate(self);
+}
+
+- (MTFingerprintCache *)fingerprintCache
+{
+    return &_fingerprintCache;
+}
+
+- (BOOL)isFrozen
+{
+    return _frozen;
+}
+
+- (void) freeze
+{
+    _frozen = YES;
+}
+
 - (NSString *)description
 {
     NSMutableString* str = [NSMutableString stringWithString:typeToText(self.type)];
@@ -256,6 +530,7 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     NSAssert(!self.subScript, @"Cannot fuse into an atom which has a subscript: %@", self);
     NSAssert(!self.superScript, @"Cannot fuse into an atom which has a superscript: %@", self);
     NSAssert(atom.type == self.type, @"Only atoms of the same type can be fused. %@, %@", self, atom);
+    [self invalidateFingerprint];
     
     // Update the fused atoms list
     if (!_fusedAtoms) {
@@ -305,7 +580,7 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
         // math minus
         [str appendString:@"-"];
     } else {
-        NSString* command = [MTMathAtomFactory latexSymbolNameForAtom:self];
+        NSString* command = MTMathParserContextLatexSymbolName(self);
         if (command) {
             [str appendFormat:@"\\%@ ", command];
         } else {
@@ -320,6 +595,14 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 
 @implementation MTFraction
 
+MT_FINGERPRINTED_CHILD_SETTER(MTMathList*, setNumerator, _numerator)
+MT_FINGERPRINTED_CHILD_SETTER(MTMathList*, setDenominator, _denominator)
+MT_FINGERPRINTED_SETTER(NSString*, setLeftDelimiter, _leftDelimiter)
+MT_FINGERPRINTED_SETTER(NSString*, setRightDelimiter, _rightDelimiter)
+MT_FINGERPRINTED_SETTER(MTFractionStyle, setStyleOverride, _styleOverride)
+MT_FINGERPRINTED_SETTER(BOOL, setIsContinuedFraction, _isContinuedFraction)
+MT_FINGERPRINTED_SETTER(MTFractionAlignment, setNumeratorAlignment, _numeratorAlignment)
+
 - (instancetype)init
 {
     return [self initWithRule:true];
@@ -381,6 +664,31 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return frac;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeBool:self.hasRule];
+    [archiver encodeMathList:self.numerator];
+    [archiver encodeMathList:self.denominator];
+    [archiver encodeString:self.leftDelimiter];
+    [archiver encodeString:self.rightDelimiter];
+    [archiver encodeUInteger:self.styleOverride];
+    [archiver encodeBool:self.isContinuedFraction];
+    [archiver encodeUInteger:self.numeratorAlignment];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    MTFraction* frac = [[self alloc] initWithRule:[unarchiver decodeBool]];
+    frac.numerator = [unarchiver decodeMathList];
+    frac.denominator = [unarchiver decodeMathList];
+    frac.leftDelimiter = [unarchiver decodeString];
+    frac.rightDelimiter = [unarchiver decodeString];
+    frac.styleOverride = [unarchiver decodeUIntegerUpTo:kMTFractionStyleScriptScript];
+    frac.isContinuedFraction = [unarchiver decodeBool];
+    frac.numeratorAlignment = [unarchiver decodeUIntegerUpTo:kMTFractionAlignmentRight];
+    return frac;
+}
+
 - (instancetype)finalized
 {
     MTFraction* newFrac = [super finalized];
@@ -424,6 +732,9 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 
 @implementation MTRadical
 
+MT_FINGERPRINTED_CHILD_SETTER(MTMathList*, setRadicand, _radicand)
+MT_FINGERPRINTED_CHILD_SETTER(MTMathList*, setDegree, _degree)
+
 - (instancetype)init
 {
     // radicals have no nucleus
@@ -466,6 +777,20 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return rad;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeMathList:self.radicand];
+    [archiver encodeMathList:self.degree];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    MTRadical* rad = [[self alloc] init];
+    rad.radicand = [unarchiver decodeMathList];
+    rad.degree = [unarchiver decodeMathList];
+    return rad;
+}
+
 - (instancetype)finalized
 {
     MTRadical* newRad = [super finalized];
@@ -489,6 +814,8 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 
 @implementation MTLargeOperator
 
+MT_FINGERPRINTED_SETTER(BOOL, setLimits, _limits)
+
 - (instancetype) initWithValue:(NSString*) value limits:(BOOL) limits
 {
     self = [super initWithType:kMTMathAtomLargeOperator value:value];
@@ -515,10 +842,20 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return op;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeBool:self.limits];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    return [[self alloc] initWithValue:nucleus limits:[unarchiver decodeBool]];
+}
+
 - (void)appendLaTeXToString:(NSMutableString *)str
 {
-    NSString* command = [MTMathAtomFactory latexSymbolNameForAtom:self];
-    MTLargeOperator* originalOp = (MTLargeOperator*) [MTMathAtomFactory atomForLatexSymbolName:command];
+    NSString* command = MTMathParserContextLatexSymbolName(self);
+    MTLargeOperator* originalOp = (MTLargeOperator*) MTMathParserContextAtom(command);
     [str appendFormat:@"\\%@ ", command];
     if (originalOp.limits != self.limits) {
         [str appendString:(self.limits ? @"\\limits " : @"\\nolimits ")];
@@ -531,6 +868,8 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 
 @implementation MTInner
 
+MT_FINGERPRINTED_CHILD_SETTER(MTMathList*, setInnerList, _innerList)
+
 - (instancetype)init
 {
     // inner atoms have no nucleus
@@ -555,6 +894,7 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
                                           reason:[NSString stringWithFormat:@"Left boundary must be of type kMTMathAtomBoundary"]
                                         userInfo:nil];
     }
+    [self invalidateFingerprint];
     _leftBoundary = leftBoundary;
 }
 
@@ -565,6 +905,7 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
                                           reason:[NSString stringWithFormat:@"Left boundary must be of type kMTMathAtomBoundary"]
                                         userInfo:nil];
     }
+    [self invalidateFingerprint];
     _rightBoundary = rightBoundary;
 }
 
@@ -597,6 +938,28 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return inner;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeMathList:self.innerList];
+    [archiver encodeAtom:self.leftBoundary];
+    [archiver encodeAtom:self.rightBoundary];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    MTInner* inner = [[self alloc] init];
+    inner.innerList = [unarchiver decodeMathList];
+    MTMathAtom* leftBoundary = [unarchiver decodeAtom];
+    MTMathAtom* rightBoundary = [unarchiver decodeAtom];
+    if ((leftBoundary && leftBoundary.type != kMTMathAtomBoundary)
+        || (rightBoundary && rightBoundary.type != kMTMathAtomBoundary)) {
+        return nil;
+    }
+    inner.leftBoundary = leftBoundary;
+    inner.rightBoundary = rightBoundary;
+    return inner;
+}
+
 - (instancetype)finalized
 {
     MTInner *newInner = [super finalized];
@@ -629,6 +992,8 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 
 @implementation MTOverLine
 
+MT_FINGERPRINTED_CHILD_SETTER(MTMathList*, setInnerList, _innerList)
+
 - (instancetype)init
 {
     self = [super initWithType:kMTMathAtomOverline value:@""];
@@ -652,6 +1017,18 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return op;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeMathList:self.innerList];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    MTOverLine* over = [[self alloc] init];
+    over.innerList = [unarchiver decodeMathList];
+    return over;
+}
+
 - (instancetype)finalized
 {
     MTOverLine* newOverline = [super finalized];
@@ -670,6 +1047,8 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 
 @implementation MTUnderLine
 
+MT_FINGERPRINTED_CHILD_SETTER(MTMathList*, setInnerList, _innerList)
+
 - (instancetype)init
 {
     self = [super initWithType:kMTMathAtomUnderline value:@""];
@@ -693,6 +1072,18 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return op;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeMathList:self.innerList];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    MTUnderLine* under = [[self alloc] init];
+    under.innerList = [unarchiver decodeMathList];
+    return under;
+}
+
 - (instancetype)finalized
 {
     MTUnderLine* newUnderline = [super finalized];
@@ -711,6 +1102,8 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 
 @implementation MTAccent
 
+MT_FINGERPRINTED_CHILD_SETTER(MTMathList*, setInnerList, _innerList)
+
 - (instancetype)initWithValue:(NSString *)value
 {
     self = [super initWithType:kMTMathAtomAccent value:value];
@@ -734,6 +1127,18 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return op;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeMathList:self.innerList];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    MTAccent* accent = [[self alloc] initWithValue:nucleus];
+    accent.innerList = [unarchiver decodeMathList];
+    return accent;
+}
+
 - (instancetype)finalized
 {
     MTAccent* newAccent = [super finalized];
@@ -794,6 +1199,23 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return copy;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeUInteger:self.delimiterSize];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    MTDelimiterSize size = [unarchiver decodeUInteger];
+    // Checked, since the initializer asserts them.
+    if (!nucleus || size < kMTDelimiterSize1 || size > kMTDelimiterSize4
+        || !(type == kMTMathAtomOrdinary || type == kMTMathAtomOpen
+             || type == kMTMathAtomClose || type == kMTMathAtomRelation)) {
+        return nil;
+    }
+    return [[self alloc] initWithDelimiterNucleus:nucleus mathClass:type size:size];
+}
+
 - (void)appendLaTeXToString:(NSMutableString *)str
 {
     NSString* prefix = nil;
@@ -866,6 +1288,16 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return op;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeFloat:self.space];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    return [[self alloc] initWithSpace:[unarchiver decodeFloat]];
+}
+
 - (void)appendLaTeXToString:(NSMutableString *)str
 {
     NSString* command = [MTMathListBuilder spaceToCommands][@(self.space)];
@@ -908,6 +1340,16 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return op;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeUInteger:self.style];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    return [[self alloc] initWithStyle:(MTLineStyle) [unarchiver decodeUIntegerUpTo:kMTLineStyleScriptScript]];
+}
+
 - (void)appendLaTeXToString:(NSMutableString *)str
 {
     NSString* command = [MTMathListBuilder styleToCommands][@(self.style)];
@@ -920,6 +1362,8 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 
 @implementation MTMathColor
 
+MT_FINGERPRINTED_CHILD_SETTER(MTMathList*, setInnerList, _innerList)
+
 
 - (instancetype)init
 {
@@ -944,14 +1388,40 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return str;
 }
 
+- (void)setColorString:(NSString *)colorString
+{
+    [self invalidateFingerprint];
+    _colorString = [colorString copy];
+    // Decoded once here rather than on every layout.
+    _rgbaColor = 0;
+    if (colorString) {
+        MTRGBAColorFromString(colorString, &_rgbaColor);
+    }
+}
+
 - (id)copyWithZone:(NSZone *)zone
 {
     MTMathColor* op = [super copyWithZone:zone];
     op.innerList = [self.innerList copyWithZone:zone];
     op->_colorString = self.colorString;
+    op->_rgbaColor = self.rgbaColor;
     return op;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeString:self.colorString];
+    [archiver encodeMathList:self.innerList];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    MTMathColor* color = [[self alloc] init];
+    color.colorString = [unarchiver decodeString];
+    color.innerList = [unarchiver decodeMathList];
+    return color;
+}
+
 - (instancetype)finalized
 {
     MTMathColor *newInner = [super finalized];
@@ -965,6 +1435,8 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 
 @implementation MTMathColorbox
 
+MT_FINGERPRINTED_CHILD_SETTER(MTMathList*, setInnerList, _innerList)
+
 
 - (instancetype)init
 {
@@ -989,14 +1461,39 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return str;
 }
 
+- (void)setColorString:(NSString *)colorString
+{
+    [self invalidateFingerprint];
+    _colorString = [colorString copy];
+    _rgbaColor = 0;
+    if (colorString) {
+        MTRGBAColorFromString(colorString, &_rgbaColor);
+    }
+}
+
 - (id)copyWithZone:(NSZone *)zone
 {
     MTMathColorbox* op = [super copyWithZone:zone];
     op.innerList = [self.innerList copyWithZone:zone];
     op->_colorString = self.colorString;
+    op->_rgbaColor = self.rgbaColor;
     return op;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeString:self.colorString];
+    [archiver encodeMathList:self.innerList];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    MTMathColorbox* colorbox = [[self alloc] init];
+    colorbox.colorString = [unarchiver decodeString];
+    colorbox.innerList = [unarchiver decodeMathList];
+    return colorbox;
+}
+
 - (instancetype)finalized
 {
     MTMathColorbox *newInner = [super finalized];
@@ -1011,6 +1508,14 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 
 @implementation MTMathBox
 
+MT_FINGERPRINTED_CHILD_SETTER(MTMathList*, setInnerList, _innerList)
+MT_FINGERPRINTED_SETTER(BOOL, setKeepWidth, _keepWidth)
+MT_FINGERPRINTED_SETTER(BOOL, setKeepHeight, _keepHeight)
+MT_FINGERPRINTED_SETTER(BOOL, setKeepDepth, _keepDepth)
+MT_FINGERPRINTED_SETTER(BOOL, setDrawChild, _drawChild)
+MT_FINGERPRINTED_SETTER(MTBoxHAlign, setHAlign, _hAlign)
+MT_FINGERPRINTED_SETTER(MTStrikeStyle, setStrikeStyle, _strikeStyle)
+
 - (instancetype)init
 {
     self = [super initWithType:kMTMathAtomBox value:@""];
@@ -1093,6 +1598,30 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return op;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeMathList:self.innerList];
+    [archiver encodeBool:self.keepWidth];
+    [archiver encodeBool:self.keepHeight];
+    [archiver encodeBool:self.keepDepth];
+    [archiver encodeBool:self.drawChild];
+    [archiver encodeUInteger:self.hAlign];
+    [archiver encodeUInteger:self.strikeStyle];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    MTMathBox* box = [[self alloc] init];
+    box.innerList = [unarchiver decodeMathList];
+    box.keepWidth = [unarchiver decodeBool];
+    box.keepHeight = [unarchiver decodeBool];
+    box.keepDepth = [unarchiver decodeBool];
+    box.drawChild = [unarchiver decodeBool];
+    box.hAlign = [unarchiver decodeUIntegerUpTo:kMTBoxHAlignRight];
+    box.strikeStyle = [unarchiver decodeUIntegerUpTo:kMTStrikeHorizontal];
+    return box;
+}
+
 - (instancetype)finalized
 {
     MTMathBox *newBox = [super finalized];
@@ -1106,6 +1635,8 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 
 @implementation MTMathGroup
 
+MT_FINGERPRINTED_CHILD_SETTER(MTMathList*, setInnerList, _innerList)
+
 - (instancetype)init
 {
     self = [super initWithType:kMTMathAtomOrdGroup value:@""];
@@ -1153,6 +1684,22 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return group;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeMathList:self.innerList];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    MTMathList* innerList = [unarchiver decodeMathList];
+    if (!innerList) {
+        return nil;
+    }
+    MTMathGroup* group = [[self alloc] init];
+    group.innerList = innerList;
+    return group;
+}
+
 - (instancetype)finalized
 {
     MTMathGroup* newGroup = [super finalized];
@@ -1173,18 +1720,35 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 
 @implementation MTMathTable
 
+MT_FINGERPRINTED_SETTER(NSString*, setEnvironment, _environment)
+MT_FINGERPRINTED_SETTER(CGFloat, setInterColumnSpacing, _interColumnSpacing)
+MT_FINGERPRINTED_SETTER(CGFloat, setInterRowAdditionalSpacing, _interRowAdditionalSpacing)
+MT_FINGERPRINTED_SETTER(MTLineStyle, setCellStyle, _cellStyle)
+
+- (void)setVerticalLines:(NSArray<NSNumber *> *)verticalLines
+{
+    [self invalidateFingerprint];
+    _verticalLines = [verticalLines copy];
+}
+
+- (void)setHorizontalLines:(NSArray<NSNumber *> *)horizontalLines
+{
+    [self invalidateFingerprint];
+    _horizontalLines = [horizontalLines copy];
+}
+
 - (MTMathList *)serializedCellAtRow:(NSUInteger)row column:(NSUInteger)column
 {
     MTMathList* cell = self.cells[row][column];
     if ([self.environment isEqualToString:@"eqalign"] || [self.environment isEqualToString:@"aligned"] || [self.environment isEqualToString:@"split"]) {
-        if (column == 1 && cell.atoms.count >= 1 && cell.atoms[0].type == kMTMathAtomOrdinary && cell.atoms[0].nucleus.length == 0) {
-            NSArray* atoms = [cell.atoms subarrayWithRange:NSMakeRange(1, cell.atoms.count - 1)];
+        if (column == 1 && cell.atomsForReading.count >= 1 && cell.atomsForReading[0].type == kMTMathAtomOrdinary && cell.atomsForReading[0].nucleus.length == 0) {
+            NSArray* atoms = [cell.atomsForReading subarrayWithRange:NSMakeRange(1, cell.atomsForReading.count - 1)];
             return [MTMathList mathListWithAtomsArray:atoms];
         }
     }
     if ([self.environment isEqualToString:@"alignedat"]) {
-        if (column % 2 == 1 && cell.atoms.count >= 1 && cell.atoms[0].type == kMTMathAtomOrdinary && cell.atoms[0].nucleus.length == 0) {
-            NSArray* atoms = [cell.atoms subarrayWithRange:NSMakeRange(1, cell.atoms.count - 1)];
+        if (column % 2 == 1 && cell.atomsForReading.count >= 1 && cell.atomsForReading[0].type == kMTMathAtomOrdinary && cell.atomsForReading[0].nucleus.length == 0) {
+            NSArray* atoms = [cell.atomsForReading subarrayWithRange:NSMakeRange(1, cell.atomsForReading.count - 1)];
             return [MTMathList mathListWithAtomsArray:atoms];
         }
     }
@@ -1242,6 +1806,81 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return op;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeString:self.environment];
+    [archiver encodeUInteger:self.alignments.count];
+    for (NSNumber* alignment in self.alignments) {
+        [archiver encodeInteger:alignment.integerValue];
+    }
+    // The rows are written one by one, they need not have the same number of cells.
+    [archiver encodeUInteger:self.cells.count];
+    for (NSArray<MTMathList*>* row in self.cells) {
+        [archiver encodeUInteger:row.count];
+        for (MTMathList* cell in row) {
+            [archiver encodeMathList:cell];
+        }
+    }
+    [archiver encodeFloat:self.interColumnSpacing];
+    [archiver encodeFloat:self.interRowAdditionalSpacing];
+    [archiver encodeUInteger:self.cellStyle];
+    [archiver encodeUInteger:self.verticalLines.count];
+    for (NSNumber* count in self.verticalLines) {
+        [archiver encodeInteger:count.integerValue];
+    }
+    [archiver encodeUInteger:self.horizontalLines.count];
+    for (NSNumber* count in self.horizontalLines) {
+        [archiver encodeInteger:count.integerValue];
+    }
+}
+
+// Reads `count` integers, each of which has to be in [min, max]. The loop ends at the first failure,
+// so a corrupt count is harmless.
+static NSMutableArray<NSNumber*>* MTDecodeIntegers(MTMathListUnarchiver* unarchiver, NSUInteger count, NSInteger min, NSInteger max)
+{
+    NSMutableArray<NSNumber*>* numbers = [NSMutableArray array];
+    for (NSUInteger i = 0; i < count && !unarchiver.failed; i++) {
+        NSInteger number = [unarchiver decodeInteger];
+        if (number < min || number > max) {
+            [unarchiver fail];
+            break;
+        }
+        [numbers addObject:@(number)];
+    }
+    return numbers;
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    MTMathTable* table = [[self alloc] initWithEnvironment:[unarchiver decodeString]];
+    table.alignments = MTDecodeIntegers(unarchiver, [unarchiver decodeUInteger], kMTColumnAlignmentLeft, kMTColumnAlignmentRight);
+    NSUInteger rowCount = [unarchiver decodeUInteger];
+    NSMutableArray<NSMutableArray<MTMathList*>*>* cells = [NSMutableArray array];
+    for (NSUInteger i = 0; i < rowCount && !unarchiver.failed; i++) {
+        NSUInteger columnCount = [unarchiver decodeUInteger];
+        NSMutableArray<MTMathList*>* row = [NSMutableArray array];
+        for (NSUInteger j = 0; j < columnCount && !unarchiver.failed; j++) {
+            MTMathList* cell = [unarchiver decodeMathList];
+            if (!cell) {
+                return nil;
+            }
+            [row addObject:cell];
+        }
+        [cells addObject:row];
+    }
+    table.cells = cells;
+    table.interColumnSpacing = [unarchiver decodeFloat];
+    table.interRowAdditionalSpacing = [unarchiver decodeFloat];
+    NSUInteger cellStyle = [unarchiver decodeUInteger];
+    if (cellStyle > kMTLineStyleScriptScript && cellStyle != kMTLineStyleInherit) {
+        return nil;
+    }
+    table.cellStyle = (MTLineStyle) cellStyle;
+    table.verticalLines = MTDecodeIntegers(unarchiver, [unarchiver decodeUInteger], 0, NSIntegerMax);
+    table.horizontalLines = MTDecodeIntegers(unarchiver, [unarchiver decodeUInteger], 0, NSIntegerMax);
+    return table;
+}
+
 - (instancetype)finalized
 {
     MTMathTable* table = [super finalized];
@@ -1256,6 +1895,7 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 - (void)setCell:(MTMathList *)list forRow:(NSInteger)row column:(NSInteger)column
 {
     NSParameterAssert(list);
+    [self invalidateFingerprint];
     
     if (self.cells.count <= row) {
         // Add more rows
@@ -1269,12 +1909,15 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
         for (NSInteger i = rowArray.count;  i < column; i++) {
             rowArray[i] = [[MTMathList alloc] init];
         }
+    } else {
+        MTFingerprintUnlinkParent(rowArray[column], self);
     }
     rowArray[column] = list;
 }
 
 - (void)setAlignment:(MTColumnAlignment)alignment forColumn:(NSInteger)column
 {
+    [self invalidateFingerprint];
     if (self.alignments.count < column) {
         // Add more columns
         for (NSInteger i = self.alignments.count; i < column; i++) {
@@ -1407,12 +2050,63 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return copy;
 }
 
+static void MTEncodeStackConstruction(MTMathListArchiver* archiver, MTMathStackConstruction* construction)
+{
+    [archiver encodeBool:construction != nil];
+    if (!construction) {
+        return;
+    }
+    [archiver encodeUInteger:construction.kind];
+    switch (construction.kind) {
+        case kMTMathStackConstructionExtensible:
+            [archiver encodeString:construction.glyph];
+            break;
+        case kMTMathStackConstructionMathList:
+            [archiver encodeMathList:construction.list];
+            break;
+        case kMTMathStackConstructionRule:
+            [archiver encodeFloat:construction.ruleThickness];
+            break;
+    }
+}
+
+// Sets `valid` to NO if the data holds no construction that the factories accept.
+static MTMathStackConstruction* MTDecodeStackConstruction(MTMathListUnarchiver* unarchiver, BOOL* valid)
+{
+    *valid = YES;
+    if (![unarchiver decodeBool]) {
+        return nil;
+    }
+    switch ([unarchiver decodeUInteger]) {
+        case kMTMathStackConstructionExtensible: {
+            NSString* glyph = [unarchiver decodeString];
+            *valid = (glyph != nil);
+            return glyph ? [MTMathStackConstruction extensibleWithGlyph:glyph] : nil;
+        }
+        case kMTMathStackConstructionMathList: {
+            MTMathList* list = [unarchiver decodeMathList];
+            *valid = (list != nil);
+            return list ? [MTMathStackConstruction mathListWithList:list] : nil;
+        }
+        case kMTMathStackConstructionRule:
+            return [MTMathStackConstruction ruleWithThickness:[unarchiver decodeFloat]];
+        default:
+            *valid = NO;
+            return nil;
+    }
+}
+
 @end
 
 #pragma mark - MTMathStack
 
 @implementation MTMathStack
 
+MT_FINGERPRINTED_CHILD_SETTER(MTMathList*, setInnerList, _innerList)
+MT_FINGERPRINTED_SETTER(MTMathStackConstruction*, setOver, _over)
+MT_FINGERPRINTED_SETTER(MTMathStackConstruction*, setUnder, _under)
+MT_FINGERPRINTED_SETTER(MTMathAtomType, setDisplayClass, _displayClass)
+
 - (instancetype)init
 {
     self = [super initWithType:kMTMathAtomStack value:@""];
@@ -1442,6 +2136,31 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return copy;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    [archiver encodeMathList:self.innerList];
+    MTEncodeStackConstruction(archiver, self.over);
+    MTEncodeStackConstruction(archiver, self.under);
+    [archiver encodeUInteger:self.displayClass];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    MTMathStack* stack = [[self alloc] init];
+    stack.innerList = [unarchiver decodeMathList];
+    BOOL overValid, underValid;
+    stack.over = MTDecodeStackConstruction(unarchiver, &overValid);
+    stack.under = MTDecodeStackConstruction(unarchiver, &underValid);
+    if (!overValid || !underValid) {
+        return nil;
+    }
+    stack.displayClass = [unarchiver decodeUInteger];
+    if (!MTIsMathAtomType(stack.displayClass)) {
+        return nil;
+    }
+    return stack;
+}
+
 - (instancetype)finalized
 {
     MTMathStack* newStack = [super finalized];
@@ -1489,6 +2208,8 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 
 @implementation MTTextAtom
 
+MT_FINGERPRINTED_SETTER(MTTextStyle, setTextStyle, _textStyle)
+
 - (instancetype)initWithText:(NSString *)text style:(MTTextStyle)style
 {
     NSParameterAssert(text);
@@ -1543,6 +2264,21 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return copy;
 }
 
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver
+{
+    // The text is the nucleus.
+    [archiver encodeUInteger:self.textStyle];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    MTTextStyle style = [unarchiver decodeUInteger];
+    if (style > kMTTextStyleTypewriter) {
+        return nil;
+    }
+    return [[self alloc] initWithText:nucleus ?: @"" style:style];
+}
+
 - (instancetype)finalized
 {
     MTTextAtom* fin = [super finalized];
@@ -1582,10 +2318,68 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 
 #pragma mark - MTMathList
 
+@interface MTMathList () <MTRetainedSizeWalking, MTFingerprintNode>
+
+// Called before the atoms of the list change.
+- (void) invalidateFingerprint;
+
+// Makes the list frozen. Only for the lists of a frozen copy.
+- (void) freeze;
+
+@end
+
+// Freezes every list and atom of a tree. They are reached the way they are archived, so no child
+// list is missed: scripts, inner lists, table cells, stack constructions and fused atoms.
+@interface MTMathListFreezer : MTMathListArchiver
+@end
+
+@implementation MTMathListFreezer
+
+- (void)encodeMathList:(MTMathList *)list
+{
+    if (list && !list.frozen) {
+        [list freeze];
+        for (MTMathAtom* atom in list.atomsForReading) {
+            [self encodeAtom:atom];
+        }
+    }
+}
+
+- (void)encodeAtom:(MTMathAtom *)atom
+{
+    if (atom && !atom.frozen) {
+        [atom freeze];
+        [atom encodeWithArchiver:self];
+    }
+}
+
+- (void)encodeUInteger:(NSUInteger)value {}
+- (void)encodeInteger:(NSInteger)value {}
+- (void)encodeBool:(BOOL)value {}
+- (void)encodeFloat:(CGFloat)value {}
+- (void)encodeRange:(NSRange)range {}
+- (void)encodeString:(NSString *)string {}
+
+@end
+
+void MTMathAtomFreeze(MTMathAtom* atom)
+{
+    NSCParameterAssert(atom);
+    [[MTMathListFreezer new] encodeAtom:atom];
+}
+
 @implementation MTMathList {
     NSMutableArray* _atoms;
+    MTFingerprintCache _fingerprintCache;
+    BOOL _frozen;
+    // Whether _atoms may hold frozen atoms of other lists or of the factory. Cleared, with
+    // _atoms swapped for an array of copies, under @synchronized(self) the first time `atoms`
+    // is read, so that readers on other threads see one array or the other.
+    _Atomic(bool) _holdsSharedAtoms;
 }
 
+@synthesize fingerprintParent = _fingerprintParent;
+
 + (instancetype)mathListWithAtoms:(MTMathAtom *)firstAtom, ...
 {
     MTMathList* list = [[MTMathList alloc] init];
@@ -1603,6 +2397,12 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 {
     MTMathList* list = [[MTMathList alloc] init];
     [list->_atoms addObjectsFromArray:atoms];
+    for (MTMathAtom* atom in atoms) {
+        if (atom.frozen) {
+            atomic_store_explicit(&list->_holdsSharedAtoms, true, memory_order_relaxed);
+            break;
+        }
+    }
     return list;
 }
 
@@ -1628,6 +2428,8 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
                                           reason:[NSString stringWithFormat:@"Cannot add atom of type %@ in a mathlist", typeToText(atom.type)]
                                         userInfo:nil];
     }
+    [self invalidateFingerprint];
+    [self noteSharedAtom:atom];
     [_atoms addObject:atom];
 }
 
@@ -1638,35 +2440,149 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
                                           reason:[NSString stringWithFormat:@"Cannot add atom of type %@ in a mathlist", typeToText(atom.type)]
                                         userInfo:nil];
     }
+    [self invalidateFingerprint];
+    [self noteSharedAtom:atom];
     [_atoms insertObject:atom atIndex:index];
 }
 
 - (void)append:(MTMathList *)list
 {
-    [_atoms addObjectsFromArray:list.atoms];
+    [self invalidateFingerprint];
+    [_atoms addObjectsFromArray:list.atomsForReading];
+    if (list->_frozen || atomic_load_explicit(&list->_holdsSharedAtoms, memory_order_relaxed)) {
+        atomic_store_explicit(&_holdsSharedAtoms, true, memory_order_relaxed);
+    }
 }
 
 - (void)removeLastAtom
 {
     if (_atoms.count > 0) {
+        [self invalidateFingerprint];
+        MTFingerprintUnlinkParent(_atoms.lastObject, self);
         [_atoms removeLastObject];
     }
 }
 
 - (void) removeAtomAtIndex:(NSUInteger)index
 {
+    [self invalidateFingerprint];
+    MTFingerprintUnlinkParent(_atoms[index], self);
     [_atoms removeObjectAtIndex:index];
 }
 
 - (void) removeAtomsInRange:(NSRange) range
 {
+    [self invalidateFingerprint];
+    for (NSUInteger i = range.location; i < NSMaxRange(range); i++) {
+        MTFingerprintUnlinkParent(_atoms[i], self);
+    }
     [_atoms removeObjectsInRange:range];
 }
 
+- (void) invalidateFingerprint
+{
+    if (_frozen) {
+        // Not an assertion: a frozen list may be read on other threads, in release builds too.
+        @throw [[NSException alloc] initWithName:@"Error"
+                                          reason:[NSString stringWithFormat:@"A frozen list can not be changed: %@", self]
+                                        userInfo:nil];
+    }
+    MTFingerprintInvalidate(self);
+}
+
+- (MTFingerprintCache *)fingerprintCache
+{
+    return &_fingerprintCache;
+}
+
+#pragma mark Shared atoms
+
+- (void) noteSharedAtom:(MTMathAtom*) atom
+{
+    if (atom.frozen) {
+        atomic_store_explicit(&_holdsSharedAtoms, true, memory_order_relaxed);
+    }
+}
+
+- (NSArray *)atoms
+{
+    // The atoms of a frozen list are frozen too and stay shared: nothing in it may change.
+    if (!_frozen && atomic_load_explicit(&_holdsSharedAtoms, memory_order_acquire)) {
+        [self copySharedAtoms];
+    }
+    return _atoms;
+}
+
+- (NSArray *)atomsForReading
+{
+    if (atomic_load_explicit(&_holdsSharedAtoms, memory_order_acquire)) {
+        @synchronized (self) {
+            return _atoms;
+        }
+    }
+    return _atoms;
+}
+
+// Replaces the shared atoms with copies. The copies are equal to the atoms they replace, so the
+// fingerprint does not change, but the copies are not cached and a change to one of them would not
+// reach this list. So the fingerprints of the list and the lists above it are cleared here.
+- (void) copySharedAtoms
+{
+    @synchronized (self) {
+        if (!atomic_load_explicit(&_holdsSharedAtoms, memory_order_relaxed)) {
+            return;
+        }
+        MTFingerprintInvalidate(self);
+        NSMutableArray* atoms = [NSMutableArray arrayWithCapacity:_atoms.count];
+        for (MTMathAtom* atom in _atoms) {
+            [atoms addObject:(atom.frozen ? [atom copy] : atom)];
+        }
+        _atoms = atoms;
+        atomic_store_explicit(&_holdsSharedAtoms, false, memory_order_release);
+    }
+}
+
+- (MTMathAtom *)mutableAtom:(MTMathAtom *)atom
+{
+    NSParameterAssert(atom);
+    if (!atom.frozen) {
+        return atom;
+    }
+    // The atom changed is usually the last one.
+    for (NSUInteger i = _atoms.count; i > 0; i--) {
+        if (_atoms[i - 1] == atom) {
+            MTMathAtom* copy = [atom copy];
+            [self invalidateFingerprint];
+            _atoms[i - 1] = copy;
+            return copy;
+        }
+    }
+    NSAssert(NO, @"%@ is not in the list", atom);
+    // Never hand out a shared atom to change, even if the list no longer holds it.
+    return [atom copy];
+}
+
+- (uint64_t)fingerprint
+{
+    return [self fingerprintWithHasher:nil];
+}
+
+- (uint64_t) fingerprintWithHasher:(MTMathListHasher*) hasher
+{
+    uint64_t epoch = MTCurrentFingerprintEpoch();
+    uint64_t fingerprint;
+    if (MTFingerprintCacheGet(&_fingerprintCache, epoch, &fingerprint)) {
+        return fingerprint;
+    }
+    fingerprint = [(hasher ?: [MTMathListHasher new]) hashOfList:self];
+    MTFingerprintCacheSet(&_fingerprintCache, epoch, fingerprint);
+    return fingerprint;
+}
+
 - (NSString *)stringValue
 {
     NSMutableString* str = [NSMutableString string];
-    for (MTMathAtom* atom in self.atoms) {
+    for (MTMathAtom* atom in self.atomsForReading) {
         [str appendString:atom.stringValue];
     }
     return str;
@@ -1674,16 +2590,20 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
 
 - (NSString *)description
 {
-    return self.atoms.description;
+    return self.atomsForReading.description;
 }
 
 - (MTMathList *)finalized
 {
+    if (_frozen) {
+        return self;
+    }
+    MTTracePhase(kMTLayoutPhaseFinalize);
     MTMathList* finalized = [MTMathList new];
     NSRange zeroRange = NSMakeRange(0, 0);
     
     MTMathAtom* prevNode = nil;
-    for (MTMathAtom* atom in self.atoms) {
+    for (MTMathAtom* atom in self.atomsForReading) {
         MTMathAtom* newNode = [atom finalized];
         // Each character is given a separate index.
         if (NSEqualRanges(zeroRange, atom.indexRange)) {
@@ -1728,14 +2648,194 @@ static NSString* fractionCommandForDelimiterPair(NSString* leftDelimiter, NSStri
     return finalized;
 }
 
+#pragma mark Freezing
+
+- (MTMathList *)frozenCopy
+{
+    if (_frozen) {
+        return self;
+    }
+    MTMathList* frozen = self.finalized;
+    [[MTMathListFreezer new] encodeMathList:frozen];
+    return frozen;
+}
+
+- (BOOL)isFrozen
+{
+    return _frozen;
+}
+
+- (void) freeze
+{
+    _frozen = YES;
+}
+
 #pragma mark NSCopying
 
+// Set while MTMathAtomCopySharingChildLists copies an atom, so that its lists are shared.
+static __thread BOOL MTShareListsOnCopy = NO;
+
+MTMathAtom* MTMathAtomCopySharingChildLists(MTMathAtom* atom)
+{
+    NSCParameterAssert(atom);
+    BOOL sharing = MTShareListsOnCopy;
+    MTShareListsOnCopy = YES;
+    MTMathAtom* copy = [atom copy];
+    MTShareListsOnCopy = sharing;
+    return copy;
+}
+
 // Makes a deep copy of the list
 - (id)copyWithZone:(NSZone *)zone
 {
+    if (MTShareListsOnCopy) {
+        return self;
+    }
+    // Shared atoms are copied too, so the copy owns all of its atoms.
     MTMathList* list = [[[self class] allocWithZone:zone] init];
-    list->_atoms = [[NSMutableArray alloc] initWithArray:self.atoms copyItems:YES];
+    list->_atoms = [[NSMutableArray alloc] initWithArray:self.atomsForReading copyItems:YES];
     return list;
 }
 
+#pragma mark Archiving
+
+- (NSData *)archivedData
+{
+    MTMathListArchiver* archiver = [[MTMathListArchiver alloc] init];
+    [archiver encodeMathList:self];
+    return [archiver finishEncoding];
+}
+
++ (instancetype)mathListWithArchivedData:(NSData *)data
+{
+    NSParameterAssert(data);
+    MTMathListUnarchiver* unarchiver = [[MTMathListUnarchiver alloc] initWithData:data];
+    MTMathList* list = [unarchiver decodeMathList];
+    if (!list || unarchiver.failed) {
+        return nil;
+    }
+    return list;
+}
+
+- (NSUInteger)retainedSize
+{
+    MTRetainedSizeCounter* counter = [MTRetainedSizeCounter new];
+    [counter addObject:self];
+    return counter.size;
+}
+
+#pragma mark Indexes
+
+MTMathList* MTMathAtomChildList(MTMathAtom* atom, MTMathListSubIndexType type)
+{
+    switch (type) {
+        case kMTSubIndexTypeSuperscript:
+            return atom.superScript;
+        case kMTSubIndexTypeSubscript:
+            return atom.subScript;
+        case kMTSubIndexTypeNumerator:
+            return [atom isKindOfClass:[MTFraction class]] ? ((MTFraction*) atom).numerator : nil;
+        case kMTSubIndexTypeDenominator:
+            return [atom isKindOfClass:[MTFraction class]] ? ((MTFraction*) atom).denominator : nil;
+        case kMTSubIndexTypeRadicand:
+            return [atom isKindOfClass:[MTRadical class]] ? ((MTRadical*) atom).radicand : nil;
+        case kMTSubIndexTypeDegree:
+            return [atom isKindOfClass:[MTRadical class]] ? ((MTRadical*) atom).degree : nil;
+        case kMTSubIndexTypeInner:
+            // \left..\right, accents, over and under lines, colors, boxes, groups and stacks.
+            return [atom respondsToSelector:@selector(innerList)] ? [(MTInner*) atom innerList] : nil;
+        case kMTSubIndexTypeNone:
+        case kMTSubIndexTypeNucleus:
+            return nil;
+    }
+    return nil;
+}
+
+BOOL MTMathAtomSetChildList(MTMathAtom* atom, MTMathListSubIndexType type, MTMathList* list)
+{
+    switch (type) {
+        case kMTSubIndexTypeSuperscript:
+        case kMTSubIndexTypeSubscript:
+            if (!atom.scriptsAllowed) {
+                return NO;
+            }
+            if (type == kMTSubIndexTypeSuperscript) {
+                atom.superScript = list;
+            } else {
+                atom.subScript = list;
+            }
+            return YES;
+        case kMTSubIndexTypeNumerator:
+        case kMTSubIndexTypeDenominator:
+            if (![atom isKindOfClass:[MTFraction class]] || !list) {
+                return NO;
+            }
+            if (type == kMTSubIndexTypeNumerator) {
+                ((MTFraction*) atom).numerator = list;
+            } else {
+                ((MTFraction*) atom).denominator = list;
+            }
+            return YES;
+        case kMTSubIndexTypeRadicand:
+        case kMTSubIndexTypeDegree:
+            if (![atom isKindOfClass:[MTRadical class]]) {
+                return NO;
+            }
+            if (type == kMTSubIndexTypeRadicand) {
+                ((MTRadical*) atom).radicand = list;
+            } else {
+                ((MTRadical*) atom).degree = list;
+            }
+            return YES;
+        case kMTSubIndexTypeInner:
+            if (![atom respondsToSelector:@selector(setInnerList:)]) {
+                return NO;
+            }
+            [(MTInner*) atom setInnerList:list];
+            return YES;
+        case kMTSubIndexTypeNone:
+        case kMTSubIndexTypeNucleus:
+            return NO;
+    }
+    return NO;
+}
+
+- (MTMathAtom *)atomAtListIndex:(MTMathListIndex *)index
+{
+    NSParameterAssert(index);
+    MTMathListIndexPath path;
+    if ([index getPath:&path]) {
+        return [self atomAtIndexPath:path];
+    }
+    // Deeper than a path holds.
+    MTMathList* list = self;
+    while (index.atomIndex < list.atomsForReading.count) {
+        MTMathAtom* atom = list.atomsForReading[index.atomIndex];
+        if (!index.subIndex || index.subIndexType == kMTSubIndexTypeNone || index.subIndexType == kMTSubIndexTypeNucleus) {
+            return atom;
+        }
+        list = MTMathAtomChildList(atom, index.subIndexType);
+        index = index.subIndex;
+    }
+    return nil;
+}
+
+- (MTMathAtom *)atomAtIndexPath:(MTMathListIndexPath)path
+{
+    MTMathList* list = self;
+    for (NSUInteger level = 0; level < path.depth; level++) {
+        NSUInteger atomIndex = MTMathListIndexPathAtomIndex(path, level);
+        if (atomIndex >= list.atomsForReading.count) {
+            return nil;
+        }
+        MTMathAtom* atom = list.atomsForReading[atomIndex];
+        MTMathListSubIndexType type = MTMathListIndexPathSubIndexType(path, level);
+        if (level + 1 == path.depth || type == kMTSubIndexTypeNone || type == kMTSubIndexTypeNucleus) {
+            return atom;
+        }
+        list = MTMathAtomChildList(atom, type);
+    }
+    return nil;
+}
+
 @end
@@ -0,0 +1,103 @@
+//
+//  MTMathListArchiver.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import Foundation;
+
+#import "MTMathList.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** The version of the format. Bump it whenever the archived fields of an atom change. */
+FOUNDATION_EXPORT const uint16_t MTMathListArchiveFormatVersion;
+
+/** The kind that an archive names the class of the atom with, from 1, or 0 if the class can not be
+ archived. The kinds are part of the format, so they are the same in every process. */
+FOUNDATION_EXPORT NSUInteger MTMathListArchiveKindOfAtom(MTMathAtom* atom);
+
+/**
+ Writes a math list into the binary format read by MTMathListUnarchiver, in a single pass
+ over the tree.
+
+ An archive is a header (a magic and the format version) and the root list. A list is its
+ atom count and then its atoms in order. Every atom is a kind byte naming its class, its type
+ and nucleus, the fields of its class, and then its font style, index range, scripts and
+ fused atoms. Integers are LEB128 varints and lengths are 64-bit floats, so that spacings
+ survive exactly. Strings are UTF-8 and are written once: a repeated string is a reference
+ to its first occurrence.
+
+ The atoms write themselves with -encodeWithArchiver:, see the declarations below.
+ */
+@interface MTMathListArchiver : NSObject
+
+- (instancetype) init NS_DESIGNATED_INITIALIZER;
+
+/** The archive, or nil if the tree holds an atom that can not be archived. */
+- (nullable NSData*) finishEncoding;
+
+- (void) fail;
+
+- (void) encodeMathList:(nullable MTMathList*) list;
+- (void) encodeAtom:(nullable MTMathAtom*) atom;
+
+- (void) encodeUInteger:(NSUInteger) value;
+- (void) encodeInteger:(NSInteger) value;
+- (void) encodeBool:(BOOL) value;
+- (void) encodeFloat:(CGFloat) value;
+- (void) encodeRange:(NSRange) range;
+- (void) encodeString:(nullable NSString*) string;
+
+@end
+
+/**
+ Reads a math list back from an archive. Every decode method returns zero or nil once the data
+ is found to be short or corrupt, and `failed` is then set. The decoded list has to be
+ discarded in that case.
+ */
+@interface MTMathListUnarchiver : NSObject
+
+- (instancetype) init NS_UNAVAILABLE;
+
+/** Returns nil if the data is not an archive of this format version. */
+- (nullable instancetype) initWithData:(NSData*) data NS_DESIGNATED_INITIALIZER;
+
+@property (nonatomic, readonly) BOOL failed;
+
+- (void) fail;
+
+/** A list, or nil if a nil list was encoded. Decoding fails if the lists nest deeper than the
+ parser allows groups to nest. */
+- (nullable MTMathList*) decodeMathList;
+- (nullable MTMathAtom*) decodeAtom;
+
+- (NSUInteger) decodeUInteger;
+/** For the enum fields: decoding fails if the value is greater than `max`. */
+- (NSUInteger) decodeUIntegerUpTo:(NSUInteger) max;
+- (NSInteger) decodeInteger;
+- (BOOL) decodeBool;
+- (CGFloat) decodeFloat;
+- (NSRange) decodeRange;
+- (nullable NSString*) decodeString;
+
+@end
+
+@interface MTMathAtom ()
+
+// -encodeWithArchiver: writes the type and nucleus, then -encodeContentsWithArchiver:, which
+// subclasses override to write their own fields, and then the fields common to every atom.
+// +atomWithUnarchiver: reads them back in the same order; +decodeContentsWithUnarchiver:
+// creates the atom of the class and reads its fields.
+- (void) encodeWithArchiver:(MTMathListArchiver*) archiver;
+- (void) encodeContentsWithArchiver:(MTMathListArchiver*) archiver;
++ (nullable instancetype) atomWithUnarchiver:(MTMathListUnarchiver*) unarchiver;
++ (nullable instancetype) decodeContentsWithUnarchiver:(MTMathListUnarchiver*) unarchiver
+                                                   type:(MTMathAtomType) type
+                                                nucleus:(NSString*) nucleus;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,352 @@
+//
+//  MTMathListArchiver.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTMathListArchiver.h"
+#import "MTMathListInternal.h"
+
+const uint16_t MTMathListArchiveFormatVersion = 1;
+
+static const uint8_t kMTMathListArchiveMagic[4] = { 'M', 'T', 'M', 'L' };
+
+// The kinds of the atoms, in the order of their numbers. 0 is a nil atom.
+static NSArray<Class>* MTArchivedAtomClasses(void)
+{
+    static NSArray<Class>* classes;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        classes = @[ MTMathAtom.class, MTFraction.class, MTRadical.class, MTLargeOperator.class,
+                     MTInner.class, MTOverLine.class, MTUnderLine.class, MTAccent.class,
+                     MTLargeDelimiter.class, MTMathSpace.class, MTMathStyle.class, MTMathColor.class,
+                     MTMathColorbox.class, MTMathBox.class, MTMathGroup.class, MTMathTable.class,
+                     MTMathStack.class, MTTextAtom.class ];
+    });
+    return classes;
+}
+
+NSUInteger MTMathListArchiveKindOfAtom(MTMathAtom* atom)
+{
+    NSUInteger index = [MTArchivedAtomClasses() indexOfObjectIdenticalTo:atom.class];
+    return (index == NSNotFound) ? 0 : index + 1;
+}
+
+#pragma mark - MTMathListArchiver
+
+@implementation MTMathListArchiver {
+    NSMutableData* _data;
+    BOOL _failed;
+    // The number of each string already written.
+    NSMutableDictionary<NSString*, NSNumber*>* _strings;
+}
+
+- (instancetype) init
+{
+    self = [super init];
+    if (self) {
+        _data = [NSMutableData dataWithCapacity:256];
+        _strings = [NSMutableDictionary dictionary];
+        [_data appendBytes:kMTMathListArchiveMagic length:sizeof(kMTMathListArchiveMagic)];
+        [self encodeUInteger:MTMathListArchiveFormatVersion];
+    }
+    return self;
+}
+
+- (void) fail
+{
+    _failed = YES;
+}
+
+- (NSData*) finishEncoding
+{
+    return _failed ? nil : [_data copy];
+}
+
+- (void) encodeMathList:(MTMathList*) list
+{
+    if (!list) {
+        [self encodeUInteger:0];
+        return;
+    }
+    NSArray<MTMathAtom*>* atoms = list.atomsForReading;
+    [self encodeUInteger:atoms.count + 1];
+    for (MTMathAtom* atom in atoms) {
+        [self encodeAtom:atom];
+    }
+}
+
+- (void) encodeAtom:(MTMathAtom*) atom
+{
+    if (!atom) {
+        [self encodeUInteger:0];
+        return;
+    }
+    NSUInteger kind = MTMathListArchiveKindOfAtom(atom);
+    if (kind == 0) {
+        _failed = YES;
+        return;
+    }
+    [self encodeUInteger:kind];
+    [atom encodeWithArchiver:self];
+}
+
+- (void) encodeUInteger:(NSUInteger) value
+{
+    uint8_t bytes[10];
+    NSUInteger count = 0;
+    uint64_t remaining = value;
+    do {
+        uint8_t byte = remaining & 0x7f;
+        remaining >>= 7;
+        bytes[count++] = byte | (remaining ? 0x80 : 0);
+    } while (remaining);
+    [_data appendBytes:bytes length:count];
+}
+
+- (void) encodeInteger:(NSInteger) value
+{
+    // Zigzag, so that small negative values stay short.
+    int64_t v = value;
+    [self encodeUInteger:(NSUInteger) (((uint64_t) v << 1) ^ (uint64_t) (v >> 63))];
+}
+
+- (void) encodeBool:(BOOL) value
+{
+    uint8_t byte = value ? 1 : 0;
+    [_data appendBytes:&byte length:1];
+}
+
+- (void) encodeFloat:(CGFloat) value
+{
+    Float64 f = value;
+    uint64_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    bits = CFSwapInt64HostToLittle(bits);
+    [_data appendBytes:&bits length:sizeof(bits)];
+}
+
+- (void) encodeRange:(NSRange) range
+{
+    [self encodeUInteger:(range.location == NSNotFound) ? 0 : range.location + 1];
+    [self encodeUInteger:range.length];
+}
+
+- (void) encodeString:(NSString*) string
+{
+    // 0 is nil, 1 a new string and n + 2 the n-th string written.
+    if (!string) {
+        [self encodeUInteger:0];
+        return;
+    }
+    NSNumber* number = _strings[string];
+    if (number) {
+        [self encodeUInteger:number.unsignedIntegerValue + 2];
+        return;
+    }
+    _strings[string] = @(_strings.count);
+    [self encodeUInteger:1];
+    // The UTF-8 bytes are written straight into the archive.
+    NSUInteger maxLength = [string maximumLengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    uint8_t stackBuffer[64];
+    uint8_t* buffer = (maxLength <= sizeof(stackBuffer)) ? stackBuffer : malloc(maxLength);
+    NSUInteger length = 0;
+    [string getBytes:buffer maxLength:maxLength usedLength:&length encoding:NSUTF8StringEncoding
+             options:0 range:NSMakeRange(0, string.length) remainingRange:NULL];
+    [self encodeUInteger:length];
+    [_data appendBytes:buffer length:length];
+    if (buffer != stackBuffer) {
+        free(buffer);
+    }
+}
+
+@end
+
+#pragma mark - MTMathListUnarchiver
+
+@implementation MTMathListUnarchiver {
+    NSData* _data;
+    const uint8_t* _bytes;
+    NSUInteger _length;
+    NSUInteger _offset;
+    NSMutableArray<NSString*>* _strings;
+    // The number of lists being decoded.
+    NSInteger _depth;
+}
+
+- (instancetype) initWithData:(NSData*) data
+{
+    NSParameterAssert(data);
+    self = [super init];
+    if (self) {
+        _data = data;
+        _bytes = data.bytes;
+        _length = data.length;
+        _strings = [NSMutableArray array];
+        if (_length < sizeof(kMTMathListArchiveMagic) || memcmp(_bytes, kMTMathListArchiveMagic, sizeof(kMTMathListArchiveMagic)) != 0) {
+            return nil;
+        }
+        _offset = sizeof(kMTMathListArchiveMagic);
+        if ([self decodeUInteger] != MTMathListArchiveFormatVersion || _failed) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void) fail
+{
+    _failed = YES;
+}
+
+- (BOOL) canRead:(NSUInteger) count
+{
+    if (_failed || count > _length - _offset) {
+        _failed = YES;
+        return NO;
+    }
+    return YES;
+}
+
+- (MTMathList*) decodeMathList
+{
+    NSUInteger count = [self decodeUInteger];
+    if (count == 0 || _failed) {
+        return nil;
+    }
+    // The lists are decoded recursively, so a corrupt archive could otherwise nest them deep enough
+    // to overflow the stack.
+    if (_depth >= kMTMaxRecursionDepth) {
+        _failed = YES;
+        return nil;
+    }
+    _depth++;
+    MTMathList* list = [MTMathList new];
+    // Every atom takes at least a byte, which bounds the count of a corrupt archive.
+    for (NSUInteger i = 0; i < count - 1 && [self canRead:1]; i++) {
+        MTMathAtom* atom = [self decodeAtom];
+        if (!atom || atom.type == kMTMathAtomBoundary) {
+            _failed = YES;
+            break;
+        }
+        [list addAtom:atom];
+    }
+    _depth--;
+    return _failed ? nil : list;
+}
+
+- (MTMathAtom*) decodeAtom
+{
+    NSUInteger kind = [self decodeUInteger];
+    if (kind == 0 || _failed) {
+        return nil;
+    }
+    NSArray<Class>* classes = MTArchivedAtomClasses();
+    if (kind > classes.count) {
+        _failed = YES;
+        return nil;
+    }
+    MTMathAtom* atom = [classes[kind - 1] atomWithUnarchiver:self];
+    if (!atom) {
+        _failed = YES;
+    }
+    return atom;
+}
+
+- (NSUInteger) decodeUInteger
+{
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (![self canRead:1]) {
+            return 0;
+        }
+        uint8_t byte = _bytes[_offset++];
+        value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return (NSUInteger) value;
+        }
+    }
+    _failed = YES;
+    return 0;
+}
+
+- (NSUInteger) decodeUIntegerUpTo:(NSUInteger) max
+{
+    NSUInteger value = [self decodeUInteger];
+    if (value > max) {
+        _failed = YES;
+        return 0;
+    }
+    return value;
+}
+
+- (NSInteger) decodeInteger
+{
+    uint64_t value = [self decodeUInteger];
+    return (NSInteger) ((value >> 1) ^ -(value & 1));
+}
+
+- (BOOL) decodeBool
+{
+    if (![self canRead:1]) {
+        return NO;
+    }
+    return _bytes[_offset++] != 0;
+}
+
+- (CGFloat) decodeFloat
+{
+    if (![self canRead:sizeof(uint64_t)]) {
+        return 0;
+    }
+    uint64_t bits;
+    memcpy(&bits, _bytes + _offset, sizeof(bits));
+    _offset += sizeof(bits);
+    bits = CFSwapInt64LittleToHost(bits);
+    Float64 value;
+    memcpy(&value, &bits, sizeof(value));
+    if (!isfinite(value)) {
+        _failed = YES;
+        return 0;
+    }
+    return value;
+}
+
+- (NSRange) decodeRange
+{
+    NSUInteger location = [self decodeUInteger];
+    NSUInteger length = [self decodeUInteger];
+    return NSMakeRange(location ? location - 1 : NSNotFound, length);
+}
+
+- (NSString*) decodeString
+{
+    NSUInteger tag = [self decodeUInteger];
+    if (tag == 0 || _failed) {
+        return nil;
+    }
+    if (tag > 1) {
+        if (tag - 2 >= _strings.count) {
+            _failed = YES;
+            return nil;
+        }
+        // The same instance, so that repeated nuclei are shared.
+        return _strings[tag - 2];
+    }
+    NSUInteger length = [self decodeUInteger];
+    if (![self canRead:length]) {
+        return nil;
+    }
+    NSString* string = [[NSString alloc] initWithBytes:_bytes + _offset length:length encoding:NSUTF8StringEncoding];
+    _offset += length;
+    if (!string) {
+        _failed = YES;
+        return nil;
+    }
+    [_strings addObject:string];
+    return string;
+}
+
+@end
@@ -12,6 +12,7 @@
 @import Foundation;
 
 #import "MTMathList.h"
+#import "MTMathParserContext.h"
 
 FOUNDATION_EXPORT NSString *const _Nonnull MTParseError;
 
@@ -30,7 +31,13 @@ NS_ASSUME_NONNULL_BEGIN
     for each string that needs to be parsed. Do not reuse the object.
     @param str The LaTeX string to be used to build the `MTMathList`
  */
-- (instancetype) initWithString:(NSString *)str NS_DESIGNATED_INITIALIZER;
+- (instancetype) initWithString:(NSString *)str;
+
+/** Create a `MTMathListBuilder` for the given string that parses the symbols and macros of
+    `context`. A nil context parses the symbols of `MTMathAtomFactory`, including those added with
+    `+[MTMathAtomFactory addLatexSymbol:value:]`, as `initWithString:` does.
+ */
+- (instancetype) initWithString:(NSString *)str context:(nullable MTMathParserContext*) context NS_DESIGNATED_INITIALIZER;
 - (instancetype) init NS_UNAVAILABLE;
 
 /// Builds a mathlist from the given string. Returns nil if there is an error.
@@ -48,9 +55,20 @@ NS_ASSUME_NONNULL_BEGIN
 + (nullable MTMathList *) buildFromString:(NSString *)str
                                     error:(NSError * _Nullable * _Nullable)error;
 
+/** Construct a math list from a given string with the symbols and macros of `context`. See
+ `buildFromString:error:`.
+ */
++ (nullable MTMathList *) buildFromString:(NSString *)str
+                                  context:(nullable MTMathParserContext*) context
+                                    error:(NSError * _Nullable * _Nullable)error;
+
 /// This converts the MTMathList to LaTeX.
 + (NSString *) mathListToString:(MTMathList *)ml;
 
+/// This converts the MTMathList to LaTeX with the symbol names of `context`, so that the LaTeX
+/// parses back to the list in that context.
++ (NSString *) mathListToString:(MTMathList *)ml context:(nullable MTMathParserContext*) context;
+
 /**
  @typedef MTParseErrors
  @brief The error encountered when parsing a LaTeX string.
@@ -97,6 +115,9 @@ typedef NS_ENUM(NSUInteger, MTParseErrors) {
     MTParseErrorMissingColumnSpec,
     /// An array column specification was empty or used an unsupported specifier.
     MTParseErrorInvalidColumnSpec,
+    /// The macros of the context expanded too many times, e.g. a macro that expands to itself,
+    /// or their expansions added too many characters.
+    MTParseErrorMacroExpansionTooDeep,
 };
 
 @end
@@ -11,6 +11,9 @@
 
 #import "MTMathListBuilder.h"
 #import "MTMathAtomFactory.h"
+#import "MTMathParserContextInternal.h"
+#import "MTMathListInternal.h"
+#import "MTInstrumentationInternal.h"
 
 NSString *const MTParseError = @"ParseError";
 
@@ -41,10 +44,13 @@ NSString *const MTParseError = @"ParseError";
 
 @end
 
-// Maximum recursion depth for -buildInternal:oneCharOnly:stopChar:.
-// 150 is comfortably deeper than any realistic human-authored expression yet
-// far below the thousands of frames needed to overflow a 1 MB stack.
-static const NSInteger kMTMaxRecursionDepth = 150;
+// Maximum number of macro expansions in one string, which stops a macro that expands to itself.
+static const NSUInteger kMTMaxMacroExpansions = 1000;
+
+// Maximum number of characters that the macro expansions of one string add in total. Each
+// expansion copies the rest of the string, so this bounds the memory and time of long macros
+// that stay well below kMTMaxMacroExpansions.
+static const NSUInteger kMTMaxMacroExpansionLength = 100000;
 
 @implementation MTMathListBuilder {
     unichar* _chars;
@@ -55,6 +61,9 @@ static const NSInteger kMTMaxRecursionDepth = 150;
     MTFontStyle _currentFontStyle;
     BOOL _spacesAllowed;
     NSInteger _recursionDepth;
+    MTMathParserContext* _context;
+    NSUInteger _macroExpansions;
+    NSUInteger _macroExpansionLength;
     // Set to YES by stopCommand when a TeX group-transformation command (\over,
     // \atop, \choose, \brack, \brace) fires inside a {…} group. Checked in the
     // {…} branch to decide whether to wrap as MTMathGroup. Cleared at the top of
@@ -63,6 +72,11 @@ static const NSInteger kMTMaxRecursionDepth = 150;
 }
 
 - (instancetype)initWithString:(NSString *)str
+{
+    return [self initWithString:str context:nil];
+}
+
+- (instancetype)initWithString:(NSString *)str context:(MTMathParserContext *)context
 {
     self = [super init];
     if (self) {
@@ -73,6 +87,7 @@ static const NSInteger kMTMaxRecursionDepth = 150;
         _currentChar = 0;
         _currentFontStyle = kMTFontStyleDefault;
         _recursionDepth = 0;
+        _context = context;
     }
     return self;
 }
@@ -82,6 +97,61 @@ static const NSInteger kMTMaxRecursionDepth = 150;
     free(_chars);
 }
 
+// The shared atom for a LaTeX symbol in the context of the builder. It is frozen: the builder copies
+// it before changing it, with atomInCurrentFontStyle: or -[MTMathList mutableAtom:].
+- (MTMathAtom*) sharedAtomForLatexSymbolName:(NSString*) name
+{
+    if (_context) {
+        return [_context sharedAtomForLatexSymbolName:name];
+    }
+    return [MTMathAtomFactory sharedAtomForLatexSymbolName:name];
+}
+
+// `atom` in the current font style. A shared atom is copied if its style changes.
+- (MTMathAtom*) atomInCurrentFontStyle:(MTMathAtom*) atom
+{
+    if (!atom || atom.fontStyle == _currentFontStyle) {
+        return atom;
+    }
+    MTMathAtom* styled = atom.frozen ? [atom copy] : atom;
+    styled.fontStyle = _currentFontStyle;
+    return styled;
+}
+
+// If the command just read is a macro of the context, replaces it in the string, from the
+// backslash at `start` on, with its expansion, which is then read in its place. Returns NO if
+// it is not a macro, or if there have been too many expansions or they have grown too long, in
+// which case the error is set.
+- (BOOL) expandMacro:(NSString*) command start:(int) start
+{
+    NSString* expansion = _context.macros[command];
+    if (!expansion) {
+        return NO;
+    }
+    if (++_macroExpansions > kMTMaxMacroExpansions) {
+        [self setError:MTParseErrorMacroExpansionTooDeep
+               message:[NSString stringWithFormat:@"Too many macro expansions at \\%@", command]];
+        return NO;
+    }
+    _macroExpansionLength += expansion.length;
+    if (_macroExpansionLength > kMTMaxMacroExpansionLength) {
+        [self setError:MTParseErrorMacroExpansionTooDeep
+               message:[NSString stringWithFormat:@"Macro expansions too long at \\%@", command]];
+        return NO;
+    }
+    NSUInteger rest = _length - _currentChar;
+    NSUInteger length = start + expansion.length + rest;
+    unichar* chars = malloc(sizeof(unichar) * length);
+    memcpy(chars, _chars, sizeof(unichar) * start);
+    [expansion getCharacters:chars + start range:NSMakeRange(0, expansion.length)];
+    memcpy(chars + start + expansion.length, _chars + _currentChar, sizeof(unichar) * rest);
+    free(_chars);
+    _chars = chars;
+    _length = length;
+    _currentChar = start;
+    return YES;
+}
+
 - (BOOL) hasCharacters
 {
     return _currentChar < _length;
@@ -156,6 +226,7 @@ static const NSInteger kMTMaxRecursionDepth = 150;
 
 - (MTMathList *)build
 {
+    MTTracePhase(kMTLayoutPhaseParse);
     MTMathList* list = [self buildInternal:false];
     if ([self hasCharacters] && !_error) {
         // something went wrong most likely braces mismatched
@@ -216,6 +287,7 @@ static const NSInteger kMTMaxRecursionDepth = 150;
             }
             // this is a superscript for the previous atom
             // note: if the next char is the stopChar it will be consumed by the ^ and so it doesn't count as stop
+            prevAtom = [list mutableAtom:prevAtom];
             prevAtom.superScript = [self buildInternal:true];
             continue;
         } else if (ch == '_') {
@@ -229,6 +301,7 @@ static const NSInteger kMTMaxRecursionDepth = 150;
             }
             // this is a subscript for the previous atom
             // note: if the next char is the stopChar it will be consumed by the _ and so it doesn't count as stop
+            prevAtom = [list mutableAtom:prevAtom];
             prevAtom.subScript = [self buildInternal:true];
             continue;
         } else if (ch == '{') {
@@ -258,7 +331,7 @@ static const NSInteger kMTMaxRecursionDepth = 150;
                 // prime attaches to the fraction (or field atom), not a spurious
                 // empty Ord — mirrors the pre-grouping behavior and the shared
                 // append path below (prevAtom = atom).
-                prevAtom = [sublist.atoms lastObject];
+                prevAtom = [sublist.atomsForReading lastObject];
                 [list append:sublist];
                 if (oneCharOnly) {
                     return list;
@@ -284,7 +357,13 @@ static const NSInteger kMTMaxRecursionDepth = 150;
             return nil;
         } else if (ch == '\\') {
             // \ means a command
+            int start = _currentChar - 1;
             NSString* command = [self readCommand];
+            if ([self expandMacro:command start:start]) {
+                continue;
+            } else if (_error) {
+                return nil;
+            }
             if ([command isEqualToString:@"hline"]) {
                 // \hline is a no-op boundary marker: record it and keep reading the same cell.
                 if (![self recordHorizontalLine]) {
@@ -298,7 +377,7 @@ static const NSInteger kMTMaxRecursionDepth = 150;
             } else if (_error) {
                 return nil;
             }
-            if ([self applyModifier:command atom:prevAtom]) {
+            if ([self applyModifier:command atom:&prevAtom list:list]) {
                 continue;
             }
             // Recognize \text* commands first — they consume their {…}
@@ -332,7 +411,7 @@ static const NSInteger kMTMaxRecursionDepth = 150;
                 _currentFontStyle = oldFontStyle;
                 _spacesAllowed = oldSpacesAllowed;
 
-                prevAtom = [sublist.atoms lastObject];
+                prevAtom = [sublist.atomsForReading lastObject];
                 [list append:sublist];
                 if (oneCharOnly) {
                     return list;
@@ -364,9 +443,8 @@ static const NSInteger kMTMaxRecursionDepth = 150;
             if (oneCharOnly) {
                 // We're filling a single-char slot (^X / _X / \fontStyle{X}).
                 // Emit one \prime atom and let the caller consume it.
-                MTMathAtom* primeAtom = [MTMathAtomFactory atomForLatexSymbolName:@"prime"];
+                MTMathAtom* primeAtom = [self atomInCurrentFontStyle:[self sharedAtomForLatexSymbolName:@"prime"]];
                 NSAssert(primeAtom != nil, @"\\prime must be registered");
-                primeAtom.fontStyle = _currentFontStyle;
                 [list addAtom:primeAtom];
                 return list;
             }
@@ -378,17 +456,15 @@ static const NSInteger kMTMaxRecursionDepth = 150;
                 [list addAtom:prevAtom];
             }
             MTMathList* primes = [MTMathList new];
-            MTMathAtom* primeAtom = [MTMathAtomFactory atomForLatexSymbolName:@"prime"];
-            NSAssert(primeAtom != nil, @"\\prime must be registered");
-            primeAtom.fontStyle = _currentFontStyle;
-            [primes addAtom:primeAtom];
+            MTMathAtom* sharedPrime = [self sharedAtomForLatexSymbolName:@"prime"];
+            NSAssert(sharedPrime != nil, @"\\prime must be registered");
+            // Only the frozen shared atom may be added more than once; a styled one is copied for each prime.
+            [primes addAtom:[self atomInCurrentFontStyle:sharedPrime]];
             // Greedy collect more consecutive primes.
             while ([self hasCharacters]) {
                 unichar peek = [self getNextCharacter];
                 if (peek == '\'') {
-                    MTMathAtom* extra = [MTMathAtomFactory atomForLatexSymbolName:@"prime"];
-                    extra.fontStyle = _currentFontStyle;
-                    [primes addAtom:extra];
+                    [primes addAtom:[self atomInCurrentFontStyle:sharedPrime]];
                 } else {
                     [self unlookCharacter];
                     break;
@@ -404,16 +480,17 @@ static const NSInteger kMTMaxRecursionDepth = 150;
                     [self unlookCharacter];
                 }
             }
+            prevAtom = [list mutableAtom:prevAtom];
             prevAtom.superScript = primes;
             continue;
         } else if (_spacesAllowed && ch == ' ') {
             // If spaces are allowed then spaces do not need escaping with a \ before being used.
-            atom = [MTMathAtomFactory atomForLatexSymbolName:@" "];
+            atom = [self sharedAtomForLatexSymbolName:@" "];
         } else if (ch == '~') {
             // Tilde is a non-breaking space in LaTeX; render it as an ordinary space.
-            atom = [MTMathAtomFactory atomForLatexSymbolName:@" "];
+            atom = [self sharedAtomForLatexSymbolName:@" "];
         } else {
-            atom = [MTMathAtomFactory atomForCharacter:ch];
+            atom = [MTMathAtomFactory sharedAtomForCharacter:ch];
             if (!atom) {
                 // Characters TeX silently discards: whitespace (catcode 10/5,
                 // ignored in math mode) and NUL (catcode 9). Note that other
@@ -436,7 +513,7 @@ static const NSInteger kMTMaxRecursionDepth = 150;
             }
         }
         NSAssert(atom != nil, @"Atom shouldn't be nil");
-        atom.fontStyle = _currentFontStyle;
+        atom = [self atomInCurrentFontStyle:atom];
         [list addAtom:atom];
         prevAtom = atom;
         
@@ -516,7 +593,7 @@ static const NSInteger kMTMaxRecursionDepth = 150;
             }
         }
 
-        MTMathAtom* atom = [MTMathAtomFactory atomForLatexSymbolName:command];
+        MTMathAtom* atom = [self sharedAtomForLatexSymbolName:command];
         if (atom && atom.nucleus.length > 0) {
             return atom.nucleus;
         }
@@ -637,8 +714,8 @@ static const NSInteger kMTMaxRecursionDepth = 150;
 
     // Read the entire token up to the closing brace or whitespace.
     // We deliberately do NOT restrict the charset here so that invalid
-    // inputs (e.g. named colors like "red") are captured whole and can
-    // produce a clear validation error instead of a confusing "Missing }".
+    // inputs (e.g. "#ff 00") are captured whole and can produce a clear
+    // validation error instead of a confusing "Missing }".
     NSMutableString* mutable = [NSMutableString string];
     while([self hasCharacters]) {
         unichar ch = [self getNextCharacter];
@@ -656,43 +733,20 @@ static const NSInteger kMTMaxRecursionDepth = 150;
         return nil;
     }
 
-    // Validate: color must be '#' followed by exactly 3 or 6 hex digits.
-    // This keeps the grammar consistent with colorFromHexString: which requires
-    // a leading '#'.  Named colors and bare hex strings are not supported.
-    //
-    // NOTE: 3-digit #RGB is accepted here at parse time, but correct *rendering*
-    // of #RGB depends on colorFromHexString: handling the 3-digit shorthand.
-    // The current decoder is 6-digit-only (scanHexInt on "f00" yields 0xF00 and
-    // is masked as if it were #000F00), so #RGB currently renders the wrong
-    // color until that decoder fix (REN-7) lands.  We deliberately keep
-    // accepting #RGB rather than rejecting it: the previous parser also
-    // accepted and mis-rendered #RGB identically, so this is parse-correct /
-    // render-deferred, not a regression.
-    BOOL valid = NO;
-    NSUInteger len = mutable.length;
-    if (len == 4 || len == 7) {
-        unichar first = [mutable characterAtIndex:0];
-        if (first == '#') {
-            valid = YES;
-            for (NSUInteger i = 1; i < len && valid; i++) {
-                unichar c = [mutable characterAtIndex:i];
-                BOOL isHex = ((c >= '0' && c <= '9') ||
-                              (c >= 'a' && c <= 'f') ||
-                              (c >= 'A' && c <= 'F'));
-                if (!isHex) {
-                    valid = NO;
-                }
-            }
-        }
-    }
+    // The color atom decodes and validates the string (see -validateColor:string:).
+    return mutable;
+}
 
-    if (!valid) {
-        NSString* msg = [NSString stringWithFormat:@"Invalid color: %@", mutable];
+// Sets the error for a color argument that the color atom could not decode. A color must be
+// '#' followed by exactly 3 or 6 hex digits, or a color name.
+- (BOOL) validateColor:(MTRGBAColor) rgba string:(NSString*) colorString
+{
+    if (rgba == 0) {
+        NSString* msg = [NSString stringWithFormat:@"Invalid color: %@", colorString];
         [self setError:MTParseErrorInvalidCommand message:msg];
-        return nil;
+        return NO;
     }
-
-    return mutable;
+    return YES;
 }
 
 // Reads a TeX length dimension (e.g. "1em", "-0.5em", "3mu") from the char stream.
@@ -1068,7 +1122,7 @@ static const NSInteger kMTMaxRecursionDepth = 150;
 
 - (MTMathAtom*) atomForCommand:(NSString*) command
 {
-    MTMathAtom* atom = [MTMathAtomFactory atomForLatexSymbolName:command];
+    MTMathAtom* atom = [self sharedAtomForLatexSymbolName:command];
     if (atom) {
         return atom;
     }
@@ -1223,6 +1277,9 @@ static const NSInteger kMTMaxRecursionDepth = 150;
         }
         MTMathColor* mathColor = [[MTMathColor alloc] init];
         mathColor.colorString = colorStr;
+        if (![self validateColor:mathColor.rgbaColor string:colorStr]) {
+            return nil;
+        }
         mathColor.innerList = [self buildInternal:true];
         return mathColor;
     } else if ([command isEqualToString:@"colorbox"]) {
@@ -1234,6 +1291,9 @@ static const NSInteger kMTMaxRecursionDepth = 150;
         }
         MTMathColorbox* mathColorbox = [[MTMathColorbox alloc] init];
         mathColorbox.colorString = colorStr;
+        if (![self validateColor:mathColorbox.rgbaColor string:colorStr]) {
+            return nil;
+        }
         mathColorbox.innerList = [self buildInternal:true];
         return mathColorbox;
     }
@@ -1411,26 +1471,29 @@ static const NSInteger kMTMaxRecursionDepth = 150;
     return nil;
 }
 
-// Applies the modifier to the atom. Returns true if modifier applied.
-- (BOOL) applyModifier:(NSString*) modifier atom:(MTMathAtom*) atom
+// Applies the modifier to the atom, which is in `list`. A shared atom is replaced by the copy that
+// is changed. Returns true if modifier applied.
+- (BOOL) applyModifier:(NSString*) modifier atom:(MTMathAtom* __strong *) atom list:(MTMathList*) list
 {
     if ([modifier isEqualToString:@"limits"]) {
-        if (atom.type != kMTMathAtomLargeOperator) {
+        if ((*atom).type != kMTMathAtomLargeOperator) {
             NSString* errorMessage = [NSString stringWithFormat:@"limits can only be applied to an operator."];
             [self setError:MTParseErrorInvalidLimits message:errorMessage];
         } else {
-            MTLargeOperator* op = (MTLargeOperator*) atom;
+            MTLargeOperator* op = [list mutableAtom:*atom];
             op.limits = YES;
+            *atom = op;
         }
         return true;
     } else if ([modifier isEqualToString:@"nolimits"]) {
-        if (atom.type != kMTMathAtomLargeOperator) {
+        if ((*atom).type != kMTMathAtomLargeOperator) {
             NSString* errorMessage = [NSString stringWithFormat:@"nolimits can only be applied to an operator."];
             [self setError:MTParseErrorInvalidLimits message:errorMessage];
             return YES;
         } else {
-            MTLargeOperator* op = (MTLargeOperator*) atom;
+            MTLargeOperator* op = [list mutableAtom:*atom];
             op.limits = NO;
+            *atom = op;
         }
         return true;
     }
@@ -1495,7 +1558,7 @@ static const NSInteger kMTMaxRecursionDepth = 150;
         NSArray<MTMathList*>* lastRow = rows.lastObject;
         BOOL lastRowEmpty = YES;
         for (MTMathList* cell in lastRow) {
-            if (cell.atoms.count > 0) {
+            if (cell.atomsForReading.count > 0) {
                 lastRowEmpty = NO;
                 break;
             }
@@ -1683,7 +1746,12 @@ static const NSInteger kMTMaxRecursionDepth = 150;
 
 + (MTMathList *)buildFromString:(NSString *)str error:(NSError *__autoreleasing *)error
 {
-    MTMathListBuilder* builder = [[MTMathListBuilder alloc] initWithString:str];
+    return [self buildFromString:str context:nil error:error];
+}
+
++ (MTMathList *)buildFromString:(NSString *)str context:(MTMathParserContext *)context error:(NSError *__autoreleasing *)error
+{
+    MTMathListBuilder* builder = [[MTMathListBuilder alloc] initWithString:str context:context];
     MTMathList* output = [builder build];
     if (builder.error) {
         if (error) {
@@ -1710,11 +1778,22 @@ static const NSInteger kMTMaxRecursionDepth = 150;
     return @"";
 }
 
++ (NSString *)mathListToString:(MTMathList *)ml context:(MTMathParserContext *)context
+{
+    // The atoms write their symbols, and the lists inside them, with the context of the thread.
+    MTMathParserContext* previous = MTMathParserContextSetCurrent(context);
+    @try {
+        return [self mathListToString:ml];
+    } @finally {
+        MTMathParserContextSetCurrent(previous);
+    }
+}
+
 + (NSString *)mathListToString:(MTMathList *)ml
 {
     NSMutableString* str = [NSMutableString string];
     MTFontStyle currentfontStyle = kMTFontStyleDefault;
-    for (MTMathAtom* atom in ml.atoms) {
+    for (MTMathAtom* atom in ml.atomsForReading) {
         if (currentfontStyle != atom.fontStyle) {
             if (currentfontStyle != kMTFontStyleDefault) {
                 // close the previous font style.
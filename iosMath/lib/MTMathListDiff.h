@@ -0,0 +1,71 @@
+//
+//  MTMathListDiff.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import Foundation;
+
+#import "MTMathList.h"
+#import "MTMathListIndex.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ @typedef MTMathListChangeType
+ @brief What a change does at its index.
+ */
+typedef NS_ENUM(NSUInteger, MTMathListChangeType) {
+    /// An atom is inserted before the atom at the index, or at the end of its list.
+    kMTMathListChangeInsert,
+    /// The atom at the index is removed.
+    kMTMathListChangeDelete,
+    /// The atom at the index, with its scripts and inner lists, is replaced.
+    kMTMathListChangeReplace,
+};
+
+/** One change of a diff. */
+@interface MTMathListChange : NSObject
+
+- (instancetype) init NS_UNAVAILABLE;
+
+@property (nonatomic, readonly) MTMathListChangeType type;
+/// Where the change applies. Its innermost level has the type `kMTSubIndexTypeNone`.
+@property (nonatomic, readonly) MTMathListIndex* index;
+/// The atom inserted or put in place, from the new list. Nil for a delete.
+@property (nonatomic, readonly, nullable) MTMathAtom* atom;
+
+@end
+
+/**
+ The structural difference between two math lists, as the atoms inserted, removed and replaced at
+ `MTMathListIndex` paths. Subtrees are compared by `fingerprint`: lists and atoms that are the same
+ object, or have the same fingerprint, are skipped without being walked again, and the atoms of a list are
+ aligned on their fingerprints. A diff of two large lists that differ in a few places takes linear time, and
+ less when the lists share atoms whose fingerprints are cached.
+
+ When two atoms in the same place differ only inside their scripts, fractions, radicals or inner lists,
+ the diff goes into those lists instead of replacing the atom. Any other difference, including in the
+ cells of a table, replaces the atom.
+ */
+@interface MTMathListDiff : NSObject
+
+- (instancetype) init NS_UNAVAILABLE;
+
+/** The changes that turn `from` into `to`. Every index is into `from`, and the changes are ordered
+ from the end of each list to its start, so that applying them in order, e.g. with
+ `-[MTPersistentMathList listByApplyingChanges:]`, leaves the indexes of the changes still to apply
+ valid. */
++ (NSArray<MTMathListChange*>*) changesFromMathList:(MTMathList*) from toMathList:(MTMathList*) to;
+
+/** The smallest edit that covers the changes, in the form that
+ `+[MTTypesetter createLineForMathList:font:style:previousDisplay:changedIndex:]` takes, so that only the
+ lists on the path to the changes are laid out again. Returns nil if there are no changes, or if they
+ are spread over the top level list so that it has to be laid out in full. */
++ (nullable MTMathListIndex*) changedIndexForChanges:(NSArray<MTMathListChange*>*) changes;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,416 @@
+//
+//  MTMathListDiff.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTMathListDiff.h"
+#import "MTMathListHasher.h"
+#import "MTMathListInternal.h"
+
+// The lists that a MTMathListIndex can go into, which the diff goes into rather than replacing the atom.
+static const MTMathListSubIndexType kMTDiffChildTypes[] = {
+    kMTSubIndexTypeSuperscript, kMTSubIndexTypeSubscript, kMTSubIndexTypeNumerator, kMTSubIndexTypeDenominator,
+    kMTSubIndexTypeRadicand, kMTSubIndexTypeDegree, kMTSubIndexTypeInner,
+};
+enum { kMTDiffChildTypeCount = sizeof(kMTDiffChildTypes) / sizeof(kMTDiffChildTypes[0]) };
+
+// The most insertions and deletions that the atoms of a list are aligned over. Lists that differ in more
+// are diffed atom by atom at the same positions.
+static const NSInteger kMTDiffMaxEdits = 128;
+
+#pragma mark - Alignment
+
+// Aligns two sequences of hashes with the O(ND) algorithm of Myers, and writes the indexes of the matched
+// elements in increasing order. Returns NO if the sequences differ in more than kMTDiffMaxEdits insertions
+// and deletions.
+static BOOL MTAlignHashes(const uint64_t* a, NSInteger n, const uint64_t* b, NSInteger m,
+                          NSInteger* matchesA, NSInteger* matchesB, NSUInteger* matchCount)
+{
+    NSInteger max = MIN(n + m, kMTDiffMaxEdits);
+    NSInteger offset = max + 1;
+    NSInteger width = 2 * max + 3;
+    // v[offset + k] is the furthest x reached on the diagonal k = x - y. The trace keeps v before every
+    // round, to walk the path back.
+    NSInteger* v = calloc(width, sizeof(NSInteger));
+    NSInteger* trace = malloc(sizeof(NSInteger) * width * (max + 1));
+    NSInteger edits = -1;
+    for (NSInteger d = 0; d <= max && edits < 0; d++) {
+        memcpy(trace + d * width, v, sizeof(NSInteger) * width);
+        for (NSInteger k = -d; k <= d; k += 2) {
+            BOOL down = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]));
+            NSInteger x = down ? v[offset + k + 1] : v[offset + k - 1] + 1;
+            NSInteger y = x - k;
+            while (x < n && y < m && a[x] == b[y]) {
+                x++;
+                y++;
+            }
+            v[offset + k] = x;
+            if (x >= n && y >= m) {
+                edits = d;
+                break;
+            }
+        }
+    }
+    free(v);
+    if (edits < 0) {
+        free(trace);
+        return NO;
+    }
+
+    NSInteger x = n, y = m;
+    NSUInteger count = 0;
+    for (NSInteger d = edits; d >= 0; d--) {
+        const NSInteger* vd = trace + d * width;
+        NSInteger k = x - y;
+        BOOL down = (k == -d || (k != d && vd[offset + k - 1] < vd[offset + k + 1]));
+        NSInteger previousK = down ? k + 1 : k - 1;
+        NSInteger previousX = vd[offset + previousK];
+        NSInteger previousY = previousX - previousK;
+        while (x > previousX && y > previousY) {
+            x--;
+            y--;
+            matchesA[count] = x;
+            matchesB[count] = y;
+            count++;
+        }
+        x = previousX;
+        y = previousY;
+    }
+    free(trace);
+    // The walk back found them from the end.
+    for (NSUInteger i = 0; i < count / 2; i++) {
+        NSInteger t = matchesA[i];
+        matchesA[i] = matchesA[count - 1 - i];
+        matchesA[count - 1 - i] = t;
+        t = matchesB[i];
+        matchesB[i] = matchesB[count - 1 - i];
+        matchesB[count - 1 - i] = t;
+    }
+    *matchCount = count;
+    return YES;
+}
+
+#pragma mark - MTMathListChange
+
+@interface MTMathListChange ()
+
+- (instancetype) initWithType:(MTMathListChangeType) type index:(MTMathListIndex*) index atom:(nullable MTMathAtom*) atom NS_DESIGNATED_INITIALIZER;
+
+@end
+
+@implementation MTMathListChange
+
+- (instancetype)initWithType:(MTMathListChangeType)type index:(MTMathListIndex *)index atom:(MTMathAtom *)atom
+{
+    self = [super init];
+    if (self) {
+        _type = type;
+        _index = index;
+        _atom = atom;
+    }
+    return self;
+}
+
+- (NSString *)description
+{
+    switch (_type) {
+        case kMTMathListChangeInsert:
+            return [NSString stringWithFormat:@"insert %@ at %@", _atom, _index];
+        case kMTMathListChangeDelete:
+            return [NSString stringWithFormat:@"delete at %@", _index];
+        case kMTMathListChangeReplace:
+            return [NSString stringWithFormat:@"replace %@ at %@", _atom, _index];
+    }
+    return super.description;
+}
+
+@end
+
+#pragma mark - MTMathListDiff
+
+// A level of the index of the list being diffed, from the innermost out.
+typedef struct MTDiffLevel {
+    const struct MTDiffLevel* parent;
+    NSUInteger atomIndex;
+    MTMathListSubIndexType type;
+} MTDiffLevel;
+
+// Atoms [oldStart, oldStart + oldCount) of the old list became [newStart, newStart + newCount) of the new one.
+typedef struct {
+    NSUInteger oldStart, oldCount, newStart, newCount;
+} MTDiffRun;
+
+@interface MTMathListDiff ()
+
+- (instancetype) initPrivate NS_DESIGNATED_INITIALIZER;
+
+@end
+
+@implementation MTMathListDiff {
+    MTMathListHasher* _hasher;
+    NSMutableArray<MTMathListChange*>* _changes;
+}
+
+- (instancetype) initPrivate
+{
+    self = [super init];
+    if (self) {
+        _hasher = [MTMathListHasher new];
+        _changes = [NSMutableArray array];
+    }
+    return self;
+}
+
++ (NSArray<MTMathListChange *> *)changesFromMathList:(MTMathList *)from toMathList:(MTMathList *)to
+{
+    NSParameterAssert(from);
+    NSParameterAssert(to);
+    MTMathListDiff* diff = [[self alloc] initPrivate];
+    [diff diffList:from toList:to parent:NULL];
+    return diff->_changes;
+}
+
+- (MTMathListIndex*) indexOfAtom:(NSUInteger) atomIndex inList:(const MTDiffLevel*) parent
+{
+    MTMathListIndex* index = [MTMathListIndex level0Index:atomIndex];
+    for (const MTDiffLevel* level = parent; level; level = level->parent) {
+        index = [MTMathListIndex indexAtLocation:level->atomIndex withSubIndex:index type:level->type];
+    }
+    return index;
+}
+
+- (void) addChange:(MTMathListChangeType) type atom:(MTMathAtom*) atom at:(NSUInteger) atomIndex inList:(const MTDiffLevel*) parent
+{
+    MTMathListIndex* index = [self indexOfAtom:atomIndex inList:parent];
+    [_changes addObject:[[MTMathListChange alloc] initWithType:type index:index atom:atom]];
+}
+
+- (BOOL) isAtom:(MTMathAtom*) atom equalTo:(MTMathAtom*) other
+{
+    return atom == other || [atom fingerprintWithHasher:_hasher] == [other fingerprintWithHasher:_hasher];
+}
+
+- (void) diffList:(MTMathList*) from toList:(MTMathList*) to parent:(const MTDiffLevel*) parent
+{
+    if (from == to) {
+        return;
+    }
+    NSArray<MTMathAtom*>* oldAtoms = from.atomsForReading;
+    NSArray<MTMathAtom*>* newAtoms = to.atomsForReading;
+    NSUInteger n = oldAtoms.count, m = newAtoms.count;
+    NSUInteger prefix = 0;
+    while (prefix < n && prefix < m && [self isAtom:oldAtoms[prefix] equalTo:newAtoms[prefix]]) {
+        prefix++;
+    }
+    NSUInteger suffix = 0;
+    while (suffix < n - prefix && suffix < m - prefix
+           && [self isAtom:oldAtoms[n - 1 - suffix] equalTo:newAtoms[m - 1 - suffix]]) {
+        suffix++;
+    }
+    NSUInteger oldCount = n - prefix - suffix, newCount = m - prefix - suffix;
+    if (oldCount == 0 && newCount == 0) {
+        return;
+    }
+
+    uint64_t* hashes = malloc(sizeof(uint64_t) * (oldCount + newCount));
+    for (NSUInteger i = 0; i < oldCount; i++) {
+        hashes[i] = [oldAtoms[prefix + i] fingerprintWithHasher:_hasher];
+    }
+    for (NSUInteger i = 0; i < newCount; i++) {
+        hashes[oldCount + i] = [newAtoms[prefix + i] fingerprintWithHasher:_hasher];
+    }
+    NSUInteger capacity = MIN(oldCount, newCount);
+    NSInteger* matchesA = malloc(sizeof(NSInteger) * (capacity + 1));
+    NSInteger* matchesB = malloc(sizeof(NSInteger) * (capacity + 1));
+    NSUInteger matchCount = 0;
+    if (!MTAlignHashes(hashes, oldCount, hashes + oldCount, newCount, matchesA, matchesB, &matchCount)) {
+        matchCount = 0;
+    }
+    free(hashes);
+
+    // The atoms between the matches, front to back.
+    MTDiffRun* runs = malloc(sizeof(MTDiffRun) * (matchCount + 1));
+    NSUInteger runCount = 0;
+    NSUInteger nextA = 0, nextB = 0;
+    for (NSUInteger i = 0; i <= matchCount; i++) {
+        NSUInteger a = (i < matchCount) ? matchesA[i] : oldCount;
+        NSUInteger b = (i < matchCount) ? matchesB[i] : newCount;
+        if (a > nextA || b > nextB) {
+            runs[runCount++] = (MTDiffRun) { prefix + nextA, a - nextA, prefix + nextB, b - nextB };
+        }
+        nextA = a + 1;
+        nextB = b + 1;
+    }
+    free(matchesA);
+    free(matchesB);
+
+    // Back to front, so that the changes made first do not move the atoms of the ones after them.
+    for (NSUInteger r = runCount; r > 0; r--) {
+        MTDiffRun run = runs[r - 1];
+        NSUInteger paired = MIN(run.oldCount, run.newCount);
+        for (NSUInteger i = run.oldCount; i > paired; i--) {
+            [self addChange:kMTMathListChangeDelete atom:nil at:run.oldStart + i - 1 inList:parent];
+        }
+        // Each one inserted before the one after it.
+        for (NSUInteger i = run.newCount; i > paired; i--) {
+            [self addChange:kMTMathListChangeInsert atom:newAtoms[run.newStart + i - 1]
+                         at:run.oldStart + run.oldCount inList:parent];
+        }
+        for (NSUInteger i = paired; i > 0; i--) {
+            [self diffAtom:oldAtoms[run.oldStart + i - 1] toAtom:newAtoms[run.newStart + i - 1]
+                        at:run.oldStart + i - 1 inList:parent];
+        }
+    }
+    free(runs);
+}
+
+- (void) diffAtom:(MTMathAtom*) from toAtom:(MTMathAtom*) to at:(NSUInteger) atomIndex inList:(const MTDiffLevel*) parent
+{
+    if ([self isAtom:from equalTo:to]) {
+        return;
+    }
+    if ([_hasher shellHashOfAtom:from] != [_hasher shellHashOfAtom:to]) {
+        [self addChange:kMTMathListChangeReplace atom:to at:atomIndex inList:parent];
+        return;
+    }
+    for (NSUInteger i = 0; i < kMTDiffChildTypeCount; i++) {
+        MTMathListSubIndexType type = kMTDiffChildTypes[i];
+        MTMathList* fromList = MTMathAtomChildList(from, type);
+        MTMathList* toList = MTMathAtomChildList(to, type);
+        if (fromList || toList) {
+            MTDiffLevel level = { parent, atomIndex, type };
+            [self diffList:fromList toList:toList parent:&level];
+        }
+    }
+}
+
+#pragma mark Incremental layout
+
+// The level of the index `depth` levels down.
+static MTMathListIndex* MTIndexAtDepth(MTMathListIndex* index, NSUInteger depth)
+{
+    for (NSUInteger i = 0; i < depth; i++) {
+        index = index.subIndex;
+    }
+    return index;
+}
+
+// The first `depth` levels of `index`, and then `atomIndex` in the list they lead to.
+static MTMathListIndex* MTIndexWithFinalAtom(MTMathListIndex* index, NSUInteger depth, NSUInteger atomIndex)
+{
+    if (depth == 0) {
+        return [MTMathListIndex level0Index:atomIndex];
+    }
+    return [MTMathListIndex indexAtLocation:index.atomIndex
+                               withSubIndex:MTIndexWithFinalAtom(index.subIndex, depth - 1, atomIndex)
+                                       type:index.subIndexType];
+}
+
+// The first atom of the edit, if the changes, all in one list, are a single edit as the typesetter takes
+// it: the atoms from there on that the changes touch in the new list are the first 1 + max(0, delta), where
+// delta is the number of atoms inserted less the number removed. That is an optional replace followed by
+// removals of the atoms right after it or by insertions right after it.
+static BOOL MTChangesAreOneEdit(NSArray<MTMathListChange*>* changes, NSUInteger depth, NSUInteger* start)
+{
+    NSUInteger first = NSUIntegerMax;
+    NSUInteger replaced = NSNotFound;
+    NSMutableIndexSet* deleted = [NSMutableIndexSet indexSet];
+    NSUInteger deleteCount = 0;
+    NSUInteger inserted = NSNotFound;
+    for (MTMathListChange* change in changes) {
+        NSUInteger atomIndex = MTIndexAtDepth(change.index, depth).atomIndex;
+        first = MIN(first, atomIndex);
+        switch (change.type) {
+            case kMTMathListChangeReplace:
+                if (replaced != NSNotFound) {
+                    return NO;
+                }
+                replaced = atomIndex;
+                break;
+            case kMTMathListChangeDelete:
+                [deleted addIndex:atomIndex];
+                deleteCount++;
+                break;
+            case kMTMathListChangeInsert:
+                if (inserted != NSNotFound && inserted != atomIndex) {
+                    return NO;
+                }
+                inserted = atomIndex;
+                break;
+        }
+    }
+    NSUInteger after = first;
+    if (replaced != NSNotFound) {
+        if (replaced != first) {
+            return NO;
+        }
+        after = first + 1;
+    }
+    if (deleteCount > 0 && inserted != NSNotFound) {
+        return NO;
+    }
+    if (deleteCount > 0 && (deleted.count != deleteCount || deleted.firstIndex != after
+                            || deleted.lastIndex - deleted.firstIndex + 1 != deleteCount)) {
+        return NO;
+    }
+    if (inserted != NSNotFound && inserted != after) {
+        return NO;
+    }
+    *start = first;
+    return YES;
+}
+
++ (MTMathListIndex *)changedIndexForChanges:(NSArray<MTMathListChange *> *)changes
+{
+    if (changes.count == 0) {
+        return nil;
+    }
+    // The levels that every change goes through.
+    MTMathListIndex* first = changes[0].index;
+    NSUInteger depth = first.depth - 1;
+    for (MTMathListChange* change in changes) {
+        MTMathListIndex* a = first;
+        MTMathListIndex* b = change.index;
+        NSUInteger common = 0;
+        while (common < depth && a.subIndex && b.subIndex
+               && a.atomIndex == b.atomIndex && a.subIndexType == b.subIndexType) {
+            common++;
+            a = a.subIndex;
+            b = b.subIndex;
+        }
+        depth = common;
+    }
+
+    BOOL sameList = YES;
+    BOOL sameAtom = YES;
+    NSUInteger atomIndex = MTIndexAtDepth(first, depth).atomIndex;
+    for (MTMathListChange* change in changes) {
+        MTMathListIndex* level = MTIndexAtDepth(change.index, depth);
+        if (level.subIndex) {
+            sameList = NO;
+        } else {
+            sameAtom = NO;
+        }
+        if (level.atomIndex != atomIndex) {
+            sameAtom = NO;
+        }
+    }
+    NSUInteger start = 0;
+    if (sameList && MTChangesAreOneEdit(changes, depth, &start)) {
+        return MTIndexWithFinalAtom(first, depth, start);
+    }
+    if (sameAtom) {
+        // Changes in several lists of one atom: lay the atom out again.
+        return MTIndexWithFinalAtom(first, depth, atomIndex);
+    }
+    if (depth == 0) {
+        return nil;
+    }
+    // Lay out again the atom that holds the list.
+    return MTIndexWithFinalAtom(first, depth - 1, MTIndexAtDepth(first, depth - 1).atomIndex);
+}
+
+@end
@@ -0,0 +1,33 @@
+//
+//  MTMathListHasher.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTMathListArchiver.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ Computes fingerprints: hashes atoms through the fields they archive, so that a fingerprint covers
+ everything that an archive keeps. The lists and atoms below an atom are fed as their own fingerprints,
+ which are taken from their caches or computed with the same hasher.
+
+ A hasher is used by one thread at a time.
+ */
+@interface MTMathListHasher : MTMathListArchiver
+
+/** The fingerprint of the atom, computed now. */
+- (uint64_t) hashOfAtom:(MTMathAtom*) atom;
+/** The fingerprint of the list, computed now from the fingerprints of its atoms. */
+- (uint64_t) hashOfList:(MTMathList*) list;
+/** The hash of the atom without the contents of the lists that a `MTMathListIndex` can go into (its scripts,
+ the parts of a fraction or radical and its inner list), only whether it has them. Two atoms with the same
+ shell hash differ only inside those lists. */
+- (uint64_t) shellHashOfAtom:(MTMathAtom*) atom;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,192 @@
+//
+//  MTMathListHasher.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTMathListHasher.h"
+#import "MTMathListInternal.h"
+
+// The lists that -shellHashOfAtom: leaves out.
+static const MTMathListSubIndexType kMTShellChildTypes[] = {
+    kMTSubIndexTypeSuperscript, kMTSubIndexTypeSubscript, kMTSubIndexTypeNumerator, kMTSubIndexTypeDenominator,
+    kMTSubIndexTypeRadicand, kMTSubIndexTypeDegree, kMTSubIndexTypeInner,
+};
+enum { kMTShellChildTypeCount = sizeof(kMTShellChildTypes) / sizeof(kMTShellChildTypes[0]) };
+
+static const uint64_t kMTHashSeed = 0x9E3779B97F4A7C15ULL;
+
+static inline uint64_t MTHashMix(uint64_t state, uint64_t value)
+{
+    // The 64-bit finalizer of MurmurHash3.
+    uint64_t h = state ^ (value * 0xC2B2AE3D27D4EB4FULL);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+@implementation MTMathListHasher {
+    uint64_t _state;
+    // The lists that are left out of the shell hash being computed.
+    __unsafe_unretained MTMathList* _skipped[kMTShellChildTypeCount];
+    NSUInteger _skippedCount;
+    // The atom or list whose fingerprint is being computed, nil for a shell hash.
+    __unsafe_unretained id _node;
+}
+
+- (void) feed:(uint64_t) value
+{
+    _state = MTHashMix(_state, value);
+}
+
+// The kind that archives name the class with, rather than the class itself, so that fingerprints are
+// the same in every launch.
+- (void) feedKindOfAtom:(MTMathAtom*) atom
+{
+    NSUInteger kind = MTMathListArchiveKindOfAtom(atom);
+    [self feed:kind];
+    if (kind == 0) {
+        [self encodeString:NSStringFromClass(atom.class)];
+    }
+}
+
+- (uint64_t)hashOfList:(MTMathList *)list
+{
+    uint64_t saved = _state;
+    id savedNode = _node;
+    _state = kMTHashSeed;
+    _node = list;
+    NSArray<MTMathAtom*>* atoms = list.atomsForReading;
+    [self feed:atoms.count];
+    for (MTMathAtom* atom in atoms) {
+        MTFingerprintLinkParent(atom, list);
+        [self feed:[atom fingerprintWithHasher:self]];
+    }
+    uint64_t hash = _state;
+    _state = saved;
+    _node = savedNode;
+    return hash;
+}
+
+- (uint64_t)hashOfAtom:(MTMathAtom *)atom
+{
+    uint64_t saved = _state;
+    NSUInteger savedSkipped = _skippedCount;
+    id savedNode = _node;
+    _state = kMTHashSeed;
+    _skippedCount = 0;
+    _node = atom;
+    [self feedKindOfAtom:atom];
+    [atom encodeWithArchiver:self];
+    uint64_t hash = _state;
+    _state = saved;
+    _skippedCount = savedSkipped;
+    _node = savedNode;
+    return hash;
+}
+
+- (uint64_t)shellHashOfAtom:(MTMathAtom *)atom
+{
+    _skippedCount = 0;
+    for (NSUInteger i = 0; i < kMTShellChildTypeCount; i++) {
+        MTMathList* list = MTMathAtomChildList(atom, kMTShellChildTypes[i]);
+        if (list) {
+            _skipped[_skippedCount++] = list;
+        }
+    }
+    _state = kMTHashSeed;
+    _node = nil;
+    [self feedKindOfAtom:atom];
+    [atom encodeWithArchiver:self];
+    _skippedCount = 0;
+    return _state;
+}
+
+- (void)encodeMathList:(MTMathList *)list
+{
+    if (!list) {
+        [self feed:0];
+        return;
+    }
+    for (NSUInteger i = 0; i < _skippedCount; i++) {
+        if (_skipped[i] == list) {
+            [self feed:1];
+            return;
+        }
+    }
+    if (_node) {
+        MTFingerprintLinkParent(list, _node);
+    }
+    [self feed:[list fingerprintWithHasher:self]];
+}
+
+- (void)encodeAtom:(MTMathAtom *)atom
+{
+    if (!atom) {
+        [self feed:0];
+        return;
+    }
+    if (_node) {
+        MTFingerprintLinkParent(atom, _node);
+    }
+    [self feed:[atom fingerprintWithHasher:self]];
+}
+
+- (void)encodeUInteger:(NSUInteger)value
+{
+    [self feed:value];
+}
+
+- (void)encodeInteger:(NSInteger)value
+{
+    [self feed:(uint64_t) value];
+}
+
+- (void)encodeBool:(BOOL)value
+{
+    [self feed:value ? 1 : 0];
+}
+
+- (void)encodeFloat:(CGFloat)value
+{
+    Float64 f = value;
+    uint64_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    [self feed:bits];
+}
+
+- (void)encodeRange:(NSRange)range
+{
+    [self feed:range.location];
+    [self feed:range.length];
+}
+
+- (void)encodeString:(NSString *)string
+{
+    if (!string) {
+        [self feed:0];
+        return;
+    }
+    NSUInteger length = string.length;
+    [self feed:length + 1];
+    // Four UTF-16 units at a time.
+    unichar buffer[64];
+    for (NSUInteger start = 0; start < length; start += 64) {
+        NSUInteger count = MIN(64u, length - start);
+        [string getCharacters:buffer range:NSMakeRange(start, count)];
+        for (NSUInteger i = 0; i < count; i += 4) {
+            uint64_t word = 0;
+            for (NSUInteger j = i; j < MIN(i + 4, count); j++) {
+                word = (word << 16) | buffer[j];
+            }
+            [self feed:word];
+        }
+    }
+}
+
+@end
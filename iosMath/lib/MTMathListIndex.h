@@ -10,6 +10,23 @@
 
 @import Foundation;
 
+/// The most levels an `MTMathListIndexPath` holds.
+enum { kMTMathListIndexPathCapacity = 15 };
+
+/** An `MTMathListIndex` as a value: its nodes packed inline, one 32 bit word per level, with no objects.
+    Editors can keep paths in their own structures and move them around without allocating. Two paths are
+    compared and hashed in constant time.
+
+    The levels past `depth` are always 0, so paths can be compared with `memcmp`. Use the functions below
+    rather than the fields.
+ */
+typedef struct MTMathListIndexPath {
+    /// The number of levels, from 1 to `kMTMathListIndexPathCapacity`.
+    uint32_t depth;
+    /// Level i is `(atomIndex << 4) | subIndexType`.
+    uint32_t levels[kMTMathListIndexPathCapacity];
+} MTMathListIndexPath;
+
 /** 
  * An index that points to a particular character in the MTMathList. The index is a LinkedList that represents
  * a path from the beginning of the MTMathList to reach a particular atom in the list. The next node of the path
@@ -24,6 +41,10 @@
  * index.
  * 
  * The level of an index is the number of nodes in the LinkedList to get to the final path.
+ *
+ * The nodes of an index are stored packed in the index object, as the same levels as an
+ * `MTMathListIndexPath`, and navigating copies them rather than building a chain of objects. The subIndex
+ * is made on first use.
  */
 NS_ASSUME_NONNULL_BEGIN
 
@@ -108,8 +129,47 @@ typedef NS_ENUM(unsigned int, MTMathListSubIndexType) {
                     withSubIndex:(nullable MTMathListIndex *)subIndex
                             type:(MTMathListSubIndexType)type;
 
+/// The number of nodes in the index, at least 1.
+@property (nonatomic, readonly) NSUInteger depth;
+
+/** Creates an index with the levels of `path`, which must have at least one level. */
++ (instancetype) indexWithPath:(MTMathListIndexPath)path;
+
+/** Copies the levels of the index to `path`. Returns NO, leaving `path` unchanged, if the index is deeper
+    than `kMTMathListIndexPathCapacity`. */
+- (BOOL) getPath:(MTMathListIndexPath *)path;
+
 @end
 
+/// A path with one level, pointing at atom `atomIndex`. Atom indexes must be less than 2^28.
+FOUNDATION_EXTERN MTMathListIndexPath MTMathListIndexPathMake(NSUInteger atomIndex);
+/// The atom index at `level`.
+FOUNDATION_EXTERN NSUInteger MTMathListIndexPathAtomIndex(MTMathListIndexPath path, NSUInteger level);
+/// The subindex type at `level`.
+FOUNDATION_EXTERN MTMathListSubIndexType MTMathListIndexPathSubIndexType(MTMathListIndexPath path, NSUInteger level);
+
+/// Same as `-[MTMathListIndex levelUpWithSubIndex:type:]`. Returns NO, leaving `path` unchanged, if the
+/// result would be deeper than `kMTMathListIndexPathCapacity`.
+FOUNDATION_EXTERN BOOL MTMathListIndexPathLevelUp(MTMathListIndexPath* path, const MTMathListIndexPath* _Nullable subIndex,
+                                                  MTMathListSubIndexType type);
+/// Same as `-[MTMathListIndex levelDown]`. Returns NO, leaving `path` unchanged, where that returns nil.
+FOUNDATION_EXTERN BOOL MTMathListIndexPathLevelDown(MTMathListIndexPath* path);
+/// Same as `-[MTMathListIndex previous]`. Returns NO, leaving `path` unchanged, where that returns nil.
+FOUNDATION_EXTERN BOOL MTMathListIndexPathPrevious(MTMathListIndexPath* path);
+/// Same as `-[MTMathListIndex next]`.
+FOUNDATION_EXTERN void MTMathListIndexPathNext(MTMathListIndexPath* path);
+
+/// Same as `-[MTMathListIndex isAtBeginningOfLine]`.
+FOUNDATION_EXTERN BOOL MTMathListIndexPathIsAtBeginningOfLine(MTMathListIndexPath path);
+/// Same as `-[MTMathListIndex finalSubIndexType]`.
+FOUNDATION_EXTERN MTMathListSubIndexType MTMathListIndexPathFinalSubIndexType(MTMathListIndexPath path);
+/// Same as `-[MTMathListIndex hasSubIndexOfType:]`.
+FOUNDATION_EXTERN BOOL MTMathListIndexPathHasSubIndexOfType(MTMathListIndexPath path, MTMathListSubIndexType type);
+
+FOUNDATION_EXTERN BOOL MTMathListIndexPathEqualToPath(MTMathListIndexPath path, MTMathListIndexPath other);
+/// Equal paths have equal hashes, which are the hashes of the equal `MTMathListIndex`.
+FOUNDATION_EXTERN NSUInteger MTMathListIndexPathHash(MTMathListIndexPath path);
+
 /** A range of atoms in an `MTMathList`. This is similar to `NSRange` with a start and length, except that
     the starting location is defined by a `MTMathListIndex` rather than an ordinary integer.
  */
@@ -10,89 +10,380 @@
 
 #import "MTMathListIndex.h"
 
+#pragma mark - Packed levels
+
+// A level is packed into 32 bits: the atom index above the 4 bits of the subindex type.
+static const unsigned kMTLevelTypeBits = 4;
+static const uint32_t kMTLevelTypeMask = (1u << kMTLevelTypeBits) - 1;
+static const NSUInteger kMTMaxAtomIndex = (1u << (32 - kMTLevelTypeBits)) - 1;
+
+static inline uint32_t MTPackLevel(NSUInteger atomIndex, MTMathListSubIndexType type)
+{
+    NSCAssert(atomIndex <= kMTMaxAtomIndex, @"Atom index %lu is too large for an MTMathListIndex", (unsigned long) atomIndex);
+    return (uint32_t) (atomIndex << kMTLevelTypeBits) | (uint32_t) type;
+}
+
+static inline NSUInteger MTLevelAtomIndex(uint32_t level)
+{
+    return level >> kMTLevelTypeBits;
+}
+
+static inline MTMathListSubIndexType MTLevelType(uint32_t level)
+{
+    return (MTMathListSubIndexType) (level & kMTLevelTypeMask);
+}
+
+// The first level without a subindex type, where the index ends, or depth if every level has one.
+static NSUInteger MTEndLevel(const uint32_t* levels, NSUInteger depth)
+{
+    for (NSUInteger i = 0; i < depth; i++) {
+        if (MTLevelType(levels[i]) == kMTSubIndexTypeNone) {
+            return i;
+        }
+    }
+    return depth;
+}
+
+static inline void MTCopyLevels(uint32_t* output, const uint32_t* levels, NSUInteger count)
+{
+    if (output != levels && count > 0) {
+        memmove(output, levels, count * sizeof(uint32_t));
+    }
+}
+
+// The navigation below mirrors the recursive definitions the index used to have, level by level. Each
+// function writes its result to `output`, which may be `levels`, and returns the depth of the result. A
+// function that can have no result returns 0 before writing anything.
+
+// `output` has room for `depth + subDepth + 1` levels. `sub` may not overlap `output`.
+static NSUInteger MTLevelUp(const uint32_t* levels, NSUInteger depth, const uint32_t* sub, NSUInteger subDepth,
+                            MTMathListSubIndexType type, uint32_t* output)
+{
+    NSUInteger end = MTEndLevel(levels, depth);
+    if (end == depth) {
+        // The last level has a type but no subindex, there is nowhere to attach.
+        MTCopyLevels(output, levels, depth);
+        return depth;
+    }
+    MTCopyLevels(output, levels, end);
+    output[end] = MTPackLevel(MTLevelAtomIndex(levels[end]), type);
+    MTCopyLevels(output + end + 1, sub, subDepth);
+    return end + 1 + subDepth;
+}
+
+static NSUInteger MTLevelDown(const uint32_t* levels, NSUInteger depth, uint32_t* output)
+{
+    NSUInteger end = MTEndLevel(levels, depth);
+    if (end == 0) {
+        return 0;
+    }
+    MTCopyLevels(output, levels, end);
+    output[end - 1] = MTPackLevel(MTLevelAtomIndex(levels[end - 1]), kMTSubIndexTypeNone);
+    return end;
+}
+
+static NSUInteger MTPrevious(const uint32_t* levels, NSUInteger depth, uint32_t* output)
+{
+    NSUInteger end = MTEndLevel(levels, depth);
+    if (end == depth || MTLevelAtomIndex(levels[end]) == 0) {
+        return 0;
+    }
+    MTCopyLevels(output, levels, end);
+    output[end] = MTPackLevel(MTLevelAtomIndex(levels[end]) - 1, kMTSubIndexTypeNone);
+    return end + 1;
+}
+
+static NSUInteger MTNext(const uint32_t* levels, NSUInteger depth, uint32_t* output)
+{
+    MTCopyLevels(output, levels, depth);
+    for (NSUInteger i = 0; i < depth; i++) {
+        MTMathListSubIndexType type = MTLevelType(levels[i]);
+        if (type == kMTSubIndexTypeNone || type == kMTSubIndexTypeNucleus) {
+            output[i] = MTPackLevel(MTLevelAtomIndex(levels[i]) + 1, type);
+            // Past a nucleus the index goes on unchanged.
+            return (type == kMTSubIndexTypeNone) ? i + 1 : depth;
+        }
+    }
+    return depth;
+}
+
+static NSUInteger MTFinalIndex(const uint32_t* levels, NSUInteger depth)
+{
+    NSUInteger end = MTEndLevel(levels, depth);
+    return (end < depth) ? MTLevelAtomIndex(levels[end]) : 0;
+}
+
+static MTMathListSubIndexType MTFinalSubIndexType(const uint32_t* levels, NSUInteger depth)
+{
+    // The type of the level above the last one.
+    return MTLevelType(levels[(depth >= 2) ? depth - 2 : 0]);
+}
+
+static BOOL MTHasSubIndexOfType(const uint32_t* levels, NSUInteger depth, MTMathListSubIndexType type)
+{
+    for (NSUInteger i = 0; i < depth; i++) {
+        if (MTLevelType(levels[i]) == type) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+static NSUInteger MTHashLevels(const uint32_t* levels, NSUInteger depth)
+{
+    const int prime = 31;
+    NSUInteger hash = depth;
+    for (NSUInteger i = 0; i < depth; i++) {
+        hash = hash * prime + levels[i];
+    }
+    return hash;
+}
+
+#pragma mark - MTMathListIndexPath
+
+MTMathListIndexPath MTMathListIndexPathMake(NSUInteger atomIndex)
+{
+    MTMathListIndexPath path = { .depth = 1 };
+    path.levels[0] = MTPackLevel(atomIndex, kMTSubIndexTypeNone);
+    return path;
+}
+
+NSUInteger MTMathListIndexPathAtomIndex(MTMathListIndexPath path, NSUInteger level)
+{
+    NSCParameterAssert(level < path.depth);
+    return MTLevelAtomIndex(path.levels[level]);
+}
+
+MTMathListSubIndexType MTMathListIndexPathSubIndexType(MTMathListIndexPath path, NSUInteger level)
+{
+    NSCParameterAssert(level < path.depth);
+    return MTLevelType(path.levels[level]);
+}
+
+// Sets the depth of a path whose first `depth` levels have been written, clearing the levels past it.
+static void MTSetPathDepth(MTMathListIndexPath* path, NSUInteger depth)
+{
+    if (depth < path->depth) {
+        memset(&path->levels[depth], 0, (path->depth - depth) * sizeof(uint32_t));
+    }
+    path->depth = (uint32_t) depth;
+}
+
+BOOL MTMathListIndexPathLevelUp(MTMathListIndexPath* path, const MTMathListIndexPath* subIndex, MTMathListSubIndexType type)
+{
+    NSCParameterAssert(path);
+    // A copy, as the subindex may be the path itself.
+    MTMathListIndexPath sub = subIndex ? *subIndex : (MTMathListIndexPath) { .depth = 0 };
+    NSUInteger end = MTEndLevel(path->levels, path->depth);
+    if (end < path->depth && end + 1 + sub.depth > kMTMathListIndexPathCapacity) {
+        return NO;
+    }
+    MTSetPathDepth(path, MTLevelUp(path->levels, path->depth, sub.levels, sub.depth, type, path->levels));
+    return YES;
+}
+
+BOOL MTMathListIndexPathLevelDown(MTMathListIndexPath* path)
+{
+    NSCParameterAssert(path);
+    NSUInteger depth = MTLevelDown(path->levels, path->depth, path->levels);
+    if (depth == 0) {
+        return NO;
+    }
+    MTSetPathDepth(path, depth);
+    return YES;
+}
+
+BOOL MTMathListIndexPathPrevious(MTMathListIndexPath* path)
+{
+    NSCParameterAssert(path);
+    NSUInteger depth = MTPrevious(path->levels, path->depth, path->levels);
+    if (depth == 0) {
+        return NO;
+    }
+    MTSetPathDepth(path, depth);
+    return YES;
+}
+
+void MTMathListIndexPathNext(MTMathListIndexPath* path)
+{
+    NSCParameterAssert(path);
+    MTSetPathDepth(path, MTNext(path->levels, path->depth, path->levels));
+}
+
+BOOL MTMathListIndexPathIsAtBeginningOfLine(MTMathListIndexPath path)
+{
+    return MTFinalIndex(path.levels, path.depth) == 0;
+}
+
+MTMathListSubIndexType MTMathListIndexPathFinalSubIndexType(MTMathListIndexPath path)
+{
+    return MTFinalSubIndexType(path.levels, path.depth);
+}
+
+BOOL MTMathListIndexPathHasSubIndexOfType(MTMathListIndexPath path, MTMathListSubIndexType type)
+{
+    return MTHasSubIndexOfType(path.levels, path.depth, type);
+}
+
+BOOL MTMathListIndexPathEqualToPath(MTMathListIndexPath path, MTMathListIndexPath other)
+{
+    return memcmp(&path, &other, sizeof(MTMathListIndexPath)) == 0;
+}
+
+NSUInteger MTMathListIndexPathHash(MTMathListIndexPath path)
+{
+    return MTHashLevels(path.levels, path.depth);
+}
+
 #pragma mark - MTMathListIndex
 
+// The number of levels kept in the index object itself. Deeper indexes allocate their levels.
+enum { kMTMathListIndexInlineLevels = 4 };
+
 @interface MTMathListIndex ()
 
-@property (nonatomic, readwrite) NSUInteger atomIndex;
-@property (nonatomic, readwrite) MTMathListSubIndexType subIndexType;
-@property (nonatomic, readwrite, nullable) MTMathListIndex* subIndex;
+// The subindex, made on first use. Atomic, as indexes are shared across threads.
+@property (atomic, nullable) MTMathListIndex* cachedSubIndex;
 
 @end
 
-@implementation MTMathListIndex
+@implementation MTMathListIndex {
+    uint32_t* _levels;
+    NSUInteger _depth;
+    NSUInteger _hash;
+    uint32_t* _allocatedLevels;
+    uint32_t _inlineLevels[kMTMathListIndexInlineLevels];
+}
+
+// Makes room for `capacity` levels, to be written to _levels and finished with -finishWithDepth:.
+- (instancetype) initWithCapacity:(NSUInteger) capacity
+{
+    self = [super init];
+    if (self) {
+        if (capacity <= kMTMathListIndexInlineLevels) {
+            _levels = _inlineLevels;
+        } else {
+            _allocatedLevels = malloc(capacity * sizeof(uint32_t));
+            _levels = _allocatedLevels;
+        }
+    }
+    return self;
+}
+
+- (nullable instancetype) finishWithDepth:(NSUInteger) depth
+{
+    if (depth == 0) {
+        return nil;
+    }
+    _depth = depth;
+    _hash = MTHashLevels(_levels, depth);
+    return self;
+}
+
++ (instancetype) indexWithLevels:(const uint32_t*) levels depth:(NSUInteger) depth
+{
+    MTMathListIndex* index = [[MTMathListIndex alloc] initWithCapacity:depth];
+    MTCopyLevels(index->_levels, levels, depth);
+    return [index finishWithDepth:depth];
+}
+
+- (void)dealloc
+{
+    free(_allocatedLevels);
+}
 
 + (id)level0Index:(NSUInteger)index
 {
-    MTMathListIndex* mlIndex = [MTMathListIndex new];
-    mlIndex.atomIndex = index;
-    return mlIndex;
+    uint32_t level = MTPackLevel(index, kMTSubIndexTypeNone);
+    return [self indexWithLevels:&level depth:1];
 }
 
 + (instancetype)indexAtLocation:(NSUInteger)location withSubIndex:(MTMathListIndex *)subIndex type:(MTMathListSubIndexType)type
 {
-    MTMathListIndex* index = [self level0Index:location];
-    index.subIndexType = type;
-    index.subIndex = subIndex;
-    return index;
+    NSUInteger subDepth = subIndex ? subIndex->_depth : 0;
+    MTMathListIndex* index = [[MTMathListIndex alloc] initWithCapacity:subDepth + 1];
+    index->_levels[0] = MTPackLevel(location, type);
+    if (subIndex) {
+        MTCopyLevels(index->_levels + 1, subIndex->_levels, subDepth);
+    }
+    return [index finishWithDepth:subDepth + 1];
 }
 
-- (MTMathListIndex *)levelUpWithSubIndex:(MTMathListIndex *)subIndex type:(MTMathListSubIndexType)type
++ (instancetype)indexWithPath:(MTMathListIndexPath)path
+{
+    NSParameterAssert(path.depth >= 1 && path.depth <= kMTMathListIndexPathCapacity);
+    return [self indexWithLevels:path.levels depth:path.depth];
+}
+
+- (BOOL)getPath:(MTMathListIndexPath *)path
 {
-    if (self.subIndexType == kMTSubIndexTypeNone) {
-        return [MTMathListIndex indexAtLocation:self.atomIndex withSubIndex:subIndex type:type];
+    NSParameterAssert(path);
+    if (_depth > kMTMathListIndexPathCapacity) {
+        return NO;
     }
-    // we have to recurse
-    return [MTMathListIndex indexAtLocation:self.atomIndex withSubIndex:[self.subIndex levelUpWithSubIndex:subIndex type:type] type:self.subIndexType];
+    memset(path, 0, sizeof(MTMathListIndexPath));
+    path->depth = (uint32_t) _depth;
+    MTCopyLevels(path->levels, _levels, _depth);
+    return YES;
 }
 
-- (MTMathListIndex *)levelDown
+- (NSUInteger)atomIndex
+{
+    return MTLevelAtomIndex(_levels[0]);
+}
+
+- (MTMathListSubIndexType)subIndexType
+{
+    return MTLevelType(_levels[0]);
+}
+
+- (NSUInteger)depth
+{
+    return _depth;
+}
+
+- (MTMathListIndex *)subIndex
 {
-    if (self.subIndexType == kMTSubIndexTypeNone) {
+    if (_depth < 2) {
         return nil;
     }
-    // recurse
-    MTMathListIndex* subIndexDown = self.subIndex.levelDown;
-    if (subIndexDown) {
-        return [MTMathListIndex indexAtLocation:self.atomIndex withSubIndex:subIndexDown type:self.subIndexType];
-    } else {
-        return [MTMathListIndex level0Index:self.atomIndex];
+    MTMathListIndex* subIndex = self.cachedSubIndex;
+    if (!subIndex) {
+        subIndex = [MTMathListIndex indexWithLevels:_levels + 1 depth:_depth - 1];
+        self.cachedSubIndex = subIndex;
     }
+    return subIndex;
+}
+
+- (MTMathListIndex *)levelUpWithSubIndex:(MTMathListIndex *)subIndex type:(MTMathListSubIndexType)type
+{
+    const uint32_t* subLevels = subIndex ? subIndex->_levels : NULL;
+    NSUInteger subDepth = subIndex ? subIndex->_depth : 0;
+    MTMathListIndex* index = [[MTMathListIndex alloc] initWithCapacity:_depth + subDepth + 1];
+    return [index finishWithDepth:MTLevelUp(_levels, _depth, subLevels, subDepth, type, index->_levels)];
+}
+
+- (MTMathListIndex *)levelDown
+{
+    MTMathListIndex* index = [[MTMathListIndex alloc] initWithCapacity:_depth];
+    return [index finishWithDepth:MTLevelDown(_levels, _depth, index->_levels)];
 }
 
 - (MTMathListIndex *)previous
 {
-    if (self.subIndexType == kMTSubIndexTypeNone) {
-        if (self.atomIndex > 0) {
-            return [MTMathListIndex level0Index:self.atomIndex - 1];
-        }
-    } else {
-        MTMathListIndex* prevSubIndex = self.subIndex.previous;
-        if (prevSubIndex) {
-            return [MTMathListIndex indexAtLocation:self.atomIndex withSubIndex:prevSubIndex type:self.subIndexType];
-        }
-    }
-    return nil;
+    MTMathListIndex* index = [[MTMathListIndex alloc] initWithCapacity:_depth];
+    return [index finishWithDepth:MTPrevious(_levels, _depth, index->_levels)];
 }
 
 - (MTMathListIndex *)next
 {
-    if (self.subIndexType == kMTSubIndexTypeNone) {
-        return [MTMathListIndex level0Index:self.atomIndex + 1];
-    } else if (self.subIndexType == kMTSubIndexTypeNucleus) {
-        return [MTMathListIndex indexAtLocation:self.atomIndex + 1 withSubIndex:self.subIndex type:self.subIndexType];
-    } else {
-        return [MTMathListIndex indexAtLocation:self.atomIndex withSubIndex:self.subIndex.next type:self.subIndexType];
-    }
+    MTMathListIndex* index = [[MTMathListIndex alloc] initWithCapacity:_depth];
+    return [index finishWithDepth:MTNext(_levels, _depth, index->_levels)];
 }
 
 - (BOOL)hasSubIndexOfType:(MTMathListSubIndexType)subIndexType
 {
-    if (self.subIndexType == subIndexType) {
-        return true;
-    } else {
-        return [self.subIndex hasSubIndexOfType:subIndexType];
-    }
+    return MTHasSubIndexOfType(_levels, _depth, subIndexType);
 }
 
 - (BOOL) isAtBeginningOfLine
@@ -100,58 +391,54 @@
     return (self.finalIndex == 0);
 }
 
-
 - (BOOL)isAtSameLevel:(MTMathListIndex *)other
 {
-    if (self.subIndexType != other.subIndexType) {
-        return false;
-    } else if (self.subIndexType == kMTSubIndexTypeNone) {
-        // No subindexes, they are at the same level.
-        return true;
-    } else if (self.atomIndex != other.atomIndex) {
-        // the subindexes are used in different atoms
-        return false;
-    } else {
-        return [self.subIndex isAtSameLevel:other.subIndex];
+    NSUInteger otherDepth = other ? other->_depth : 0;
+    for (NSUInteger i = 0; i < _depth; i++) {
+        // A missing level of the other index reads as 0, as messages to its nil subindex did.
+        uint32_t otherLevel = (i < otherDepth) ? other->_levels[i] : 0;
+        MTMathListSubIndexType type = MTLevelType(_levels[i]);
+        if (type != MTLevelType(otherLevel)) {
+            return false;
+        } else if (type == kMTSubIndexTypeNone) {
+            // No subindexes, they are at the same level.
+            return true;
+        } else if (MTLevelAtomIndex(_levels[i]) != MTLevelAtomIndex(otherLevel)) {
+            // the subindexes are used in different atoms
+            return false;
+        }
     }
+    return false;
 }
 
 - (NSUInteger) finalIndex
 {
-    if (self.subIndexType == kMTSubIndexTypeNone) {
-        return self.atomIndex;
-    } else {
-        return self.subIndex.finalIndex;
-    }
+    return MTFinalIndex(_levels, _depth);
 }
 
 - (MTMathListSubIndexType) finalSubIndexType
 {
-    if (self.subIndex.subIndex) {
-        return [self.subIndex finalSubIndexType];
-    } else {
-        return self.subIndexType;
-    }
+    return MTFinalSubIndexType(_levels, _depth);
 }
 
 - (NSString *)description
 {
-    if (self.subIndex) {
-        return [NSString stringWithFormat:@"[%lu, %d:%@]", (unsigned long)self.atomIndex, self.subIndexType, self.subIndex];
+    NSMutableString* str = [NSMutableString string];
+    for (NSUInteger i = 0; i + 1 < _depth; i++) {
+        [str appendFormat:@"[%lu, %d:", (unsigned long) MTLevelAtomIndex(_levels[i]), MTLevelType(_levels[i])];
     }
-    return [NSString stringWithFormat:@"[%lu]", (unsigned long)self.atomIndex];
+    [str appendFormat:@"[%lu]", (unsigned long) MTLevelAtomIndex(_levels[_depth - 1])];
+    for (NSUInteger i = 0; i + 1 < _depth; i++) {
+        [str appendString:@"]"];
+    }
+    return str;
 }
 
 - (BOOL)isEqualToIndex:(MTMathListIndex *)index
 {
-    if (self.atomIndex != index.atomIndex || self.subIndexType != index.subIndexType) {
-        return NO;
-    }
-    if (self.subIndex) {
-        return [self.subIndex isEqual:index.subIndex];
-    } else {
-        return (index.subIndex == nil);
-    }
+    // Constant time for indexes that differ, which almost always differ in their hashes.
+    return _depth == index->_depth && _hash == index->_hash
+        && memcmp(_levels, index->_levels, _depth * sizeof(uint32_t)) == 0;
 }
 
 - (BOOL) isEqual:(id) anObject
@@ -167,11 +454,7 @@
 
 - (NSUInteger) hash
 {
-    const int prime = 31;
-    NSUInteger hash = self.atomIndex;
-    hash = hash * prime + self.subIndexType;
-    hash = hash * prime + self.subIndex.hash;
-    return hash;
+    return _hash;
 }
 
 @end
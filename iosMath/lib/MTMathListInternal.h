@@ -0,0 +1,57 @@
+//
+//  MTMathListInternal.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTMathList.h"
+
+@class MTMathListHasher;
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Maximum recursion depth for -buildInternal:oneCharOnly:stopChar:, and how deep the lists of an
+// archive may nest. 150 is comfortably deeper than any realistic human-authored expression yet
+// far below the thousands of frames needed to overflow a 1 MB stack.
+static const NSInteger kMTMaxRecursionDepth = 150;
+
+/// The list that a subindex of the given type goes into: a script, a part of a fraction or a radical, or
+/// the inner list of an atom. Nil if the atom has none.
+FOUNDATION_EXTERN MTMathList* _Nullable MTMathAtomChildList(MTMathAtom* atom, MTMathListSubIndexType type);
+
+/// Sets the list that a subindex of the given type goes into. Returns NO if the atom can have no such list,
+/// e.g. a script on an atom that does not allow scripts.
+FOUNDATION_EXTERN BOOL MTMathAtomSetChildList(MTMathAtom* atom, MTMathListSubIndexType type, MTMathList* _Nullable list);
+
+/// A copy of `atom` that shares its scripts, inner lists, table cells and other child lists with `atom`
+/// rather than copying them. Only for atoms whose lists are never mutated.
+FOUNDATION_EXTERN __kindof MTMathAtom* MTMathAtomCopySharingChildLists(MTMathAtom* atom);
+
+/// Freezes `atom` and every list and atom below it, so that it can be shared.
+FOUNDATION_EXTERN void MTMathAtomFreeze(MTMathAtom* atom);
+
+/// Links `child`, an atom or list, to the atom or list whose fingerprint is computed from it, so that a
+/// change to the child clears the fingerprint cached for the parent. Called by the hasher.
+FOUNDATION_EXTERN void MTFingerprintLinkParent(id child, id parent);
+
+@interface MTMathAtom ()
+
+/// The fingerprint, computed with `hasher` if it is not cached.
+- (uint64_t) fingerprintWithHasher:(nullable MTMathListHasher*) hasher;
+
+@end
+
+@interface MTMathList ()
+
+/// The fingerprint, computed with `hasher` if it is not cached.
+- (uint64_t) fingerprintWithHasher:(nullable MTMathListHasher*) hasher;
+
+/// The atom to change in place of `atom`, which is in the list: `atom` itself, or if it is shared, a
+/// copy of it that replaces it in the list.
+- (__kindof MTMathAtom*) mutableAtom:(MTMathAtom*) atom;
+
+@end
+
+NS_ASSUME_NONNULL_END
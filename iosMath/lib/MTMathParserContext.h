@@ -0,0 +1,72 @@
+//
+//  MTMathParserContext.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import Foundation;
+
+#import "MTMathList.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ The LaTeX symbols and macros that `MTMathListBuilder` parses with, and that
+ `+[MTMathListBuilder mathListToString:context:]` writes with. A context has the built-in symbols of
+ `MTMathAtomFactory`, which all contexts share, and symbols and macros of its own, which override
+ the built-in ones. Symbols added with `+[MTMathAtomFactory addLatexSymbol:value:]` are not part of
+ any context.
+
+ A context cannot change once it is made, so it can be used on any number of threads at once
+ without locking. Use `contextByAddingSymbol:value:` or `contextByAddingMacro:expansion:` to make a
+ context with more definitions.
+ */
+@interface MTMathParserContext : NSObject <NSCopying>
+
+/** A context with the built-in symbols only. */
++ (instancetype) defaultContext;
+
+/** A context with the built-in symbols only. */
+- (instancetype) init;
+
+/** A context with the built-in symbols, and `symbols` and `macros` of its own.
+ @param symbols Atoms by LaTeX symbol name, e.g. `@{ @"lcm" : [MTMathAtomFactory operatorWithName:@"lcm" limits:NO] }`.
+ The atoms are copied, unless they are frozen.
+ @param macros LaTeX by command name, e.g. `@{ @"R" : @"\\mathbb{R}" }`. A macro takes no arguments:
+ the command is replaced by its LaTeX, which is parsed in its place. Macro names are made of letters. */
+- (instancetype) initWithSymbols:(nullable NSDictionary<NSString*, MTMathAtom*>*) symbols
+                          macros:(nullable NSDictionary<NSString*, NSString*>*) macros NS_DESIGNATED_INITIALIZER;
+
+/** A context with the definitions of this one and the symbol `name`. */
+- (MTMathParserContext*) contextByAddingSymbol:(NSString*) name value:(MTMathAtom*) atom;
+
+/** A context with the definitions of this one and the macro `name`. */
+- (MTMathParserContext*) contextByAddingMacro:(NSString*) name expansion:(NSString*) latex;
+
+/** The symbols of this context, without the built-in ones. The atoms are frozen. */
+@property (nonatomic, readonly) NSDictionary<NSString*, MTMathAtom*>* symbols;
+
+/** The macros of this context. */
+@property (nonatomic, readonly) NSDictionary<NSString*, NSString*>* macros;
+
+/** A new atom for the LaTeX symbol `name`, or one of its aliases, in this context. Nil if the
+ symbol is unknown. See `+[MTMathAtomFactory atomForLatexSymbolName:]`. */
+- (nullable MTMathAtom*) atomForLatexSymbolName:(NSString*) name
+    NS_SWIFT_NAME(atom(forLatexSymbol:));
+
+/** The atom of `atomForLatexSymbolName:`, shared instead of copied. It is frozen, and its setters
+ raise an exception. See `+[MTMathAtomFactory sharedAtomForLatexSymbolName:]`. */
+- (nullable MTMathAtom*) sharedAtomForLatexSymbolName:(NSString*) name
+    NS_SWIFT_NAME(sharedAtom(forLatexSymbol:));
+
+/** The name of the LaTeX symbol for `atom` in this context, or nil if there is none. A built-in
+ name that the context redefines is not returned, since it would not read back as `atom`. See
+ `+[MTMathAtomFactory latexSymbolNameForAtom:]`. */
+- (nullable NSString*) latexSymbolNameForAtom:(MTMathAtom*) atom
+    NS_SWIFT_NAME(latexSymbolName(for:));
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,171 @@
+//
+//  MTMathParserContext.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTMathParserContext.h"
+#import "MTMathParserContextInternal.h"
+#import "MTMathListInternal.h"
+
+// The context atoms write their LaTeX with. Not retained: it is only set for the duration of
+// +[MTMathListBuilder mathListToString:context:], which holds the context.
+static __thread __unsafe_unretained MTMathParserContext* MTCurrentContext;
+
+MTMathParserContext* MTMathParserContextSetCurrent(MTMathParserContext* context)
+{
+    MTMathParserContext* previous = MTCurrentContext;
+    MTCurrentContext = context;
+    return previous;
+}
+
+NSString* MTMathParserContextLatexSymbolName(MTMathAtom* atom)
+{
+    MTMathParserContext* context = MTCurrentContext;
+    if (context) {
+        return [context latexSymbolNameForAtom:atom];
+    }
+    return [MTMathAtomFactory latexSymbolNameForAtom:atom];
+}
+
+MTMathAtom* MTMathParserContextAtom(NSString* name)
+{
+    MTMathParserContext* context = MTCurrentContext;
+    if (context) {
+        return [context atomForLatexSymbolName:name];
+    }
+    return [MTMathAtomFactory atomForLatexSymbolName:name];
+}
+
+#ifndef NS_BLOCK_ASSERTIONS
+// Whether `name` can be read as a command: letters only, as -[MTMathListBuilder readCommand] reads them.
+static BOOL MTIsCommandName(NSString* name)
+{
+    if (name.length == 0) {
+        return NO;
+    }
+    for (NSUInteger i = 0; i < name.length; i++) {
+        unichar ch = [name characterAtIndex:i];
+        if (!((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z'))) {
+            return NO;
+        }
+    }
+    return YES;
+}
+#endif
+
+@implementation MTMathParserContext {
+    // The names of _symbols by nucleus and type.
+    NSDictionary<NSString*, NSDictionary<NSNumber*, NSString*>*>* _symbolNames;
+}
+
++ (instancetype) defaultContext
+{
+    static MTMathParserContext* context = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        context = [[MTMathParserContext alloc] init];
+    });
+    return context;
+}
+
+- (instancetype) init
+{
+    return [self initWithSymbols:nil macros:nil];
+}
+
+- (instancetype) initWithSymbols:(NSDictionary<NSString*, MTMathAtom*>*) symbols macros:(NSDictionary<NSString*, NSString*>*) macros
+{
+    self = [super init];
+    if (self) {
+        // Frozen copies, as +[MTMathAtomFactory addLatexSymbol:value:] makes, to share with the lists
+        // that are parsed.
+        NSMutableDictionary<NSString*, MTMathAtom*>* ownSymbols = [NSMutableDictionary dictionaryWithCapacity:symbols.count];
+        [symbols enumerateKeysAndObjectsUsingBlock:^(NSString* name, MTMathAtom* atom, BOOL* stop) {
+            MTMathAtom* shared = atom.frozen ? atom : [atom copy];
+            if (!shared.frozen) {
+                MTMathAtomFreeze(shared);
+            }
+            ownSymbols[name] = shared;
+        }];
+        _symbols = [ownSymbols copy];
+        _symbolNames = [[MTMathAtomFactory textToLatexSymbolNamesForSymbols:_symbols] copy];
+        _macros = macros ? [[NSDictionary alloc] initWithDictionary:macros copyItems:YES] : @{};
+#ifndef NS_BLOCK_ASSERTIONS
+        for (NSString* name in _macros) {
+            NSAssert(MTIsCommandName(name), @"Macro name %@ is not made of letters", name);
+        }
+#endif
+    }
+    return self;
+}
+
+- (id) copyWithZone:(NSZone*) zone
+{
+    // Contexts do not change.
+    return self;
+}
+
+- (MTMathParserContext*) contextByAddingSymbol:(NSString*) name value:(MTMathAtom*) atom
+{
+    NSParameterAssert(name);
+    NSParameterAssert(atom);
+    NSMutableDictionary<NSString*, MTMathAtom*>* symbols = [_symbols mutableCopy];
+    symbols[name] = atom;
+    return [[MTMathParserContext alloc] initWithSymbols:symbols macros:_macros];
+}
+
+- (MTMathParserContext*) contextByAddingMacro:(NSString*) name expansion:(NSString*) latex
+{
+    NSParameterAssert(name);
+    NSParameterAssert(latex);
+    NSMutableDictionary<NSString*, NSString*>* macros = [_macros mutableCopy];
+    macros[name] = latex;
+    return [[MTMathParserContext alloc] initWithSymbols:_symbols macros:macros];
+}
+
+- (MTMathAtom*) atomForLatexSymbolName:(NSString*) name
+{
+    // Return a copy of the atom since atoms are mutable.
+    return [[self sharedAtomForLatexSymbolName:name] copy];
+}
+
+- (MTMathAtom*) sharedAtomForLatexSymbolName:(NSString*) name
+{
+    NSParameterAssert(name);
+    // A symbol of the context overrides an alias of the same name, and the alias then resolves
+    // in the context as well.
+    MTMathAtom* atom = _symbols[name];
+    if (!atom) {
+        NSString* canonicalName = [MTMathAtomFactory aliases][name] ?: name;
+        atom = _symbols[canonicalName] ?: [MTMathAtomFactory builtinLatexSymbols][canonicalName];
+    }
+    return atom;
+}
+
+- (NSString*) latexSymbolNameForAtom:(MTMathAtom*) atom
+{
+    if (atom.nucleus.length == 0) {
+        return nil;
+    }
+    // A name that a macro shadows would not read back as a symbol.
+    NSString* name = [MTMathAtomFactory latexSymbolNameForAtom:atom table:_symbolNames];
+    if (name && !_macros[name]) {
+        return name;
+    }
+    name = [MTMathAtomFactory latexSymbolNameForAtom:atom table:[MTMathAtomFactory builtinTextToLatexSymbolNames]];
+    if (name && !_symbols[name] && !_macros[name]) {
+        return name;
+    }
+    return nil;
+}
+
+- (NSString*) description
+{
+    return [NSString stringWithFormat:@"<%@: %lu symbols, %lu macros>", NSStringFromClass(self.class),
+            (unsigned long) _symbols.count, (unsigned long) _macros.count];
+}
+
+@end
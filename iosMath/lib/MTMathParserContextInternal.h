@@ -0,0 +1,44 @@
+//
+//  MTMathParserContextInternal.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTMathParserContext.h"
+#import "MTMathAtomFactory.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Makes `context` the one that atoms write their LaTeX with on the calling thread, and returns the
+/// previous one. Nil writes with the symbols of `MTMathAtomFactory`.
+FOUNDATION_EXTERN MTMathParserContext* _Nullable MTMathParserContextSetCurrent(MTMathParserContext* _Nullable context);
+
+/// `latexSymbolNameForAtom:` of the current context, or of `MTMathAtomFactory` if there is none.
+FOUNDATION_EXTERN NSString* _Nullable MTMathParserContextLatexSymbolName(MTMathAtom* atom);
+
+/// `atomForLatexSymbolName:` of the current context, or of `MTMathAtomFactory` if there is none.
+FOUNDATION_EXTERN MTMathAtom* _Nullable MTMathParserContextAtom(NSString* name);
+
+@interface MTMathAtomFactory (MTMathParserContext)
+
+/// The built-in symbols, without the ones added with `addLatexSymbol:value:`.
++ (NSDictionary<NSString*, MTMathAtom*>*) builtinLatexSymbols;
+
+/// The names of the built-in symbols by nucleus and type.
++ (NSDictionary<NSString*, NSDictionary<NSNumber*, NSString*>*>*) builtinTextToLatexSymbolNames;
+
+/// The names of `symbols` by nucleus and type. Of two names for the same atom the shorter one, then
+/// the first in alphabetical order, is kept.
++ (NSMutableDictionary<NSString*, NSMutableDictionary<NSNumber*, NSString*>*>*) textToLatexSymbolNamesForSymbols:(NSDictionary<NSString*, MTMathAtom*>*) symbols;
+
+/// The name of `atom` in a table made by `textToLatexSymbolNamesForSymbols:`.
++ (nullable NSString*) latexSymbolNameForAtom:(MTMathAtom*) atom table:(NSDictionary<NSString*, NSDictionary<NSNumber*, NSString*>*>*) table;
+
+/// Canonical symbol names by alias.
++ (NSDictionary<NSString*, NSString*>*) aliases;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,69 @@
+//
+//  MTPersistentMathList.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import Foundation;
+
+#import "MTMathList.h"
+#import "MTMathListIndex.h"
+
+@class MTMathListChange;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ An immutable version of a math list, e.g. for an undo stack. Editing a version makes a new version,
+ which shares every atom and list that the edit did not touch with the version it was made from: an
+ edit copies only the atoms on the path from the top of the list to the edited list, and the arrays of
+ the lists on that path. Keeping a version costs nothing more, and copying one returns it.
+
+ Versions can be read and typeset from any thread.
+ */
+@interface MTPersistentMathList : NSObject <NSCopying>
+
+/** An empty version. */
+- (instancetype) init;
+
+/** A version with the contents of `list`, which is copied once. Later changes to `list` do not
+ affect the version. */
+- (instancetype) initWithMathList:(MTMathList*) list;
+
+/** The list of this version, to read or typeset. Its atoms and lists are shared with other versions
+ and must not be changed. */
+@property (nonatomic, readonly) MTMathList* mathList;
+
+/** A copy of the list that can be changed, e.g. by an editor that keeps a mutable list and makes a
+ new version with `initWithMathList:` after each change. */
+- (MTMathList*) mutableMathList;
+
+/** The atom at `index`, see `-[MTMathList atomAtListIndex:]`. */
+- (nullable MTMathAtom*) atomAtListIndex:(MTMathListIndex*) index;
+
+/** A version with a copy of `atom` inserted at `index`, before the atom there. The final level of the
+ index may be one past the last atom of its list, to append. If the index goes into a script or the
+ degree of a radical that is missing, it is added. Returns nil if the index does not point into the
+ list, or goes into a list the atom cannot have.
+ @throws NSException if the atom is of type `kMTMathAtomBoundary`. */
+- (nullable instancetype) listByInsertingAtom:(MTMathAtom*) atom atListIndex:(MTMathListIndex*) index;
+
+/** A version without the atom at `index`, and so without its scripts and inner lists. Returns nil if
+ there is no atom at the index. */
+- (nullable instancetype) listByRemovingAtomAtListIndex:(MTMathListIndex*) index;
+
+/** A version with the atom at `index`, and everything below it, replaced by a copy of `atom`. Returns
+ nil if there is no atom at the index.
+ @throws NSException if the atom is of type `kMTMathAtomBoundary`. */
+- (nullable instancetype) listByReplacingAtomAtListIndex:(MTMathListIndex*) index withAtom:(MTMathAtom*) atom;
+
+/** A version with the changes applied in order, e.g. the changes from
+ `+[MTMathListDiff changesFromMathList:toMathList:]` between the list of this version and another list.
+ Returns nil if one of them does not apply. */
+- (nullable instancetype) listByApplyingChanges:(NSArray<MTMathListChange*>*) changes;
+
+@end
+
+NS_ASSUME_NONNULL_END
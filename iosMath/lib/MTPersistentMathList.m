@@ -0,0 +1,162 @@
+//
+//  MTPersistentMathList.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTPersistentMathList.h"
+#import "MTMathListDiff.h"
+#import "MTMathListInternal.h"
+
+// Edits a list that no one else has. Returns NO if the edit does not apply at `atomIndex`.
+typedef BOOL (^MTMathListEdit)(MTMathList* list, NSUInteger atomIndex);
+
+// Applies `edit` at the final level of `index` and returns the new version of `list`, or nil. The lists on
+// the path are copied, and so are the atoms on it, sharing their other lists. Nothing else is copied.
+static MTMathList* MTEditMathList(MTMathList* list, MTMathListIndex* index, MTMathListEdit edit)
+{
+    MTMathListSubIndexType type = index.subIndexType;
+    if (!index.subIndex || type == kMTSubIndexTypeNone || type == kMTSubIndexTypeNucleus) {
+        MTMathList* edited = [MTMathList mathListWithAtomsArray:list.atomsForReading];
+        return edit(edited, index.atomIndex) ? edited : nil;
+    }
+    if (index.atomIndex >= list.atomsForReading.count) {
+        return nil;
+    }
+    MTMathAtom* atom = list.atomsForReading[index.atomIndex];
+    // A missing script or degree is edited as an empty list.
+    MTMathList* child = MTMathAtomChildList(atom, type) ?: [MTMathList new];
+    MTMathList* editedChild = MTEditMathList(child, index.subIndex, edit);
+    if (!editedChild) {
+        return nil;
+    }
+    MTMathAtom* editedAtom = MTMathAtomCopySharingChildLists(atom);
+    if (!MTMathAtomSetChildList(editedAtom, type, editedChild)) {
+        return nil;
+    }
+    MTMathList* edited = [MTMathList mathListWithAtomsArray:list.atomsForReading];
+    [edited removeAtomAtIndex:index.atomIndex];
+    [edited insertAtom:editedAtom atIndex:index.atomIndex];
+    return edited;
+}
+
+@interface MTPersistentMathList ()
+
+// Takes a list that no one else changes.
+- (instancetype) initSharingMathList:(MTMathList*) list NS_DESIGNATED_INITIALIZER;
+
+@end
+
+@implementation MTPersistentMathList
+
+- (instancetype)init
+{
+    return [self initWithMathList:[MTMathList new]];
+}
+
+- (instancetype)initWithMathList:(MTMathList *)list
+{
+    NSParameterAssert(list);
+    return [self initSharingMathList:[list copy]];
+}
+
+- (instancetype) initSharingMathList:(MTMathList*) list
+{
+    self = [super init];
+    if (self) {
+        _mathList = list;
+    }
+    return self;
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    // Immutable.
+    return self;
+}
+
+- (MTMathList *)mutableMathList
+{
+    return [_mathList copy];
+}
+
+- (MTMathAtom *)atomAtListIndex:(MTMathListIndex *)index
+{
+    return [_mathList atomAtListIndex:index];
+}
+
+- (instancetype) listByApplyingEdit:(MTMathListEdit) edit atListIndex:(MTMathListIndex*) index
+{
+    NSParameterAssert(index);
+    MTMathList* list = MTEditMathList(_mathList, index, edit);
+    return list ? [[[self class] alloc] initSharingMathList:list] : nil;
+}
+
+- (instancetype)listByInsertingAtom:(MTMathAtom *)atom atListIndex:(MTMathListIndex *)index
+{
+    NSParameterAssert(atom);
+    MTMathAtom* inserted = [atom copy];
+    return [self listByApplyingEdit:^BOOL(MTMathList* list, NSUInteger atomIndex) {
+        if (atomIndex > list.atomsForReading.count) {
+            return NO;
+        }
+        [list insertAtom:inserted atIndex:atomIndex];
+        return YES;
+    } atListIndex:index];
+}
+
+- (instancetype)listByRemovingAtomAtListIndex:(MTMathListIndex *)index
+{
+    return [self listByApplyingEdit:^BOOL(MTMathList* list, NSUInteger atomIndex) {
+        if (atomIndex >= list.atomsForReading.count) {
+            return NO;
+        }
+        [list removeAtomAtIndex:atomIndex];
+        return YES;
+    } atListIndex:index];
+}
+
+- (instancetype)listByReplacingAtomAtListIndex:(MTMathListIndex *)index withAtom:(MTMathAtom *)atom
+{
+    NSParameterAssert(atom);
+    MTMathAtom* replacement = [atom copy];
+    return [self listByApplyingEdit:^BOOL(MTMathList* list, NSUInteger atomIndex) {
+        if (atomIndex >= list.atomsForReading.count) {
+            return NO;
+        }
+        [list removeAtomAtIndex:atomIndex];
+        [list insertAtom:replacement atIndex:atomIndex];
+        return YES;
+    } atListIndex:index];
+}
+
+- (instancetype)listByApplyingChanges:(NSArray<MTMathListChange *> *)changes
+{
+    MTPersistentMathList* version = self;
+    for (MTMathListChange* change in changes) {
+        switch (change.type) {
+            case kMTMathListChangeInsert:
+                version = [version listByInsertingAtom:change.atom atListIndex:change.index];
+                break;
+            case kMTMathListChangeDelete:
+                version = [version listByRemovingAtomAtListIndex:change.index];
+                break;
+            case kMTMathListChangeReplace:
+                version = [version listByReplacingAtomAtListIndex:change.index withAtom:change.atom];
+                break;
+        }
+        if (!version) {
+            return nil;
+        }
+    }
+    return version;
+}
+
+- (NSString *)description
+{
+    return _mathList.description;
+}
+
+@end
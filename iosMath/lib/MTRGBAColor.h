@@ -0,0 +1,23 @@
+//
+//  MTRGBAColor.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import Foundation;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// An sRGB color with 8 bits per component, packed as 0xRRGGBBAA.
+typedef uint32_t MTRGBAColor;
+
+/// Decodes a LaTeX color argument: `#RGB`, `#RRGGBB`, or a color name. Names are matched
+/// without regard to case. The base colors of the LaTeX `xcolor` package (`red`, `green`,
+/// `orange`, `darkgray`, ...) have their `xcolor` values, and the other CSS color names
+/// (`royalblue`, `teal`, `rebeccapurple`, ...) their CSS values. The decoded colors are
+/// opaque. Returns NO, leaving `color` unchanged, if the string is not a color.
+FOUNDATION_EXTERN BOOL MTRGBAColorFromString(NSString* string, MTRGBAColor* color);
+
+NS_ASSUME_NONNULL_END
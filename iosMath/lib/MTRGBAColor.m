@@ -0,0 +1,402 @@
+//
+//  MTRGBAColor.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTRGBAColor.h"
+
+typedef struct {
+    const char* name;
+    MTRGBAColor rgba;
+} MTNamedColor;
+
+// The named colors, sorted by name. The xcolor base colors replace the CSS colors of the same
+// name, and the "grey" spellings follow their "gray" ones.
+static const MTNamedColor kMTNamedColors[] = {
+    { "aliceblue", 0xF0F8FFFF },
+    { "antiquewhite", 0xFAEBD7FF },
+    { "aqua", 0x00FFFFFF },
+    { "aquamarine", 0x7FFFD4FF },
+    { "azure", 0xF0FFFFFF },
+    { "beige", 0xF5F5DCFF },
+    { "bisque", 0xFFE4C4FF },
+    { "black", 0x000000FF },
+    { "blanchedalmond", 0xFFEBCDFF },
+    { "blue", 0x0000FFFF },
+    { "blueviolet", 0x8A2BE2FF },
+    { "brown", 0xBF8040FF },
+    { "burlywood", 0xDEB887FF },
+    { "cadetblue", 0x5F9EA0FF },
+    { "chartreuse", 0x7FFF00FF },
+    { "chocolate", 0xD2691EFF },
+    { "coral", 0xFF7F50FF },
+    { "cornflowerblue", 0x6495EDFF },
+    { "cornsilk", 0xFFF8DCFF },
+    { "crimson", 0xDC143CFF },
+    { "cyan", 0x00FFFFFF },
+    { "darkblue", 0x00008BFF },
+    { "darkcyan", 0x008B8BFF },
+    { "darkgoldenrod", 0xB8860BFF },
+    { "darkgray", 0x404040FF },
+    { "darkgreen", 0x006400FF },
+    { "darkgrey", 0x404040FF },
+    { "darkkhaki", 0xBDB76BFF },
+    { "darkmagenta", 0x8B008BFF },
+    { "darkolivegreen", 0x556B2FFF },
+    { "darkorange", 0xFF8C00FF },
+    { "darkorchid", 0x9932CCFF },
+    { "darkred", 0x8B0000FF },
+    { "darksalmon", 0xE9967AFF },
+    { "darkseagreen", 0x8FBC8FFF },
+    { "darkslateblue", 0x483D8BFF },
+    { "darkslategray", 0x2F4F4FFF },
+    { "darkslategrey", 0x2F4F4FFF },
+    { "darkturquoise", 0x00CED1FF },
+    { "darkviolet", 0x9400D3FF },
+    { "deeppink", 0xFF1493FF },
+    { "deepskyblue", 0x00BFFFFF },
+    { "dimgray", 0x696969FF },
+    { "dimgrey", 0x696969FF },
+    { "dodgerblue", 0x1E90FFFF },
+    { "firebrick", 0xB22222FF },
+    { "floralwhite", 0xFFFAF0FF },
+    { "forestgreen", 0x228B22FF },
+    { "fuchsia", 0xFF00FFFF },
+    { "gainsboro", 0xDCDCDCFF },
+    { "ghostwhite", 0xF8F8FFFF },
+    { "gold", 0xFFD700FF },
+    { "goldenrod", 0xDAA520FF },
+    { "gray", 0x808080FF },
+    { "green", 0x00FF00FF },
+    { "greenyellow", 0xADFF2FFF },
+    { "grey", 0x808080FF },
+    { "honeydew", 0xF0FFF0FF },
+    { "hotpink", 0xFF69B4FF },
+    { "indianred", 0xCD5C5CFF },
+    { "indigo", 0x4B0082FF },
+    { "ivory", 0xFFFFF0FF },
+    { "khaki", 0xF0E68CFF },
+    { "lavender", 0xE6E6FAFF },
+    { "lavenderblush", 0xFFF0F5FF },
+    { "lawngreen", 0x7CFC00FF },
+    { "lemonchiffon", 0xFFFACDFF },
+    { "lightblue", 0xADD8E6FF },
+    { "lightcoral", 0xF08080FF },
+    { "lightcyan", 0xE0FFFFFF },
+    { "lightgoldenrodyellow", 0xFAFAD2FF },
+    { "lightgray", 0xBFBFBFFF },
+    { "lightgreen", 0x90EE90FF },
+    { "lightgrey", 0xBFBFBFFF },
+    { "lightpink", 0xFFB6C1FF },
+    { "lightsalmon", 0xFFA07AFF },
+    { "lightseagreen", 0x20B2AAFF },
+    { "lightskyblue", 0x87CEFAFF },
+    { "lightslategray", 0x778899FF },
+    { "lightslategrey", 0x778899FF },
+    { "lightsteelblue", 0xB0C4DEFF },
+    { "lightyellow", 0xFFFFE0FF },
+    { "lime", 0xBFFF00FF },
+    { "limegreen", 0x32CD32FF },
+    { "linen", 0xFAF0E6FF },
+    { "magenta", 0xFF00FFFF },
+    { "maroon", 0x800000FF },
+    { "mediumaquamarine", 0x66CDAAFF },
+    { "mediumblue", 0x0000CDFF },
+    { "mediumorchid", 0xBA55D3FF },
+    { "mediumpurple", 0x9370DBFF },
+    { "mediumseagreen", 0x3CB371FF },
+    { "mediumslateblue", 0x7B68EEFF },
+    { "mediumspringgreen", 0x00FA9AFF },
+    { "mediumturquoise", 0x48D1CCFF },
+    { "mediumvioletred", 0xC71585FF },
+    { "midnightblue", 0x191970FF },
+    { "mintcream", 0xF5FFFAFF },
+    { "mistyrose", 0xFFE4E1FF },
+    { "moccasin", 0xFFE4B5FF },
+    { "navajowhite", 0xFFDEADFF },
+    { "navy", 0x000080FF },
+    { "oldlace", 0xFDF5E6FF },
+    { "olive", 0x808000FF },
+    { "olivedrab", 0x6B8E23FF },
+    { "orange", 0xFF8000FF },
+    { "orangered", 0xFF4500FF },
+    { "orchid", 0xDA70D6FF },
+    { "palegoldenrod", 0xEEE8AAFF },
+    { "palegreen", 0x98FB98FF },
+    { "paleturquoise", 0xAFEEEEFF },
+    { "palevioletred", 0xDB7093FF },
+    { "papayawhip", 0xFFEFD5FF },
+    { "peachpuff", 0xFFDAB9FF },
+    { "peru", 0xCD853FFF },
+    { "pink", 0xFFBFBFFF },
+    { "plum", 0xDDA0DDFF },
+    { "powderblue", 0xB0E0E6FF },
+    { "purple", 0xBF0040FF },
+    { "rebeccapurple", 0x663399FF },
+    { "red", 0xFF0000FF },
+    { "rosybrown", 0xBC8F8FFF },
+    { "royalblue", 0x4169E1FF },
+    { "saddlebrown", 0x8B4513FF },
+    { "salmon", 0xFA8072FF },
+    { "sandybrown", 0xF4A460FF },
+    { "seagreen", 0x2E8B57FF },
+    { "seashell", 0xFFF5EEFF },
+    { "sienna", 0xA0522DFF },
+    { "silver", 0xC0C0C0FF },
+    { "skyblue", 0x87CEEBFF },
+    { "slateblue", 0x6A5ACDFF },
+    { "slategray", 0x708090FF },
+    { "slategrey", 0x708090FF },
+    { "snow", 0xFFFAFAFF },
+    { "springgreen", 0x00FF7FFF },
+    { "steelblue", 0x4682B4FF },
+    { "tan", 0xD2B48CFF },
+    { "teal", 0x008080FF },
+    { "thistle", 0xD8BFD8FF },
+    { "tomato", 0xFF6347FF },
+    { "turquoise", 0x40E0D0FF },
+    { "violet", 0x800080FF },
+    { "wheat", 0xF5DEB3FF },
+    { "white", 0xFFFFFFFF },
+    { "whitesmoke", 0xF5F5F5FF },
+    { "yellow", 0xFFFF00FF },
+    { "yellowgreen", 0x9ACD32FF },
+};
+
+enum {
+    // Longer names are not colors.
+    kMTNamedColorMaxLength = 20,
+    kMTNamedColorSlotCount = 2048,
+    kMTNamedColorHashSeed = 108,
+};
+
+// A perfect hash of the names: the slot of each name, MTNamedColorHash() modulo the slot count,
+// holds its index in kMTNamedColors plus one. Empty slots are 0. The seed is the first one
+// for which no two names share a slot, so it has to be searched again when a name is added.
+static const uint8_t kMTNamedColorSlots[kMTNamedColorSlotCount] = {
+    [12] = 120, // rebeccapurple
+    [17] = 103, // oldlace
+    [66] = 131, // skyblue
+    [83] = 12, // brown
+    [98] = 89, // mediumblue
+    [114] = 62, // ivory
+    [115] = 146, // whitesmoke
+    [126] = 111, // paleturquoise
+    [129] = 51, // ghostwhite
+    [133] = 109, // palegoldenrod
+    [139] = 2, // antiquewhite
+    [144] = 123, // royalblue
+    [178] = 122, // rosybrown
+    [190] = 23, // darkcyan
+    [213] = 38, // darkslategrey
+    [217] = 114, // peachpuff
+    [247] = 129, // sienna
+    [259] = 125, // salmon
+    [262] = 94, // mediumspringgreen
+    [263] = 6, // beige
+    [267] = 119, // purple
+    [282] = 66, // lawngreen
+    [298] = 36, // darkslateblue
+    [332] = 148, // yellowgreen
+    [341] = 53, // goldenrod
+    [396] = 86, // magenta
+    [402] = 64, // lavender
+    [416] = 140, // thistle
+    [467] = 79, // lightslategray
+    [469] = 113, // papayawhip
+    [471] = 50, // gainsboro
+    [480] = 33, // darkred
+    [485] = 98, // mintcream
+    [502] = 107, // orangered
+    [507] = 101, // navajowhite
+    [573] = 24, // darkgoldenrod
+    [581] = 97, // midnightblue
+    [599] = 31, // darkorange
+    [600] = 65, // lavenderblush
+    [615] = 82, // lightyellow
+    [643] = 127, // seagreen
+    [652] = 5, // azure
+    [670] = 124, // saddlebrown
+    [679] = 85, // linen
+    [684] = 137, // steelblue
+    [689] = 133, // slategray
+    [726] = 32, // darkorchid
+    [728] = 88, // mediumaquamarine
+    [729] = 87, // maroon
+    [750] = 142, // turquoise
+    [770] = 20, // crimson
+    [812] = 59, // hotpink
+    [822] = 39, // darkturquoise
+    [830] = 17, // coral
+    [859] = 84, // limegreen
+    [862] = 11, // blueviolet
+    [868] = 78, // lightskyblue
+    [871] = 68, // lightblue
+    [940] = 74, // lightgrey
+    [951] = 52, // gold
+    [952] = 69, // lightcoral
+    [967] = 80, // lightslategrey
+    [968] = 99, // mistyrose
+    [993] = 3, // aqua
+    [1000] = 55, // green
+    [1049] = 116, // pink
+    [1058] = 45, // dodgerblue
+    [1076] = 29, // darkmagenta
+    [1085] = 77, // lightseagreen
+    [1106] = 27, // darkgrey
+    [1114] = 14, // cadetblue
+    [1123] = 136, // springgreen
+    [1135] = 67, // lemonchiffon
+    [1147] = 34, // darksalmon
+    [1149] = 9, // blanchedalmond
+    [1208] = 72, // lightgray
+    [1238] = 54, // gray
+    [1240] = 92, // mediumseagreen
+    [1248] = 26, // darkgreen
+    [1250] = 128, // seashell
+    [1261] = 134, // slategrey
+    [1292] = 18, // cornflowerblue
+    [1297] = 22, // darkblue
+    [1298] = 81, // lightsteelblue
+    [1307] = 93, // mediumslateblue
+    [1313] = 15, // chartreuse
+    [1327] = 61, // indigo
+    [1345] = 60, // indianred
+    [1370] = 145, // white
+    [1374] = 25, // darkgray
+    [1385] = 76, // lightsalmon
+    [1403] = 4, // aquamarine
+    [1417] = 90, // mediumorchid
+    [1419] = 139, // teal
+    [1428] = 138, // tan
+    [1432] = 110, // palegreen
+    [1442] = 132, // slateblue
+    [1445] = 112, // palevioletred
+    [1451] = 35, // darkseagreen
+    [1452] = 42, // deepskyblue
+    [1525] = 102, // navy
+    [1538] = 46, // firebrick
+    [1546] = 43, // dimgray
+    [1552] = 70, // lightcyan
+    [1560] = 47, // floralwhite
+    [1577] = 10, // blue
+    [1590] = 49, // fuchsia
+    [1624] = 121, // red
+    [1632] = 56, // greenyellow
+    [1636] = 144, // wheat
+    [1648] = 100, // moccasin
+    [1649] = 105, // olivedrab
+    [1669] = 63, // khaki
+    [1686] = 126, // sandybrown
+    [1689] = 37, // darkslategray
+    [1692] = 130, // silver
+    [1693] = 16, // chocolate
+    [1700] = 13, // burlywood
+    [1702] = 21, // cyan
+    [1710] = 108, // orchid
+    [1726] = 135, // snow
+    [1736] = 83, // lime
+    [1738] = 57, // grey
+    [1758] = 143, // violet
+    [1766] = 40, // darkviolet
+    [1767] = 1, // aliceblue
+    [1783] = 117, // plum
+    [1784] = 104, // olive
+    [1814] = 44, // dimgrey
+    [1830] = 19, // cornsilk
+    [1838] = 7, // bisque
+    [1839] = 141, // tomato
+    [1842] = 73, // lightgreen
+    [1891] = 95, // mediumturquoise
+    [1896] = 91, // mediumpurple
+    [1907] = 71, // lightgoldenrodyellow
+    [1911] = 115, // peru
+    [1916] = 58, // honeydew
+    [1919] = 48, // forestgreen
+    [1928] = 118, // powderblue
+    [1932] = 96, // mediumvioletred
+    [1947] = 41, // deeppink
+    [1955] = 75, // lightpink
+    [1983] = 106, // orange
+    [1987] = 30, // darkolivegreen
+    [1997] = 28, // darkkhaki
+    [2005] = 147, // yellow
+    [2008] = 8, // black
+};
+
+// 32-bit FNV-1a, offset by the seed.
+static uint32_t MTNamedColorHash(const char* name, NSUInteger length)
+{
+    uint32_t hash = 2166136261u ^ kMTNamedColorHashSeed;
+    for (NSUInteger i = 0; i < length; i++) {
+        hash ^= (uint8_t) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static BOOL MTLookupNamedColor(NSString* string, MTRGBAColor* color)
+{
+    NSUInteger length = string.length;
+    if (length == 0 || length > kMTNamedColorMaxLength) {
+        return NO;
+    }
+    char name[kMTNamedColorMaxLength + 1];
+    for (NSUInteger i = 0; i < length; i++) {
+        unichar ch = [string characterAtIndex:i];
+        if (ch >= 'A' && ch <= 'Z') {
+            ch += 'a' - 'A';
+        } else if (ch < 'a' || ch > 'z') {
+            return NO;
+        }
+        name[i] = (char) ch;
+    }
+    name[length] = 0;
+    uint8_t slot = kMTNamedColorSlots[MTNamedColorHash(name, length) % kMTNamedColorSlotCount];
+    if (slot == 0 || strcmp(kMTNamedColors[slot - 1].name, name) != 0) {
+        return NO;
+    }
+    *color = kMTNamedColors[slot - 1].rgba;
+    return YES;
+}
+
+static int MTHexDigitValue(unichar ch)
+{
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    } else if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 10;
+    } else if (ch >= 'A' && ch <= 'F') {
+        return ch - 'A' + 10;
+    }
+    return -1;
+}
+
+BOOL MTRGBAColorFromString(NSString* string, MTRGBAColor* color)
+{
+    NSCParameterAssert(color);
+    NSUInteger length = string.length;
+    if (length == 0) {
+        return NO;
+    }
+    if ([string characterAtIndex:0] != '#') {
+        return MTLookupNamedColor(string, color);
+    }
+    if (length != 4 && length != 7) {
+        return NO;
+    }
+    uint32_t rgb = 0;
+    for (NSUInteger i = 1; i < length; i++) {
+        int digit = MTHexDigitValue([string characterAtIndex:i]);
+        if (digit < 0) {
+            return NO;
+        }
+        // #RGB is short for #RRGGBB.
+        rgb = (length == 4) ? (rgb << 8) | (uint32_t) (digit * 0x11) : (rgb << 4) | (uint32_t) digit;
+    }
+    *color = (rgb << 8) | 0xFF;
+    return YES;
+}
@@ -0,0 +1,46 @@
+//
+//  MTRetainedSize.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import Foundation;
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class MTRetainedSizeCounter;
+
+/**
+ Adopted by the classes whose objects the counter looks into: their object instance variables
+ are followed, and `-addStorageToRetainedSize:` adds what they hold outside of objects.
+ */
+@protocol MTRetainedSizeWalking <NSObject>
+
+@optional
+- (void) addStorageToRetainedSize:(MTRetainedSizeCounter*) counter;
+
+@end
+
+/**
+ Adds up the heap memory retained by a graph of math lists or displays, as reported by
+ `malloc_size`. Each block is counted once. The objects of classes that adopt
+ MTRetainedSizeWalking are followed through their instance variables, as are collections.
+ Strings, attributed strings, numbers, values and data are counted as leaves. Every other
+ object, e.g. a font or a color, is taken to be shared with other formulas and is not
+ counted.
+ */
+@interface MTRetainedSizeCounter : NSObject
+
+@property (nonatomic, readonly) NSUInteger size;
+
+- (void) addObject:(nullable id) object;
+/** Adds a block returned by malloc. */
+- (void) addMallocBlock:(nullable const void*) block;
+/** Adds a number of bytes held outside of the malloc heap, or in blocks that can not be reached. */
+- (void) addBytes:(NSUInteger) bytes;
+
+@end
+
+NS_ASSUME_NONNULL_END
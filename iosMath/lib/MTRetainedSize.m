@@ -0,0 +1,111 @@
+//
+//  MTRetainedSize.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#include <malloc/malloc.h>
+#include <objc/runtime.h>
+
+#import "MTRetainedSize.h"
+
+@implementation MTRetainedSizeCounter {
+    NSHashTable* _visited;
+}
+
+- (instancetype) init
+{
+    self = [super init];
+    if (self) {
+        _visited = [NSHashTable hashTableWithOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsOpaquePersonality];
+    }
+    return self;
+}
+
+- (BOOL) visit:(const void*) pointer
+{
+    if (!pointer || [_visited containsObject:(__bridge id) pointer]) {
+        return NO;
+    }
+    [_visited addObject:(__bridge id) pointer];
+    return YES;
+}
+
+- (void) addMallocBlock:(const void*) block
+{
+    if ([self visit:block]) {
+        _size += malloc_size(block);
+    }
+}
+
+- (void) addBytes:(NSUInteger) bytes
+{
+    _size += bytes;
+}
+
+- (void) addObject:(id) object
+{
+    if ([object isKindOfClass:[NSArray class]]) {
+        [self addCollection:object count:[object count] elements:object];
+    } else if ([object isKindOfClass:[NSDictionary class]]) {
+        NSDictionary* dictionary = object;
+        [self addCollection:dictionary count:dictionary.count * 2 elements:dictionary.allKeys];
+        for (id value in dictionary.objectEnumerator) {
+            [self addObject:value];
+        }
+    } else if ([object isKindOfClass:[NSAttributedString class]]) {
+        if ([self visit:(__bridge const void*) object]) {
+            _size += malloc_size((__bridge const void*) object);
+            [self addObject:[object string]];
+        }
+    } else if ([object isKindOfClass:[NSString class]] || [object isKindOfClass:[NSValue class]]
+               || [object isKindOfClass:[NSData class]]) {
+        // Tagged pointers and constants are not in the heap, and have no malloc size.
+        [self addMallocBlock:(__bridge const void*) object];
+        if ([object isKindOfClass:[NSData class]] && [self visit:[object bytes]]) {
+            _size += malloc_size([object bytes]);
+        }
+    } else if ([object conformsToProtocol:@protocol(MTRetainedSizeWalking)]) {
+        if ([self visit:(__bridge const void*) object]) {
+            _size += malloc_size((__bridge const void*) object);
+            [self addInstanceVariablesOfObject:object];
+            if ([object respondsToSelector:@selector(addStorageToRetainedSize:)]) {
+                [object addStorageToRetainedSize:self];
+            }
+        }
+    }
+}
+
+- (void) addCollection:(id) collection count:(NSUInteger) count elements:(id<NSFastEnumeration>) elements
+{
+    if (![self visit:(__bridge const void*) collection]) {
+        return;
+    }
+    _size += malloc_size((__bridge const void*) collection);
+    // Mutable collections keep their elements in a separate buffer.
+    if ([collection isKindOfClass:[NSMutableArray class]] || [collection isKindOfClass:[NSMutableDictionary class]]) {
+        _size += count * sizeof(id);
+    }
+    for (id element in elements) {
+        [self addObject:element];
+    }
+}
+
+- (void) addInstanceVariablesOfObject:(id) object
+{
+    for (Class cls = object_getClass(object); cls && cls != [NSObject class]; cls = class_getSuperclass(cls)) {
+        unsigned int count = 0;
+        Ivar* ivars = class_copyIvarList(cls, &count);
+        for (unsigned int i = 0; i < count; i++) {
+            const char* type = ivar_getTypeEncoding(ivars[i]);
+            if (type && type[0] == '@') {
+                [self addObject:object_getIvar(object, ivars[i])];
+            }
+        }
+        free(ivars);
+    }
+}
+
+@end
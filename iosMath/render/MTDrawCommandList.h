@@ -0,0 +1,123 @@
+//
+//  MTDrawCommandList.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import CoreText;
+@import CoreGraphics;
+@import Foundation;
+
+#import "MTMathListDisplay.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ @typedef MTDrawCommandType
+ @brief The primitives a display tree is drawn with.
+ */
+typedef NS_ENUM(unsigned int, MTDrawCommandType) {
+    /// A CoreText line whose baseline starts at `origin`. The line carries its own text color.
+    kMTDrawCommandLine,
+    /// `count` glyphs of `font`, starting at `index` in the glyph buffers, filled with `color`.
+    kMTDrawCommandGlyphs,
+    /// `count` points, starting at `index` in the point buffer, stroked pairwise as straight
+    /// segments (fraction bars, radical and over/underlines, table rules, strikes).
+    kMTDrawCommandStroke,
+    /// `rect` filled with `color` (background colors).
+    kMTDrawCommandFillRect,
+};
+
+/**
+ One primitive of an `MTDrawCommandList`. All coordinates are absolute, in the coordinate
+ space in which the compiled display was positioned. The Core Foundation references are
+ owned by the list.
+ */
+typedef struct {
+    MTDrawCommandType type;
+    /// The color to fill or stroke with, or NULL to use the color of the context. For a line
+    /// this is the color already set on the line.
+    CGColorRef _Nullable color;
+    /// The line of a `kMTDrawCommandLine`.
+    CTLineRef _Nullable line;
+    /// The font of a `kMTDrawCommandGlyphs`.
+    CTFontRef _Nullable font;
+    /// The first glyph or point of the command in the buffers of the list, and how many there are.
+    NSUInteger index;
+    NSUInteger count;
+    /// The text position of a line.
+    CGPoint origin;
+    /// The width and line cap of a stroke.
+    CGFloat lineWidth;
+    CGLineCap lineCap;
+    /// The rectangle of a `kMTDrawCommandFillRect`.
+    CGRect rect;
+    /// The area the command paints: the glyph outlines of lines and glyphs, the stroked area
+    /// of strokes (including the line width) and the rectangle of fills.
+    CGRect bounds;
+    /// The display of the compiled tree that draws this command. Not retained.
+    __unsafe_unretained MTDisplay* _Nullable display;
+} MTDrawCommand;
+
+/**
+ A display tree compiled into a flat array of absolute-positioned draw commands.
+
+ Drawing an `MTDisplay` walks the tree and saves, translates and restores the graphics state
+ at every node. A command list is built once from a finished display and replays the same
+ output while only changing the graphics state when a color, line width or cap actually
+ changes. It is also a simple input for exporters.
+
+ The list captures the positions and colors of the display when it is created. Compile a
+ new list after changing either. The list does not retain the display, so the displays
+ returned by its queries are only valid while the compiled tree is alive.
+
+ The commands are indexed by their bounds, so drawing a part of a formula and finding what
+ is under a point only visit the commands there. The index is built on the first query.
+ */
+@interface MTDrawCommandList : NSObject
+
+- (instancetype) init NS_UNAVAILABLE;
+
+/** Compiles the given display, usually the `MTMathListDisplay` returned by `MTTypesetter`. */
+- (instancetype) initWithDisplay:(MTDisplay*) display NS_DESIGNATED_INITIALIZER;
+
+/** The number of commands. */
+@property (nonatomic, readonly) NSUInteger count;
+
+/** The commands, in drawing order. */
+- (const MTDrawCommand*) commands NS_RETURNS_INNER_POINTER;
+
+/** The glyphs of all the `kMTDrawCommandGlyphs` commands, and their absolute positions. */
+- (const CGGlyph*) glyphs NS_RETURNS_INNER_POINTER;
+- (const CGPoint*) glyphPositions NS_RETURNS_INNER_POINTER;
+
+/** The end points of all the `kMTDrawCommandStroke` segments. */
+- (const CGPoint*) points NS_RETURNS_INNER_POINTER;
+
+/** The union of the bounds of all commands. */
+@property (nonatomic, readonly) CGRect bounds;
+
+/** The bounds of a display of the compiled tree (its `displayBounds`) in the absolute
+ coordinates of the list, or `CGRectNull` if the display is not part of the tree. */
+- (CGRect) boundsOfDisplay:(MTDisplay*) display;
+
+/** Draws the commands in the given context. The output is the same as `-[MTDisplay draw:]`
+ on the compiled display. */
+- (void) draw:(CGContextRef) context;
+
+/** Draws only the commands whose bounds intersect `rect`, e.g. the dirty rectangle of a view.
+ Commands are drawn in their original order, so the output inside `rect` is the same as
+ `-draw:`. Pass a rectangle slightly larger than the dirty one to include antialiasing. */
+- (void) drawInRect:(CGRect) rect context:(CGContextRef) context;
+
+/** The indexes of the commands whose bounds intersect `rect`, in drawing order. */
+- (NSIndexSet*) indexesOfCommandsInRect:(CGRect) rect;
+
+/** The displays that draw something at `point`, in drawing order (the topmost last). */
+- (NSArray<MTDisplay*>*) displaysAtPoint:(CGPoint) point;
+
+@end
+
+NS_ASSUME_NONNULL_END
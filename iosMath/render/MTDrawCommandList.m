@@ -0,0 +1,435 @@
+//
+//  MTDrawCommandList.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTDrawCommandList.h"
+#import "MTDrawCommandList+Internal.h"
+#import "MTMathListDisplayInternal.h"
+#import "../lib/MTInstrumentationInternal.h"
+
+// Grows a malloc'd buffer so that it holds at least `needed` elements.
+static void* MTGrowBuffer(void* buffer, NSUInteger* capacity, NSUInteger needed, size_t elementSize)
+{
+    if (needed <= *capacity) {
+        return buffer;
+    }
+    NSUInteger newCapacity = MAX(MAX(*capacity * 2, needed), (NSUInteger) 16);
+    void* grown = realloc(buffer, newCapacity * elementSize);
+    NSCAssert(grown != NULL, @"Failed to grow the draw command buffers");
+    *capacity = newCapacity;
+    return grown;
+}
+
+static BOOL MTSameColor(CGColorRef a, CGColorRef b)
+{
+    return a == b || (a != NULL && b != NULL && CGColorEqualToColor(a, b));
+}
+
+// Closed intervals, so that a point on an edge (or an empty rectangle) still counts.
+static BOOL MTRectsOverlap(CGRect a, CGRect b)
+{
+    return CGRectGetMinX(a) <= CGRectGetMaxX(b) && CGRectGetMaxX(a) >= CGRectGetMinX(b)
+        && CGRectGetMinY(a) <= CGRectGetMaxY(b) && CGRectGetMaxY(a) >= CGRectGetMinY(b);
+}
+
+typedef struct {
+    CGFloat minX;
+    NSUInteger command;
+} MTIndexEntry;
+
+static int MTCompareIndexEntries(const void* a, const void* b)
+{
+    CGFloat x = ((const MTIndexEntry*) a)->minX;
+    CGFloat y = ((const MTIndexEntry*) b)->minX;
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+static int MTCompareCommandIndexes(const void* a, const void* b)
+{
+    NSUInteger x = *(const NSUInteger*) a;
+    NSUInteger y = *(const NSUInteger*) b;
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+@implementation MTDrawCommandList {
+    MTDrawCommand* _commands;
+    NSUInteger _commandCapacity;
+    CGGlyph* _glyphs;
+    CGPoint* _glyphPositions;
+    NSUInteger _glyphCount;
+    NSUInteger _glyphCapacity;
+    CGPoint* _points;
+    NSUInteger _pointCount;
+    NSUInteger _pointCapacity;
+    NSMapTable<MTDisplay*, NSValue*>* _displayBounds;
+    // The spatial index: the commands sorted by the left edge of their bounds, seen as an
+    // implicit balanced tree (the root of [lo, hi) is at the middle). Every node also keeps
+    // the largest right edge in its subtree, which is what makes it an interval tree on x.
+    // The y extent is only checked on the candidates.
+    MTIndexEntry* _index;
+    CGFloat* _subtreeMaxX;
+}
+
+- (instancetype)initWithDisplay:(MTDisplay *)display
+{
+    NSParameterAssert(display);
+    self = [super init];
+    if (self) {
+        _bounds = CGRectNull;
+        _displayBounds = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsOpaquePersonality
+                                               valueOptions:NSPointerFunctionsStrongMemory];
+        [display appendDrawCommands:self origin:CGPointZero];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    for (NSUInteger i = 0; i < _count; i++) {
+        if (_commands[i].color) { CGColorRelease(_commands[i].color); }
+        if (_commands[i].line) { CFRelease(_commands[i].line); }
+        if (_commands[i].font) { CFRelease(_commands[i].font); }
+    }
+    free(_commands);
+    free(_glyphs);
+    free(_glyphPositions);
+    free(_points);
+    free(_index);
+    free(_subtreeMaxX);
+}
+
+- (const MTDrawCommand *)commands
+{
+    return _commands;
+}
+
+- (const CGGlyph *)glyphs
+{
+    return _glyphs;
+}
+
+- (const CGPoint *)glyphPositions
+{
+    return _glyphPositions;
+}
+
+- (const CGPoint *)points
+{
+    return _points;
+}
+
+#pragma mark - Building
+
+- (MTDrawCommand*) appendCommandOfType:(MTDrawCommandType) type color:(CGColorRef) color display:(MTDisplay*) display
+{
+    _commands = MTGrowBuffer(_commands, &_commandCapacity, _count + 1, sizeof(MTDrawCommand));
+    MTDrawCommand* command = &_commands[_count++];
+    memset(command, 0, sizeof(MTDrawCommand));
+    command->type = type;
+    command->color = CGColorRetain(color);
+    command->display = display;
+    return command;
+}
+
+- (void) setBounds:(CGRect) bounds forCommand:(MTDrawCommand*) command
+{
+    command->bounds = bounds;
+    _bounds = CGRectUnion(_bounds, bounds);
+}
+
+- (void)setBounds:(CGRect)bounds forDisplay:(MTDisplay *)display
+{
+    [_displayBounds setObject:[NSValue valueWithBytes:&bounds objCType:@encode(CGRect)] forKey:display];
+}
+
+- (void)addLine:(CTLineRef)line origin:(CGPoint)origin color:(CGColorRef)color display:(MTDisplay *)display
+{
+    MTDrawCommand* command = [self appendCommandOfType:kMTDrawCommandLine color:color display:display];
+    command->line = CFRetain(line);
+    command->origin = origin;
+    CGRect bounds = CTLineGetBoundsWithOptions(line, kCTLineBoundsUseGlyphPathBounds);
+    [self setBounds:CGRectOffset(bounds, origin.x, origin.y) forCommand:command];
+}
+
+- (void)addGlyphs:(const CGGlyph *)glyphs positions:(const CGPoint *)positions count:(NSUInteger)count
+           offset:(CGPoint)offset font:(CTFontRef)font color:(CGColorRef)color display:(MTDisplay *)display
+{
+    NSUInteger capacity = _glyphCapacity;
+    _glyphs = MTGrowBuffer(_glyphs, &capacity, _glyphCount + count, sizeof(CGGlyph));
+    capacity = _glyphCapacity;
+    _glyphPositions = MTGrowBuffer(_glyphPositions, &capacity, _glyphCount + count, sizeof(CGPoint));
+    _glyphCapacity = capacity;
+    for (NSUInteger i = 0; i < count; i++) {
+        CGPoint position = positions ? positions[i] : CGPointZero;
+        _glyphs[_glyphCount + i] = glyphs[i];
+        _glyphPositions[_glyphCount + i] = CGPointMake(position.x + offset.x, position.y + offset.y);
+    }
+    MTDrawCommand* command = [self appendCommandOfType:kMTDrawCommandGlyphs color:color display:display];
+    command->font = CFRetain(font);
+    command->index = _glyphCount;
+    command->count = count;
+    CGRect bounds = CGRectNull;
+    for (NSUInteger i = 0; i < count; i++) {
+        CGPoint position = _glyphPositions[_glyphCount + i];
+        CGRect glyphBounds = CTFontGetBoundingRectsForGlyphs(font, kCTFontOrientationDefault, &_glyphs[_glyphCount + i], NULL, 1);
+        bounds = CGRectUnion(bounds, CGRectOffset(glyphBounds, position.x, position.y));
+    }
+    [self setBounds:bounds forCommand:command];
+    _glyphCount += count;
+}
+
+- (void)addStrokeWithPoints:(const CGPoint *)points count:(NSUInteger)count
+                  lineWidth:(CGFloat)lineWidth lineCap:(CGLineCap)lineCap color:(CGColorRef)color
+                    display:(MTDisplay *)display
+{
+    NSAssert(count % 2 == 0, @"A stroke needs pairs of points, got %lu", (unsigned long) count);
+    _points = MTGrowBuffer(_points, &_pointCapacity, _pointCount + count, sizeof(CGPoint));
+    memcpy(_points + _pointCount, points, count * sizeof(CGPoint));
+    MTDrawCommand* command = [self appendCommandOfType:kMTDrawCommandStroke color:color display:display];
+    command->index = _pointCount;
+    command->count = count;
+    command->lineWidth = lineWidth;
+    command->lineCap = lineCap;
+    CGRect bounds = CGRectNull;
+    for (NSUInteger i = 0; i < count; i++) {
+        bounds = CGRectUnion(bounds, CGRectMake(points[i].x, points[i].y, 0, 0));
+    }
+    // Half the width on every side covers the stroke and its caps. A zero width is a hairline.
+    CGFloat outset = MAX(lineWidth / 2, 0.5);
+    [self setBounds:CGRectInset(bounds, -outset, -outset) forCommand:command];
+    _pointCount += count;
+}
+
+- (void)addFillRect:(CGRect)rect color:(CGColorRef)color display:(MTDisplay *)display
+{
+    MTDrawCommand* command = [self appendCommandOfType:kMTDrawCommandFillRect color:color display:display];
+    command->rect = rect;
+    [self setBounds:rect forCommand:command];
+}
+
+- (void)setFillColor:(CGColorRef)color forCommandsFromIndex:(NSUInteger)index
+{
+    if (!color) {
+        return;
+    }
+    for (NSUInteger i = index; i < _count; i++) {
+        MTDrawCommand* command = &_commands[i];
+        if (command->color == NULL && (command->type == kMTDrawCommandGlyphs || command->type == kMTDrawCommandLine)) {
+            command->color = CGColorRetain(color);
+        }
+    }
+}
+
+#pragma mark - Queries
+
+- (CGRect)boundsOfDisplay:(MTDisplay *)display
+{
+    NSValue* value = [_displayBounds objectForKey:display];
+    if (!value) {
+        return CGRectNull;
+    }
+    CGRect bounds;
+    [value getValue:&bounds];
+    return bounds;
+}
+
+- (void) buildIndex
+{
+    _index = malloc(MAX(_count, (NSUInteger) 1) * sizeof(MTIndexEntry));
+    _subtreeMaxX = malloc(MAX(_count, (NSUInteger) 1) * sizeof(CGFloat));
+    NSAssert(_index != NULL && _subtreeMaxX != NULL, @"Failed to allocate the draw command index");
+    for (NSUInteger i = 0; i < _count; i++) {
+        _index[i].minX = CGRectGetMinX(_commands[i].bounds);
+        _index[i].command = i;
+    }
+    qsort(_index, _count, sizeof(MTIndexEntry), MTCompareIndexEntries);
+    [self computeSubtreeMaxXFrom:0 to:_count];
+}
+
+- (CGFloat) computeSubtreeMaxXFrom:(NSUInteger) lo to:(NSUInteger) hi
+{
+    if (lo >= hi) {
+        return -CGFLOAT_MAX;
+    }
+    NSUInteger mid = lo + (hi - lo) / 2;
+    CGFloat maxX = CGRectGetMaxX(_commands[_index[mid].command].bounds);
+    maxX = MAX(maxX, [self computeSubtreeMaxXFrom:lo to:mid]);
+    maxX = MAX(maxX, [self computeSubtreeMaxXFrom:mid + 1 to:hi]);
+    _subtreeMaxX[mid] = maxX;
+    return maxX;
+}
+
+// Collects the commands in [lo, hi) of the index that overlap `rect`.
+- (void) collectCommandsInRect:(CGRect) rect from:(NSUInteger) lo to:(NSUInteger) hi
+                          into:(NSUInteger*) found count:(NSUInteger*) foundCount
+{
+    while (lo < hi) {
+        NSUInteger mid = lo + (hi - lo) / 2;
+        if (_subtreeMaxX[mid] < CGRectGetMinX(rect)) {
+            // Nothing in this subtree reaches the rectangle.
+            return;
+        }
+        [self collectCommandsInRect:rect from:lo to:mid into:found count:foundCount];
+        if (_index[mid].minX > CGRectGetMaxX(rect)) {
+            // This command and everything to its right start after the rectangle.
+            return;
+        }
+        NSUInteger command = _index[mid].command;
+        if (MTRectsOverlap(_commands[command].bounds, rect)) {
+            found[(*foundCount)++] = command;
+        }
+        lo = mid + 1;
+    }
+}
+
+// Returns the overlapping commands in drawing order in a malloc'd buffer.
+- (NSUInteger*) createCommandsInRect:(CGRect) rect count:(NSUInteger*) count
+{
+    if (!_index) {
+        [self buildIndex];
+    }
+    NSUInteger* found = malloc(MAX(_count, (NSUInteger) 1) * sizeof(NSUInteger));
+    NSAssert(found != NULL, @"Failed to allocate the query buffer");
+    *count = 0;
+    if (!CGRectIsNull(rect)) {
+        [self collectCommandsInRect:rect from:0 to:_count into:found count:count];
+    }
+    qsort(found, *count, sizeof(NSUInteger), MTCompareCommandIndexes);
+    return found;
+}
+
+- (NSIndexSet *)indexesOfCommandsInRect:(CGRect)rect
+{
+    NSUInteger count = 0;
+    NSUInteger* found = [self createCommandsInRect:rect count:&count];
+    NSMutableIndexSet* indexes = [NSMutableIndexSet indexSet];
+    for (NSUInteger i = 0; i < count; i++) {
+        [indexes addIndex:found[i]];
+    }
+    free(found);
+    return indexes;
+}
+
+- (NSArray<MTDisplay *> *)displaysAtPoint:(CGPoint)point
+{
+    NSUInteger count = 0;
+    NSUInteger* found = [self createCommandsInRect:CGRectMake(point.x, point.y, 0, 0) count:&count];
+    NSMutableArray<MTDisplay*>* displays = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        MTDisplay* display = _commands[found[i]].display;
+        if (display && displays.lastObject != display) {
+            [displays addObject:display];
+        }
+    }
+    free(found);
+    return displays;
+}
+
+#pragma mark - Drawing
+
+- (void)draw:(CGContextRef)context
+{
+    [self drawCommands:NULL count:_count context:context];
+}
+
+- (void)drawInRect:(CGRect)rect context:(CGContextRef)context
+{
+    if (CGRectContainsRect(rect, _bounds)) {
+        [self draw:context];
+        return;
+    }
+    NSUInteger count = 0;
+    NSUInteger* found = [self createCommandsInRect:rect count:&count];
+    [self drawCommands:found count:count context:context];
+    free(found);
+}
+
+// Draws the given commands, or the first `count` commands if `indexes` is NULL.
+- (void) drawCommands:(const NSUInteger*) indexes count:(NSUInteger) count context:(CGContextRef) context
+{
+    if (count == 0) {
+        return;
+    }
+    MTTracePhase(kMTLayoutPhaseDraw);
+    CGContextSaveGState(context);
+    // What the list has changed on top of the state the context came with. A NULL color or
+    // a negative width means the context's own value is in effect.
+    CGColorRef fill = NULL;
+    CGColorRef stroke = NULL;
+    CGFloat lineWidth = -1;
+    CGLineCap lineCap = kCGLineCapButt;
+    BOOL lineCapSet = NO;
+
+    for (NSUInteger i = 0; i < count; i++) {
+        const MTDrawCommand* command = &_commands[indexes ? indexes[i] : i];
+        // Going back to the context's color is only possible by restoring the saved state.
+        BOOL needsContextFill = (command->color == NULL && command->type != kMTDrawCommandStroke && fill != NULL);
+        BOOL needsContextStroke = (command->color == NULL && command->type == kMTDrawCommandStroke && stroke != NULL);
+        if (needsContextFill || needsContextStroke) {
+            CGContextRestoreGState(context);
+            CGContextSaveGState(context);
+            fill = stroke = NULL;
+            lineWidth = -1;
+            lineCapSet = NO;
+        }
+        switch (command->type) {
+            case kMTDrawCommandLine:
+                // A line with a color attribute draws in it; a \text run draws in the fill color.
+                if (command->color && !MTSameColor(command->color, fill)) {
+                    CGContextSetFillColorWithColor(context, command->color);
+                    fill = command->color;
+                }
+                CGContextSetTextPosition(context, command->origin.x, command->origin.y);
+                CTLineDraw(command->line, context);
+                break;
+
+            case kMTDrawCommandGlyphs:
+                if (command->color && !MTSameColor(command->color, fill)) {
+                    CGContextSetFillColorWithColor(context, command->color);
+                    fill = command->color;
+                }
+                CTFontDrawGlyphs(command->font, _glyphs + command->index, _glyphPositions + command->index, command->count, context);
+                break;
+
+            case kMTDrawCommandStroke:
+                if (command->color && !MTSameColor(command->color, stroke)) {
+                    CGContextSetStrokeColorWithColor(context, command->color);
+                    stroke = command->color;
+                }
+                if (command->lineWidth != lineWidth) {
+                    CGContextSetLineWidth(context, command->lineWidth);
+                    lineWidth = command->lineWidth;
+                }
+                if (!lineCapSet || command->lineCap != lineCap) {
+                    CGContextSetLineCap(context, command->lineCap);
+                    lineCap = command->lineCap;
+                    lineCapSet = YES;
+                }
+                CGContextBeginPath(context);
+                for (NSUInteger p = 0; p + 1 < command->count; p += 2) {
+                    CGPoint start = _points[command->index + p];
+                    CGPoint end = _points[command->index + p + 1];
+                    CGContextMoveToPoint(context, start.x, start.y);
+                    CGContextAddLineToPoint(context, end.x, end.y);
+                }
+                CGContextStrokePath(context);
+                break;
+
+            case kMTDrawCommandFillRect:
+                // Backgrounds are rare; keep them out of the tracked state like -[MTDisplay draw:] does.
+                CGContextSaveGState(context);
+                CGContextSetBlendMode(context, kCGBlendModeNormal);
+                CGContextSetFillColorWithColor(context, command->color);
+                CGContextFillRect(context, command->rect);
+                CGContextRestoreGState(context);
+                break;
+        }
+    }
+    CGContextRestoreGState(context);
+}
+
+@end
@@ -14,6 +14,9 @@
 
 /** MTFont wraps the inconvenient distinction between CTFont and CGFont as well
  as the data loaded from the math table.
+
+ An MTFont is not mutated after it is created, so a single instance may be read
+ from several threads at once (e.g. when table cells are typeset concurrently).
  */
 NS_ASSUME_NONNULL_BEGIN
 
@@ -10,6 +10,7 @@
 
 #import "MTFont.h"
 #import "MTFont+Internal.h"
+#import "../lib/MTInstrumentationInternal.h"
 
 @interface MTFont ()
 
@@ -84,6 +85,7 @@
 
 - (MTFont *)copyFontWithSize:(CGFloat)size
 {
+    MTCountEvent(kMTLayoutCounterFontCopies);
     MTFont* copyFont = [[[self class] alloc] init];
     copyFont.defaultCGFont = self.defaultCGFont;
     CTFontRef newCtFont = CTFontCreateWithGraphicsFont(self.defaultCGFont, size, nil, nil);
@@ -67,6 +67,9 @@ extern NSString *const MTFontNameNotoSansMath;
    `CTFontCreateCopyWithSymbolicTraits`. If the trait is unsatisfiable the
    plain system font is returned.
  - `kMTTextStyleTypewriter` → system monospace font.
+
+ The fonts are cached by style and size, so repeated calls return the same
+ font. This method is thread safe.
  */
 + (CTFontRef) textCTFontForStyle:(MTTextStyle) style
                             size:(CGFloat) size CF_RETURNS_RETAINED;
@@ -9,6 +9,8 @@
 //  MIT license. See the LICENSE file for details.
 //
 
+#include <os/lock.h>
+
 #import "MTFontManager.h"
 #import "MTFont+Internal.h"
 
@@ -29,6 +31,67 @@ NSString *const MTFontNameNotoSansMath      = @"notosansmath";
 
 @end
 
+static CTFontRef MTCreateTextCTFont(MTTextStyle style, CGFloat size)
+{
+    CTFontUIFontType base;
+    switch (style) {
+        case kMTTextStyleTypewriter:
+            base = kCTFontUIFontUserFixedPitch;
+            break;
+        case kMTTextStyleRoman:
+        case kMTTextStyleBold:
+        case kMTTextStyleItalic:
+        case kMTTextStyleSansSerif:
+        default:
+            base = kCTFontUIFontSystem;
+            break;
+    }
+
+    CTFontRef baseFont = CTFontCreateUIFontForLanguage(base, size, NULL);
+
+    CTFontSymbolicTraits requested = 0;
+    if (style == kMTTextStyleBold)   requested |= kCTFontTraitBold;
+    if (style == kMTTextStyleItalic) requested |= kCTFontTraitItalic;
+
+    if (requested == 0) {
+        return baseFont;
+    }
+
+    CTFontRef styled = CTFontCreateCopyWithSymbolicTraits(
+        baseFont, size, NULL, requested, requested);
+    if (styled != NULL) {
+        CFRelease(baseFont);
+        return styled;
+    }
+    return baseFont;
+}
+
+// The text fonts made so far. Only a few styles and sizes are used at a time, so they are
+// searched in order, and once the table is full the oldest entry is replaced.
+enum { kMTTextFontCacheSize = 32 };
+
+typedef struct {
+    MTTextStyle style;
+    CGFloat size;
+    CTFontRef font;
+} MTTextFontCacheEntry;
+
+static MTTextFontCacheEntry sTextFonts[kMTTextFontCacheSize];
+static NSUInteger sTextFontCount = 0;
+static NSUInteger sNextTextFont = 0;
+static os_unfair_lock sTextFontLock = OS_UNFAIR_LOCK_INIT;
+
+// Returns a retained font, or NULL. Called with the lock held.
+static CTFontRef MTCopyCachedTextCTFont(MTTextStyle style, CGFloat size)
+{
+    for (NSUInteger i = 0; i < sTextFontCount; i++) {
+        if (sTextFonts[i].style == style && sTextFonts[i].size == size) {
+            return CFRetain(sTextFonts[i].font);
+        }
+    }
+    return NULL;
+}
+
 @implementation MTFontManager
 
 + (MTFontManager *) fontManager
@@ -81,37 +144,32 @@ NSString *const MTFontNameNotoSansMath      = @"notosansmath";
 + (CTFontRef) textCTFontForStyle:(MTTextStyle) style
                             size:(CGFloat) size
 {
-    CTFontUIFontType base;
-    switch (style) {
-        case kMTTextStyleTypewriter:
-            base = kCTFontUIFontUserFixedPitch;
-            break;
-        case kMTTextStyleRoman:
-        case kMTTextStyleBold:
-        case kMTTextStyleItalic:
-        case kMTTextStyleSansSerif:
-        default:
-            base = kCTFontUIFontSystem;
-            break;
+    os_unfair_lock_lock(&sTextFontLock);
+    CTFontRef font = MTCopyCachedTextCTFont(style, size);
+    os_unfair_lock_unlock(&sTextFontLock);
+    if (font) {
+        return font;
     }
-
-    CTFontRef baseFont = CTFontCreateUIFontForLanguage(base, size, NULL);
-
-    CTFontSymbolicTraits requested = 0;
-    if (style == kMTTextStyleBold)   requested |= kCTFontTraitBold;
-    if (style == kMTTextStyleItalic) requested |= kCTFontTraitItalic;
-
-    if (requested == 0) {
-        return baseFont;
-    }
-
-    CTFontRef styled = CTFontCreateCopyWithSymbolicTraits(
-        baseFont, size, NULL, requested, requested);
-    if (styled != NULL) {
-        CFRelease(baseFont);
-        return styled;
+    // Creating the font is slow, so it is done outside the lock.
+    CTFontRef created = MTCreateTextCTFont(style, size);
+    os_unfair_lock_lock(&sTextFontLock);
+    // Another thread may have added the font in the meantime.
+    font = MTCopyCachedTextCTFont(style, size);
+    if (!font) {
+        NSUInteger slot;
+        if (sTextFontCount < kMTTextFontCacheSize) {
+            slot = sTextFontCount++;
+        } else {
+            slot = sNextTextFont;
+            sNextTextFont = (sNextTextFont + 1) % kMTTextFontCacheSize;
+            CFRelease(sTextFonts[slot].font);
+        }
+        sTextFonts[slot] = (MTTextFontCacheEntry) { style, size, CFRetain(created) };
+        font = CFRetain(created);
     }
-    return baseFont;
+    os_unfair_lock_unlock(&sTextFontLock);
+    CFRelease(created);
+    return font;
 }
 
 @end
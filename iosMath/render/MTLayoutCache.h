@@ -0,0 +1,71 @@
+//
+//  MTLayoutCache.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import CoreGraphics;
+@import Foundation;
+
+#import "MTConfig.h"
+#import "MTFont.h"
+#import "MTMathListDisplay.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ A persistent cache of finished display trees, so that formulas laid out in an earlier launch
+ are loaded without parsing and typesetting them again.
+
+ Each display is stored as a compact binary archive of its nodes: their kinds, glyph ids,
+ positions, metrics, colors and ranges, with the fonts referenced by PostScript name and size.
+ Archives are memory mapped when read. An archive written by another version of the library,
+ or for another version of the math font, is treated as a miss and deleted.
+
+ A decoded display draws, measures and hit tests like the one that was archived, but it has
+ no typesetter bookkeeping, so an incremental layout starting from it typesets everything.
+ All methods are thread safe.
+ */
+@interface MTLayoutCache : NSObject
+
+/** The cache in the `iosMath/Layout` folder of the caches directory. */
++ (instancetype) sharedCache;
+
+- (instancetype) init NS_UNAVAILABLE;
+
+/** A cache whose archives are files in `directoryURL`, which is created when needed. */
+- (instancetype) initWithDirectoryURL:(NSURL*) directoryURL NS_DESIGNATED_INITIALIZER;
+
+@property (nonatomic, readonly) NSURL* directoryURL;
+
+/** Archives a display typeset with the math font `font`, at any size. Returns nil if the tree
+ holds a display that can not be archived. */
++ (nullable NSData*) archivedDataWithDisplay:(MTMathListDisplay*) display font:(MTFont*) font;
+
+/** Decodes an archive made by `archivedDataWithDisplay:font:` for the same face as `font`.
+ Returns nil if the archive is corrupt or of another library or font version. */
++ (nullable MTMathListDisplay*) displayWithArchivedData:(NSData*) data font:(MTFont*) font;
+
+/** The display stored for the formula, or nil. */
+- (nullable MTMathListDisplay*) displayForLatex:(NSString*) latex font:(MTFont*) font style:(MTLineStyle) style;
+
+/** Stores the display of a formula, replacing any previous one. Returns NO if it can not be
+ archived or written. */
+- (BOOL) setDisplay:(MTMathListDisplay*) display forLatex:(NSString*) latex font:(MTFont*) font style:(MTLineStyle) style;
+
+/** The stored display of the formula, or on a miss, the display parsed and typeset from it,
+ which is then stored. Either way the display does not keep the atoms of the formula, see
+ `-[MTCTLineDisplay atoms]`. Returns nil and sets `error` if the LaTeX does not parse. */
+- (nullable MTMathListDisplay*) layoutLatex:(NSString*) latex font:(MTFont*) font style:(MTLineStyle) style
+                                      error:(NSError* _Nullable * _Nullable) error;
+
+- (void) removeDisplayForLatex:(NSString*) latex font:(MTFont*) font style:(MTLineStyle) style;
+
+/** Deletes every stored display. */
+- (void) removeAllDisplays;
+
+@end
+
+NS_ASSUME_NONNULL_END
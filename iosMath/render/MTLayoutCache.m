@@ -0,0 +1,143 @@
+//
+//  MTLayoutCache.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <CommonCrypto/CommonDigest.h>
+
+#import "MTLayoutCache.h"
+#import "MTDisplayArchiver.h"
+#import "MTFont+Internal.h"
+#import "MTMathListBuilder.h"
+#import "MTTypesetter.h"
+
+static NSString* const kMTLayoutCacheExtension = @"mtda";
+
+@implementation MTLayoutCache
+
++ (instancetype) sharedCache
+{
+    static MTLayoutCache* sharedCache = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSURL* caches = [[NSFileManager defaultManager] URLsForDirectory:NSCachesDirectory inDomains:NSUserDomainMask].firstObject;
+        NSURL* directory = [[caches URLByAppendingPathComponent:@"iosMath" isDirectory:YES] URLByAppendingPathComponent:@"Layout" isDirectory:YES];
+        sharedCache = [[MTLayoutCache alloc] initWithDirectoryURL:directory];
+    });
+    return sharedCache;
+}
+
+- (instancetype) initWithDirectoryURL:(NSURL*) directoryURL
+{
+    NSParameterAssert(directoryURL);
+    self = [super init];
+    if (self) {
+        _directoryURL = directoryURL;
+    }
+    return self;
+}
+
++ (NSData*) archivedDataWithDisplay:(MTMathListDisplay*) display font:(MTFont*) font
+{
+    NSParameterAssert(display);
+    NSParameterAssert(font);
+    MTDisplayArchiver* archiver = [[MTDisplayArchiver alloc] initWithFont:font];
+    [archiver encodeDisplay:display];
+    return [archiver finishEncoding];
+}
+
++ (MTMathListDisplay*) displayWithArchivedData:(NSData*) data font:(MTFont*) font
+{
+    NSParameterAssert(data);
+    NSParameterAssert(font);
+    MTDisplayUnarchiver* unarchiver = [[MTDisplayUnarchiver alloc] initWithData:data font:font];
+    MTDisplay* display = [unarchiver decodeDisplay];
+    if (unarchiver.failed || ![display isKindOfClass:MTMathListDisplay.class]) {
+        return nil;
+    }
+    return (MTMathListDisplay*) display;
+}
+
+// The file of a formula is named by a digest of everything the layout depends on.
+- (NSURL*) URLForLatex:(NSString*) latex font:(MTFont*) font style:(MTLineStyle) style
+{
+    NSParameterAssert(latex);
+    NSParameterAssert(font);
+    NSString* fontName = CFBridgingRelease(CTFontCopyPostScriptName(font.ctFont));
+    NSString* key = [NSString stringWithFormat:@"%@|%g|%ld|%@", fontName, font.fontSize, (long) style, latex];
+    NSData* keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256(keyData.bytes, (CC_LONG) keyData.length, digest);
+    NSMutableString* name = [NSMutableString stringWithCapacity:CC_SHA256_DIGEST_LENGTH * 2];
+    for (int i = 0; i < CC_SHA256_DIGEST_LENGTH; i++) {
+        [name appendFormat:@"%02x", digest[i]];
+    }
+    return [[_directoryURL URLByAppendingPathComponent:name] URLByAppendingPathExtension:kMTLayoutCacheExtension];
+}
+
+- (MTMathListDisplay*) displayForLatex:(NSString*) latex font:(MTFont*) font style:(MTLineStyle) style
+{
+    NSURL* url = [self URLForLatex:latex font:font style:style];
+    // Mapped, so that only the pages that are read are loaded.
+    NSData* data = [NSData dataWithContentsOfURL:url options:NSDataReadingMappedIfSafe error:NULL];
+    if (!data) {
+        return nil;
+    }
+    MTMathListDisplay* display = [MTLayoutCache displayWithArchivedData:data font:font];
+    if (!display) {
+        // Stale or corrupt, it would never be read.
+        [[NSFileManager defaultManager] removeItemAtURL:url error:NULL];
+    }
+    return display;
+}
+
+- (BOOL) setDisplay:(MTMathListDisplay*) display forLatex:(NSString*) latex font:(MTFont*) font style:(MTLineStyle) style
+{
+    NSData* data = [MTLayoutCache archivedDataWithDisplay:display font:font];
+    if (!data) {
+        return NO;
+    }
+    if (![[NSFileManager defaultManager] createDirectoryAtURL:_directoryURL withIntermediateDirectories:YES attributes:nil error:NULL]) {
+        return NO;
+    }
+    return [data writeToURL:[self URLForLatex:latex font:font style:style] options:NSDataWritingAtomic error:NULL];
+}
+
+- (MTMathListDisplay*) layoutLatex:(NSString*) latex font:(MTFont*) font style:(MTLineStyle) style error:(NSError**) error
+{
+    MTMathListDisplay* display = [self displayForLatex:latex font:font style:style];
+    if (display) {
+        return display;
+    }
+    MTMathList* mathList = [MTMathListBuilder buildFromString:latex error:error];
+    if (!mathList) {
+        return nil;
+    }
+    // Like a stored display, the display does not keep the atoms of the list.
+    display = [MTTypesetter createLineForMathList:mathList font:font style:style retainsAtoms:NO];
+    if (display) {
+        [self setDisplay:display forLatex:latex font:font style:style];
+    }
+    return display;
+}
+
+- (void) removeDisplayForLatex:(NSString*) latex font:(MTFont*) font style:(MTLineStyle) style
+{
+    [[NSFileManager defaultManager] removeItemAtURL:[self URLForLatex:latex font:font style:style] error:NULL];
+}
+
+- (void) removeAllDisplays
+{
+    NSFileManager* fileManager = [NSFileManager defaultManager];
+    NSArray<NSURL*>* urls = [fileManager contentsOfDirectoryAtURL:_directoryURL includingPropertiesForKeys:nil options:0 error:NULL];
+    for (NSURL* url in urls) {
+        if ([url.pathExtension isEqualToString:kMTLayoutCacheExtension]) {
+            [fileManager removeItemAtURL:url error:NULL];
+        }
+    }
+}
+
+@end
@@ -19,6 +19,7 @@
 
 #import "MTFont.h"
 #import "lib/MTMathList.h"
+#import "lib/MTMathListIndex.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -30,6 +31,11 @@ NS_ASSUME_NONNULL_BEGIN
 /// Gets the bounding rectangle for the MTDisplay
 - (CGRect) displayBounds;
 
+/// The approximate number of bytes of memory held by the display and its children. The fonts
+/// and colors, which are shared with other displays, are not counted; the atoms kept by an
+/// `MTCTLineDisplay` are.
+- (NSUInteger) retainedSize;
+
 /// For debugging. Shows the object in quick look in Xcode.
 #if TARGET_OS_IPHONE
 - (id) debugQuickLookObject;
@@ -67,7 +73,9 @@ NS_ASSUME_NONNULL_BEGIN
 /// the display. So set only when
 @property (nonatomic) NSAttributedString* attributedString;
 
-/// An array of MTMathAtoms that this CTLine displays. Used for indexing back into the MTMathList
+/// An array of MTMathAtoms that this CTLine displays. Used for indexing back into the MTMathList.
+/// Empty if the display was typeset by a label with `retainsAtoms` off, by `-[MTLayoutCache layoutLatex:font:style:error:]`,
+/// or loaded from an archive.
 @property (nonatomic, readonly) NSArray<MTMathAtom*>* atoms;
 
 @end
@@ -119,6 +127,32 @@ typedef NS_ENUM(unsigned int, MTLinePosition)  {
 /// regular list this is NSNotFound
 @property (nonatomic, readonly) NSUInteger index;
 
+/**
+ Returns the index in the displayed math list closest to the given point, e.g. to place a
+ caret where the user tapped. The index may point into a script, a numerator, a radicand,
+ an inner list and so on; a table counts as a single atom. An index whose innermost sub
+ index is of type `kMTSubIndexTypeNucleus` (with index 1) is after the nucleus of an atom
+ but before its scripts.
+
+ Each list keeps its sub-displays sorted by their x extent, built the first time it is
+ queried, so a lookup takes logarithmic time per level of nesting. Because of that the
+ same display should not be queried from several threads at once.
+
+ @param point The point, in the coordinate space this display is positioned in (the space
+ it is drawn in).
+ @param caretOffset If not NULL, set to the x coordinate of the caret for the returned index.
+ @return The closest index, or nil if it can not be determined.
+ */
+- (nullable MTMathListIndex*) closestIndexToPoint:(CGPoint) point caretOffset:(nullable CGFloat*) caretOffset;
+
+/**
+ Returns the rectangle of a caret placed at the given index, in the coordinate space this
+ display is positioned in. The rectangle has zero width and spans the ascent and descent
+ of the innermost list containing the index. Returns `CGRectNull` if the index does not
+ point into this display.
+ */
+- (CGRect) caretRectForIndex:(MTMathListIndex*) index;
+
 @end
 
 /// Rendering of an MTFraction as an MTDisplay
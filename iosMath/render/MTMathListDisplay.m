@@ -9,6 +9,7 @@
 //  MIT license. See the LICENSE file for details.
 //
 
+#include <os/lock.h>
 #import <CoreText/CoreText.h>
 
 #import "MTMathListDisplay.h"
@@ -16,6 +17,11 @@
 #import "MTFontManager.h"
 #import "MTFont+Internal.h"
 #import "MTMathListDisplayInternal.h"
+#import "MTDrawCommandList+Internal.h"
+#import "MTDisplayArchiver.h"
+#import "MTTextRunCache.h"
+#import "../lib/MTInstrumentationInternal.h"
+#import "../lib/MTRetainedSize.h"
 
 // Ink max-x of a glyph run: the widest per-glyph bbox right edge, each shifted by
 // its own x-offset. Shared by the two glyph-array displays so they can't drift.
@@ -29,9 +35,217 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     return maxX;
 }
 
+static CGPoint MTOffsetPoint(CGPoint point, CGPoint origin)
+{
+    return CGPointMake(point.x + origin.x, point.y + origin.y);
+}
+
+#pragma mark Hit testing helpers
+
+// How far outside a display a point may be and still be taken to be on it.
+static const CGFloat kMTHitTestSlop = 2;
+
+static CGFloat MTDistanceFromPointToRect(CGPoint point, CGRect rect)
+{
+    CGFloat distance = 0;
+    if (point.x < CGRectGetMinX(rect)) {
+        distance += CGRectGetMinX(rect) - point.x;
+    } else if (point.x > CGRectGetMaxX(rect)) {
+        distance += point.x - CGRectGetMaxX(rect);
+    }
+    if (point.y < CGRectGetMinY(rect)) {
+        distance += CGRectGetMinY(rect) - point.y;
+    } else if (point.y > CGRectGetMaxY(rect)) {
+        distance += point.y - CGRectGetMaxY(rect);
+    }
+    return distance;
+}
+
+// The index before or after the atoms in `range`, by which half of `bounds` the point is in.
+static MTMathListIndex* MTIndexBeforeOrAfter(NSRange range, CGRect bounds, CGPoint point)
+{
+    return [MTMathListIndex level0Index:(point.x < CGRectGetMidX(bounds)) ? range.location : NSMaxRange(range)];
+}
+
+// The index for a point on the display of an atom with a child list: in the child list if
+// the point is over it, and otherwise before or after the atom.
+static MTMathListIndex* MTIndexInChild(MTMathListDisplay* child, MTMathListSubIndexType type, NSRange range, CGRect bounds, CGPoint point)
+{
+    CGRect childBounds = child.displayBounds;
+    if (!child || point.x < CGRectGetMinX(childBounds) - kMTHitTestSlop || point.x > CGRectGetMaxX(childBounds) + kMTHitTestSlop) {
+        return MTIndexBeforeOrAfter(range, bounds, point);
+    }
+    MTMathListIndex* childIndex = [child closestIndexToPoint:point];
+    if (!childIndex) {
+        return nil;
+    }
+    return [MTMathListIndex indexAtLocation:range.location withSubIndex:childIndex type:type];
+}
+
+// The caret rectangle for an index into the child list `child` of an atom.
+static CGRect MTCaretRectInChild(MTMathListDisplay* child, MTMathListIndex* index)
+{
+    if (!child || !index.subIndex) {
+        return CGRectNull;
+    }
+    return [child caretRectForIndex:index.subIndex];
+}
+
+#pragma mark Archiving helpers
+
+// Decodes a child display, which has to be of class `cls`, and present if it is `required`.
+static id MTDecodeDisplayOfClass(MTDisplayUnarchiver* unarchiver, Class cls, BOOL required)
+{
+    MTDisplay* display = [unarchiver decodeDisplay];
+    if ((!display && required) || (display && ![display isKindOfClass:cls])) {
+        [unarchiver fail];
+        return nil;
+    }
+    return display;
+}
+
+// CoreText does not report the size of a line. This counts its object and runs, and for each
+// glyph the glyph, position, advance and string index that a run keeps.
+static void MTAddLineToRetainedSize(CTLineRef line, MTRetainedSizeCounter* counter)
+{
+    if (!line) {
+        return;
+    }
+    [counter addMallocBlock:line];
+    CFArrayRef runs = CTLineGetGlyphRuns(line);
+    for (CFIndex i = 0; i < CFArrayGetCount(runs); i++) {
+        CTRunRef run = CFArrayGetValueAtIndex(runs, i);
+        [counter addMallocBlock:run];
+        [counter addBytes:CTRunGetGlyphCount(run) * (sizeof(CGGlyph) + sizeof(CGPoint) + sizeof(CGSize) + sizeof(CFIndex))];
+    }
+}
+
+#pragma mark MTDisplayColors
+
+// The colors of a display. They are immutable and interned, so that all the displays with the
+// same colors, usually every display of a formula, share one instance instead of holding three
+// references each.
+@interface MTDisplayColors : NSObject
+
+@property (nonatomic, readonly, nullable) MTColor* textColor;
+@property (nonatomic, readonly, nullable) MTColor* localTextColor;
+@property (nonatomic, readonly, nullable) MTColor* localBackgroundColor;
+
+@end
+
+static BOOL MTColorsEqual(MTColor* a, MTColor* b)
+{
+    return a == b || [a isEqual:b];
+}
+
+@implementation MTDisplayColors
+
+// Returns nil if there are no colors.
++ (nullable MTDisplayColors*) colorsWithTextColor:(MTColor*) textColor localTextColor:(MTColor*) localTextColor localBackgroundColor:(MTColor*) localBackgroundColor
+{
+    if (!textColor && !localTextColor && !localBackgroundColor) {
+        return nil;
+    }
+    MTDisplayColors* colors = [[self alloc] init];
+    colors->_textColor = textColor;
+    colors->_localTextColor = localTextColor;
+    colors->_localBackgroundColor = localBackgroundColor;
+
+    // Weak, so that the colors no display uses any more are dropped.
+    static NSHashTable<MTDisplayColors*>* table;
+    static os_unfair_lock lock = OS_UNFAIR_LOCK_INIT;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        table = [NSHashTable weakObjectsHashTable];
+    });
+    os_unfair_lock_lock(&lock);
+    MTDisplayColors* interned = [table member:colors];
+    if (!interned) {
+        [table addObject:colors];
+        interned = colors;
+    }
+    os_unfair_lock_unlock(&lock);
+    return interned;
+}
+
+- (NSUInteger)hash
+{
+    return _textColor.hash ^ (_localTextColor.hash * 31) ^ (_localBackgroundColor.hash * 17);
+}
+
+- (BOOL)isEqual:(id)object
+{
+    if (![object isKindOfClass:[MTDisplayColors class]]) {
+        return NO;
+    }
+    MTDisplayColors* other = object;
+    return MTColorsEqual(_textColor, other->_textColor) && MTColorsEqual(_localTextColor, other->_localTextColor)
+        && MTColorsEqual(_localBackgroundColor, other->_localBackgroundColor);
+}
+
+@end
+
 #pragma mark MTDisplay
 
-@implementation MTDisplay
+@interface MTDisplay () <MTRetainedSizeWalking>
+
+@end
+
+@implementation MTDisplay {
+    MTDisplayColors* _colors;
+}
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        MTCountEvent(kMTLayoutCounterDisplays);
+    }
+    return self;
+}
+
+- (MTColor *)textColor
+{
+    return _colors.textColor;
+}
+
+- (void)setTextColor:(MTColor *)textColor
+{
+    if (textColor != _colors.textColor) {
+        _colors = [MTDisplayColors colorsWithTextColor:textColor localTextColor:_colors.localTextColor localBackgroundColor:_colors.localBackgroundColor];
+    }
+}
+
+- (MTColor *)localTextColor
+{
+    return _colors.localTextColor;
+}
+
+- (void)setLocalTextColor:(MTColor *)localTextColor
+{
+    if (localTextColor != _colors.localTextColor) {
+        _colors = [MTDisplayColors colorsWithTextColor:_colors.textColor localTextColor:localTextColor localBackgroundColor:_colors.localBackgroundColor];
+    }
+}
+
+- (MTColor *)localBackgroundColor
+{
+    return _colors.localBackgroundColor;
+}
+
+- (void)setLocalBackgroundColor:(MTColor *)localBackgroundColor
+{
+    if (localBackgroundColor != _colors.localBackgroundColor) {
+        _colors = [MTDisplayColors colorsWithTextColor:_colors.textColor localTextColor:_colors.localTextColor localBackgroundColor:localBackgroundColor];
+    }
+}
+
+- (NSUInteger)retainedSize
+{
+    MTRetainedSizeCounter* counter = [MTRetainedSizeCounter new];
+    [counter addObject:self];
+    return counter.size;
+}
 
 - (void)draw:(CGContextRef)context
 {
@@ -45,11 +259,37 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     
 }
 
+- (void)appendDrawCommands:(MTDrawCommandList *)commands origin:(CGPoint)origin
+{
+    [commands setBounds:CGRectOffset([self displayBounds], origin.x, origin.y) forDisplay:self];
+    if (self.localBackgroundColor != nil) {
+        [commands addFillRect:CGRectOffset([self displayBounds], origin.x, origin.y) color:self.localBackgroundColor.CGColor display:self];
+    }
+}
+
 - (CGRect) displayBounds
 {
     return CGRectMake(self.position.x, self.position.y - self.descent, self.width, self.ascent + self.descent);
 }
 
+- (MTMathListIndex *)closestIndexToPoint:(CGPoint)point
+{
+    if (self.range.location == NSNotFound) {
+        return nil;
+    }
+    return MTIndexBeforeOrAfter(self.range, [self displayBounds], point);
+}
+
+- (CGFloat)caretOffsetForIndex:(MTMathListIndex *)index
+{
+    return (index.atomIndex <= self.range.location) ? self.position.x : self.position.x + self.width;
+}
+
+- (CGRect)caretRectForChildIndex:(MTMathListIndex *)index
+{
+    return CGRectNull;
+}
+
 - (CGFloat)inkWidth
 {
     return MAX(self.width, self.inkMaxX);
@@ -81,20 +321,92 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
 }
 #endif
 
+#pragma mark Archiving
+
+- (void) encodeWithArchiver:(MTDisplayArchiver*) archiver
+{
+    // The stored values, not those of the getters that subclasses compute from their children.
+    [archiver encodePoint:_position];
+    [archiver encodeFloat:_ascent];
+    [archiver encodeFloat:_descent];
+    [archiver encodeFloat:_width];
+    [archiver encodeFloat:_inkMaxX];
+    [archiver encodeRange:_range];
+    [archiver encodeBool:_hasScript];
+    [archiver encodeColor:_colors.textColor];
+    [archiver encodeColor:_colors.localTextColor];
+    [archiver encodeColor:_colors.localBackgroundColor];
+    [self encodeContentsWithArchiver:archiver];
+}
+
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver
+{
+}
+
++ (instancetype) displayWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+    CGPoint position = [unarchiver decodePoint];
+    CGFloat ascent = [unarchiver decodeFloat];
+    CGFloat descent = [unarchiver decodeFloat];
+    CGFloat width = [unarchiver decodeFloat];
+    CGFloat inkMaxX = [unarchiver decodeFloat];
+    NSRange range = [unarchiver decodeRange];
+    BOOL hasScript = [unarchiver decodeBool];
+    MTColor* textColor = [unarchiver decodeColor];
+    MTColor* localTextColor = [unarchiver decodeColor];
+    MTColor* localBackgroundColor = [unarchiver decodeColor];
+    MTDisplay* display = [self decodeContentsWithUnarchiver:unarchiver];
+    if (!display || unarchiver.failed) {
+        return nil;
+    }
+    // Assigned directly, since the setters of the subclasses move the children, which are
+    // already in place, and propagate the colors, which are already set.
+    display->_position = position;
+    display->_ascent = ascent;
+    display->_descent = descent;
+    display->_width = width;
+    display->_inkMaxX = inkMaxX;
+    display->_range = range;
+    display->_hasScript = hasScript;
+    display->_colors = [MTDisplayColors colorsWithTextColor:textColor localTextColor:localTextColor localBackgroundColor:localBackgroundColor];
+    return display;
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+    return [[self alloc] init];
+}
+
 @end
 
 #pragma mark - MTCTLine
 
-@implementation MTCTLineDisplay
+@implementation MTCTLineDisplay {
+    NSArray<MTMathAtom*>* _atoms;
+    // The length of the nucleus of each atom.
+    uint32_t* _atomLengths;
+    NSUInteger _atomCount;
+    // The x of the caret before each of the atoms and after the last one, relative to the
+    // position. Built on the first hit test.
+    CGFloat* _caretOffsets;
+}
 
-- (instancetype)initWithString:(NSAttributedString*) attrString position:(CGPoint)position range:(NSRange) range font:(MTFont*) font atoms:(NSArray<MTMathAtom*>*) atoms
+- (instancetype)initWithString:(NSAttributedString*) attrString position:(CGPoint)position range:(NSRange) range font:(MTFont*) font
+                         atoms:(NSArray<MTMathAtom*>*) atoms retainAtoms:(BOOL) retainAtoms
 {
     self = [super init];
     if (self) {
         self.position = position;
         self.attributedString = attrString;
         self.range = range;
-        _atoms = atoms;
+        if (retainAtoms) {
+            _atoms = atoms;
+        }
+        _atomCount = atoms.count;
+        _atomLengths = malloc(_atomCount * sizeof(uint32_t));
+        for (NSUInteger i = 0; i < _atomCount; i++) {
+            _atomLengths[i] = (uint32_t) atoms[i].nucleus.length;
+        }
         // We can't use typographic bounds here as the ascent and descent returned are for the font and not for the line.
         self.width = CTLineGetTypographicBounds(_line, NULL, NULL, NULL);
         CGRect bounds = CTLineGetBoundsWithOptions(_line, kCTLineBoundsUseGlyphPathBounds);
@@ -113,6 +425,7 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
         CFRelease(_line);
     }
     _attributedString = [attrString copy];
+    MTCountEvent(kMTLayoutCounterCTLines);
     _line = CTLineCreateWithAttributedString((__bridge CFAttributedStringRef)(_attributedString));
 }
 
@@ -125,9 +438,23 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     self.attributedString = attrStr;
 }
 
+- (NSArray<MTMathAtom*>*) atoms
+{
+    return _atoms ?: @[];
+}
+
+- (void) addStorageToRetainedSize:(MTRetainedSizeCounter*) counter
+{
+    MTAddLineToRetainedSize(_line, counter);
+    [counter addMallocBlock:_atomLengths];
+    [counter addMallocBlock:_caretOffsets];
+}
+
 - (void)dealloc
 {
     CFRelease(_line);
+    free(_atomLengths);
+    free(_caretOffsets);
 }
 
 - (void)draw:(CGContextRef)context
@@ -141,6 +468,125 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     CGContextRestoreGState(context);
 }
 
+- (void)appendDrawCommands:(MTDrawCommandList *)commands origin:(CGPoint)origin
+{
+    [super appendDrawCommands:commands origin:origin];
+    [commands addLine:_line origin:MTOffsetPoint(self.position, origin) color:self.textColor.CGColor display:self];
+}
+
+- (const CGFloat*) caretOffsets
+{
+    if (_caretOffsets) {
+        return _caretOffsets;
+    }
+    // The caret before a character is at the first glyph made from it.
+    NSUInteger length = _attributedString.length;
+    CGFloat* stringOffsets = malloc((length + 1) * sizeof(CGFloat));
+    for (NSUInteger i = 0; i < length; i++) {
+        stringOffsets[i] = CGFLOAT_MAX;
+    }
+    stringOffsets[length] = self.width;
+    CFArrayRef runs = CTLineGetGlyphRuns(_line);
+    for (CFIndex r = 0; r < CFArrayGetCount(runs); r++) {
+        CTRunRef run = CFArrayGetValueAtIndex(runs, r);
+        CFIndex glyphCount = CTRunGetGlyphCount(run);
+        // Lines can hold thousands of glyphs, so these are not on the stack.
+        CGPoint* positions = malloc(glyphCount * sizeof(CGPoint));
+        CFIndex* stringIndexes = malloc(glyphCount * sizeof(CFIndex));
+        CTRunGetPositions(run, CFRangeMake(0, 0), positions);
+        CTRunGetStringIndices(run, CFRangeMake(0, 0), stringIndexes);
+        for (CFIndex g = 0; g < glyphCount; g++) {
+            NSUInteger stringIndex = (NSUInteger) stringIndexes[g];
+            if (stringIndex < length) {
+                stringOffsets[stringIndex] = MIN(stringOffsets[stringIndex], positions[g].x);
+            }
+        }
+        free(positions);
+        free(stringIndexes);
+    }
+    // Characters without a glyph of their own (e.g. the second half of a surrogate pair)
+    // share the caret of the character after them.
+    for (NSUInteger i = length; i > 0; i--) {
+        if (stringOffsets[i - 1] == CGFLOAT_MAX) {
+            stringOffsets[i - 1] = stringOffsets[i];
+        }
+    }
+    _caretOffsets = malloc((_atomCount + 1) * sizeof(CGFloat));
+    NSUInteger stringIndex = 0;
+    for (NSUInteger i = 0; i <= _atomCount; i++) {
+        _caretOffsets[i] = stringOffsets[MIN(stringIndex, length)];
+        if (i < _atomCount) {
+            stringIndex += _atomLengths[i];
+        }
+    }
+    free(stringOffsets);
+    return _caretOffsets;
+}
+
+- (MTMathListIndex *)closestIndexToPoint:(CGPoint)point
+{
+    const CGFloat* offsets = [self caretOffsets];
+    CGFloat x = point.x - self.position.x;
+    // The first caret at or after x, then whichever of it and the one before is closer.
+    NSUInteger lo = 0;
+    NSUInteger hi = _atomCount;
+    while (lo < hi) {
+        NSUInteger mid = lo + (hi - lo) / 2;
+        if (offsets[mid] < x) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo > 0 && x - offsets[lo - 1] <= offsets[lo] - x) {
+        lo--;
+    }
+    return [MTMathListIndex level0Index:self.range.location + lo];
+}
+
+- (CGFloat)caretOffsetForIndex:(MTMathListIndex *)index
+{
+    NSUInteger atom = (index.atomIndex > self.range.location) ? index.atomIndex - self.range.location : 0;
+    return self.position.x + [self caretOffsets][MIN(atom, _atomCount)];
+}
+
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver
+{
+    // The string is shaped again when decoded, but it is not typeset: the kerns, fonts and
+    // colors of the runs are the ones the typesetter chose.
+    [archiver encodeAttributedString:_attributedString];
+    // Hit testing only needs the length of the nucleus of each atom.
+    [archiver encodeUInteger:_atomCount];
+    for (NSUInteger i = 0; i < _atomCount; i++) {
+        [archiver encodeUInteger:_atomLengths[i]];
+    }
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+    NSAttributedString* string = [unarchiver decodeAttributedString];
+    NSUInteger count = [unarchiver decodeUInteger];
+    // Every length takes a byte, which bounds the allocation by the data.
+    if (unarchiver.failed || count > unarchiver.remainingLength) {
+        return nil;
+    }
+    uint32_t* lengths = malloc(count * sizeof(uint32_t));
+    for (NSUInteger i = 0; i < count; i++) {
+        NSUInteger length = [unarchiver decodeUInteger];
+        lengths[i] = (uint32_t) MIN(length, (NSUInteger) UINT32_MAX);
+    }
+    if (unarchiver.failed) {
+        free(lengths);
+        return nil;
+    }
+    MTCTLineDisplay* display = [[self alloc] initWithString:string position:CGPointZero range:NSMakeRange(0, 0) font:unarchiver.font
+                                                      atoms:@[] retainAtoms:NO];
+    free(display->_atomLengths);
+    display->_atomLengths = lengths;
+    display->_atomCount = count;
+    return display;
+}
+
 @end
 
 #pragma mark - MTTextDisplay
@@ -155,6 +601,15 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
                        ctFont:(CTFontRef) ctFont
                         range:(NSRange) range
 {
+    return [self initWithText:text textStyle:textStyle run:[MTTextRun runWithText:text font:ctFont] range:range];
+}
+
+- (instancetype) initWithText:(NSString *) text
+                    textStyle:(MTTextStyle) textStyle
+                          run:(MTTextRun *) run
+                        range:(NSRange) range
+{
+    NSParameterAssert(run);
     self = [super init];
     if (self) {
         _text = [text copy];
@@ -162,22 +617,24 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
         self.range = range;
         self.position = CGPointZero;
 
-        NSDictionary *attrs = @{ (NSString *)kCTFontAttributeName: (__bridge id)ctFont };
-        _attributedString = [[NSAttributedString alloc]
-                              initWithString:text ?: @""
-                                  attributes:attrs];
-        _line = CTLineCreateWithAttributedString(
-                    (__bridge CFAttributedStringRef)_attributedString);
+        // The line is shared with the other displays of the run. It draws in the fill color
+        // of the context, so the text color does not change it.
+        _attributedString = run.attributedString;
+        _line = CFRetain(run.line);
 
-        self.width = (CGFloat)CTLineGetTypographicBounds(_line, NULL, NULL, NULL);
-        CGRect bounds = CTLineGetBoundsWithOptions(_line, kCTLineBoundsUseGlyphPathBounds);
-        self.ascent  = MAX(0, CGRectGetMaxY(bounds));
-        self.descent = MAX(0, -CGRectGetMinY(bounds));
-        self.inkMaxX = CGRectGetMaxX(bounds);   // ink extent
+        self.width = run.width;
+        self.ascent = run.ascent;
+        self.descent = run.descent;
+        self.inkMaxX = run.inkMaxX;   // ink extent
     }
     return self;
 }
 
+- (void) addStorageToRetainedSize:(MTRetainedSizeCounter*) counter
+{
+    MTAddLineToRetainedSize(_line, counter);
+}
+
 - (void) dealloc
 {
     if (_line) {
@@ -186,35 +643,99 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     }
 }
 
-- (void) setTextColor:(MTColor *) textColor
-{
-    [super setTextColor:textColor];
-
-    NSMutableAttributedString *m = [_attributedString mutableCopy];
-    [m addAttribute:(NSString *)kCTForegroundColorAttributeName
-              value:(id)textColor.CGColor
-              range:NSMakeRange(0, m.length)];
-    _attributedString = [m copy];
-    if (_line) CFRelease(_line);
-    _line = CTLineCreateWithAttributedString(
-                (__bridge CFAttributedStringRef)_attributedString);
-}
-
 - (void) draw:(CGContextRef) context
 {
     [super draw:context];
     CGContextSaveGState(context);
+    if (self.textColor) {
+        CGContextSetFillColorWithColor(context, self.textColor.CGColor);
+    }
     CGContextSetTextPosition(context, self.position.x, self.position.y);
     CTLineDraw(_line, context);
     CGContextRestoreGState(context);
 }
 
+- (void) appendDrawCommands:(MTDrawCommandList *) commands origin:(CGPoint) origin
+{
+    [super appendDrawCommands:commands origin:origin];
+    [commands addLine:_line origin:MTOffsetPoint(self.position, origin) color:self.textColor.CGColor display:self];
+}
+
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver
+{
+    [archiver encodeString:_text];
+    [archiver encodeUInteger:_textStyle];
+    // An empty text has no attributes, and any font will do for it.
+    id font = _attributedString.length ? [_attributedString attribute:(NSString*) kCTFontAttributeName atIndex:0 effectiveRange:NULL] : nil;
+    [archiver encodeCTFont:font ? (__bridge CTFontRef) font : archiver.font.ctFont];
+    // The color is set on the display again once decoded.
+    [archiver encodeColor:self.textColor];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+    NSString* text = [unarchiver decodeString];
+    MTTextStyle textStyle = (MTTextStyle) [unarchiver decodeUInteger];
+    CTFontRef font = [unarchiver decodeCTFont];
+    MTColor* textColor = [unarchiver decodeColor];
+    if (unarchiver.failed || !font) {
+        return nil;
+    }
+    MTTextDisplay* display = [[self alloc] initWithText:text textStyle:textStyle ctFont:font range:NSMakeRange(0, 0)];
+    if (textColor) {
+        display.textColor = textColor;
+    }
+    return display;
+}
+
 @end
 
 #pragma mark - MTLine
 
+// A sub-display of a list, as seen by hit testing.
+typedef struct {
+    CGFloat minX;
+    CGFloat maxX;
+    // kMTSubIndexTypeNone for the display of atoms of the list, kMTSubIndexTypeSubscript
+    // or kMTSubIndexTypeSuperscript for the scripts of `atom`, and kMTSubIndexTypeInner for
+    // the inner list of `atom` laid out inline (\color, a brace group, ...).
+    MTMathListSubIndexType type;
+    NSRange atoms;
+    NSUInteger display;
+} MTHitTestEntry;
+
+// The sub-displays of a list sorted by their x extent, with the running maximum of their
+// right edges, and sorted by their atoms (scripts after the other displays of their atom).
+typedef struct {
+    NSUInteger count;
+    MTHitTestEntry* byX;
+    CGFloat* maxXThrough;
+    MTHitTestEntry* byAtom;
+} MTHitTestIndex;
+
+static int MTCompareEntriesByX(const void* a, const void* b)
+{
+    CGFloat x = ((const MTHitTestEntry*) a)->minX;
+    CGFloat y = ((const MTHitTestEntry*) b)->minX;
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+static int MTCompareEntriesByAtom(const void* a, const void* b)
+{
+    const MTHitTestEntry* x = a;
+    const MTHitTestEntry* y = b;
+    if (x->atoms.location != y->atoms.location) {
+        return (x->atoms.location < y->atoms.location) ? -1 : 1;
+    }
+    if (x->type != y->type) {
+        return (x->type < y->type) ? -1 : 1;
+    }
+    return (x->display < y->display) ? -1 : (x->display > y->display) ? 1 : 0;
+}
+
 @implementation MTMathListDisplay {
     NSUInteger _index;
+    MTHitTestIndex* _hitTestIndex;
 }
 
 
@@ -232,6 +753,26 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     return self;
 }
 
+- (void)dealloc
+{
+    if (_hitTestIndex) {
+        free(_hitTestIndex->byX);
+        free(_hitTestIndex->maxXThrough);
+        free(_hitTestIndex->byAtom);
+        free(_hitTestIndex);
+    }
+}
+
+- (void) addStorageToRetainedSize:(MTRetainedSizeCounter*) counter
+{
+    if (_hitTestIndex) {
+        [counter addMallocBlock:_hitTestIndex];
+        [counter addMallocBlock:_hitTestIndex->byX];
+        [counter addMallocBlock:_hitTestIndex->maxXThrough];
+        [counter addMallocBlock:_hitTestIndex->byAtom];
+    }
+}
+
 - (void) setType:(MTLinePosition) type
 {
     _type = type;
@@ -259,6 +800,7 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
 
 - (void)draw:(CGContextRef)context
 {
+    MTTracePhase(kMTLayoutPhaseDraw);
     [super draw:context];
     CGContextSaveGState(context);
     
@@ -274,6 +816,16 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     CGContextRestoreGState(context);
 }
 
+- (void)appendDrawCommands:(MTDrawCommandList *)commands origin:(CGPoint)origin
+{
+    [super appendDrawCommands:commands origin:origin];
+    // The positions of the sub atoms are relative to the position of this display.
+    CGPoint listOrigin = MTOffsetPoint(self.position, origin);
+    for (MTDisplay* displayAtom in self.subDisplays) {
+        [displayAtom appendDrawCommands:commands origin:listOrigin];
+    }
+}
+
 - (void) recomputeDimensions
 {
     CGFloat max_ascent = 0;
@@ -305,6 +857,348 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     self.inkMaxX = max_inkMaxX;
 }
 
+#pragma mark Hit testing
+
+- (const MTHitTestIndex*) hitTestIndex
+{
+    if (_hitTestIndex) {
+        return _hitTestIndex;
+    }
+    // The inner lists laid out inline only know their own atoms; the atom of the parent
+    // they belong to is recorded in childLayouts.
+    NSMapTable<MTDisplay*, NSNumber*>* inlineAtoms = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsObjectPointerPersonality
+                                                                           valueOptions:NSPointerFunctionsStrongMemory];
+    [self.childLayouts enumerateKeysAndObjectsUsingBlock:^(NSNumber* key, MTMathListDisplay* child, BOOL* stop) {
+        if (MTLayoutKeySlot(key) == kMTSubIndexTypeInner) {
+            [inlineAtoms setObject:@(MTLayoutKeyAtomIndex(key)) forKey:child];
+        }
+    }];
+
+    NSUInteger capacity = MAX(self.subDisplays.count, (NSUInteger) 1);
+    MTHitTestIndex* index = calloc(1, sizeof(MTHitTestIndex));
+    index->byX = malloc(capacity * sizeof(MTHitTestEntry));
+    index->maxXThrough = malloc(capacity * sizeof(CGFloat));
+    index->byAtom = malloc(capacity * sizeof(MTHitTestEntry));
+    NSAssert(index->byX && index->maxXThrough && index->byAtom, @"Failed to allocate the hit test index");
+    for (NSUInteger i = 0; i < self.subDisplays.count; i++) {
+        MTDisplay* display = self.subDisplays[i];
+        MTHitTestEntry entry = { 0 };
+        entry.display = i;
+        entry.type = kMTSubIndexTypeNone;
+        entry.atoms = display.range;
+        if ([display isKindOfClass:[MTMathListDisplay class]]) {
+            MTMathListDisplay* line = (MTMathListDisplay*) display;
+            NSNumber* inlineAtom = [inlineAtoms objectForKey:line];
+            if (line.type == kMTLinePositionSubscript || line.type == kMTLinePositionSuperscript) {
+                entry.type = (line.type == kMTLinePositionSubscript) ? kMTSubIndexTypeSubscript : kMTSubIndexTypeSuperscript;
+                entry.atoms = NSMakeRange(line.index, 1);
+            } else if (inlineAtom) {
+                entry.type = kMTSubIndexTypeInner;
+                entry.atoms = NSMakeRange(inlineAtom.unsignedIntegerValue, 1);
+            }
+            // Otherwise it is a table, which counts as a single atom.
+        }
+        if (entry.atoms.location == NSNotFound) {
+            // Not part of any atom, so there is nothing to index.
+            continue;
+        }
+        CGRect bounds = display.displayBounds;
+        entry.minX = CGRectGetMinX(bounds);
+        entry.maxX = CGRectGetMaxX(bounds);
+        index->byX[index->count] = entry;
+        index->byAtom[index->count] = entry;
+        index->count++;
+    }
+    qsort(index->byX, index->count, sizeof(MTHitTestEntry), MTCompareEntriesByX);
+    qsort(index->byAtom, index->count, sizeof(MTHitTestEntry), MTCompareEntriesByAtom);
+    CGFloat maxX = -CGFLOAT_MAX;
+    for (NSUInteger i = 0; i < index->count; i++) {
+        maxX = MAX(maxX, index->byX[i].maxX);
+        index->maxXThrough[i] = maxX;
+    }
+    _hitTestIndex = index;
+    return index;
+}
+
+// The entry of the given type for `atom`: for kMTSubIndexTypeNone the display whose atoms
+// include it, otherwise the script or inline list of that atom.
+static const MTHitTestEntry* MTFindEntry(const MTHitTestIndex* index, NSUInteger atom, MTMathListSubIndexType type)
+{
+    // The last entry that starts at or before the atom.
+    NSUInteger lo = 0;
+    NSUInteger hi = index->count;
+    while (lo < hi) {
+        NSUInteger mid = lo + (hi - lo) / 2;
+        if (index->byAtom[mid].atoms.location <= atom) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    // A few entries can share an atom (its display and its scripts).
+    for (NSUInteger i = lo; i > 0; i--) {
+        const MTHitTestEntry* entry = &index->byAtom[i - 1];
+        BOOL isScript = (entry->type == kMTSubIndexTypeSubscript || entry->type == kMTSubIndexTypeSuperscript);
+        if (type == kMTSubIndexTypeNone) {
+            if (!isScript) {
+                // Displays of atoms do not overlap, so only the last one can contain it.
+                return NSLocationInRange(atom, entry->atoms) ? entry : NULL;
+            }
+        } else if (entry->atoms.location != atom) {
+            break;
+        } else if (entry->type == type) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// The first display of atoms after `atom`, or NULL if there is none.
+static const MTHitTestEntry* MTFindEntryAfter(const MTHitTestIndex* index, NSUInteger atom)
+{
+    NSUInteger lo = 0;
+    NSUInteger hi = index->count;
+    while (lo < hi) {
+        NSUInteger mid = lo + (hi - lo) / 2;
+        if (index->byAtom[mid].atoms.location <= atom) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (NSUInteger i = lo; i < index->count; i++) {
+        const MTHitTestEntry* entry = &index->byAtom[i];
+        if (entry->type != kMTSubIndexTypeSubscript && entry->type != kMTSubIndexTypeSuperscript) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+- (MTMathListIndex *)closestIndexToPoint:(CGPoint)point caretOffset:(CGFloat *)caretOffset
+{
+    MTMathListIndex* index = [self closestIndexToPoint:point];
+    if (index && caretOffset) {
+        CGRect caret = [self caretRectForIndex:index];
+        if (!CGRectIsNull(caret)) {
+            *caretOffset = CGRectGetMinX(caret);
+        }
+    }
+    return index;
+}
+
+- (MTMathListIndex *)closestIndexToPoint:(CGPoint)point
+{
+    // The positions of the sub-displays are relative to the position of this display.
+    CGPoint translated = CGPointMake(point.x - self.position.x, point.y - self.position.y);
+    const MTHitTestIndex* index = [self hitTestIndex];
+    if (index->count == 0) {
+        return [MTMathListIndex level0Index:self.range.location];
+    }
+    // The displays over the point horizontally: they start before it, so they come before
+    // `end` in x order, and they end after it, which the running maximum stops at quickly.
+    NSUInteger lo = 0;
+    NSUInteger end = index->count;
+    while (lo < end) {
+        NSUInteger mid = lo + (end - lo) / 2;
+        if (index->byX[mid].minX - kMTHitTestSlop <= translated.x) {
+            lo = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    const MTHitTestEntry* closest = NULL;
+    CGFloat minDistance = CGFLOAT_MAX;
+    NSUInteger overCount = 0;
+    for (NSUInteger i = end; i > 0 && index->maxXThrough[i - 1] + kMTHitTestSlop >= translated.x; i--) {
+        const MTHitTestEntry* entry = &index->byX[i - 1];
+        if (entry->maxX + kMTHitTestSlop < translated.x) {
+            continue;
+        }
+        overCount++;
+        CGFloat distance = MTDistanceFromPointToRect(translated, self.subDisplays[entry->display].displayBounds);
+        if (distance < minDistance) {
+            closest = entry;
+            minDistance = distance;
+        }
+    }
+    if (overCount == 0) {
+        if (translated.x <= -kMTHitTestSlop) {
+            // All the way to the left.
+            return [MTMathListIndex level0Index:self.range.location];
+        } else if (translated.x >= self.width + kMTHitTestSlop) {
+            // All the way to the right.
+            return [MTMathListIndex level0Index:NSMaxRange(self.range)];
+        }
+        // In a gap between displays: take the closer of its neighbours.
+        for (NSUInteger i = (end > 0) ? end - 1 : 0; i < MIN(end + 1, index->count); i++) {
+            const MTHitTestEntry* entry = &index->byX[i];
+            CGFloat distance = MTDistanceFromPointToRect(translated, self.subDisplays[entry->display].displayBounds);
+            if (distance < minDistance) {
+                closest = entry;
+                minDistance = distance;
+            }
+        }
+    } else if (overCount == 1 && translated.x >= self.width - kMTHitTestSlop
+               && translated.y <= CGRectGetMinY(self.subDisplays[closest->display].displayBounds) - kMTHitTestSlop) {
+        // Below the last display at the end of the line: the caret goes at the end rather
+        // than into that display.
+        return [MTMathListIndex level0Index:NSMaxRange(self.range)];
+    }
+
+    MTDisplay* display = self.subDisplays[closest->display];
+    switch (closest->type) {
+        case kMTSubIndexTypeSubscript:
+        case kMTSubIndexTypeSuperscript: {
+            MTMathListIndex* scriptIndex = [display closestIndexToPoint:translated];
+            if (!scriptIndex) {
+                return nil;
+            }
+            return [MTMathListIndex indexAtLocation:closest->atoms.location withSubIndex:scriptIndex type:closest->type];
+        }
+
+        case kMTSubIndexTypeInner:
+            return MTIndexInChild((MTMathListDisplay*) display, kMTSubIndexTypeInner, closest->atoms, display.displayBounds, translated);
+
+        default: {
+            MTMathListIndex* atomIndex;
+            if ([display isKindOfClass:[MTMathListDisplay class]]) {
+                // A table.
+                atomIndex = MTIndexBeforeOrAfter(closest->atoms, display.displayBounds, translated);
+            } else {
+                atomIndex = [display closestIndexToPoint:translated];
+            }
+            if (display.hasScript && atomIndex.subIndexType == kMTSubIndexTypeNone
+                && atomIndex.atomIndex == NSMaxRange(display.range) && atomIndex.atomIndex > 0) {
+                // After the nucleus of the last atom but before its scripts, which follow it.
+                return [MTMathListIndex indexAtLocation:atomIndex.atomIndex - 1
+                                           withSubIndex:[MTMathListIndex level0Index:1]
+                                                   type:kMTSubIndexTypeNucleus];
+            }
+            return atomIndex;
+        }
+    }
+}
+
+- (CGRect)caretRectForIndex:(MTMathListIndex *)index
+{
+    NSParameterAssert(index);
+    const MTHitTestIndex* hitTestIndex = [self hitTestIndex];
+    CGRect rect = CGRectNull;
+    switch (index.subIndexType) {
+        case kMTSubIndexTypeNone:
+        case kMTSubIndexTypeNucleus: {
+            CGFloat x;
+            const MTHitTestEntry* entry = MTFindEntry(hitTestIndex, index.atomIndex, kMTSubIndexTypeNone);
+            if (index.subIndexType == kMTSubIndexTypeNucleus && entry) {
+                // Before or after the nucleus, i.e. before the scripts.
+                NSUInteger atom = index.atomIndex + MIN(index.subIndex.atomIndex, (NSUInteger) 1);
+                MTDisplay* display = self.subDisplays[entry->display];
+                x = (entry->type == kMTSubIndexTypeInner) ? display.position.x + ((atom > index.atomIndex) ? display.width : 0)
+                                                          : [display caretOffsetForIndex:[MTMathListIndex level0Index:atom]];
+            } else if (index.subIndexType == kMTSubIndexTypeNone && entry) {
+                MTDisplay* display = self.subDisplays[entry->display];
+                x = (entry->type == kMTSubIndexTypeInner) ? display.position.x : [display caretOffsetForIndex:index];
+            } else if (index.subIndexType == kMTSubIndexTypeNone && index.atomIndex <= NSMaxRange(self.range)) {
+                // An atom without a display (e.g. a space) or the end of the list: the caret
+                // is where the next display starts.
+                const MTHitTestEntry* next = MTFindEntryAfter(hitTestIndex, index.atomIndex);
+                x = next ? self.subDisplays[next->display].position.x : self.width;
+            } else {
+                return CGRectNull;
+            }
+            rect = CGRectMake(x, -self.descent, 0, self.ascent + self.descent);
+            break;
+        }
+
+        case kMTSubIndexTypeSubscript:
+        case kMTSubIndexTypeSuperscript: {
+            const MTHitTestEntry* entry = MTFindEntry(hitTestIndex, index.atomIndex, index.subIndexType);
+            if (entry) {
+                rect = MTCaretRectInChild((MTMathListDisplay*) self.subDisplays[entry->display], index);
+                break;
+            }
+            // The limits of a large operator are its scripts.
+            entry = MTFindEntry(hitTestIndex, index.atomIndex, kMTSubIndexTypeNone);
+            if (entry) {
+                rect = [self.subDisplays[entry->display] caretRectForChildIndex:index];
+            }
+            break;
+        }
+
+        default: {
+            const MTHitTestEntry* entry = MTFindEntry(hitTestIndex, index.atomIndex, kMTSubIndexTypeNone);
+            if (!entry) {
+                break;
+            }
+            MTDisplay* display = self.subDisplays[entry->display];
+            if (entry->type == kMTSubIndexTypeInner) {
+                rect = (index.subIndexType == kMTSubIndexTypeInner) ? MTCaretRectInChild((MTMathListDisplay*) display, index) : CGRectNull;
+            } else {
+                rect = [display caretRectForChildIndex:index];
+            }
+            break;
+        }
+    }
+    if (CGRectIsNull(rect)) {
+        return rect;
+    }
+    return CGRectOffset(rect, self.position.x, self.position.y);
+}
+
+
+#pragma mark Archiving
+
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver
+{
+    [archiver encodeUInteger:_subDisplays.count];
+    for (MTDisplay* display in _subDisplays) {
+        [archiver encodeDisplay:display];
+    }
+    [archiver encodeUInteger:_type];
+    // The index is usually NSNotFound, which the location of a range encodes.
+    [archiver encodeRange:NSMakeRange(_index, 0)];
+    // The child layouts are displays of the tree, written as references to them. The layout
+    // font is not written, so the incremental layout never adopts a decoded display.
+    [archiver encodeUInteger:_childLayouts.count];
+    [_childLayouts enumerateKeysAndObjectsUsingBlock:^(NSNumber* key, MTMathListDisplay* child, BOOL* stop) {
+        [archiver encodeUInteger:(NSUInteger) key.unsignedLongLongValue];
+        [archiver encodeReferenceToDisplay:child];
+    }];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+    NSUInteger count = [unarchiver decodeUInteger];
+    NSMutableArray<MTDisplay*>* displays = [NSMutableArray array];
+    for (NSUInteger i = 0; i < count && !unarchiver.failed; i++) {
+        MTDisplay* display = [unarchiver decodeDisplay];
+        if (display) {
+            [displays addObject:display];
+        } else {
+            [unarchiver fail];
+        }
+    }
+    MTLinePosition type = (MTLinePosition) [unarchiver decodeUInteger];
+    NSUInteger index = [unarchiver decodeRange].location;
+    NSUInteger childCount = [unarchiver decodeUInteger];
+    NSMutableDictionary<NSNumber*, MTMathListDisplay*>* childLayouts = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < childCount && !unarchiver.failed; i++) {
+        NSNumber* key = @((unsigned long long) [unarchiver decodeUInteger]);
+        MTDisplay* child = [unarchiver decodeReferencedDisplay];
+        if ([child isKindOfClass:MTMathListDisplay.class]) {
+            childLayouts[key] = (MTMathListDisplay*) child;
+        }
+    }
+    if (unarchiver.failed) {
+        return nil;
+    }
+    MTMathListDisplay* display = [[self alloc] initWithDisplays:displays range:NSMakeRange(0, 0)];
+    display->_type = type;
+    display->_index = index;
+    display.childLayouts = childLayouts.count ? childLayouts : nil;
+    return display;
+}
 
 @end
 
@@ -421,6 +1315,82 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     CGContextRestoreGState(context);
 }
 
+- (void)appendDrawCommands:(MTDrawCommandList *)commands origin:(CGPoint)origin
+{
+    [super appendDrawCommands:commands origin:origin];
+    [_numerator appendDrawCommands:commands origin:origin];
+    [_denominator appendDrawCommands:commands origin:origin];
+    CGPoint line[2] = {
+        MTOffsetPoint(CGPointMake(self.position.x, self.position.y + self.linePosition), origin),
+        MTOffsetPoint(CGPointMake(self.position.x + self.width, self.position.y + self.linePosition), origin),
+    };
+    [commands addStrokeWithPoints:line count:2 lineWidth:self.lineThickness lineCap:kCGLineCapButt color:self.textColor.CGColor display:self];
+}
+
+- (MTMathListIndex *)closestIndexToPoint:(CGPoint)point
+{
+    CGRect bounds = [self displayBounds];
+    if (point.x < CGRectGetMinX(bounds) - kMTHitTestSlop || point.x > CGRectGetMaxX(bounds) + kMTHitTestSlop) {
+        return MTIndexBeforeOrAfter(self.range, bounds, point);
+    }
+    // Above the fraction bar is the numerator, below it the denominator.
+    CGFloat barY = self.position.y + self.linePosition;
+    if (point.y > barY + kMTHitTestSlop) {
+        return MTIndexInChild(_numerator, kMTSubIndexTypeNumerator, self.range, bounds, point);
+    } else if (point.y < barY - kMTHitTestSlop) {
+        return MTIndexInChild(_denominator, kMTSubIndexTypeDenominator, self.range, bounds, point);
+    }
+    return MTIndexBeforeOrAfter(self.range, bounds, point);
+}
+
+- (CGRect)caretRectForChildIndex:(MTMathListIndex *)index
+{
+    switch (index.subIndexType) {
+        case kMTSubIndexTypeNumerator:
+            return MTCaretRectInChild(_numerator, index);
+        case kMTSubIndexTypeDenominator:
+            return MTCaretRectInChild(_denominator, index);
+        default:
+            return CGRectNull;
+    }
+}
+
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver
+{
+    [archiver encodeDisplay:_numerator];
+    [archiver encodeDisplay:_denominator];
+    [archiver encodeFloat:_numeratorUp];
+    [archiver encodeFloat:_denominatorDown];
+    [archiver encodeFloat:_linePosition];
+    [archiver encodeFloat:_lineThickness];
+    [archiver encodeUInteger:_numeratorAlignment];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+    MTMathListDisplay* numerator = MTDecodeDisplayOfClass(unarchiver, MTMathListDisplay.class, YES);
+    MTMathListDisplay* denominator = MTDecodeDisplayOfClass(unarchiver, MTMathListDisplay.class, YES);
+    CGFloat numeratorUp = [unarchiver decodeFloat];
+    CGFloat denominatorDown = [unarchiver decodeFloat];
+    CGFloat linePosition = [unarchiver decodeFloat];
+    CGFloat lineThickness = [unarchiver decodeFloat];
+    MTFractionAlignment alignment = (MTFractionAlignment) [unarchiver decodeUInteger];
+    if (unarchiver.failed) {
+        return nil;
+    }
+    CGPoint numeratorPosition = numerator.position;
+    CGPoint denominatorPosition = denominator.position;
+    MTFractionDisplay* display = [[self alloc] initWithNumerator:numerator denominator:denominator position:CGPointZero range:NSMakeRange(0, 1)];
+    display->_numeratorUp = numeratorUp;
+    display->_denominatorDown = denominatorDown;
+    display->_linePosition = linePosition;
+    display->_lineThickness = lineThickness;
+    display->_numeratorAlignment = alignment;
+    numerator.position = numeratorPosition;
+    denominator.position = denominatorPosition;
+    return display;
+}
+
 @end
 
 #pragma mark - MTRadicalDisplay
@@ -544,6 +1514,82 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     CGContextRestoreGState(context);
 }
 
+- (void)appendDrawCommands:(MTDrawCommandList *)commands origin:(CGPoint)origin
+{
+    [super appendDrawCommands:commands origin:origin];
+    [self.radicand appendDrawCommands:commands origin:origin];
+    [self.degree appendDrawCommands:commands origin:origin];
+
+    CGPoint signOrigin = MTOffsetPoint(CGPointMake(self.position.x + _radicalShift, self.position.y), origin);
+    NSUInteger glyphStart = commands.count;
+    [_radicalGlyph appendDrawCommands:commands origin:signOrigin];
+    // -draw: sets the fill color around the glyph, which has no color of its own.
+    [commands setFillColor:self.textColor.CGColor forCommandsFromIndex:glyphStart];
+    CGPoint lineStart = CGPointMake(_radicalGlyph.width, self.ascent - _topKern - self.lineThickness / 2);
+    CGPoint line[2] = {
+        MTOffsetPoint(lineStart, signOrigin),
+        MTOffsetPoint(CGPointMake(lineStart.x + self.radicand.width, lineStart.y), signOrigin),
+    };
+    [commands addStrokeWithPoints:line count:2 lineWidth:_lineThickness lineCap:kCGLineCapRound color:self.textColor.CGColor display:self];
+}
+
+- (MTMathListIndex *)closestIndexToPoint:(CGPoint)point
+{
+    CGRect bounds = [self displayBounds];
+    if (point.x < CGRectGetMinX(bounds) - kMTHitTestSlop || point.x > CGRectGetMaxX(bounds) + kMTHitTestSlop) {
+        return MTIndexBeforeOrAfter(self.range, bounds, point);
+    }
+    // The degree sits above the left part of the radical sign.
+    if (self.degree && point.x <= CGRectGetMaxX(self.degree.displayBounds) + kMTHitTestSlop
+        && point.y >= CGRectGetMinY(self.degree.displayBounds) - kMTHitTestSlop) {
+        return MTIndexInChild(self.degree, kMTSubIndexTypeDegree, self.range, bounds, point);
+    }
+    return MTIndexInChild(self.radicand, kMTSubIndexTypeRadicand, self.range, bounds, point);
+}
+
+- (CGRect)caretRectForChildIndex:(MTMathListIndex *)index
+{
+    switch (index.subIndexType) {
+        case kMTSubIndexTypeRadicand:
+            return MTCaretRectInChild(self.radicand, index);
+        case kMTSubIndexTypeDegree:
+            return MTCaretRectInChild(self.degree, index);
+        default:
+            return CGRectNull;
+    }
+}
+
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver
+{
+    [archiver encodeDisplay:_radicand];
+    [archiver encodeDisplay:_radicalGlyph];
+    [archiver encodeDisplay:_degree];
+    [archiver encodeFloat:_radicalShift];
+    [archiver encodeFloat:_topKern];
+    [archiver encodeFloat:_lineThickness];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+    MTMathListDisplay* radicand = MTDecodeDisplayOfClass(unarchiver, MTMathListDisplay.class, YES);
+    MTDisplay* glyph = MTDecodeDisplayOfClass(unarchiver, MTDisplay.class, YES);
+    MTMathListDisplay* degree = MTDecodeDisplayOfClass(unarchiver, MTMathListDisplay.class, NO);
+    CGFloat radicalShift = [unarchiver decodeFloat];
+    CGFloat topKern = [unarchiver decodeFloat];
+    CGFloat lineThickness = [unarchiver decodeFloat];
+    if (unarchiver.failed) {
+        return nil;
+    }
+    CGPoint radicandPosition = radicand.position;
+    MTRadicalDisplay* display = [[self alloc] initWitRadicand:radicand glpyh:glyph position:CGPointZero range:NSMakeRange(0, 1)];
+    display->_degree = degree;
+    display->_radicalShift = radicalShift;
+    display->_topKern = topKern;
+    display->_lineThickness = lineThickness;
+    radicand.position = radicandPosition;
+    return display;
+}
+
 @end
 
 #pragma mark - MTGlyphDisplay
@@ -587,6 +1633,13 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     CGContextRestoreGState(context);
 }
 
+- (void)appendDrawCommands:(MTDrawCommandList *)commands origin:(CGPoint)origin
+{
+    [super appendDrawCommands:commands origin:origin];
+    CGPoint glyphOrigin = MTOffsetPoint(CGPointMake(self.position.x, self.position.y - self.shiftDown), origin);
+    [commands addGlyphs:&_glyph positions:NULL count:1 offset:glyphOrigin font:_font.ctFont color:self.textColor.CGColor display:self];
+}
+
 - (CGFloat)ascent
 {
     return super.ascent - self.shiftDown;
@@ -597,6 +1650,26 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     return super.descent + self.shiftDown;
 }
 
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver
+{
+    [archiver encodeUInteger:_glyph];
+    [archiver encodeFont:_font];
+    [archiver encodeFloat:self.shiftDown];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+    CGGlyph glyph = (CGGlyph) [unarchiver decodeUInteger];
+    MTFont* font = [unarchiver decodeFont];
+    CGFloat shiftDown = [unarchiver decodeFloat];
+    if (unarchiver.failed || !font) {
+        return nil;
+    }
+    MTGlyphDisplay* display = [[self alloc] initWithGlpyh:glyph range:NSMakeRange(0, 0) font:font];
+    display.shiftDown = shiftDown;
+    return display;
+}
+
 @end
 
 #pragma mark - MTGlyphConstructionDisplay
@@ -610,18 +1683,13 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
 
 @synthesize shiftDown;
 
-- (instancetype)initWithGlyphs:(NSArray<NSNumber *> *)glyphs offsets:(NSArray<NSNumber *> *)offsets font:(MTFont *)font
+- (instancetype)initWithGlyphs:(CGGlyph *)glyphs positions:(CGPoint *)positions count:(NSUInteger)count font:(MTFont *)font
 {
     self = [super init];
     if (self) {
-        NSAssert(glyphs.count == offsets.count, @"Glyphs and offsets need to match");
-        _numGlyphs = glyphs.count;
-        _glyphs = malloc(sizeof(CGGlyph) * _numGlyphs);
-        _positions = malloc(sizeof(CGPoint) * _numGlyphs);
-        for (int i = 0; i < _numGlyphs; i++) {
-            _glyphs[i] = glyphs[i].shortValue;
-            _positions[i] = CGPointMake(0, offsets[i].floatValue);
-        }
+        _numGlyphs = count;
+        _glyphs = glyphs;
+        _positions = positions;
         _font = font;
         self.position = CGPointZero;
         // x-offsets are 0 for vertical stacking, so ink max-x is the widest glyph bbox.
@@ -647,6 +1715,13 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     CGContextRestoreGState(context);
 }
 
+- (void)appendDrawCommands:(MTDrawCommandList *)commands origin:(CGPoint)origin
+{
+    [super appendDrawCommands:commands origin:origin];
+    CGPoint glyphOrigin = MTOffsetPoint(CGPointMake(self.position.x, self.position.y - self.shiftDown), origin);
+    [commands addGlyphs:_glyphs positions:_positions count:_numGlyphs offset:glyphOrigin font:_font.ctFont color:self.textColor.CGColor display:self];
+}
+
 - (CGFloat)ascent
 {
     return super.ascent - self.shiftDown;
@@ -663,6 +1738,36 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     free(_positions);
 }
 
+- (void) addStorageToRetainedSize:(MTRetainedSizeCounter*) counter
+{
+    [counter addMallocBlock:_glyphs];
+    [counter addMallocBlock:_positions];
+}
+
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver
+{
+    [archiver encodeGlyphs:_glyphs positions:_positions count:_numGlyphs];
+    [archiver encodeFont:_font];
+    [archiver encodeFloat:self.shiftDown];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+    CGGlyph* glyphs;
+    CGPoint* positions;
+    NSUInteger count = [unarchiver decodeGlyphs:&glyphs positions:&positions];
+    MTFont* font = [unarchiver decodeFont];
+    CGFloat shiftDown = [unarchiver decodeFloat];
+    if (unarchiver.failed || !font) {
+        free(glyphs);
+        free(positions);
+        return nil;
+    }
+    MTGlyphConstructionDisplay* display = [[self alloc] initWithGlyphs:glyphs positions:positions count:count font:font];
+    display.shiftDown = shiftDown;
+    return display;
+}
+
 @end
 
 #pragma mark - MTLargeOpLimitsDisplay
@@ -781,6 +1886,14 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     [_nucleus draw:context];
 }
 
+- (void)appendDrawCommands:(MTDrawCommandList *)commands origin:(CGPoint)origin
+{
+    [super appendDrawCommands:commands origin:origin];
+    [self.upperLimit appendDrawCommands:commands origin:origin];
+    [self.lowerLimit appendDrawCommands:commands origin:origin];
+    [_nucleus appendDrawCommands:commands origin:origin];
+}
+
 - (CGFloat)inkWidth
 {
     // Nucleus and limits hold absolute positions (updateNucleus/Upper/LowerLimitPosition,
@@ -796,6 +1909,63 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     return result;
 }
 
+- (MTMathListIndex *)closestIndexToPoint:(CGPoint)point
+{
+    CGRect bounds = [self displayBounds];
+    if (point.x < CGRectGetMinX(bounds) - kMTHitTestSlop || point.x > CGRectGetMaxX(bounds) + kMTHitTestSlop) {
+        return MTIndexBeforeOrAfter(self.range, bounds, point);
+    }
+    // The limits are the scripts of the operator.
+    if (self.upperLimit && point.y > self.position.y + _nucleus.ascent + kMTHitTestSlop) {
+        return MTIndexInChild(self.upperLimit, kMTSubIndexTypeSuperscript, self.range, bounds, point);
+    } else if (self.lowerLimit && point.y < self.position.y - _nucleus.descent - kMTHitTestSlop) {
+        return MTIndexInChild(self.lowerLimit, kMTSubIndexTypeSubscript, self.range, bounds, point);
+    }
+    return MTIndexBeforeOrAfter(self.range, bounds, point);
+}
+
+- (CGRect)caretRectForChildIndex:(MTMathListIndex *)index
+{
+    switch (index.subIndexType) {
+        case kMTSubIndexTypeSuperscript:
+            return MTCaretRectInChild(self.upperLimit, index);
+        case kMTSubIndexTypeSubscript:
+            return MTCaretRectInChild(self.lowerLimit, index);
+        default:
+            return CGRectNull;
+    }
+}
+
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver
+{
+    [archiver encodeDisplay:_nucleus];
+    [archiver encodeDisplay:_upperLimit];
+    [archiver encodeDisplay:_lowerLimit];
+    [archiver encodeFloat:_limitShift];
+    [archiver encodeFloat:_extraPadding];
+    [archiver encodeFloat:_upperLimitGap];
+    [archiver encodeFloat:_lowerLimitGap];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+    MTDisplay* nucleus = MTDecodeDisplayOfClass(unarchiver, MTDisplay.class, YES);
+    MTMathListDisplay* upperLimit = MTDecodeDisplayOfClass(unarchiver, MTMathListDisplay.class, NO);
+    MTMathListDisplay* lowerLimit = MTDecodeDisplayOfClass(unarchiver, MTMathListDisplay.class, NO);
+    CGFloat limitShift = [unarchiver decodeFloat];
+    CGFloat extraPadding = [unarchiver decodeFloat];
+    CGFloat upperLimitGap = [unarchiver decodeFloat];
+    CGFloat lowerLimitGap = [unarchiver decodeFloat];
+    if (unarchiver.failed) {
+        return nil;
+    }
+    MTLargeOpLimitsDisplay* display = [[self alloc] initWithNucleus:nucleus upperLimit:upperLimit lowerLimit:lowerLimit
+                                                         limitShift:limitShift extraPadding:extraPadding];
+    display->_upperLimitGap = upperLimitGap;
+    display->_lowerLimitGap = lowerLimitGap;
+    return display;
+}
+
 @end
 
 #pragma mark - MTLineDisplay
@@ -841,6 +2011,18 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     CGContextRestoreGState(context);
 }
 
+- (void)appendDrawCommands:(MTDrawCommandList *)commands origin:(CGPoint)origin
+{
+    [super appendDrawCommands:commands origin:origin];
+    [self.inner appendDrawCommands:commands origin:origin];
+    CGPoint lineStart = CGPointMake(self.position.x, self.position.y + self.lineShiftUp);
+    CGPoint line[2] = {
+        MTOffsetPoint(lineStart, origin),
+        MTOffsetPoint(CGPointMake(lineStart.x + self.inner.width, lineStart.y), origin),
+    };
+    [commands addStrokeWithPoints:line count:2 lineWidth:self.lineThickness lineCap:kCGLineCapButt color:self.textColor.CGColor display:self];
+}
+
 - (void) setPosition:(CGPoint)position
 {
     super.position = position;
@@ -858,6 +2040,39 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     return MAX(self.width, (_inner.position.x - self.position.x) + _inner.inkWidth);
 }
 
+- (MTMathListIndex *)closestIndexToPoint:(CGPoint)point
+{
+    return MTIndexInChild(self.inner, kMTSubIndexTypeInner, self.range, [self displayBounds], point);
+}
+
+- (CGRect)caretRectForChildIndex:(MTMathListIndex *)index
+{
+    return (index.subIndexType == kMTSubIndexTypeInner) ? MTCaretRectInChild(self.inner, index) : CGRectNull;
+}
+
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver
+{
+    [archiver encodeDisplay:_inner];
+    [archiver encodeFloat:_lineShiftUp];
+    [archiver encodeFloat:_lineThickness];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+    MTMathListDisplay* inner = MTDecodeDisplayOfClass(unarchiver, MTMathListDisplay.class, YES);
+    CGFloat lineShiftUp = [unarchiver decodeFloat];
+    CGFloat lineThickness = [unarchiver decodeFloat];
+    if (unarchiver.failed) {
+        return nil;
+    }
+    CGPoint innerPosition = inner.position;
+    MTLineDisplay* display = [[self alloc] initWithInner:inner position:CGPointZero range:NSMakeRange(0, 1)];
+    display->_lineShiftUp = lineShiftUp;
+    display->_lineThickness = lineThickness;
+    inner.position = innerPosition;
+    return display;
+}
+
 @end
 
 #pragma mark - MTRuleDisplay
@@ -917,6 +2132,37 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     CGContextRestoreGState(context);
 }
 
+- (void)appendDrawCommands:(MTDrawCommandList *)commands origin:(CGPoint)origin
+{
+    [super appendDrawCommands:commands origin:origin];
+    CGPoint begin = _vertical
+        ? CGPointMake(self.position.x + _thickness / 2, self.position.y)
+        : CGPointMake(self.position.x, self.position.y + _thickness / 2);
+    CGPoint end = _vertical
+        ? CGPointMake(begin.x, begin.y + _length)
+        : CGPointMake(begin.x + _length, begin.y);
+    CGPoint line[2] = { MTOffsetPoint(begin, origin), MTOffsetPoint(end, origin) };
+    [commands addStrokeWithPoints:line count:2 lineWidth:_thickness lineCap:kCGLineCapButt color:self.textColor.CGColor display:self];
+}
+
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver
+{
+    [archiver encodeFloat:_length];
+    [archiver encodeFloat:_thickness];
+    [archiver encodeBool:_vertical];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+    CGFloat length = [unarchiver decodeFloat];
+    CGFloat thickness = [unarchiver decodeFloat];
+    BOOL vertical = [unarchiver decodeBool];
+    if (unarchiver.failed) {
+        return nil;
+    }
+    return [[self alloc] initWithStart:CGPointZero length:length thickness:thickness vertical:vertical range:NSMakeRange(0, 0)];
+}
+
 @end
 
 #pragma mark - MTAccentDisplay
@@ -978,6 +2224,44 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     
     CGContextRestoreGState(context);
 }
+
+- (void)appendDrawCommands:(MTDrawCommandList *)commands origin:(CGPoint)origin
+{
+    [super appendDrawCommands:commands origin:origin];
+    [self.accentee appendDrawCommands:commands origin:origin];
+    // The position of the accent is relative to this display.
+    [self.accent appendDrawCommands:commands origin:MTOffsetPoint(self.position, origin)];
+}
+
+- (MTMathListIndex *)closestIndexToPoint:(CGPoint)point
+{
+    return MTIndexInChild(self.accentee, kMTSubIndexTypeInner, self.range, [self displayBounds], point);
+}
+
+- (CGRect)caretRectForChildIndex:(MTMathListIndex *)index
+{
+    return (index.subIndexType == kMTSubIndexTypeInner) ? MTCaretRectInChild(self.accentee, index) : CGRectNull;
+}
+
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver
+{
+    [archiver encodeDisplay:_accent];
+    [archiver encodeDisplay:_accentee];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+    MTGlyphDisplay* accent = MTDecodeDisplayOfClass(unarchiver, MTGlyphDisplay.class, YES);
+    MTMathListDisplay* accentee = MTDecodeDisplayOfClass(unarchiver, MTMathListDisplay.class, YES);
+    if (unarchiver.failed) {
+        return nil;
+    }
+    CGPoint accenteePosition = accentee.position;
+    MTAccentDisplay* display = [[self alloc] initWithAccent:accent accentee:accentee range:NSMakeRange(0, 1)];
+    accentee.position = accenteePosition;
+    return display;
+}
+
 @end
 
 #pragma mark - MTStackDisplay
@@ -1039,6 +2323,42 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     [_under draw:context];
 }
 
+- (void)appendDrawCommands:(MTDrawCommandList *)commands origin:(CGPoint)origin
+{
+    [super appendDrawCommands:commands origin:origin];
+    [_base appendDrawCommands:commands origin:origin];
+    [_over appendDrawCommands:commands origin:origin];
+    [_under appendDrawCommands:commands origin:origin];
+}
+
+- (MTMathListIndex *)closestIndexToPoint:(CGPoint)point
+{
+    return MTIndexInChild(_base, kMTSubIndexTypeInner, self.range, [self displayBounds], point);
+}
+
+- (CGRect)caretRectForChildIndex:(MTMathListIndex *)index
+{
+    return (index.subIndexType == kMTSubIndexTypeInner) ? MTCaretRectInChild(_base, index) : CGRectNull;
+}
+
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver
+{
+    [archiver encodeDisplay:_base];
+    [archiver encodeDisplay:_over];
+    [archiver encodeDisplay:_under];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+    MTMathListDisplay* base = MTDecodeDisplayOfClass(unarchiver, MTMathListDisplay.class, YES);
+    MTDisplay* over = MTDecodeDisplayOfClass(unarchiver, MTDisplay.class, NO);
+    MTDisplay* under = MTDecodeDisplayOfClass(unarchiver, MTDisplay.class, NO);
+    if (unarchiver.failed) {
+        return nil;
+    }
+    return [[self alloc] initWithBase:base over:over under:under range:NSMakeRange(0, 1)];
+}
+
 @end
 
 #pragma mark - MTHorizontalGlyphAssemblyDisplay
@@ -1050,23 +2370,17 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     NSInteger _numGlyphs;
 }
 
-- (instancetype)initWithGlyphs:(NSArray<NSNumber*>*)glyphs
-                     positions:(NSArray<NSValue*>*)positions
+- (instancetype)initWithGlyphs:(CGGlyph*)glyphs
+                     positions:(CGPoint*)positions
+                         count:(NSUInteger)count
                           font:(MTFont*)font
                          range:(NSRange)range
 {
     self = [super init];
     if (self) {
-        NSAssert(glyphs.count == positions.count, @"Glyphs and positions need to match");
-        _numGlyphs = glyphs.count;
-        _glyphs = malloc(sizeof(CGGlyph) * _numGlyphs);
-        _positions = malloc(sizeof(CGPoint) * _numGlyphs);
-        for (int i = 0; i < _numGlyphs; i++) {
-            _glyphs[i] = glyphs[i].shortValue;
-            CGPoint pt;
-            [positions[i] getValue:&pt];
-            _positions[i] = pt;
-        }
+        _numGlyphs = count;
+        _glyphs = glyphs;
+        _positions = positions;
         _font = font;
         self.range = range;
         self.position = CGPointZero;
@@ -1090,12 +2404,45 @@ static CGFloat MTInkMaxXForGlyphRun(const CGGlyph* glyphs, const CGPoint* positi
     CGContextRestoreGState(context);
 }
 
+- (void)appendDrawCommands:(MTDrawCommandList *)commands origin:(CGPoint)origin
+{
+    [super appendDrawCommands:commands origin:origin];
+    [commands addGlyphs:_glyphs positions:_positions count:_numGlyphs offset:MTOffsetPoint(self.position, origin)
+                   font:_font.ctFont color:self.textColor.CGColor display:self];
+}
+
 - (void)dealloc
 {
     free(_glyphs);
     free(_positions);
 }
 
+- (void) addStorageToRetainedSize:(MTRetainedSizeCounter*) counter
+{
+    [counter addMallocBlock:_glyphs];
+    [counter addMallocBlock:_positions];
+}
+
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver
+{
+    [archiver encodeGlyphs:_glyphs positions:_positions count:_numGlyphs];
+    [archiver encodeFont:_font];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+    CGGlyph* glyphs;
+    CGPoint* positions;
+    NSUInteger count = [unarchiver decodeGlyphs:&glyphs positions:&positions];
+    MTFont* font = [unarchiver decodeFont];
+    if (unarchiver.failed || !font) {
+        free(glyphs);
+        free(positions);
+        return nil;
+    }
+    return [[self alloc] initWithGlyphs:glyphs positions:positions count:count font:font range:NSMakeRange(0, 0)];
+}
+
 @end
 
 #pragma mark - MTMathBoxDisplay
@@ -1230,6 +2577,65 @@ static CGPoint MTBoxPointFromValue(NSValue* v) {
     CGContextRestoreGState(context);
 }
 
+- (void)appendDrawCommands:(MTDrawCommandList *)commands origin:(CGPoint)origin
+{
+    [super appendDrawCommands:commands origin:origin];
+    if (!self.drawChild) {
+        return;
+    }
+    [self.child appendDrawCommands:commands origin:origin];
+    NSArray<NSValue*>* points = [self strikeSegmentPoints];
+    if (points.count == 0) {
+        return;
+    }
+    // At most two segments (\xcancel), stroked as one path like -draw:.
+    CGPoint segments[4];
+    NSUInteger count = MIN(points.count, (NSUInteger) 4);
+    for (NSUInteger i = 0; i < count; i++) {
+        segments[i] = MTOffsetPoint(MTBoxPointFromValue(points[i]), origin);
+    }
+    [commands addStrokeWithPoints:segments count:count lineWidth:self.strikeThickness lineCap:kCGLineCapButt color:self.textColor.CGColor display:self];
+}
+
+- (MTMathListIndex *)closestIndexToPoint:(CGPoint)point
+{
+    return MTIndexInChild(self.child, kMTSubIndexTypeInner, self.range, [self displayBounds], point);
+}
+
+- (CGRect)caretRectForChildIndex:(MTMathListIndex *)index
+{
+    return (index.subIndexType == kMTSubIndexTypeInner) ? MTCaretRectInChild(self.child, index) : CGRectNull;
+}
+
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver
+{
+    [archiver encodeDisplay:_child];
+    [archiver encodeBool:_drawChild];
+    [archiver encodeBool:_keepWidth];
+    [archiver encodeUInteger:_hAlign];
+    [archiver encodeUInteger:_strikeStyle];
+    [archiver encodeFloat:_strikeThickness];
+    [archiver encodeFloat:_strikeVerticalOffset];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+    MTMathListDisplay* child = MTDecodeDisplayOfClass(unarchiver, MTMathListDisplay.class, YES);
+    BOOL drawChild = [unarchiver decodeBool];
+    BOOL keepWidth = [unarchiver decodeBool];
+    MTBoxHAlign hAlign = (MTBoxHAlign) [unarchiver decodeUInteger];
+    MTStrikeStyle strikeStyle = (MTStrikeStyle) [unarchiver decodeUInteger];
+    CGFloat strikeThickness = [unarchiver decodeFloat];
+    CGFloat strikeVerticalOffset = [unarchiver decodeFloat];
+    if (unarchiver.failed) {
+        return nil;
+    }
+    // The height and depth only set the metrics, which are restored as they were.
+    return [[self alloc] initWithChild:child keepWidth:keepWidth keepHeight:NO keepDepth:NO drawChild:drawChild
+                                hAlign:hAlign strikeStyle:strikeStyle strikeThickness:strikeThickness
+                  strikeVerticalOffset:strikeVerticalOffset range:NSMakeRange(0, 1)];
+}
+
 @end
 
 #pragma mark - MTInnerDisplay
@@ -1355,4 +2761,43 @@ static CGPoint MTBoxPointFromValue(NSValue* v) {
   [_inner draw:context];
 }
 
+- (void)appendDrawCommands:(MTDrawCommandList *)commands origin:(CGPoint)origin
+{
+  [super appendDrawCommands:commands origin:origin];
+  [self.leftDelimiter appendDrawCommands:commands origin:origin];
+  [self.rightDelimiter appendDrawCommands:commands origin:origin];
+  [_inner appendDrawCommands:commands origin:origin];
+}
+
+- (MTMathListIndex *)closestIndexToPoint:(CGPoint)point
+{
+  // A point on a delimiter is before or after the whole inner.
+  return MTIndexInChild(_inner, kMTSubIndexTypeInner, self.range, [self displayBounds], point);
+}
+
+- (CGRect)caretRectForChildIndex:(MTMathListIndex *)index
+{
+  return (index.subIndexType == kMTSubIndexTypeInner) ? MTCaretRectInChild(_inner, index) : CGRectNull;
+}
+
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver
+{
+  [archiver encodeDisplay:_inner];
+  [archiver encodeDisplay:_leftDelimiter];
+  [archiver encodeDisplay:_rightDelimiter];
+  [archiver encodeUInteger:_index];
+}
+
++ (instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver
+{
+  MTMathListDisplay* inner = MTDecodeDisplayOfClass(unarchiver, MTMathListDisplay.class, YES);
+  MTDisplay* leftDelimiter = MTDecodeDisplayOfClass(unarchiver, MTDisplay.class, NO);
+  MTDisplay* rightDelimiter = MTDecodeDisplayOfClass(unarchiver, MTDisplay.class, NO);
+  NSUInteger index = [unarchiver decodeUInteger];
+  if (unarchiver.failed) {
+    return nil;
+  }
+  return [[self alloc] initWithInner:inner leftDelimiter:leftDelimiter rightDelimiter:rightDelimiter atIndex:index];
+}
+
 @end
@@ -17,6 +17,7 @@
 #import "MTFont.h"
 #import "lib/MTMathList.h"
 #import "MTMathListDisplay.h"
+#import "MTRasterCache.h"
 
 /**
  @typedef MTMathUILabelMode
@@ -103,7 +104,46 @@ IB_DESIGNABLE @interface MTMathUILabel : MTView
 /** Horizontal alignment for the text. The default is align left. */
 @property (nonatomic) MTTextAlignment textAlignment;
 
-/** The internal display of the MTMathUILabel. This is for advanced use only. */
+/** If true, the math is typeset once at a reference size and the font size is applied as
+ a transform when measuring and drawing, so changing `fontSize` (e.g. while pinch-zooming
+ or for Dynamic Type) does not typeset the formula again. The layout is kept until the
+ math list, the label mode or the font face changes; set `mathList` again after mutating it
+ in place. Large `\left`/`\right` delimiters may be one size different from a regular
+ layout, and `\text{}` is shaped at the reference size, so its width may differ slightly from a
+ regular layout, see `+[MTTypesetter createScalableLineForMathList:font:style:]`. Default false. */
+@property (nonatomic) BOOL scalesLayout;
+
+/** If true, the origin of the rendered math is rounded to the nearest device pixel. Default false. */
+@property (nonatomic) BOOL snapsToPixels;
+
+/** If true, parsing `latex` and typesetting run on a background queue instead of on the
+ main thread, and the finished display is installed on the main thread. Until then the label
+ draws nothing, `mathList` and `error` are nil for a `latex` that is still being parsed, and
+ `sizeThatFits:` and `intrinsicContentSize` return `placeholderSize`. Changing the content,
+ the font, the mode or `scalesLayout` drops the layout in flight, so a reused cell never shows
+ a stale formula. A `mathList` set on the label is copied for the background layout. Default false. */
+@property (nonatomic) BOOL layoutsAsynchronously;
+
+/** The size reported while an asynchronous layout is pending. Default `CGSizeZero`. */
+@property (nonatomic) CGSize placeholderSize;
+
+/** If set, the label draws a bitmap of the formula from this cache instead of drawing its
+ glyphs, rendering it into the cache on a miss. Labels showing the same formula with the same
+ font, mode and color at the same screen scale share the bitmap, which suits static content
+ such as chat history. With `layoutsAsynchronously` the bitmap is rendered on the background
+ queue as well. Set `snapsToPixels` too so the bitmaps are drawn without resampling. Ignored
+ when `scalesLayout` is set. Default nil. */
+@property (nonatomic, nullable) MTRasterCache* rasterCache;
+
+/** If false, the displays of the label do not keep the atoms they display (see
+ `-[MTCTLineDisplay atoms]`), so the laid out formula does not keep its finalized math list
+ alive. This saves memory when many labels are kept, e.g. in a long list. Hit testing works
+ either way. Default true. */
+@property (nonatomic) BOOL retainsAtoms;
+
+/** The internal display of the MTMathUILabel. This is for advanced use only. When
+ `scalesLayout` is set, it is laid out at `MTTypesetterReferenceFontSize` and drawn scaled.
+ The label draws a compiled copy of it, so call `setNeedsLayout` after modifying it. */
 @property (nonatomic, readonly, nullable) MTMathListDisplay* displayList;
 
 @end
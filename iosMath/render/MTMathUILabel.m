@@ -17,14 +17,46 @@
 #import "MTFontManager.h"
 #import "MTMathListBuilder.h"
 #import "MTTypesetter.h"
+#import "MTDrawCommandList.h"
 
 static CGFloat ceilToPixel(CGFloat value, CGFloat scale) {
     if (scale <= 0) { scale = 1; }
     return ceil(value * scale) / scale;
 }
 
+static CGFloat roundToPixel(CGFloat value, CGFloat scale) {
+    if (scale <= 0) { scale = 1; }
+    return round(value * scale) / scale;
+}
+
+// Identifies one asynchronous layout of a label. It is cancelled when the content it was
+// started for changes: the background work checks it between steps, and the result is only
+// installed if it is still the current token of the label.
+@interface MTLabelLayoutToken : NSObject
+@property (atomic, getter=isCancelled) BOOL cancelled;
+// Set on the main thread once the result is installed.
+@property (nonatomic, getter=isFinished) BOOL finished;
+@end
+
+@implementation MTLabelLayoutToken
+@end
+
 @implementation MTMathUILabel {
     MTLabel* _errorLabel;
+    // The layout at the reference size when scalesLayout is set. It depends only on the
+    // math list, the label mode and the font face, so it survives font size changes.
+    MTMathListDisplay* _scalableDisplayList;
+    // Where the display is drawn, and the scale it is drawn at, as of the last layout.
+    CGPoint _displayOrigin;
+    CGFloat _displayScale;
+    // displayList compiled for drawing. Built on the first draw after a layout.
+    MTDrawCommandList* _drawCommands;
+    // The asynchronous layout of the current content, in flight or finished. The finished
+    // display is kept in _scalableDisplayList when scalesLayout is set.
+    MTLabelLayoutToken* _layoutToken;
+    MTMathListDisplay* _asyncDisplayList;
+    // The latex was set asynchronously and _mathList is only known once it is parsed.
+    BOOL _latexNeedsParsing;
 }
 
 - (instancetype)initWithFrame:(CGRect)frame
@@ -56,7 +88,9 @@ static CGFloat ceilToPixel(CGFloat value, CGFloat scale) {
     self.font = font;
     _textAlignment = kMTTextAlignmentLeft;
     _displayList = nil;
+    _displayScale = 1;
     _displayErrorInline = true;
+    _retainsAtoms = YES;
     self.backgroundColor = [MTColor clearColor];
     
     _textColor = [MTColor blackColor];
@@ -88,6 +122,8 @@ static CGFloat ceilToPixel(CGFloat value, CGFloat scale) {
 {
     NSParameterAssert(font);
     _font = font;
+    _scalableDisplayList = nil;
+    [self cancelAsynchronousLayout];
     [self invalidateIntrinsicContentSize];
     [self setNeedsLayout];
 }
@@ -96,7 +132,55 @@ static CGFloat ceilToPixel(CGFloat value, CGFloat scale) {
 {
     _fontSize = fontSize;
     MTFont* font = [_font copyFontWithSize:_fontSize];
-    self.font = font;
+    if (_scalesLayout) {
+        // Only the size changes, which a scalable layout (finished or in flight) does not depend on.
+        _font = font;
+        [self invalidateIntrinsicContentSize];
+        [self setNeedsLayout];
+    } else {
+        self.font = font;
+    }
+}
+
+- (void)setScalesLayout:(BOOL)scalesLayout
+{
+    _scalesLayout = scalesLayout;
+    _scalableDisplayList = nil;
+    [self cancelAsynchronousLayout];
+    [self invalidateIntrinsicContentSize];
+    [self setNeedsLayout];
+}
+
+- (void)setRetainsAtoms:(BOOL)retainsAtoms
+{
+    _retainsAtoms = retainsAtoms;
+    _scalableDisplayList = nil;
+    [self cancelAsynchronousLayout];
+    [self setNeedsLayout];
+}
+
+- (void)setLayoutsAsynchronously:(BOOL)layoutsAsynchronously
+{
+    _layoutsAsynchronously = layoutsAsynchronously;
+    [self cancelAsynchronousLayout];
+    if (!layoutsAsynchronously && _latexNeedsParsing) {
+        // The latex was left to the background, parse it now.
+        self.latex = _latex;
+    }
+    [self invalidateIntrinsicContentSize];
+    [self setNeedsLayout];
+}
+
+- (void)setPlaceholderSize:(CGSize)placeholderSize
+{
+    _placeholderSize = placeholderSize;
+    [self invalidateIntrinsicContentSize];
+}
+
+- (void)setSnapsToPixels:(BOOL)snapsToPixels
+{
+    _snapsToPixels = snapsToPixels;
+    [self setNeedsLayout];
 }
 
 - (void)setContentInsets:(MTEdgeInsets)contentInsets
@@ -110,6 +194,9 @@ static CGFloat ceilToPixel(CGFloat value, CGFloat scale) {
 {
     _mathList = mathList;
     _error = nil;
+    _scalableDisplayList = nil;
+    _latexNeedsParsing = NO;
+    [self cancelAsynchronousLayout];
     _latex = [MTMathListBuilder mathListToString:mathList];
     [self invalidateIntrinsicContentSize];
     [self setNeedsLayout];
@@ -119,24 +206,42 @@ static CGFloat ceilToPixel(CGFloat value, CGFloat scale) {
 {
     _latex = latex;
     _error = nil;
-    NSError* error = nil;
-    _mathList = [MTMathListBuilder buildFromString:latex error:&error];
-    if (error) {
+    _scalableDisplayList = nil;
+    [self cancelAsynchronousLayout];
+    if (_layoutsAsynchronously) {
+        // Parsed on the background queue along with the layout.
         _mathList = nil;
-        _error = error;
-        _errorLabel.text = error.localizedDescription;
+        _latexNeedsParsing = YES;
+    } else {
+        _latexNeedsParsing = NO;
+        NSError* error = nil;
+        _mathList = [MTMathListBuilder buildFromString:latex error:&error];
+        if (error) {
+            _mathList = nil;
+            _error = error;
+        }
+    }
+    [self updateErrorLabel];
+    [self invalidateIntrinsicContentSize];
+    [self setNeedsLayout];
+}
+
+- (void) updateErrorLabel
+{
+    if (_error) {
+        _errorLabel.text = _error.localizedDescription;
         _errorLabel.frame = self.bounds;
         _errorLabel.hidden = !self.displayErrorInline;
     } else {
         _errorLabel.hidden = YES;
     }
-    [self invalidateIntrinsicContentSize];
-    [self setNeedsLayout];
 }
 
 - (void)setLabelMode:(MTMathUILabelMode)labelMode
 {
     _labelMode = labelMode;
+    _scalableDisplayList = nil;
+    [self cancelAsynchronousLayout];
     [self invalidateIntrinsicContentSize];
     [self setNeedsLayout];
 }
@@ -146,6 +251,13 @@ static CGFloat ceilToPixel(CGFloat value, CGFloat scale) {
     NSParameterAssert(textColor);
     _textColor = textColor;
     _displayList.textColor = textColor;
+    _drawCommands = nil;
+    [self setNeedsDisplay];
+}
+
+- (void)setRasterCache:(MTRasterCache *)rasterCache
+{
+    _rasterCache = rasterCache;
     [self setNeedsDisplay];
 }
 
@@ -182,30 +294,178 @@ static CGFloat ceilToPixel(CGFloat value, CGFloat scale) {
 #endif
 }
 
+// The display for the current math list, and the factor its metrics have to be scaled by.
+// Returns nil if there is nothing to display, or if the asynchronous layout is not done yet.
+- (nullable MTMathListDisplay*) createDisplayListWithScale:(CGFloat*) scale
+{
+    *scale = _scalesLayout ? _font.fontSize / MTTypesetterReferenceFontSize : 1;
+    if (!_mathList && !_latexNeedsParsing) {
+        return nil;
+    }
+    if (_layoutsAsynchronously) {
+        MTMathListDisplay* displayList = _scalesLayout ? _scalableDisplayList : _asyncDisplayList;
+        if (!displayList) {
+            [self startAsynchronousLayout];
+        }
+        return displayList;
+    }
+    if (!_scalesLayout) {
+        return [MTTypesetter createLineForMathList:_mathList font:_font style:self.currentStyle retainsAtoms:_retainsAtoms];
+    }
+    if (!_scalableDisplayList) {
+        _scalableDisplayList = [MTTypesetter createScalableLineForMathList:_mathList font:_font style:self.currentStyle
+                                                             retainsAtoms:_retainsAtoms];
+    }
+    return _scalableDisplayList;
+}
+
+- (BOOL) isAsynchronousLayoutPending
+{
+    return _layoutsAsynchronously && (_mathList || _latexNeedsParsing) && !_layoutToken.finished;
+}
+
+// The key of the bitmap of the current content, or nil if the label does not draw from a cache.
+- (nullable MTRasterKey*) rasterKey
+{
+    if (!_rasterCache || _scalesLayout || !_latex) {
+        return nil;
+    }
+    return [[MTRasterKey alloc] initWithLatex:_latex font:_font style:self.currentStyle
+                                    textColor:_textColor scale:[self screenScale]];
+}
+
+// Drops the asynchronous layout of the previous content, finished or in flight.
+- (void) cancelAsynchronousLayout
+{
+    _layoutToken.cancelled = YES;
+    _layoutToken = nil;
+    _asyncDisplayList = nil;
+}
+
+// Parses and typesets the current content on a background queue, unless that is already under
+// way, and installs the result on the main thread if the content has not changed in between.
+- (void) startAsynchronousLayout
+{
+    if (_layoutToken) {
+        return;
+    }
+    MTLabelLayoutToken* token = [[MTLabelLayoutToken alloc] init];
+    _layoutToken = token;
+    // Capture everything the layout depends on, the label is only touched on the main thread.
+    NSString* latex = _latexNeedsParsing ? _latex : nil;
+    MTMathList* mathList = _latexNeedsParsing ? nil : [_mathList copy];
+    MTFont* font = _font;
+    MTLineStyle style = self.currentStyle;
+    BOOL scalesLayout = _scalesLayout;
+    BOOL retainsAtoms = _retainsAtoms;
+    MTRasterCache* rasterCache = _rasterCache;
+    MTRasterKey* rasterKey = [self rasterKey];
+    MTColor* textColor = _textColor;
+    __weak MTMathUILabel* weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        MTMathList* list = mathList;
+        NSError* error = nil;
+        if (latex) {
+            if (token.cancelled) {
+                return;
+            }
+            list = [MTMathListBuilder buildFromString:latex error:&error];
+            if (error) {
+                list = nil;
+            }
+        }
+        MTMathListDisplay* displayList = nil;
+        if (list) {
+            if (token.cancelled) {
+                return;
+            }
+            if (scalesLayout) {
+                displayList = [MTTypesetter createScalableLineForMathList:list font:font style:style retainsAtoms:retainsAtoms];
+            } else {
+                displayList = [MTTypesetter createLineForMathList:list font:font style:style retainsAtoms:retainsAtoms];
+            }
+        }
+        if (displayList && rasterKey && !token.cancelled) {
+            // Render the bitmap here too, so that the first draw only has to copy it.
+            displayList.textColor = textColor;
+            (void)[rasterCache imageForKey:rasterKey display:displayList];
+        }
+        if (token.cancelled) {
+            return;
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [weakSelf finishAsynchronousLayout:token mathList:list error:error displayList:displayList];
+        });
+    });
+}
+
+- (void) finishAsynchronousLayout:(MTLabelLayoutToken*) token mathList:(nullable MTMathList*) mathList
+                            error:(nullable NSError*) error displayList:(nullable MTMathListDisplay*) displayList
+{
+    if (token != _layoutToken || token.cancelled) {
+        // The content changed while the layout was running.
+        return;
+    }
+    token.finished = YES;
+    if (_latexNeedsParsing) {
+        _latexNeedsParsing = NO;
+        _mathList = mathList;
+        _error = error;
+        [self updateErrorLabel];
+    }
+    if (_scalesLayout) {
+        _scalableDisplayList = displayList;
+    } else {
+        _asyncDisplayList = displayList;
+    }
+    [self invalidateIntrinsicContentSize];
+    [self setNeedsLayout];
+}
+
 // Only override drawRect: if you perform custom drawing.
 // An empty implementation adversely affects performance during animation.
 - (void)drawRect:(MTRect)rect
 {
     [super drawRect:rect];
     
-    if (!_mathList) {
+    if (!_mathList || !_displayList) {
         return;
     }
     
     // Drawing code
     CGContextRef context = MTGraphicsGetCurrentContext();
+    MTRasterKey* rasterKey = [self rasterKey];
+    if (rasterKey) {
+        MTRasterImage* image = [_rasterCache imageForKey:rasterKey display:_displayList];
+        [image drawAtPosition:_displayList.position context:context];
+        return;
+    }
     CGContextSaveGState(context);
     
-    [_displayList draw:context];
+    if (_scalesLayout) {
+        CGContextTranslateCTM(context, _displayOrigin.x, _displayOrigin.y);
+        CGContextScaleCTM(context, _displayScale, _displayScale);
+    }
+    if (!_drawCommands) {
+        _drawCommands = [[MTDrawCommandList alloc] initWithDisplay:_displayList];
+    }
+    // The clip is the dirty rectangle in the coordinates of the display (after the transform
+    // above). Outset it a little so that antialiased edges just outside are redrawn too.
+    CGRect dirtyRect = CGRectInset(CGContextGetClipBoundingBox(context), -1, -1);
+    [_drawCommands drawInRect:dirtyRect context:context];
     
     CGContextRestoreGState(context);
 }
 
 - (void) layoutSubviews
 {
-    if (_mathList) {
-        _displayList = [MTTypesetter createLineForMathList:_mathList font:_font style:self.currentStyle];
+    CGFloat scale = 1;
+    _displayList = [self createDisplayListWithScale:&scale];
+    if (_displayList) {
         _displayList.textColor = _textColor;
+        CGFloat inkWidth = _displayList.inkWidth * scale;
+        CGFloat ascent = _displayList.ascent * scale;
+        CGFloat descent = _displayList.descent * scale;
         
         // Determine x position based on alignment
         CGFloat textX = 0;
@@ -214,25 +474,32 @@ static CGFloat ceilToPixel(CGFloat value, CGFloat scale) {
                 textX = self.contentInsets.left;
                 break;
             case kMTTextAlignmentCenter:
-                textX = (self.bounds.size.width - self.contentInsets.left - self.contentInsets.right - _displayList.inkWidth) / 2 + self.contentInsets.left;
+                textX = (self.bounds.size.width - self.contentInsets.left - self.contentInsets.right - inkWidth) / 2 + self.contentInsets.left;
                 break;
             case kMTTextAlignmentRight:
-                textX = (self.bounds.size.width - _displayList.inkWidth - self.contentInsets.right);
+                textX = (self.bounds.size.width - inkWidth - self.contentInsets.right);
                 break;
         }
         
         CGFloat availableHeight = self.bounds.size.height - self.contentInsets.bottom - self.contentInsets.top;
         // center things vertically
-        CGFloat height = _displayList.ascent + _displayList.descent;
+        CGFloat height = ascent + descent;
         if (height < _fontSize/2) {
             // Set the height to the half the size of the font
             height = _fontSize/2;
         }
-        CGFloat textY = (availableHeight - height) / 2 + _displayList.descent + self.contentInsets.bottom;
-        _displayList.position = CGPointMake(textX, textY);
-    } else {
-        _displayList = nil;
+        CGFloat textY = (availableHeight - height) / 2 + descent + self.contentInsets.bottom;
+        if (_snapsToPixels) {
+            CGFloat screenScale = [self screenScale];
+            textX = roundToPixel(textX, screenScale);
+            textY = roundToPixel(textY, screenScale);
+        }
+        _displayOrigin = CGPointMake(textX, textY);
+        _displayScale = scale;
+        // A scaled display is placed by the transform in drawRect:.
+        _displayList.position = _scalesLayout ? CGPointZero : _displayOrigin;
     }
+    _drawCommands = nil;
     _errorLabel.frame = self.bounds;
     [self setNeedsDisplay];
 }
@@ -247,14 +514,15 @@ static CGFloat ceilToPixel(CGFloat value, CGFloat scale) {
 
 - (CGSize) sizeThatFits:(CGSize)size
 {
-    MTMathListDisplay* displayList = nil;
-    if (_mathList) {
-        displayList = [MTTypesetter createLineForMathList:_mathList font:_font style:self.currentStyle];
+    CGFloat displayScale = 1;
+    MTMathListDisplay* displayList = [self createDisplayListWithScale:&displayScale];
+    if (self.asynchronousLayoutPending) {
+        return _placeholderSize;
     }
 
     CGFloat scale = [self screenScale];
-    CGFloat rawWidth  = displayList.inkWidth + self.contentInsets.left + self.contentInsets.right;
-    CGFloat rawHeight = displayList.ascent + displayList.descent + self.contentInsets.top + self.contentInsets.bottom;
+    CGFloat rawWidth  = displayList.inkWidth * displayScale + self.contentInsets.left + self.contentInsets.right;
+    CGFloat rawHeight = (displayList.ascent + displayList.descent) * displayScale + self.contentInsets.top + self.contentInsets.bottom;
     size.width  = ceilToPixel(rawWidth,  scale);
     size.height = ceilToPixel(rawHeight, scale);
     return size;
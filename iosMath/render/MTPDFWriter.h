@@ -0,0 +1,69 @@
+//
+//  MTPDFWriter.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import CoreGraphics;
+@import Foundation;
+
+#import "MTConfig.h"
+#import "MTMathListDisplay.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ Writes any number of displays into one PDF document, page by page.
+
+ Every page is written out when it is finished, so memory use does not grow with the number
+ of formulas. Each font is embedded once for the whole document, with the glyphs used by all
+ the formulas, instead of once per formula.
+
+ Displays are either flowed down the pages with `addDisplay:`, starting a new page when the
+ next one does not fit, or placed explicitly with `drawDisplay:atPoint:`. Page coordinates
+ have their origin at the bottom left, with y pointing up. A writer is not thread safe.
+ */
+@interface MTPDFWriter : NSObject
+
+- (instancetype) init NS_UNAVAILABLE;
+
+/** Writes to a file, replacing it. Returns nil if the file cannot be created. */
+- (nullable instancetype) initWithURL:(NSURL*) url pageSize:(CGSize) pageSize;
+
+/** Writes to an open stream as the pages are finished. */
+- (nullable instancetype) initWithStream:(NSOutputStream*) stream pageSize:(CGSize) pageSize;
+
+/** The size of the pages. */
+@property (nonatomic, readonly) CGSize pageSize;
+
+/** The distance from the edges of the page to the flowed displays. 36 points on every side by default. */
+@property (nonatomic) MTEdgeInsets margins;
+
+/** The vertical space between flowed displays. 12 points by default. */
+@property (nonatomic) CGFloat spacing;
+
+/** The number of pages begun so far. */
+@property (nonatomic, readonly) NSUInteger pageCount;
+
+/** Places the display below the previous one, at the left margin, and begins a new page if it
+ does not fit on the current one. A display taller than a page gets a page of its own and is
+ cut off at the bottom. The display is not modified. */
+- (void) addDisplay:(MTDisplay*) display;
+
+/** Ends the current page, if any, and begins a new one. The next flowed display goes to the
+ top of it. */
+- (void) beginPage;
+
+/** Draws the display with the start of its baseline at `point` on the current page, beginning
+ a page if there is none. The display is not modified. */
+- (void) drawDisplay:(MTDisplay*) display atPoint:(CGPoint) point;
+
+/** Ends the last page and writes the end of the document. Nothing may be added afterwards.
+ Returns NO, and sets `error` to the error of the stream, if writing to the stream failed. */
+- (BOOL) finishWithError:(NSError* _Nullable * _Nullable) error;
+
+@end
+
+NS_ASSUME_NONNULL_END
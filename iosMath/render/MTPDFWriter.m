@@ -0,0 +1,173 @@
+//
+//  MTPDFWriter.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTPDFWriter.h"
+#import "MTDrawCommandList.h"
+
+// Hands the bytes of the PDF context to a stream and remembers the first error.
+@interface MTPDFStreamSink : NSObject
+
+@property (nonatomic) NSOutputStream* stream;
+@property (nonatomic, nullable) NSError* error;
+
+@end
+
+@implementation MTPDFStreamSink
+@end
+
+static size_t MTPDFPutBytes(void* info, const void* buffer, size_t count)
+{
+    MTPDFStreamSink* sink = (__bridge MTPDFStreamSink*) info;
+    if (sink.error) {
+        return 0;
+    }
+    const uint8_t* bytes = buffer;
+    size_t remaining = count;
+    while (remaining > 0) {
+        NSInteger written = [sink.stream write:bytes maxLength:remaining];
+        if (written <= 0) {
+            sink.error = sink.stream.streamError ?: [NSError errorWithDomain:NSPOSIXErrorDomain code:EIO userInfo:nil];
+            return count - remaining;
+        }
+        bytes += written;
+        remaining -= (size_t) written;
+    }
+    return count;
+}
+
+static void MTPDFReleaseSink(void* info)
+{
+    CFBridgingRelease(info);
+}
+
+@implementation MTPDFWriter {
+    CGContextRef _context;
+    MTPDFStreamSink* _sink;
+    BOOL _pageOpen;
+    // The top of the free space on the current page, for flowed displays.
+    CGFloat _cursorY;
+}
+
+- (instancetype) initWithConsumer:(CGDataConsumerRef) consumer pageSize:(CGSize) pageSize
+{
+    NSParameterAssert(pageSize.width > 0 && pageSize.height > 0);
+    self = [super init];
+    if (self) {
+        _pageSize = pageSize;
+        _margins = (MTEdgeInsets) { 36, 36, 36, 36 };
+        _spacing = 12;
+        CGRect mediaBox = CGRectMake(0, 0, pageSize.width, pageSize.height);
+        _context = CGPDFContextCreate(consumer, &mediaBox, NULL);
+        if (!_context) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (instancetype) initWithURL:(NSURL*) url pageSize:(CGSize) pageSize
+{
+    NSParameterAssert(url);
+    CGDataConsumerRef consumer = CGDataConsumerCreateWithURL((__bridge CFURLRef) url);
+    if (!consumer) {
+        return nil;
+    }
+    self = [self initWithConsumer:consumer pageSize:pageSize];
+    CGDataConsumerRelease(consumer);
+    return self;
+}
+
+- (instancetype) initWithStream:(NSOutputStream*) stream pageSize:(CGSize) pageSize
+{
+    NSParameterAssert(stream);
+    MTPDFStreamSink* sink = [[MTPDFStreamSink alloc] init];
+    sink.stream = stream;
+    CGDataConsumerCallbacks callbacks = { MTPDFPutBytes, MTPDFReleaseSink };
+    CGDataConsumerRef consumer = CGDataConsumerCreate((void*) CFBridgingRetain(sink), &callbacks);
+    self = [self initWithConsumer:consumer pageSize:pageSize];
+    CGDataConsumerRelease(consumer);
+    if (self) {
+        _sink = sink;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_context) {
+        if (_pageOpen) {
+            CGPDFContextEndPage(_context);
+        }
+        CGPDFContextClose(_context);
+        CGContextRelease(_context);
+    }
+}
+
+- (void) beginPage
+{
+    NSAssert(_context, @"The PDF writer is already finished");
+    if (_pageOpen) {
+        CGPDFContextEndPage(_context);
+    }
+    CGPDFContextBeginPage(_context, NULL);
+    _pageOpen = YES;
+    _pageCount++;
+    _cursorY = _pageSize.height - _margins.top;
+}
+
+- (void) addDisplay:(MTDisplay*) display
+{
+    NSParameterAssert(display);
+    CGFloat height = display.ascent + display.descent;
+    CGFloat top = _pageSize.height - _margins.top;
+    // A display that does not fit goes to the next page, unless the page is still empty.
+    if (!_pageOpen || (_cursorY - height < _margins.bottom && _cursorY < top)) {
+        [self beginPage];
+    }
+    CGFloat baseline = _cursorY - display.ascent;
+    [self drawDisplay:display atPoint:CGPointMake(_margins.left, baseline)];
+    _cursorY = baseline - display.descent - _spacing;
+}
+
+- (void) drawDisplay:(MTDisplay*) display atPoint:(CGPoint) point
+{
+    NSParameterAssert(display);
+    if (!_pageOpen) {
+        [self beginPage];
+    }
+    // The compiled commands and the temporary objects of drawing are released right away, so
+    // that nothing accumulates over thousands of formulas.
+    @autoreleasepool {
+        MTDrawCommandList* commands = [[MTDrawCommandList alloc] initWithDisplay:display];
+        CGContextSaveGState(_context);
+        CGContextTranslateCTM(_context, point.x - display.position.x, point.y - display.position.y);
+        [commands draw:_context];
+        CGContextRestoreGState(_context);
+    }
+}
+
+- (BOOL) finishWithError:(NSError**) error
+{
+    NSAssert(_context, @"The PDF writer is already finished");
+    if (_pageOpen) {
+        CGPDFContextEndPage(_context);
+        _pageOpen = NO;
+    }
+    CGPDFContextClose(_context);
+    CGContextRelease(_context);
+    _context = NULL;
+    if (_sink.error) {
+        if (error) {
+            *error = _sink.error;
+        }
+        return NO;
+    }
+    return YES;
+}
+
+@end
@@ -0,0 +1,112 @@
+//
+//  MTRasterCache.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import CoreGraphics;
+@import Foundation;
+
+#import "MTConfig.h"
+#import "MTFont.h"
+#import "MTMathListDisplay.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ A rendered formula: a bitmap of a display and where it goes relative to the display.
+ Images are immutable and may be used from any thread.
+ */
+@interface MTRasterImage : NSObject
+
+- (instancetype) init NS_UNAVAILABLE;
+
+/** Renders the display into a bitmap with `scale` pixels per point of the display. The
+ bitmap covers the ink of the display, including what overhangs its typographic bounds.
+ Returns nil if the display draws nothing. This may be called on any thread as long as the
+ display is not modified at the same time. */
++ (nullable instancetype) imageWithDisplay:(MTDisplay*) display scale:(CGFloat) scale;
+
+/** The bitmap, in premultiplied sRGB. */
+@property (nonatomic, readonly) CGImageRef image;
+
+/** The rectangle the bitmap covers, in points relative to the position of the display. */
+@property (nonatomic, readonly) CGRect rect;
+
+/** The pixels per point of the bitmap. */
+@property (nonatomic, readonly) CGFloat scale;
+
+/** The memory taken by the bitmap. */
+@property (nonatomic, readonly) NSUInteger byteCount;
+
+/** Draws the bitmap in place of a display positioned at `position`. */
+- (void) drawAtPosition:(CGPoint) position context:(CGContextRef) context;
+
+@end
+
+/**
+ The key of a rendered formula. Everything that changes the pixels is part of it: the
+ content (the LaTeX, or `+[MTMathListBuilder mathListToString:]` of a math list, which is
+ the same for the same structure), the font face and size, the line style, the text color
+ and the scale.
+ */
+@interface MTRasterKey : NSObject <NSCopying>
+
+- (instancetype) init NS_UNAVAILABLE;
+
+- (instancetype) initWithLatex:(NSString*) latex font:(MTFont*) font style:(MTLineStyle) style
+                     textColor:(MTColor*) textColor scale:(CGFloat) scale NS_DESIGNATED_INITIALIZER;
+
+@property (nonatomic, readonly) NSString* latex;
+@property (nonatomic, readonly) NSString* fontName;
+@property (nonatomic, readonly) CGFloat fontSize;
+@property (nonatomic, readonly) MTLineStyle style;
+@property (nonatomic, readonly) MTColor* textColor;
+@property (nonatomic, readonly) CGFloat scale;
+
+@end
+
+/**
+ A cache of rendered formulas with a memory budget. When the bitmaps take more than
+ `byteLimit`, the least recently used ones are evicted. All methods are thread safe.
+
+ On iOS the shared cache is emptied when the application receives a memory warning.
+ */
+@interface MTRasterCache : NSObject
+
+/** The cache shared by all the labels that use one. Its limit is 32 MB. */
++ (instancetype) sharedCache;
+
+- (instancetype) initWithByteLimit:(NSUInteger) byteLimit NS_DESIGNATED_INITIALIZER;
+
+/** Creates a cache with a limit of 32 MB. */
+- (instancetype) init;
+
+/** The most memory the bitmaps may take. Lowering it evicts images right away. */
+@property (nonatomic) NSUInteger byteLimit;
+
+/** The memory taken by the cached bitmaps. */
+@property (nonatomic, readonly) NSUInteger byteCount;
+
+/** The number of cached images. */
+@property (nonatomic, readonly) NSUInteger count;
+
+/** The image for the key, which becomes the most recently used one, or nil. */
+- (nullable MTRasterImage*) imageForKey:(MTRasterKey*) key;
+
+/** Adds an image. An image larger than `byteLimit` is not cached. */
+- (void) setImage:(MTRasterImage*) image forKey:(MTRasterKey*) key;
+
+/** The image for the key, rendering and adding it from `display` on a miss. The display has
+ to be the one the key describes, positioned anywhere. Returns nil if it draws nothing. */
+- (nullable MTRasterImage*) imageForKey:(MTRasterKey*) key display:(MTDisplay*) display;
+
+- (void) removeImageForKey:(MTRasterKey*) key;
+
+- (void) removeAllImages;
+
+@end
+
+NS_ASSUME_NONNULL_END
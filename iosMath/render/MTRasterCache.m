@@ -0,0 +1,221 @@
+//
+//  MTRasterCache.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTRasterCache.h"
+#import "MTFont+Internal.h"
+#import "MTDrawCommandList.h"
+#import "MTLRUCache.h"
+#import "../lib/MTInstrumentationInternal.h"
+
+static const NSUInteger kMTDefaultRasterByteLimit = 32 * 1024 * 1024;
+
+@implementation MTRasterImage
+
+- (instancetype) initWithImage:(CGImageRef) image rect:(CGRect) rect scale:(CGFloat) scale byteCount:(NSUInteger) byteCount
+{
+    self = [super init];
+    if (self) {
+        _image = CGImageRetain(image);
+        _rect = rect;
+        _scale = scale;
+        _byteCount = byteCount;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    CGImageRelease(_image);
+}
+
++ (instancetype) imageWithDisplay:(MTDisplay*) display scale:(CGFloat) scale
+{
+    NSParameterAssert(display);
+    NSParameterAssert(scale > 0);
+    MTDrawCommandList* commands = [[MTDrawCommandList alloc] initWithDisplay:display];
+    CGRect bounds = commands.bounds;
+    if (commands.count == 0 || CGRectIsNull(bounds) || CGRectIsEmpty(bounds)) {
+        return nil;
+    }
+    // The bounds in pixels, outset by a pixel for the antialiasing and snapped to whole pixels.
+    CGFloat minX = floor(CGRectGetMinX(bounds) * scale) - 1;
+    CGFloat minY = floor(CGRectGetMinY(bounds) * scale) - 1;
+    CGFloat maxX = ceil(CGRectGetMaxX(bounds) * scale) + 1;
+    CGFloat maxY = ceil(CGRectGetMaxY(bounds) * scale) + 1;
+    size_t width = (size_t) (maxX - minX);
+    size_t height = (size_t) (maxY - minY);
+
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, colorSpace, (CGBitmapInfo) kCGImageAlphaPremultipliedLast);
+    CGColorSpaceRelease(colorSpace);
+    if (!context) {
+        return nil;
+    }
+    CGContextScaleCTM(context, scale, scale);
+    CGContextTranslateCTM(context, -minX / scale, -minY / scale);
+    [commands draw:context];
+    CGImageRef image = CGBitmapContextCreateImage(context);
+    NSUInteger byteCount = CGBitmapContextGetBytesPerRow(context) * height;
+    CGContextRelease(context);
+    if (!image) {
+        return nil;
+    }
+    CGRect rect = CGRectMake(minX / scale - display.position.x, minY / scale - display.position.y,
+                             width / scale, height / scale);
+    MTRasterImage* rasterImage = [[MTRasterImage alloc] initWithImage:image rect:rect scale:scale byteCount:byteCount];
+    CGImageRelease(image);
+    return rasterImage;
+}
+
+- (void) drawAtPosition:(CGPoint) position context:(CGContextRef) context
+{
+    MTTracePhase(kMTLayoutPhaseDraw);
+    CGContextDrawImage(context, CGRectOffset(_rect, position.x, position.y), _image);
+}
+
+@end
+
+@implementation MTRasterKey {
+    NSUInteger _hash;
+}
+
+- (instancetype) initWithLatex:(NSString*) latex font:(MTFont*) font style:(MTLineStyle) style
+                     textColor:(MTColor*) textColor scale:(CGFloat) scale
+{
+    NSParameterAssert(latex);
+    NSParameterAssert(font);
+    NSParameterAssert(textColor);
+    self = [super init];
+    if (self) {
+        _latex = [latex copy];
+        _fontName = CFBridgingRelease(CTFontCopyPostScriptName(font.ctFont));
+        _fontSize = font.fontSize;
+        _style = style;
+        _textColor = textColor;
+        _scale = scale;
+        _hash = _latex.hash ^ (_fontName.hash * 31) ^ (NSUInteger) (_fontSize * 64) ^ ((NSUInteger) style << 24)
+            ^ (_textColor.hash * 17) ^ ((NSUInteger) (_scale * 8) << 16);
+    }
+    return self;
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    // Immutable.
+    return self;
+}
+
+- (NSUInteger)hash
+{
+    return _hash;
+}
+
+- (BOOL)isEqual:(id)object
+{
+    if (object == self) {
+        return YES;
+    }
+    if (![object isKindOfClass:[MTRasterKey class]]) {
+        return NO;
+    }
+    MTRasterKey* other = object;
+    return _hash == other->_hash && _fontSize == other->_fontSize && _style == other->_style && _scale == other->_scale
+        && [_latex isEqualToString:other->_latex] && [_fontName isEqualToString:other->_fontName]
+        && [_textColor isEqual:other->_textColor];
+}
+
+@end
+
+@implementation MTRasterCache {
+    // The images, with their size in bytes as the cost.
+    MTLRUCache<MTRasterKey*, MTRasterImage*>* _images;
+}
+
++ (instancetype) sharedCache
+{
+    static MTRasterCache* sharedCache = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedCache = [[MTRasterCache alloc] init];
+    });
+    return sharedCache;
+}
+
+- (instancetype) init
+{
+    return [self initWithByteLimit:kMTDefaultRasterByteLimit];
+}
+
+- (instancetype) initWithByteLimit:(NSUInteger) byteLimit
+{
+    self = [super init];
+    if (self) {
+        _images = [[MTLRUCache alloc] initWithCostLimit:byteLimit];
+    }
+    return self;
+}
+
+- (NSUInteger) byteLimit
+{
+    return _images.costLimit;
+}
+
+- (void) setByteLimit:(NSUInteger) byteLimit
+{
+    _images.costLimit = byteLimit;
+}
+
+- (NSUInteger) byteCount
+{
+    return _images.totalCost;
+}
+
+- (NSUInteger) count
+{
+    return _images.count;
+}
+
+- (MTRasterImage*) imageForKey:(MTRasterKey*) key
+{
+    NSParameterAssert(key);
+    return [_images objectForKey:key];
+}
+
+- (void) setImage:(MTRasterImage*) image forKey:(MTRasterKey*) key
+{
+    NSParameterAssert(image);
+    NSParameterAssert(key);
+    [_images setObject:image forKey:key cost:image.byteCount];
+}
+
+- (MTRasterImage*) imageForKey:(MTRasterKey*) key display:(MTDisplay*) display
+{
+    MTRasterImage* image = [self imageForKey:key];
+    if (!image) {
+        // Rendered outside the lock. Two threads may both render a missing image, the
+        // second one simply replaces the first.
+        image = [MTRasterImage imageWithDisplay:display scale:key.scale];
+        if (image) {
+            [self setImage:image forKey:key];
+        }
+    }
+    return image;
+}
+
+- (void) removeImageForKey:(MTRasterKey*) key
+{
+    NSParameterAssert(key);
+    [_images removeObjectForKey:key];
+}
+
+- (void) removeAllImages
+{
+    [_images removeAllObjects];
+}
+
+@end
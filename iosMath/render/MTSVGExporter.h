@@ -0,0 +1,46 @@
+//
+//  MTSVGExporter.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import Foundation;
+
+#import "MTMathListDisplay.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ Writes a finished display tree as a standalone SVG document, without a view or a window.
+
+ Every distinct glyph of a document is written once as a path in `<defs>` and placed with
+ `<use>`, so repeated symbols cost a few bytes each. Fraction bars, radical and over/under
+ lines, table rules and strikes become stroked paths, and background colors rectangles.
+ One user unit is one point of the display, and the baseline of the display is at y = 0.
+ The root element carries a `vertical-align` style that puts the baseline on the baseline of
+ the surrounding text when the SVG is used inline in HTML.
+
+ The exporter keeps the outlines of the glyphs it has converted, so exporting many formulas
+ with the same exporter only converts each glyph once. An exporter may be used from several
+ threads at once; a display must not be modified while it is exported.
+ */
+@interface MTSVGExporter : NSObject
+
+/** Writes the SVG of the display to an open stream, in chunks as it is produced. Returns NO,
+ and sets `error` to the error of the stream, if writing failed. */
+- (BOOL) writeDisplay:(MTDisplay*) display toStream:(NSOutputStream*) stream error:(NSError* _Nullable * _Nullable) error;
+
+/** The SVG of the display as UTF-8 data. */
+- (NSData*) SVGDataForDisplay:(MTDisplay*) display;
+
+/** The SVG of the display. */
+- (NSString*) SVGStringForDisplay:(MTDisplay*) display;
+
+/** Forgets the converted glyph outlines. */
+- (void) removeCachedOutlines;
+
+@end
+
+NS_ASSUME_NONNULL_END
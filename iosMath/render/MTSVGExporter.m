@@ -0,0 +1,472 @@
+//
+//  MTSVGExporter.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import CoreText;
+
+#import "MTSVGExporter.h"
+#import "MTDrawCommandList.h"
+
+// The writer collects output in a buffer and hands it to the stream in chunks of this size.
+static const NSUInteger kMTSVGChunkSize = 64 * 1024;
+
+// Writes `value` rounded to two decimals without trailing zeros into `out`, which must hold
+// at least 32 bytes, and returns the length. Hundredths of a point are well below a pixel.
+static size_t MTSVGFormatNumber(CGFloat value, char* out)
+{
+    long long scaled = llround(value * 100);
+    char* p = out;
+    if (scaled < 0) {
+        *p++ = '-';
+        scaled = -scaled;
+    }
+    p += snprintf(p, 24, "%lld", scaled / 100);
+    int fraction = (int) (scaled % 100);
+    if (fraction) {
+        *p++ = '.';
+        *p++ = (char) ('0' + fraction / 10);
+        if (fraction % 10) {
+            *p++ = (char) ('0' + fraction % 10);
+        }
+    }
+    *p = '\0';
+    return (size_t) (p - out);
+}
+
+#pragma mark - MTSVGWriter
+
+// Buffered output, either into memory or into a stream.
+@interface MTSVGWriter : NSObject
+
+- (instancetype) initWithStream:(nullable NSOutputStream*) stream;
+
+@property (nonatomic, readonly) NSMutableData* data;
+@property (nonatomic, readonly, nullable) NSError* error;
+
+- (void) appendBytes:(const void*) bytes length:(NSUInteger) length;
+- (void) appendCString:(const char*) string;
+- (void) appendNumber:(CGFloat) number;
+- (void) appendUnsignedInteger:(NSUInteger) number;
+- (BOOL) flush;
+
+@end
+
+@implementation MTSVGWriter {
+    NSOutputStream* _stream;
+}
+
+- (instancetype) initWithStream:(NSOutputStream*) stream
+{
+    self = [super init];
+    if (self) {
+        _stream = stream;
+        _data = [NSMutableData dataWithCapacity:stream ? kMTSVGChunkSize : 4096];
+    }
+    return self;
+}
+
+- (void) appendBytes:(const void*) bytes length:(NSUInteger) length
+{
+    [_data appendBytes:bytes length:length];
+    if (_stream && _data.length >= kMTSVGChunkSize) {
+        [self flush];
+    }
+}
+
+- (void) appendCString:(const char*) string
+{
+    [self appendBytes:string length:strlen(string)];
+}
+
+- (void) appendNumber:(CGFloat) number
+{
+    char buffer[32];
+    size_t length = MTSVGFormatNumber(number, buffer);
+    [self appendBytes:buffer length:length];
+}
+
+- (void) appendUnsignedInteger:(NSUInteger) number
+{
+    char buffer[24];
+    int length = snprintf(buffer, sizeof(buffer), "%lu", (unsigned long) number);
+    [self appendBytes:buffer length:(NSUInteger) length];
+}
+
+- (BOOL) flush
+{
+    if (!_stream) {
+        return YES;
+    }
+    const uint8_t* bytes = _data.bytes;
+    NSUInteger remaining = _data.length;
+    while (remaining > 0 && !_error) {
+        NSInteger written = [_stream write:bytes maxLength:remaining];
+        if (written <= 0) {
+            _error = _stream.streamError ?: [NSError errorWithDomain:NSPOSIXErrorDomain code:EIO userInfo:nil];
+            break;
+        }
+        bytes += written;
+        remaining -= (NSUInteger) written;
+    }
+    _data.length = 0;
+    return _error == nil;
+}
+
+@end
+
+#pragma mark - Glyph runs
+
+// Calls `block` for every run of glyphs in the given commands, from glyph commands and from
+// the runs of lines, with absolute glyph positions and the color the run is filled with (NULL
+// for the color of the context).
+static void MTEnumerateGlyphRuns(MTDrawCommandList* commands, NSRange range,
+                                 void (^block)(CTFontRef font, const CGGlyph* glyphs, const CGPoint* positions,
+                                               NSUInteger count, CGColorRef _Nullable color))
+{
+    const MTDrawCommand* list = commands.commands;
+    CGGlyph* runGlyphs = NULL;
+    CGPoint* runPositions = NULL;
+    NSUInteger runCapacity = 0;
+    for (NSUInteger i = range.location; i < NSMaxRange(range); i++) {
+        const MTDrawCommand* command = &list[i];
+        if (command->type == kMTDrawCommandGlyphs) {
+            block(command->font, commands.glyphs + command->index, commands.glyphPositions + command->index,
+                  command->count, command->color);
+        } else if (command->type == kMTDrawCommandLine) {
+            CFArrayRef runs = CTLineGetGlyphRuns(command->line);
+            for (CFIndex r = 0; r < CFArrayGetCount(runs); r++) {
+                CTRunRef run = CFArrayGetValueAtIndex(runs, r);
+                CFIndex count = CTRunGetGlyphCount(run);
+                if (count == 0) {
+                    continue;
+                }
+                if ((NSUInteger) count > runCapacity) {
+                    runCapacity = (NSUInteger) count;
+                    runGlyphs = realloc(runGlyphs, runCapacity * sizeof(CGGlyph));
+                    runPositions = realloc(runPositions, runCapacity * sizeof(CGPoint));
+                    NSCAssert(runGlyphs != NULL && runPositions != NULL, @"Failed to allocate the run buffers");
+                }
+                CTRunGetGlyphs(run, CFRangeMake(0, count), runGlyphs);
+                CTRunGetPositions(run, CFRangeMake(0, count), runPositions);
+                for (CFIndex g = 0; g < count; g++) {
+                    runPositions[g].x += command->origin.x;
+                    runPositions[g].y += command->origin.y;
+                }
+                CFDictionaryRef attributes = CTRunGetAttributes(run);
+                CTFontRef font = CFDictionaryGetValue(attributes, kCTFontAttributeName);
+                CGColorRef color = (CGColorRef) CFDictionaryGetValue(attributes, kCTForegroundColorAttributeName);
+                if (font) {
+                    block(font, runGlyphs, runPositions, (NSUInteger) count, color ?: command->color);
+                }
+            }
+        }
+    }
+    free(runGlyphs);
+    free(runPositions);
+}
+
+#pragma mark - Outlines
+
+typedef struct {
+    __unsafe_unretained MTSVGWriter* writer;
+} MTSVGPathContext;
+
+// Writes a glyph outline with y pointing down, as SVG wants it.
+static void MTSVGWritePathElement(void* info, const CGPathElement* element)
+{
+    MTSVGWriter* writer = ((MTSVGPathContext*) info)->writer;
+    int points = 0;
+    switch (element->type) {
+        case kCGPathElementMoveToPoint:
+            [writer appendCString:"M"];
+            points = 1;
+            break;
+        case kCGPathElementAddLineToPoint:
+            [writer appendCString:"L"];
+            points = 1;
+            break;
+        case kCGPathElementAddQuadCurveToPoint:
+            [writer appendCString:"Q"];
+            points = 2;
+            break;
+        case kCGPathElementAddCurveToPoint:
+            [writer appendCString:"C"];
+            points = 3;
+            break;
+        case kCGPathElementCloseSubpath:
+            [writer appendCString:"Z"];
+            break;
+    }
+    for (int i = 0; i < points; i++) {
+        if (i > 0) {
+            [writer appendCString:" "];
+        }
+        [writer appendNumber:element->points[i].x];
+        [writer appendCString:" "];
+        [writer appendNumber:-element->points[i].y];
+    }
+}
+
+#pragma mark - MTSVGExporter
+
+@implementation MTSVGExporter {
+    // "postscript name|size|glyph" to the path data of the outline, empty for glyphs
+    // without one (spaces).
+    NSMutableDictionary<NSString*, NSData*>* _outlines;
+}
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _outlines = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+- (void) removeCachedOutlines
+{
+    @synchronized (_outlines) {
+        [_outlines removeAllObjects];
+    }
+}
+
+- (NSData*) outlineOfGlyph:(CGGlyph) glyph font:(CTFontRef) font
+{
+    NSString* name = CFBridgingRelease(CTFontCopyPostScriptName(font));
+    NSString* key = [NSString stringWithFormat:@"%@|%g|%u", name, CTFontGetSize(font), (unsigned) glyph];
+    @synchronized (_outlines) {
+        NSData* outline = _outlines[key];
+        if (outline) {
+            return outline;
+        }
+    }
+    // Converted outside the lock; two threads converting the same glyph write the same data.
+    MTSVGWriter* writer = [[MTSVGWriter alloc] initWithStream:nil];
+    CGPathRef path = CTFontCreatePathForGlyph(font, glyph, NULL);
+    if (path) {
+        MTSVGPathContext context = { writer };
+        CGPathApply(path, &context, MTSVGWritePathElement);
+        CGPathRelease(path);
+    }
+    NSData* outline = [writer.data copy];
+    @synchronized (_outlines) {
+        _outlines[key] = outline;
+    }
+    return outline;
+}
+
+// Writes `fill` or `stroke` and the opacity for a color, in sRGB.
+static void MTSVGWriteColor(MTSVGWriter* writer, const char* attribute, CGColorRef color)
+{
+    static CGColorSpaceRef sRGB = NULL;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sRGB = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    });
+    CGColorRef converted = CGColorCreateCopyByMatchingToColorSpace(sRGB, kCGRenderingIntentDefault, color, NULL);
+    if (!converted || CGColorGetNumberOfComponents(converted) < 4) {
+        if (converted) {
+            CGColorRelease(converted);
+        }
+        return;
+    }
+    const CGFloat* components = CGColorGetComponents(converted);
+    char buffer[80];
+    int length = snprintf(buffer, sizeof(buffer), " %s=\"#%02x%02x%02x\"", attribute,
+                          (unsigned) lround(MIN(MAX(components[0], 0), 1) * 255),
+                          (unsigned) lround(MIN(MAX(components[1], 0), 1) * 255),
+                          (unsigned) lround(MIN(MAX(components[2], 0), 1) * 255));
+    [writer appendBytes:buffer length:(NSUInteger) length];
+    CGFloat alpha = components[3];
+    if (alpha < 1) {
+        length = snprintf(buffer, sizeof(buffer), " %s-opacity=\"", attribute);
+        [writer appendBytes:buffer length:(NSUInteger) length];
+        [writer appendNumber:alpha];
+        [writer appendCString:"\""];
+    }
+    CGColorRelease(converted);
+}
+
+// Writes x and y attributes for an absolute point of the display.
+static void MTSVGWritePoint(MTSVGWriter* writer, CGPoint point, CGPoint origin)
+{
+    [writer appendCString:" x=\""];
+    [writer appendNumber:point.x - origin.x];
+    [writer appendCString:"\" y=\""];
+    [writer appendNumber:origin.y - point.y];
+    [writer appendCString:"\""];
+}
+
+- (void) writeDisplay:(MTDisplay*) display writer:(MTSVGWriter*) writer
+{
+    NSParameterAssert(display);
+    MTDrawCommandList* commands = [[MTDrawCommandList alloc] initWithDisplay:display];
+    CGPoint origin = display.position;
+
+    // The typographic box, extended by any ink outside it.
+    CGRect box = CGRectMake(origin.x, origin.y - display.descent, display.width, display.ascent + display.descent);
+    if (!CGRectIsNull(commands.bounds)) {
+        box = CGRectUnion(box, commands.bounds);
+    }
+    [writer appendCString:"<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" width=\""];
+    [writer appendNumber:CGRectGetWidth(box)];
+    [writer appendCString:"\" height=\""];
+    [writer appendNumber:CGRectGetHeight(box)];
+    [writer appendCString:"\" viewBox=\""];
+    [writer appendNumber:CGRectGetMinX(box) - origin.x];
+    [writer appendCString:" "];
+    [writer appendNumber:origin.y - CGRectGetMaxY(box)];
+    [writer appendCString:" "];
+    [writer appendNumber:CGRectGetWidth(box)];
+    [writer appendCString:" "];
+    [writer appendNumber:CGRectGetHeight(box)];
+    // Parts without a color of their own follow the color of the surrounding text.
+    [writer appendCString:"\" fill=\"currentColor\" style=\"vertical-align:"];
+    [writer appendNumber:CGRectGetMinY(box) - origin.y];
+    [writer appendCString:"px\">\n"];
+
+    // The glyphs, numbered in the order they are first used. Glyphs without an outline get
+    // no number and are left out.
+    CFMutableDictionaryRef fontGlyphs = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    __block NSUInteger glyphCount = 0;
+    [writer appendCString:"<defs>\n"];
+    MTEnumerateGlyphRuns(commands, NSMakeRange(0, commands.count), ^(CTFontRef font, const CGGlyph* glyphs, const CGPoint* positions, NSUInteger count, CGColorRef color) {
+        NSMutableDictionary<NSNumber*, NSNumber*>* ids = (__bridge NSMutableDictionary*) CFDictionaryGetValue(fontGlyphs, font);
+        if (!ids) {
+            ids = [NSMutableDictionary dictionary];
+            CFDictionarySetValue(fontGlyphs, font, (__bridge CFTypeRef) ids);
+        }
+        for (NSUInteger i = 0; i < count; i++) {
+            NSNumber* glyph = @(glyphs[i]);
+            if (ids[glyph]) {
+                continue;
+            }
+            NSData* outline = [self outlineOfGlyph:glyphs[i] font:font];
+            if (outline.length == 0) {
+                ids[glyph] = @(NSNotFound);
+                continue;
+            }
+            ids[glyph] = @(glyphCount);
+            [writer appendCString:"<path id=\"g"];
+            [writer appendUnsignedInteger:glyphCount];
+            [writer appendCString:"\" d=\""];
+            [writer appendBytes:outline.bytes length:outline.length];
+            [writer appendCString:"\"/>\n"];
+            glyphCount++;
+        }
+    }];
+    [writer appendCString:"</defs>\n"];
+
+    // The body, in drawing order. Glyph commands and lines are drawn as their runs.
+    const MTDrawCommand* list = commands.commands;
+    void (^writeRun)(CTFontRef, const CGGlyph*, const CGPoint*, NSUInteger, CGColorRef) =
+    ^(CTFontRef font, const CGGlyph* glyphs, const CGPoint* positions, NSUInteger count, CGColorRef color) {
+        NSDictionary<NSNumber*, NSNumber*>* ids = (__bridge NSDictionary*) CFDictionaryGetValue(fontGlyphs, font);
+        [writer appendCString:"<g"];
+        if (color) {
+            MTSVGWriteColor(writer, "fill", color);
+        }
+        [writer appendCString:">"];
+        for (NSUInteger i = 0; i < count; i++) {
+            NSUInteger glyphId = ids[@(glyphs[i])].unsignedIntegerValue;
+            if (glyphId == NSNotFound) {
+                continue;
+            }
+            [writer appendCString:"<use xlink:href=\"#g"];
+            [writer appendUnsignedInteger:glyphId];
+            [writer appendCString:"\""];
+            MTSVGWritePoint(writer, positions[i], origin);
+            [writer appendCString:"/>"];
+        }
+        [writer appendCString:"</g>\n"];
+    };
+    for (NSUInteger i = 0; i < commands.count; i++) {
+        const MTDrawCommand* command = &list[i];
+        switch (command->type) {
+            case kMTDrawCommandLine:
+            case kMTDrawCommandGlyphs:
+                MTEnumerateGlyphRuns(commands, NSMakeRange(i, 1), writeRun);
+                break;
+
+            case kMTDrawCommandStroke: {
+                [writer appendCString:"<path d=\""];
+                const CGPoint* points = commands.points + command->index;
+                for (NSUInteger p = 0; p + 1 < command->count; p += 2) {
+                    [writer appendCString:"M"];
+                    [writer appendNumber:points[p].x - origin.x];
+                    [writer appendCString:" "];
+                    [writer appendNumber:origin.y - points[p].y];
+                    [writer appendCString:"L"];
+                    [writer appendNumber:points[p + 1].x - origin.x];
+                    [writer appendCString:" "];
+                    [writer appendNumber:origin.y - points[p + 1].y];
+                }
+                [writer appendCString:"\" fill=\"none\""];
+                if (command->color) {
+                    MTSVGWriteColor(writer, "stroke", command->color);
+                } else {
+                    [writer appendCString:" stroke=\"currentColor\""];
+                }
+                [writer appendCString:" stroke-width=\""];
+                [writer appendNumber:command->lineWidth];
+                [writer appendCString:"\""];
+                if (command->lineCap == kCGLineCapRound) {
+                    [writer appendCString:" stroke-linecap=\"round\""];
+                } else if (command->lineCap == kCGLineCapSquare) {
+                    [writer appendCString:" stroke-linecap=\"square\""];
+                }
+                [writer appendCString:"/>\n"];
+                break;
+            }
+
+            case kMTDrawCommandFillRect: {
+                CGRect rect = command->rect;
+                [writer appendCString:"<rect"];
+                MTSVGWritePoint(writer, CGPointMake(CGRectGetMinX(rect), CGRectGetMaxY(rect)), origin);
+                [writer appendCString:" width=\""];
+                [writer appendNumber:CGRectGetWidth(rect)];
+                [writer appendCString:"\" height=\""];
+                [writer appendNumber:CGRectGetHeight(rect)];
+                [writer appendCString:"\""];
+                MTSVGWriteColor(writer, "fill", command->color);
+                [writer appendCString:"/>\n"];
+                break;
+            }
+        }
+    }
+    CFRelease(fontGlyphs);
+    [writer appendCString:"</svg>\n"];
+}
+
+- (BOOL) writeDisplay:(MTDisplay*) display toStream:(NSOutputStream*) stream error:(NSError**) error
+{
+    NSParameterAssert(stream);
+    MTSVGWriter* writer = [[MTSVGWriter alloc] initWithStream:stream];
+    [self writeDisplay:display writer:writer];
+    if (![writer flush]) {
+        if (error) {
+            *error = writer.error;
+        }
+        return NO;
+    }
+    return YES;
+}
+
+- (NSData*) SVGDataForDisplay:(MTDisplay*) display
+{
+    MTSVGWriter* writer = [[MTSVGWriter alloc] initWithStream:nil];
+    [self writeDisplay:display writer:writer];
+    return writer.data;
+}
+
+- (NSString*) SVGStringForDisplay:(MTDisplay*) display
+{
+    return [[NSString alloc] initWithData:[self SVGDataForDisplay:display] encoding:NSUTF8StringEncoding];
+}
+
+@end
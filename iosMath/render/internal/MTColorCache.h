@@ -0,0 +1,21 @@
+//
+//  MTColorCache.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import Foundation;
+
+#import "MTConfig.h"
+#import "../../lib/MTRGBAColor.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// The color for a packed sRGB value, or nil for 0. The colors are made once, around a shared
+/// CGColor, so that the displays of every formula with the same color draw with the same
+/// CGColor. Thread safe.
+FOUNDATION_EXTERN MTColor* _Nullable MTColorForRGBA(MTRGBAColor rgba);
+
+NS_ASSUME_NONNULL_END
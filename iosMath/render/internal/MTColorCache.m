@@ -0,0 +1,47 @@
+//
+//  MTColorCache.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTColorCache.h"
+
+// Formulas use few colors; any more are made again when needed.
+static const NSUInteger kMTColorCacheCountLimit = 256;
+
+static MTColor* MTCreateColor(MTRGBAColor rgba)
+{
+    CGColorSpaceRef sRGB = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGFloat components[4];
+    for (int i = 0; i < 4; i++) {
+        components[i] = ((rgba >> (24 - 8 * i)) & 0xFF) / 255.0;
+    }
+    CGColorRef cgColor = CGColorCreate(sRGB, components);
+    CGColorSpaceRelease(sRGB);
+    MTColor* color = [MTColor colorWithCGColor:cgColor];
+    CGColorRelease(cgColor);
+    return color;
+}
+
+MTColor* MTColorForRGBA(MTRGBAColor rgba)
+{
+    if (rgba == 0) {
+        return nil;
+    }
+    static NSCache<NSNumber*, MTColor*>* cache;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cache = [[NSCache alloc] init];
+        cache.countLimit = kMTColorCacheCountLimit;
+    });
+    // Small NSNumbers are tagged pointers, so the key allocates nothing.
+    NSNumber* key = @(rgba);
+    MTColor* color = [cache objectForKey:key];
+    if (!color) {
+        color = MTCreateColor(rgba);
+        [cache setObject:color forKey:key];
+    }
+    return color;
+}
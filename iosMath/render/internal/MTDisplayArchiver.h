@@ -0,0 +1,119 @@
+//
+//  MTDisplayArchiver.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import CoreText;
+@import Foundation;
+
+#import "MTConfig.h"
+#import "MTFont.h"
+#import "MTMathListDisplay.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** The version of the archive format. Bump it whenever the archived state of a display or
+ the typesetting of the same input changes, so that archives of an older library are not
+ loaded. */
+FOUNDATION_EXPORT const uint16_t MTDisplayArchiveFormatVersion;
+
+/**
+ Writes a display tree into the binary format read by MTDisplayUnarchiver.
+
+ An archive is a header (the format and library versions, and the PostScript name and version
+ of the math font), a table of the fonts used by the tree, and the nodes in pre-order. Every
+ node is a kind byte followed by the state of the display. Integers are LEB128 varints,
+ lengths and coordinates are 32-bit floats and colors are 8-bit sRGB. Fonts are written as
+ an index into the table, so a font is stored once by name and size.
+
+ The displays write themselves with -encodeWithArchiver:, see MTMathListDisplayInternal.h.
+ */
+@interface MTDisplayArchiver : NSObject
+
+- (instancetype) init NS_UNAVAILABLE;
+
+/** `font` is the math font the tree was typeset with. */
+- (instancetype) initWithFont:(MTFont*) font NS_DESIGNATED_INITIALIZER;
+
+@property (nonatomic, readonly) MTFont* font;
+
+/** The archive, or nil if the tree holds something that can not be archived. */
+- (nullable NSData*) finishEncoding;
+
+/** Marks the archive as failed, e.g. for state with no encoding. */
+- (void) fail;
+
+- (void) encodeDisplay:(nullable MTDisplay*) display;
+/** A display that was already encoded, as the number of the node. Displays that are not in
+ the tree are written as nil. */
+- (void) encodeReferenceToDisplay:(nullable MTDisplay*) display;
+
+- (void) encodeUInteger:(NSUInteger) value;
+- (void) encodeBool:(BOOL) value;
+- (void) encodeFloat:(CGFloat) value;
+- (void) encodePoint:(CGPoint) point;
+/** A range whose location may be NSNotFound. */
+- (void) encodeRange:(NSRange) range;
+- (void) encodeColor:(nullable MTColor*) color;
+- (void) encodeCGColor:(nullable CGColorRef) color;
+- (void) encodeString:(NSString*) string;
+/** A copy of the math font of the archive. */
+- (void) encodeFont:(MTFont*) font;
+/** Any font, e.g. of the text of \text. */
+- (void) encodeCTFont:(CTFontRef) font;
+- (void) encodeGlyphs:(const CGGlyph*) glyphs positions:(const CGPoint*) positions count:(NSUInteger) count;
+/** The runs of a string with the font, kern and foreground color attributes. Any other
+ attribute fails the archive. */
+- (void) encodeAttributedString:(NSAttributedString*) string;
+
+@end
+
+/**
+ Reads the displays back from an archive without typesetting them again. The data is read in
+ place, so a memory mapped file is never copied.
+
+ Every decode method returns zero or nil once the data is found to be short or corrupt, and
+ `failed` is then set. The decoded tree has to be discarded in that case.
+ */
+@interface MTDisplayUnarchiver : NSObject
+
+- (instancetype) init NS_UNAVAILABLE;
+
+/** Returns nil if the data is not an archive of this format and library version for the math
+ font `font` (of any size), with the same font version. */
+- (nullable instancetype) initWithData:(NSData*) data font:(MTFont*) font NS_DESIGNATED_INITIALIZER;
+
+/** The math font the archive is decoded with. */
+@property (nonatomic, readonly) MTFont* font;
+
+@property (nonatomic, readonly) BOOL failed;
+/** The number of bytes not decoded yet, to bound the allocations of corrupt archives. */
+@property (nonatomic, readonly) NSUInteger remainingLength;
+
+- (void) fail;
+
+- (nullable MTDisplay*) decodeDisplay;
+- (nullable MTDisplay*) decodeReferencedDisplay;
+
+- (NSUInteger) decodeUInteger;
+- (BOOL) decodeBool;
+- (CGFloat) decodeFloat;
+- (CGPoint) decodePoint;
+- (NSRange) decodeRange;
+- (nullable MTColor*) decodeColor;
+/** The color is owned by the unarchiver. */
+- (nullable CGColorRef) decodeCGColor CF_RETURNS_NOT_RETAINED;
+- (NSString*) decodeString;
+- (nullable MTFont*) decodeFont;
+/** The font is owned by the unarchiver. */
+- (nullable CTFontRef) decodeCTFont CF_RETURNS_NOT_RETAINED;
+/** Returns the number of glyphs. The buffers are malloc'ed and owned by the caller. */
+- (NSUInteger) decodeGlyphs:(CGGlyph* _Nullable * _Nonnull) glyphs positions:(CGPoint* _Nullable * _Nonnull) positions;
+- (NSAttributedString*) decodeAttributedString;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,581 @@
+//
+//  MTDisplayArchiver.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTDisplayArchiver.h"
+#import "MTFont+Internal.h"
+#import "MTMathListDisplayInternal.h"
+
+const uint16_t MTDisplayArchiveFormatVersion = 2;
+
+static const uint8_t kMTArchiveMagic[4] = { 'M', 'T', 'D', 'A' };
+
+// The kinds of the nodes, in the order of their numbers. 0 is a nil display.
+static NSArray<Class>* MTArchivedDisplayClasses(void)
+{
+    static NSArray<Class>* classes;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        classes = @[ MTDisplay.class, MTCTLineDisplay.class, MTTextDisplay.class, MTMathListDisplay.class,
+                     MTFractionDisplay.class, MTRadicalDisplay.class, MTGlyphDisplay.class,
+                     MTGlyphConstructionDisplay.class, MTLargeOpLimitsDisplay.class, MTLineDisplay.class,
+                     MTRuleDisplay.class, MTAccentDisplay.class, MTStackDisplay.class,
+                     MTHorizontalGlyphAssemblyDisplay.class, MTMathBoxDisplay.class, MTInnerDisplay.class ];
+    });
+    return classes;
+}
+
+// The release of the library, compiled in rather than read from a bundle: a library that is linked
+// statically has no bundle of its own, and would find the version of the app. Bump it with every
+// release, since a release may lay out the same formula differently.
+static NSString* const kMTLibraryVersion = @"2.5.0";
+
+// The version of the library the archives are invalidated with: the format version and the release.
+static NSString* MTArchiveLibraryVersion(void)
+{
+    static NSString* version;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        version = [NSString stringWithFormat:@"%u/%@", MTDisplayArchiveFormatVersion, kMTLibraryVersion];
+    });
+    return version;
+}
+
+static NSString* MTFontVersion(CTFontRef font)
+{
+    return CFBridgingRelease(CTFontCopyName(font, kCTFontVersionNameKey)) ?: @"";
+}
+
+static NSString* MTFontPostScriptName(CTFontRef font)
+{
+    return CFBridgingRelease(CTFontCopyPostScriptName(font));
+}
+
+// Colors are 8-bit sRGB, packed as 0xRRGGBBAA.
+static uint32_t MTPackColor(CGColorRef color)
+{
+    CGColorSpaceRef sRGB = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGColorRef converted = CGColorCreateCopyByMatchingToColorSpace(sRGB, kCGRenderingIntentDefault, color, NULL);
+    CGColorSpaceRelease(sRGB);
+    uint32_t packed = 0;
+    if (converted && CGColorGetNumberOfComponents(converted) == 4) {
+        const CGFloat* components = CGColorGetComponents(converted);
+        for (int i = 0; i < 4; i++) {
+            packed = (packed << 8) | (uint32_t) lround(MAX(0, MIN(1, components[i])) * 255);
+        }
+    }
+    CGColorRelease(converted);
+    return packed;
+}
+
+#pragma mark - MTDisplayArchiver
+
+@implementation MTDisplayArchiver {
+    NSMutableData* _body;
+    BOOL _failed;
+    // The font table: the PostScript name and size of each entry, and the entry of a CTFont.
+    NSMutableData* _fonts;
+    NSUInteger _fontCount;
+    NSMutableDictionary<id, NSNumber*>* _fontIndexes;
+    // The number of each finished node, in post-order.
+    NSMapTable<MTDisplay*, NSNumber*>* _nodeNumbers;
+}
+
+- (instancetype) initWithFont:(MTFont*) font
+{
+    NSParameterAssert(font);
+    self = [super init];
+    if (self) {
+        _font = font;
+        _body = [NSMutableData dataWithCapacity:1024];
+        _fonts = [NSMutableData data];
+        _fontIndexes = [NSMutableDictionary dictionary];
+        _nodeNumbers = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsObjectPointerPersonality
+                                             valueOptions:NSPointerFunctionsStrongMemory];
+    }
+    return self;
+}
+
+- (void) fail
+{
+    _failed = YES;
+}
+
+static void MTWriteVarint(NSMutableData* data, uint64_t value)
+{
+    uint8_t bytes[10];
+    NSUInteger count = 0;
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        bytes[count++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    [data appendBytes:bytes length:count];
+}
+
+static void MTWriteString(NSMutableData* data, NSString* string)
+{
+    NSData* utf8 = [string dataUsingEncoding:NSUTF8StringEncoding];
+    MTWriteVarint(data, utf8.length);
+    [data appendData:utf8];
+}
+
+static void MTWriteFloat(NSMutableData* data, CGFloat value)
+{
+    Float32 f = (Float32) value;
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    bits = CFSwapInt32HostToLittle(bits);
+    [data appendBytes:&bits length:sizeof(bits)];
+}
+
+- (NSData*) finishEncoding
+{
+    if (_failed) {
+        return nil;
+    }
+    NSMutableData* archive = [NSMutableData dataWithCapacity:_body.length + _fonts.length + 128];
+    [archive appendBytes:kMTArchiveMagic length:sizeof(kMTArchiveMagic)];
+    MTWriteString(archive, MTArchiveLibraryVersion());
+    MTWriteString(archive, MTFontPostScriptName(_font.ctFont));
+    MTWriteString(archive, MTFontVersion(_font.ctFont));
+    MTWriteVarint(archive, _fontCount);
+    [archive appendData:_fonts];
+    [archive appendData:_body];
+    return archive;
+}
+
+- (void) encodeDisplay:(MTDisplay*) display
+{
+    if (!display) {
+        [self encodeUInteger:0];
+        return;
+    }
+    NSUInteger kind = [MTArchivedDisplayClasses() indexOfObjectIdenticalTo:display.class];
+    if (kind == NSNotFound) {
+        _failed = YES;
+        return;
+    }
+    [self encodeUInteger:kind + 1];
+    [display encodeWithArchiver:self];
+    [_nodeNumbers setObject:@(_nodeNumbers.count) forKey:display];
+}
+
+- (void) encodeReferenceToDisplay:(MTDisplay*) display
+{
+    NSNumber* number = display ? [_nodeNumbers objectForKey:display] : nil;
+    [self encodeUInteger:number ? number.unsignedIntegerValue + 1 : 0];
+}
+
+- (void) encodeUInteger:(NSUInteger) value
+{
+    MTWriteVarint(_body, value);
+}
+
+- (void) encodeBool:(BOOL) value
+{
+    uint8_t byte = value ? 1 : 0;
+    [_body appendBytes:&byte length:1];
+}
+
+- (void) encodeFloat:(CGFloat) value
+{
+    MTWriteFloat(_body, value);
+}
+
+- (void) encodePoint:(CGPoint) point
+{
+    MTWriteFloat(_body, point.x);
+    MTWriteFloat(_body, point.y);
+}
+
+- (void) encodeRange:(NSRange) range
+{
+    MTWriteVarint(_body, (range.location == NSNotFound) ? 0 : (uint64_t) range.location + 1);
+    MTWriteVarint(_body, range.length);
+}
+
+- (void) encodeColor:(MTColor*) color
+{
+    [self encodeCGColor:color.CGColor];
+}
+
+- (void) encodeCGColor:(CGColorRef) color
+{
+    [self encodeBool:color != NULL];
+    if (color) {
+        uint32_t packed = CFSwapInt32HostToBig(MTPackColor(color));
+        [_body appendBytes:&packed length:sizeof(packed)];
+    }
+}
+
+- (void) encodeString:(NSString*) string
+{
+    MTWriteString(_body, string ?: @"");
+}
+
+- (NSUInteger) indexOfFontWithName:(NSString*) name size:(CGFloat) size
+{
+    NSString* key = [NSString stringWithFormat:@"%@|%g", name, size];
+    NSNumber* index = _fontIndexes[key];
+    if (!index) {
+        index = @(_fontCount++);
+        _fontIndexes[key] = index;
+        MTWriteString(_fonts, name);
+        MTWriteFloat(_fonts, size);
+    }
+    return index.unsignedIntegerValue;
+}
+
+- (void) encodeFont:(MTFont*) font
+{
+    [self encodeCTFont:font.ctFont];
+}
+
+- (void) encodeCTFont:(CTFontRef) font
+{
+    if (!font) {
+        _failed = YES;
+        return;
+    }
+    [self encodeUInteger:[self indexOfFontWithName:MTFontPostScriptName(font) size:CTFontGetSize(font)]];
+}
+
+- (void) encodeGlyphs:(const CGGlyph*) glyphs positions:(const CGPoint*) positions count:(NSUInteger) count
+{
+    [self encodeUInteger:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [self encodeUInteger:glyphs[i]];
+        [self encodePoint:positions[i]];
+    }
+}
+
+- (void) encodeAttributedString:(NSAttributedString*) string
+{
+    [self encodeString:string.string];
+    NSMutableArray<NSValue*>* ranges = [NSMutableArray array];
+    NSMutableArray<NSDictionary*>* attributes = [NSMutableArray array];
+    [string enumerateAttributesInRange:NSMakeRange(0, string.length) options:0 usingBlock:^(NSDictionary<NSAttributedStringKey, id>* attrs, NSRange range, BOOL* stop) {
+        [ranges addObject:[NSValue valueWithRange:range]];
+        [attributes addObject:attrs];
+    }];
+    [self encodeUInteger:ranges.count];
+    NSSet<NSString*>* supported = [NSSet setWithObjects:(NSString*) kCTFontAttributeName, (NSString*) kCTKernAttributeName,
+                                   (NSString*) kCTForegroundColorAttributeName, nil];
+    for (NSUInteger i = 0; i < ranges.count; i++) {
+        NSDictionary* attrs = attributes[i];
+        for (NSString* key in attrs) {
+            if (![supported containsObject:key]) {
+                _failed = YES;
+                return;
+            }
+        }
+        [self encodeUInteger:ranges[i].rangeValue.length];
+        id font = attrs[(NSString*) kCTFontAttributeName];
+        [self encodeBool:font != nil];
+        if (font) {
+            [self encodeCTFont:(__bridge CTFontRef) font];
+        }
+        NSNumber* kern = attrs[(NSString*) kCTKernAttributeName];
+        [self encodeBool:kern != nil];
+        if (kern) {
+            [self encodeFloat:kern.doubleValue];
+        }
+        [self encodeCGColor:(__bridge CGColorRef) attrs[(NSString*) kCTForegroundColorAttributeName]];
+    }
+}
+
+@end
+
+#pragma mark - MTDisplayUnarchiver
+
+@implementation MTDisplayUnarchiver {
+    NSData* _data;
+    const uint8_t* _bytes;
+    NSUInteger _length;
+    NSUInteger _offset;
+    NSString* _fontName;
+    // The decoded font table. The math fonts are MTFonts, other fonts only CTFonts.
+    NSMutableArray* _fonts;
+    NSMutableDictionary<NSNumber*, id>* _colors;
+    NSMutableArray<MTDisplay*>* _nodes;
+}
+
+- (instancetype) initWithData:(NSData*) data font:(MTFont*) font
+{
+    NSParameterAssert(data);
+    NSParameterAssert(font);
+    self = [super init];
+    if (self) {
+        _data = data;
+        _bytes = data.bytes;
+        _length = data.length;
+        _font = font;
+        _colors = [NSMutableDictionary dictionary];
+        _nodes = [NSMutableArray array];
+        if (_length < sizeof(kMTArchiveMagic) || memcmp(_bytes, kMTArchiveMagic, sizeof(kMTArchiveMagic)) != 0) {
+            return nil;
+        }
+        _offset = sizeof(kMTArchiveMagic);
+        _fontName = MTFontPostScriptName(font.ctFont);
+        if (![[self decodeString] isEqualToString:MTArchiveLibraryVersion()]
+            || ![[self decodeString] isEqualToString:_fontName]
+            || ![[self decodeString] isEqualToString:MTFontVersion(font.ctFont)]) {
+            return nil;
+        }
+        NSUInteger fontCount = [self decodeUInteger];
+        _fonts = [NSMutableArray arrayWithCapacity:MIN(fontCount, _length)];
+        for (NSUInteger i = 0; i < fontCount && !_failed; i++) {
+            NSString* name = [self decodeString];
+            CGFloat size = [self decodeFloat];
+            if (size <= 0) {
+                _failed = YES;
+            } else if ([name isEqualToString:_fontName]) {
+                [_fonts addObject:(size == font.fontSize) ? font : [font copyFontWithSize:size]];
+            } else {
+                [_fonts addObject:CFBridgingRelease(CTFontCreateWithName((__bridge CFStringRef) name, size, NULL))];
+            }
+        }
+        if (_failed) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void) fail
+{
+    _failed = YES;
+}
+
+- (NSUInteger) remainingLength
+{
+    return _length - _offset;
+}
+
+- (BOOL) canRead:(NSUInteger) count
+{
+    if (_failed || count > _length - _offset) {
+        _failed = YES;
+        return NO;
+    }
+    return YES;
+}
+
+- (MTDisplay*) decodeDisplay
+{
+    NSUInteger kind = [self decodeUInteger];
+    if (kind == 0 || _failed) {
+        return nil;
+    }
+    NSArray<Class>* classes = MTArchivedDisplayClasses();
+    if (kind > classes.count) {
+        _failed = YES;
+        return nil;
+    }
+    MTDisplay* display = [classes[kind - 1] displayWithUnarchiver:self];
+    if (!display) {
+        _failed = YES;
+        return nil;
+    }
+    [_nodes addObject:display];
+    return display;
+}
+
+- (MTDisplay*) decodeReferencedDisplay
+{
+    NSUInteger number = [self decodeUInteger];
+    if (number == 0) {
+        return nil;
+    }
+    if (number > _nodes.count) {
+        _failed = YES;
+        return nil;
+    }
+    return _nodes[number - 1];
+}
+
+- (NSUInteger) decodeUInteger
+{
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (![self canRead:1]) {
+            return 0;
+        }
+        uint8_t byte = _bytes[_offset++];
+        value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return (NSUInteger) value;
+        }
+    }
+    _failed = YES;
+    return 0;
+}
+
+- (BOOL) decodeBool
+{
+    if (![self canRead:1]) {
+        return NO;
+    }
+    return _bytes[_offset++] != 0;
+}
+
+- (CGFloat) decodeFloat
+{
+    if (![self canRead:sizeof(uint32_t)]) {
+        return 0;
+    }
+    uint32_t bits;
+    memcpy(&bits, _bytes + _offset, sizeof(bits));
+    _offset += sizeof(bits);
+    bits = CFSwapInt32LittleToHost(bits);
+    Float32 value;
+    memcpy(&value, &bits, sizeof(value));
+    if (!isfinite(value)) {
+        _failed = YES;
+        return 0;
+    }
+    return value;
+}
+
+- (CGPoint) decodePoint
+{
+    CGFloat x = [self decodeFloat];
+    CGFloat y = [self decodeFloat];
+    return CGPointMake(x, y);
+}
+
+- (NSRange) decodeRange
+{
+    NSUInteger location = [self decodeUInteger];
+    NSUInteger length = [self decodeUInteger];
+    return NSMakeRange(location ? location - 1 : NSNotFound, length);
+}
+
+- (CGColorRef) decodeCGColor
+{
+    if (![self decodeBool] || ![self canRead:sizeof(uint32_t)]) {
+        return NULL;
+    }
+    uint32_t packed;
+    memcpy(&packed, _bytes + _offset, sizeof(packed));
+    _offset += sizeof(packed);
+    packed = CFSwapInt32BigToHost(packed);
+    // The colors of a tree are few, so each one is created once.
+    id color = _colors[@(packed)];
+    if (!color) {
+        CGColorSpaceRef sRGB = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+        CGFloat components[4] = { (packed >> 24) / 255.0, ((packed >> 16) & 0xff) / 255.0,
+                                  ((packed >> 8) & 0xff) / 255.0, (packed & 0xff) / 255.0 };
+        color = CFBridgingRelease(CGColorCreate(sRGB, components));
+        CGColorSpaceRelease(sRGB);
+        _colors[@(packed)] = color;
+    }
+    return (__bridge CGColorRef) color;
+}
+
+- (MTColor*) decodeColor
+{
+    CGColorRef color = [self decodeCGColor];
+    return color ? [MTColor colorWithCGColor:color] : nil;
+}
+
+- (NSString*) decodeString
+{
+    NSUInteger length = [self decodeUInteger];
+    if (![self canRead:length]) {
+        return @"";
+    }
+    NSString* string = [[NSString alloc] initWithBytes:_bytes + _offset length:length encoding:NSUTF8StringEncoding];
+    _offset += length;
+    if (!string) {
+        _failed = YES;
+        return @"";
+    }
+    return string;
+}
+
+- (id) decodeFontEntry
+{
+    NSUInteger index = [self decodeUInteger];
+    if (_failed || index >= _fonts.count) {
+        _failed = YES;
+        return nil;
+    }
+    return _fonts[index];
+}
+
+- (MTFont*) decodeFont
+{
+    id font = [self decodeFontEntry];
+    if (font && ![font isKindOfClass:MTFont.class]) {
+        _failed = YES;
+        return nil;
+    }
+    return font;
+}
+
+- (CTFontRef) decodeCTFont
+{
+    id font = [self decodeFontEntry];
+    if ([font isKindOfClass:MTFont.class]) {
+        return ((MTFont*) font).ctFont;
+    }
+    return (__bridge CTFontRef) font;
+}
+
+- (NSUInteger) decodeGlyphs:(CGGlyph**) glyphs positions:(CGPoint**) positions
+{
+    NSUInteger count = [self decodeUInteger];
+    *glyphs = NULL;
+    *positions = NULL;
+    // Every glyph takes at least 9 bytes, which bounds the allocation by the data.
+    if (_failed || count > (_length - _offset) / 9) {
+        _failed = YES;
+        return 0;
+    }
+    *glyphs = malloc(sizeof(CGGlyph) * count);
+    *positions = malloc(sizeof(CGPoint) * count);
+    for (NSUInteger i = 0; i < count; i++) {
+        (*glyphs)[i] = (CGGlyph) [self decodeUInteger];
+        (*positions)[i] = [self decodePoint];
+    }
+    return count;
+}
+
+- (NSAttributedString*) decodeAttributedString
+{
+    NSString* string = [self decodeString];
+    NSMutableAttributedString* attributedString = [[NSMutableAttributedString alloc] initWithString:string];
+    NSUInteger runCount = [self decodeUInteger];
+    NSUInteger location = 0;
+    for (NSUInteger i = 0; i < runCount && !_failed; i++) {
+        NSUInteger length = [self decodeUInteger];
+        if (length > string.length - location) {
+            _failed = YES;
+            break;
+        }
+        NSRange range = NSMakeRange(location, length);
+        location += length;
+        if ([self decodeBool]) {
+            CTFontRef font = [self decodeCTFont];
+            if (font) {
+                [attributedString addAttribute:(NSString*) kCTFontAttributeName value:(__bridge id) font range:range];
+            }
+        }
+        if ([self decodeBool]) {
+            [attributedString addAttribute:(NSString*) kCTKernAttributeName value:@([self decodeFloat]) range:range];
+        }
+        CGColorRef color = [self decodeCGColor];
+        if (color) {
+            [attributedString addAttribute:(NSString*) kCTForegroundColorAttributeName value:(__bridge id) color range:range];
+        }
+    }
+    return attributedString;
+}
+
+@end
@@ -0,0 +1,39 @@
+//
+//  MTDrawCommandList+Internal.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTDrawCommandList.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** The methods the displays use to compile themselves into a command list.
+ All coordinates are absolute, and `display` is the display that draws the command. */
+@interface MTDrawCommandList (Internal)
+
+- (void) addLine:(CTLineRef) line origin:(CGPoint) origin color:(nullable CGColorRef) color display:(MTDisplay*) display;
+
+/** Adds `count` glyphs drawn at `positions` offset by `offset`. */
+- (void) addGlyphs:(const CGGlyph*) glyphs positions:(nullable const CGPoint*) positions count:(NSUInteger) count
+            offset:(CGPoint) offset font:(CTFontRef) font color:(nullable CGColorRef) color display:(MTDisplay*) display;
+
+/** Adds a stroke of `count` points, consumed pairwise as segments. */
+- (void) addStrokeWithPoints:(const CGPoint*) points count:(NSUInteger) count
+                   lineWidth:(CGFloat) lineWidth lineCap:(CGLineCap) lineCap color:(nullable CGColorRef) color
+                     display:(MTDisplay*) display;
+
+- (void) addFillRect:(CGRect) rect color:(CGColorRef) color display:(MTDisplay*) display;
+
+/** Records the absolute bounds of a display of the compiled tree. */
+- (void) setBounds:(CGRect) bounds forDisplay:(MTDisplay*) display;
+
+/** Gives the glyph and line commands from `index` on that have no color the given color. This
+ is what setting a fill color around the drawing of a child does. */
+- (void) setFillColor:(nullable CGColorRef) color forCommandsFromIndex:(NSUInteger) index;
+
+@end
+
+NS_ASSUME_NONNULL_END
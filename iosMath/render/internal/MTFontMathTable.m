@@ -12,6 +12,7 @@
 #import "MTFontMathTable.h"
 #import "MTFont.h"
 #import "MTFont+Internal.h"
+#import "../../lib/MTInstrumentationInternal.h"
 
 
 @interface MTGlyphPart ()
@@ -425,6 +426,7 @@ static NSString* const kHorizVariants = @"h_variants";
 
 - (NSArray<NSNumber*>*) getVariantsForGlyph:(CGGlyph) glyph inDictionary:(NSDictionary*) variants
 {
+    MTCountEvent(kMTLayoutCounterGlyphVariantLookups);
     NSString* glyphName = [self.font getGlyphName:glyph];
     NSArray* variantGlyphs = (NSArray*) variants[glyphName];
     NSMutableArray* glyphArray = [NSMutableArray arrayWithCapacity:variantGlyphs.count];
@@ -0,0 +1,47 @@
+//
+//  MTLRUCache.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import Foundation;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// A map that evicts its least recently used objects when their total cost is over `costLimit`.
+/// The caches of the renderer keep their objects in one, with the cost in bytes or 1 for each
+/// object. All methods are thread safe.
+///
+/// On iOS the cache is emptied when the application receives a memory warning.
+@interface MTLRUCache<KeyType, ObjectType> : NSObject
+
+- (instancetype) init NS_UNAVAILABLE;
+
+- (instancetype) initWithCostLimit:(NSUInteger) costLimit NS_DESIGNATED_INITIALIZER;
+
+/// The highest total cost kept. Lowering it evicts objects right away.
+@property (nonatomic) NSUInteger costLimit;
+
+/// The total cost of the objects in the cache.
+@property (nonatomic, readonly) NSUInteger totalCost;
+
+/// The number of objects in the cache.
+@property (nonatomic, readonly) NSUInteger count;
+
+/// The object for `key`, which becomes the most recently used one.
+- (nullable ObjectType) objectForKey:(KeyType) key;
+
+/// Adds `object` as the most recently used one, replacing the object of `key` if there is one,
+/// and evicts the least recently used objects until the total cost is within the limit. An object
+/// that costs more than the limit by itself is not kept.
+- (void) setObject:(ObjectType) object forKey:(KeyType) key cost:(NSUInteger) cost;
+
+- (void) removeObjectForKey:(KeyType) key;
+
+- (void) removeAllObjects;
+
+@end
+
+NS_ASSUME_NONNULL_END
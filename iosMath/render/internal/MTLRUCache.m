@@ -0,0 +1,197 @@
+//
+//  MTLRUCache.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTLRUCache.h"
+#import "MTConfig.h"
+
+// An object and its place in the recency list. The dictionary of the cache owns the entries,
+// the list only points at them.
+@interface MTLRUCacheEntry : NSObject {
+    @public
+    id _key;
+    id _object;
+    NSUInteger _cost;
+    __unsafe_unretained MTLRUCacheEntry* _newer;
+    __unsafe_unretained MTLRUCacheEntry* _older;
+}
+@end
+
+@implementation MTLRUCacheEntry
+@end
+
+@implementation MTLRUCache {
+    NSMutableDictionary<id, MTLRUCacheEntry*>* _entries;
+    // The ends of the recency list, evicted from the oldest end.
+    __unsafe_unretained MTLRUCacheEntry* _newest;
+    __unsafe_unretained MTLRUCacheEntry* _oldest;
+    NSUInteger _totalCost;
+    id _memoryWarningObserver;
+}
+
+- (instancetype) initWithCostLimit:(NSUInteger) costLimit
+{
+    self = [super init];
+    if (self) {
+        _costLimit = costLimit;
+        _entries = [[NSMutableDictionary alloc] init];
+#if TARGET_OS_IPHONE
+        __weak MTLRUCache* weakSelf = self;
+        _memoryWarningObserver = [[NSNotificationCenter defaultCenter] addObserverForName:UIApplicationDidReceiveMemoryWarningNotification
+                                                                                   object:nil queue:nil
+                                                                               usingBlock:^(NSNotification* note) {
+            [weakSelf removeAllObjects];
+        }];
+#endif
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_memoryWarningObserver) {
+        [[NSNotificationCenter defaultCenter] removeObserver:_memoryWarningObserver];
+    }
+}
+
+#pragma mark - Recency list (called with the lock held)
+
+- (void) unlinkEntry:(MTLRUCacheEntry*) entry
+{
+    if (entry->_newer) {
+        entry->_newer->_older = entry->_older;
+    } else {
+        _newest = entry->_older;
+    }
+    if (entry->_older) {
+        entry->_older->_newer = entry->_newer;
+    } else {
+        _oldest = entry->_newer;
+    }
+    entry->_newer = nil;
+    entry->_older = nil;
+}
+
+- (void) linkNewestEntry:(MTLRUCacheEntry*) entry
+{
+    entry->_older = _newest;
+    entry->_newer = nil;
+    if (_newest) {
+        _newest->_newer = entry;
+    } else {
+        _oldest = entry;
+    }
+    _newest = entry;
+}
+
+- (void) removeEntry:(MTLRUCacheEntry*) entry
+{
+    [self unlinkEntry:entry];
+    _totalCost -= entry->_cost;
+    // Last, the dictionary owns the entry.
+    [_entries removeObjectForKey:entry->_key];
+}
+
+- (void) evictToLimit
+{
+    while (_totalCost > _costLimit && _oldest) {
+        [self removeEntry:_oldest];
+    }
+}
+
+#pragma mark - Public
+
+- (NSUInteger) costLimit
+{
+    @synchronized (self) {
+        return _costLimit;
+    }
+}
+
+- (void) setCostLimit:(NSUInteger) costLimit
+{
+    @synchronized (self) {
+        _costLimit = costLimit;
+        [self evictToLimit];
+    }
+}
+
+- (NSUInteger) totalCost
+{
+    @synchronized (self) {
+        return _totalCost;
+    }
+}
+
+- (NSUInteger) count
+{
+    @synchronized (self) {
+        return _entries.count;
+    }
+}
+
+- (id) objectForKey:(id) key
+{
+    NSParameterAssert(key);
+    @synchronized (self) {
+        MTLRUCacheEntry* entry = _entries[key];
+        if (!entry) {
+            return nil;
+        }
+        if (entry != _newest) {
+            [self unlinkEntry:entry];
+            [self linkNewestEntry:entry];
+        }
+        return entry->_object;
+    }
+}
+
+- (void) setObject:(id) object forKey:(id) key cost:(NSUInteger) cost
+{
+    NSParameterAssert(object);
+    NSParameterAssert(key);
+    @synchronized (self) {
+        MTLRUCacheEntry* existing = _entries[key];
+        if (existing) {
+            [self removeEntry:existing];
+        }
+        if (cost > _costLimit) {
+            return;
+        }
+        MTLRUCacheEntry* entry = [[MTLRUCacheEntry alloc] init];
+        entry->_key = [key copy];
+        entry->_object = object;
+        entry->_cost = cost;
+        _entries[entry->_key] = entry;
+        [self linkNewestEntry:entry];
+        _totalCost += cost;
+        [self evictToLimit];
+    }
+}
+
+- (void) removeObjectForKey:(id) key
+{
+    NSParameterAssert(key);
+    @synchronized (self) {
+        MTLRUCacheEntry* entry = _entries[key];
+        if (entry) {
+            [self removeEntry:entry];
+        }
+    }
+}
+
+- (void) removeAllObjects
+{
+    @synchronized (self) {
+        [_entries removeAllObjects];
+        _newest = nil;
+        _oldest = nil;
+        _totalCost = 0;
+    }
+}
+
+@end
@@ -0,0 +1,32 @@
+//
+//  MTMathAlphanumerics.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import Foundation;
+
+#import "../../lib/MTMathList.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// The largest number of UTF-16 code units a character can become when styled.
+static const NSUInteger kMTMathAlphanumericMaxLength __attribute__((unused)) = 2;
+
+/// The character of the Unicode Mathematical Alphanumeric Symbols (or of the Letterlike Symbols
+/// that fill its holes, such as ℎ, ℬ and ℭ) for `ch` in `style`. Characters that have no
+/// styled form, and all characters in `kMTFontStyleRoman`, are returned unchanged.
+FOUNDATION_EXTERN UTF32Char MTMathAlphanumericCharacter(unichar ch, MTFontStyle style);
+
+/// Styles `length` characters and writes them to `output` as UTF-16, surrogate pairs included.
+/// `output` must have room for `length * kMTMathAlphanumericMaxLength` characters and may not
+/// overlap `characters`. Returns the number of characters written. Does not allocate.
+FOUNDATION_EXTERN NSUInteger MTMathAlphanumericWriteCharacters(const unichar* characters, NSUInteger length,
+                                                               MTFontStyle style, unichar* output);
+
+/// `string` in `style`. Returns `string` itself when none of its characters change.
+FOUNDATION_EXTERN NSString* MTMathAlphanumericString(NSString* string, MTFontStyle style);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,289 @@
+//
+//  MTMathAlphanumerics.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTMathAlphanumerics.h"
+
+// Characters first...last map to target, target + 1, ... target + (last - first).
+typedef struct {
+    unichar first;
+    unichar last;
+    UTF32Char target;
+} MTAlphanumericRange;
+
+// The tables of each style, sorted and without overlaps. They list every character that changes:
+// Latin letters, digits, Greek letters and the Greek symbols ϵ ϑ ϰ ϕ ϱ ϖ (which follow the
+// alphabet in the Unicode blocks), with the Letterlike Symbols in the holes of the Mathematical
+// Alphanumeric Symbols as ranges of their own. Styles which Latin Modern Math lacks for some
+// characters (lowercase script, Greek typewriter, ...) fall back to the default style, which
+// is italic except for digits and capital Greek.
+//
+// The tables reproduce the per-style functions that the typesetter used before, which
+// MTMathAlphanumericsTest checks for every character.
+
+static const MTAlphanumericRange kMTDefaultRanges[] = {
+    { 'A', 'Z', 0x1D434 },
+    { 'a', 'g', 0x1D44E },
+    { 'h', 'h', 0x210E },
+    { 'i', 'z', 0x1D456 },
+    { 0x03B1, 0x03C9, 0x1D6FC },
+    { 0x03D1, 0x03D1, 0x1D717 },
+    { 0x03D5, 0x03D5, 0x1D719 },
+    { 0x03D6, 0x03D6, 0x1D71B },
+    { 0x03F0, 0x03F0, 0x1D718 },
+    { 0x03F1, 0x03F1, 0x1D71A },
+    { 0x03F5, 0x03F5, 0x1D716 },
+};
+
+static const MTAlphanumericRange kMTBoldRanges[] = {
+    { '0', '9', 0x1D7CE },
+    { 'A', 'Z', 0x1D400 },
+    { 'a', 'z', 0x1D41A },
+    { 0x0391, 0x03A9, 0x1D6A8 },
+    { 0x03B1, 0x03C9, 0x1D6C2 },
+    { 0x03D1, 0x03D1, 0x1D6DD },
+    { 0x03D5, 0x03D5, 0x1D6DF },
+    { 0x03D6, 0x03D6, 0x1D6E1 },
+    { 0x03F0, 0x03F0, 0x1D6DE },
+    { 0x03F1, 0x03F1, 0x1D6E0 },
+    { 0x03F5, 0x03F5, 0x1D6DC },
+};
+
+static const MTAlphanumericRange kMTCaligraphicRanges[] = {
+    { 'A', 'A', 0x1D49C },
+    { 'B', 'B', 0x212C },
+    { 'C', 'D', 0x1D49E },
+    { 'E', 'F', 0x2130 },
+    { 'G', 'G', 0x1D4A2 },
+    { 'H', 'H', 0x210B },
+    { 'I', 'I', 0x2110 },
+    { 'J', 'K', 0x1D4A5 },
+    { 'L', 'L', 0x2112 },
+    { 'M', 'M', 0x2133 },
+    { 'N', 'Q', 0x1D4A9 },
+    { 'R', 'R', 0x211B },
+    { 'S', 'Z', 0x1D4AE },
+    { 'a', 'd', 0x1D44E },
+    { 'e', 'e', 0x212F },
+    { 'f', 'f', 0x1D453 },
+    { 'g', 'g', 0x210A },
+    { 'h', 'h', 0x210E },
+    { 'i', 'n', 0x1D456 },
+    { 'o', 'o', 0x2134 },
+    { 'p', 'z', 0x1D45D },
+    { 0x03B1, 0x03C9, 0x1D6FC },
+    { 0x03D1, 0x03D1, 0x1D717 },
+    { 0x03D5, 0x03D5, 0x1D719 },
+    { 0x03D6, 0x03D6, 0x1D71B },
+    { 0x03F0, 0x03F0, 0x1D718 },
+    { 0x03F1, 0x03F1, 0x1D71A },
+    { 0x03F5, 0x03F5, 0x1D716 },
+};
+
+static const MTAlphanumericRange kMTTypewriterRanges[] = {
+    { '0', '9', 0x1D7F6 },
+    { 'A', 'Z', 0x1D670 },
+    { 'a', 'z', 0x1D68A },
+    { 0x03B1, 0x03C9, 0x1D6FC },
+    { 0x03D1, 0x03D1, 0x1D717 },
+    { 0x03D5, 0x03D5, 0x1D719 },
+    { 0x03D6, 0x03D6, 0x1D71B },
+    { 0x03F0, 0x03F0, 0x1D718 },
+    { 0x03F1, 0x03F1, 0x1D71A },
+    { 0x03F5, 0x03F5, 0x1D716 },
+};
+
+static const MTAlphanumericRange kMTItalicRanges[] = {
+    { 'A', 'Z', 0x1D434 },
+    { 'a', 'g', 0x1D44E },
+    { 'h', 'h', 0x210E },
+    { 'i', 'z', 0x1D456 },
+    { 0x0391, 0x03A9, 0x1D6E2 },
+    { 0x03B1, 0x03C9, 0x1D6FC },
+    { 0x03D1, 0x03D1, 0x1D717 },
+    { 0x03D5, 0x03D5, 0x1D719 },
+    { 0x03D6, 0x03D6, 0x1D71B },
+    { 0x03F0, 0x03F0, 0x1D718 },
+    { 0x03F1, 0x03F1, 0x1D71A },
+    { 0x03F5, 0x03F5, 0x1D716 },
+};
+
+static const MTAlphanumericRange kMTSansSerifRanges[] = {
+    { '0', '9', 0x1D7E2 },
+    { 'A', 'Z', 0x1D5A0 },
+    { 'a', 'z', 0x1D5BA },
+    { 0x03B1, 0x03C9, 0x1D6FC },
+    { 0x03D1, 0x03D1, 0x1D717 },
+    { 0x03D5, 0x03D5, 0x1D719 },
+    { 0x03D6, 0x03D6, 0x1D71B },
+    { 0x03F0, 0x03F0, 0x1D718 },
+    { 0x03F1, 0x03F1, 0x1D71A },
+    { 0x03F5, 0x03F5, 0x1D716 },
+};
+
+static const MTAlphanumericRange kMTFrakturRanges[] = {
+    { 'A', 'B', 0x1D504 },
+    { 'C', 'C', 0x212D },
+    { 'D', 'G', 0x1D507 },
+    { 'H', 'H', 0x210C },
+    { 'I', 'I', 0x2111 },
+    { 'J', 'Q', 0x1D50D },
+    { 'R', 'R', 0x211C },
+    { 'S', 'Y', 0x1D516 },
+    { 'Z', 'Z', 0x2128 },
+    { 'a', 'z', 0x1D51E },
+    { 0x03B1, 0x03C9, 0x1D6FC },
+    { 0x03D1, 0x03D1, 0x1D717 },
+    { 0x03D5, 0x03D5, 0x1D719 },
+    { 0x03D6, 0x03D6, 0x1D71B },
+    { 0x03F0, 0x03F0, 0x1D718 },
+    { 0x03F1, 0x03F1, 0x1D71A },
+    { 0x03F5, 0x03F5, 0x1D716 },
+};
+
+static const MTAlphanumericRange kMTBlackboardRanges[] = {
+    { '0', '9', 0x1D7D8 },
+    { 'A', 'B', 0x1D538 },
+    { 'C', 'C', 0x2102 },
+    { 'D', 'G', 0x1D53B },
+    { 'H', 'H', 0x210D },
+    { 'I', 'M', 0x1D540 },
+    { 'N', 'N', 0x2115 },
+    { 'O', 'O', 0x1D546 },
+    { 'P', 'Q', 0x2119 },
+    { 'R', 'R', 0x211D },
+    { 'S', 'Y', 0x1D54A },
+    { 'Z', 'Z', 0x2124 },
+    { 'a', 'z', 0x1D552 },
+    { 0x03B1, 0x03C9, 0x1D6FC },
+    { 0x03D1, 0x03D1, 0x1D717 },
+    { 0x03D5, 0x03D5, 0x1D719 },
+    { 0x03D6, 0x03D6, 0x1D71B },
+    { 0x03F0, 0x03F0, 0x1D718 },
+    { 0x03F1, 0x03F1, 0x1D71A },
+    { 0x03F5, 0x03F5, 0x1D716 },
+};
+
+static const MTAlphanumericRange kMTBoldItalicRanges[] = {
+    { '0', '9', 0x1D7CE },
+    { 'A', 'Z', 0x1D468 },
+    { 'a', 'z', 0x1D482 },
+    { 0x0391, 0x03A9, 0x1D71C },
+    { 0x03B1, 0x03C9, 0x1D736 },
+    { 0x03D1, 0x03D1, 0x1D751 },
+    { 0x03D5, 0x03D5, 0x1D753 },
+    { 0x03D6, 0x03D6, 0x1D755 },
+    { 0x03F0, 0x03F0, 0x1D752 },
+    { 0x03F1, 0x03F1, 0x1D754 },
+    { 0x03F5, 0x03F5, 0x1D750 },
+};
+
+typedef struct {
+    const MTAlphanumericRange* ranges;
+    NSUInteger count;
+} MTAlphanumericTable;
+
+#define MT_TABLE(ranges) { ranges, sizeof(ranges) / sizeof(ranges[0]) }
+
+// Indexed by MTFontStyle. Roman leaves everything unchanged.
+static const MTAlphanumericTable kMTAlphanumericTables[] = {
+    [kMTFontStyleDefault] = MT_TABLE(kMTDefaultRanges),
+    [kMTFontStyleRoman] = { NULL, 0 },
+    [kMTFontStyleBold] = MT_TABLE(kMTBoldRanges),
+    [kMTFontStyleCaligraphic] = MT_TABLE(kMTCaligraphicRanges),
+    [kMTFontStyleTypewriter] = MT_TABLE(kMTTypewriterRanges),
+    [kMTFontStyleItalic] = MT_TABLE(kMTItalicRanges),
+    [kMTFontStyleSansSerif] = MT_TABLE(kMTSansSerifRanges),
+    [kMTFontStyleFraktur] = MT_TABLE(kMTFrakturRanges),
+    [kMTFontStyleBlackboard] = MT_TABLE(kMTBlackboardRanges),
+    [kMTFontStyleBoldItalic] = MT_TABLE(kMTBoldItalicRanges),
+};
+
+#undef MT_TABLE
+
+// Strings up to this length are styled without a heap buffer, which holds the input followed
+// by up to kMTMathAlphanumericMaxLength characters of output per input character.
+enum {
+    kMTAlphanumericStackLength = 256,
+    kMTAlphanumericStackBufferLength = kMTAlphanumericStackLength * 3,
+};
+
+static inline MTAlphanumericTable MTAlphanumericTableForStyle(MTFontStyle style)
+{
+    // Unknown styles are left unchanged, like roman.
+    if (style >= sizeof(kMTAlphanumericTables) / sizeof(kMTAlphanumericTables[0])) {
+        return (MTAlphanumericTable) { NULL, 0 };
+    }
+    return kMTAlphanumericTables[style];
+}
+
+static inline UTF32Char MTAlphanumericLookup(MTAlphanumericTable table, unichar ch)
+{
+    if (table.count == 0 || ch < table.ranges[0].first || ch > table.ranges[table.count - 1].last) {
+        return ch;
+    }
+    NSUInteger low = 0, high = table.count;
+    while (low < high) {
+        NSUInteger mid = (low + high) / 2;
+        const MTAlphanumericRange* range = &table.ranges[mid];
+        if (ch > range->last) {
+            low = mid + 1;
+        } else if (ch < range->first) {
+            high = mid;
+        } else {
+            return range->target + (ch - range->first);
+        }
+    }
+    return ch;
+}
+
+UTF32Char MTMathAlphanumericCharacter(unichar ch, MTFontStyle style)
+{
+    return MTAlphanumericLookup(MTAlphanumericTableForStyle(style), ch);
+}
+
+NSUInteger MTMathAlphanumericWriteCharacters(const unichar* characters, NSUInteger length, MTFontStyle style, unichar* output)
+{
+    MTAlphanumericTable table = MTAlphanumericTableForStyle(style);
+    NSUInteger written = 0;
+    for (NSUInteger i = 0; i < length; i++) {
+        UTF32Char unicode = MTAlphanumericLookup(table, characters[i]);
+        if (unicode <= 0xFFFF) {
+            output[written++] = (unichar) unicode;
+        } else {
+            unicode -= 0x10000;
+            output[written++] = (unichar) (0xD800 + (unicode >> 10));
+            output[written++] = (unichar) (0xDC00 + (unicode & 0x3FF));
+        }
+    }
+    return written;
+}
+
+NSString* MTMathAlphanumericString(NSString* string, MTFontStyle style)
+{
+    NSUInteger length = string.length;
+    if (length == 0 || MTAlphanumericTableForStyle(style).count == 0) {
+        return string;
+    }
+    unichar stackBuffer[kMTAlphanumericStackBufferLength];
+    unichar* buffer = (length <= kMTAlphanumericStackLength) ? stackBuffer : malloc(sizeof(unichar) * length * (1 + kMTMathAlphanumericMaxLength));
+    if (!buffer) {
+        return string;
+    }
+    unichar* input = buffer;
+    unichar* output = buffer + length;
+    [string getCharacters:input range:NSMakeRange(0, length)];
+    NSUInteger outputLength = MTMathAlphanumericWriteCharacters(input, length, style, output);
+    NSString* result = string;
+    if (outputLength != length || memcmp(input, output, sizeof(unichar) * length) != 0) {
+        result = [[NSString alloc] initWithCharacters:output length:outputLength];
+    }
+    if (buffer != stackBuffer) {
+        free(buffer);
+    }
+    return result;
+}
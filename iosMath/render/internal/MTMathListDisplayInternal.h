@@ -12,6 +12,11 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+@class MTDrawCommandList;
+@class MTDisplayArchiver;
+@class MTDisplayUnarchiver;
+@class MTTextRun;
+
 @interface MTDisplay ()
 
 @property (nonatomic) CGFloat ascent;
@@ -25,6 +30,32 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic) NSRange range;
 @property (nonatomic) BOOL hasScript;
 
+// Compiles the display into absolute draw commands, mirroring -draw:. `origin` is the origin
+// of the coordinate space that this display's position is relative to.
+- (void) appendDrawCommands:(MTDrawCommandList*) commands origin:(CGPoint) origin;
+
+// Hit testing, see -[MTMathListDisplay closestIndexToPoint:caretOffset:]. Points and
+// rectangles are in the coordinate space this display's position is relative to. Indexes
+// are in the list that contains this display, except for an MTMathListDisplay whose
+// indexes are in its own list.
+// The index closest to `point`.
+- (nullable MTMathListIndex*) closestIndexToPoint:(CGPoint) point;
+// The x of a caret at `index`, which is a level 0 or nucleus index at this display.
+- (CGFloat) caretOffsetForIndex:(MTMathListIndex*) index;
+// The caret rectangle for an index that goes into a child list of this display (a
+// numerator, an inner list, ...), or CGRectNull if it has no such child.
+- (CGRect) caretRectForChildIndex:(MTMathListIndex*) index;
+
+// Archiving, see MTDisplayArchiver.h. -encodeWithArchiver: writes the state of MTDisplay
+// and then -encodeContentsWithArchiver:, which subclasses override to write their own state
+// and children. +displayWithUnarchiver: reads them back in the same order, creating the
+// display with +decodeContentsWithUnarchiver:. The stored metrics and positions are restored
+// as they were, so nothing is laid out again.
+- (void) encodeWithArchiver:(MTDisplayArchiver*) archiver;
+- (void) encodeContentsWithArchiver:(MTDisplayArchiver*) archiver;
++ (nullable instancetype) displayWithUnarchiver:(MTDisplayUnarchiver*) unarchiver;
++ (nullable instancetype) decodeContentsWithUnarchiver:(MTDisplayUnarchiver*) unarchiver;
+
 @end
 
 // The Downshift protocol allows an MTDisplay to be shifted down by a given amount.
@@ -34,6 +65,24 @@ NS_ASSUME_NONNULL_BEGIN
 
 @end
 
+// The keys of MTMathListDisplay.childLayouts: the index of the atom in the high 32 bits and
+// the slot in the low ones. A slot is the MTMathListSubIndexType that addresses the child
+// list, or one of the typesetter's own slots above those for lists it can not address.
+static inline NSNumber* MTLayoutKey(NSUInteger atomIndex, NSUInteger slot)
+{
+    return @(((unsigned long long) atomIndex << 32) | slot);
+}
+
+static inline NSUInteger MTLayoutKeyAtomIndex(NSNumber* key)
+{
+    return (NSUInteger) (key.unsignedLongLongValue >> 32);
+}
+
+static inline NSUInteger MTLayoutKeySlot(NSNumber* key)
+{
+    return (NSUInteger) (key.unsignedLongLongValue & 0xffffffff);
+}
+
 @interface MTMathListDisplay ()
 
 - (instancetype)init NS_UNAVAILABLE;
@@ -43,11 +92,24 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic, readwrite) MTLinePosition type;
 @property (nonatomic, readwrite) NSUInteger index;
 
+// Bookkeeping written by MTTypesetter so an incremental layout can adopt parts of this
+// display. layoutFont is nil for displays the typesetter did not build.
+@property (nonatomic, nullable) MTFont* layoutFont;
+@property (nonatomic) MTLineStyle layoutStyle;
+@property (nonatomic) BOOL layoutCramped;
+@property (nonatomic) BOOL layoutScaleInvariant;
+// The displays of the child lists (numerators, scripts, cells, ...) laid out for the
+// atoms of this list, keyed by MTLayoutKey. See MTTypesetter.m.
+@property (nonatomic, nullable) NSDictionary<NSNumber*, MTMathListDisplay*>* childLayouts;
+
 @end
 
 @interface MTCTLineDisplay ()
 
-- (instancetype)initWithString:(NSAttributedString*) attrString position:(CGPoint)position range:(NSRange) range font:(MTFont*) font atoms:(NSArray<MTMathAtom*>*) atoms NS_DESIGNATED_INITIALIZER;
+// Only the lengths of the nuclei of the atoms are needed for hit testing, the atoms
+// themselves are kept if `retainAtoms`.
+- (instancetype)initWithString:(NSAttributedString*) attrString position:(CGPoint)position range:(NSRange) range font:(MTFont*) font
+                         atoms:(NSArray<MTMathAtom*>*) atoms retainAtoms:(BOOL) retainAtoms NS_DESIGNATED_INITIALIZER;
 
 - (instancetype)init NS_UNAVAILABLE;
 
@@ -56,7 +118,7 @@ NS_ASSUME_NONNULL_BEGIN
 @interface MTTextDisplay ()
 
 /**
- Designated initializer.
+ Shapes `text` in `ctFont`.
  - `text`: raw body (already escape-processed).
  - `textStyle`: the requested style — used for introspection only;
    `ctFont` already encodes traits.
@@ -67,6 +129,15 @@ NS_ASSUME_NONNULL_BEGIN
 - (instancetype) initWithText:(NSString*) text
                     textStyle:(MTTextStyle) textStyle
                        ctFont:(CTFontRef) ctFont
+                        range:(NSRange) range;
+
+/**
+ Designated initializer. Displays `run`, which is shaped already and may be
+ shared with other displays (see `MTTextRunCache`).
+ */
+- (instancetype) initWithText:(NSString*) text
+                    textStyle:(MTTextStyle) textStyle
+                          run:(MTTextRun*) run
                         range:(NSRange) range NS_DESIGNATED_INITIALIZER;
 
 - (instancetype) init NS_UNAVAILABLE;
@@ -109,7 +180,8 @@ NS_ASSUME_NONNULL_BEGIN
 @interface MTGlyphConstructionDisplay : MTDisplay<DownShift>
 
 - (instancetype) init NS_UNAVAILABLE;
-- (instancetype) initWithGlyphs:(NSArray<NSNumber*>*) glyphs offsets:(NSArray<NSNumber*>*) offsets font:(MTFont*) font NS_DESIGNATED_INITIALIZER;
+// Takes ownership of `glyphs` and `positions`, which are malloc'd arrays of `count` elements.
+- (instancetype) initWithGlyphs:(CGGlyph*) glyphs positions:(CGPoint*) positions count:(NSUInteger) count font:(MTFont*) font NS_DESIGNATED_INITIALIZER;
 
 @end
 
@@ -176,12 +248,13 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (instancetype)init NS_UNAVAILABLE;
 
-/// @param glyphs  Array of CGGlyph values (as NSNumber shortValue).
-/// @param positions  Array of CGPoint values (as NSValue CGPointValue); x=horizontal offset, y=0.
+/// @param glyphs  A malloc'd array of `count` glyphs, which the display takes ownership of.
+/// @param positions  A malloc'd array of `count` positions, owned likewise; x=horizontal offset, y=0.
 /// @param font  The font used to draw the glyphs.
 /// @param range  Source range in the parent math list.
-- (instancetype)initWithGlyphs:(NSArray<NSNumber*>*) glyphs
-                     positions:(NSArray<NSValue*>*) positions
+- (instancetype)initWithGlyphs:(CGGlyph*) glyphs
+                     positions:(CGPoint*) positions
+                         count:(NSUInteger) count
                           font:(MTFont*) font
                          range:(NSRange) range NS_DESIGNATED_INITIALIZER;
 
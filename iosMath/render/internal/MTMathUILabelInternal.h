@@ -31,6 +31,10 @@ NS_ASSUME_NONNULL_BEGIN
 // layout directly and cross-platform.
 - (void)layoutSubviews;
 
+// True while `layoutsAsynchronously` is set and the layout of the current content has not been
+// installed yet (it may not have been started either, layout and sizing start it).
+@property (nonatomic, readonly, getter=isAsynchronousLayoutPending) BOOL asynchronousLayoutPending;
+
 @end
 
 NS_ASSUME_NONNULL_END
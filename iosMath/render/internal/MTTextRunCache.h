@@ -0,0 +1,63 @@
+//
+//  MTTextRunCache.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import Foundation;
+@import CoreText;
+
+#import "../../lib/MTMathList.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// A run of `\text` shaped by CoreText, with its metrics. Runs are immutable and are shared by
+/// the displays of any number of formulas, on any thread.
+@interface MTTextRun : NSObject
+
+- (instancetype) init NS_UNAVAILABLE;
+
+/// Shapes `text` in `font`. Font fallback (for CJK, Arabic, ...) happens here, once.
++ (instancetype) runWithText:(NSString*) text font:(CTFontRef) font;
+
+@property (nonatomic, readonly) NSAttributedString* attributedString;
+@property (nonatomic, readonly) CTLineRef line;
+@property (nonatomic, readonly) CGFloat width;
+@property (nonatomic, readonly) CGFloat ascent;
+@property (nonatomic, readonly) CGFloat descent;
+/// The right edge of the ink.
+@property (nonatomic, readonly) CGFloat inkMaxX;
+
+@end
+
+/// A cache of shaped text runs keyed by the text, its style and its size. When there are more
+/// than `countLimit` runs, the least recently used ones are evicted. All methods are thread safe.
+///
+/// On iOS the shared cache is emptied when the application receives a memory warning.
+@interface MTTextRunCache : NSObject
+
+/// The cache used by the typesetter. Its limit is 512 runs.
++ (instancetype) sharedCache;
+
+- (instancetype) initWithCountLimit:(NSUInteger) countLimit NS_DESIGNATED_INITIALIZER;
+
+/// Creates a cache with a limit of 512 runs.
+- (instancetype) init;
+
+/// The most runs kept. Lowering it evicts runs right away, and 0 disables the cache.
+@property (nonatomic) NSUInteger countLimit;
+
+/// The number of cached runs.
+@property (nonatomic, readonly) NSUInteger count;
+
+/// The run of `text` in the text font of `style` and `size` (see
+/// `+[MTFontManager textCTFontForStyle:size:]`), shaping and adding it on a miss.
+- (MTTextRun*) runForText:(NSString*) text style:(MTTextStyle) style size:(CGFloat) size;
+
+- (void) removeAllRuns;
+
+@end
+
+NS_ASSUME_NONNULL_END
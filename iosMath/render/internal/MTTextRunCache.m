@@ -0,0 +1,165 @@
+//
+//  MTTextRunCache.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTTextRunCache.h"
+#import "MTFontManager.h"
+#import "MTLRUCache.h"
+#import "../../lib/MTInstrumentationInternal.h"
+
+static const NSUInteger kMTDefaultTextRunCountLimit = 512;
+
+@implementation MTTextRun
+
+- (instancetype) initWithAttributedString:(NSAttributedString*) attributedString
+{
+    self = [super init];
+    if (self) {
+        _attributedString = attributedString;
+        MTCountEvent(kMTLayoutCounterCTLines);
+        _line = CTLineCreateWithAttributedString((__bridge CFAttributedStringRef) attributedString);
+        _width = (CGFloat) CTLineGetTypographicBounds(_line, NULL, NULL, NULL);
+        CGRect bounds = CTLineGetBoundsWithOptions(_line, kCTLineBoundsUseGlyphPathBounds);
+        _ascent = MAX(0, CGRectGetMaxY(bounds));
+        _descent = MAX(0, -CGRectGetMinY(bounds));
+        _inkMaxX = CGRectGetMaxX(bounds);
+    }
+    return self;
+}
+
++ (instancetype) runWithText:(NSString*) text font:(CTFontRef) font
+{
+    NSParameterAssert(font);
+    // The run is drawn in the fill color of the context, so displays of any color can share it.
+    NSDictionary* attrs = @{ (NSString*) kCTFontAttributeName : (__bridge id) font,
+                             (NSString*) kCTForegroundColorFromContextAttributeName : @YES };
+    NSAttributedString* attributedString = [[NSAttributedString alloc] initWithString:text ?: @"" attributes:attrs];
+    return [[self alloc] initWithAttributedString:attributedString];
+}
+
+- (void)dealloc
+{
+    if (_line) {
+        CFRelease(_line);
+    }
+}
+
+@end
+
+// The key of a run.
+@interface MTTextRunKey : NSObject <NSCopying> {
+    @public
+    NSString* _text;
+    MTTextStyle _style;
+    CGFloat _size;
+}
+@end
+
+@implementation MTTextRunKey
+
+- (instancetype) initWithText:(NSString*) text style:(MTTextStyle) style size:(CGFloat) size
+{
+    self = [super init];
+    if (self) {
+        _text = [text copy];
+        _style = style;
+        _size = size;
+    }
+    return self;
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    // Immutable.
+    return self;
+}
+
+- (NSUInteger)hash
+{
+    return _text.hash ^ ((NSUInteger) _style << 24) ^ (NSUInteger) (_size * 64);
+}
+
+- (BOOL)isEqual:(id)object
+{
+    if (object == self) {
+        return YES;
+    }
+    if (![object isKindOfClass:[MTTextRunKey class]]) {
+        return NO;
+    }
+    MTTextRunKey* other = object;
+    return _style == other->_style && _size == other->_size && [_text isEqualToString:other->_text];
+}
+
+@end
+
+@implementation MTTextRunCache {
+    // The runs, each with a cost of 1.
+    MTLRUCache<MTTextRunKey*, MTTextRun*>* _runs;
+}
+
++ (instancetype) sharedCache
+{
+    static MTTextRunCache* sharedCache = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedCache = [[MTTextRunCache alloc] init];
+    });
+    return sharedCache;
+}
+
+- (instancetype) init
+{
+    return [self initWithCountLimit:kMTDefaultTextRunCountLimit];
+}
+
+- (instancetype) initWithCountLimit:(NSUInteger) countLimit
+{
+    self = [super init];
+    if (self) {
+        _runs = [[MTLRUCache alloc] initWithCostLimit:countLimit];
+    }
+    return self;
+}
+
+- (NSUInteger) countLimit
+{
+    return _runs.costLimit;
+}
+
+- (void) setCountLimit:(NSUInteger) countLimit
+{
+    _runs.costLimit = countLimit;
+}
+
+- (NSUInteger) count
+{
+    return _runs.count;
+}
+
+- (MTTextRun*) runForText:(NSString*) text style:(MTTextStyle) style size:(CGFloat) size
+{
+    MTTextRunKey* key = [[MTTextRunKey alloc] initWithText:text ?: @"" style:style size:size];
+    MTTextRun* run = [_runs objectForKey:key];
+    if (run) {
+        return run;
+    }
+    // Shaped outside the lock. Two threads may both shape a missing run, the second one
+    // simply replaces the first.
+    CTFontRef font = [MTFontManager textCTFontForStyle:style size:size];
+    run = [MTTextRun runWithText:key->_text font:font];
+    CFRelease(font);
+    [_runs setObject:run forKey:key cost:1];
+    return run;
+}
+
+- (void) removeAllRuns
+{
+    [_runs removeAllObjects];
+}
+
+@end
@@ -11,9 +11,13 @@
 @import Foundation;
 
 #import "MTMathListDisplay.h"
+#import "../../lib/MTMathListIndex.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
+/// The font size at which `+[MTTypesetter createScalableLineForMathList:font:style:]` lays out.
+FOUNDATION_EXPORT const CGFloat MTTypesetterReferenceFontSize;
+
 /// This class does all the LaTeX typesetting logic.
 /// For ADVANCED use only.
 @interface MTTypesetter : NSObject
@@ -21,6 +25,60 @@ NS_ASSUME_NONNULL_BEGIN
 /// Renders a MTMathList as a list of displays.
 + (MTMathListDisplay*) createLineForMathList:(MTMathList*) mathList font:(MTFont*) font style:(MTLineStyle) style;
 
+/// Renders a MTMathList as a list of displays. If `retainsAtoms` is NO, the `MTCTLineDisplay`s
+/// of the tree do not keep the atoms they display, see `-[MTCTLineDisplay atoms]`.
++ (MTMathListDisplay*) createLineForMathList:(MTMathList*) mathList font:(MTFont*) font style:(MTLineStyle) style
+                                retainsAtoms:(BOOL) retainsAtoms;
+
+/// Renders a MTMathList after an edit, reusing the parts of a previous rendering that the
+/// edit cannot have changed. Only the lists on the path from the root to `changedIndex`
+/// are laid out again; every other child list (numerators, scripts, radicands, table
+/// cells, ...) is adopted from `previousDisplay`, and its siblings are repositioned.
+///
+/// `previousDisplay` must have been returned by this class for the same list before the
+/// edit, with the same font and style. `changedIndex` describes the edit: if its innermost
+/// level has type `kMTSubIndexTypeNone`, atoms of that list were inserted, removed or
+/// replaced starting at its `atomIndex`; every list above it kept its atom count. If the
+/// previous display cannot be used, this is a full layout. The result is identical to
+/// `+createLineForMathList:font:style:`. Displays adopted from `previousDisplay` are shared
+/// with it, so the previous display should not be modified afterwards.
++ (MTMathListDisplay*) createLineForMathList:(MTMathList*) mathList
+                                        font:(MTFont*) font
+                                       style:(MTLineStyle) style
+                             previousDisplay:(nullable MTMathListDisplay*) previousDisplay
+                                changedIndex:(nullable MTMathListIndex*) changedIndex;
+
+/// Lays out a MTMathList once for every font size. The formula is typeset with `font`
+/// at `MTTypesetterReferenceFontSize` (font design units for the bundled fonts), and a
+/// size is then applied as a transform: to draw at size `s`, scale the context by
+/// `s / MTTypesetterReferenceFontSize` and multiply the metrics of the display by the same
+/// factor.
+///
+/// Every OpenType MATH constant and glyph metric scales linearly with the font size. There
+/// are two exceptions in the layout:
+///
+/// - The delimiter shortfall of `\left`/`\right`, which plain.tex gives as 5pt, is taken as
+///   0.5em instead. A scalable layout can therefore pick a different delimiter size than
+///   `+createLineForMathList:font:style:` would at sizes other than 10pt.
+/// - `\text{}` is set in the system font, whose optical sizes and tracking change with the
+///   point size, and is shaped by CoreText at the reference size. Scaled down, the text of a
+///   scalable layout keeps the letterforms and spacing of that large size, so its width, and
+///   with it the layout around it, can differ slightly from the same text typeset at the
+///   target size. Use `+createLineForMathList:font:style:` at the target size where text must
+///   match the system font exactly.
++ (MTMathListDisplay*) createScalableLineForMathList:(MTMathList*) mathList font:(MTFont*) font style:(MTLineStyle) style;
+
+/// `createScalableLineForMathList:font:style:`, with the atoms retained as in
+/// `createLineForMathList:font:style:retainsAtoms:`.
++ (MTMathListDisplay*) createScalableLineForMathList:(MTMathList*) mathList font:(MTFont*) font style:(MTLineStyle) style
+                                        retainsAtoms:(BOOL) retainsAtoms;
+
+/// Tables with at least this many cells lay their cells out concurrently on a
+/// bounded GCD pool; smaller tables use a serial loop. Both paths produce identical
+/// displays. Defaults to 64. Set to `NSUIntegerMax` to always typeset serially.
+/// This is a setup-time knob and must not be changed while typesetting is in flight.
+@property (class, nonatomic) NSUInteger parallelCellThreshold;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -12,7 +12,12 @@
 #import "MTFont+Internal.h"
 #import "MTFontManager.h"
 #import "MTMathListDisplayInternal.h"
+#import "MTMathAlphanumerics.h"
+#import "MTTextRunCache.h"
+#import "MTColorCache.h"
 #import "../../lib/MTUnicode.h"
+#import "../../lib/MTMathListInternal.h"
+#import "../../lib/MTInstrumentationInternal.h"
 
 #pragma mark Inter Element Spacing
 
@@ -28,7 +33,10 @@ typedef NS_ENUM(int, MTInterElementSpaceType) {
 
 NSArray* getInterElementSpaces(void) {
     static NSArray* interElementSpaceArray = nil;
-    if (!interElementSpaceArray) {
+    // dispatch_once rather than a nil check: table cells may be typeset concurrently
+    // (see -typesetCells:columnWidths:), so the first touch can race.
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
         interElementSpaceArray =
         //   ordinary             operator             binary               relation            open                 close               punct               // fraction
         @[ @[@(kMTSpaceNone),     @(kMTSpaceThin),     @(kMTSpaceNSMedium), @(kMTSpaceNSThick), @(kMTSpaceNone),     @(kMTSpaceNone),    @(kMTSpaceNone),    @(kMTSpaceNSThin)],    // ordinary
@@ -40,7 +48,7 @@ NSArray* getInterElementSpaces(void) {
            @[@(kMTSpaceNSThin),   @(kMTSpaceNSThin),   @(kMTSpaceInvalid),  @(kMTSpaceNSThin),  @(kMTSpaceNSThin),   @(kMTSpaceNSThin),  @(kMTSpaceNSThin),  @(kMTSpaceNSThin)],    // punct
            @[@(kMTSpaceNSThin),   @(kMTSpaceThin),     @(kMTSpaceNSMedium), @(kMTSpaceNSThick), @(kMTSpaceNSThin),   @(kMTSpaceNone),    @(kMTSpaceNSThin),  @(kMTSpaceNSThin)],    // fraction
            @[@(kMTSpaceNSMedium), @(kMTSpaceNSThin),   @(kMTSpaceNSMedium), @(kMTSpaceNSThick), @(kMTSpaceNone),     @(kMTSpaceNone),    @(kMTSpaceNone),    @(kMTSpaceNSThin)]];   // radical
-    }
+    });
     return interElementSpaceArray;
 }
 
@@ -99,374 +107,156 @@ NSUInteger getInterElementSpaceArrayIndexForType(MTMathAtomType type, BOOL row)
 static const CGFloat kMTRadicalShortfallFraction = 0.03;
 static const CGFloat kMTRadicalBigJumpFactor = 1.3;
 
-static const unichar kMTUnicodeGreekLowerStart = 0x03B1;
-static const unichar kMTUnicodeGreekLowerEnd = 0x03C9;
-static const unichar kMTUnicodeGreekCapitalStart = 0x0391;
-static const unichar kMTUnicodeGreekCapitalEnd = 0x03A9;
+static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
+{
+    if (ascent) {
+        *ascent = MAX(0, CGRectGetMaxY(bbox) - 0);
+    }
+    
+    if (descent) {
+        // Descent is how much the line goes below the origin. However if the line is all above the origin, then descent can't be negative.
+        *descent = MAX(0, 0 - CGRectGetMinY(bbox));
+    }
+}
 
-#define IS_LOWER_EN(ch) ((ch) >= 'a' && (ch) <= 'z')
-#define IS_UPPER_EN(ch) ((ch) >= 'A' && (ch) <= 'Z')
-#define IS_NUMBER(ch) ((ch) >= '0' && (ch) <= '9')
-#define IS_LOWER_GREEK(ch) ((ch) >= kMTUnicodeGreekLowerStart && (ch) <= kMTUnicodeGreekLowerEnd)
-#define IS_CAPITAL_GREEK(ch) ((ch) >= kMTUnicodeGreekCapitalStart && (ch) <= kMTUnicodeGreekCapitalEnd)
+#pragma mark - Incremental layout
 
+// Child lists that MTMathListIndex cannot address get slots above the
+// MTMathListSubIndexType values, so the two never collide in a layout key.
+static const NSUInteger kMTLayoutSlotStackOver = 0x100;
+static const NSUInteger kMTLayoutSlotStackUnder = 0x101;
+static const NSUInteger kMTLayoutSlotTableCell = 0x200;   // + row-major cell index
 
-NSUInteger greekSymbolOrder(unichar ch) {
-    // These greek symbols that always appear in unicode in this particular order after the alphabet
-    // The symbols are epsilon, vartheta, varkappa, phi, varrho, varpi.
-    static NSArray* greekSymbols;
-    if (!greekSymbols) {
-        greekSymbols = @[@0x03F5, @0x03D1, @0x03F0, @0x03D5, @0x03F1, @0x03D6];
-    }
-    return [greekSymbols indexOfObject:@(ch)];
+// The atom a child list belongs to is named by the last index of its range, since a
+// fused atom takes the scripts of the last atom fused into it.
+static NSUInteger layoutAtomIndex(NSRange atomRange)
+{
+    return (atomRange.length > 0) ? NSMaxRange(atomRange) - 1 : atomRange.location;
 }
 
-#define IS_GREEK_SYMBOL(ch) (greekSymbolOrder(ch) != NSNotFound)
+// A child layout is adopted through a fresh wrapper around the same sub-displays.
+// Parents position, tag and occasionally stretch the wrapper they are given (scripts,
+// cfrac struts, the trailing space of a spaced list), so sharing the wrapper itself
+// would apply those changes twice.
+static MTMathListDisplay* adoptLayout(MTMathListDisplay* previous)
+{
+    MTMathListDisplay* display = [[MTMathListDisplay alloc] initWithDisplays:previous.subDisplays range:previous.range];
+    display.layoutFont = previous.layoutFont;
+    display.layoutStyle = previous.layoutStyle;
+    display.layoutCramped = previous.layoutCramped;
+    display.childLayouts = previous.childLayouts;
+    return display;
+}
 
-static const unichar kMTUnicodePlanksConstant = 0x210e;
-static const UTF32Char kMTUnicodeMathCapitalItalicStart = 0x1D434;
-static const UTF32Char kMTUnicodeMathLowerItalicStart = 0x1D44E;
-static const UTF32Char kMTUnicodeGreekCapitalItalicStart = 0x1D6E2;
-static const UTF32Char kMTUnicodeGreekLowerItalicStart = 0x1D6FC;
-static const UTF32Char kMTUnicodeGreekSymbolItalicStart = 0x1D716;
+// What the layout of one list may take from the previous layout of the same list.
+@interface MTLayoutReuse : NSObject
 
-// mathit
-UTF32Char getItalicized(unichar ch) {
-    UTF32Char unicode = ch;
-    // Special cases for italics
-    switch(ch) {
-        case 'h':
-            return kMTUnicodePlanksConstant;   // italic h (plank's constant)
-    }
-    
-    if (IS_UPPER_EN(ch)) {
-        unicode = kMTUnicodeMathCapitalItalicStart + (ch - 'A');
-    } else if (IS_LOWER_EN(ch)) {
-        unicode = kMTUnicodeMathLowerItalicStart + (ch - 'a');
-    } else if (IS_CAPITAL_GREEK(ch)) {
-        // Capital Greek characters
-        unicode = kMTUnicodeGreekCapitalItalicStart + (ch - kMTUnicodeGreekCapitalStart);
-    } else if (IS_LOWER_GREEK(ch)) {
-        // Greek characters
-        unicode = kMTUnicodeGreekLowerItalicStart + (ch - kMTUnicodeGreekLowerStart);
-    } else if (IS_GREEK_SYMBOL(ch)) {
-        return kMTUnicodeGreekSymbolItalicStart + (int)greekSymbolOrder(ch);
-    }
-    // Note there are no italicized numbers in unicode so we don't support italicizing numbers.
-    return unicode;
-}
-
-static const UTF32Char kMTUnicodeMathCapitalBoldStart = 0x1D400;
-static const UTF32Char kMTUnicodeMathLowerBoldStart = 0x1D41A;
-static const UTF32Char kMTUnicodeGreekCapitalBoldStart = 0x1D6A8;
-static const UTF32Char kMTUnicodeGreekLowerBoldStart = 0x1D6C2;
-static const UTF32Char kMTUnicodeGreekSymbolBoldStart = 0x1D6DC;
-static const UTF32Char kMTUnicodeNumberBoldStart = 0x1D7CE;
-
-// mathbf
-UTF32Char getBold(unichar ch) {
-    UTF32Char unicode = ch;
-    if (IS_UPPER_EN(ch)) {
-        unicode = kMTUnicodeMathCapitalBoldStart + (ch - 'A');
-    } else if (IS_LOWER_EN(ch)) {
-        unicode = kMTUnicodeMathLowerBoldStart + (ch - 'a');
-    } else if (IS_CAPITAL_GREEK(ch)) {
-        // Capital Greek characters
-        unicode = kMTUnicodeGreekCapitalBoldStart + (ch - kMTUnicodeGreekCapitalStart);
-    } else if (IS_LOWER_GREEK(ch)) {
-        // Greek characters
-        unicode = kMTUnicodeGreekLowerBoldStart + (ch - kMTUnicodeGreekLowerStart);
-    } else if (IS_GREEK_SYMBOL(ch)) {
-        return kMTUnicodeGreekSymbolBoldStart + (int)greekSymbolOrder(ch);
-    } else if (IS_NUMBER(ch)) {
-        unicode = kMTUnicodeNumberBoldStart + (ch - '0');
-    }
-    return unicode;
-}
-
-static const UTF32Char kMTUnicodeMathCapitalBoldItalicStart = 0x1D468;
-static const UTF32Char kMTUnicodeMathLowerBoldItalicStart = 0x1D482;
-static const UTF32Char kMTUnicodeGreekCapitalBoldItalicStart = 0x1D71C;
-static const UTF32Char kMTUnicodeGreekLowerBoldItalicStart = 0x1D736;
-static const UTF32Char kMTUnicodeGreekSymbolBoldItalicStart = 0x1D750;
-
-// mathbfit
-UTF32Char getBoldItalic(unichar ch) {
-    UTF32Char unicode = ch;
-    if (IS_UPPER_EN(ch)) {
-        unicode = kMTUnicodeMathCapitalBoldItalicStart + (ch - 'A');
-    } else if (IS_LOWER_EN(ch)) {
-        unicode = kMTUnicodeMathLowerBoldItalicStart + (ch - 'a');
-    } else if (IS_CAPITAL_GREEK(ch)) {
-        // Capital Greek characters
-        unicode = kMTUnicodeGreekCapitalBoldItalicStart + (ch - kMTUnicodeGreekCapitalStart);
-    } else if (IS_LOWER_GREEK(ch)) {
-        // Greek characters
-        unicode = kMTUnicodeGreekLowerBoldItalicStart + (ch - kMTUnicodeGreekLowerStart);
-    } else if (IS_GREEK_SYMBOL(ch)) {
-        return kMTUnicodeGreekSymbolBoldItalicStart + (int)greekSymbolOrder(ch);
-    } else if (IS_NUMBER(ch)) {
-        // No bold italic for numbers so we just bold them.
-        unicode = getBold(ch);
-    }
-    return unicode;
-}
-
-// LaTeX default
-UTF32Char getDefaultStyle(unichar ch) {
-    if (IS_LOWER_EN(ch) || IS_UPPER_EN(ch) || IS_LOWER_GREEK(ch) || IS_GREEK_SYMBOL(ch)) {
-        return getItalicized(ch);
-    } else if (IS_NUMBER(ch) || IS_CAPITAL_GREEK(ch)) {
-        // In the default style numbers and capital greek is roman
-        return ch;
-    } else if (ch == '.') {
-        // . is treated as a number in our code, but it doesn't change fonts.
-        return ch;
-    } else {
-        // Unknown character for the default style (e.g. a symbol placed in a
-        // Variable/Number atom via the public API). Fall back to the character
-        // as-is rather than crashing the render path. (SEC-4)
-        return ch;
-    }
-}
-
-static const UTF32Char kMTUnicodeMathCapitalScriptStart = 0x1D49C;
-// TODO(kostub): Unused in Latin Modern Math - if another font is used determine if
-// this should be applicable.
-// static const UTF32Char kMTUnicodeMathLowerScriptStart = 0x1D4B6;
-
-// mathcal/mathscr (caligraphic or script)
-UTF32Char getCaligraphic(unichar ch) {
-    // Caligraphic has lots of exceptions:
-    switch(ch) {
-        case 'B':
-            return 0x212C;   // Script B (bernoulli)
-        case 'E':
-            return 0x2130;   // Script E (emf)
-        case 'F':
-            return 0x2131;   // Script F (fourier)
-        case 'H':
-            return 0x210B;   // Script H (hamiltonian)
-        case 'I':
-            return 0x2110;   // Script I
-        case 'L':
-            return 0x2112;   // Script L (laplace)
-        case 'M':
-            return 0x2133;   // Script M (M-matrix)
-        case 'R':
-            return 0x211B;   // Script R (Riemann integral)
-        case 'e':
-            return 0x212F;   // Script e (Natural exponent)
-        case 'g':
-            return 0x210A;   // Script g (real number)
-        case 'o':
-            return 0x2134;   // Script o (order)
-        default:
-            break;
-    }
-    UTF32Char unicode;
-    if (IS_UPPER_EN(ch)) {
-        unicode = kMTUnicodeMathCapitalScriptStart + (ch - 'A');
-    } else if (IS_LOWER_EN(ch)) {
-        // Latin Modern Math does not have lower case caligraphic characters, so we use
-        // the default style instead of showing a ?
-        unicode = getDefaultStyle(ch);
-    } else {
-        // Caligraphic characters don't exist for greek or numbers, we give them the
-        // default treatment.
-        unicode = getDefaultStyle(ch);
-    }
-    return unicode;
-}
-
-static const UTF32Char kMTUnicodeMathCapitalTTStart = 0x1D670;
-static const UTF32Char kMTUnicodeMathLowerTTStart = 0x1D68A;
-static const UTF32Char kMTUnicodeNumberTTStart = 0x1D7F6;
-
-// mathtt (monospace)
-UTF32Char getTypewriter(unichar ch) {
-    if (IS_UPPER_EN(ch)) {
-        return kMTUnicodeMathCapitalTTStart + (ch - 'A');
-    } else if (IS_LOWER_EN(ch)) {
-        return kMTUnicodeMathLowerTTStart + (ch - 'a');
-    } else if (IS_NUMBER(ch)) {
-        return kMTUnicodeNumberTTStart + (ch - '0');
-    }
-    // Monospace characters don't exist for greek, we give them the
-    // default treatment.
-    return getDefaultStyle(ch);
-}
-
-static const UTF32Char kMTUnicodeMathCapitalSansSerifStart = 0x1D5A0;
-static const UTF32Char kMTUnicodeMathLowerSansSerifStart = 0x1D5BA;
-static const UTF32Char kMTUnicodeNumberSansSerifStart = 0x1D7E2;
-
-// mathsf
-UTF32Char getSansSerif(unichar ch) {
-    if (IS_UPPER_EN(ch)) {
-        return kMTUnicodeMathCapitalSansSerifStart + (ch - 'A');
-    } else if (IS_LOWER_EN(ch)) {
-        return kMTUnicodeMathLowerSansSerifStart + (ch - 'a');
-    } else if (IS_NUMBER(ch)) {
-        return kMTUnicodeNumberSansSerifStart + (ch - '0');
-    }
-    // Sans-serif characters don't exist for greek, we give them the
-    // default treatment.
-    return getDefaultStyle(ch);
-}
-
-static const UTF32Char kMTUnicodeMathCapitalFrakturStart = 0x1D504;
-static const UTF32Char kMTUnicodeMathLowerFrakturStart = 0x1D51E;
-
-// mathfrak
-UTF32Char getFraktur(unichar ch) {
-    // Fraktur has exceptions:
-    switch(ch) {
-        case 'C':
-            return 0x212D;   // C Fraktur
-        case 'H':
-            return 0x210C;   // Hilbert space
-        case 'I':
-            return 0x2111;   // Imaginary
-        case 'R':
-            return 0x211C;   // Real
-        case 'Z':
-            return 0x2128;   // Z Fraktur
-        default:
-            break;
-    }
-    if (IS_UPPER_EN(ch)) {
-        return kMTUnicodeMathCapitalFrakturStart + (ch - 'A');
-    } else if (IS_LOWER_EN(ch)) {
-        return kMTUnicodeMathLowerFrakturStart + (ch - 'a');
-    }
-    // Fraktur characters don't exist for greek & numbers, we give them the
-    // default treatment.
-    return getDefaultStyle(ch);
-}
-
-static const UTF32Char kMTUnicodeMathCapitalBlackboardStart = 0x1D538;
-static const UTF32Char kMTUnicodeMathLowerBlackboardStart = 0x1D552;
-static const UTF32Char kMTUnicodeNumberBlackboardStart = 0x1D7D8;
-
-// mathbb (double struck)
-UTF32Char getBlackboard(unichar ch) {
-    // Blackboard has lots of exceptions:
-    switch(ch) {
-        case 'C':
-            return 0x2102;   // Complex numbers
-        case 'H':
-            return 0x210D;   // Quarternions
-        case 'N':
-            return 0x2115;   // Natural numbers
-        case 'P':
-            return 0x2119;   // Primes
-        case 'Q':
-            return 0x211A;   // Rationals
-        case 'R':
-            return 0x211D;   // Reals
-        case 'Z':
-            return 0x2124;   // Integers
-        default:
-            break;
-    }
-    if (IS_UPPER_EN(ch)) {
-        return kMTUnicodeMathCapitalBlackboardStart + (ch - 'A');
-    } else if (IS_LOWER_EN(ch)) {
-        return kMTUnicodeMathLowerBlackboardStart + (ch - 'a');
-    } else if (IS_NUMBER(ch)) {
-        return kMTUnicodeNumberBlackboardStart + (ch - '0');
+- (instancetype) initWithPrevious:(MTMathListDisplay*) previous changedIndex:(MTMathListIndex*) changedIndex atomDelta:(NSInteger) atomDelta;
+
+// Returns the previous layout of the child list in `slot` of the atom at `atomIndex`, or
+// nil if the edit may have replaced it. If the edit lies inside that child list, also
+// sets *changedIndex to the path of the edit within it.
+- (nullable MTMathListDisplay*) previousChildForAtom:(NSUInteger) atomIndex slot:(NSUInteger) slot changedIndex:(MTMathListIndex* _Nullable * _Nonnull) changedIndex;
+
+@end
+
+@implementation MTLayoutReuse {
+    MTMathListDisplay* _previous;
+    MTMathListIndex* _changedIndex;
+    NSInteger _atomDelta;
+}
+
+- (instancetype)initWithPrevious:(MTMathListDisplay *)previous changedIndex:(MTMathListIndex *)changedIndex atomDelta:(NSInteger)atomDelta
+{
+    self = [super init];
+    if (self) {
+        _previous = previous;
+        _changedIndex = changedIndex;
+        _atomDelta = atomDelta;
     }
-    // Blackboard characters don't exist for greek, we give them the
-    // default treatment.
-    return getDefaultStyle(ch);
+    return self;
 }
 
-static UTF32Char styleCharacter(unichar ch, MTFontStyle fontStyle)
+- (MTMathListDisplay *)previousChildForAtom:(NSUInteger)atomIndex slot:(NSUInteger)slot changedIndex:(MTMathListIndex **)changedIndex
 {
-    switch (fontStyle) {
-        case kMTFontStyleDefault:
-            return getDefaultStyle(ch);
-            
-        case kMTFontStyleRoman:
-            return ch;
-            
-        case kMTFontStyleBold:
-            return getBold(ch);
-            
-        case kMTFontStyleItalic:
-            return getItalicized(ch);
-            
-        case kMTFontStyleBoldItalic:
-            return getBoldItalic(ch);
-            
-        case kMTFontStyleCaligraphic:
-            return getCaligraphic(ch);
-            
-        case kMTFontStyleTypewriter:
-            return getTypewriter(ch);
-            
-        case kMTFontStyleSansSerif:
-            return getSansSerif(ch);
-            
-        case kMTFontStyleFraktur:
-            return getFraktur(ch);
-            
-        case kMTFontStyleBlackboard:
-            return getBlackboard(ch);
-            
-        default:
-            @throw [NSException exceptionWithName:@"Invalid style"
-                                           reason:[NSString stringWithFormat:@"Unknown style %lu for font.", (unsigned long)fontStyle]
-                                         userInfo:nil];
-    }
-    return ch;
-}
-
-static NSString* changeFont(NSString* str, MTFontStyle fontStyle) {
-    NSUInteger length = str.length;
-    NSMutableString* retval = [NSMutableString stringWithCapacity:length];
-    // Hot path: almost every nucleus is a single character (length == 1).
-    // Use a fixed-size stack buffer for the common small case to avoid a
-    // malloc/free per call.  Inputs longer than 256 unichars still fall back
-    // to the heap so the SEC-2 fix (no unbounded VLA) remains intact.
-    unichar stackBuf[256];
-    unichar *charBuffer = (length <= 256) ? stackBuf : malloc(sizeof(unichar) * (size_t)length);
-    NSCAssert(length == 0 || charBuffer != NULL, @"Failed to allocate charBuffer");
-    // Wrap in @try/@finally so charBuffer is released on all exit paths,
-    // including the IllegalCharacter / Invalid style exceptions that
-    // styleCharacter can @throw from inside the loop.
-    @try {
-        [str getCharacters:charBuffer range:NSMakeRange(0, length)];
-        for (NSUInteger i = 0; i < length; ++i) {
-            unichar ch = charBuffer[i];
-            UTF32Char unicode = styleCharacter(ch, fontStyle);
-            unicode = NSSwapHostIntToLittle(unicode);
-            NSString* charStr = [[NSString alloc] initWithBytes:&unicode length:sizeof(unicode) encoding:NSUTF32LittleEndianStringEncoding];
-            [retval appendString:charStr];
+    *changedIndex = nil;
+    NSUInteger editIndex = _changedIndex.atomIndex;
+    MTMathListSubIndexType type = _changedIndex.subIndexType;
+    NSUInteger previousIndex = atomIndex;
+    if (type == kMTSubIndexTypeNone || type == kMTSubIndexTypeNucleus || !_changedIndex.subIndex) {
+        // Atoms of this list were inserted, removed or replaced starting at editIndex.
+        // Everything before it is unchanged; everything after it moved by _atomDelta.
+        NSUInteger editEnd = editIndex + MAX(_atomDelta, 0) + 1;
+        if (atomIndex >= editIndex && atomIndex < editEnd) {
+            return nil;
         }
-    } @finally {
-        if (charBuffer != stackBuf) {
-            free(charBuffer);
+        if (atomIndex >= editEnd) {
+            previousIndex = atomIndex - _atomDelta;
         }
+    } else if (atomIndex == editIndex && slot == type) {
+        *changedIndex = _changedIndex.subIndex;
     }
-    return retval;
+    return _previous.childLayouts[MTLayoutKey(previousIndex, slot)];
 }
 
-static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
+@end
+
+#pragma mark - Preprocessing
+
+// The nucleus an atom is typeset with: variables and numbers are drawn in the font style of the atom.
+static NSString* typesetNucleus(MTMathAtom* atom)
 {
-    if (ascent) {
-        *ascent = MAX(0, CGRectGetMaxY(bbox) - 0);
+    if (atom.type == kMTMathAtomVariable || atom.type == kMTMathAtomNumber) {
+        return MTMathAlphanumericString(atom.nucleus, atom.fontStyle);
     }
-    
-    if (descent) {
-        // Descent is how much the line goes below the origin. However if the line is all above the origin, then descent can't be negative.
-        *descent = MAX(0, 0 - CGRectGetMinY(bbox));
+    return atom.nucleus;
+}
+
+// What preprocessing makes of an atom, or of a run of ordinary atoms merged by Rule 14. It is kept
+// beside the list rather than written into its atoms, so the list is only read during the layout.
+@interface MTPreprocessedAtom : NSObject {
+    @public
+    MTMathAtom* _atom;               // For a run, its last atom, which has the scripts of the run.
+    MTMathAtomType _type;            // The type the atom is laid out as.
+    NSString* _nucleus;              // For a run, the nuclei of all its atoms.
+    NSRange _indexRange;             // For a run, the range of all its atoms.
+    NSMutableArray<MTMathAtom*>* _runAtoms;   // The atoms of a run, nil for a single atom.
+}
+@end
+
+@implementation MTPreprocessedAtom
+
+- (instancetype) initWithAtom:(MTMathAtom*) atom type:(MTMathAtomType) type nucleus:(NSString*) nucleus
+{
+    self = [super init];
+    if (self) {
+        _atom = atom;
+        _type = type;
+        _nucleus = nucleus;
+        _indexRange = atom.indexRange;
     }
+    return self;
 }
 
+// The counterpart of -[MTMathAtom fuse:].
+- (void) fuse:(MTMathAtom*) atom nucleus:(NSString*) nucleus
+{
+    if (!_runAtoms) {
+        _runAtoms = [NSMutableArray arrayWithArray:(_atom.fusedAtoms ?: @[ _atom ])];
+        _nucleus = [_nucleus mutableCopy];
+    }
+    [_runAtoms addObjectsFromArray:(atom.fusedAtoms ?: @[ atom ])];
+    [(NSMutableString*) _nucleus appendString:nucleus];
+    _indexRange.length += atom.indexRange.length;
+    _atom = atom;
+}
+
+@end
+
 #pragma mark - MTTypesetter
 
+const CGFloat MTTypesetterReferenceFontSize = 1000;
+
 @implementation MTTypesetter {
     MTFont* _font;
     NSMutableArray<MTDisplay *>* _displayAtoms;
@@ -478,13 +268,49 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
     MTFont* _styleFont;
     BOOL _cramped;
     BOOL _spaced;
+    BOOL _scaleInvariant;            // see +createScalableLineForMathList:font:style:
+    BOOL _retainsAtoms;              // see +createLineForMathList:font:style:retainsAtoms:
+    MTLayoutReuse* _reuse;           // nil unless this is an incremental layout
+    NSMutableDictionary<NSNumber*, MTMathListDisplay*>* _childLayouts;
 }
 
 + (MTMathListDisplay *)createLineForMathList:(MTMathList *)mathList font:(MTFont*)font style:(MTLineStyle)style
+{
+    return [self createLineForMathList:mathList font:font style:style retainsAtoms:YES];
+}
+
++ (MTMathListDisplay *)createLineForMathList:(MTMathList *)mathList font:(MTFont*)font style:(MTLineStyle)style retainsAtoms:(BOOL)retainsAtoms
 {
     MTMathList* finalizedList = mathList.finalized;
     // default is not cramped
-    return [self createLineForMathList:finalizedList font:font style:style cramped:false];
+    return [self createLineForMathList:finalizedList font:font style:style cramped:false spaced:false scaleInvariant:false
+                          retainsAtoms:retainsAtoms previousDisplay:nil changedIndex:nil];
+}
+
++ (MTMathListDisplay *)createLineForMathList:(MTMathList *)mathList font:(MTFont *)font style:(MTLineStyle)style previousDisplay:(MTMathListDisplay *)previousDisplay changedIndex:(MTMathListIndex *)changedIndex
+{
+    MTMathList* finalizedList = mathList.finalized;
+    // The previous display can only be reused if it was laid out in the same context.
+    BOOL reusable = previousDisplay.layoutFont != nil && changedIndex != nil
+        && previousDisplay.layoutStyle == style && !previousDisplay.layoutCramped
+        && !previousDisplay.layoutScaleInvariant
+        && CFEqual(previousDisplay.layoutFont.ctFont, font.ctFont);
+    return [self createLineForMathList:finalizedList font:font style:style cramped:false spaced:false scaleInvariant:false
+                          retainsAtoms:YES previousDisplay:(reusable ? previousDisplay : nil) changedIndex:changedIndex];
+}
+
++ (MTMathListDisplay *)createScalableLineForMathList:(MTMathList *)mathList font:(MTFont *)font style:(MTLineStyle)style
+{
+    return [self createScalableLineForMathList:mathList font:font style:style retainsAtoms:YES];
+}
+
++ (MTMathListDisplay *)createScalableLineForMathList:(MTMathList *)mathList font:(MTFont *)font style:(MTLineStyle)style retainsAtoms:(BOOL)retainsAtoms
+{
+    NSParameterAssert(font);
+    MTFont* referenceFont = (font.fontSize == MTTypesetterReferenceFontSize) ? font : [font copyFontWithSize:MTTypesetterReferenceFontSize];
+    MTMathList* finalizedList = mathList.finalized;
+    return [self createLineForMathList:finalizedList font:referenceFont style:style cramped:false spaced:false scaleInvariant:true
+                          retainsAtoms:retainsAtoms previousDisplay:nil changedIndex:nil];
 }
 
 // Internal
@@ -495,16 +321,95 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
 
 // Internal
 + (MTMathListDisplay *)createLineForMathList:(MTMathList *)mathList font:(MTFont*)font style:(MTLineStyle)style cramped:(BOOL) cramped spaced:(BOOL) spaced
+{
+    return [self createLineForMathList:mathList font:font style:style cramped:cramped spaced:spaced scaleInvariant:false
+                          retainsAtoms:YES previousDisplay:nil changedIndex:nil];
+}
+
+// Internal. previousDisplay must have been laid out from this list, before the edit at
+// changedIndex, in the same style and font; it is nil for a full layout. scaleInvariant
+// replaces the fixed-point quantities of the layout with font-relative ones, and retainsAtoms
+// applies to the whole tree.
++ (MTMathListDisplay *)createLineForMathList:(MTMathList *)mathList font:(MTFont*)font style:(MTLineStyle)style cramped:(BOOL) cramped spaced:(BOOL) spaced
+                              scaleInvariant:(BOOL) scaleInvariant retainsAtoms:(BOOL) retainsAtoms
+                             previousDisplay:(MTMathListDisplay*) previousDisplay changedIndex:(MTMathListIndex*) changedIndex
 {
     NSParameterAssert(font);
+    // Atom count in source indices, which is what the ranges of the displays refer to.
+    MTMathAtom* lastAtom = mathList.atomsForReading.lastObject;
+    NSUInteger numAtoms = NSMaxRange(lastAtom.indexRange);
+    MTLayoutReuse* reuse = nil;
+    if (previousDisplay && changedIndex) {
+        NSInteger atomDelta = (NSInteger) numAtoms - (NSInteger) previousDisplay.range.length;
+        // An edit further down cannot change the number of atoms at this level.
+        BOOL editHere = (changedIndex.subIndexType == kMTSubIndexTypeNone || changedIndex.subIndexType == kMTSubIndexTypeNucleus);
+        if (editHere || atomDelta == 0) {
+            reuse = [[MTLayoutReuse alloc] initWithPrevious:previousDisplay changedIndex:changedIndex atomDelta:atomDelta];
+        }
+    }
+
     NSArray* preprocessedAtoms = [self preprocessMathList:mathList];
     MTTypesetter *typesetter = [[MTTypesetter alloc] initWithFont:font style:style cramped:cramped spaced:spaced];
+    typesetter->_scaleInvariant = scaleInvariant;
+    typesetter->_retainsAtoms = retainsAtoms;
+    typesetter->_reuse = reuse;
     [typesetter createDisplayAtoms:preprocessedAtoms];
-    MTMathAtom* lastAtom = mathList.atoms.lastObject;
-    MTMathListDisplay* line = [[MTMathListDisplay alloc] initWithDisplays:typesetter->_displayAtoms range:NSMakeRange(0, NSMaxRange(lastAtom.indexRange))];
+    MTMathListDisplay* line = [[MTMathListDisplay alloc] initWithDisplays:typesetter->_displayAtoms range:NSMakeRange(0, numAtoms)];
+    line.layoutFont = font;
+    line.layoutStyle = style;
+    line.layoutCramped = cramped;
+    line.layoutScaleInvariant = scaleInvariant;
+    line.childLayouts = typesetter->_childLayouts;
     return line;
 }
 
+// Lays out a child list of the atom with the given range (a numerator, a script, ...).
+// During an incremental layout a child the edit did not touch is adopted from the
+// previous display, and the child on the edit path is itself laid out incrementally.
+- (MTMathListDisplay*) layoutChildList:(MTMathList*) list atomRange:(NSRange) atomRange slot:(NSUInteger) slot style:(MTLineStyle) style cramped:(BOOL) cramped
+{
+    NSUInteger atomIndex = layoutAtomIndex(atomRange);
+    MTMathListDisplay* previous = nil;
+    MTMathListIndex* changedIndex = nil;
+    if (_reuse) {
+        previous = [_reuse previousChildForAtom:atomIndex slot:slot changedIndex:&changedIndex];
+        if (previous.layoutStyle != style || previous.layoutCramped != cramped) {
+            // e.g. a \scriptstyle was inserted in front of this atom.
+            previous = nil;
+        }
+    }
+    MTMathListDisplay* display;
+    if (previous && !changedIndex) {
+        display = adoptLayout(previous);
+    } else {
+        display = [MTTypesetter createLineForMathList:list font:_font style:style cramped:cramped spaced:NO scaleInvariant:_scaleInvariant
+                                         retainsAtoms:_retainsAtoms previousDisplay:previous changedIndex:changedIndex];
+    }
+    [self recordChildLayout:display atomIndex:atomIndex slot:slot];
+    return display;
+}
+
+- (void) recordChildLayout:(MTMathListDisplay*) display atomIndex:(NSUInteger) atomIndex slot:(NSUInteger) slot
+{
+    if (!_childLayouts) {
+        _childLayouts = [NSMutableDictionary dictionary];
+    }
+    _childLayouts[MTLayoutKey(atomIndex, slot)] = display;
+}
+
+// Tables with at least this many cells are typeset concurrently. See -typesetCellLists:style:.
+static NSUInteger sParallelCellThreshold = 64;
+
++ (NSUInteger)parallelCellThreshold
+{
+    return sParallelCellThreshold;
+}
+
++ (void)setParallelCellThreshold:(NSUInteger)parallelCellThreshold
+{
+    sParallelCellThreshold = parallelCellThreshold;
+}
+
 + (MTColor*) placeholderColor
 {
     return [MTColor blueColor];
@@ -514,6 +419,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
 {
     self = [super init];
     if (self) {
+        MTCountEvent(kMTLayoutCounterTypesetters);
         _font = font;
         _displayAtoms = [NSMutableArray array];
         _currentPosition = CGPointZero;
@@ -527,42 +433,42 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
     return self;
 }
 
-+ (NSArray*) preprocessMathList:(MTMathList*) ml
++ (NSArray<MTPreprocessedAtom*>*) preprocessMathList:(MTMathList*) ml
 {
+    MTTracePhase(kMTLayoutPhasePreprocess);
     // Note: Some of the preprocessing described by the TeX algorithm is done in the finalize method of MTMathList.
     // Specifically rules 5 & 6 in Appendix G are handled by finalize.
     // This function does not do a complete preprocessing as specified by TeX either. It removes any special atom types
     // that are not included in TeX and applies Rule 14 to merge ordinary characters.
-    NSMutableArray* preprocessed = [NSMutableArray arrayWithCapacity:ml.atoms.count];
-    MTMathAtom* prevNode = nil;
-    for (MTMathAtom *atom in ml.atoms) {
-        if (atom.type == kMTMathAtomVariable || atom.type == kMTMathAtomNumber) {
+    // The list is not changed, so that a frozen list can be laid out on several threads at once.
+    NSMutableArray<MTPreprocessedAtom*>* preprocessed = [NSMutableArray arrayWithCapacity:ml.atomsForReading.count];
+    MTPreprocessedAtom* prevNode = nil;
+    for (MTMathAtom *atom in ml.atomsForReading) {
+        MTMathAtomType type = atom.type;
+        if (type == kMTMathAtomVariable || type == kMTMathAtomNumber || type == kMTMathAtomUnaryOperator) {
             // These are not a TeX type nodes. TeX does this during parsing the input.
-            // switch to using the font specified in the atom
-            NSString* newFont = changeFont(atom.nucleus, atom.fontStyle);
-            // We convert it to ordinary
-            atom.type = kMTMathAtomOrdinary;
-            atom.nucleus = newFont;
-        } else if (atom.type == kMTMathAtomUnaryOperator) {
-            // TeX treats these as Ordinary. So will we.
-            atom.type = kMTMathAtomOrdinary;
+            // Variables and numbers are switched to the font specified in the atom (see typesetNucleus),
+            // and all of them are treated as Ordinary.
+            type = kMTMathAtomOrdinary;
         }
+        NSString* nucleus = typesetNucleus(atom);
         
-        if (atom.type == kMTMathAtomOrdinary) {
+        if (type == kMTMathAtomOrdinary) {
             // This is Rule 14 to merge ordinary characters.
             // combine ordinary atoms together
-            if (prevNode && prevNode.type == kMTMathAtomOrdinary && !prevNode.subScript && !prevNode.superScript
-                && ![prevNode isKindOfClass:[MTLargeDelimiter class]]
+            MTMathAtom* prevAtom = prevNode ? prevNode->_atom : nil;
+            if (prevAtom && prevNode->_type == kMTMathAtomOrdinary && !prevAtom.subScript && !prevAtom.superScript
+                && ![prevAtom isKindOfClass:[MTLargeDelimiter class]]
                 && ![atom isKindOfClass:[MTLargeDelimiter class]]) {
-                [prevNode fuse:atom];
+                [prevNode fuse:atom nucleus:nucleus];
                 // skip the current node, we are done here.
                 continue;
             }
         }
         
         // TODO: add italic correction here or in second pass?
-        prevNode = atom;
-        [preprocessed addObject:atom];
+        prevNode = [[MTPreprocessedAtom alloc] initWithAtom:atom type:type nucleus:nucleus];
+        [preprocessed addObject:prevNode];
     }
     return preprocessed;
 }
@@ -593,11 +499,11 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
     _styleFont = [_font copyFontWithSize:[[self class] getStyleSize:_style font:_font]];
 }
 
-- (void) addInterElementSpace:(MTMathAtom*) prevNode currentType:(MTMathAtomType) type
+- (void) addInterElementSpace:(MTPreprocessedAtom*) prevNode currentType:(MTMathAtomType) type
 {
     CGFloat interElementSpace = 0;
     if (prevNode) {
-        interElementSpace = [self getInterElementSpace:prevNode.type right:type];
+        interElementSpace = [self getInterElementSpace:prevNode->_type right:type];
     } else if (_spaced) {
         // For the first atom of a spaced list, treat it as if it is preceded by an open.
         interElementSpace = [self getInterElementSpace:kMTMathAtomOpen right:type];
@@ -605,14 +511,16 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
     _currentPosition.x += interElementSpace;
 }
 
-- (void) createDisplayAtoms:(NSArray*) preprocessed
+- (void) createDisplayAtoms:(NSArray<MTPreprocessedAtom*>*) preprocessed
 {
+    MTTracePhase(kMTLayoutPhaseCreateDisplayAtoms);
     // items should contain all the nodes that need to be layed out.
     // convert to a list of MTDisplayAtoms
-    MTMathAtom *prevNode = nil;
+    MTPreprocessedAtom* prevNode = nil;
     MTMathAtomType lastType = 0;
-    for (MTMathAtom* atom in preprocessed) {
-        switch (atom.type) {
+    for (MTPreprocessedAtom* node in preprocessed) {
+        MTMathAtom* atom = node->_atom;
+        switch (node->_type) {
             case kMTMathAtomNumber:
             case kMTMathAtomVariable:
             case kMTMathAtomUnaryOperator:
@@ -656,10 +564,10 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                     [self addDisplayLine];
                 }
                 // Color is spaced as Ord (see getInterElementSpaceArrayIndexForType).
-                [self addInterElementSpace:prevNode currentType:atom.type];
+                [self addInterElementSpace:prevNode currentType:node->_type];
                 MTMathColor* colorAtom = (MTMathColor*) atom;
-                MTDisplay* display = [MTTypesetter createLineForMathList:colorAtom.innerList font:_font style:_style];
-                display.localTextColor = [MTColor colorFromHexString:colorAtom.colorString];
+                MTDisplay* display = [self layoutChildList:colorAtom.innerList.finalized atomRange:atom.indexRange slot:kMTSubIndexTypeInner style:_style cramped:NO];
+                display.localTextColor = MTColorForRGBA(colorAtom.rgbaColor);
                 display.position = _currentPosition;
                 _currentPosition.x += display.width;
                 [_displayAtoms addObject:display];
@@ -672,11 +580,11 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                     [self addDisplayLine];
                 }
                 // Colorbox is spaced as Ord (see getInterElementSpaceArrayIndexForType).
-                [self addInterElementSpace:prevNode currentType:atom.type];
+                [self addInterElementSpace:prevNode currentType:node->_type];
                 MTMathColorbox* colorboxAtom = (MTMathColorbox*) atom;
-                MTDisplay* display = [MTTypesetter createLineForMathList:colorboxAtom.innerList font:_font style:_style];
+                MTDisplay* display = [self layoutChildList:colorboxAtom.innerList.finalized atomRange:atom.indexRange slot:kMTSubIndexTypeInner style:_style cramped:NO];
 
-                display.localBackgroundColor = [MTColor colorFromHexString:colorboxAtom.colorString];
+                display.localBackgroundColor = MTColorForRGBA(colorboxAtom.rgbaColor);
                 display.position = _currentPosition;
                 _currentPosition.x += display.width;
                 [_displayAtoms addObject:display];
@@ -691,10 +599,10 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                 // Box spacing class is Ordinary: reclassify before any inter-element lookup
                 // (mirrors overline/accent), so it never reaches the getInterElementSpace default assert.
                 [self addInterElementSpace:prevNode currentType:kMTMathAtomOrdinary];
-                atom.type = kMTMathAtomOrdinary;
+                node->_type = kMTMathAtomOrdinary;
 
                 MTMathBox* boxAtom = (MTMathBox*) atom;
-                MTMathListDisplay* child = [MTTypesetter createLineForMathList:boxAtom.innerList font:_font style:_style];
+                MTMathListDisplay* child = [self layoutChildList:boxAtom.innerList.finalized atomRange:atom.indexRange slot:kMTSubIndexTypeInner style:_style cramped:NO];
                 MTMathBoxDisplay* display = [[MTMathBoxDisplay alloc] initWithChild:child
                                                                          keepWidth:boxAtom.keepWidth
                                                                         keepHeight:boxAtom.keepHeight
@@ -726,10 +634,10 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                 // Spaced as Ordinary: reclassify before any inter-element lookup
                 // (mirrors the Box case), so it never reaches the default assert.
                 [self addInterElementSpace:prevNode currentType:kMTMathAtomOrdinary];
-                atom.type = kMTMathAtomOrdinary;
+                node->_type = kMTMathAtomOrdinary;
 
                 MTMathGroup* groupAtom = (MTMathGroup*) atom;
-                MTMathListDisplay* child = [MTTypesetter createLineForMathList:groupAtom.innerList font:_font style:_style];
+                MTMathListDisplay* child = [self layoutChildList:groupAtom.innerList.finalized atomRange:atom.indexRange slot:kMTSubIndexTypeInner style:_style cramped:NO];
                 child.position = _currentPosition;
                 _currentPosition.x += child.width;
                 [_displayAtoms addObject:child];
@@ -748,20 +656,18 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                 // Inter-element spacing: kMTMathAtomText maps to the
                 // Ordinary row/column in getInterElementSpaceArrayIndexForType,
                 // so addInterElementSpace works unchanged.
-                [self addInterElementSpace:prevNode currentType:atom.type];
+                [self addInterElementSpace:prevNode currentType:node->_type];
 
                 MTTextAtom* textAtom = (MTTextAtom*) atom;
-                CTFontRef textFont = [MTFontManager textCTFontForStyle:textAtom.textStyle
-                                                                  size:_styleFont.fontSize];
-
+                // The shaped run is shared by every \text with the same body, style and size.
+                MTTextRun* run = [MTTextRunCache.sharedCache runForText:textAtom.text
+                                                                  style:textAtom.textStyle
+                                                                   size:_styleFont.fontSize];
                 MTTextDisplay* display = [[MTTextDisplay alloc]
                                           initWithText:textAtom.text
                                              textStyle:textAtom.textStyle
-                                                ctFont:textFont
+                                                   run:run
                                                  range:textAtom.indexRange];
-                // MTTextDisplay's initializer takes its own retain on the
-                // CTFont via the attributed-string attribute dictionary.
-                CFRelease(textFont);
 
                 display.position = _currentPosition;
                 _currentPosition.x += display.width;
@@ -773,8 +679,8 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                     [self makeScripts:atom display:display
                                 index:atom.indexRange.location delta:0];
                 }
-                // No mutation of atom.type. prevNode bookkeeping at the
-                // bottom of the loop assigns prevNode = atom; on the next
+                // The type is kept. prevNode bookkeeping at the
+                // bottom of the loop assigns prevNode = node; on the next
                 // iteration the spacing-index lookup for kMTMathAtomText
                 // resolves to the same index as Ord.
                 break;
@@ -791,7 +697,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                 MTRadicalDisplay* displayRad = [self makeRadical:rad.radicand range:rad.indexRange];
                 if (rad.degree) {
                     // add the degree to the radical
-                    MTMathListDisplay* degree = [MTTypesetter createLineForMathList:rad.degree font:_font style:kMTLineStyleScriptScript];
+                    MTMathListDisplay* degree = [self layoutChildList:rad.degree.finalized atomRange:rad.indexRange slot:kMTSubIndexTypeDegree style:kMTLineStyleScriptScript cramped:NO];
                     [displayRad setDegree:degree fontMetrics:_styleFont.mathTable];
                 }
                 [_displayAtoms addObject:displayRad];
@@ -802,7 +708,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                     [self makeScripts:atom display:displayRad index:rad.indexRange.location delta:0];
                 }
                 // change type to ordinary
-                //atom.type = kMTMathAtomOrdinary;
+                //node->_type = kMTMathAtomOrdinary;
                 break;
             }
                 
@@ -812,7 +718,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                     [self addDisplayLine];
                 }
                 MTFraction* frac = (MTFraction*) atom;
-                [self addInterElementSpace:prevNode currentType:atom.type];
+                [self addInterElementSpace:prevNode currentType:node->_type];
                 MTDisplay* display = [self makeFraction:frac];
                 [_displayAtoms addObject:display];
                 _currentPosition.x += display.width;
@@ -828,7 +734,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                 if (_currentLine.length > 0) {
                     [self addDisplayLine];
                 }
-                [self addInterElementSpace:prevNode currentType:atom.type];
+                [self addInterElementSpace:prevNode currentType:node->_type];
                 MTLargeOperator* op = (MTLargeOperator*) atom;
                 MTDisplay* display = [self makeLargeOp:op];
                 [_displayAtoms addObject:display];
@@ -840,7 +746,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                 if (_currentLine.length > 0) {
                     [self addDisplayLine];
                 }
-                [self addInterElementSpace:prevNode currentType:atom.type];
+                [self addInterElementSpace:prevNode currentType:node->_type];
                 MTInner* inner = (MTInner*) atom;
               MTInnerDisplay* display = [self makeInner:inner atIndex:atom.indexRange.location];
                 display.position = _currentPosition;
@@ -860,7 +766,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                 }
                 // Underline is considered as Ord in rule 16.
                 [self addInterElementSpace:prevNode currentType:kMTMathAtomOrdinary];
-                atom.type = kMTMathAtomOrdinary;
+                node->_type = kMTMathAtomOrdinary;
                 
                 MTUnderLine* under = (MTUnderLine*) atom;
                 MTDisplay* display = [self makeUnderline:under];
@@ -880,7 +786,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                 }
                 // Overline is considered as Ord in rule 16.
                 [self addInterElementSpace:prevNode currentType:kMTMathAtomOrdinary];
-                atom.type = kMTMathAtomOrdinary;
+                node->_type = kMTMathAtomOrdinary;
                 
                 MTOverLine* over = (MTOverLine*) atom;
                 MTDisplay* display = [self makeOverline:over];
@@ -900,15 +806,15 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                 }
                 // Accent is considered as Ord in rule 16.
                 [self addInterElementSpace:prevNode currentType:kMTMathAtomOrdinary];
-                atom.type = kMTMathAtomOrdinary;
+                node->_type = kMTMathAtomOrdinary;
                 
                 MTAccent* accent = (MTAccent*) atom;
                 MTDisplay* display = [self makeAccent:accent];
                 [_displayAtoms addObject:display];
                 _currentPosition.x += display.width;
                 
-                // add super scripts || subscripts
-                if (atom.subScript || atom.superScript) {
+                // add super scripts || subscripts, unless makeAccent: put them on the accentee
+                if ((atom.subScript || atom.superScript) && ![self accenteeTakesScripts:accent]) {
                     [self makeScripts:atom display:display index:atom.indexRange.location delta:0];
                 }
                 break;
@@ -921,7 +827,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                 MTMathStack* stack = (MTMathStack*) atom;
                 // Stack is treated as displayClass (default Ord) for inter-element spacing (Rule 16).
                 [self addInterElementSpace:prevNode currentType:stack.displayClass];
-                atom.type = stack.displayClass;
+                node->_type = stack.displayClass;
                 MTDisplay* display = [self makeStack:stack];
                 [_displayAtoms addObject:display];
                 _currentPosition.x += display.width;
@@ -938,7 +844,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                 }
                 // We will consider tables as inner
                 [self addInterElementSpace:prevNode currentType:kMTMathAtomInner];
-                atom.type = kMTMathAtomInner;
+                node->_type = kMTMathAtomInner;
                 
                 MTMathTable* table = (MTMathTable*) atom;
                 MTDisplay* display = [self makeTable:table];
@@ -959,7 +865,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                     if (_currentLine.length > 0) {
                         [self addDisplayLine];
                     }
-                    [self addInterElementSpace:prevNode currentType:atom.type];
+                    [self addInterElementSpace:prevNode currentType:node->_type];
                     MTDisplay* display = [self makeLargeDelimiter:(MTLargeDelimiter*)atom];
                     display.position = _currentPosition;
                     _currentPosition.x += display.width;
@@ -972,7 +878,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                 // the rendering for all the rest is pretty similar
                 // All we need is render the character and set the interelement space.
                 if (prevNode) {
-                    CGFloat interElementSpace = [self getInterElementSpace:prevNode.type right:atom.type];
+                    CGFloat interElementSpace = [self getInterElementSpace:prevNode->_type right:node->_type];
                     if (_currentLine.length > 0) {
                         if (interElementSpace > 0) {
                             // add a kerning of that space to the previous character
@@ -986,23 +892,24 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                     }
                 }
                 NSAttributedString* current = nil;
-                if (atom.type == kMTMathAtomPlaceholder) {
+                if (node->_type == kMTMathAtomPlaceholder) {
                     MTColor* color = [MTTypesetter placeholderColor];
-                    current = [[NSAttributedString alloc] initWithString:atom.nucleus
+                    current = [[NSAttributedString alloc] initWithString:node->_nucleus
                                                               attributes:@{ (NSString*) kCTForegroundColorAttributeName : (id) color.CGColor }];
                 } else {
-                    current = [[NSAttributedString alloc] initWithString:atom.nucleus];
+                    current = [[NSAttributedString alloc] initWithString:node->_nucleus];
                 }
                 [_currentLine appendAttributedString:current];
                 // add the atom to the current range
                 if (_currentLineIndexRange.location == NSNotFound) {
-                    _currentLineIndexRange = atom.indexRange;
+                    _currentLineIndexRange = node->_indexRange;
                 } else {
-                    _currentLineIndexRange.length += atom.indexRange.length;
+                    _currentLineIndexRange.length += node->_indexRange.length;
                 }
                 // add the fused atoms
-                if (atom.fusedAtoms) {
-                    [_currentAtoms addObjectsFromArray:atom.fusedAtoms];
+                NSArray* fusedAtoms = node->_runAtoms ?: atom.fusedAtoms;
+                if (fusedAtoms) {
+                    [_currentAtoms addObjectsFromArray:fusedAtoms];
                 } else {
                     [_currentAtoms addObject:atom];
                 }
@@ -1013,22 +920,22 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                     // We don't check _currentLine.length here since we want to allow empty lines with super/sub scripts.
                     MTCTLineDisplay* line = [self addDisplayLine];
                     CGFloat delta = 0;
-                    if (atom.nucleus.length > 0) {
+                    if (node->_nucleus.length > 0) {
                         // Use the italic correction of the last character.
-                        CGGlyph glyph = [self findGlyphForCharacterAtIndex:atom.nucleus.length - 1 inString:atom.nucleus];
+                        CGGlyph glyph = [self findGlyphForCharacterAtIndex:node->_nucleus.length - 1 inString:node->_nucleus];
                         delta = [_styleFont.mathTable getItalicCorrection:glyph];
                     }
                     if (delta > 0 && !atom.subScript) {
                         // Add a kern of delta
                         _currentPosition.x += delta;
                     }
-                    [self makeScripts:atom display:line index:NSMaxRange(atom.indexRange) - 1 delta:delta];
+                    [self makeScripts:atom display:line index:NSMaxRange(node->_indexRange) - 1 delta:delta];
                 }
                 break;
             }
         }
-        lastType = atom.type;
-        prevNode = atom;
+        lastType = node->_type;
+        prevNode = node;
     }
     if (_currentLine.length > 0) {
         [self addDisplayLine];
@@ -1049,7 +956,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
      @"The length of the current line: %@ does not match the length of the range (%d, %d)",
      _currentLine, _currentLineIndexRange.location, _currentLineIndexRange.length);*/
     
-    MTCTLineDisplay* displayAtom = [[MTCTLineDisplay alloc] initWithString:_currentLine position:_currentPosition range:_currentLineIndexRange font:_styleFont atoms:_currentAtoms];
+    MTCTLineDisplay* displayAtom = [[MTCTLineDisplay alloc] initWithString:_currentLine position:_currentPosition range:_currentLineIndexRange font:_styleFont atoms:_currentAtoms retainAtoms:_retainsAtoms];
     [_displayAtoms addObject:displayAtom];
     // update the position
     _currentPosition.x += displayAtom.width;
@@ -1160,7 +1067,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
     
     if (!atom.superScript) {
         assert(atom.subScript);
-        MTMathListDisplay* subscript = [MTTypesetter createLineForMathList:atom.subScript font:_font style:self.scriptStyle cramped:self.subscriptCramped];
+        MTMathListDisplay* subscript = [self layoutChildList:atom.subScript atomRange:atom.indexRange slot:kMTSubIndexTypeSubscript style:self.scriptStyle cramped:self.subscriptCramped];
         subscript.type = kMTLinePositionSubscript;
         subscript.index = index;
         
@@ -1174,7 +1081,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
         return;
     }
     
-    MTMathListDisplay* superScript = [MTTypesetter createLineForMathList:atom.superScript font:_font style:self.scriptStyle cramped:self.superScriptCramped];
+    MTMathListDisplay* superScript = [self layoutChildList:atom.superScript atomRange:atom.indexRange slot:kMTSubIndexTypeSuperscript style:self.scriptStyle cramped:self.superScriptCramped];
     superScript.type = kMTLinePositionSuperscript;
     superScript.index = index;
     superScriptShiftUp = fmax(superScriptShiftUp, self.superScriptShiftUp);
@@ -1187,7 +1094,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
         _currentPosition.x += superScript.width + _styleFont.mathTable.spaceAfterScript;
         return;
     }
-    MTMathListDisplay* subscript = [MTTypesetter createLineForMathList:atom.subScript font:_font style:self.scriptStyle cramped:self.subscriptCramped];
+    MTMathListDisplay* subscript = [self layoutChildList:atom.subScript atomRange:atom.indexRange slot:kMTSubIndexTypeSubscript style:self.scriptStyle cramped:self.subscriptCramped];
     subscript.type = kMTLinePositionSubscript;
     subscript.index = index;
     subscriptShiftDown = fmax(subscriptShiftDown, _styleFont.mathTable.subscriptShiftDown);
@@ -1346,8 +1253,8 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
     }
 
     MTLineStyle fractionStyle = self.fractionStyle;
-    MTMathListDisplay* numeratorDisplay = [MTTypesetter createLineForMathList:frac.numerator font:_font style:fractionStyle cramped:false];
-    MTMathListDisplay* denominatorDisplay = [MTTypesetter createLineForMathList:frac.denominator font:_font style:fractionStyle cramped:true];
+    MTMathListDisplay* numeratorDisplay = [self layoutChildList:frac.numerator atomRange:frac.indexRange slot:kMTSubIndexTypeNumerator style:fractionStyle cramped:NO];
+    MTMathListDisplay* denominatorDisplay = [self layoutChildList:frac.denominator atomRange:frac.indexRange slot:kMTSubIndexTypeDenominator style:fractionStyle cramped:YES];
 
     if (frac.isContinuedFraction) {
         // Apply cfrac strut floors to the operand boxes *before* numeratorShiftUp
@@ -1506,7 +1413,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
 
 - (MTRadicalDisplay*) makeRadical:(MTMathList*) radicand range:(NSRange) range
 {
-    MTMathListDisplay* innerDisplay = [MTTypesetter createLineForMathList:radicand font:_font style:_style cramped:YES];
+    MTMathListDisplay* innerDisplay = [self layoutChildList:radicand atomRange:range slot:kMTSubIndexTypeRadicand style:_style cramped:YES];
     CGFloat clearance = self.radicalVerticalGap;
     CGFloat radicalRuleThickness = _styleFont.mathTable.radicalRuleThickness;
     CGFloat radicalHeight = innerDisplay.ascent + innerDisplay.descent + clearance + radicalRuleThickness;
@@ -1603,12 +1510,12 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
     if (parts.count == 0) {
         return nil;
     }
-    NSArray<NSNumber*>* glyphs, *offsets;
+    CGGlyph* glyphs;
+    CGPoint* positions;
     CGFloat height;
-    [self constructGlyphWithParts:parts height:glyphHeight glyphs:&glyphs offsets:&offsets height:&height];
-    CGGlyph first = glyphs[0].shortValue;
-    CGFloat width = CTFontGetAdvancesForGlyphs(_styleFont.ctFont, kCTFontOrientationDefault, &first, NULL, 1);
-    MTGlyphConstructionDisplay* display = [[MTGlyphConstructionDisplay alloc] initWithGlyphs:glyphs offsets:offsets font:_styleFont];
+    NSUInteger count = [self constructGlyphWithParts:parts height:glyphHeight horizontal:NO glyphs:&glyphs positions:&positions height:&height];
+    CGFloat width = CTFontGetAdvancesForGlyphs(_styleFont.ctFont, kCTFontOrientationDefault, glyphs, NULL, 1);
+    MTGlyphConstructionDisplay* display = [[MTGlyphConstructionDisplay alloc] initWithGlyphs:glyphs positions:positions count:count font:_styleFont];
     display.width = width;
     display.ascent = height;
     display.descent = 0;   // it's upto the rendering to adjust the display up or down.
@@ -1625,23 +1532,14 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
     if (parts.count == 0) {
         return nil;
     }
-    NSArray<NSNumber*>* glyphs, *offsets;
+    CGGlyph* glyphs;
+    CGPoint* positions;
     CGFloat width;
-    [self constructGlyphWithParts:parts height:glyphWidth glyphs:&glyphs offsets:&offsets height:&width];
-
-    // Convert 1D offsets (along the construction axis) into 2D positions for the horizontal display.
-    NSMutableArray<NSValue*>* positions = [NSMutableArray arrayWithCapacity:offsets.count];
-    for (NSNumber* offset in offsets) {
-        CGPoint pt = CGPointMake(offset.floatValue, 0);
-        [positions addObject:[NSValue value:&pt withObjCType:@encode(CGPoint)]];
-    }
+    NSUInteger n = [self constructGlyphWithParts:parts height:glyphWidth horizontal:YES glyphs:&glyphs positions:&positions height:&width];
 
     // Compute combined ascent/descent from the parts' bounding boxes.
-    NSUInteger n = glyphs.count;
-    CGGlyph cgGlyphs[n];
-    for (NSUInteger i = 0; i < n; i++) cgGlyphs[i] = glyphs[i].shortValue;
     CGRect bboxes[n];
-    CTFontGetBoundingRectsForGlyphs(_styleFont.ctFont, kCTFontOrientationDefault, cgGlyphs, bboxes, n);
+    CTFontGetBoundingRectsForGlyphs(_styleFont.ctFont, kCTFontOrientationDefault, glyphs, bboxes, n);
     CGFloat maxAsc = 0, maxDes = 0;
     for (NSUInteger i = 0; i < n; i++) {
         CGFloat a, d;
@@ -1651,7 +1549,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
     }
 
     MTHorizontalGlyphAssemblyDisplay* display =
-        [[MTHorizontalGlyphAssemblyDisplay alloc] initWithGlyphs:glyphs positions:positions font:_styleFont range:range];
+        [[MTHorizontalGlyphAssemblyDisplay alloc] initWithGlyphs:glyphs positions:positions count:n font:_styleFont range:range];
     display.ascent = maxAsc;
     display.descent = maxDes;
     display.width = width;
@@ -1659,14 +1557,29 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
     return display;
 }
 
-- (void) constructGlyphWithParts:(NSArray<MTGlyphPart*>*) parts height:(CGFloat) glyphHeight glyphs:(NSArray<NSNumber*>**) glyphs offsets:(NSArray<NSNumber*>**) offsets height:(CGFloat*) height
+// Returns the number of glyphs, and in `glyphs` and `positions` malloc'd arrays of the glyphs
+// and their positions, offset along the y axis, or the x axis if `horizontal`.
+- (NSUInteger) constructGlyphWithParts:(NSArray<MTGlyphPart*>*) parts height:(CGFloat) glyphHeight horizontal:(BOOL) horizontal
+                                glyphs:(CGGlyph**) glyphs positions:(CGPoint**) positions height:(CGFloat*) height
 {
     NSParameterAssert(glyphs);
-    NSParameterAssert(offsets);
+    NSParameterAssert(positions);
+    MTCountEvent(kMTLayoutCounterGlyphAssemblies);
     
-    for (int numExtenders = 0; true; numExtenders++) {
-        NSMutableArray<NSNumber*>* glyphsRv = [NSMutableArray array];
-        NSMutableArray<NSNumber*>* offsetsRv = [NSMutableArray array];
+    NSUInteger extenderCount = 0;
+    for (MTGlyphPart* part in parts) {
+        if (part.isExtender) {
+            extenderCount++;
+        }
+    }
+    for (NSUInteger numExtenders = 0; true; numExtenders++) {
+        NSUInteger count = parts.count - extenderCount + extenderCount * numExtenders;
+        if (count == 0) {
+            continue;   // only extenders
+        }
+        CGGlyph* glyphsRv = malloc(count * sizeof(CGGlyph));
+        CGFloat* offsetsRv = malloc(count * sizeof(CGFloat));
+        NSUInteger n = 0;
         
         MTGlyphPart* prev = nil;
         CGFloat minDistance = _styleFont.mathTable.minConnectorOverlap;
@@ -1674,13 +1587,13 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
         CGFloat maxDelta = CGFLOAT_MAX;  // the maximum amount we can increase the offsets by
         
         for (MTGlyphPart* part in parts) {
-            int repeats = 1;
+            NSUInteger repeats = 1;
             if (part.isExtender) {
                 repeats = numExtenders;
             }
             // add the extender num extender times
-            for (int i = 0; i < repeats; i++) {
-                [glyphsRv addObject:[NSNumber numberWithShort:part.glyph]];
+            for (NSUInteger i = 0; i < repeats; i++) {
+                glyphsRv[n] = part.glyph;
                 if (prev) {
                     CGFloat maxOverlap = MIN(prev.endConnectorLength, part.startConnectorLength);
                     // the minimum amount we can add to the offset
@@ -1691,39 +1604,40 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
                     maxDelta = MIN(maxDelta, maxOffsetDelta - minOffsetDelta);
                     minOffset = minOffset + minOffsetDelta;
                 }
-                [offsetsRv addObject:[NSNumber numberWithFloat:minOffset]];
+                offsetsRv[n++] = minOffset;
                 prev = part;
             }
         }
         
-        NSAssert(glyphsRv.count == offsetsRv.count, @"Offsets should match the glyphs");
-        if (!prev) {
-            continue;   // maybe only extenders
-        }
+        NSAssert(n == count, @"Offsets should match the glyphs");
         CGFloat minHeight = minOffset + prev.fullAdvance;
-        CGFloat maxHeight = minHeight + maxDelta * (glyphsRv.count - 1);
+        CGFloat maxHeight = minHeight + maxDelta * (count - 1);
+        BOOL done = YES;
         if (minHeight >= glyphHeight) {
-            // we are done
-            *glyphs = glyphsRv;
-            *offsets = offsetsRv;
             *height = minHeight;
-            return;
         } else if (glyphHeight <= maxHeight) {
             // spread the delta equally between all the connectors
             CGFloat delta = glyphHeight - minHeight;
-            CGFloat deltaIncrease = delta / (glyphsRv.count - 1);
-            CGFloat lastOffset = 0;
-            for (int i = 0; i < offsetsRv.count; i++) {
-                CGFloat offset = offsetsRv[i].floatValue + i*deltaIncrease;
-                offsetsRv[i] = [NSNumber numberWithFloat:offset];
-                lastOffset = offset;
+            CGFloat deltaIncrease = delta / (count - 1);
+            for (NSUInteger i = 0; i < count; i++) {
+                offsetsRv[i] += i*deltaIncrease;
+            }
+            *height = offsetsRv[count - 1] + prev.fullAdvance;
+        } else {
+            done = NO;
+        }
+        if (done) {
+            CGPoint* positionsRv = malloc(count * sizeof(CGPoint));
+            for (NSUInteger i = 0; i < count; i++) {
+                positionsRv[i] = horizontal ? CGPointMake(offsetsRv[i], 0) : CGPointMake(0, offsetsRv[i]);
             }
-            // we are done
+            free(offsetsRv);
             *glyphs = glyphsRv;
-            *offsets = offsetsRv;
-            *height = lastOffset + prev.fullAdvance;
-            return;
+            *positions = positionsRv;
+            return count;
         }
+        free(glyphsRv);
+        free(offsetsRv);
     }
 }
 
@@ -1783,7 +1697,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
         NSMutableAttributedString* line = [[NSMutableAttributedString alloc] initWithString:op.nucleus];
         // add the font
         [line addAttribute:(NSString *)kCTFontAttributeName value:(__bridge id)(_styleFont.ctFont) range:NSMakeRange(0, line.length)];
-        MTCTLineDisplay* displayAtom = [[MTCTLineDisplay alloc] initWithString:line position:_currentPosition range:op.indexRange font:_styleFont atoms:@[ op ]];
+        MTCTLineDisplay* displayAtom = [[MTCTLineDisplay alloc] initWithString:line position:_currentPosition range:op.indexRange font:_styleFont atoms:@[ op ] retainAtoms:_retainsAtoms];
         return [self addLimitsToDisplay:displayAtom forOperator:op delta:0];
     }
 }
@@ -1811,10 +1725,10 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
         // make limits
         MTMathListDisplay *superScript = nil, *subScript = nil;
         if (op.superScript) {
-            superScript = [MTTypesetter createLineForMathList:op.superScript font:_font style:self.scriptStyle cramped:self.superScriptCramped];
+            superScript = [self layoutChildList:op.superScript atomRange:op.indexRange slot:kMTSubIndexTypeSuperscript style:self.scriptStyle cramped:self.superScriptCramped];
         }
         if (op.subScript) {
-            subScript = [MTTypesetter createLineForMathList:op.subScript font:_font style:self.scriptStyle cramped:self.subscriptCramped];
+            subScript = [self layoutChildList:op.subScript atomRange:op.indexRange slot:kMTSubIndexTypeSubscript style:self.scriptStyle cramped:self.subscriptCramped];
         }
         NSAssert(superScript || subScript, @"Atleast one of superscript or subscript should have been present.");
         MTLargeOpLimitsDisplay* opsDisplay = [[MTLargeOpLimitsDisplay alloc] initWithNucleus:display upperLimit:superScript lowerLimit:subScript limitShift:delta/2 extraPadding:0];
@@ -1866,7 +1780,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
 
 - (MTDisplay*) makeUnderline:(MTUnderLine*) under
 {
-    MTMathListDisplay* innerListDisplay = [MTTypesetter createLineForMathList:under.innerList font:_font style:_style cramped:_cramped];
+    MTMathListDisplay* innerListDisplay = [self layoutChildList:under.innerList atomRange:under.indexRange slot:kMTSubIndexTypeInner style:_style cramped:_cramped];
     MTLineDisplay* underDisplay = [[MTLineDisplay alloc] initWithInner:innerListDisplay position:_currentPosition range:under.indexRange];
     // Move the line down by the vertical gap.
     underDisplay.lineShiftUp = -(innerListDisplay.descent + _styleFont.mathTable.underbarVerticalGap);
@@ -1879,7 +1793,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
 
 - (MTDisplay*) makeOverline:(MTOverLine*) over
 {
-    MTMathListDisplay* innerListDisplay = [MTTypesetter createLineForMathList:over.innerList font:_font style:_style cramped:YES];
+    MTMathListDisplay* innerListDisplay = [self layoutChildList:over.innerList atomRange:over.indexRange slot:kMTSubIndexTypeInner style:_style cramped:YES];
     MTLineDisplay* overDisplay = [[MTLineDisplay alloc] initWithInner:innerListDisplay position:_currentPosition range:over.indexRange];
     overDisplay.lineShiftUp = innerListDisplay.ascent + _styleFont.mathTable.overbarVerticalGap;
     overDisplay.lineThickness = _styleFont.mathTable.underbarRuleThickness;
@@ -1893,11 +1807,11 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
 
 - (BOOL) isSingleCharAccentee:(MTAccent*) accent
 {
-    if (accent.innerList.atoms.count != 1) {
+    if (accent.innerList.atomsForReading.count != 1) {
         // Not a single char list.
         return 0;
     }
-    MTMathAtom* innerAtom = accent.innerList.atoms[0];
+    MTMathAtom* innerAtom = accent.innerList.atomsForReading[0];
     if (innerAtom.nucleus.unicodeLength != 1) {
         // A complex atom, not a simple char.
         return NO;
@@ -1908,6 +1822,12 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
     return YES;
 }
 
+// The scripts of an accent over a single character are attached to the character.
+- (BOOL) accenteeTakesScripts:(MTAccent*) accent
+{
+    return accent.nucleus.length > 0 && (accent.subScript || accent.superScript) && [self isSingleCharAccentee:accent];
+}
+
 // The distance the accent must be moved from the beginning.
 - (CGFloat) getSkew:(MTAccent*) accent accenteeWidth:(CGFloat) width accentGlyph:(CGGlyph) accentGlyph
 {
@@ -1921,8 +1841,8 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
         // use the center of the accentee
         accenteeAdjustment = width/2;
     } else {
-        MTMathAtom* innerAtom = accent.innerList.atoms[0];
-        CGGlyph accenteeGlyph = [self findGlyphForCharacterAtIndex:innerAtom.nucleus.length - 1 inString:innerAtom.nucleus];
+        NSString* nucleus = typesetNucleus(accent.innerList.atomsForReading[0]);
+        CGGlyph accenteeGlyph = [self findGlyphForCharacterAtIndex:nucleus.length - 1 inString:nucleus];
         accenteeAdjustment = [_styleFont.mathTable getTopAccentAdjustment:accenteeGlyph];
     }
     // The adjustments need to aligned, so skew is just the difference.
@@ -1974,7 +1894,7 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
 
 - (MTDisplay*) makeAccent:(MTAccent*) accent
 {
-    MTMathListDisplay* accentee = [MTTypesetter createLineForMathList:accent.innerList font:_font style:_style cramped:YES];
+    MTMathListDisplay* accentee = [self layoutChildList:accent.innerList atomRange:accent.indexRange slot:kMTSubIndexTypeInner style:_style cramped:YES];
     if (accent.nucleus.length == 0) {
         // no accent!
         return accentee;
@@ -1994,17 +1914,16 @@ static void getBboxDetails(CGRect bbox, CGFloat* ascent, CGFloat* descent)
     accentGlyphDisplay.width = glyphWidth;
     accentGlyphDisplay.position = accentPosition;
     
-    if ([self isSingleCharAccentee:accent] && (accent.subScript || accent.superScript)) {
-        // Attach the super/subscripts to the accentee instead of the accent.
-        MTMathAtom* innerAtom = accent.innerList.atoms[0];
+    if ([self accenteeTakesScripts:accent]) {
+        // Attach the super/subscripts to the accentee instead of the accent. The accent is left as it is,
+        // the accentee is remade from a copy of its atom that has the sub/superscripts.
+        MTMathAtom* innerAtom = MTMathAtomCopySharingChildLists(accent.innerList.atomsForReading[0]);
         innerAtom.superScript = accent.superScript;
         innerAtom.subScript = accent.subScript;
-        accent.superScript = nil;
-        accent.subScript = nil;
-        // Remake the accentee (now with sub/superscripts)
         // Note: Latex adjusts the heights in case the height of the char is different in non-cramped mode. However this shouldn't be the case since cramping
         // only affects fractions and superscripts. We skip adjusting the heights.
-        accentee = [MTTypesetter createLineForMathList:accent.innerList font:_font style:_style cramped:_cramped];
+        accentee = [MTTypesetter createLineForMathList:[MTMathList mathListWithAtoms:innerAtom, nil] font:_font style:_style cramped:_cramped spaced:NO
+                                        scaleInvariant:_scaleInvariant retainsAtoms:_retainsAtoms previousDisplay:nil changedIndex:nil];
     }
     
     MTAccentDisplay* display = [[MTAccentDisplay alloc] initWithAccent:accentGlyphDisplay accentee:accentee range:accent.indexRange];
@@ -2132,11 +2051,12 @@ typedef NS_ENUM(NSUInteger, MTStackRole) {
             return [self buildHorizontalExtensibleDisplay:construction forWidth:targetWidth range:range];
 
         case kMTMathStackConstructionMathList: {
-            return [MTTypesetter createLineForMathList:construction.list
-                                                  font:_font
-                                                 style:self.scriptStyle
-                                               cramped:(role == kMTStackRoleOver ? self.superScriptCramped
-                                                                                 : self.subscriptCramped)];
+            return [self layoutChildList:construction.list
+                               atomRange:range
+                                    slot:(role == kMTStackRoleOver ? kMTLayoutSlotStackOver : kMTLayoutSlotStackUnder)
+                                   style:self.scriptStyle
+                                 cramped:(role == kMTStackRoleOver ? self.superScriptCramped
+                                                                   : self.subscriptCramped)];
         }
 
         case kMTMathStackConstructionRule:
@@ -2153,7 +2073,7 @@ typedef NS_ENUM(NSUInteger, MTStackRole) {
     // Current Phase-1 behavior uses the gap metrics uniformly for all construction
     // kinds; revisit if brace/accent-like constructions need tighter clearance.
     MTMathListDisplay* baseDisplay =
-        [MTTypesetter createLineForMathList:stack.innerList font:_font style:_style cramped:_cramped];
+        [self layoutChildList:stack.innerList atomRange:stack.indexRange slot:kMTSubIndexTypeInner style:_style cramped:_cramped];
     CGFloat targetWidth = baseDisplay.width;
 
     MTDisplay* overDisp  = stack.over  ? [self buildStackConstruction:stack.over  forWidth:targetWidth role:kMTStackRoleOver  range:stack.indexRange] : nil;
@@ -2215,8 +2135,8 @@ static const CGFloat kArrayRulePaddingMultiplier = 0.2; // content↔rule cleara
     CGFloat *columnWidths = calloc(numColumns, sizeof(CGFloat));
     NSAssert(columnWidths != NULL, @"Failed to allocate columnWidths");
     // Wrap in @try/@finally so columnWidths is released on all exit paths.
-    // typesetCells:/makeRowWithColumns: eventually call changeFont, which can
-    // @throw IllegalCharacter / Invalid style; those would otherwise leak the buffer.
+    // An exception raised while typesetting the cells (e.g. a failed assertion) would
+    // otherwise leak the buffer.
     MTMathListDisplay* tableDisplay = nil;
     @try {
         NSArray<NSArray<MTDisplay*>*>* displays = [self typesetCells:table columnWidths:columnWidths];
@@ -2394,16 +2314,49 @@ static const CGFloat kArrayRulePaddingMultiplier = 0.2; // content↔rule cleara
 // Typeset every cell in the table. As a side-effect calculate the max column width of each column.
 - (NSArray<NSArray<MTDisplay*>*>*) typesetCells:(MTMathTable*) table columnWidths:(CGFloat[]) columnWidths
 {
-    NSMutableArray<NSMutableArray<MTDisplay*>*> *displays = [NSMutableArray arrayWithCapacity:table.numRows];
     // Cells inherit the surrounding style unless the env pins one (matrix/cases -> Text,
     // smallmatrix -> Script); see -cellStyleForTable:.
     MTLineStyle cellStyle = [self cellStyleForTable:table];
 
+    // Flatten row-major so each cell owns one slot, even when rows are ragged. During an
+    // incremental layout, cells of an untouched table are adopted from the previous one.
+    NSUInteger atomIndex = layoutAtomIndex(table.indexRange);
+    NSMutableArray<MTMathListDisplay*>* cellDisplays = [NSMutableArray array];
+    NSMutableArray<MTMathList*>* missingLists = [NSMutableArray array];
+    NSMutableIndexSet* missingCells = [NSMutableIndexSet indexSet];
+    for (NSArray<MTMathList*>* row in table.cells) {
+        for (MTMathList* cell in row) {
+            NSUInteger cellIndex = cellDisplays.count;
+            MTMathListIndex* changedIndex = nil;
+            MTMathListDisplay* previous = [_reuse previousChildForAtom:atomIndex slot:kMTLayoutSlotTableCell + cellIndex changedIndex:&changedIndex];
+            if (previous && previous.layoutStyle == cellStyle && !previous.layoutCramped) {
+                [cellDisplays addObject:adoptLayout(previous)];
+            } else {
+                // Placeholder until the missing cells are laid out below.
+                [cellDisplays addObject:(MTMathListDisplay*) [NSNull null]];
+                [missingLists addObject:cell];
+                [missingCells addIndex:cellIndex];
+            }
+        }
+    }
+    NSArray<MTMathListDisplay*>* laidOut = [self typesetCellLists:missingLists style:cellStyle];
+    __block NSUInteger next = 0;
+    [missingCells enumerateIndexesUsingBlock:^(NSUInteger cellIndex, BOOL *stop) {
+        cellDisplays[cellIndex] = laidOut[next++];
+    }];
+    for (NSUInteger cellIndex = 0; cellIndex < cellDisplays.count; cellIndex++) {
+        [self recordChildLayout:cellDisplays[cellIndex] atomIndex:atomIndex slot:kMTLayoutSlotTableCell + cellIndex];
+    }
+
+    // The column width reduction runs serially after layout, so it sees the cells in
+    // the same order regardless of which path produced them.
+    NSMutableArray<NSMutableArray<MTDisplay*>*> *displays = [NSMutableArray arrayWithCapacity:table.numRows];
+    NSUInteger cellIndex = 0;
     for(NSArray<MTMathList*>* row in table.cells) {
         NSMutableArray<MTDisplay*>* colDisplays = [NSMutableArray arrayWithCapacity:row.count];
         [displays addObject:colDisplays];
         for (int i = 0; i < row.count; i++) {
-            MTMathListDisplay* disp = [MTTypesetter createLineForMathList:row[i] font:_font style:cellStyle cramped:NO];
+            MTMathListDisplay* disp = cellDisplays[cellIndex++];
             columnWidths[i] = MAX(disp.width, columnWidths[i]);
             [colDisplays addObject:disp];
         };
@@ -2411,6 +2364,63 @@ static const CGFloat kArrayRulePaddingMultiplier = 0.2; // content↔rule cleara
     return displays;
 }
 
+// Lay out each cell list on its own. Below +parallelCellThreshold this is a plain loop;
+// above it the cells are spread across GCD's bounded apply pool. Cells never share atoms
+// and the font is only read, so the workers need no locking beyond the exception slot.
+- (NSArray<MTMathListDisplay*>*) typesetCellLists:(NSArray<MTMathList*>*) cellLists style:(MTLineStyle) cellStyle
+{
+    NSUInteger count = cellLists.count;
+    if (count < 2 || count < sParallelCellThreshold) {
+        NSMutableArray<MTMathListDisplay*>* cellDisplays = [NSMutableArray arrayWithCapacity:count];
+        for (MTMathList* cell in cellLists) {
+            [cellDisplays addObject:[MTTypesetter createLineForMathList:cell font:_font style:cellStyle cramped:NO spaced:NO
+                                                         scaleInvariant:_scaleInvariant retainsAtoms:_retainsAtoms
+                                                        previousDisplay:nil changedIndex:nil]];
+        }
+        return cellDisplays;
+    }
+
+    // Each worker writes only its own slot, so the buffer itself needs no lock.
+    MTMathListDisplay* __strong *results = (MTMathListDisplay* __strong *) calloc(count, sizeof(MTMathListDisplay*));
+    NSAssert(results != NULL, @"Failed to allocate cell display buffer");
+    MTFont* font = _font;
+    BOOL scaleInvariant = _scaleInvariant;
+    BOOL retainsAtoms = _retainsAtoms;
+    NSObject* failureLock = [NSObject new];
+    // Exceptions must not escape a dispatch_apply block. Keep the one from the lowest
+    // cell index so the caller sees the same exception the serial loop would raise.
+    __block NSException* failure = nil;
+    __block NSUInteger failureIndex = NSNotFound;
+    NSArray<MTMathListDisplay*>* cellDisplays = nil;
+    @try {
+        dispatch_apply(count, DISPATCH_APPLY_AUTO, ^(size_t i) {
+            @try {
+                results[i] = [MTTypesetter createLineForMathList:cellLists[i] font:font style:cellStyle cramped:NO spaced:NO
+                                                  scaleInvariant:scaleInvariant retainsAtoms:retainsAtoms
+                                                 previousDisplay:nil changedIndex:nil];
+            } @catch (NSException* exception) {
+                @synchronized (failureLock) {
+                    if (i < failureIndex) {
+                        failureIndex = i;
+                        failure = exception;
+                    }
+                }
+            }
+        });
+        if (failure) {
+            @throw failure;
+        }
+        cellDisplays = [NSArray arrayWithObjects:results count:count];
+    } @finally {
+        // Release the strong references by hand before freeing the raw buffer.
+        for (NSUInteger i = 0; i < count; i++) {
+            results[i] = nil;
+        }
+        free(results);
+    }
+    return cellDisplays;
+}
+
 // The line style the cells of this table actually render in. Some envs pin every
 // cell to a fixed style (matrix/cases -> Text, smallmatrix -> Script) via
 // table.cellStyle; the rest leave it kMTLineStyleInherit and render in the
@@ -2512,18 +2522,24 @@ static const CGFloat kArrayRulePaddingMultiplier = 0.2; // content↔rule cleara
 
 // Delimiter shortfall from plain.tex
 static const NSInteger kDelimiterFactor = 901;
+// This is the only quantity of the layout given in absolute points rather than relative to
+// the font, so it makes the layout depend on the font size beyond a plain scale.
 static const NSInteger kDelimiterShortfallPoints = 5;
+// The same shortfall relative to the em: 5pt at the 10pt design size of plain.tex. Used by
+// scale-invariant layouts.
+static const CGFloat kDelimiterShortfallEm = 0.5;
 
 - (MTInnerDisplay*) makeInner:(MTInner*) inner atIndex:(NSUInteger) index
 {
   NSAssert(inner.leftBoundary || inner.rightBoundary, @"Inner should have a boundary to call this function");
   
-  MTMathListDisplay* innerListDisplay = [MTTypesetter createLineForMathList:inner.innerList font:_font style:_style cramped:_cramped];
+  MTMathListDisplay* innerListDisplay = [self layoutChildList:inner.innerList atomRange:inner.indexRange slot:kMTSubIndexTypeInner style:_style cramped:_cramped];
   CGFloat axisHeight = _styleFont.mathTable.axisHeight;
   // delta is the max distance from the axis
   CGFloat delta = MAX(innerListDisplay.ascent - axisHeight, innerListDisplay.descent + axisHeight);
   CGFloat d1 = (delta / 500) * kDelimiterFactor;  // This represents atleast 90% of the formula
-  CGFloat d2 = 2 * delta - kDelimiterShortfallPoints;  // This represents a shortfall of 5pt
+  CGFloat shortfall = _scaleInvariant ? kDelimiterShortfallEm * _styleFont.fontSize : kDelimiterShortfallPoints;
+  CGFloat d2 = 2 * delta - shortfall;  // This represents a shortfall of 5pt
   // The size of the delimiter glyph should cover at least 90% of the formula or
   // be at most 5pt short.
   CGFloat glyphHeight = MAX(d1, d2);
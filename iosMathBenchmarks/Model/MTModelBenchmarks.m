@@ -0,0 +1,287 @@
+//
+//  MTModelBenchmarks.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTBenchmarkCase.h"
+#import "MTMathList.h"
+#import "MTMathListBuilder.h"
+#import "MTMathAtomFactory.h"
+#import "MTMathParserContext.h"
+#import "MTMathListDiff.h"
+#import "MTPersistentMathList.h"
+#import "MTRetainedSize.h"
+
+// The parse and finalize stages, which only need the math model and Foundation.
+@interface MTModelBenchmarks : MTBenchmarkCase
+
+@end
+
+@implementation MTModelBenchmarks
+
+- (NSArray<MTMathList*>*) parsedFormulasOfCorpus:(MTBenchmarkCorpus*) corpus
+{
+    NSMutableArray<MTMathList*>* lists = [NSMutableArray array];
+    for (NSString* latex in corpus.formulas) {
+        NSError* error = nil;
+        MTMathList* list = [MTMathListBuilder buildFromString:latex error:&error];
+        XCTAssertNotNil(list, @"%@ %@: %@", corpus.name, latex, error);
+        if (list) {
+            [lists addObject:list];
+        }
+    }
+    return lists;
+}
+
+- (void)testParse
+{
+    for (MTBenchmarkCorpus* corpus in [MTBenchmarkCorpus allCorpora]) {
+        NSArray<NSString*>* formulas = corpus.formulas;
+        [self measureStage:@"parse" corpus:corpus formulaCount:formulas.count block:^{
+            for (NSString* latex in formulas) {
+                [MTMathListBuilder buildFromString:latex];
+            }
+        }];
+    }
+}
+
+- (void)testFinalize
+{
+    for (MTBenchmarkCorpus* corpus in [MTBenchmarkCorpus allCorpora]) {
+        NSArray<MTMathList*>* lists = [self parsedFormulasOfCorpus:corpus];
+        [self measureStage:@"finalize" corpus:corpus formulaCount:lists.count block:^{
+            for (MTMathList* list in lists) {
+                [list finalized];
+            }
+        }];
+    }
+}
+
+// Symbol lookups, copying the atom as the parser used to and sharing it as it does now, and parsing
+// followed by the first call to `atoms`, which copies the shared atoms of each list. Compare the
+// allocations of `parse` and `parseThenAtoms` for what the shared atoms save.
+- (void)testSharedAtoms
+{
+    NSArray<NSString*>* names = [MTMathAtomFactory supportedLatexSymbolNames];
+    MTBenchmarkCorpus* symbols = [[MTBenchmarkCorpus alloc] initWithName:@"symbols" formulas:names];
+    [self measureStage:@"symbolLookupCopy" corpus:symbols formulaCount:names.count block:^{
+        for (NSString* name in names) {
+            [MTMathAtomFactory atomForLatexSymbolName:name];
+        }
+    }];
+    [self measureStage:@"symbolLookupShared" corpus:symbols formulaCount:names.count block:^{
+        for (NSString* name in names) {
+            [MTMathAtomFactory sharedAtomForLatexSymbolName:name];
+        }
+    }];
+    for (MTBenchmarkCorpus* corpus in [MTBenchmarkCorpus allCorpora]) {
+        NSArray<NSString*>* formulas = corpus.formulas;
+        [self measureStage:@"parseThenAtoms" corpus:corpus formulaCount:formulas.count block:^{
+            for (NSString* latex in formulas) {
+                (void) [MTMathListBuilder buildFromString:latex].atoms;
+            }
+        }];
+    }
+}
+
+// Parsing every formula on all cores at once: with the symbols of the factory, with one shared context, and
+// with a context of its own for each pass, as a server that parses for many documents would. The
+// contexts are only read, so the three should scale alike.
+- (void)testConcurrentParse
+{
+    const NSUInteger passCount = 64;
+    NSMutableArray<MTMathParserContext*>* contexts = [NSMutableArray array];
+    for (NSUInteger i = 0; i < passCount; i++) {
+        NSString* name = [NSString stringWithFormat:@"op%c%c", (char) ('a' + i / 26), (char) ('a' + i % 26)];
+        [contexts addObject:[[MTMathParserContext.defaultContext contextByAddingSymbol:name value:[MTMathAtomFactory operatorWithName:name limits:NO]]
+                             contextByAddingMacro:@"R" expansion:@"\\mathbb{R}"]];
+    }
+    dispatch_queue_t queue = dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0);
+    for (MTBenchmarkCorpus* corpus in [MTBenchmarkCorpus allCorpora]) {
+        NSArray<NSString*>* formulas = corpus.formulas;
+        NSUInteger formulaCount = formulas.count * passCount;
+        [self measureStage:@"parseConcurrent" corpus:corpus formulaCount:formulaCount block:^{
+            dispatch_apply(passCount, queue, ^(size_t pass) {
+                for (NSString* latex in formulas) {
+                    [MTMathListBuilder buildFromString:latex];
+                }
+            });
+        }];
+        [self measureStage:@"parseConcurrentSharedContext" corpus:corpus formulaCount:formulaCount block:^{
+            dispatch_apply(passCount, queue, ^(size_t pass) {
+                for (NSString* latex in formulas) {
+                    [MTMathListBuilder buildFromString:latex context:MTMathParserContext.defaultContext error:nil];
+                }
+            });
+        }];
+        [self measureStage:@"parseConcurrentContexts" corpus:corpus formulaCount:formulaCount block:^{
+            dispatch_apply(passCount, queue, ^(size_t pass) {
+                for (NSString* latex in formulas) {
+                    [MTMathListBuilder buildFromString:latex context:contexts[pass] error:nil];
+                }
+            });
+        }];
+    }
+}
+
+// Fingerprinting every formula, against hashing its LaTeX, the only identity a cache had before. Each pass
+// starts from invalidated fingerprints, so this is the cost of computing them, not of reading the cache.
+- (void)testFingerprint
+{
+    // A change to a list that two atoms hold invalidates every cached fingerprint, since the list does
+    // not know all the nodes above it.
+    MTMathList* shared = [MTMathList new];
+    MTMathAtom* first = [MTMathAtomFactory atomForCharacter:'x'];
+    MTMathAtom* second = [MTMathAtomFactory atomForCharacter:'y'];
+    first.superScript = shared;
+    second.superScript = shared;
+    for (MTBenchmarkCorpus* corpus in [MTBenchmarkCorpus allCorpora]) {
+        NSArray<MTMathList*>* lists = [self parsedFormulasOfCorpus:corpus];
+        [self measureStage:@"fingerprint" corpus:corpus formulaCount:lists.count block:^{
+            (void) first.fingerprint;
+            (void) second.fingerprint;
+            [shared addAtom:[MTMathAtomFactory atomForCharacter:'2']];
+            for (MTMathList* list in lists) {
+                (void) list.fingerprint;
+            }
+        }];
+        [self measureStage:@"latexHash" corpus:corpus formulaCount:lists.count block:^{
+            for (MTMathList* list in lists) {
+                (void) [MTMathListBuilder mathListToString:list].hash;
+            }
+        }];
+        // Nothing changes between the runs, so every fingerprint is read from the cache.
+        [self measureStage:@"cachedFingerprint" corpus:corpus formulaCount:lists.count block:^{
+            for (MTMathList* list in lists) {
+                (void) list.fingerprint;
+            }
+        }];
+    }
+}
+
+// Encoding and decoding the binary archives, to compare with the parse stage of the LaTeX they
+// were made from. Logs the size of the archives against that of the LaTeX.
+- (void)testArchive
+{
+    for (MTBenchmarkCorpus* corpus in [MTBenchmarkCorpus allCorpora]) {
+        NSArray<MTMathList*>* lists = [self parsedFormulasOfCorpus:corpus];
+        NSMutableArray<NSData*>* archives = [NSMutableArray arrayWithCapacity:lists.count];
+        for (MTMathList* list in lists) {
+            NSData* data = list.archivedData;
+            XCTAssertNotNil(data, @"%@", corpus.name);
+            if (data) {
+                [archives addObject:data];
+            }
+        }
+        [self measureStage:@"archive" corpus:corpus formulaCount:lists.count block:^{
+            for (MTMathList* list in lists) {
+                (void) list.archivedData;
+            }
+        }];
+        [self measureStage:@"unarchive" corpus:corpus formulaCount:archives.count block:^{
+            for (NSData* data in archives) {
+                [MTMathList mathListWithArchivedData:data];
+            }
+        }];
+        NSUInteger archiveBytes = 0;
+        NSUInteger latexBytes = 0;
+        for (NSData* data in archives) {
+            archiveBytes += data.length;
+        }
+        for (NSString* latex in corpus.formulas) {
+            latexBytes += [latex lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+        }
+        NSLog(@"%@/archive: %lu archive bytes vs %lu LaTeX bytes", corpus.name, (unsigned long) archiveBytes, (unsigned long) latexBytes);
+    }
+}
+
+// An editor of a long sum that keeps every version for undo, editing one subscript at a time: by
+// copying the list before each edit, and with persistent versions. Reports the time per edit and the
+// memory held per undo step.
+- (void)testUndoSnapshots
+{
+    const NSUInteger editCount = 100;
+    MTBenchmarkCorpus* corpus = [MTBenchmarkCorpus longSum];
+    MTMathList* base = [self parsedFormulasOfCorpus:corpus].firstObject;
+    MTBenchmarkCorpus* edits = [[MTBenchmarkCorpus alloc] initWithName:@"longSumEdits" formulas:corpus.formulas];
+    MTMathAtom* replacement = [MTMathAtomFactory atomForCharacter:'n'];
+    // The first digit of the subscript of the ith term.
+    NSMutableArray<MTMathListIndex*>* indexes = [NSMutableArray array];
+    for (NSUInteger i = 0; i < editCount; i++) {
+        MTMathListIndex* digit = [MTMathListIndex level0Index:0];
+        [indexes addObject:[MTMathListIndex indexAtLocation:(i * 40) withSubIndex:digit type:kMTSubIndexTypeSubscript]];
+    }
+
+    __block NSArray* copies = nil;
+    [self measureStage:@"undoCopy" corpus:edits formulaCount:editCount block:^{
+        NSMutableArray* snapshots = [NSMutableArray array];
+        MTMathList* list = [base copy];
+        for (MTMathListIndex* index in indexes) {
+            [snapshots addObject:[list copy]];
+            MTMathList* subscript = [list.atoms[index.atomIndex] subScript];
+            [subscript removeAtomAtIndex:0];
+            [subscript insertAtom:[replacement copy] atIndex:0];
+        }
+        copies = snapshots;
+    }];
+
+    __block NSArray* versions = nil;
+    MTPersistentMathList* first = [[MTPersistentMathList alloc] initWithMathList:base];
+    [self measureStage:@"undoPersistent" corpus:edits formulaCount:editCount block:^{
+        NSMutableArray* snapshots = [NSMutableArray array];
+        MTPersistentMathList* version = first;
+        for (MTMathListIndex* index in indexes) {
+            [snapshots addObject:version.mathList];
+            version = [version listByReplacingAtomAtListIndex:index withAtom:replacement];
+        }
+        versions = snapshots;
+    }];
+
+    MTRetainedSizeCounter* copySize = [MTRetainedSizeCounter new];
+    [copySize addObject:copies];
+    MTRetainedSizeCounter* versionSize = [MTRetainedSizeCounter new];
+    [versionSize addObject:versions];
+    NSLog(@"%@/undo: %lu bytes/step with copies, %lu bytes/step with persistent versions", edits.name,
+          (unsigned long) (copySize.size / editCount), (unsigned long) (versionSize.size / editCount));
+    XCTAssertLessThan(versionSize.size, copySize.size);
+}
+
+// Diffs a long sum against versions of it with a few small edits: versions made from it, which share the
+// atoms that did not change, and the same versions parsed on their own, which share nothing.
+- (void)testDiff
+{
+    const NSUInteger versionCount = 20;
+    MTBenchmarkCorpus* corpus = [MTBenchmarkCorpus longSum];
+    MTMathList* base = [self parsedFormulasOfCorpus:corpus].firstObject;
+    MTPersistentMathList* first = [[MTPersistentMathList alloc] initWithMathList:base];
+    MTMathAtom* replacement = [MTMathAtomFactory atomForCharacter:'n'];
+    NSMutableArray<MTMathList*>* shared = [NSMutableArray array];
+    NSMutableArray<MTMathList*>* parsed = [NSMutableArray array];
+    for (NSUInteger i = 0; i < versionCount; i++) {
+        // A subscript digit and an operator, far apart.
+        MTMathListIndex* digit = [MTMathListIndex indexAtLocation:(i * 200) withSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeSubscript];
+        MTPersistentMathList* version = [[first listByReplacingAtomAtListIndex:digit withAtom:replacement]
+                                         listByRemovingAtomAtListIndex:[MTMathListIndex level0Index:(i * 200 + 4001)]];
+        [shared addObject:version.mathList];
+        [parsed addObject:[MTMathListBuilder buildFromString:[MTMathListBuilder mathListToString:version.mathList]]];
+    }
+    MTBenchmarkCorpus* edits = [[MTBenchmarkCorpus alloc] initWithName:@"longSumEdits" formulas:corpus.formulas];
+    [self measureStage:@"diffShared" corpus:edits formulaCount:versionCount block:^{
+        for (MTMathList* list in shared) {
+            [MTMathListDiff changesFromMathList:first.mathList toMathList:list];
+        }
+    }];
+    [self measureStage:@"diffParsed" corpus:edits formulaCount:versionCount block:^{
+        for (MTMathList* list in parsed) {
+            [MTMathListDiff changesFromMathList:base toMathList:list];
+        }
+    }];
+    for (NSUInteger i = 0; i < versionCount; i++) {
+        XCTAssertEqual([MTMathListDiff changesFromMathList:base toMathList:parsed[i]].count, 2u);
+    }
+}
+
+@end
@@ -0,0 +1,156 @@
+//
+//  MTDrawBenchmarks.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTRenderBenchmarkCase.h"
+#import "MTDrawCommandList.h"
+#import "MTRasterCache.h"
+#import "MTSVGExporter.h"
+#import "MTPDFWriter.h"
+
+static const CGSize kMTBenchmarkLetterSize = { 612, 792 };
+
+// Drawing through the compiled command lists and the raster cache, and exporting to SVG and PDF.
+// Compare with the `draw` stage of MTRenderBenchmarks, which draws the display trees.
+@interface MTDrawBenchmarks : MTRenderBenchmarkCase
+
+@end
+
+@implementation MTDrawBenchmarks
+
+// Compiling the displays of each corpus to command lists, and drawing the lists.
+- (void)testCommandLists
+{
+    CGContextRef context = MTBenchmarkCreateContext(512, 512, 1);
+    for (MTBenchmarkCorpus* corpus in [MTBenchmarkCorpus allCorpora]) {
+        NSArray<MTMathListDisplay*>* displays = [self displaysOfCorpus:corpus];
+        NSMutableArray<MTDrawCommandList*>* commandLists = [NSMutableArray arrayWithCapacity:displays.count];
+        for (MTMathListDisplay* display in displays) {
+            [commandLists addObject:[[MTDrawCommandList alloc] initWithDisplay:display]];
+        }
+        [self measureStage:@"compileCommands" corpus:corpus formulaCount:displays.count block:^{
+            for (MTMathListDisplay* display in displays) {
+                (void) [[MTDrawCommandList alloc] initWithDisplay:display];
+            }
+        }];
+        [self measureStage:@"drawCommands" corpus:corpus formulaCount:commandLists.count block:^{
+            for (MTDrawCommandList* commands in commandLists) {
+                [commands draw:context];
+            }
+        }];
+    }
+    CGContextRelease(context);
+}
+
+// A formula a few thousand points wide, of which a view redraws a 100pt square: drawing every
+// command, and only those in the dirty rect.
+- (void)testCulledDraw
+{
+    NSMutableString* latex = [NSMutableString string];
+    for (NSUInteger i = 0; i < 300; i++) {
+        [latex appendFormat:@"\\frac{x_{%lu}}{%lu} + ", (unsigned long) i, (unsigned long) i + 1];
+    }
+    [latex appendString:@"y"];
+    MTBenchmarkCorpus* corpus = [[MTBenchmarkCorpus alloc] initWithName:@"wideFormula" formulas:@[ latex ]];
+    MTMathListDisplay* display = [self displaysOfCorpus:corpus].firstObject;
+    MTDrawCommandList* commands = [[MTDrawCommandList alloc] initWithDisplay:display];
+    // Build the index outside the measurement.
+    (void) [commands indexesOfCommandsInRect:CGRectZero];
+
+    CGRect dirtyRect = CGRectMake(display.inkWidth / 2, 0, 100, 100);
+    CGContextRef context = MTBenchmarkCreateContext(200, 200, 1);
+    // Move the dirty rectangle onto the bitmap.
+    CGContextTranslateCTM(context, 50 - CGRectGetMinX(dirtyRect), 50);
+    CGContextClipToRect(context, dirtyRect);
+    [self measureStage:@"drawCommands" corpus:corpus formulaCount:1 block:^{
+        [commands draw:context];
+    }];
+    [self measureStage:@"drawCommandsInRect" corpus:corpus formulaCount:1 block:^{
+        [commands drawInRect:dirtyRect context:context];
+    }];
+    CGContextRelease(context);
+}
+
+// Rendering the displays to bitmaps at 2x, and drawing the bitmaps as a scrolling list does
+// from the raster cache. Logs the memory the bitmaps take. Only the corpora of formulas of a
+// usual size: the bitmaps of the synthetic ones would be many megabytes each.
+- (void)testRasterImages
+{
+    CGContextRef context = MTBenchmarkCreateContext(800, 240, 2);
+    for (MTBenchmarkCorpus* corpus in @[ [MTBenchmarkCorpus demo], [MTBenchmarkCorpus features] ]) {
+        NSArray<MTMathListDisplay*>* displays = [self displaysOfCorpus:corpus];
+        NSMutableArray<MTRasterImage*>* images = [NSMutableArray arrayWithCapacity:displays.count];
+        NSUInteger bytes = 0;
+        for (MTMathListDisplay* display in displays) {
+            MTRasterImage* image = [MTRasterImage imageWithDisplay:display scale:2];
+            XCTAssertNotNil(image);
+            if (image) {
+                [images addObject:image];
+                bytes += image.byteCount;
+            }
+        }
+        [self measureStage:@"rasterize" corpus:corpus formulaCount:displays.count block:^{
+            for (MTMathListDisplay* display in displays) {
+                [MTRasterImage imageWithDisplay:display scale:2];
+            }
+        }];
+        [self measureStage:@"drawRaster" corpus:corpus formulaCount:images.count block:^{
+            for (NSUInteger i = 0; i < images.count; i++) {
+                [images[i] drawAtPosition:displays[i].position context:context];
+            }
+        }];
+        NSLog(@"%@/raster: %lu bytes/formula at 2x", corpus.name, (unsigned long) (bytes / images.count));
+    }
+    CGContextRelease(context);
+}
+
+// Exporting every display to SVG with one exporter, whose outlines are cached after the first
+// run as on a server. Logs the size of the documents.
+- (void)testSVGExport
+{
+    MTSVGExporter* exporter = [[MTSVGExporter alloc] init];
+    for (MTBenchmarkCorpus* corpus in [MTBenchmarkCorpus allCorpora]) {
+        NSArray<MTMathListDisplay*>* displays = [self displaysOfCorpus:corpus];
+        [self measureStage:@"svg" corpus:corpus formulaCount:displays.count block:^{
+            for (MTMathListDisplay* display in displays) {
+                [exporter SVGDataForDisplay:display];
+            }
+        }];
+        NSUInteger bytes = 0;
+        for (MTMathListDisplay* display in displays) {
+            bytes += [exporter SVGDataForDisplay:display].length;
+        }
+        NSLog(@"%@/svg: %lu bytes/formula", corpus.name, (unsigned long) (bytes / displays.count));
+    }
+}
+
+// Streaming the example formulas to a PDF file, 10k formulas a run, and the peak memory of
+// doing so, which stays flat since pages are written as they end. Logs the size of the document.
+- (void)testPDFExport
+{
+    const NSUInteger formulaCount = 10000;
+    MTBenchmarkCorpus* corpus = [MTBenchmarkCorpus demo];
+    NSArray<MTMathListDisplay*>* displays = [self displaysOfCorpus:corpus];
+    NSURL* url = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"MTDrawBenchmarks.pdf"]];
+    void (^write)(void) = ^{
+        NSOutputStream* stream = [NSOutputStream outputStreamWithURL:url append:NO];
+        [stream open];
+        MTPDFWriter* writer = [[MTPDFWriter alloc] initWithStream:stream pageSize:kMTBenchmarkLetterSize];
+        for (NSUInteger i = 0; i < formulaCount; i++) {
+            [writer addDisplay:displays[i % displays.count]];
+        }
+        [writer finishWithError:NULL];
+        [stream close];
+    };
+    [self measureStage:@"pdf" corpus:corpus formulaCount:formulaCount block:write];
+    NSNumber* size = [[NSFileManager defaultManager] attributesOfItemAtPath:url.path error:NULL][NSFileSize];
+    NSLog(@"%@/pdf: %@ bytes for %lu formulas", corpus.name, size, (unsigned long) formulaCount);
+    [self measureWithMetrics:@[ [[XCTMemoryMetric alloc] init] ] block:write];
+    [[NSFileManager defaultManager] removeItemAtURL:url error:NULL];
+}
+
+@end
@@ -0,0 +1,40 @@
+//
+//  MTRenderBenchmarkCase.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <CoreGraphics/CoreGraphics.h>
+
+#import "MTBenchmarkCase.h"
+#import "MTMathListDisplay.h"
+#import "MTTypesetter.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface MTTypesetter (Benchmark)
+
+// Lays out a list that is already finalized, so that layout is timed without finalize.
++ (MTMathListDisplay *)createLineForMathList:(MTMathList *)mathList font:(MTFont*)font style:(MTLineStyle)style cramped:(BOOL) cramped;
+
+@end
+
+/** A transparent sRGB bitmap context with `scale` pixels per point. The caller releases it. */
+CGContextRef MTBenchmarkCreateContext(size_t width, size_t height, CGFloat scale) CF_RETURNS_RETAINED;
+
+/** The base of the benchmarks that lay out or draw, in the default font. */
+@interface MTRenderBenchmarkCase : MTBenchmarkCase
+
+@property (nonatomic) MTFont* font;
+
+/** Parses and finalizes every formula of the corpus. */
+- (NSArray<MTMathList*>*) finalizedFormulasOfCorpus:(MTBenchmarkCorpus*) corpus;
+
+/** Lays out every formula of the corpus in the display style, with the baseline above the origin by the descent. */
+- (NSArray<MTMathListDisplay*>*) displaysOfCorpus:(MTBenchmarkCorpus*) corpus;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,55 @@
+//
+//  MTRenderBenchmarkCase.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTRenderBenchmarkCase.h"
+#import "MTMathListBuilder.h"
+#import "MTFontManager.h"
+
+CGContextRef MTBenchmarkCreateContext(size_t width, size_t height, CGFloat scale)
+{
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, width * 4, colorSpace,
+                                                 (CGBitmapInfo) kCGImageAlphaPremultipliedLast);
+    CGColorSpaceRelease(colorSpace);
+    CGContextScaleCTM(context, scale, scale);
+    return context;
+}
+
+@implementation MTRenderBenchmarkCase
+
+- (void)setUp
+{
+    [super setUp];
+    self.font = MTFontManager.fontManager.defaultFont;
+}
+
+- (NSArray<MTMathList*>*) finalizedFormulasOfCorpus:(MTBenchmarkCorpus*) corpus
+{
+    NSMutableArray<MTMathList*>* lists = [NSMutableArray array];
+    for (NSString* latex in corpus.formulas) {
+        MTMathList* list = [MTMathListBuilder buildFromString:latex];
+        XCTAssertNotNil(list, @"%@ %@", corpus.name, latex);
+        if (list) {
+            [lists addObject:list.finalized];
+        }
+    }
+    return lists;
+}
+
+- (NSArray<MTMathListDisplay*>*) displaysOfCorpus:(MTBenchmarkCorpus*) corpus
+{
+    NSMutableArray<MTMathListDisplay*>* displays = [NSMutableArray array];
+    for (MTMathList* list in [self finalizedFormulasOfCorpus:corpus]) {
+        MTMathListDisplay* display = [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay cramped:NO];
+        display.position = CGPointMake(0, display.descent);
+        [displays addObject:display];
+    }
+    return displays;
+}
+
+@end
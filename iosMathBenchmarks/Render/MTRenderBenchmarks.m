@@ -0,0 +1,245 @@
+//
+//  MTRenderBenchmarks.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTRenderBenchmarkCase.h"
+#import "MTMathListBuilder.h"
+#import "MTMathListIndex.h"
+#import "MTMathAtomFactory.h"
+#import "MTMathAlphanumerics.h"
+#import "MTInstrumentation.h"
+#import "MTLayoutCache.h"
+
+static const MTFontStyle kMTBenchmarkFontStyles[] = {
+    kMTFontStyleDefault, kMTFontStyleRoman, kMTFontStyleBold, kMTFontStyleCaligraphic, kMTFontStyleTypewriter,
+    kMTFontStyleItalic, kMTFontStyleSansSerif, kMTFontStyleFraktur, kMTFontStyleBlackboard, kMTFontStyleBoldItalic,
+};
+
+// Layout, incremental layout, hit testing and the layout cache, drawing the display trees, and the
+// styling of characters.
+@interface MTRenderBenchmarks : MTRenderBenchmarkCase
+
+@end
+
+@implementation MTRenderBenchmarks
+
+- (void)testLayout
+{
+    for (MTBenchmarkCorpus* corpus in [MTBenchmarkCorpus allCorpora]) {
+        NSArray<MTMathList*>* lists = [self finalizedFormulasOfCorpus:corpus];
+        MTFont* font = self.font;
+        [self measureStage:@"layout" corpus:corpus formulaCount:lists.count block:^{
+            for (MTMathList* list in lists) {
+                [MTTypesetter createLineForMathList:list font:font style:kMTLineStyleDisplay cramped:NO];
+            }
+        }];
+        // The cost of the instrumentation when it is enabled.
+        [self measureStage:@"layoutInstrumented" corpus:corpus formulaCount:lists.count block:^{
+            MTInstrumentation.enabled = YES;
+            for (MTMathList* list in lists) {
+                [MTTypesetter createLineForMathList:list font:font style:kMTLineStyleDisplay cramped:NO];
+            }
+            MTInstrumentation.enabled = NO;
+        }];
+    }
+}
+
+// Lays out the cells of tables one after the other and in parallel. Only the corpora with large
+// tables differ.
+- (void)testTableLayout
+{
+    NSUInteger savedThreshold = MTTypesetter.parallelCellThreshold;
+    for (MTBenchmarkCorpus* corpus in [MTBenchmarkCorpus allCorpora]) {
+        NSArray<MTMathList*>* lists = [self finalizedFormulasOfCorpus:corpus];
+        MTFont* font = self.font;
+        MTTypesetter.parallelCellThreshold = NSUIntegerMax;
+        [self measureStage:@"layoutSerialCells" corpus:corpus formulaCount:lists.count block:^{
+            for (MTMathList* list in lists) {
+                [MTTypesetter createLineForMathList:list font:font style:kMTLineStyleDisplay cramped:NO];
+            }
+        }];
+        MTTypesetter.parallelCellThreshold = 1;
+        [self measureStage:@"layoutParallelCells" corpus:corpus formulaCount:lists.count block:^{
+            for (MTMathList* list in lists) {
+                [MTTypesetter createLineForMathList:list font:font style:kMTLineStyleDisplay cramped:NO];
+            }
+        }];
+    }
+    MTTypesetter.parallelCellThreshold = savedThreshold;
+}
+
+// Re-layout after an edit in the numerator of the middle fraction of a formula of about 1 KB and
+// 10 KB of LaTeX, from scratch and from the previous display.
+- (void)testIncrementalLayout
+{
+    for (NSNumber* size in @[ @1024, @(10 * 1024) ]) {
+        NSMutableString* latex = [NSMutableString string];
+        NSUInteger pieces = 0;
+        while (latex.length < size.unsignedIntegerValue) {
+            [latex appendString:@"\\frac{a_{1}+b^{2}}{\\sqrt{c+d}} + "];
+            pieces++;
+        }
+        [latex appendString:@"x"];
+        MTBenchmarkCorpus* corpus = [[MTBenchmarkCorpus alloc] initWithName:[NSString stringWithFormat:@"fractions%luKB", (unsigned long) (size.unsignedIntegerValue / 1024)]
+                                                                    formulas:@[ latex ]];
+        MTMathList* list = [MTMathListBuilder buildFromString:latex];
+        XCTAssertNotNil(list);
+        // Each piece is two atoms: the fraction and the +.
+        MTMathListIndex* index = [MTMathListIndex indexAtLocation:2 * (pieces / 2)
+                                                     withSubIndex:[MTMathListIndex level0Index:0]
+                                                             type:kMTSubIndexTypeNumerator];
+        MTFont* font = self.font;
+        MTMathListDisplay* previous = [MTTypesetter createLineForMathList:list font:font style:kMTLineStyleDisplay];
+        MTFraction* fraction = (MTFraction*) list.atoms[index.atomIndex];
+        [fraction.numerator removeAtomAtIndex:0];
+        [fraction.numerator insertAtom:[MTMathAtomFactory atomForCharacter:'z'] atIndex:0];
+        [self measureStage:@"layoutAfterEdit" corpus:corpus formulaCount:1 block:^{
+            [MTTypesetter createLineForMathList:list font:font style:kMTLineStyleDisplay];
+        }];
+        [self measureStage:@"incrementalLayoutAfterEdit" corpus:corpus formulaCount:1 block:^{
+            [MTTypesetter createLineForMathList:list font:font style:kMTLineStyleDisplay previousDisplay:previous changedIndex:index];
+        }];
+    }
+}
+
+// Hit testing and caret rects on a line of thousands of sub-displays, most of them with scripts,
+// per query. The lookup tables are built on the first query after a layout: compare the
+// `layoutThenHitTest` stage with the `layout` stage for what they cost.
+- (void)testHitTesting
+{
+    const NSUInteger queryCount = 10000;
+    NSMutableString* latex = [NSMutableString string];
+    for (NSUInteger i = 0; i < 2000; i++) {
+        [latex appendString:(i % 2) ? @"x_{i}+" : @"\\frac{a}{b}^{2}-"];
+    }
+    [latex appendString:@"y"];
+    MTBenchmarkCorpus* corpus = [[MTBenchmarkCorpus alloc] initWithName:@"scriptedLine" formulas:@[ latex ]];
+    MTMathList* list = [self finalizedFormulasOfCorpus:corpus].firstObject;
+    MTFont* font = self.font;
+    MTMathListDisplay* display = [MTTypesetter createLineForMathList:list font:font style:kMTLineStyleDisplay cramped:NO];
+    CGRect bounds = display.displayBounds;
+    NSUInteger count = NSMaxRange(display.range);
+    [self measureStage:@"closestIndex" corpus:corpus formulaCount:queryCount block:^{
+        for (NSUInteger i = 0; i < queryCount; i++) {
+            CGPoint point = CGPointMake(CGRectGetMinX(bounds) + bounds.size.width * (i * 7919 % queryCount) / queryCount,
+                                        CGRectGetMinY(bounds) + bounds.size.height * (i % 5) / 4);
+            [display closestIndexToPoint:point caretOffset:NULL];
+        }
+    }];
+    [self measureStage:@"caretRect" corpus:corpus formulaCount:queryCount block:^{
+        for (NSUInteger i = 0; i < queryCount; i++) {
+            MTMathListIndex* index = [MTMathListIndex indexAtLocation:(i * 7919) % count
+                                                         withSubIndex:[MTMathListIndex level0Index:0]
+                                                                 type:(i % 2) ? kMTSubIndexTypeSubscript : kMTSubIndexTypeNumerator];
+            [display caretRectForIndex:index];
+        }
+    }];
+    [self measureStage:@"layout" corpus:corpus formulaCount:1 block:^{
+        [MTTypesetter createLineForMathList:list font:font style:kMTLineStyleDisplay cramped:NO];
+    }];
+    [self measureStage:@"layoutThenHitTest" corpus:corpus formulaCount:1 block:^{
+        MTMathListDisplay* laidOut = [MTTypesetter createLineForMathList:list font:font style:kMTLineStyleDisplay cramped:NO];
+        [laidOut closestIndexToPoint:CGPointZero caretOffset:NULL];
+    }];
+}
+
+// Loading the displays from the archives of the layout cache, as on a launch after the first,
+// against parsing and laying them out. The archives are likely in the file cache, so this
+// measures the decoding rather than the disk. Logs the size of the archives.
+- (void)testLayoutCache
+{
+    NSURL* directoryURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString] isDirectory:YES];
+    MTLayoutCache* cache = [[MTLayoutCache alloc] initWithDirectoryURL:directoryURL];
+    MTFont* font = self.font;
+    for (MTBenchmarkCorpus* corpus in [MTBenchmarkCorpus allCorpora]) {
+        NSArray<NSString*>* formulas = corpus.formulas;
+        [cache removeAllDisplays];
+        for (NSString* latex in formulas) {
+            [cache layoutLatex:latex font:font style:kMTLineStyleDisplay error:NULL];
+        }
+        [self measureStage:@"layoutCacheLoad" corpus:corpus formulaCount:formulas.count block:^{
+            for (NSString* latex in formulas) {
+                [cache displayForLatex:latex font:font style:kMTLineStyleDisplay];
+            }
+        }];
+        [self measureStage:@"parseAndLayout" corpus:corpus formulaCount:formulas.count block:^{
+            for (NSString* latex in formulas) {
+                [MTTypesetter createLineForMathList:[MTMathListBuilder buildFromString:latex] font:font style:kMTLineStyleDisplay];
+            }
+        }];
+        NSUInteger bytes = 0;
+        for (NSURL* url in [[NSFileManager defaultManager] contentsOfDirectoryAtURL:directoryURL includingPropertiesForKeys:nil options:0 error:NULL]) {
+            bytes += [[[NSFileManager defaultManager] attributesOfItemAtPath:url.path error:NULL][NSFileSize] unsignedIntegerValue];
+        }
+        NSLog(@"%@/layoutCache: %lu bytes/formula on disk", corpus.name, (unsigned long) (bytes / formulas.count));
+    }
+    [[NSFileManager defaultManager] removeItemAtURL:directoryURL error:NULL];
+}
+
+// Logs the memory held by the lists and displays of each corpus, with and without the atoms kept
+// by the displays.
+- (void)testRetainedSize
+{
+    for (MTBenchmarkCorpus* corpus in [MTBenchmarkCorpus allCorpora]) {
+        NSUInteger count = 0, listBytes = 0, displayBytes = 0, slimBytes = 0;
+        for (NSString* latex in corpus.formulas) {
+            MTMathList* list = [MTMathListBuilder buildFromString:latex];
+            XCTAssertNotNil(list, @"%@ %@", corpus.name, latex);
+            if (!list) {
+                continue;
+            }
+            count++;
+            listBytes += list.retainedSize;
+            displayBytes += [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay retainsAtoms:YES].retainedSize;
+            slimBytes += [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay retainsAtoms:NO].retainedSize;
+        }
+        NSLog(@"%@/retainedSize: %lu bytes/list, %lu bytes/display with atoms, %lu without (%.1f%% less)", corpus.name,
+              (unsigned long) (listBytes / count), (unsigned long) (displayBytes / count), (unsigned long) (slimBytes / count),
+              100.0 * (displayBytes - slimBytes) / displayBytes);
+    }
+}
+
+- (void)testDraw
+{
+    CGContextRef context = MTBenchmarkCreateContext(512, 512, 1);
+    for (MTBenchmarkCorpus* corpus in [MTBenchmarkCorpus allCorpora]) {
+        NSArray<MTMathListDisplay*>* displays = [self displaysOfCorpus:corpus];
+        [self measureStage:@"draw" corpus:corpus formulaCount:displays.count block:^{
+            for (MTMathListDisplay* display in displays) {
+                [display draw:context];
+            }
+        }];
+    }
+    CGContextRelease(context);
+}
+
+// Maps the nuclei of variables and numbers to the styled characters, as the typesetter does
+// for every such atom, in each font style.
+- (void)testAlphanumericStyles
+{
+    NSMutableArray<NSString*>* nuclei = [NSMutableArray array];
+    NSString* characters = @"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    for (NSUInteger i = 0; i < characters.length; i++) {
+        [nuclei addObject:[characters substringWithRange:NSMakeRange(i, 1)]];
+    }
+    for (unichar ch = 0x0391; ch <= 0x03C9; ch++) {
+        [nuclei addObject:[NSString stringWithCharacters:&ch length:1]];
+    }
+    // Numbers are merged into one atom before they are styled.
+    [nuclei addObjectsFromArray:@[ @"3.14159", @"1000000", @"2.718281828" ]];
+    const NSUInteger styleCount = sizeof(kMTBenchmarkFontStyles) / sizeof(kMTBenchmarkFontStyles[0]);
+    MTBenchmarkCorpus* corpus = [[MTBenchmarkCorpus alloc] initWithName:@"alphanumerics" formulas:nuclei];
+    [self measureStage:@"style" corpus:corpus formulaCount:nuclei.count * styleCount block:^{
+        for (NSUInteger i = 0; i < styleCount; i++) {
+            for (NSString* nucleus in nuclei) {
+                MTMathAlphanumericString(nucleus, kMTBenchmarkFontStyles[i]);
+            }
+        }
+    }];
+}
+
+@end
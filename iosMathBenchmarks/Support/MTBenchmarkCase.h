@@ -0,0 +1,41 @@
+//
+//  MTBenchmarkCase.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTBenchmarkCorpus.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ The base of the benchmarks. Only Foundation and the instrumentation of iosMath are used, so
+ that the parse and model benchmarks build without the renderer.
+
+ The benchmarks are skipped unless `MT_BENCHMARK` is set in the environment, and are meant to
+ run in a release build (`swift test -c release --filter Benchmarks`). They are
+ configured by the environment:
+
+ - `MT_BENCHMARK_SAVE_BASELINE`: a JSON file the results are written to. Results already in
+   the file from other stages are kept.
+ - `MT_BENCHMARK_BASELINE`: a JSON file written as above to compare against. A stage fails if
+   it is slower than its baseline by more than the tolerance, or allocates more.
+ - `MT_BENCHMARK_TOLERANCE`: the allowed slowdown, as a fraction. Defaults to 0.1.
+ */
+@interface MTBenchmarkCase : XCTestCase
+
+/**
+ Times `block`, which runs a stage over the `formulaCount` formulas of a corpus once, and
+ reports the median time and the allocations per formula. The allocations are the atoms,
+ displays, typesetters, fonts and CTLines counted by `MTInstrumentation`, measured in a
+ separate run so that they do not slow the timed ones.
+ */
+- (void) measureStage:(NSString*) stage corpus:(MTBenchmarkCorpus*) corpus formulaCount:(NSUInteger) formulaCount block:(void (^)(void)) block;
+
+@end
+
+NS_ASSUME_NONNULL_END
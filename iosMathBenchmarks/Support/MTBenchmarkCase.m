@@ -0,0 +1,114 @@
+//
+//  MTBenchmarkCase.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#include <time.h>
+
+#import "MTBenchmarkCase.h"
+#import "MTInstrumentation.h"
+
+// A stage is run at least this many times, and until it has taken kMTBenchmarkMinimumTime.
+static const NSUInteger kMTBenchmarkMinimumRuns = 5;
+static const NSUInteger kMTBenchmarkMaximumRuns = 100;
+static const uint64_t kMTBenchmarkMinimumTime = 500 * NSEC_PER_MSEC;
+
+static NSString* const kMTBenchmarkNanoseconds = @"nsPerFormula";
+static NSString* const kMTBenchmarkAllocations = @"allocationsPerFormula";
+
+static NSString* MTBenchmarkEnvironment(NSString* name)
+{
+    NSString* value = NSProcessInfo.processInfo.environment[name];
+    return (value.length > 0) ? value : nil;
+}
+
+static NSDictionary<NSString*, NSDictionary*>* MTBenchmarkReadResults(NSString* path)
+{
+    NSData* data = [NSData dataWithContentsOfFile:path];
+    if (!data) {
+        return @{};
+    }
+    id results = [NSJSONSerialization JSONObjectWithData:data options:0 error:nil];
+    return [results isKindOfClass:[NSDictionary class]] ? results : @{};
+}
+
+@implementation MTBenchmarkCase
+
+- (BOOL)setUpWithError:(NSError **)error
+{
+    XCTSkipUnless(MTBenchmarkEnvironment(@"MT_BENCHMARK") != nil, @"Set MT_BENCHMARK to run the benchmarks.");
+    return [super setUpWithError:error];
+}
+
+- (void)tearDown
+{
+    MTInstrumentation.enabled = NO;
+    [MTInstrumentation resetStatistics];
+    [super tearDown];
+}
+
+- (void) measureStage:(NSString*) stage corpus:(MTBenchmarkCorpus*) corpus formulaCount:(NSUInteger) formulaCount block:(void (^)(void)) block
+{
+    NSParameterAssert(formulaCount > 0);
+    // The allocations, in a run of their own which also warms the caches.
+    MTInstrumentation.enabled = YES;
+    [MTInstrumentation resetStatistics];
+    @autoreleasepool {
+        block();
+    }
+    MTInstrumentation.enabled = NO;
+    MTLayoutStatistics* stats = [MTInstrumentation statistics];
+    NSUInteger allocations = 0;
+    for (NSUInteger i = 0; i < kMTLayoutCounterCount; i++) {
+        if (i != kMTLayoutCounterGlyphVariantLookups && i != kMTLayoutCounterGlyphAssemblies) {
+            allocations += [stats valueOfCounter:i];
+        }
+    }
+
+    NSMutableArray<NSNumber*>* times = [NSMutableArray array];
+    uint64_t total = 0;
+    while (times.count < kMTBenchmarkMaximumRuns && (times.count < kMTBenchmarkMinimumRuns || total < kMTBenchmarkMinimumTime)) {
+        uint64_t start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+        @autoreleasepool {
+            block();
+        }
+        uint64_t elapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - start;
+        total += elapsed;
+        [times addObject:@(elapsed)];
+    }
+    [times sortUsingSelector:@selector(compare:)];
+    double nanoseconds = times[times.count / 2].doubleValue / formulaCount;
+    double allocationsPerFormula = (double) allocations / formulaCount;
+
+    NSString* key = [NSString stringWithFormat:@"%@/%@", corpus.name, stage];
+    NSMutableString* report = [NSMutableString stringWithFormat:@"%@: %.0f ns/formula, %.1f allocations/formula (%lu formulas, %lu runs)",
+                               key, nanoseconds, allocationsPerFormula, (unsigned long) formulaCount, (unsigned long) times.count];
+
+    NSString* baselinePath = MTBenchmarkEnvironment(@"MT_BENCHMARK_BASELINE");
+    NSDictionary* baseline = baselinePath ? MTBenchmarkReadResults(baselinePath)[key] : nil;
+    if (baseline) {
+        double baselineNanoseconds = [baseline[kMTBenchmarkNanoseconds] doubleValue];
+        double baselineAllocations = [baseline[kMTBenchmarkAllocations] doubleValue];
+        NSString* toleranceValue = MTBenchmarkEnvironment(@"MT_BENCHMARK_TOLERANCE");
+        double tolerance = toleranceValue ? toleranceValue.doubleValue : 0.1;
+        [report appendFormat:@", baseline %.0f ns (%+.1f%%), %.1f allocations", baselineNanoseconds,
+                             (nanoseconds / baselineNanoseconds - 1) * 100, baselineAllocations];
+        XCTAssertLessThanOrEqual(nanoseconds, baselineNanoseconds * (1 + tolerance), @"%@ is slower than its baseline", key);
+        // The allocations do not depend on the machine, so any increase is a regression.
+        XCTAssertLessThanOrEqual(allocationsPerFormula, baselineAllocations, @"%@ allocates more than its baseline", key);
+    }
+    NSLog(@"%@", report);
+
+    NSString* savePath = MTBenchmarkEnvironment(@"MT_BENCHMARK_SAVE_BASELINE");
+    if (savePath) {
+        NSMutableDictionary* results = [MTBenchmarkReadResults(savePath) mutableCopy];
+        results[key] = @{ kMTBenchmarkNanoseconds : @(nanoseconds), kMTBenchmarkAllocations : @(allocationsPerFormula) };
+        NSData* data = [NSJSONSerialization dataWithJSONObject:results options:NSJSONWritingPrettyPrinted | NSJSONWritingSortedKeys error:nil];
+        XCTAssertTrue([data writeToFile:savePath atomically:YES], @"Could not write %@", savePath);
+    }
+}
+
+@end
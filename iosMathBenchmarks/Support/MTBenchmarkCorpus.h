@@ -0,0 +1,42 @@
+//
+//  MTBenchmarkCorpus.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+@import Foundation;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/** A named set of formulas that the benchmarks run over. Foundation only. */
+@interface MTBenchmarkCorpus : NSObject
+
+@property (nonatomic, readonly) NSString* name;
+@property (nonatomic, readonly) NSArray<NSString*>* formulas;
+
+- (instancetype) init NS_UNAVAILABLE;
+- (instancetype) initWithName:(NSString*) name formulas:(NSArray<NSString*>*) formulas NS_DESIGNATED_INITIALIZER;
+
+/** Every corpus below, in a fixed order. */
++ (NSArray<MTBenchmarkCorpus*>*) allCorpora;
+
+/** The real-world formulas of the example apps (`MathDemoFormulas()`). */
++ (instancetype) demo;
+/** The feature and edge case formulas of the example apps (`MathTestFormulas()`). */
++ (instancetype) features;
+/** Fractions nested close to the recursion limit of the parser. */
++ (instancetype) deepNesting;
+/** A 100×100 matrix. */
++ (instancetype) largeMatrix;
+/** A sum of 5000 subscripted terms, about 10k atoms. */
++ (instancetype) longSum;
+/** Long runs of `\text{}`. */
++ (instancetype) longText;
+/** Nested `\left`/`\right` pairs around tall tables, which need assembled delimiters. */
++ (instancetype) tallDelimiters;
+
+@end
+
+NS_ASSUME_NONNULL_END
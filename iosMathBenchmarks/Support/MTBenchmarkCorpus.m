@@ -0,0 +1,115 @@
+//
+//  MTBenchmarkCorpus.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTBenchmarkCorpus.h"
+#import "../../MathExamples.h"
+
+// Each level takes two levels of the parser (the argument and its group), whose limit is 150.
+static const NSUInteger kMTBenchmarkNestingDepth = 60;
+
+@implementation MTBenchmarkCorpus
+
+- (instancetype) initWithName:(NSString*) name formulas:(NSArray<NSString*>*) formulas
+{
+    NSParameterAssert(name);
+    NSParameterAssert(formulas.count > 0);
+    self = [super init];
+    if (self) {
+        _name = [name copy];
+        _formulas = [formulas copy];
+    }
+    return self;
+}
+
++ (NSArray<MTBenchmarkCorpus*>*) allCorpora
+{
+    return @[ [self demo], [self features], [self deepNesting], [self largeMatrix], [self longSum],
+              [self longText], [self tallDelimiters] ];
+}
+
++ (instancetype) demo
+{
+    return [[self alloc] initWithName:@"demo" formulas:MathDemoFormulas()];
+}
+
++ (instancetype) features
+{
+    return [[self alloc] initWithName:@"features" formulas:MathTestFormulas()];
+}
+
++ (instancetype) deepNesting
+{
+    // A continued fraction, and scripts of scripts.
+    NSMutableString* fraction = [NSMutableString string];
+    NSMutableString* scripts = [NSMutableString stringWithString:@"x"];
+    for (NSUInteger i = 0; i < kMTBenchmarkNestingDepth; i++) {
+        [fraction appendString:@"\\frac{1}{1+"];
+        [scripts appendString:@"^{x"];
+    }
+    [fraction appendString:@"x"];
+    for (NSUInteger i = 0; i < kMTBenchmarkNestingDepth; i++) {
+        [fraction appendString:@"}"];
+        [scripts appendString:@"}"];
+    }
+    return [[self alloc] initWithName:@"deepNesting" formulas:@[ fraction, scripts ]];
+}
+
++ (instancetype) largeMatrix
+{
+    NSMutableString* latex = [NSMutableString stringWithString:@"\\begin{pmatrix}"];
+    for (NSUInteger row = 0; row < 100; row++) {
+        if (row > 0) {
+            [latex appendString:@"\\\\"];
+        }
+        for (NSUInteger col = 0; col < 100; col++) {
+            [latex appendFormat:(col > 0) ? @"&a_{%lu}" : @"a_{%lu}", (unsigned long) (row * 100 + col)];
+        }
+    }
+    [latex appendString:@"\\end{pmatrix}"];
+    return [[self alloc] initWithName:@"largeMatrix" formulas:@[ latex ]];
+}
+
++ (instancetype) longSum
+{
+    NSMutableString* latex = [NSMutableString stringWithString:@"x_{0}"];
+    for (NSUInteger i = 1; i < 5000; i++) {
+        [latex appendFormat:@"+x_{%lu}", (unsigned long) i];
+    }
+    return [[self alloc] initWithName:@"longSum" formulas:@[ latex ]];
+}
+
++ (instancetype) longText
+{
+    NSString* words = @"the quick brown fox jumps over the lazy dog ";
+    NSMutableString* text = [NSMutableString string];
+    for (NSUInteger i = 0; i < 50; i++) {
+        [text appendString:words];
+    }
+    NSString* run = [NSString stringWithFormat:@"\\text{%@}", text];
+    NSMutableString* mixed = [NSMutableString string];
+    for (NSUInteger i = 0; i < 50; i++) {
+        [mixed appendFormat:@"\\text{if } x_{%lu} > 0 \\text{ then %@} ", (unsigned long) i, words];
+    }
+    return [[self alloc] initWithName:@"longText" formulas:@[ run, mixed ]];
+}
+
++ (instancetype) tallDelimiters
+{
+    NSMutableArray<NSString*>* formulas = [NSMutableArray array];
+    for (NSUInteger rows = 5; rows <= 40; rows += 5) {
+        NSMutableString* column = [NSMutableString string];
+        for (NSUInteger row = 0; row < rows; row++) {
+            [column appendFormat:(row > 0) ? @"\\\\%lu" : @"%lu", (unsigned long) row];
+        }
+        [formulas addObject:[NSString stringWithFormat:@"\\left\\{ \\left[ \\left( \\begin{matrix}%@\\end{matrix} \\right) \\right] \\right\\}", column]];
+        [formulas addObject:[NSString stringWithFormat:@"\\left\\Vert \\begin{matrix}%@\\end{matrix} \\right\\rangle", column]];
+    }
+    return [[self alloc] initWithName:@"tallDelimiters" formulas:formulas];
+}
+
+@end
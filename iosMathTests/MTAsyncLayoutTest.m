@@ -0,0 +1,158 @@
+//
+//  MTAsyncLayoutTest.m
+//  iosMath
+//
+//  Tests for MTMathUILabel.layoutsAsynchronously: the background layout matches the main
+//  thread one, the placeholder size is reported until it is installed, and layouts for
+//  content that was replaced in the meantime are dropped.
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+#import "MTMathUILabel.h"
+#import "MTMathUILabelInternal.h"
+#import "MTMathListDisplay.h"
+#import "MTMathListBuilder.h"
+
+@interface MTAsyncLayoutTest : XCTestCase
+@end
+
+@implementation MTAsyncLayoutTest
+
+// Runs the main run loop until the label has installed its layout, which happens on the
+// main queue. Sizing the label starts the layout if it is not running yet.
+- (void)waitForLayoutOfLabel:(MTMathUILabel*)label
+{
+    (void)[label sizeThatFits:CGSizeZero];
+    NSDate* deadline = [NSDate dateWithTimeIntervalSinceNow:10];
+    while (label.asynchronousLayoutPending && [deadline timeIntervalSinceNow] > 0) {
+        [[NSRunLoop mainRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    XCTAssertFalse(label.asynchronousLayoutPending, @"the asynchronous layout did not finish");
+}
+
+- (MTMathUILabel*)asyncLabel
+{
+    MTMathUILabel* label = [[MTMathUILabel alloc] init];
+    label.layoutsAsynchronously = YES;
+    label.placeholderSize = CGSizeMake(44, 22);
+    return label;
+}
+
+- (void)testAsyncLayoutMatchesSync
+{
+    NSArray<NSString*>* formulas = @[@"x", @"\\frac{1}{2} + \\sqrt{x}", @"\\int_0^1 f(x) dx", @"\\begin{pmatrix} a & b \\\\ c & d \\end{pmatrix}"];
+    for (NSString* latex in formulas) {
+        for (NSNumber* scalesLayout in @[@NO, @YES]) {
+            MTMathUILabel* sync = [[MTMathUILabel alloc] init];
+            sync.scalesLayout = scalesLayout.boolValue;
+            sync.latex = latex;
+            MTMathUILabel* async = [self asyncLabel];
+            async.scalesLayout = scalesLayout.boolValue;
+            async.latex = latex;
+
+            [self waitForLayoutOfLabel:async];
+            XCTAssertNotNil(async.mathList, @"%@", latex);
+            XCTAssertEqualObjects([MTMathListBuilder mathListToString:async.mathList],
+                                  [MTMathListBuilder mathListToString:sync.mathList], @"%@", latex);
+            CGSize expected = [sync sizeThatFits:CGSizeZero];
+            CGSize size = [async sizeThatFits:CGSizeZero];
+            XCTAssertEqualWithAccuracy(size.width, expected.width, 0.001, @"%@", latex);
+            XCTAssertEqualWithAccuracy(size.height, expected.height, 0.001, @"%@", latex);
+
+            sync.frame = async.frame = CGRectMake(0, 0, size.width, size.height);
+            [sync layoutSubviews];
+            [async layoutSubviews];
+            XCTAssertNotNil(async.displayList, @"%@", latex);
+            XCTAssertEqualWithAccuracy(async.displayList.width, sync.displayList.width, 0.001, @"%@", latex);
+            XCTAssertEqual(async.displayList.position.x, sync.displayList.position.x, @"%@", latex);
+            XCTAssertEqual(async.displayList.position.y, sync.displayList.position.y, @"%@", latex);
+        }
+    }
+}
+
+- (void)testPlaceholderUntilInstalled
+{
+    MTMathUILabel* label = [self asyncLabel];
+    label.latex = @"\\frac{a}{b}";
+    // Nothing is parsed or laid out on the main thread.
+    XCTAssertNil(label.mathList);
+    XCTAssertTrue(label.asynchronousLayoutPending);
+    CGSize size = [label sizeThatFits:CGSizeZero];
+    XCTAssertEqual(size.width, 44);
+    XCTAssertEqual(size.height, 22);
+    [label layoutSubviews];
+    XCTAssertNil(label.displayList);
+
+    [self waitForLayoutOfLabel:label];
+    size = [label sizeThatFits:CGSizeZero];
+    XCTAssertNotEqual(size.width, 44);
+    [label layoutSubviews];
+    XCTAssertNotNil(label.displayList);
+}
+
+// A reused cell sets new content while the layout of the old one is in flight. Only the
+// layout of the latest content may be installed.
+- (void)testStaleLayoutIsDropped
+{
+    MTMathUILabel* label = [self asyncLabel];
+    for (NSUInteger i = 0; i < 20; i++) {
+        label.latex = [NSString stringWithFormat:@"\\frac{%lu}{x}", (unsigned long)i];
+        // Start the layout so that there is work to drop.
+        (void)[label sizeThatFits:CGSizeZero];
+    }
+    label.latex = @"y";
+    [self waitForLayoutOfLabel:label];
+    XCTAssertEqualObjects([MTMathListBuilder mathListToString:label.mathList], @"y");
+
+    // Let any stale completions that were already queued run; they must not replace it.
+    [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
+    XCTAssertEqualObjects([MTMathListBuilder mathListToString:label.mathList], @"y");
+    [label layoutSubviews];
+    MTMathUILabel* expected = [[MTMathUILabel alloc] init];
+    expected.latex = @"y";
+    [expected layoutSubviews];
+    XCTAssertEqualWithAccuracy(label.displayList.width, expected.displayList.width, 0.001);
+}
+
+- (void)testAsyncParseError
+{
+    MTMathUILabel* label = [self asyncLabel];
+    label.latex = @"{5+3";
+    XCTAssertNil(label.error);
+    [self waitForLayoutOfLabel:label];
+    XCTAssertNil(label.mathList);
+    XCTAssertNotNil(label.error);
+    XCTAssertEqual(label.error.code, MTParseErrorMismatchBraces);
+    [label layoutSubviews];
+    XCTAssertNil(label.displayList);
+}
+
+- (void)testAsyncMathList
+{
+    MTMathList* mathList = [MTMathListBuilder buildFromString:@"x^2 + 1"];
+    MTMathUILabel* label = [self asyncLabel];
+    label.mathList = mathList;
+    // A math list set on the label is kept, it is only copied for the background layout.
+    XCTAssertEqual(label.mathList, mathList);
+    [self waitForLayoutOfLabel:label];
+    XCTAssertEqual(label.mathList, mathList);
+    [label layoutSubviews];
+    XCTAssertNotNil(label.displayList);
+}
+
+- (void)testTurningOffParsesPendingLatex
+{
+    MTMathUILabel* label = [self asyncLabel];
+    label.latex = @"a+b";
+    XCTAssertNil(label.mathList);
+    label.layoutsAsynchronously = NO;
+    XCTAssertNotNil(label.mathList);
+    XCTAssertFalse(label.asynchronousLayoutPending);
+    [label layoutSubviews];
+    XCTAssertNotNil(label.displayList);
+}
+
+@end
@@ -5,6 +5,7 @@
 //  SEC-3: Thread-safety tests for symbol/lookup tables and font cache.
 //  Verifies: dispatch_once lazy inits (safe concurrent first-touch + reads),
 //  copy-on-write in +addLatexSymbol:value:, and the @synchronized font cache.
+//  Also checks that parallel table cell layout matches the serial path.
 //
 //  Note: +addLatexSymbol:value: is a setup-time API and is NOT expected to be
 //  called concurrently with parsing/reads, so there is no concurrent-write test.
@@ -15,12 +16,32 @@
 #import "MTMathListBuilder.h"
 #import "MTFontManager.h"
 #import "MTFont.h"
+#import "MTTypesetter.h"
+#import "MTMathListDisplayInternal.h"
 
 // Number of concurrent workers for stress tests.
 static const NSUInteger kConcurrencyDegree = 32;
 // Number of iterations per worker.
 static const NSUInteger kIterationsPerWorker = 200;
 
+// Builds an n x n pmatrix whose cells mix scripts, fractions and radicals so the
+// per-cell layout is non-trivial and the column widths differ.
+static NSString* matrixLaTeX(NSUInteger n)
+{
+    NSArray<NSString*>* cells = @[@"x_{#}^2", @"\\frac{a}{#}", @"\\sqrt{#+y}", @"\\alpha_{#}", @"#"];
+    NSMutableString* latex = [NSMutableString stringWithString:@"\\begin{pmatrix}"];
+    for (NSUInteger r = 0; r < n; r++) {
+        if (r > 0) { [latex appendString:@" \\\\ "]; }
+        for (NSUInteger c = 0; c < n; c++) {
+            if (c > 0) { [latex appendString:@" & "]; }
+            NSString* index = [NSString stringWithFormat:@"%lu", (unsigned long)(r + c)];
+            [latex appendString:[cells[(r * n + c) % cells.count] stringByReplacingOccurrencesOfString:@"#" withString:index]];
+        }
+    }
+    [latex appendString:@"\\end{pmatrix}"];
+    return latex;
+}
+
 @interface MTConcurrencyTest : XCTestCase
 @end
 
@@ -173,4 +194,49 @@ static const NSUInteger kIterationsPerWorker = 200;
     XCTAssertEqual(result, 0, @"Concurrent parsing must not crash");
 }
 
+// ---------------------------------------------------------------------------
+// Test 6: Parallel table cell layout matches the serial path.
+// ---------------------------------------------------------------------------
+// The same table is typeset with the parallel threshold forced off and on; the
+// resulting display trees must agree exactly in geometry and content.
+- (void)assertDisplay:(MTDisplay*)a equalsDisplay:(MTDisplay*)b
+{
+    XCTAssertEqualObjects([a class], [b class]);
+    XCTAssertTrue(CGPointEqualToPoint(a.position, b.position), @"%@ vs %@", a, b);
+    XCTAssertEqual(a.ascent, b.ascent);
+    XCTAssertEqual(a.descent, b.descent);
+    XCTAssertEqual(a.width, b.width);
+    XCTAssertTrue(NSEqualRanges(a.range, b.range));
+    if ([a isKindOfClass:[MTCTLineDisplay class]]) {
+        XCTAssertEqualObjects(((MTCTLineDisplay*) a).attributedString.string,
+                              ((MTCTLineDisplay*) b).attributedString.string);
+    }
+    if ([a isKindOfClass:[MTMathListDisplay class]]) {
+        NSArray<MTDisplay*>* subA = ((MTMathListDisplay*) a).subDisplays;
+        NSArray<MTDisplay*>* subB = ((MTMathListDisplay*) b).subDisplays;
+        XCTAssertEqual(subA.count, subB.count);
+        for (NSUInteger i = 0; i < MIN(subA.count, subB.count); i++) {
+            [self assertDisplay:subA[i] equalsDisplay:subB[i]];
+        }
+    }
+}
+
+- (void)testParallelTableCellsMatchSerial
+{
+    MTFont* font = [MTFontManager fontManager].defaultFont;
+    NSUInteger savedThreshold = MTTypesetter.parallelCellThreshold;
+    for (NSNumber* size in @[@3, @12, @30]) {
+        MTMathList* list = [MTMathListBuilder buildFromString:matrixLaTeX(size.unsignedIntegerValue)];
+        XCTAssertNotNil(list);
+
+        MTTypesetter.parallelCellThreshold = NSUIntegerMax;
+        MTMathListDisplay* serial = [MTTypesetter createLineForMathList:list font:font style:kMTLineStyleDisplay];
+        MTTypesetter.parallelCellThreshold = 1;
+        MTMathListDisplay* parallel = [MTTypesetter createLineForMathList:list font:font style:kMTLineStyleDisplay];
+
+        [self assertDisplay:serial equalsDisplay:parallel];
+    }
+    MTTypesetter.parallelCellThreshold = savedThreshold;
+}
+
 @end
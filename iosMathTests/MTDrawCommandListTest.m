@@ -0,0 +1,231 @@
+//
+//  MTDrawCommandListTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+#import "MTDrawCommandList.h"
+#import "MTTypesetter.h"
+#import "MTFontManager.h"
+#import "MTMathListDisplay.h"
+#import "MTMathListDisplayInternal.h"
+#import "MTMathListBuilder.h"
+
+// Formulas that between them use every kind of display.
+static NSArray<NSString*>* allDisplaysLaTeX(void)
+{
+    return @[@"x^2 + y_1 = \\alpha",
+             @"\\frac{1}{2} + \\sqrt[3]{x+1}",
+             @"\\sum_{i=0}^{n} i^2 + \\int_0^1 x\\,dx",
+             @"\\overline{xy} + \\underline{z} + \\hat{a} + \\vec{v}",
+             @"\\overbrace{a+b}^{n} + \\overrightarrow{AB}",
+             @"\\left(\\frac{\\frac{a}{b}}{c}\\right) + \\left\\{ x \\right.",
+             @"\\color{red}{x+y} + \\colorbox{yellow}{z} + w",
+             @"\\cancel{x} + \\xcancel{y} + \\sout{z} + \\rlap{a}b + \\phantom{c}",
+             @"\\text{if } x > 0",
+             @"\\begin{array}{|c|c|} \\hline a & b \\\\ \\hline c & d \\\\ \\hline \\end{array}",
+             @"\\begin{pmatrix} 1 & 0 \\\\ 0 & 1 \\end{pmatrix}"];
+}
+
+@interface MTDrawCommandListTest : XCTestCase
+
+@property (nonatomic) MTFont* font;
+
+@end
+
+@implementation MTDrawCommandListTest
+
+- (void)setUp {
+    [super setUp];
+    self.font = MTFontManager.fontManager.defaultFont;
+}
+
+- (MTMathListDisplay*)displayForLaTeX:(NSString*)latex
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:latex];
+    XCTAssertNotNil(list, @"%@", latex);
+    MTMathListDisplay* display = [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay];
+    display.textColor = [MTColor blackColor];
+    // Away from the origin so that the absolute positions are exercised.
+    display.position = CGPointMake(10, 10 + display.descent);
+    return display;
+}
+
+// A white RGBA bitmap context large enough for the display. The caller frees the context and buffer.
+static CGContextRef createContext(MTMathListDisplay* display, uint8_t** buffer, size_t* length)
+{
+    size_t width = (size_t) ceil(display.inkWidth) + 20;
+    size_t height = (size_t) ceil(display.ascent + display.descent) + 20;
+    size_t bytesPerRow = width * 4;
+    *length = bytesPerRow * height;
+    *buffer = calloc(*length, 1);
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(*buffer, width, height, 8, bytesPerRow, colorSpace,
+                                                 (CGBitmapInfo) kCGImageAlphaPremultipliedLast);
+    CGColorSpaceRelease(colorSpace);
+    CGContextSetRGBFillColor(context, 1, 1, 1, 1);
+    CGContextFillRect(context, CGRectMake(0, 0, width, height));
+    return context;
+}
+
+- (void)testReplayMatchesTreeDrawing
+{
+    for (NSString* latex in allDisplaysLaTeX()) {
+        MTMathListDisplay* display = [self displayForLaTeX:latex];
+        MTDrawCommandList* commands = [[MTDrawCommandList alloc] initWithDisplay:display];
+        XCTAssertGreaterThan(commands.count, 0u, @"%@", latex);
+
+        uint8_t* expected = NULL;
+        uint8_t* actual = NULL;
+        size_t length = 0;
+        CGContextRef context = createContext(display, &expected, &length);
+        [display draw:context];
+        CGContextRelease(context);
+        context = createContext(display, &actual, &length);
+        [commands draw:context];
+        CGContextRelease(context);
+
+        NSUInteger differing = 0;
+        for (size_t i = 0; i < length; i++) {
+            if (abs((int) expected[i] - (int) actual[i]) > 16) {
+                differing++;
+            }
+        }
+        XCTAssertEqual(differing, 0u, @"%@", latex);
+        free(expected);
+        free(actual);
+    }
+}
+
+- (void)testCommandsAreAbsolute
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@"\\frac{1}{2}"];
+    MTDrawCommandList* commands = [[MTDrawCommandList alloc] initWithDisplay:display];
+    MTFractionDisplay* fraction = (MTFractionDisplay*) display.subDisplays[0];
+
+    XCTAssertEqual(commands.count, 3u);
+    const MTDrawCommand* command = commands.commands;
+    // Numerator and denominator are lines offset by the list's position.
+    XCTAssertEqual(command[0].type, kMTDrawCommandLine);
+    MTDisplay* numeratorLine = fraction.numerator.subDisplays[0];
+    XCTAssertEqualWithAccuracy(command[0].origin.x, display.position.x + fraction.numerator.position.x + numeratorLine.position.x, 0.001);
+    XCTAssertEqualWithAccuracy(command[0].origin.y, display.position.y + fraction.numerator.position.y + numeratorLine.position.y, 0.001);
+    XCTAssertEqual(command[1].type, kMTDrawCommandLine);
+    // The fraction bar.
+    XCTAssertEqual(command[2].type, kMTDrawCommandStroke);
+    XCTAssertEqual(command[2].count, 2u);
+    const CGPoint* points = commands.points + command[2].index;
+    XCTAssertEqualWithAccuracy(points[0].x, display.position.x + fraction.position.x, 0.001);
+    XCTAssertEqualWithAccuracy(points[0].y, display.position.y + fraction.position.y + fraction.linePosition, 0.001);
+    XCTAssertEqualWithAccuracy(points[1].x - points[0].x, fraction.width, 0.001);
+    XCTAssertEqualWithAccuracy(command[2].lineWidth, fraction.lineThickness, 0.001);
+    XCTAssertTrue(CGColorEqualToColor(command[2].color, [MTColor blackColor].CGColor));
+}
+
+- (void)testRadicalSignTakesRadicalColor
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@"\\sqrt{x}"];
+    display.textColor = [MTColor redColor];
+    MTDrawCommandList* commands = [[MTDrawCommandList alloc] initWithDisplay:display];
+    BOOL foundSign = NO;
+    for (NSUInteger i = 0; i < commands.count; i++) {
+        const MTDrawCommand* command = &commands.commands[i];
+        if (command->type == kMTDrawCommandGlyphs) {
+            foundSign = YES;
+            XCTAssertTrue(CGColorEqualToColor(command->color, [MTColor redColor].CGColor));
+        }
+    }
+    XCTAssertTrue(foundSign);
+}
+
+- (void)testCulledDrawMatchesFullDrawInsideRect
+{
+    for (NSString* latex in allDisplaysLaTeX()) {
+        MTMathListDisplay* display = [self displayForLaTeX:latex];
+        MTDrawCommandList* commands = [[MTDrawCommandList alloc] initWithDisplay:display];
+        // The middle third of the formula.
+        CGRect rect = CGRectMake(10 + display.inkWidth / 3, 0, display.inkWidth / 3, display.ascent + display.descent + 20);
+
+        uint8_t* expected = NULL;
+        uint8_t* actual = NULL;
+        size_t length = 0;
+        CGContextRef context = createContext(display, &expected, &length);
+        CGContextClipToRect(context, rect);
+        [commands draw:context];
+        CGContextRelease(context);
+        context = createContext(display, &actual, &length);
+        CGContextClipToRect(context, rect);
+        [commands drawInRect:CGRectInset(rect, -1, -1) context:context];
+        CGContextRelease(context);
+
+        XCTAssertEqual(memcmp(expected, actual, length), 0, @"%@", latex);
+        free(expected);
+        free(actual);
+    }
+}
+
+- (void)testIndexMatchesLinearScan
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@"\sum_{i=0}^{n} \frac{x_i^2}{\sqrt{y_i}} + \begin{pmatrix} a & b \\ c & d \end{pmatrix} + \overline{xyz}"];
+    MTDrawCommandList* commands = [[MTDrawCommandList alloc] initWithDisplay:display];
+    CGRect bounds = commands.bounds;
+    for (NSUInteger i = 0; i < 50; i++) {
+        // A grid of rectangles of various sizes over and around the formula.
+        CGFloat x = CGRectGetMinX(bounds) - 5 + (i % 10) * (bounds.size.width + 10) / 10;
+        CGFloat y = CGRectGetMinY(bounds) - 5 + (i / 10) * (bounds.size.height + 10) / 5;
+        CGRect rect = CGRectMake(x, y, (i % 3) * 4, (i % 4) * 3);
+        NSMutableIndexSet* expected = [NSMutableIndexSet indexSet];
+        for (NSUInteger c = 0; c < commands.count; c++) {
+            CGRect commandBounds = commands.commands[c].bounds;
+            if (CGRectGetMinX(commandBounds) <= CGRectGetMaxX(rect) && CGRectGetMaxX(commandBounds) >= CGRectGetMinX(rect)
+                && CGRectGetMinY(commandBounds) <= CGRectGetMaxY(rect) && CGRectGetMaxY(commandBounds) >= CGRectGetMinY(rect)) {
+                [expected addIndex:c];
+            }
+        }
+        XCTAssertEqualObjects([commands indexesOfCommandsInRect:rect], expected, @"Rect %lu", (unsigned long) i);
+    }
+    XCTAssertEqual([commands indexesOfCommandsInRect:bounds].count, commands.count);
+    XCTAssertEqual([commands indexesOfCommandsInRect:CGRectOffset(bounds, bounds.size.width + 1, 0)].count, 0u);
+}
+
+- (void)testDisplaysAtPoint
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@"\frac{1}{2}"];
+    MTDrawCommandList* commands = [[MTDrawCommandList alloc] initWithDisplay:display];
+    MTFractionDisplay* fraction = (MTFractionDisplay*) display.subDisplays[0];
+
+    // The middle of the fraction bar.
+    CGPoint onBar = CGPointMake(display.position.x + fraction.position.x + fraction.width / 2,
+                                display.position.y + fraction.position.y + fraction.linePosition);
+    NSArray<MTDisplay*>* displays = [commands displaysAtPoint:onBar];
+    XCTAssertEqual(displays.count, 1u);
+    XCTAssertEqual(displays.firstObject, fraction);
+
+    XCTAssertEqual([commands displaysAtPoint:CGPointMake(-100, -100)].count, 0u);
+}
+
+- (void)testBoundsOfDisplay
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@"\frac{1}{2}"];
+    MTDrawCommandList* commands = [[MTDrawCommandList alloc] initWithDisplay:display];
+    MTFractionDisplay* fraction = (MTFractionDisplay*) display.subDisplays[0];
+
+    CGRect listBounds = [commands boundsOfDisplay:display];
+    XCTAssertTrue(CGRectEqualToRect(listBounds, display.displayBounds));
+    // The numerator is positioned in the frame of the list.
+    CGRect numeratorBounds = [commands boundsOfDisplay:fraction.numerator];
+    CGRect expected = CGRectOffset(fraction.numerator.displayBounds, display.position.x, display.position.y);
+    XCTAssertEqualWithAccuracy(numeratorBounds.origin.x, expected.origin.x, 0.001);
+    XCTAssertEqualWithAccuracy(numeratorBounds.origin.y, expected.origin.y, 0.001);
+    XCTAssertEqualWithAccuracy(numeratorBounds.size.width, expected.size.width, 0.001);
+
+    MTMathListDisplay* other = [self displayForLaTeX:@"x"];
+    XCTAssertTrue(CGRectIsNull([commands boundsOfDisplay:other]));
+}
+
+@end
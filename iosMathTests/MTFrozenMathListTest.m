@@ -0,0 +1,164 @@
+//
+//  MTFrozenMathListTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+//  Frozen math lists, and the stress test for typesetting one frozen list on
+//  many threads at once. Run under the Thread Sanitizer to catch a write to
+//  the shared list.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTMathList.h"
+#import "MTMathListBuilder.h"
+#import "MTMathAtomFactory.h"
+#import "MTFontManager.h"
+#import "MTTypesetter.h"
+#import "MTMathListDisplayInternal.h"
+
+// Variables and numbers in their font style, fused runs, scripts on an accent over a single character,
+// tables, stacks and colors: every place where the typesetter used to write into the atoms.
+static NSString* const kFrozenLaTeX = @"\\hat{x}^{2}_{i} + abc12.5 - \\frac{\\mathbf{uv}}{\\sqrt[3]{-y}} "
+    @"\\begin{pmatrix} a & -b \\\\ \\bar{c}^{n} & d \\end{pmatrix} \\overset{\\text{def}}{=} "
+    @"\\color{red}{\\underline{z}} \\left( \\sum_{k=1}^{n} k \\right)";
+
+// Number of layouts of the shared list in the stress test.
+static const NSUInteger kFrozenLayouts = 400;
+
+@interface MTFrozenMathListTest : XCTestCase
+
+@end
+
+@implementation MTFrozenMathListTest
+
+- (void) assertTreeOfList:(MTMathList*) list isFrozen:(BOOL) frozen
+{
+    XCTAssertEqual(list.frozen, frozen);
+    for (MTMathAtom* atom in list.atoms) {
+        XCTAssertEqual(atom.frozen, frozen, @"%@", atom);
+        for (MTMathAtom* fused in atom.fusedAtoms) {
+            XCTAssertEqual(fused.frozen, frozen, @"%@", fused);
+        }
+        NSMutableArray<MTMathList*>* children = [NSMutableArray array];
+        if (atom.superScript) { [children addObject:atom.superScript]; }
+        if (atom.subScript) { [children addObject:atom.subScript]; }
+        if ([atom isKindOfClass:[MTFraction class]]) {
+            [children addObject:((MTFraction*) atom).numerator];
+            [children addObject:((MTFraction*) atom).denominator];
+        } else if ([atom isKindOfClass:[MTInner class]]) {
+            [children addObject:((MTInner*) atom).innerList];
+        } else if ([atom isKindOfClass:[MTMathTable class]]) {
+            for (NSArray<MTMathList*>* row in ((MTMathTable*) atom).cells) {
+                [children addObjectsFromArray:row];
+            }
+        }
+        for (MTMathList* child in children) {
+            [self assertTreeOfList:child isFrozen:frozen];
+        }
+    }
+}
+
+- (void) assertDisplay:(MTDisplay*) a equalsDisplay:(MTDisplay*) b
+{
+    XCTAssertEqualObjects([a class], [b class]);
+    XCTAssertTrue(CGPointEqualToPoint(a.position, b.position), @"%@ vs %@", a, b);
+    XCTAssertEqual(a.ascent, b.ascent);
+    XCTAssertEqual(a.descent, b.descent);
+    XCTAssertEqual(a.width, b.width);
+    XCTAssertTrue(NSEqualRanges(a.range, b.range));
+    if ([a isKindOfClass:[MTCTLineDisplay class]]) {
+        XCTAssertEqualObjects(((MTCTLineDisplay*) a).attributedString.string,
+                              ((MTCTLineDisplay*) b).attributedString.string);
+        XCTAssertEqual(((MTCTLineDisplay*) a).atoms.count, ((MTCTLineDisplay*) b).atoms.count);
+    }
+    if ([a isKindOfClass:[MTMathListDisplay class]]) {
+        NSArray<MTDisplay*>* subA = ((MTMathListDisplay*) a).subDisplays;
+        NSArray<MTDisplay*>* subB = ((MTMathListDisplay*) b).subDisplays;
+        XCTAssertEqual(subA.count, subB.count);
+        for (NSUInteger i = 0; i < MIN(subA.count, subB.count); i++) {
+            [self assertDisplay:subA[i] equalsDisplay:subB[i]];
+        }
+    }
+}
+
+- (void)testFrozenCopy
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:kFrozenLaTeX];
+    XCTAssertNotNil(list);
+    MTMathList* frozen = list.frozenCopy;
+    [self assertTreeOfList:frozen isFrozen:YES];
+    [self assertTreeOfList:list isFrozen:NO];
+    XCTAssertEqual(frozen.fingerprint, list.finalized.fingerprint);
+
+    // A frozen list is final already, and frozen once.
+    XCTAssertEqual(frozen.finalized, frozen);
+    XCTAssertEqual(frozen.frozenCopy, frozen);
+
+    // It can not be changed, but its copies can.
+    MTMathAtom* y = [MTMathAtomFactory atomForCharacter:'y'];
+    XCTAssertThrows([frozen addAtom:y]);
+    XCTAssertThrows([frozen removeLastAtom]);
+    XCTAssertThrows(frozen.atoms[0].nucleus = @"z");
+    XCTAssertThrows([frozen.atoms[0].superScript addAtom:y]);
+    MTMathList* copy = [frozen copy];
+    [self assertTreeOfList:copy isFrozen:NO];
+    [copy addAtom:y];
+    XCTAssertEqual(copy.atoms.count, frozen.atoms.count + 1);
+    XCTAssertEqual(frozen.fingerprint, list.finalized.fingerprint);
+}
+
+- (void)testLayoutLeavesTheListUnchanged
+{
+    MTFont* font = MTFontManager.fontManager.defaultFont;
+    MTMathList* frozen = [MTMathListBuilder buildFromString:kFrozenLaTeX].frozenCopy;
+    NSData* before = frozen.archivedData;
+    XCTAssertNotNil(before);
+
+    MTMathListDisplay* display = [MTTypesetter createLineForMathList:frozen font:font style:kMTLineStyleDisplay];
+    MTMathListDisplay* expected = [MTTypesetter createLineForMathList:[MTMathListBuilder buildFromString:kFrozenLaTeX]
+                                                                 font:font style:kMTLineStyleDisplay];
+    [self assertDisplay:display equalsDisplay:expected];
+    XCTAssertEqualObjects(frozen.archivedData, before);
+}
+
+- (void)testConcurrentLayoutOfFrozenList
+{
+    MTMathList* frozen = [MTMathListBuilder buildFromString:kFrozenLaTeX].frozenCopy;
+    MTFont* defaultFont = MTFontManager.fontManager.defaultFont;
+    NSArray<MTFont*>* fonts = @[ [defaultFont copyFontWithSize:12], [defaultFont copyFontWithSize:20], [defaultFont copyFontWithSize:31] ];
+    NSArray<NSNumber*>* styles = @[ @(kMTLineStyleDisplay), @(kMTLineStyleText), @(kMTLineStyleScript) ];
+
+    // The serial layouts, from lists of their own.
+    NSMutableArray<MTMathListDisplay*>* expected = [NSMutableArray array];
+    for (NSUInteger i = 0; i < fonts.count * styles.count; i++) {
+        [expected addObject:[MTTypesetter createLineForMathList:[MTMathListBuilder buildFromString:kFrozenLaTeX]
+                                                           font:fonts[i % fonts.count]
+                                                          style:(MTLineStyle) styles[i / fonts.count].integerValue]];
+    }
+    NSData* before = frozen.archivedData;
+
+    NSMutableArray* displays = [NSMutableArray arrayWithCapacity:kFrozenLayouts];
+    for (NSUInteger i = 0; i < kFrozenLayouts; i++) {
+        [displays addObject:[NSNull null]];
+    }
+    NSObject* lock = [NSObject new];
+    dispatch_apply(kFrozenLayouts, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+        NSUInteger variant = i % expected.count;
+        MTMathListDisplay* display = [MTTypesetter createLineForMathList:frozen
+                                                                    font:fonts[variant % fonts.count]
+                                                                   style:(MTLineStyle) styles[variant / fonts.count].integerValue];
+        @synchronized (lock) {
+            displays[i] = display;
+        }
+    });
+
+    for (NSUInteger i = 0; i < kFrozenLayouts; i++) {
+        [self assertDisplay:displays[i] equalsDisplay:expected[i % expected.count]];
+    }
+    XCTAssertEqualObjects(frozen.archivedData, before);
+}
+
+@end
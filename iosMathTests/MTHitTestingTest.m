@@ -0,0 +1,185 @@
+//
+//  MTHitTestingTest.m
+//  iosMath
+//
+//  Checks -[MTMathListDisplay closestIndexToPoint:caretOffset:] and
+//  -[MTMathListDisplay caretRectForIndex:].
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTTypesetter.h"
+#import "MTFontManager.h"
+#import "MTMathListDisplay.h"
+#import "MTMathListBuilder.h"
+#import "MTMathListIndex.h"
+
+@interface MTHitTestingTest : XCTestCase
+
+@property (nonatomic) MTFont* font;
+
+@end
+
+@implementation MTHitTestingTest
+
+- (void)setUp {
+    [super setUp];
+    self.font = MTFontManager.fontManager.defaultFont;
+}
+
+- (MTMathListDisplay*)displayForLaTeX:(NSString*)latex
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:latex];
+    XCTAssertNotNil(list, @"%@", latex);
+    MTMathListDisplay* display = [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay];
+    // Away from the origin so that the coordinate spaces are exercised.
+    display.position = CGPointMake(10, 20);
+    return display;
+}
+
+static CGPoint centerOf(CGRect rect)
+{
+    return CGPointMake(CGRectGetMidX(rect), CGRectGetMidY(rect));
+}
+
+// The bounds of `child` (positioned in the frame of `list`) in the space `list` is positioned in.
+static CGRect boundsInParent(MTDisplay* child, MTMathListDisplay* list)
+{
+    return CGRectOffset(child.displayBounds, list.position.x, list.position.y);
+}
+
+- (void)testCaretRoundTripOnLine
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@"x+y=123"];
+    NSUInteger count = NSMaxRange(display.range);
+    XCTAssertEqual(count, 7u);
+    CGFloat previousX = -CGFLOAT_MAX;
+    for (NSUInteger i = 0; i <= count; i++) {
+        MTMathListIndex* index = [MTMathListIndex level0Index:i];
+        CGRect caret = [display caretRectForIndex:index];
+        XCTAssertFalse(CGRectIsNull(caret), @"%lu", (unsigned long) i);
+        XCTAssertEqual(caret.size.width, 0);
+        XCTAssertEqualWithAccuracy(CGRectGetMinY(caret), display.position.y - display.descent, 0.001);
+        XCTAssertEqualWithAccuracy(caret.size.height, display.ascent + display.descent, 0.001);
+        XCTAssertGreaterThan(CGRectGetMinX(caret), previousX, @"%lu", (unsigned long) i);
+        previousX = CGRectGetMinX(caret);
+
+        CGFloat caretOffset = 0;
+        MTMathListIndex* closest = [display closestIndexToPoint:CGPointMake(CGRectGetMinX(caret), display.position.y) caretOffset:&caretOffset];
+        XCTAssertEqualObjects(closest, index);
+        XCTAssertEqualWithAccuracy(caretOffset, CGRectGetMinX(caret), 0.001);
+    }
+    XCTAssertEqualWithAccuracy(CGRectGetMinX([display caretRectForIndex:[MTMathListIndex level0Index:0]]), display.position.x, 0.001);
+    XCTAssertEqualWithAccuracy(CGRectGetMinX([display caretRectForIndex:[MTMathListIndex level0Index:count]]), display.position.x + display.width, 0.001);
+}
+
+- (void)testPointsOutsideTheLine
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@"x+y"];
+    XCTAssertEqualObjects([display closestIndexToPoint:CGPointMake(-100, 20) caretOffset:NULL], [MTMathListIndex level0Index:0]);
+    XCTAssertEqualObjects([display closestIndexToPoint:CGPointMake(1000, 20) caretOffset:NULL], [MTMathListIndex level0Index:3]);
+    // Far above or below still maps by x.
+    XCTAssertEqualObjects([display closestIndexToPoint:CGPointMake(-100, 500) caretOffset:NULL], [MTMathListIndex level0Index:0]);
+}
+
+- (void)testFraction
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@"a+\\frac{12}{3}"];
+    MTFractionDisplay* fraction = (MTFractionDisplay*) display.subDisplays[1];
+    XCTAssertTrue([fraction isKindOfClass:[MTFractionDisplay class]]);
+
+    // The right half of the 2 in the numerator.
+    CGRect numerator = boundsInParent(fraction.numerator, display);
+    CGPoint onTwo = CGPointMake(CGRectGetMaxX(numerator) - 1, CGRectGetMidY(numerator));
+    MTMathListIndex* expected = [MTMathListIndex indexAtLocation:2 withSubIndex:[MTMathListIndex level0Index:2] type:kMTSubIndexTypeNumerator];
+    XCTAssertEqualObjects([display closestIndexToPoint:onTwo caretOffset:NULL], expected);
+
+    CGPoint onThree = centerOf(boundsInParent(fraction.denominator, display));
+    MTMathListIndex* index = [display closestIndexToPoint:onThree caretOffset:NULL];
+    XCTAssertEqual(index.atomIndex, 2u);
+    XCTAssertEqual(index.subIndexType, kMTSubIndexTypeDenominator);
+
+    // The caret in the numerator spans the numerator.
+    CGRect caret = [display caretRectForIndex:expected];
+    XCTAssertEqualWithAccuracy(CGRectGetMinX(caret), CGRectGetMaxX(numerator), 0.001);
+    XCTAssertEqualWithAccuracy(CGRectGetMinY(caret), CGRectGetMinY(numerator), 0.001);
+    XCTAssertEqualWithAccuracy(CGRectGetHeight(caret), CGRectGetHeight(numerator), 0.001);
+
+    // Beside the fraction.
+    CGRect bounds = boundsInParent(fraction, display);
+    XCTAssertEqualObjects([display closestIndexToPoint:CGPointMake(CGRectGetMaxX(bounds) + 50, CGRectGetMidY(bounds)) caretOffset:NULL],
+                          [MTMathListIndex level0Index:3]);
+}
+
+- (void)testScripts
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@"x^{2}+y"];
+    MTDisplay* nucleus = display.subDisplays[0];
+    MTMathListDisplay* superscript = (MTMathListDisplay*) display.subDisplays[1];
+    XCTAssertEqual(superscript.type, kMTLinePositionSuperscript);
+
+    MTMathListIndex* index = [display closestIndexToPoint:centerOf(boundsInParent(superscript, display)) caretOffset:NULL];
+    XCTAssertEqual(index.atomIndex, 0u);
+    XCTAssertEqual(index.subIndexType, kMTSubIndexTypeSuperscript);
+
+    // The right edge of the x is after its nucleus, but before its script.
+    CGRect x = boundsInParent(nucleus, display);
+    CGFloat caretOffset = 0;
+    index = [display closestIndexToPoint:CGPointMake(CGRectGetMaxX(x) - 0.5, CGRectGetMinY(x) + 1) caretOffset:&caretOffset];
+    MTMathListIndex* expected = [MTMathListIndex indexAtLocation:0 withSubIndex:[MTMathListIndex level0Index:1] type:kMTSubIndexTypeNucleus];
+    XCTAssertEqualObjects(index, expected);
+    XCTAssertEqualWithAccuracy(caretOffset, CGRectGetMaxX(x), 0.001);
+    // While the index after the atom is after the script.
+    XCTAssertGreaterThanOrEqual(CGRectGetMinX([display caretRectForIndex:[MTMathListIndex level0Index:1]]),
+                                CGRectGetMaxX(boundsInParent(superscript, display)) - 0.001);
+}
+
+- (void)testInlineInnerList
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@"a\\color{red}{bc}d"];
+    MTMathListDisplay* colored = (MTMathListDisplay*) display.subDisplays[1];
+    XCTAssertTrue([colored isKindOfClass:[MTMathListDisplay class]]);
+
+    CGRect bounds = boundsInParent(colored, display);
+    MTMathListIndex* index = [display closestIndexToPoint:CGPointMake(CGRectGetMidX(bounds), CGRectGetMidY(bounds)) caretOffset:NULL];
+    MTMathListIndex* expected = [MTMathListIndex indexAtLocation:1 withSubIndex:[MTMathListIndex level0Index:1] type:kMTSubIndexTypeInner];
+    XCTAssertEqualObjects(index, expected);
+    XCTAssertFalse(CGRectIsNull([display caretRectForIndex:expected]));
+    XCTAssertEqualWithAccuracy(CGRectGetMinX([display caretRectForIndex:[MTMathListIndex level0Index:2]]), CGRectGetMaxX(bounds), 0.001);
+}
+
+- (void)testNestedContainers
+{
+    NSArray<NSString*>* formulas = @[@"\\sqrt[3]{x+1}", @"\\sum_{i=0}^{n} i", @"\\left( a+b \\right)",
+                                     @"\\overline{ab}", @"\\hat{a}", @"\\overbrace{a+b}", @"\\rlap{a}b"];
+    for (NSString* latex in formulas) {
+        MTMathListDisplay* display = [self displayForLaTeX:latex];
+        // Every index the hit test returns has a caret within the formula.
+        CGRect bounds = display.displayBounds;
+        for (NSUInteger i = 0; i <= 20; i++) {
+            for (NSUInteger j = 0; j <= 4; j++) {
+                CGPoint point = CGPointMake(CGRectGetMinX(bounds) + bounds.size.width * i / 20,
+                                            CGRectGetMinY(bounds) + bounds.size.height * j / 4);
+                MTMathListIndex* index = [display closestIndexToPoint:point caretOffset:NULL];
+                XCTAssertNotNil(index, @"%@", latex);
+                CGRect caret = [display caretRectForIndex:index];
+                XCTAssertFalse(CGRectIsNull(caret), @"%@ %@", latex, index);
+                XCTAssertGreaterThanOrEqual(CGRectGetMinX(caret), CGRectGetMinX(bounds) - 0.001, @"%@ %@", latex, index);
+                XCTAssertLessThanOrEqual(CGRectGetMinX(caret), CGRectGetMaxX(bounds) + 0.001, @"%@ %@", latex, index);
+            }
+        }
+    }
+}
+
+- (void)testInvalidIndex
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@"x+y"];
+    XCTAssertTrue(CGRectIsNull([display caretRectForIndex:[MTMathListIndex level0Index:10]]));
+    MTMathListIndex* numerator = [MTMathListIndex indexAtLocation:0 withSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeNumerator];
+    XCTAssertTrue(CGRectIsNull([display caretRectForIndex:numerator]));
+}
+
+@end
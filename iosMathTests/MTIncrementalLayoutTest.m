@@ -0,0 +1,329 @@
+//
+//  MTIncrementalLayoutTest.m
+//  iosMath
+//
+//  Checks +[MTTypesetter createLineForMathList:font:style:previousDisplay:changedIndex:]
+//  against a full layout on randomly generated formulas and random edits.
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTTypesetter.h"
+#import "MTFontManager.h"
+#import "MTMathListDisplay.h"
+#import "MTMathListDisplayInternal.h"
+#import "MTMathAtomFactory.h"
+#import "MTMathListBuilder.h"
+#import "MTMathListIndex.h"
+
+// Number of random formulas, and the number of successive edits applied to each.
+static const NSUInteger kNumFormulas = 60;
+static const NSUInteger kEditsPerFormula = 8;
+// Maximum nesting depth of the generated formulas.
+static const NSUInteger kMaxDepth = 3;
+
+@interface MTIncrementalLayoutTest : XCTestCase
+
+@property (nonatomic) MTFont* font;
+
+@end
+
+@implementation MTIncrementalLayoutTest {
+    uint64_t _seed;
+}
+
+- (void)setUp {
+    [super setUp];
+    self.font = MTFontManager.fontManager.defaultFont;
+    // Fixed seed so a failure can be reproduced.
+    _seed = 0x9E3779B97F4A7C15ULL;
+}
+
+// xorshift64: deterministic across platforms, unlike random().
+- (NSUInteger)randomBelow:(NSUInteger)bound
+{
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 7;
+    _seed ^= _seed << 17;
+    return (NSUInteger) (_seed % bound);
+}
+
+#pragma mark - Generators
+
+- (MTMathList*)randomListWithDepth:(NSUInteger)depth
+{
+    MTMathList* list = [MTMathList new];
+    NSUInteger count = 1 + [self randomBelow:5];
+    for (NSUInteger i = 0; i < count; i++) {
+        [list addAtom:[self randomAtomWithDepth:depth]];
+    }
+    return list;
+}
+
+- (MTMathAtom*)randomAtomWithDepth:(NSUInteger)depth
+{
+    NSUInteger kind = [self randomBelow:(depth < kMaxDepth) ? 12 : 5];
+    MTMathAtom* atom = nil;
+    switch (kind) {
+        case 0:
+            atom = [MTMathAtomFactory atomForCharacter:'a' + [self randomBelow:26]];
+            break;
+        case 1:
+            atom = [MTMathAtomFactory atomForCharacter:'0' + [self randomBelow:10]];
+            break;
+        case 2:
+            atom = [MTMathAtomFactory atomForCharacter:"+-="[[self randomBelow:3]]];
+            break;
+        case 3:
+            atom = [MTMathAtomFactory atomForLatexSymbolName:@"alpha"];
+            break;
+        case 4:
+            atom = [MTMathAtomFactory atomForCharacter:'('];
+            break;
+        case 5: {
+            MTFraction* frac = [MTFraction new];
+            frac.numerator = [self randomListWithDepth:depth + 1];
+            frac.denominator = [self randomListWithDepth:depth + 1];
+            atom = frac;
+            break;
+        }
+        case 6: {
+            MTRadical* rad = [MTRadical new];
+            rad.radicand = [self randomListWithDepth:depth + 1];
+            if ([self randomBelow:2]) {
+                rad.degree = [self randomListWithDepth:depth + 1];
+            }
+            atom = rad;
+            break;
+        }
+        case 7: {
+            MTInner* inner = [MTInner new];
+            inner.leftBoundary = [MTMathAtomFactory boundaryAtomForDelimiterName:@"("];
+            inner.rightBoundary = [MTMathAtomFactory boundaryAtomForDelimiterName:@")"];
+            inner.innerList = [self randomListWithDepth:depth + 1];
+            atom = inner;
+            break;
+        }
+        case 8:
+            atom = [MTMathAtomFactory operatorWithName:@"∑" limits:YES];
+            break;
+        case 9: {
+            MTOverLine* over = [MTOverLine new];
+            over.innerList = [self randomListWithDepth:depth + 1];
+            atom = over;
+            break;
+        }
+        case 10: {
+            MTMathList* table = [MTMathListBuilder buildFromString:@"\\begin{pmatrix} a & b \\\\ \\frac{c}{2} & d^2 \\end{pmatrix}"];
+            atom = table.atoms.firstObject;
+            break;
+        }
+        default:
+            atom = [MTMathAtomFactory atomForCharacter:'x'];
+            break;
+    }
+    if (depth < kMaxDepth && atom.scriptsAllowed && [self randomBelow:4] == 0) {
+        atom.superScript = [self randomListWithDepth:depth + 1];
+        if ([self randomBelow:2]) {
+            atom.subScript = [self randomListWithDepth:depth + 1];
+        }
+    }
+    return atom;
+}
+
+#pragma mark - Editing
+
+// The child lists an edit may descend into, by sub-index type.
+static NSArray<NSNumber*>* childTypesOfAtom(MTMathAtom* atom)
+{
+    NSMutableArray<NSNumber*>* types = [NSMutableArray array];
+    if (atom.superScript) { [types addObject:@(kMTSubIndexTypeSuperscript)]; }
+    if (atom.subScript) { [types addObject:@(kMTSubIndexTypeSubscript)]; }
+    if ([atom isKindOfClass:[MTFraction class]]) {
+        [types addObjectsFromArray:@[@(kMTSubIndexTypeNumerator), @(kMTSubIndexTypeDenominator)]];
+    } else if ([atom isKindOfClass:[MTRadical class]]) {
+        [types addObject:@(kMTSubIndexTypeRadicand)];
+        if (((MTRadical*) atom).degree) { [types addObject:@(kMTSubIndexTypeDegree)]; }
+    } else if ([atom isKindOfClass:[MTInner class]] || [atom isKindOfClass:[MTOverLine class]]) {
+        [types addObject:@(kMTSubIndexTypeInner)];
+    }
+    return types;
+}
+
+static MTMathList* childListOfAtom(MTMathAtom* atom, MTMathListSubIndexType type)
+{
+    switch (type) {
+        case kMTSubIndexTypeSuperscript: return atom.superScript;
+        case kMTSubIndexTypeSubscript: return atom.subScript;
+        case kMTSubIndexTypeNumerator: return ((MTFraction*) atom).numerator;
+        case kMTSubIndexTypeDenominator: return ((MTFraction*) atom).denominator;
+        case kMTSubIndexTypeRadicand: return ((MTRadical*) atom).radicand;
+        case kMTSubIndexTypeDegree: return ((MTRadical*) atom).degree;
+        case kMTSubIndexTypeInner: return [atom respondsToSelector:@selector(innerList)] ? [(id) atom innerList] : nil;
+        default: return nil;
+    }
+}
+
+// Applies a random insert, remove or replace somewhere in the list (in place) and
+// returns the index describing it.
+- (MTMathListIndex*)applyRandomEditToList:(MTMathList*)list depth:(NSUInteger)depth
+{
+    NSUInteger count = list.atoms.count;
+    if (count > 0 && [self randomBelow:3] > 0) {
+        NSUInteger atomIndex = [self randomBelow:count];
+        NSArray<NSNumber*>* types = childTypesOfAtom(list.atoms[atomIndex]);
+        if (types.count > 0) {
+            MTMathListSubIndexType type = types[[self randomBelow:types.count]].unsignedIntValue;
+            MTMathList* child = childListOfAtom(list.atoms[atomIndex], type);
+            MTMathListIndex* subIndex = [self applyRandomEditToList:child depth:depth + 1];
+            return [MTMathListIndex indexAtLocation:atomIndex withSubIndex:subIndex type:type];
+        }
+    }
+    NSUInteger op = (count == 0) ? 0 : [self randomBelow:3];
+    if (op == 0) {
+        NSUInteger atomIndex = [self randomBelow:count + 1];
+        [list insertAtom:[self randomAtomWithDepth:depth] atIndex:atomIndex];
+        return [MTMathListIndex level0Index:atomIndex];
+    }
+    NSUInteger atomIndex = [self randomBelow:count];
+    [list removeAtomAtIndex:atomIndex];
+    if (op == 2) {
+        [list insertAtom:[self randomAtomWithDepth:depth] atIndex:atomIndex];
+    }
+    return [MTMathListIndex level0Index:atomIndex];
+}
+
+#pragma mark - Comparison
+
+static NSArray<MTDisplay*>* childDisplays(MTDisplay* display)
+{
+    NSMutableArray<MTDisplay*>* children = [NSMutableArray array];
+    void (^add)(MTDisplay*) = ^(MTDisplay* child) {
+        [children addObject:(child ?: (MTDisplay*) [NSNull null])];
+    };
+    if ([display isKindOfClass:[MTMathListDisplay class]]) {
+        [children addObjectsFromArray:((MTMathListDisplay*) display).subDisplays];
+    } else if ([display isKindOfClass:[MTFractionDisplay class]]) {
+        add(((MTFractionDisplay*) display).numerator);
+        add(((MTFractionDisplay*) display).denominator);
+    } else if ([display isKindOfClass:[MTRadicalDisplay class]]) {
+        add(((MTRadicalDisplay*) display).radicand);
+        add(((MTRadicalDisplay*) display).degree);
+    } else if ([display isKindOfClass:[MTLargeOpLimitsDisplay class]]) {
+        add(((MTLargeOpLimitsDisplay*) display).upperLimit);
+        add(((MTLargeOpLimitsDisplay*) display).lowerLimit);
+    } else if ([display isKindOfClass:[MTLineDisplay class]]) {
+        add(((MTLineDisplay*) display).inner);
+    } else if ([display isKindOfClass:[MTAccentDisplay class]]) {
+        add(((MTAccentDisplay*) display).accentee);
+        add(((MTAccentDisplay*) display).accent);
+    } else if ([display isKindOfClass:[MTStackDisplay class]]) {
+        add(((MTStackDisplay*) display).base);
+        add(((MTStackDisplay*) display).over);
+        add(((MTStackDisplay*) display).under);
+    } else if ([display isKindOfClass:[MTInnerDisplay class]]) {
+        add(((MTInnerDisplay*) display).inner);
+        add(((MTInnerDisplay*) display).leftDelimiter);
+        add(((MTInnerDisplay*) display).rightDelimiter);
+    } else if ([display isKindOfClass:[MTMathBoxDisplay class]]) {
+        add(((MTMathBoxDisplay*) display).child);
+    }
+    return children;
+}
+
+- (void)assertDisplay:(MTDisplay*)actual equalsDisplay:(MTDisplay*)expected context:(NSString*)context
+{
+    if ((id) actual == [NSNull null] || (id) expected == [NSNull null]) {
+        XCTAssertEqual((id) actual, (id) expected, @"%@", context);
+        return;
+    }
+    XCTAssertEqualObjects([actual class], [expected class], @"%@", context);
+    XCTAssertTrue(CGPointEqualToPoint(actual.position, expected.position), @"%@: %@ vs %@", context, actual, expected);
+    XCTAssertEqual(actual.ascent, expected.ascent, @"%@", context);
+    XCTAssertEqual(actual.descent, expected.descent, @"%@", context);
+    XCTAssertEqual(actual.width, expected.width, @"%@", context);
+    XCTAssertTrue(NSEqualRanges(actual.range, expected.range), @"%@", context);
+    XCTAssertEqual(actual.hasScript, expected.hasScript, @"%@", context);
+    if ([actual isKindOfClass:[MTCTLineDisplay class]]) {
+        XCTAssertEqualObjects(((MTCTLineDisplay*) actual).attributedString.string,
+                              ((MTCTLineDisplay*) expected).attributedString.string, @"%@", context);
+    }
+    if ([actual isKindOfClass:[MTMathListDisplay class]]) {
+        XCTAssertEqual(((MTMathListDisplay*) actual).type, ((MTMathListDisplay*) expected).type, @"%@", context);
+        XCTAssertEqual(((MTMathListDisplay*) actual).index, ((MTMathListDisplay*) expected).index, @"%@", context);
+    }
+    NSArray<MTDisplay*>* actualChildren = childDisplays(actual);
+    NSArray<MTDisplay*>* expectedChildren = childDisplays(expected);
+    XCTAssertEqual(actualChildren.count, expectedChildren.count, @"%@", context);
+    for (NSUInteger i = 0; i < MIN(actualChildren.count, expectedChildren.count); i++) {
+        [self assertDisplay:actualChildren[i] equalsDisplay:expectedChildren[i] context:context];
+    }
+}
+
+#pragma mark - Tests
+
+- (void)testIncrementalLayoutMatchesFullLayout
+{
+    for (NSUInteger f = 0; f < kNumFormulas; f++) {
+        MTMathList* list = [self randomListWithDepth:0];
+        MTMathListDisplay* display = [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay];
+        for (NSUInteger e = 0; e < kEditsPerFormula; e++) {
+            MTMathList* before = [list copy];
+            MTMathListIndex* index = [self applyRandomEditToList:list depth:0];
+            NSString* context = [NSString stringWithFormat:@"formula %lu edit %lu at %@: %@ -> %@",
+                                 (unsigned long) f, (unsigned long) e, index,
+                                 [MTMathListBuilder mathListToString:before], [MTMathListBuilder mathListToString:list]];
+
+            MTMathListDisplay* incremental = [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay
+                                                                 previousDisplay:display changedIndex:index];
+            MTMathListDisplay* full = [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay];
+            [self assertDisplay:incremental equalsDisplay:full context:context];
+
+            // Adopting parts of the previous display must leave it intact.
+            MTMathListDisplay* previousFull = [MTTypesetter createLineForMathList:before font:self.font style:kMTLineStyleDisplay];
+            [self assertDisplay:display equalsDisplay:previousFull context:[@"previous display, " stringByAppendingString:context]];
+
+            // Chain the next edit off the incremental result.
+            display = incremental;
+        }
+    }
+}
+
+- (void)testIncrementalLayoutFallsBackWithoutPreviousDisplay
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:@"\\frac{a}{b} + c"];
+    MTMathListDisplay* full = [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay];
+    MTMathListDisplay* incremental = [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay
+                                                         previousDisplay:nil changedIndex:[MTMathListIndex level0Index:0]];
+    [self assertDisplay:incremental equalsDisplay:full context:@"no previous display"];
+
+    // A previous display laid out in a different style is not reused.
+    MTMathListDisplay* textStyle = [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleText];
+    incremental = [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay
+                                      previousDisplay:textStyle changedIndex:[MTMathListIndex level0Index:2]];
+    [self assertDisplay:incremental equalsDisplay:full context:@"style mismatch"];
+}
+
+- (void)testIncrementalLayoutReusesUntouchedChildren
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:@"\\frac{a}{b} + \\sqrt{c}"];
+    MTMathListDisplay* previous = [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay];
+    MTFractionDisplay* previousFrac = (MTFractionDisplay*) previous.subDisplays[0];
+
+    // Edit the numerator: the denominator's sub-displays are adopted as they are.
+    MTFraction* frac = (MTFraction*) list.atoms[0];
+    [frac.numerator addAtom:[MTMathAtomFactory atomForCharacter:'x']];
+    MTMathListIndex* index = [MTMathListIndex indexAtLocation:0
+                                                 withSubIndex:[MTMathListIndex level0Index:1]
+                                                         type:kMTSubIndexTypeNumerator];
+    MTMathListDisplay* display = [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay
+                                                     previousDisplay:previous changedIndex:index];
+    MTFractionDisplay* newFrac = (MTFractionDisplay*) display.subDisplays[0];
+    XCTAssertEqual(newFrac.denominator.subDisplays.firstObject, previousFrac.denominator.subDisplays.firstObject);
+    XCTAssertNotEqual(newFrac.numerator.subDisplays.firstObject, previousFrac.numerator.subDisplays.firstObject);
+}
+
+@end
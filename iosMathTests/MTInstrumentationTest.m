@@ -0,0 +1,239 @@
+//
+//  MTInstrumentationTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+#import "MTInstrumentation.h"
+#import "MTTypesetter.h"
+#import "MTFontManager.h"
+#import "MTMathListDisplay.h"
+#import "MTMathListBuilder.h"
+#import "MTMathUILabel.h"
+#import "MTRasterCache.h"
+
+// Records the phases it is told about.
+@interface MTRecordingTraceSink : NSObject <MTTraceSink>
+
+@property (nonatomic, readonly) NSMutableArray<NSString*>* events;
+
+@end
+
+@implementation MTRecordingTraceSink
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _events = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void)beginPhase:(MTLayoutPhase)phase
+{
+    @synchronized (self) {
+        [_events addObject:[NSString stringWithFormat:@"begin %lu", (unsigned long) phase]];
+    }
+}
+
+- (void)endPhase:(MTLayoutPhase)phase duration:(NSTimeInterval)duration
+{
+    @synchronized (self) {
+        [_events addObject:[NSString stringWithFormat:@"end %lu", (unsigned long) phase]];
+    }
+}
+
+@end
+
+@interface MTInstrumentationTest : XCTestCase
+
+@property (nonatomic) MTFont* font;
+
+@end
+
+@implementation MTInstrumentationTest
+
+- (void)setUp {
+    [super setUp];
+    self.font = MTFontManager.fontManager.defaultFont;
+    [MTInstrumentation resetStatistics];
+}
+
+- (void)tearDown {
+    MTInstrumentation.enabled = NO;
+    MTInstrumentation.traceSink = nil;
+    [MTInstrumentation resetStatistics];
+    [super tearDown];
+}
+
+// Parses, lays out and draws the formula.
+- (void)renderLaTeX:(NSString*)latex
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:latex];
+    XCTAssertNotNil(list, @"%@", latex);
+    MTMathListDisplay* display = [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay];
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGContextRef context = CGBitmapContextCreate(NULL, 64, 64, 8, 64 * 4, colorSpace,
+                                                 (CGBitmapInfo) kCGImageAlphaPremultipliedLast);
+    CGColorSpaceRelease(colorSpace);
+    [display draw:context];
+    CGContextRelease(context);
+}
+
+- (void)testDisabledByDefault
+{
+    XCTAssertFalse(MTInstrumentation.isEnabled);
+    [self renderLaTeX:@"\\frac{1}{2} + \\sqrt{x}"];
+    MTLayoutStatistics* stats = [MTInstrumentation statistics];
+    for (NSUInteger i = 0; i < kMTLayoutPhaseCount; i++) {
+        XCTAssertEqual([stats countOfPhase:i], 0u);
+        XCTAssertEqual([stats durationOfPhase:i], 0);
+    }
+    for (NSUInteger i = 0; i < kMTLayoutCounterCount; i++) {
+        XCTAssertEqual([stats valueOfCounter:i], 0u);
+    }
+}
+
+- (void)testPhasesAndCounters
+{
+    MTInstrumentation.enabled = YES;
+    [self renderLaTeX:@"\\left( \\frac{\\sum_{i=0}^{n} x_i}{\\sqrt{2}} \\right)"];
+    MTLayoutStatistics* stats = [MTInstrumentation statistics];
+
+    // Each phase ran at least once, and nested occurrences are not timed again.
+    XCTAssertEqual([stats countOfPhase:kMTLayoutPhaseParse], 1u);
+    XCTAssertEqual([stats countOfPhase:kMTLayoutPhaseFinalize], 1u);
+    XCTAssertEqual([stats countOfPhase:kMTLayoutPhaseDraw], 1u);
+    XCTAssertGreaterThan([stats countOfPhase:kMTLayoutPhasePreprocess], 0u);
+    XCTAssertGreaterThan([stats countOfPhase:kMTLayoutPhaseCreateDisplayAtoms], 0u);
+    for (NSUInteger i = 0; i < kMTLayoutPhaseCount; i++) {
+        XCTAssertGreaterThan([stats durationOfPhase:i], 0);
+    }
+
+    XCTAssertGreaterThan([stats valueOfCounter:kMTLayoutCounterTypesetters], 1u);
+    XCTAssertGreaterThan([stats valueOfCounter:kMTLayoutCounterFontCopies], 0u);
+    XCTAssertGreaterThan([stats valueOfCounter:kMTLayoutCounterCTLines], 0u);
+    XCTAssertGreaterThan([stats valueOfCounter:kMTLayoutCounterGlyphVariantLookups], 0u);
+    XCTAssertGreaterThan([stats valueOfCounter:kMTLayoutCounterAtoms], 0u);
+    XCTAssertGreaterThan([stats valueOfCounter:kMTLayoutCounterDisplays], 0u);
+
+    // A snapshot does not change as more work is recorded.
+    [self renderLaTeX:@"x"];
+    XCTAssertEqual([stats countOfPhase:kMTLayoutPhaseParse], 1u);
+    XCTAssertEqual([[MTInstrumentation statistics] countOfPhase:kMTLayoutPhaseParse], 2u);
+
+    [MTInstrumentation resetStatistics];
+    XCTAssertEqual([[MTInstrumentation statistics] valueOfCounter:kMTLayoutCounterAtoms], 0u);
+}
+
+- (void)testGlyphAssembly
+{
+    MTInstrumentation.enabled = YES;
+    // A delimiter taller than its largest variant is assembled.
+    [self renderLaTeX:@"\\left( \\begin{matrix} 1 \\\\ 2 \\\\ 3 \\\\ 4 \\\\ 5 \\\\ 6 \\end{matrix} \\right)"];
+    XCTAssertGreaterThan([[MTInstrumentation statistics] valueOfCounter:kMTLayoutCounterGlyphAssemblies], 0u);
+}
+
+// Lays out the label and draws it into a bitmap, as its view would.
+- (void)drawLabel:(MTMathUILabel*)label
+{
+    label.frame = CGRectMake(0, 0, 200, 60);
+    [label layoutSubviews];
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGContextRef context = CGBitmapContextCreate(NULL, 200, 60, 8, 200 * 4, colorSpace,
+                                                 (CGBitmapInfo) kCGImageAlphaPremultipliedLast);
+    CGColorSpaceRelease(colorSpace);
+#if TARGET_OS_IPHONE
+    UIGraphicsPushContext(context);
+    [label drawRect:label.bounds];
+    UIGraphicsPopContext();
+#else
+    NSGraphicsContext* previous = NSGraphicsContext.currentContext;
+    NSGraphicsContext.currentContext = [NSGraphicsContext graphicsContextWithCGContext:context flipped:NO];
+    [label drawRect:label.bounds];
+    NSGraphicsContext.currentContext = previous;
+#endif
+    CGContextRelease(context);
+}
+
+- (void)testLabelDraw
+{
+    MTMathUILabel* label = [[MTMathUILabel alloc] init];
+    label.latex = @"\\frac{1}{2} + \\sqrt{x}";
+    MTInstrumentation.enabled = YES;
+
+    // Through the draw commands.
+    [self drawLabel:label];
+    XCTAssertEqual([[MTInstrumentation statistics] countOfPhase:kMTLayoutPhaseDraw], 1u);
+    XCTAssertGreaterThan([[MTInstrumentation statistics] durationOfPhase:kMTLayoutPhaseDraw], 0);
+
+    // Through the raster cache: the image is rendered on the first draw, and only drawn on the second.
+    label.rasterCache = [[MTRasterCache alloc] init];
+    [self drawLabel:label];
+    [MTInstrumentation resetStatistics];
+    [self drawLabel:label];
+    XCTAssertEqual([[MTInstrumentation statistics] countOfPhase:kMTLayoutPhaseDraw], 1u);
+}
+
+- (void)testTraceSink
+{
+    MTRecordingTraceSink* sink = [MTRecordingTraceSink new];
+    MTInstrumentation.traceSink = sink;
+    XCTAssertEqual(MTInstrumentation.traceSink, sink);
+
+    // Nothing is reported while disabled.
+    [self renderLaTeX:@"x^2"];
+    XCTAssertEqual(sink.events.count, 0u);
+
+    MTInstrumentation.enabled = YES;
+    [self renderLaTeX:@"\\frac{x^2}{y}"];
+    XCTAssertEqualObjects(sink.events.firstObject, @"begin 0");
+    XCTAssertEqualObjects(sink.events.lastObject, @"end 4");
+    // The children are preprocessed while the parent is typeset, so the intervals nest.
+    NSMutableArray<NSString*>* open = [NSMutableArray array];
+    for (NSString* event in sink.events) {
+        if ([event hasPrefix:@"begin "]) {
+            [open addObject:[event substringFromIndex:6]];
+        } else {
+            XCTAssertEqualObjects(open.lastObject, [event substringFromIndex:4]);
+            [open removeLastObject];
+        }
+    }
+    XCTAssertEqual(open.count, 0u);
+    NSUInteger count = sink.events.count;
+
+    MTInstrumentation.traceSink = nil;
+    [self renderLaTeX:@"x"];
+    XCTAssertEqual(sink.events.count, count);
+}
+
+- (void)testSignpostTraceSink
+{
+    MTInstrumentation.traceSink = [MTSignpostTraceSink new];
+    MTInstrumentation.enabled = YES;
+    [self renderLaTeX:@"\\int_0^1 x\\,dx"];
+    XCTAssertEqual([[MTInstrumentation statistics] countOfPhase:kMTLayoutPhaseParse], 1u);
+}
+
+- (void)testConcurrentCounts
+{
+    MTInstrumentation.enabled = YES;
+    MTMathList* list = [MTMathListBuilder buildFromString:@"x+y"];
+    [MTInstrumentation resetStatistics];
+    dispatch_apply(8, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+        for (int j = 0; j < 25; j++) {
+            [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleText];
+        }
+    });
+    MTLayoutStatistics* stats = [MTInstrumentation statistics];
+    XCTAssertEqual([stats countOfPhase:kMTLayoutPhaseFinalize], 200u);
+    XCTAssertEqual([stats valueOfCounter:kMTLayoutCounterTypesetters], 200u);
+}
+
+@end
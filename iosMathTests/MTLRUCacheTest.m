@@ -0,0 +1,73 @@
+//
+//  MTLRUCacheTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTLRUCache.h"
+
+@interface MTLRUCacheTest : XCTestCase
+
+@end
+
+@implementation MTLRUCacheTest
+
+- (void)testLeastRecentlyUsedObjectsAreEvicted
+{
+    MTLRUCache<NSString*, NSNumber*>* cache = [[MTLRUCache alloc] initWithCostLimit:10];
+    [cache setObject:@1 forKey:@"a" cost:4];
+    [cache setObject:@2 forKey:@"b" cost:4];
+    XCTAssertEqual(cache.totalCost, 8u);
+    // Use a, so that b is the oldest.
+    XCTAssertEqualObjects([cache objectForKey:@"a"], @1);
+    [cache setObject:@3 forKey:@"c" cost:4];
+    XCTAssertEqual(cache.count, 2u);
+    XCTAssertEqual(cache.totalCost, 8u);
+    XCTAssertNil([cache objectForKey:@"b"]);
+    XCTAssertEqualObjects([cache objectForKey:@"a"], @1);
+    XCTAssertEqualObjects([cache objectForKey:@"c"], @3);
+
+    // c is now the newest.
+    cache.costLimit = 4;
+    XCTAssertEqual(cache.count, 1u);
+    XCTAssertEqualObjects([cache objectForKey:@"c"], @3);
+}
+
+- (void)testReplacingAndRemoving
+{
+    MTLRUCache<NSString*, NSNumber*>* cache = [[MTLRUCache alloc] initWithCostLimit:10];
+    [cache setObject:@1 forKey:@"a" cost:4];
+    [cache setObject:@2 forKey:@"a" cost:6];
+    XCTAssertEqual(cache.count, 1u);
+    XCTAssertEqual(cache.totalCost, 6u);
+    XCTAssertEqualObjects([cache objectForKey:@"a"], @2);
+
+    // Too costly to keep, and it still replaces the old object.
+    [cache setObject:@3 forKey:@"a" cost:11];
+    XCTAssertNil([cache objectForKey:@"a"]);
+    XCTAssertEqual(cache.totalCost, 0u);
+
+    [cache setObject:@1 forKey:@"a" cost:1];
+    [cache setObject:@2 forKey:@"b" cost:2];
+    [cache removeObjectForKey:@"a"];
+    XCTAssertEqual(cache.totalCost, 2u);
+    [cache removeAllObjects];
+    XCTAssertEqual(cache.count, 0u);
+    XCTAssertEqual(cache.totalCost, 0u);
+}
+
+- (void)testKeysAreCopied
+{
+    MTLRUCache<NSString*, NSNumber*>* cache = [[MTLRUCache alloc] initWithCostLimit:10];
+    NSMutableString* key = [NSMutableString stringWithString:@"a"];
+    [cache setObject:@1 forKey:key cost:1];
+    [key appendString:@"b"];
+    XCTAssertEqualObjects([cache objectForKey:@"a"], @1);
+    XCTAssertNil([cache objectForKey:@"ab"]);
+}
+
+@end
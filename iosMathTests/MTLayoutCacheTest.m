@@ -0,0 +1,220 @@
+//
+//  MTLayoutCacheTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTLayoutCache.h"
+#import "MTDrawCommandList.h"
+#import "MTTypesetter.h"
+#import "MTFontManager.h"
+#import "MTMathListDisplay.h"
+#import "MTMathListDisplayInternal.h"
+#import "MTMathListBuilder.h"
+#import "../MathExamples.h"
+
+// Positions and metrics are archived as 32-bit floats.
+static const CGFloat kAccuracy = 1e-3;
+
+@interface MTLayoutCacheTest : XCTestCase
+
+@property (nonatomic) MTFont* font;
+@property (nonatomic) NSURL* directoryURL;
+@property (nonatomic) MTLayoutCache* cache;
+
+@end
+
+@implementation MTLayoutCacheTest
+
+- (void)setUp {
+    [super setUp];
+    self.font = MTFontManager.fontManager.defaultFont;
+    self.directoryURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString] isDirectory:YES];
+    self.cache = [[MTLayoutCache alloc] initWithDirectoryURL:self.directoryURL];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtURL:self.directoryURL error:NULL];
+    [super tearDown];
+}
+
+- (NSArray<NSString*>*)formulas
+{
+    return [MathDemoFormulas() arrayByAddingObjectsFromArray:MathTestFormulas()];
+}
+
+- (MTMathListDisplay*)displayForLaTeX:(NSString*)latex
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:latex];
+    return list ? [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay] : nil;
+}
+
+- (MTMathListDisplay*)roundTrip:(MTMathListDisplay*)display
+{
+    NSData* data = [MTLayoutCache archivedDataWithDisplay:display font:self.font];
+    XCTAssertNotNil(data);
+    return [MTLayoutCache displayWithArchivedData:data font:self.font];
+}
+
+- (void)assertDisplay:(MTDisplay*)decoded equalTo:(MTDisplay*)display latex:(NSString*)latex
+{
+    XCTAssertEqualObjects(decoded.class, display.class, @"%@", latex);
+    XCTAssertEqualWithAccuracy(decoded.position.x, display.position.x, kAccuracy, @"%@", latex);
+    XCTAssertEqualWithAccuracy(decoded.position.y, display.position.y, kAccuracy, @"%@", latex);
+    XCTAssertEqualWithAccuracy(decoded.ascent, display.ascent, kAccuracy, @"%@", latex);
+    XCTAssertEqualWithAccuracy(decoded.descent, display.descent, kAccuracy, @"%@", latex);
+    XCTAssertEqualWithAccuracy(decoded.width, display.width, kAccuracy, @"%@", latex);
+    XCTAssertEqualWithAccuracy(decoded.inkWidth, display.inkWidth, kAccuracy, @"%@", latex);
+    XCTAssertTrue(NSEqualRanges(decoded.range, display.range), @"%@", latex);
+    XCTAssertEqual(decoded.hasScript, display.hasScript, @"%@", latex);
+    if ([display isKindOfClass:MTMathListDisplay.class]) {
+        NSArray<MTDisplay*>* subDisplays = ((MTMathListDisplay*) display).subDisplays;
+        NSArray<MTDisplay*>* decodedSubDisplays = ((MTMathListDisplay*) decoded).subDisplays;
+        XCTAssertEqual(decodedSubDisplays.count, subDisplays.count, @"%@", latex);
+        for (NSUInteger i = 0; i < MIN(subDisplays.count, decodedSubDisplays.count); i++) {
+            [self assertDisplay:decodedSubDisplays[i] equalTo:subDisplays[i] latex:latex];
+        }
+    }
+}
+
+// The draw commands cover every node, so equal commands mean an equal drawing.
+- (void)assertCommandsOf:(MTDisplay*)decoded equalTo:(MTDisplay*)display latex:(NSString*)latex
+{
+    MTDrawCommandList* expected = [[MTDrawCommandList alloc] initWithDisplay:display];
+    MTDrawCommandList* actual = [[MTDrawCommandList alloc] initWithDisplay:decoded];
+    XCTAssertEqual(actual.count, expected.count, @"%@", latex);
+    XCTAssertEqualWithAccuracy(CGRectGetMinX(actual.bounds), CGRectGetMinX(expected.bounds), kAccuracy, @"%@", latex);
+    XCTAssertEqualWithAccuracy(CGRectGetMinY(actual.bounds), CGRectGetMinY(expected.bounds), kAccuracy, @"%@", latex);
+    XCTAssertEqualWithAccuracy(CGRectGetWidth(actual.bounds), CGRectGetWidth(expected.bounds), kAccuracy, @"%@", latex);
+    XCTAssertEqualWithAccuracy(CGRectGetHeight(actual.bounds), CGRectGetHeight(expected.bounds), kAccuracy, @"%@", latex);
+    for (NSUInteger i = 0; i < MIN(actual.count, expected.count); i++) {
+        XCTAssertEqual(actual.commands[i].type, expected.commands[i].type, @"%@", latex);
+        XCTAssertEqualWithAccuracy(actual.commands[i].origin.x, expected.commands[i].origin.x, kAccuracy, @"%@", latex);
+        XCTAssertEqualWithAccuracy(actual.commands[i].origin.y, expected.commands[i].origin.y, kAccuracy, @"%@", latex);
+    }
+}
+
+- (void)testRoundTripAllExamples
+{
+    for (NSString* latex in [self formulas]) {
+        MTMathListDisplay* display = [self displayForLaTeX:latex];
+        if (!display) {
+            continue;
+        }
+        MTMathListDisplay* decoded = [self roundTrip:display];
+        XCTAssertNotNil(decoded, @"%@", latex);
+        [self assertDisplay:decoded equalTo:display latex:latex];
+        [self assertCommandsOf:decoded equalTo:display latex:latex];
+    }
+}
+
+- (void)testColorsRoundTrip
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@"\\color{#ff0000}{x} + \\colorbox{#00ff00}{y} + \\text{z}"];
+    display.textColor = [MTColor colorWithRed:0 green:0 blue:1 alpha:1];
+    MTMathListDisplay* decoded = [self roundTrip:display];
+    [self assertCommandsOf:decoded equalTo:display latex:@"colors"];
+    MTDrawCommandList* expected = [[MTDrawCommandList alloc] initWithDisplay:display];
+    MTDrawCommandList* actual = [[MTDrawCommandList alloc] initWithDisplay:decoded];
+    for (NSUInteger i = 0; i < MIN(actual.count, expected.count); i++) {
+        CGColorRef expectedColor = expected.commands[i].color;
+        CGColorRef actualColor = actual.commands[i].color;
+        XCTAssertEqual(actualColor == NULL, expectedColor == NULL);
+        if (expectedColor && actualColor) {
+            const CGFloat* a = CGColorGetComponents(actualColor);
+            const CGFloat* e = CGColorGetComponents(expectedColor);
+            for (size_t c = 0; c < CGColorGetNumberOfComponents(expectedColor); c++) {
+                XCTAssertEqualWithAccuracy(a[c], e[c], 1.0 / 255);
+            }
+        }
+    }
+}
+
+- (void)testHitTestingAfterRoundTrip
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@"x + \\frac{a}{b} + \\sqrt{c} + y^2"];
+    MTMathListDisplay* decoded = [self roundTrip:display];
+    for (CGFloat x = -5; x < display.width + 5; x += 3) {
+        for (CGFloat y = -display.descent; y < display.ascent; y += 4) {
+            CGPoint point = CGPointMake(x, y);
+            XCTAssertEqualObjects([decoded closestIndexToPoint:point caretOffset:NULL],
+                                  [display closestIndexToPoint:point caretOffset:NULL], @"(%g, %g)", x, y);
+        }
+    }
+}
+
+- (void)testDecodedDisplayIsNotAdopted
+{
+    MTMathListDisplay* decoded = [self roundTrip:[self displayForLaTeX:@"\\frac{1}{2}"]];
+    XCTAssertNil(decoded.layoutFont);
+}
+
+- (void)testOtherFontIsRejected
+{
+    NSData* data = [MTLayoutCache archivedDataWithDisplay:[self displayForLaTeX:@"x^2"] font:self.font];
+    MTFont* other = [MTFontManager.fontManager fontWithName:@"xits-math" size:20];
+    XCTAssertNotNil(other);
+    XCTAssertNil([MTLayoutCache displayWithArchivedData:data font:other]);
+    // The same face at another size is fine.
+    XCTAssertNotNil([MTLayoutCache displayWithArchivedData:data font:[self.font copyFontWithSize:30]]);
+}
+
+- (void)testOtherVersionIsRejected
+{
+    NSMutableData* data = [[MTLayoutCache archivedDataWithDisplay:[self displayForLaTeX:@"x^2"] font:self.font] mutableCopy];
+    // The library version follows the magic and its length.
+    ((uint8_t*) data.mutableBytes)[5] ^= 0x01;
+    XCTAssertNil([MTLayoutCache displayWithArchivedData:data font:self.font]);
+}
+
+- (void)testTruncatedArchivesFail
+{
+    NSData* data = [MTLayoutCache archivedDataWithDisplay:[self displayForLaTeX:@"\\sum_{i=0}^n \\frac{x_i}{\\sqrt{2}}"] font:self.font];
+    for (NSUInteger length = 0; length < data.length; length++) {
+        XCTAssertNil([MTLayoutCache displayWithArchivedData:[data subdataWithRange:NSMakeRange(0, length)] font:self.font], @"%lu", (unsigned long) length);
+    }
+}
+
+- (void)testCacheStoresAndLoads
+{
+    NSString* latex = @"\\int_0^\\infty e^{-x^2} dx = \\frac{\\sqrt{\\pi}}{2}";
+    XCTAssertNil([self.cache displayForLatex:latex font:self.font style:kMTLineStyleDisplay]);
+    MTMathListDisplay* display = [self.cache layoutLatex:latex font:self.font style:kMTLineStyleDisplay error:NULL];
+    XCTAssertNotNil(display);
+    MTMathListDisplay* loaded = [self.cache displayForLatex:latex font:self.font style:kMTLineStyleDisplay];
+    XCTAssertNotNil(loaded);
+    [self assertDisplay:loaded equalTo:display latex:latex];
+    // The key has the style and the size.
+    XCTAssertNil([self.cache displayForLatex:latex font:self.font style:kMTLineStyleText]);
+    XCTAssertNil([self.cache displayForLatex:latex font:[self.font copyFontWithSize:30] style:kMTLineStyleDisplay]);
+
+    [self.cache removeDisplayForLatex:latex font:self.font style:kMTLineStyleDisplay];
+    XCTAssertNil([self.cache displayForLatex:latex font:self.font style:kMTLineStyleDisplay]);
+    [self.cache layoutLatex:latex font:self.font style:kMTLineStyleDisplay error:NULL];
+    [self.cache removeAllDisplays];
+    XCTAssertNil([self.cache displayForLatex:latex font:self.font style:kMTLineStyleDisplay]);
+}
+
+- (void)testParseErrorIsReported
+{
+    NSError* error = nil;
+    XCTAssertNil([self.cache layoutLatex:@"{5+3" font:self.font style:kMTLineStyleDisplay error:&error]);
+    XCTAssertNotNil(error);
+}
+
+- (void)testCorruptFileIsDeleted
+{
+    NSString* latex = @"a+b";
+    XCTAssertTrue([self.cache setDisplay:[self displayForLaTeX:latex] forLatex:latex font:self.font style:kMTLineStyleDisplay]);
+    NSArray<NSURL*>* files = [[NSFileManager defaultManager] contentsOfDirectoryAtURL:self.directoryURL includingPropertiesForKeys:nil options:0 error:NULL];
+    XCTAssertEqual(files.count, 1u);
+    [[@"garbage" dataUsingEncoding:NSUTF8StringEncoding] writeToURL:files[0] atomically:YES];
+    XCTAssertNil([self.cache displayForLatex:latex font:self.font style:kMTLineStyleDisplay]);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:files[0].path]);
+}
+
+@end
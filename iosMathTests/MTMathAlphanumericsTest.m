@@ -0,0 +1,496 @@
+//
+//  MTMathAlphanumericsTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTMathAlphanumerics.h"
+
+#pragma mark - Reference
+
+// The per-style functions and changeFont() that the typesetter used before the tables, kept
+// unchanged as the reference for the tables.
+
+static const unichar kMTUnicodeGreekLowerStart = 0x03B1;
+static const unichar kMTUnicodeGreekLowerEnd = 0x03C9;
+static const unichar kMTUnicodeGreekCapitalStart = 0x0391;
+static const unichar kMTUnicodeGreekCapitalEnd = 0x03A9;
+
+#define IS_LOWER_EN(ch) ((ch) >= 'a' && (ch) <= 'z')
+#define IS_UPPER_EN(ch) ((ch) >= 'A' && (ch) <= 'Z')
+#define IS_NUMBER(ch) ((ch) >= '0' && (ch) <= '9')
+#define IS_LOWER_GREEK(ch) ((ch) >= kMTUnicodeGreekLowerStart && (ch) <= kMTUnicodeGreekLowerEnd)
+#define IS_CAPITAL_GREEK(ch) ((ch) >= kMTUnicodeGreekCapitalStart && (ch) <= kMTUnicodeGreekCapitalEnd)
+
+
+static NSUInteger greekSymbolOrder(unichar ch) {
+    // These greek symbols that always appear in unicode in this particular order after the alphabet
+    // The symbols are epsilon, vartheta, varkappa, phi, varrho, varpi.
+    static NSArray* greekSymbols;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        greekSymbols = @[@0x03F5, @0x03D1, @0x03F0, @0x03D5, @0x03F1, @0x03D6];
+    });
+    return [greekSymbols indexOfObject:@(ch)];
+}
+
+#define IS_GREEK_SYMBOL(ch) (greekSymbolOrder(ch) != NSNotFound)
+
+static const unichar kMTUnicodePlanksConstant = 0x210e;
+static const UTF32Char kMTUnicodeMathCapitalItalicStart = 0x1D434;
+static const UTF32Char kMTUnicodeMathLowerItalicStart = 0x1D44E;
+static const UTF32Char kMTUnicodeGreekCapitalItalicStart = 0x1D6E2;
+static const UTF32Char kMTUnicodeGreekLowerItalicStart = 0x1D6FC;
+static const UTF32Char kMTUnicodeGreekSymbolItalicStart = 0x1D716;
+
+// mathit
+static UTF32Char getItalicized(unichar ch) {
+    UTF32Char unicode = ch;
+    // Special cases for italics
+    switch(ch) {
+        case 'h':
+            return kMTUnicodePlanksConstant;   // italic h (plank's constant)
+    }
+    
+    if (IS_UPPER_EN(ch)) {
+        unicode = kMTUnicodeMathCapitalItalicStart + (ch - 'A');
+    } else if (IS_LOWER_EN(ch)) {
+        unicode = kMTUnicodeMathLowerItalicStart + (ch - 'a');
+    } else if (IS_CAPITAL_GREEK(ch)) {
+        // Capital Greek characters
+        unicode = kMTUnicodeGreekCapitalItalicStart + (ch - kMTUnicodeGreekCapitalStart);
+    } else if (IS_LOWER_GREEK(ch)) {
+        // Greek characters
+        unicode = kMTUnicodeGreekLowerItalicStart + (ch - kMTUnicodeGreekLowerStart);
+    } else if (IS_GREEK_SYMBOL(ch)) {
+        return kMTUnicodeGreekSymbolItalicStart + (int)greekSymbolOrder(ch);
+    }
+    // Note there are no italicized numbers in unicode so we don't support italicizing numbers.
+    return unicode;
+}
+
+static const UTF32Char kMTUnicodeMathCapitalBoldStart = 0x1D400;
+static const UTF32Char kMTUnicodeMathLowerBoldStart = 0x1D41A;
+static const UTF32Char kMTUnicodeGreekCapitalBoldStart = 0x1D6A8;
+static const UTF32Char kMTUnicodeGreekLowerBoldStart = 0x1D6C2;
+static const UTF32Char kMTUnicodeGreekSymbolBoldStart = 0x1D6DC;
+static const UTF32Char kMTUnicodeNumberBoldStart = 0x1D7CE;
+
+// mathbf
+static UTF32Char getBold(unichar ch) {
+    UTF32Char unicode = ch;
+    if (IS_UPPER_EN(ch)) {
+        unicode = kMTUnicodeMathCapitalBoldStart + (ch - 'A');
+    } else if (IS_LOWER_EN(ch)) {
+        unicode = kMTUnicodeMathLowerBoldStart + (ch - 'a');
+    } else if (IS_CAPITAL_GREEK(ch)) {
+        // Capital Greek characters
+        unicode = kMTUnicodeGreekCapitalBoldStart + (ch - kMTUnicodeGreekCapitalStart);
+    } else if (IS_LOWER_GREEK(ch)) {
+        // Greek characters
+        unicode = kMTUnicodeGreekLowerBoldStart + (ch - kMTUnicodeGreekLowerStart);
+    } else if (IS_GREEK_SYMBOL(ch)) {
+        return kMTUnicodeGreekSymbolBoldStart + (int)greekSymbolOrder(ch);
+    } else if (IS_NUMBER(ch)) {
+        unicode = kMTUnicodeNumberBoldStart + (ch - '0');
+    }
+    return unicode;
+}
+
+static const UTF32Char kMTUnicodeMathCapitalBoldItalicStart = 0x1D468;
+static const UTF32Char kMTUnicodeMathLowerBoldItalicStart = 0x1D482;
+static const UTF32Char kMTUnicodeGreekCapitalBoldItalicStart = 0x1D71C;
+static const UTF32Char kMTUnicodeGreekLowerBoldItalicStart = 0x1D736;
+static const UTF32Char kMTUnicodeGreekSymbolBoldItalicStart = 0x1D750;
+
+// mathbfit
+static UTF32Char getBoldItalic(unichar ch) {
+    UTF32Char unicode = ch;
+    if (IS_UPPER_EN(ch)) {
+        unicode = kMTUnicodeMathCapitalBoldItalicStart + (ch - 'A');
+    } else if (IS_LOWER_EN(ch)) {
+        unicode = kMTUnicodeMathLowerBoldItalicStart + (ch - 'a');
+    } else if (IS_CAPITAL_GREEK(ch)) {
+        // Capital Greek characters
+        unicode = kMTUnicodeGreekCapitalBoldItalicStart + (ch - kMTUnicodeGreekCapitalStart);
+    } else if (IS_LOWER_GREEK(ch)) {
+        // Greek characters
+        unicode = kMTUnicodeGreekLowerBoldItalicStart + (ch - kMTUnicodeGreekLowerStart);
+    } else if (IS_GREEK_SYMBOL(ch)) {
+        return kMTUnicodeGreekSymbolBoldItalicStart + (int)greekSymbolOrder(ch);
+    } else if (IS_NUMBER(ch)) {
+        // No bold italic for numbers so we just bold them.
+        unicode = getBold(ch);
+    }
+    return unicode;
+}
+
+// LaTeX default
+static UTF32Char getDefaultStyle(unichar ch) {
+    if (IS_LOWER_EN(ch) || IS_UPPER_EN(ch) || IS_LOWER_GREEK(ch) || IS_GREEK_SYMBOL(ch)) {
+        return getItalicized(ch);
+    } else if (IS_NUMBER(ch) || IS_CAPITAL_GREEK(ch)) {
+        // In the default style numbers and capital greek is roman
+        return ch;
+    } else if (ch == '.') {
+        // . is treated as a number in our code, but it doesn't change fonts.
+        return ch;
+    } else {
+        // Unknown character for the default style (e.g. a symbol placed in a
+        // Variable/Number atom via the public API). Fall back to the character
+        // as-is rather than crashing the render path. (SEC-4)
+        return ch;
+    }
+}
+
+static const UTF32Char kMTUnicodeMathCapitalScriptStart = 0x1D49C;
+// TODO(kostub): Unused in Latin Modern Math - if another font is used determine if
+// this should be applicable.
+// static const UTF32Char kMTUnicodeMathLowerScriptStart = 0x1D4B6;
+
+// mathcal/mathscr (caligraphic or script)
+static UTF32Char getCaligraphic(unichar ch) {
+    // Caligraphic has lots of exceptions:
+    switch(ch) {
+        case 'B':
+            return 0x212C;   // Script B (bernoulli)
+        case 'E':
+            return 0x2130;   // Script E (emf)
+        case 'F':
+            return 0x2131;   // Script F (fourier)
+        case 'H':
+            return 0x210B;   // Script H (hamiltonian)
+        case 'I':
+            return 0x2110;   // Script I
+        case 'L':
+            return 0x2112;   // Script L (laplace)
+        case 'M':
+            return 0x2133;   // Script M (M-matrix)
+        case 'R':
+            return 0x211B;   // Script R (Riemann integral)
+        case 'e':
+            return 0x212F;   // Script e (Natural exponent)
+        case 'g':
+            return 0x210A;   // Script g (real number)
+        case 'o':
+            return 0x2134;   // Script o (order)
+        default:
+            break;
+    }
+    UTF32Char unicode;
+    if (IS_UPPER_EN(ch)) {
+        unicode = kMTUnicodeMathCapitalScriptStart + (ch - 'A');
+    } else if (IS_LOWER_EN(ch)) {
+        // Latin Modern Math does not have lower case caligraphic characters, so we use
+        // the default style instead of showing a ?
+        unicode = getDefaultStyle(ch);
+    } else {
+        // Caligraphic characters don't exist for greek or numbers, we give them the
+        // default treatment.
+        unicode = getDefaultStyle(ch);
+    }
+    return unicode;
+}
+
+static const UTF32Char kMTUnicodeMathCapitalTTStart = 0x1D670;
+static const UTF32Char kMTUnicodeMathLowerTTStart = 0x1D68A;
+static const UTF32Char kMTUnicodeNumberTTStart = 0x1D7F6;
+
+// mathtt (monospace)
+static UTF32Char getTypewriter(unichar ch) {
+    if (IS_UPPER_EN(ch)) {
+        return kMTUnicodeMathCapitalTTStart + (ch - 'A');
+    } else if (IS_LOWER_EN(ch)) {
+        return kMTUnicodeMathLowerTTStart + (ch - 'a');
+    } else if (IS_NUMBER(ch)) {
+        return kMTUnicodeNumberTTStart + (ch - '0');
+    }
+    // Monospace characters don't exist for greek, we give them the
+    // default treatment.
+    return getDefaultStyle(ch);
+}
+
+static const UTF32Char kMTUnicodeMathCapitalSansSerifStart = 0x1D5A0;
+static const UTF32Char kMTUnicodeMathLowerSansSerifStart = 0x1D5BA;
+static const UTF32Char kMTUnicodeNumberSansSerifStart = 0x1D7E2;
+
+// mathsf
+static UTF32Char getSansSerif(unichar ch) {
+    if (IS_UPPER_EN(ch)) {
+        return kMTUnicodeMathCapitalSansSerifStart + (ch - 'A');
+    } else if (IS_LOWER_EN(ch)) {
+        return kMTUnicodeMathLowerSansSerifStart + (ch - 'a');
+    } else if (IS_NUMBER(ch)) {
+        return kMTUnicodeNumberSansSerifStart + (ch - '0');
+    }
+    // Sans-serif characters don't exist for greek, we give them the
+    // default treatment.
+    return getDefaultStyle(ch);
+}
+
+static const UTF32Char kMTUnicodeMathCapitalFrakturStart = 0x1D504;
+static const UTF32Char kMTUnicodeMathLowerFrakturStart = 0x1D51E;
+
+// mathfrak
+static UTF32Char getFraktur(unichar ch) {
+    // Fraktur has exceptions:
+    switch(ch) {
+        case 'C':
+            return 0x212D;   // C Fraktur
+        case 'H':
+            return 0x210C;   // Hilbert space
+        case 'I':
+            return 0x2111;   // Imaginary
+        case 'R':
+            return 0x211C;   // Real
+        case 'Z':
+            return 0x2128;   // Z Fraktur
+        default:
+            break;
+    }
+    if (IS_UPPER_EN(ch)) {
+        return kMTUnicodeMathCapitalFrakturStart + (ch - 'A');
+    } else if (IS_LOWER_EN(ch)) {
+        return kMTUnicodeMathLowerFrakturStart + (ch - 'a');
+    }
+    // Fraktur characters don't exist for greek & numbers, we give them the
+    // default treatment.
+    return getDefaultStyle(ch);
+}
+
+static const UTF32Char kMTUnicodeMathCapitalBlackboardStart = 0x1D538;
+static const UTF32Char kMTUnicodeMathLowerBlackboardStart = 0x1D552;
+static const UTF32Char kMTUnicodeNumberBlackboardStart = 0x1D7D8;
+
+// mathbb (double struck)
+static UTF32Char getBlackboard(unichar ch) {
+    // Blackboard has lots of exceptions:
+    switch(ch) {
+        case 'C':
+            return 0x2102;   // Complex numbers
+        case 'H':
+            return 0x210D;   // Quarternions
+        case 'N':
+            return 0x2115;   // Natural numbers
+        case 'P':
+            return 0x2119;   // Primes
+        case 'Q':
+            return 0x211A;   // Rationals
+        case 'R':
+            return 0x211D;   // Reals
+        case 'Z':
+            return 0x2124;   // Integers
+        default:
+            break;
+    }
+    if (IS_UPPER_EN(ch)) {
+        return kMTUnicodeMathCapitalBlackboardStart + (ch - 'A');
+    } else if (IS_LOWER_EN(ch)) {
+        return kMTUnicodeMathLowerBlackboardStart + (ch - 'a');
+    } else if (IS_NUMBER(ch)) {
+        return kMTUnicodeNumberBlackboardStart + (ch - '0');
+    }
+    // Blackboard characters don't exist for greek, we give them the
+    // default treatment.
+    return getDefaultStyle(ch);
+}
+
+static UTF32Char styleCharacter(unichar ch, MTFontStyle fontStyle)
+{
+    switch (fontStyle) {
+        case kMTFontStyleDefault:
+            return getDefaultStyle(ch);
+            
+        case kMTFontStyleRoman:
+            return ch;
+            
+        case kMTFontStyleBold:
+            return getBold(ch);
+            
+        case kMTFontStyleItalic:
+            return getItalicized(ch);
+            
+        case kMTFontStyleBoldItalic:
+            return getBoldItalic(ch);
+            
+        case kMTFontStyleCaligraphic:
+            return getCaligraphic(ch);
+            
+        case kMTFontStyleTypewriter:
+            return getTypewriter(ch);
+            
+        case kMTFontStyleSansSerif:
+            return getSansSerif(ch);
+            
+        case kMTFontStyleFraktur:
+            return getFraktur(ch);
+            
+        case kMTFontStyleBlackboard:
+            return getBlackboard(ch);
+            
+        default:
+            @throw [NSException exceptionWithName:@"Invalid style"
+                                           reason:[NSString stringWithFormat:@"Unknown style %lu for font.", (unsigned long)fontStyle]
+                                         userInfo:nil];
+    }
+    return ch;
+}
+
+static NSString* changeFont(NSString* str, MTFontStyle fontStyle) {
+    NSUInteger length = str.length;
+    NSMutableString* retval = [NSMutableString stringWithCapacity:length];
+    // Hot path: almost every nucleus is a single character (length == 1).
+    // Use a fixed-size stack buffer for the common small case to avoid a
+    // malloc/free per call.  Inputs longer than 256 unichars still fall back
+    // to the heap so the SEC-2 fix (no unbounded VLA) remains intact.
+    unichar stackBuf[256];
+    unichar *charBuffer = (length <= 256) ? stackBuf : malloc(sizeof(unichar) * (size_t)length);
+    NSCAssert(length == 0 || charBuffer != NULL, @"Failed to allocate charBuffer");
+    // Wrap in @try/@finally so charBuffer is released on all exit paths,
+    // including the IllegalCharacter / Invalid style exceptions that
+    // styleCharacter can @throw from inside the loop.
+    @try {
+        [str getCharacters:charBuffer range:NSMakeRange(0, length)];
+        for (NSUInteger i = 0; i < length; ++i) {
+            unichar ch = charBuffer[i];
+            UTF32Char unicode = styleCharacter(ch, fontStyle);
+            unicode = NSSwapHostIntToLittle(unicode);
+            NSString* charStr = [[NSString alloc] initWithBytes:&unicode length:sizeof(unicode) encoding:NSUTF32LittleEndianStringEncoding];
+            [retval appendString:charStr];
+        }
+    } @finally {
+        if (charBuffer != stackBuf) {
+            free(charBuffer);
+        }
+    }
+    return retval;
+}
+
+#pragma mark - Tests
+
+static const MTFontStyle kAllStyles[] = {
+    kMTFontStyleDefault, kMTFontStyleRoman, kMTFontStyleBold, kMTFontStyleCaligraphic, kMTFontStyleTypewriter,
+    kMTFontStyleItalic, kMTFontStyleSansSerif, kMTFontStyleFraktur, kMTFontStyleBlackboard, kMTFontStyleBoldItalic,
+};
+
+enum { kAllCharacters = 0x10000 };
+
+@interface MTMathAlphanumericsTest : XCTestCase
+
+@end
+
+@implementation MTMathAlphanumericsTest
+
+- (void)testEveryCharacterMatchesReference
+{
+    for (size_t s = 0; s < sizeof(kAllStyles) / sizeof(kAllStyles[0]); s++) {
+        MTFontStyle style = kAllStyles[s];
+        NSUInteger mismatches = 0;
+        for (UTF32Char ch = 0; ch < kAllCharacters; ch++) {
+            UTF32Char expected = styleCharacter((unichar) ch, style);
+            UTF32Char actual = MTMathAlphanumericCharacter((unichar) ch, style);
+            if (expected != actual && mismatches++ < 10) {
+                XCTFail(@"Style %lu: U+%04X is U+%04X, expected U+%04X", (unsigned long) style, ch, actual, expected);
+            }
+        }
+        XCTAssertEqual(mismatches, 0u, @"Style %lu", (unsigned long) style);
+    }
+}
+
+- (void)testWriteCharactersMatchesReference
+{
+    unichar* input = malloc(sizeof(unichar) * kAllCharacters);
+    unichar* output = malloc(sizeof(unichar) * kAllCharacters * kMTMathAlphanumericMaxLength);
+    for (UTF32Char ch = 0; ch < kAllCharacters; ch++) {
+        input[ch] = (unichar) ch;
+    }
+    for (size_t s = 0; s < sizeof(kAllStyles) / sizeof(kAllStyles[0]); s++) {
+        MTFontStyle style = kAllStyles[s];
+        NSUInteger length = MTMathAlphanumericWriteCharacters(input, kAllCharacters, style, output);
+        // Decode the UTF-16 output again, one styled character per input character.
+        NSUInteger position = 0;
+        for (UTF32Char ch = 0; ch < kAllCharacters && position < length; ch++) {
+            UTF32Char decoded = output[position++];
+            if (CFStringIsSurrogateHighCharacter(decoded) && styleCharacter((unichar) ch, style) > 0xFFFF) {
+                XCTAssertLessThan(position, length);
+                decoded = CFStringGetLongCharacterForSurrogatePair((UniChar) decoded, output[position++]);
+            }
+            if (decoded != styleCharacter((unichar) ch, style)) {
+                XCTFail(@"Style %lu: U+%04X is written as U+%04X", (unsigned long) style, ch, decoded);
+                break;
+            }
+        }
+        XCTAssertEqual(position, length, @"Style %lu", (unsigned long) style);
+    }
+    free(input);
+    free(output);
+}
+
+- (void)testStringsMatchReference
+{
+    NSMutableString* alphabet = [NSMutableString stringWithString:@"0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz.,"];
+    for (unichar ch = 0x0391; ch <= 0x03C9; ch++) {
+        [alphabet appendFormat:@"%C", ch];
+    }
+    [alphabet appendString:@"\u03F5\u03D1\u03F0\u03D5\u03F1\u03D6\u2202\u221E@"];
+    NSArray<NSString*>* strings = @[ @"x", @"h", @"\u03B1", @"sin", @"1.5", @"", alphabet ];
+    for (size_t s = 0; s < sizeof(kAllStyles) / sizeof(kAllStyles[0]); s++) {
+        MTFontStyle style = kAllStyles[s];
+        for (NSString* string in strings) {
+            XCTAssertEqualObjects(MTMathAlphanumericString(string, style), changeFont(string, style),
+                                  @"Style %lu: %@", (unsigned long) style, string);
+        }
+    }
+}
+
+- (void)testLongStrings
+{
+    // Longer than the stack buffer.
+    NSString* word = [@"" stringByPaddingToLength:1000 withString:@"abcXYZ019" startingAtIndex:0];
+    for (size_t s = 0; s < sizeof(kAllStyles) / sizeof(kAllStyles[0]); s++) {
+        MTFontStyle style = kAllStyles[s];
+        XCTAssertEqualObjects(MTMathAlphanumericString(word, style), changeFont(word, style), @"Style %lu", (unsigned long) style);
+    }
+}
+
+- (void)testHoles
+{
+    XCTAssertEqual(MTMathAlphanumericCharacter('h', kMTFontStyleItalic), 0x210Eu);
+    XCTAssertEqual(MTMathAlphanumericCharacter('h', kMTFontStyleDefault), 0x210Eu);
+    XCTAssertEqual(MTMathAlphanumericCharacter('B', kMTFontStyleCaligraphic), 0x212Cu);
+    XCTAssertEqual(MTMathAlphanumericCharacter('C', kMTFontStyleFraktur), 0x212Du);
+    XCTAssertEqual(MTMathAlphanumericCharacter('R', kMTFontStyleBlackboard), 0x211Du);
+    XCTAssertEqualObjects(MTMathAlphanumericString(@"hB", kMTFontStyleCaligraphic), @"\u210E\u212C");
+    XCTAssertEqualObjects(MTMathAlphanumericString(@"xR", kMTFontStyleBlackboard), @"\U0001D569\u211D");
+}
+
+- (void)testUnchangedStringsAreNotCopied
+{
+    NSString* string = @"+=\u2202";
+    for (size_t s = 0; s < sizeof(kAllStyles) / sizeof(kAllStyles[0]); s++) {
+        XCTAssertEqual(MTMathAlphanumericString(string, kAllStyles[s]), string);
+    }
+    NSString* roman = @"abc";
+    XCTAssertEqual(MTMathAlphanumericString(roman, kMTFontStyleRoman), roman);
+}
+
+- (void)testSurrogatePairsPassThrough
+{
+    // Already styled characters, which the functions before could not take.
+    NSString* styled = @"\U0001D465\U0001D7D9";
+    XCTAssertEqualObjects(MTMathAlphanumericString(styled, kMTFontStyleBold), styled);
+    XCTAssertEqualObjects(MTMathAlphanumericString([styled stringByAppendingString:@"a"], kMTFontStyleBold), @"\U0001D465\U0001D7D9\U0001D41A");
+}
+
+- (void)testUnknownStyle
+{
+    NSString* string = @"abc";
+    XCTAssertEqual(MTMathAlphanumericString(string, (MTFontStyle) 100), string);
+    XCTAssertEqual(MTMathAlphanumericCharacter('a', (MTFontStyle) 100), (UTF32Char) 'a');
+}
+
+@end
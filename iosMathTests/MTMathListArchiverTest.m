@@ -0,0 +1,326 @@
+//
+//  MTMathListArchiverTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTMathList.h"
+#import "MTMathListBuilder.h"
+#import "MTMathAtomFactory.h"
+#import "../MathExamples.h"
+#import "MTMathListBuilderTestData.h"
+
+@interface MTMathListArchiverTest : XCTestCase
+
+@end
+
+@implementation MTMathListArchiverTest
+
+- (MTMathList*)roundTrip:(MTMathList*)list
+{
+    NSData* data = list.archivedData;
+    XCTAssertNotNil(data);
+    return data ? [MTMathList mathListWithArchivedData:data] : nil;
+}
+
+#pragma mark - Comparison
+
+- (void)assertList:(MTMathList*)list equalTo:(MTMathList*)expected path:(NSString*)path
+{
+    if (!expected) {
+        XCTAssertNil(list, @"%@", path);
+        return;
+    }
+    XCTAssertNotNil(list, @"%@", path);
+    XCTAssertEqual(list.atoms.count, expected.atoms.count, @"%@", path);
+    if (list.atoms.count != expected.atoms.count) {
+        return;
+    }
+    for (NSUInteger i = 0; i < expected.atoms.count; i++) {
+        [self assertAtom:list.atoms[i] equalTo:expected.atoms[i] path:[NSString stringWithFormat:@"%@/%lu", path, (unsigned long) i]];
+    }
+}
+
+- (void)assertAtom:(MTMathAtom*)atom equalTo:(MTMathAtom*)expected path:(NSString*)path
+{
+    if (!expected) {
+        XCTAssertNil(atom, @"%@", path);
+        return;
+    }
+    XCTAssertEqualObjects(atom.class, expected.class, @"%@", path);
+    if (atom.class != expected.class) {
+        return;
+    }
+    XCTAssertEqual(atom.type, expected.type, @"%@", path);
+    XCTAssertEqualObjects(atom.nucleus, expected.nucleus, @"%@", path);
+    XCTAssertEqual(atom.fontStyle, expected.fontStyle, @"%@", path);
+    XCTAssertTrue(NSEqualRanges(atom.indexRange, expected.indexRange), @"%@", path);
+    [self assertList:atom.superScript equalTo:expected.superScript path:[path stringByAppendingString:@"^"]];
+    [self assertList:atom.subScript equalTo:expected.subScript path:[path stringByAppendingString:@"_"]];
+    XCTAssertEqual(atom.fusedAtoms.count, expected.fusedAtoms.count, @"%@", path);
+    if (atom.fusedAtoms.count == expected.fusedAtoms.count) {
+        for (NSUInteger i = 0; i < expected.fusedAtoms.count; i++) {
+            [self assertAtom:atom.fusedAtoms[i] equalTo:expected.fusedAtoms[i] path:[path stringByAppendingFormat:@"~%lu", (unsigned long) i]];
+        }
+    }
+
+    if ([expected isKindOfClass:MTFraction.class]) {
+        MTFraction* frac = (MTFraction*) atom;
+        MTFraction* expectedFrac = (MTFraction*) expected;
+        XCTAssertEqual(frac.hasRule, expectedFrac.hasRule, @"%@", path);
+        XCTAssertEqualObjects(frac.leftDelimiter, expectedFrac.leftDelimiter, @"%@", path);
+        XCTAssertEqualObjects(frac.rightDelimiter, expectedFrac.rightDelimiter, @"%@", path);
+        XCTAssertEqual(frac.styleOverride, expectedFrac.styleOverride, @"%@", path);
+        XCTAssertEqual(frac.isContinuedFraction, expectedFrac.isContinuedFraction, @"%@", path);
+        XCTAssertEqual(frac.numeratorAlignment, expectedFrac.numeratorAlignment, @"%@", path);
+        [self assertList:frac.numerator equalTo:expectedFrac.numerator path:[path stringByAppendingString:@"/num"]];
+        [self assertList:frac.denominator equalTo:expectedFrac.denominator path:[path stringByAppendingString:@"/den"]];
+    } else if ([expected isKindOfClass:MTRadical.class]) {
+        MTRadical* rad = (MTRadical*) atom;
+        MTRadical* expectedRad = (MTRadical*) expected;
+        [self assertList:rad.radicand equalTo:expectedRad.radicand path:[path stringByAppendingString:@"/radicand"]];
+        [self assertList:rad.degree equalTo:expectedRad.degree path:[path stringByAppendingString:@"/degree"]];
+    } else if ([expected isKindOfClass:MTLargeOperator.class]) {
+        XCTAssertEqual(((MTLargeOperator*) atom).limits, ((MTLargeOperator*) expected).limits, @"%@", path);
+    } else if ([expected isKindOfClass:MTInner.class]) {
+        MTInner* inner = (MTInner*) atom;
+        MTInner* expectedInner = (MTInner*) expected;
+        [self assertList:inner.innerList equalTo:expectedInner.innerList path:[path stringByAppendingString:@"/inner"]];
+        [self assertAtom:inner.leftBoundary equalTo:expectedInner.leftBoundary path:[path stringByAppendingString:@"/left"]];
+        [self assertAtom:inner.rightBoundary equalTo:expectedInner.rightBoundary path:[path stringByAppendingString:@"/right"]];
+    } else if ([expected isKindOfClass:MTOverLine.class] || [expected isKindOfClass:MTUnderLine.class]
+               || [expected isKindOfClass:MTAccent.class] || [expected isKindOfClass:MTMathGroup.class]) {
+        [self assertList:[(id) atom innerList] equalTo:[(id) expected innerList] path:[path stringByAppendingString:@"/inner"]];
+    } else if ([expected isKindOfClass:MTLargeDelimiter.class]) {
+        XCTAssertEqual(((MTLargeDelimiter*) atom).delimiterSize, ((MTLargeDelimiter*) expected).delimiterSize, @"%@", path);
+    } else if ([expected isKindOfClass:MTMathSpace.class]) {
+        XCTAssertEqual(((MTMathSpace*) atom).space, ((MTMathSpace*) expected).space, @"%@", path);
+    } else if ([expected isKindOfClass:MTMathStyle.class]) {
+        XCTAssertEqual(((MTMathStyle*) atom).style, ((MTMathStyle*) expected).style, @"%@", path);
+    } else if ([expected isKindOfClass:MTMathColor.class] || [expected isKindOfClass:MTMathColorbox.class]) {
+        XCTAssertEqualObjects([(id) atom colorString], [(id) expected colorString], @"%@", path);
+        [self assertList:[(id) atom innerList] equalTo:[(id) expected innerList] path:[path stringByAppendingString:@"/inner"]];
+    } else if ([expected isKindOfClass:MTMathBox.class]) {
+        MTMathBox* box = (MTMathBox*) atom;
+        MTMathBox* expectedBox = (MTMathBox*) expected;
+        XCTAssertEqual(box.keepWidth, expectedBox.keepWidth, @"%@", path);
+        XCTAssertEqual(box.keepHeight, expectedBox.keepHeight, @"%@", path);
+        XCTAssertEqual(box.keepDepth, expectedBox.keepDepth, @"%@", path);
+        XCTAssertEqual(box.drawChild, expectedBox.drawChild, @"%@", path);
+        XCTAssertEqual(box.hAlign, expectedBox.hAlign, @"%@", path);
+        XCTAssertEqual(box.strikeStyle, expectedBox.strikeStyle, @"%@", path);
+        [self assertList:box.innerList equalTo:expectedBox.innerList path:[path stringByAppendingString:@"/inner"]];
+    } else if ([expected isKindOfClass:MTMathTable.class]) {
+        MTMathTable* table = (MTMathTable*) atom;
+        MTMathTable* expectedTable = (MTMathTable*) expected;
+        XCTAssertEqualObjects(table.environment, expectedTable.environment, @"%@", path);
+        XCTAssertEqualObjects(table.alignments, expectedTable.alignments, @"%@", path);
+        XCTAssertEqual(table.interColumnSpacing, expectedTable.interColumnSpacing, @"%@", path);
+        XCTAssertEqual(table.interRowAdditionalSpacing, expectedTable.interRowAdditionalSpacing, @"%@", path);
+        XCTAssertEqual(table.cellStyle, expectedTable.cellStyle, @"%@", path);
+        XCTAssertEqualObjects(table.verticalLines, expectedTable.verticalLines, @"%@", path);
+        XCTAssertEqualObjects(table.horizontalLines, expectedTable.horizontalLines, @"%@", path);
+        XCTAssertEqual(table.cells.count, expectedTable.cells.count, @"%@", path);
+        for (NSUInteger i = 0; i < MIN(table.cells.count, expectedTable.cells.count); i++) {
+            XCTAssertEqual(table.cells[i].count, expectedTable.cells[i].count, @"%@", path);
+            for (NSUInteger j = 0; j < MIN(table.cells[i].count, expectedTable.cells[i].count); j++) {
+                [self assertList:table.cells[i][j] equalTo:expectedTable.cells[i][j]
+                            path:[path stringByAppendingFormat:@"/cell%lu,%lu", (unsigned long) i, (unsigned long) j]];
+            }
+        }
+    } else if ([expected isKindOfClass:MTMathStack.class]) {
+        MTMathStack* stack = (MTMathStack*) atom;
+        MTMathStack* expectedStack = (MTMathStack*) expected;
+        XCTAssertEqual(stack.displayClass, expectedStack.displayClass, @"%@", path);
+        [self assertList:stack.innerList equalTo:expectedStack.innerList path:[path stringByAppendingString:@"/inner"]];
+        [self assertConstruction:stack.over equalTo:expectedStack.over path:[path stringByAppendingString:@"/over"]];
+        [self assertConstruction:stack.under equalTo:expectedStack.under path:[path stringByAppendingString:@"/under"]];
+    } else if ([expected isKindOfClass:MTTextAtom.class]) {
+        XCTAssertEqualObjects(((MTTextAtom*) atom).text, ((MTTextAtom*) expected).text, @"%@", path);
+        XCTAssertEqual(((MTTextAtom*) atom).textStyle, ((MTTextAtom*) expected).textStyle, @"%@", path);
+    }
+}
+
+- (void)assertConstruction:(MTMathStackConstruction*)construction equalTo:(MTMathStackConstruction*)expected path:(NSString*)path
+{
+    if (!expected) {
+        XCTAssertNil(construction, @"%@", path);
+        return;
+    }
+    XCTAssertEqual(construction.kind, expected.kind, @"%@", path);
+    XCTAssertEqualObjects(construction.glyph, expected.glyph, @"%@", path);
+    XCTAssertEqual(construction.ruleThickness, expected.ruleThickness, @"%@", path);
+    [self assertList:construction.list equalTo:expected.list path:[path stringByAppendingString:@"/list"]];
+}
+
+#pragma mark - Round trips
+
+- (void)testRoundTripBuilderInputs
+{
+    NSUInteger parsed = 0;
+    for (NSString* latex in MTBuilderTestInputs()) {
+        MTMathList* list = [MTMathListBuilder buildFromString:latex];
+        if (!list) {
+            continue;
+        }
+        parsed++;
+        [self assertList:[self roundTrip:list] equalTo:list path:latex];
+        // The finalized list has the index ranges and fused atoms.
+        MTMathList* finalized = list.finalized;
+        [self assertList:[self roundTrip:finalized] equalTo:finalized path:[latex stringByAppendingString:@" (finalized)"]];
+        XCTAssertEqualObjects([MTMathListBuilder mathListToString:[self roundTrip:list]], [MTMathListBuilder mathListToString:list], @"%@", latex);
+    }
+    XCTAssertGreaterThan(parsed, 200u);
+}
+
+- (void)testRoundTripExamples
+{
+    for (NSString* latex in [MathDemoFormulas() arrayByAddingObjectsFromArray:MathTestFormulas()]) {
+        MTMathList* list = [MTMathListBuilder buildFromString:latex];
+        if (list) {
+            [self assertList:[self roundTrip:list] equalTo:list path:latex];
+            [self assertList:[self roundTrip:list.finalized] equalTo:list.finalized path:latex];
+        }
+    }
+}
+
+- (void)testFusedAtoms
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:@"x+12.3"].finalized;
+    MTMathAtom* number = list.atoms[2];
+    XCTAssertEqual(number.fusedAtoms.count, 4u);
+    MTMathList* decoded = [self roundTrip:list];
+    MTMathAtom* decodedNumber = decoded.atoms[2];
+    XCTAssertEqualObjects(decodedNumber.nucleus, @"12.3");
+    XCTAssertTrue(NSEqualRanges(decodedNumber.indexRange, NSMakeRange(2, 4)));
+    XCTAssertEqual(decodedNumber.fusedAtoms.count, 4u);
+    XCTAssertEqualObjects(decodedNumber.fusedAtoms[2].nucleus, @".");
+    XCTAssertTrue(NSEqualRanges(decodedNumber.fusedAtoms[2].indexRange, NSMakeRange(4, 1)));
+}
+
+- (void)testProgrammaticTableAndStack
+{
+    MTMathTable* table = [[MTMathTable alloc] initWithEnvironment:@"array"];
+    [table setCell:[MTMathListBuilder buildFromString:@"a"] forRow:0 column:0];
+    [table setCell:[MTMathListBuilder buildFromString:@"b"] forRow:0 column:2];
+    [table setCell:[MTMathListBuilder buildFromString:@"c"] forRow:1 column:0];
+    [table setAlignment:kMTColumnAlignmentRight forColumn:2];
+    table.interColumnSpacing = 18;
+    table.interRowAdditionalSpacing = 0.3;
+    table.cellStyle = kMTLineStyleScript;
+    table.verticalLines = @[ @1, @0, @2, @1 ];
+    table.horizontalLines = @[ @2, @0, @1 ];
+
+    MTMathStack* stack = [[MTMathStack alloc] init];
+    stack.innerList = [MTMathListBuilder buildFromString:@"x+y"];
+    stack.over = [MTMathStackConstruction ruleWithThickness:1.5];
+    stack.under = [MTMathStackConstruction extensibleWithGlyph:@"⏟"];
+    stack.displayClass = kMTMathAtomRelation;
+
+    MTMathSpace* space = [[MTMathSpace alloc] initWithSpace:-1.0 / 3];
+    MTMathList* list = [MTMathList mathListWithAtoms:table, stack, space, nil];
+    MTMathList* decoded = [self roundTrip:list];
+    [self assertList:decoded equalTo:list path:@"programmatic"];
+    // Spacings are kept exactly.
+    XCTAssertEqual(((MTMathSpace*) decoded.atoms[2]).space, -1.0 / 3);
+}
+
+- (void)testStringsAreShared
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:@"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"];
+    NSData* data = list.archivedData;
+    // Every x after the first refers back to it, a byte instead of the three of a new string.
+    XCTAssertLessThan(data.length, 64u * 10);
+    MTMathList* decoded = [MTMathList mathListWithArchivedData:data];
+    XCTAssertEqual(decoded.atoms.count, 64u);
+    XCTAssertTrue(decoded.atoms[0].nucleus == decoded.atoms[63].nucleus);
+}
+
+#pragma mark - Corrupt data
+
+- (void)testRejectsOtherVersion
+{
+    NSMutableData* data = [[MTMathListBuilder buildFromString:@"x^2"].archivedData mutableCopy];
+    // The version follows the magic.
+    ((uint8_t*) data.mutableBytes)[4] ^= 0x7f;
+    XCTAssertNil([MTMathList mathListWithArchivedData:data]);
+    ((uint8_t*) data.mutableBytes)[4] ^= 0x7f;
+    ((uint8_t*) data.mutableBytes)[0] = 'X';
+    XCTAssertNil([MTMathList mathListWithArchivedData:data]);
+}
+
+- (void)testRejectsTruncatedData
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:@"\\begin{pmatrix} \\frac{a}{b} & \\sqrt[3]{x} \\\\ \\color{red}{y} & \\overset{!}{=} \\end{pmatrix}"].finalized;
+    NSData* data = list.archivedData;
+    for (NSUInteger length = 0; length < data.length; length++) {
+        XCTAssertNil([MTMathList mathListWithArchivedData:[data subdataWithRange:NSMakeRange(0, length)]], @"%lu", (unsigned long) length);
+    }
+    XCTAssertNotNil([MTMathList mathListWithArchivedData:data]);
+}
+
+- (void)testRejectsCorruptData
+{
+    NSData* data = [MTMathListBuilder buildFromString:@"\\left( \\frac{1}{2} \\right)"].archivedData;
+    // Flipping any byte must never crash or throw: it either decodes or returns nil.
+    for (NSUInteger i = 0; i < data.length; i++) {
+        for (int bit = 0; bit < 8; bit++) {
+            NSMutableData* corrupt = [data mutableCopy];
+            ((uint8_t*) corrupt.mutableBytes)[i] ^= (1 << bit);
+            XCTAssertNoThrow([MTMathList mathListWithArchivedData:corrupt]);
+        }
+    }
+}
+
+- (MTMathList*)listNestedInSuperscripts:(NSUInteger)depth
+{
+    MTMathList* list = [MTMathList new];
+    MTMathList* inner = list;
+    for (NSUInteger i = 0; i < depth; i++) {
+        MTMathAtom* atom = [MTMathAtomFactory atomForCharacter:'x'];
+        [inner addAtom:atom];
+        if (i + 1 < depth) {
+            atom.superScript = [MTMathList new];
+            inner = atom.superScript;
+        }
+    }
+    return list;
+}
+
+- (void)testRejectsDeepNesting
+{
+    // As deep as the parser allows groups to nest.
+    XCTAssertNotNil([self roundTrip:[self listNestedInSuperscripts:150]]);
+    NSData* data = [self listNestedInSuperscripts:151].archivedData;
+    XCTAssertNotNil(data);
+    XCTAssertNil([MTMathList mathListWithArchivedData:data]);
+}
+
+- (void)testRejectsFieldsOutOfRange
+{
+    NSArray<void (^)(MTMathList*)>* corruptions = @[
+        ^(MTMathList* list) { [list.atoms[0] setFontStyle:(MTFontStyle) 99]; },
+        ^(MTMathList* list) { [list.atoms[1] setStyleOverride:(MTFractionStyle) 99]; },
+        ^(MTMathList* list) { [list.atoms[1] setNumeratorAlignment:(MTFractionAlignment) 99]; },
+        ^(MTMathList* list) { [list.atoms[2] setAlignment:(MTColumnAlignment) 99 forColumn:0]; },
+        ^(MTMathList* list) { [list.atoms[2] setCellStyle:(MTLineStyle) 99]; },
+    ];
+    for (NSUInteger i = 0; i < corruptions.count; i++) {
+        MTMathList* list = [MTMathListBuilder buildFromString:@"x\\frac{a}{b}\\begin{matrix} a & b \\end{matrix}"];
+        XCTAssertNotNil([self roundTrip:list]);
+        corruptions[i](list);
+        NSData* data = list.archivedData;
+        XCTAssertNotNil(data);
+        XCTAssertNil([MTMathList mathListWithArchivedData:data], @"%lu", (unsigned long) i);
+    }
+
+    // The cells of a table may inherit their style.
+    MTMathList* table = [MTMathListBuilder buildFromString:@"\\begin{aligned} a & b \\end{aligned}"];
+    XCTAssertEqual(((MTMathTable*) [self roundTrip:table].atoms[0]).cellStyle, kMTLineStyleInherit);
+}
+
+@end
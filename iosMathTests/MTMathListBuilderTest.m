@@ -13,6 +13,7 @@
 
 #import "MTMathListBuilder.h"
 #import "MTMathAtomFactory.h"
+#import "MTMathListBuilderTestData.h"
 
 @interface MTMathListBuilderTest : XCTestCase
 
@@ -44,36 +45,6 @@
     [super tearDown];
 }
 
-static NSArray* getTestData() {
-    return @[
-             @[ @"x", @[ @(kMTMathAtomVariable) ] , @"x"],
-             @[ @"1", @[ @(kMTMathAtomNumber) ] , @"1"],
-             @[ @"*", @[ @(kMTMathAtomBinaryOperator) ] ,@"*"],
-             @[ @"+", @[ @(kMTMathAtomBinaryOperator) ], @"+"],
-             @[ @".", @[ @(kMTMathAtomNumber) ], @"." ],
-             @[ @"(", @[ @(kMTMathAtomOpen) ], @"(" ],
-             @[ @")", @[ @(kMTMathAtomClose) ], @")" ],
-             @[ @",", @[ @(kMTMathAtomPunctuation)], @"," ],
-             @[ @"!", @[ @(kMTMathAtomClose)], @"!" ],
-             @[ @"=", @[ @(kMTMathAtomRelation)], @"=" ],
-             @[ @"x+2", @[ @(kMTMathAtomVariable), @(kMTMathAtomBinaryOperator), @(kMTMathAtomNumber) ], @"x+2"],
-             // spaces are ignored
-             @[ @"(2.3 * 8)", @[ @(kMTMathAtomOpen), @(kMTMathAtomNumber), @(kMTMathAtomNumber), @(kMTMathAtomNumber), @(kMTMathAtomBinaryOperator), @(kMTMathAtomNumber) , @(kMTMathAtomClose) ], @"(2.3*8)"],
-             // braces create an Ord group (MTMathGroup)
-             @[ @"5{3+4}", @[@(kMTMathAtomNumber), @(kMTMathAtomOrdGroup)], @"5{3+4}"],
-             // commands
-             @[ @"\\pi+\\theta\\geq 3",@[ @(kMTMathAtomVariable), @(kMTMathAtomBinaryOperator), @(kMTMathAtomVariable), @(kMTMathAtomRelation), @(kMTMathAtomNumber)], @"\\pi +\\theta \\geq 3"],
-             // aliases
-             @[ @"\\pi\\ne 5 \\land 3", @[ @(kMTMathAtomVariable), @(kMTMathAtomRelation), @(kMTMathAtomNumber), @(kMTMathAtomBinaryOperator), @(kMTMathAtomNumber)], @"\\pi \\neq 5\\wedge 3"],
-             // control space
-             @[ @"x \\ y", @[  @(kMTMathAtomVariable), @(kMTMathAtomOrdinary), @(kMTMathAtomVariable)], @"x\\  y"],
-             // spacing
-             @[ @"x \\quad y \\; z \\! q", @[  @(kMTMathAtomVariable), @(kMTMathAtomSpace), @(kMTMathAtomVariable),@(kMTMathAtomSpace), @(kMTMathAtomVariable),@(kMTMathAtomSpace), @(kMTMathAtomVariable)], @"x\\quad y\\; z\\! q"],
-             // tilde is a non-breaking space (renders as an ordinary space, same as a literal space)
-             @[ @"x~y", @[  @(kMTMathAtomVariable), @(kMTMathAtomOrdinary), @(kMTMathAtomVariable)], @"x\\  y"],
-             ];
-}
-
 
 - (void) testBuilder
 {
@@ -93,21 +64,6 @@ static NSArray* getTestData() {
     }
 }
 
-static NSArray* getTestDataSuperScript() {
-    return @[
-             @[ @"x^2", @[ @(kMTMathAtomVariable) ],  @[ @(kMTMathAtomNumber) ], @"x^{2}"],
-             @[ @"x^23", @[ @(kMTMathAtomVariable), @(kMTMathAtomNumber) ],  @[ @(kMTMathAtomNumber) ], @"x^{2}3"],
-             @[ @"x^{23}", @[ @(kMTMathAtomVariable) ],  @[ @(kMTMathAtomNumber), @(kMTMathAtomNumber) ], @"x^{23}"],
-             @[ @"x^2^3", @[ @(kMTMathAtomVariable), @(kMTMathAtomOrdinary) ],  @[ @(kMTMathAtomNumber) ], @"x^{2}{}^{3}" ],
-             @[ @"x^{2^3}", @[ @(kMTMathAtomVariable) ], @[ @(kMTMathAtomNumber)], @[ @(kMTMathAtomNumber),], @"x^{2^{3}}"],
-             @[ @"x^{^2*}", @[ @(kMTMathAtomVariable) ], @[ @(kMTMathAtomOrdinary), @(kMTMathAtomBinaryOperator)], @[ @(kMTMathAtomNumber),], @"x^{{}^{2}*}"],
-             @[ @"^2", @ [ @(kMTMathAtomOrdinary)], @[ @(kMTMathAtomNumber) ], @"{}^{2}"],
-             @[ @"{}^2", @ [ @(kMTMathAtomOrdGroup)], @[ @(kMTMathAtomNumber) ], @"{}^{2}"],
-             @[ @"x^^2", @[ @(kMTMathAtomVariable), @(kMTMathAtomOrdinary) ],  @[ ], @"x^{}{}^{2}"],
-             @[ @"5{x}^2", @ [ @(kMTMathAtomNumber), @(kMTMathAtomOrdGroup)], @[ ], @"5{x}^{2}"],
-             ];
-}
-
 - (void) testSuperScript
 {
     NSArray* data = getTestDataSuperScript();
@@ -143,21 +99,6 @@ static NSArray* getTestDataSuperScript() {
     }
 }
 
-static NSArray* getTestDataSubScript() {
-    return @[
-             @[ @"x_2", @[ @(kMTMathAtomVariable) ],  @[ @(kMTMathAtomNumber) ], @"x_{2}" ],
-             @[ @"x_23", @[ @(kMTMathAtomVariable), @(kMTMathAtomNumber) ],  @[ @(kMTMathAtomNumber) ], @"x_{2}3"],
-             @[ @"x_{23}", @[ @(kMTMathAtomVariable) ],  @[ @(kMTMathAtomNumber), @(kMTMathAtomNumber) ], @"x_{23}"],
-             @[ @"x_2_3", @[ @(kMTMathAtomVariable) , @(kMTMathAtomOrdinary)],  @[ @(kMTMathAtomNumber) ], @"x_{2}{}_{3}" ],
-             @[ @"x_{2_3}", @[ @(kMTMathAtomVariable) ], @[ @(kMTMathAtomNumber)], @[ @(kMTMathAtomNumber),], @"x_{2_{3}}"],
-             @[ @"x_{_2*}", @[ @(kMTMathAtomVariable) ], @[ @(kMTMathAtomOrdinary), @(kMTMathAtomBinaryOperator)], @[ @(kMTMathAtomNumber),], @"x_{{}_{2}*}"],
-             @[ @"_2", @ [ @(kMTMathAtomOrdinary)], @[ @(kMTMathAtomNumber) ], @"{}_{2}" ],
-             @[ @"{}_2", @ [ @(kMTMathAtomOrdGroup)], @[ @(kMTMathAtomNumber) ], @"{}_{2}" ],
-             @[ @"x__2", @[ @(kMTMathAtomVariable), @(kMTMathAtomOrdinary) ],  @[ ], @"x_{}{}_{2}"],
-             @[ @"5{x}_2", @ [ @(kMTMathAtomNumber), @(kMTMathAtomOrdGroup)], @[ ], @"5{x}_{2}"],
-             ];
-}
-
 - (void) testSubScript
 {
     NSArray* data = getTestDataSubScript();
@@ -194,18 +135,6 @@ static NSArray* getTestDataSubScript() {
     }
 }
 
-static NSArray* getTestDataSuperSubScript() {
-    return @[
-             @[ @"x_2^*", @[ @(kMTMathAtomVariable) ],  @[ @(kMTMathAtomNumber) ], @[ @(kMTMathAtomBinaryOperator) ], @"x^{*}_{2}" ],
-             @[ @"x^*_2", @[ @(kMTMathAtomVariable) ],  @[ @(kMTMathAtomNumber) ], @[ @(kMTMathAtomBinaryOperator) ], @"x^{*}_{2}" ],
-             @[ @"x_^*", @[ @(kMTMathAtomVariable) ],  @[ ], @[ @(kMTMathAtomBinaryOperator) ], @"x^{*}_{}" ],
-             @[ @"x^_2", @[ @(kMTMathAtomVariable) ],  @[ @(kMTMathAtomNumber)], @[ ], @"x^{}_{2}"],
-             @[ @"x_{2^*}", @[ @(kMTMathAtomVariable) ],  @[ @(kMTMathAtomNumber)], @[ ], @"x_{2^{*}}"],
-             @[ @"x^{*_2}", @[ @(kMTMathAtomVariable) ], @[ ], @[ @(kMTMathAtomBinaryOperator),], @"x^{*_{2}}"],
-             @[ @"_2^*", @ [ @(kMTMathAtomOrdinary)], @[ @(kMTMathAtomNumber) ], @[ @(kMTMathAtomBinaryOperator) ], @"{}^{*}_{2}"],
-             ];
-}
-
 - (void) testSuperSubScript
 {
     NSArray* data = getTestDataSuperSubScript();
@@ -496,42 +425,6 @@ static NSArray* getTestDataSuperSubScript() {
     XCTAssertEqualObjects(latex, @"\\sqrt[3]{2}");
 }
 
-static NSArray* getTestDataLeftRight() {
-    return @[
-             @[@"\\left( 2 \\right)", @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomNumber)], @"(", @")", @"\\left( 2\\right) "],
-             // spacing
-             @[@"\\left ( 2 \\right )", @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomNumber)], @"(", @")", @"\\left( 2\\right) "],
-             // commands
-             @[@"\\left\\{ 2 \\right\\}", @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomNumber)], @"{", @"}", @"\\left\\{ 2\\right\\} "],
-             // complex commands
-             @[@"\\left\\langle x \\right\\rangle", @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomVariable)], @"\u27E8", @"\u27E9", @"\\left< x\\right> "],
-             // bars
-             @[@"\\left| x \\right\\|", @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomVariable)], @"|", @"\u2016", @"\\left| x\\right\\| "],
-             // inner in between
-             @[@"5 + \\left( 2 \\right) - 2", @[ @(kMTMathAtomNumber), @(kMTMathAtomBinaryOperator), @(kMTMathAtomInner), @(kMTMathAtomBinaryOperator), @(kMTMathAtomNumber) ], @2, @[ @(kMTMathAtomNumber)], @"(", @")", @"5+\\left( 2\\right) -2"],
-             // long inner
-             @[@"\\left( 2 + \\frac12\\right)", @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomNumber), @(kMTMathAtomBinaryOperator), @(kMTMathAtomFraction)], @"(", @")", @"\\left( 2+\\frac{1}{2}\\right) "],
-             // nested
-             @[@"\\left[ 2 + \\left|\\frac{-x}{2}\\right| \\right]", @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomNumber), @(kMTMathAtomBinaryOperator), @(kMTMathAtomInner)], @"[", @"]", @"\\left[ 2+\\left| \\frac{-x}{2}\\right| \\right] "],
-             // With scripts
-             @[@"\\left( 2 \\right)^2", @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomNumber)], @"(", @")", @"\\left( 2\\right) ^{2}"],
-             // Scripts on left
-             @[@"\\left(^2 \\right )", @[ @(kMTMathAtomInner)], @0, @[ @(kMTMathAtomOrdinary)], @"(", @")", @"\\left( {}^{2}\\right) "],
-             // Dot
-             @[@"\\left( 2 \\right.", @[ @(kMTMathAtomInner)], @0, @[ @(kMTMathAtomNumber)], @"(", @"", @"\\left( 2\\right. "],
-             // Double arrows (REN-1): Uparrow/Downarrow nuclei must be the actual Unicode glyphs, not the literal strings "21D1"/"21D3"
-             @[@"\\left\\Uparrow x \\right\\Downarrow",
-               @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomVariable)],
-               @"\u21D1", @"\u21D3",
-               @"\\left\\Uparrow x\\right\\Downarrow "],
-             // Updownarrow (REN-1): nucleus must be the Unicode glyph U+21D5, not the literal string "21D5"
-             @[@"\\left\\Updownarrow x \\right\\Updownarrow",
-               @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomVariable)],
-               @"\u21D5", @"\u21D5",
-               @"\\left\\Updownarrow x\\right\\Updownarrow "],
-        ];
-}
-
 - (void) testLeftRight
 {
     NSArray* data = getTestDataLeftRight();
@@ -1635,101 +1528,6 @@ static NSArray* getTestDataLeftRight() {
     XCTAssertEqualObjects(latex, @"\\begin{alignedat}{2}10&x+&3&y\\end{alignedat}");
 }
 
-static NSArray* getTestDataParseErrors() {
-    return @[
-              @[@"}a", @(MTParseErrorMismatchBraces)],
-              @[@"\\notacommand", @(MTParseErrorInvalidCommand)],
-              @[@"\\sqrt[5+3", @(MTParseErrorCharacterNotFound)],
-              @[@"\\smash[t", @(MTParseErrorCharacterNotFound)], // missing ] on smash optional arg
-              @[@"{5+3", @(MTParseErrorMismatchBraces)],
-              @[@"5+3}", @(MTParseErrorMismatchBraces)],
-              @[@"{1+\\frac{3+2", @(MTParseErrorMismatchBraces)],
-              @[@"1+\\left", @(MTParseErrorMissingDelimiter)],
-              @[@"\\left(\\frac12\\right", @(MTParseErrorMissingDelimiter)],
-              @[@"\\left 5 + 3 \\right)", @(MTParseErrorInvalidDelimiter)],
-              @[@"\\left(\\frac12\\right + 3", @(MTParseErrorInvalidDelimiter)],
-              @[@"\\left\\lmoustache 5 + 3 \\right)", @(MTParseErrorInvalidDelimiter)],
-              @[@"\\left(\\frac12\\right\\rmoustache + 3", @(MTParseErrorInvalidDelimiter)],
-              @[@"5 + 3 \\right)", @(MTParseErrorMissingLeft)],
-              @[@"\\left(\\frac12", @(MTParseErrorMissingRight)],
-              @[@"\\left(5 + \\left| \\frac12 \\right)", @(MTParseErrorMissingRight)],
-              @[@"5+ \\left|\\frac12\\right| \\right)", @(MTParseErrorMissingLeft)],
-              @[@"\\begin matrix \\end matrix", @(MTParseErrorCharacterNotFound)], // missing {
-              @[@"\\begin", @(MTParseErrorCharacterNotFound)], // missing {
-              @[@"\\begin{", @(MTParseErrorCharacterNotFound)], // missing }
-              @[@"\\begin{matrix parens}", @(MTParseErrorCharacterNotFound)], // missing } (no spaces in env)
-              @[@"\\begin{matrix} x", @(MTParseErrorMissingEnd)],
-              @[@"\\begin{matrix} x \\end", @(MTParseErrorCharacterNotFound)], // missing {
-              @[@"\\begin{matrix} x \\end + 3", @(MTParseErrorCharacterNotFound)], // missing {
-              @[@"\\begin{matrix} x \\end{", @(MTParseErrorCharacterNotFound)], // missing }
-              @[@"\\begin{matrix} x \\end{matrix + 3", @(MTParseErrorCharacterNotFound)], // missing }
-              @[@"\\begin{matrix} x \\end{pmatrix}", @(MTParseErrorInvalidEnv)],
-              @[@"x \\end{matrix}", @(MTParseErrorMissingBegin)],
-              @[@"\\begin{notanenv} x \\end{notanenv}", @(MTParseErrorInvalidEnv)],
-              @[@"\\begin{matrix} \\notacommand \\end{matrix}", @(MTParseErrorInvalidCommand)],
-              @[@"\\begin{displaylines} x & y \\end{displaylines}", @(MTParseErrorInvalidNumColumns)],
-              @[@"\\begin{eqalign} x \\end{eqalign}", @(MTParseErrorInvalidNumColumns)],
-              @[@"\\begin{gathered} x & y \\end{gathered}", @(MTParseErrorInvalidNumColumns)],
-              @[@"\\nolimits", @(MTParseErrorInvalidLimits)],
-              @[@"\\frac\\limits{1}{2}", @(MTParseErrorInvalidLimits)],
-              // REN-6: generalized-fraction commands are illegal in one-char script slots
-              @[@"x^\\over y",   @(MTParseErrorInvalidCommand)],
-              @[@"x_\\over y",   @(MTParseErrorInvalidCommand)],
-              @[@"x^\\atop y",   @(MTParseErrorInvalidCommand)],
-              @[@"x^\\choose y", @(MTParseErrorInvalidCommand)],
-              @[@"x^\\brack y",  @(MTParseErrorInvalidCommand)],
-              @[@"x^\\brace y",  @(MTParseErrorInvalidCommand)],
-              // REN-5: non-ASCII literal characters should produce MTParseErrorInvalidCharacter
-              @[@"π", @(MTParseErrorInvalidCharacter)],          // π (U+03C0)
-              @[@"3 × 4", @(MTParseErrorInvalidCharacter)],      // 3 × 4
-              @[@"x ≤ y", @(MTParseErrorInvalidCharacter)],      // x ≤ y
-              @[@"x 𝑎 y", @(MTParseErrorInvalidCharacter)],      // above-BMP literal (U+1D44E, surrogate pair)
-              // Special characters with no meaning in math mode are errors (match LaTeX:
-              // % is a comment, # is a macro parameter, $ toggles math mode - none valid here).
-              @[@"a % b", @(MTParseErrorInvalidCharacter)],
-              @[@"a # b", @(MTParseErrorInvalidCharacter)],
-              @[@"a $ b", @(MTParseErrorInvalidCharacter)],
-              // Item 4: spacing dimension parse errors
-              @[@"\\kern", @(MTParseErrorInvalidCommand)],          // missing distance at EOF
-              @[@"\\kernabc", @(MTParseErrorInvalidCommand)],       // no number/unit
-              @[@"\\hspace{abc}", @(MTParseErrorInvalidCommand)],   // no number/unit
-              @[@"\\hspace{}", @(MTParseErrorInvalidCommand)],      // empty
-              @[@"\\mkern{1em}", @(MTParseErrorInvalidCommand)],    // mu required for \mkern
-              @[@"\\kern1pt", @(MTParseErrorInvalidCommand)],      // valid number, unsupported unit
-              @[@"\\kern1xx", @(MTParseErrorInvalidCommand)],      // valid number, unknown unit
-              @[@"\\begin{alignedat} x & y \\end{alignedat}", @(MTParseErrorInvalidCommand)],  // missing {n}
-              @[@"\\begin{alignedat}{x} a&b \\end{alignedat}", @(MTParseErrorInvalidCommand)],      // non-numeric
-              @[@"\\begin{alignedat}{0} a&b \\end{alignedat}", @(MTParseErrorInvalidCommand)],      // n < 1
-              @[@"\\begin{alignedat}{-1} a&b \\end{alignedat}", @(MTParseErrorInvalidCommand)],     // negative (leading '-' fails digit check)
-              @[@"\\begin{alignedat}{} a&b \\end{alignedat}", @(MTParseErrorInvalidCommand)],       // empty braces
-              @[@"\\begin{alignedat}{2} a&b&c \\end{alignedat}", @(MTParseErrorInvalidNumColumns)], // 3 cols != 2n
-              @[@"\\begin{array} a \\end{array}", @(MTParseErrorMissingColumnSpec)],
-              @[@"\\begin{array}{} a \\end{array}", @(MTParseErrorInvalidColumnSpec)],
-              @[@"\\begin{array}{p} a \\end{array}", @(MTParseErrorInvalidColumnSpec)],
-              @[@"\\begin{array}{c} a & b \\end{array}", @(MTParseErrorInvalidNumColumns)],
-              @[@"\\begin{array}{c} a", @(MTParseErrorMissingEnd)],
-              @[@"\\hline a", @(MTParseErrorInvalidCommand)],
-              @[@"\\begin{matrix} \\hline a \\end{matrix}", @(MTParseErrorInvalidCommand)],
-              ];
-};
-
-- (void) testErrors
-{
-        NSArray* data = getTestDataParseErrors();
-        for (NSArray* testCase in data) {
-            NSString* str = testCase[0];
-            NSError* error = nil;
-            MTMathList* list = [MTMathListBuilder buildFromString:str error:&error];
-            NSString* desc = [NSString stringWithFormat:@"Error for string:%@", str];
-            XCTAssertNil(list, @"%@", desc);
-            XCTAssertNotNil(error, @"%@", desc);
-            XCTAssertEqual(error.domain, MTParseError, @"%@", desc);
-            NSNumber* num = testCase[1];
-            NSInteger code = [num integerValue];
-            XCTAssertEqual(error.code, code, @"%@", desc);
-        }
-}
-
 // REN-5: characters TeX silently discards (whitespace catcode 10/5 and NUL
 // catcode 9) must continue to parse without error. Guards against the error
 // path swallowing legitimate whitespace.
@@ -1969,32 +1767,6 @@ static NSArray* getTestDataParseErrors() {
     XCTAssertEqualObjects(latex, @"\\sum \\nolimits ", @"%@", desc);
 }
 
-static NSArray* getTestDataLargeDelimiters() {
-    // Each entry: [latex, expected class, expected size, expected nucleus, expected serialized latex?]
-    return @[
-        @[ @"\\big(",     @(kMTMathAtomOrdinary), @(kMTDelimiterSize1), @"(" ],
-        @[ @"\\Big(",     @(kMTMathAtomOrdinary), @(kMTDelimiterSize2), @"(" ],
-        @[ @"\\bigg(",    @(kMTMathAtomOrdinary), @(kMTDelimiterSize3), @"(" ],
-        @[ @"\\Bigg(",    @(kMTMathAtomOrdinary), @(kMTDelimiterSize4), @"(" ],
-        @[ @"\\bigl(",    @(kMTMathAtomOpen),     @(kMTDelimiterSize1), @"(" ],
-        @[ @"\\Bigl[",    @(kMTMathAtomOpen),     @(kMTDelimiterSize2), @"[" ],
-        @[ @"\\biggl\\{", @(kMTMathAtomOpen),     @(kMTDelimiterSize3), @"{" ],
-        @[ @"\\Biggl\\lceil", @(kMTMathAtomOpen), @(kMTDelimiterSize4), @"\u2308" ],
-        @[ @"\\bigr)",    @(kMTMathAtomClose),    @(kMTDelimiterSize1), @")" ],
-        @[ @"\\Bigr]",    @(kMTMathAtomClose),    @(kMTDelimiterSize2), @"]" ],
-        @[ @"\\biggr\\}", @(kMTMathAtomClose),    @(kMTDelimiterSize3), @"}" ],
-        @[ @"\\Biggr\\rfloor", @(kMTMathAtomClose),@(kMTDelimiterSize4), @"\u230B" ],
-        @[ @"\\bigm|",    @(kMTMathAtomRelation), @(kMTDelimiterSize1), @"|" ],
-        @[ @"\\Bigm\\|",  @(kMTMathAtomRelation), @(kMTDelimiterSize2), @"\u2016" ],
-        @[ @"\\biggm\\Vert", @(kMTMathAtomRelation),@(kMTDelimiterSize3), @"\u2016", @"\\biggm\\|" ],
-        @[ @"\\Biggm\\langle", @(kMTMathAtomRelation),@(kMTDelimiterSize4), @"\u27E8", @"\\Biggm<" ],
-        // Null delimiter.
-        @[ @"\\bigl.",    @(kMTMathAtomOpen),     @(kMTDelimiterSize1), @"" ],
-        @[ @"\\bigr.",    @(kMTMathAtomClose),    @(kMTDelimiterSize1), @"" ],
-        @[ @"\\big.",     @(kMTMathAtomOrdinary), @(kMTDelimiterSize1), @"" ],
-    ];
-}
-
 - (void) testLargeDelimiter
 {
     for (NSArray* testCase in getTestDataLargeDelimiters()) {
@@ -3285,11 +3057,11 @@ static NSArray* getTestDataLargeDelimiters() {
     XCTAssertEqualObjects(textcolorAtom.stringValue, colorAtom.stringValue);
 }
 
-- (void)testTextcolorInvalidNamedColorIsParseError
+- (void)testTextcolorUnknownNamedColorIsParseError
 {
-    // \textcolor shares \color's readColor grammar: named colors fail loud.
+    // \textcolor shares \color's readColor grammar: unknown color names fail loud.
     NSError* error = nil;
-    MTMathList* list = [MTMathListBuilder buildFromString:@"\\textcolor{red}{x}" error:&error];
+    MTMathList* list = [MTMathListBuilder buildFromString:@"\\textcolor{reddish}{x}" error:&error];
     XCTAssertNil(list, @"Expected nil list for invalid textcolor color");
     XCTAssertNotNil(error);
     XCTAssertEqual(error.domain, MTParseError);
@@ -3308,17 +3080,46 @@ static NSArray* getTestDataLargeDelimiters() {
     XCTAssertEqualObjects(colorboxAtom.colorString, @"#00ff00");
 }
 
-- (void)testColorInvalidNamedColorIsParseError
+- (void)testColorUnknownNamedColorIsParseError
 {
-    // Named colors like "red" must be a parse error (not a silent no-op).
+    // Unknown color names must be a parse error (not a silent no-op).
     NSError* error = nil;
-    MTMathList* list = [MTMathListBuilder buildFromString:@"\\color{red}x" error:&error];
+    MTMathList* list = [MTMathListBuilder buildFromString:@"\\color{reddish}x" error:&error];
     XCTAssertNil(list, @"Expected nil list for invalid color");
     XCTAssertNotNil(error);
     XCTAssertEqual(error.domain, MTParseError);
     XCTAssertEqual(error.code, MTParseErrorInvalidCommand);
 }
 
+- (void)testColorsAreDecodedWhenParsed
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:@"\\color{#f00}{x}\\colorbox{#44AA99}{y}" error:nil];
+    XCTAssertEqual(list.atoms.count, (NSUInteger)2);
+    XCTAssertEqual([(MTMathColor*) list.atoms[0] rgbaColor], 0xFF0000FFu);
+    XCTAssertEqual([(MTMathColorbox*) list.atoms[1] rgbaColor], 0x44AA99FFu);
+    // Copies keep the decoded color.
+    XCTAssertEqual([(MTMathColor*) [list.atoms[0] copy] rgbaColor], 0xFF0000FFu);
+}
+
+- (void)testNamedColors
+{
+    // xcolor's base colors take their xcolor values, other names their CSS values.
+    NSDictionary<NSString*, NSNumber*>* expected = @{
+        @"red" : @0xFF0000FF, @"green" : @0x00FF00FF, @"orange" : @0xFF8000FF, @"darkgray" : @0x404040FF,
+        @"RoyalBlue" : @0x4169E1FF, @"rebeccapurple" : @0x663399FF, @"navy" : @0x000080FF,
+    };
+    for (NSString* name in expected) {
+        NSString* latex = [NSString stringWithFormat:@"\\color{%@}{x}", name];
+        NSError* error = nil;
+        MTMathList* list = [MTMathListBuilder buildFromString:latex error:&error];
+        XCTAssertNil(error, @"%@", name);
+        MTMathColor* color = (MTMathColor*) list.atoms.firstObject;
+        XCTAssertEqual(color.rgbaColor, expected[name].unsignedIntValue, @"%@", name);
+        // The original spelling round-trips.
+        XCTAssertEqualObjects(color.stringValue, latex);
+    }
+}
+
 - (void)testColorInvalidMissingHashIsParseError
 {
     // "ff0000" without leading # must be a parse error (silent failure bug).
@@ -3351,10 +3152,10 @@ static NSArray* getTestDataLargeDelimiters() {
     XCTAssertEqual(error.code, MTParseErrorInvalidCommand);
 }
 
-- (void)testColorboxInvalidNamedColorIsParseError
+- (void)testColorboxUnknownNamedColorIsParseError
 {
     NSError* error = nil;
-    MTMathList* list = [MTMathListBuilder buildFromString:@"\\colorbox{red}x" error:&error];
+    MTMathList* list = [MTMathListBuilder buildFromString:@"\\colorbox{notacolor}x" error:&error];
     XCTAssertNil(list, @"Expected nil list for invalid colorbox color");
     XCTAssertNotNil(error);
     XCTAssertEqual(error.domain, MTParseError);
@@ -0,0 +1,423 @@
+//
+//  MTMathListBuilderTestData.h
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import "MTMathList.h"
+#import "MTMathListBuilder.h"
+
+// The inputs of MTMathListBuilderTest, shared with the tests that run over all of them.
+
+static inline NSArray* getTestData() {
+    return @[
+             @[ @"x", @[ @(kMTMathAtomVariable) ] , @"x"],
+             @[ @"1", @[ @(kMTMathAtomNumber) ] , @"1"],
+             @[ @"*", @[ @(kMTMathAtomBinaryOperator) ] ,@"*"],
+             @[ @"+", @[ @(kMTMathAtomBinaryOperator) ], @"+"],
+             @[ @".", @[ @(kMTMathAtomNumber) ], @"." ],
+             @[ @"(", @[ @(kMTMathAtomOpen) ], @"(" ],
+             @[ @")", @[ @(kMTMathAtomClose) ], @")" ],
+             @[ @",", @[ @(kMTMathAtomPunctuation)], @"," ],
+             @[ @"!", @[ @(kMTMathAtomClose)], @"!" ],
+             @[ @"=", @[ @(kMTMathAtomRelation)], @"=" ],
+             @[ @"x+2", @[ @(kMTMathAtomVariable), @(kMTMathAtomBinaryOperator), @(kMTMathAtomNumber) ], @"x+2"],
+             // spaces are ignored
+             @[ @"(2.3 * 8)", @[ @(kMTMathAtomOpen), @(kMTMathAtomNumber), @(kMTMathAtomNumber), @(kMTMathAtomNumber), @(kMTMathAtomBinaryOperator), @(kMTMathAtomNumber) , @(kMTMathAtomClose) ], @"(2.3*8)"],
+             // braces create an Ord group (MTMathGroup)
+             @[ @"5{3+4}", @[@(kMTMathAtomNumber), @(kMTMathAtomOrdGroup)], @"5{3+4}"],
+             // commands
+             @[ @"\\pi+\\theta\\geq 3",@[ @(kMTMathAtomVariable), @(kMTMathAtomBinaryOperator), @(kMTMathAtomVariable), @(kMTMathAtomRelation), @(kMTMathAtomNumber)], @"\\pi +\\theta \\geq 3"],
+             // aliases
+             @[ @"\\pi\\ne 5 \\land 3", @[ @(kMTMathAtomVariable), @(kMTMathAtomRelation), @(kMTMathAtomNumber), @(kMTMathAtomBinaryOperator), @(kMTMathAtomNumber)], @"\\pi \\neq 5\\wedge 3"],
+             // control space
+             @[ @"x \\ y", @[  @(kMTMathAtomVariable), @(kMTMathAtomOrdinary), @(kMTMathAtomVariable)], @"x\\  y"],
+             // spacing
+             @[ @"x \\quad y \\; z \\! q", @[  @(kMTMathAtomVariable), @(kMTMathAtomSpace), @(kMTMathAtomVariable),@(kMTMathAtomSpace), @(kMTMathAtomVariable),@(kMTMathAtomSpace), @(kMTMathAtomVariable)], @"x\\quad y\\; z\\! q"],
+             // tilde is a non-breaking space (renders as an ordinary space, same as a literal space)
+             @[ @"x~y", @[  @(kMTMathAtomVariable), @(kMTMathAtomOrdinary), @(kMTMathAtomVariable)], @"x\\  y"],
+             ];
+}
+
+static inline NSArray* getTestDataSuperScript() {
+    return @[
+             @[ @"x^2", @[ @(kMTMathAtomVariable) ],  @[ @(kMTMathAtomNumber) ], @"x^{2}"],
+             @[ @"x^23", @[ @(kMTMathAtomVariable), @(kMTMathAtomNumber) ],  @[ @(kMTMathAtomNumber) ], @"x^{2}3"],
+             @[ @"x^{23}", @[ @(kMTMathAtomVariable) ],  @[ @(kMTMathAtomNumber), @(kMTMathAtomNumber) ], @"x^{23}"],
+             @[ @"x^2^3", @[ @(kMTMathAtomVariable), @(kMTMathAtomOrdinary) ],  @[ @(kMTMathAtomNumber) ], @"x^{2}{}^{3}" ],
+             @[ @"x^{2^3}", @[ @(kMTMathAtomVariable) ], @[ @(kMTMathAtomNumber)], @[ @(kMTMathAtomNumber),], @"x^{2^{3}}"],
+             @[ @"x^{^2*}", @[ @(kMTMathAtomVariable) ], @[ @(kMTMathAtomOrdinary), @(kMTMathAtomBinaryOperator)], @[ @(kMTMathAtomNumber),], @"x^{{}^{2}*}"],
+             @[ @"^2", @ [ @(kMTMathAtomOrdinary)], @[ @(kMTMathAtomNumber) ], @"{}^{2}"],
+             @[ @"{}^2", @ [ @(kMTMathAtomOrdGroup)], @[ @(kMTMathAtomNumber) ], @"{}^{2}"],
+             @[ @"x^^2", @[ @(kMTMathAtomVariable), @(kMTMathAtomOrdinary) ],  @[ ], @"x^{}{}^{2}"],
+             @[ @"5{x}^2", @ [ @(kMTMathAtomNumber), @(kMTMathAtomOrdGroup)], @[ ], @"5{x}^{2}"],
+             ];
+}
+
+static inline NSArray* getTestDataSubScript() {
+    return @[
+             @[ @"x_2", @[ @(kMTMathAtomVariable) ],  @[ @(kMTMathAtomNumber) ], @"x_{2}" ],
+             @[ @"x_23", @[ @(kMTMathAtomVariable), @(kMTMathAtomNumber) ],  @[ @(kMTMathAtomNumber) ], @"x_{2}3"],
+             @[ @"x_{23}", @[ @(kMTMathAtomVariable) ],  @[ @(kMTMathAtomNumber), @(kMTMathAtomNumber) ], @"x_{23}"],
+             @[ @"x_2_3", @[ @(kMTMathAtomVariable) , @(kMTMathAtomOrdinary)],  @[ @(kMTMathAtomNumber) ], @"x_{2}{}_{3}" ],
+             @[ @"x_{2_3}", @[ @(kMTMathAtomVariable) ], @[ @(kMTMathAtomNumber)], @[ @(kMTMathAtomNumber),], @"x_{2_{3}}"],
+             @[ @"x_{_2*}", @[ @(kMTMathAtomVariable) ], @[ @(kMTMathAtomOrdinary), @(kMTMathAtomBinaryOperator)], @[ @(kMTMathAtomNumber),], @"x_{{}_{2}*}"],
+             @[ @"_2", @ [ @(kMTMathAtomOrdinary)], @[ @(kMTMathAtomNumber) ], @"{}_{2}" ],
+             @[ @"{}_2", @ [ @(kMTMathAtomOrdGroup)], @[ @(kMTMathAtomNumber) ], @"{}_{2}" ],
+             @[ @"x__2", @[ @(kMTMathAtomVariable), @(kMTMathAtomOrdinary) ],  @[ ], @"x_{}{}_{2}"],
+             @[ @"5{x}_2", @ [ @(kMTMathAtomNumber), @(kMTMathAtomOrdGroup)], @[ ], @"5{x}_{2}"],
+             ];
+}
+
+static inline NSArray* getTestDataSuperSubScript() {
+    return @[
+             @[ @"x_2^*", @[ @(kMTMathAtomVariable) ],  @[ @(kMTMathAtomNumber) ], @[ @(kMTMathAtomBinaryOperator) ], @"x^{*}_{2}" ],
+             @[ @"x^*_2", @[ @(kMTMathAtomVariable) ],  @[ @(kMTMathAtomNumber) ], @[ @(kMTMathAtomBinaryOperator) ], @"x^{*}_{2}" ],
+             @[ @"x_^*", @[ @(kMTMathAtomVariable) ],  @[ ], @[ @(kMTMathAtomBinaryOperator) ], @"x^{*}_{}" ],
+             @[ @"x^_2", @[ @(kMTMathAtomVariable) ],  @[ @(kMTMathAtomNumber)], @[ ], @"x^{}_{2}"],
+             @[ @"x_{2^*}", @[ @(kMTMathAtomVariable) ],  @[ @(kMTMathAtomNumber)], @[ ], @"x_{2^{*}}"],
+             @[ @"x^{*_2}", @[ @(kMTMathAtomVariable) ], @[ ], @[ @(kMTMathAtomBinaryOperator),], @"x^{*_{2}}"],
+             @[ @"_2^*", @ [ @(kMTMathAtomOrdinary)], @[ @(kMTMathAtomNumber) ], @[ @(kMTMathAtomBinaryOperator) ], @"{}^{*}_{2}"],
+             ];
+}
+
+static inline NSArray* getTestDataLeftRight() {
+    return @[
+             @[@"\\left( 2 \\right)", @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomNumber)], @"(", @")", @"\\left( 2\\right) "],
+             // spacing
+             @[@"\\left ( 2 \\right )", @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomNumber)], @"(", @")", @"\\left( 2\\right) "],
+             // commands
+             @[@"\\left\\{ 2 \\right\\}", @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomNumber)], @"{", @"}", @"\\left\\{ 2\\right\\} "],
+             // complex commands
+             @[@"\\left\\langle x \\right\\rangle", @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomVariable)], @"\u27E8", @"\u27E9", @"\\left< x\\right> "],
+             // bars
+             @[@"\\left| x \\right\\|", @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomVariable)], @"|", @"\u2016", @"\\left| x\\right\\| "],
+             // inner in between
+             @[@"5 + \\left( 2 \\right) - 2", @[ @(kMTMathAtomNumber), @(kMTMathAtomBinaryOperator), @(kMTMathAtomInner), @(kMTMathAtomBinaryOperator), @(kMTMathAtomNumber) ], @2, @[ @(kMTMathAtomNumber)], @"(", @")", @"5+\\left( 2\\right) -2"],
+             // long inner
+             @[@"\\left( 2 + \\frac12\\right)", @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomNumber), @(kMTMathAtomBinaryOperator), @(kMTMathAtomFraction)], @"(", @")", @"\\left( 2+\\frac{1}{2}\\right) "],
+             // nested
+             @[@"\\left[ 2 + \\left|\\frac{-x}{2}\\right| \\right]", @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomNumber), @(kMTMathAtomBinaryOperator), @(kMTMathAtomInner)], @"[", @"]", @"\\left[ 2+\\left| \\frac{-x}{2}\\right| \\right] "],
+             // With scripts
+             @[@"\\left( 2 \\right)^2", @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomNumber)], @"(", @")", @"\\left( 2\\right) ^{2}"],
+             // Scripts on left
+             @[@"\\left(^2 \\right )", @[ @(kMTMathAtomInner)], @0, @[ @(kMTMathAtomOrdinary)], @"(", @")", @"\\left( {}^{2}\\right) "],
+             // Dot
+             @[@"\\left( 2 \\right.", @[ @(kMTMathAtomInner)], @0, @[ @(kMTMathAtomNumber)], @"(", @"", @"\\left( 2\\right. "],
+             // Double arrows (REN-1): Uparrow/Downarrow nuclei must be the actual Unicode glyphs, not the literal strings "21D1"/"21D3"
+             @[@"\\left\\Uparrow x \\right\\Downarrow",
+               @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomVariable)],
+               @"\u21D1", @"\u21D3",
+               @"\\left\\Uparrow x\\right\\Downarrow "],
+             // Updownarrow (REN-1): nucleus must be the Unicode glyph U+21D5, not the literal string "21D5"
+             @[@"\\left\\Updownarrow x \\right\\Updownarrow",
+               @[ @(kMTMathAtomInner) ], @0, @[ @(kMTMathAtomVariable)],
+               @"\u21D5", @"\u21D5",
+               @"\\left\\Updownarrow x\\right\\Updownarrow "],
+        ];
+}
+
+static inline NSArray* getTestDataParseErrors() {
+    return @[
+              @[@"}a", @(MTParseErrorMismatchBraces)],
+              @[@"\\notacommand", @(MTParseErrorInvalidCommand)],
+              @[@"\\sqrt[5+3", @(MTParseErrorCharacterNotFound)],
+              @[@"\\smash[t", @(MTParseErrorCharacterNotFound)], // missing ] on smash optional arg
+              @[@"{5+3", @(MTParseErrorMismatchBraces)],
+              @[@"5+3}", @(MTParseErrorMismatchBraces)],
+              @[@"{1+\\frac{3+2", @(MTParseErrorMismatchBraces)],
+              @[@"1+\\left", @(MTParseErrorMissingDelimiter)],
+              @[@"\\left(\\frac12\\right", @(MTParseErrorMissingDelimiter)],
+              @[@"\\left 5 + 3 \\right)", @(MTParseErrorInvalidDelimiter)],
+              @[@"\\left(\\frac12\\right + 3", @(MTParseErrorInvalidDelimiter)],
+              @[@"\\left\\lmoustache 5 + 3 \\right)", @(MTParseErrorInvalidDelimiter)],
+              @[@"\\left(\\frac12\\right\\rmoustache + 3", @(MTParseErrorInvalidDelimiter)],
+              @[@"5 + 3 \\right)", @(MTParseErrorMissingLeft)],
+              @[@"\\left(\\frac12", @(MTParseErrorMissingRight)],
+              @[@"\\left(5 + \\left| \\frac12 \\right)", @(MTParseErrorMissingRight)],
+              @[@"5+ \\left|\\frac12\\right| \\right)", @(MTParseErrorMissingLeft)],
+              @[@"\\begin matrix \\end matrix", @(MTParseErrorCharacterNotFound)], // missing {
+              @[@"\\begin", @(MTParseErrorCharacterNotFound)], // missing {
+              @[@"\\begin{", @(MTParseErrorCharacterNotFound)], // missing }
+              @[@"\\begin{matrix parens}", @(MTParseErrorCharacterNotFound)], // missing } (no spaces in env)
+              @[@"\\begin{matrix} x", @(MTParseErrorMissingEnd)],
+              @[@"\\begin{matrix} x \\end", @(MTParseErrorCharacterNotFound)], // missing {
+              @[@"\\begin{matrix} x \\end + 3", @(MTParseErrorCharacterNotFound)], // missing {
+              @[@"\\begin{matrix} x \\end{", @(MTParseErrorCharacterNotFound)], // missing }
+              @[@"\\begin{matrix} x \\end{matrix + 3", @(MTParseErrorCharacterNotFound)], // missing }
+              @[@"\\begin{matrix} x \\end{pmatrix}", @(MTParseErrorInvalidEnv)],
+              @[@"x \\end{matrix}", @(MTParseErrorMissingBegin)],
+              @[@"\\begin{notanenv} x \\end{notanenv}", @(MTParseErrorInvalidEnv)],
+              @[@"\\begin{matrix} \\notacommand \\end{matrix}", @(MTParseErrorInvalidCommand)],
+              @[@"\\begin{displaylines} x & y \\end{displaylines}", @(MTParseErrorInvalidNumColumns)],
+              @[@"\\begin{eqalign} x \\end{eqalign}", @(MTParseErrorInvalidNumColumns)],
+              @[@"\\begin{gathered} x & y \\end{gathered}", @(MTParseErrorInvalidNumColumns)],
+              @[@"\\nolimits", @(MTParseErrorInvalidLimits)],
+              @[@"\\frac\\limits{1}{2}", @(MTParseErrorInvalidLimits)],
+              // REN-6: generalized-fraction commands are illegal in one-char script slots
+              @[@"x^\\over y",   @(MTParseErrorInvalidCommand)],
+              @[@"x_\\over y",   @(MTParseErrorInvalidCommand)],
+              @[@"x^\\atop y",   @(MTParseErrorInvalidCommand)],
+              @[@"x^\\choose y", @(MTParseErrorInvalidCommand)],
+              @[@"x^\\brack y",  @(MTParseErrorInvalidCommand)],
+              @[@"x^\\brace y",  @(MTParseErrorInvalidCommand)],
+              // REN-5: non-ASCII literal characters should produce MTParseErrorInvalidCharacter
+              @[@"π", @(MTParseErrorInvalidCharacter)],          // π (U+03C0)
+              @[@"3 × 4", @(MTParseErrorInvalidCharacter)],      // 3 × 4
+              @[@"x ≤ y", @(MTParseErrorInvalidCharacter)],      // x ≤ y
+              @[@"x 𝑎 y", @(MTParseErrorInvalidCharacter)],      // above-BMP literal (U+1D44E, surrogate pair)
+              // Special characters with no meaning in math mode are errors (match LaTeX:
+              // % is a comment, # is a macro parameter, $ toggles math mode - none valid here).
+              @[@"a % b", @(MTParseErrorInvalidCharacter)],
+              @[@"a # b", @(MTParseErrorInvalidCharacter)],
+              @[@"a $ b", @(MTParseErrorInvalidCharacter)],
+              // Item 4: spacing dimension parse errors
+              @[@"\\kern", @(MTParseErrorInvalidCommand)],          // missing distance at EOF
+              @[@"\\kernabc", @(MTParseErrorInvalidCommand)],       // no number/unit
+              @[@"\\hspace{abc}", @(MTParseErrorInvalidCommand)],   // no number/unit
+              @[@"\\hspace{}", @(MTParseErrorInvalidCommand)],      // empty
+              @[@"\\mkern{1em}", @(MTParseErrorInvalidCommand)],    // mu required for \mkern
+              @[@"\\kern1pt", @(MTParseErrorInvalidCommand)],      // valid number, unsupported unit
+              @[@"\\kern1xx", @(MTParseErrorInvalidCommand)],      // valid number, unknown unit
+              @[@"\\begin{alignedat} x & y \\end{alignedat}", @(MTParseErrorInvalidCommand)],  // missing {n}
+              @[@"\\begin{alignedat}{x} a&b \\end{alignedat}", @(MTParseErrorInvalidCommand)],      // non-numeric
+              @[@"\\begin{alignedat}{0} a&b \\end{alignedat}", @(MTParseErrorInvalidCommand)],      // n < 1
+              @[@"\\begin{alignedat}{-1} a&b \\end{alignedat}", @(MTParseErrorInvalidCommand)],     // negative (leading '-' fails digit check)
+              @[@"\\begin{alignedat}{} a&b \\end{alignedat}", @(MTParseErrorInvalidCommand)],       // empty braces
+              @[@"\\begin{alignedat}{2} a&b&c \\end{alignedat}", @(MTParseErrorInvalidNumColumns)], // 3 cols != 2n
+              @[@"\\begin{array} a \\end{array}", @(MTParseErrorMissingColumnSpec)],
+              @[@"\\begin{array}{} a \\end{array}", @(MTParseErrorInvalidColumnSpec)],
+              @[@"\\begin{array}{p} a \\end{array}", @(MTParseErrorInvalidColumnSpec)],
+              @[@"\\begin{array}{c} a & b \\end{array}", @(MTParseErrorInvalidNumColumns)],
+              @[@"\\begin{array}{c} a", @(MTParseErrorMissingEnd)],
+              @[@"\\hline a", @(MTParseErrorInvalidCommand)],
+              @[@"\\begin{matrix} \\hline a \\end{matrix}", @(MTParseErrorInvalidCommand)],
+              ];
+};
+
+- (void) testErrors
+{
+        NSArray* data = getTestDataParseErrors();
+        for (NSArray* testCase in data) {
+            NSString* str = testCase[0];
+            NSError* error = nil;
+            MTMathList* list = [MTMathListBuilder buildFromString:str error:&error];
+            NSString* desc = [NSString stringWithFormat:@"Error for string:%@", str];
+            XCTAssertNil(list, @"%@", desc);
+            XCTAssertNotNil(error, @"%@", desc);
+            XCTAssertEqual(error.domain, MTParseError, @"%@", desc);
+            NSNumber* num = testCase[1];
+            NSInteger code = [num integerValue];
+            XCTAssertEqual(error.code, code, @"%@", desc);
+        }
+}
+
+static inline NSArray* getTestDataLargeDelimiters() {
+    // Each entry: [latex, expected class, expected size, expected nucleus, expected serialized latex?]
+    return @[
+        @[ @"\\big(",     @(kMTMathAtomOrdinary), @(kMTDelimiterSize1), @"(" ],
+        @[ @"\\Big(",     @(kMTMathAtomOrdinary), @(kMTDelimiterSize2), @"(" ],
+        @[ @"\\bigg(",    @(kMTMathAtomOrdinary), @(kMTDelimiterSize3), @"(" ],
+        @[ @"\\Bigg(",    @(kMTMathAtomOrdinary), @(kMTDelimiterSize4), @"(" ],
+        @[ @"\\bigl(",    @(kMTMathAtomOpen),     @(kMTDelimiterSize1), @"(" ],
+        @[ @"\\Bigl[",    @(kMTMathAtomOpen),     @(kMTDelimiterSize2), @"[" ],
+        @[ @"\\biggl\\{", @(kMTMathAtomOpen),     @(kMTDelimiterSize3), @"{" ],
+        @[ @"\\Biggl\\lceil", @(kMTMathAtomOpen), @(kMTDelimiterSize4), @"\u2308" ],
+        @[ @"\\bigr)",    @(kMTMathAtomClose),    @(kMTDelimiterSize1), @")" ],
+        @[ @"\\Bigr]",    @(kMTMathAtomClose),    @(kMTDelimiterSize2), @"]" ],
+        @[ @"\\biggr\\}", @(kMTMathAtomClose),    @(kMTDelimiterSize3), @"}" ],
+        @[ @"\\Biggr\\rfloor", @(kMTMathAtomClose),@(kMTDelimiterSize4), @"\u230B" ],
+        @[ @"\\bigm|",    @(kMTMathAtomRelation), @(kMTDelimiterSize1), @"|" ],
+        @[ @"\\Bigm\\|",  @(kMTMathAtomRelation), @(kMTDelimiterSize2), @"\u2016" ],
+        @[ @"\\biggm\\Vert", @(kMTMathAtomRelation),@(kMTDelimiterSize3), @"\u2016", @"\\biggm\\|" ],
+        @[ @"\\Biggm\\langle", @(kMTMathAtomRelation),@(kMTDelimiterSize4), @"\u27E8", @"\\Biggm<" ],
+        // Null delimiter.
+        @[ @"\\bigl.",    @(kMTMathAtomOpen),     @(kMTDelimiterSize1), @"" ],
+        @[ @"\\bigr.",    @(kMTMathAtomClose),    @(kMTDelimiterSize1), @"" ],
+        @[ @"\\big.",     @(kMTMathAtomOrdinary), @(kMTDelimiterSize1), @"" ],
+    ];
+}
+
+// The inputs of the tests of MTMathListBuilderTest that are not in one of the tables above.
+static inline NSArray<NSString*>* MTBuilderTestFormulas(void)
+{
+    return @[
+        @"5\\times3^{2\\div2}",
+        @"\\frac1c",
+        @"\\frac1\\frac23",
+        @"\\sqrt2",
+        @"\\sqrt",
+        @"{\\sqrt}",
+        @"\\sqrt\\sqrt2",
+        @"\\sqrt[3]2",
+        @"1 \\over c",
+        @"5 + {1 \\over c} + 8",
+        @"1 \\atop c",
+        @"5 + {1 \\atop c} + 8",
+        @"n \\choose k",
+        @"n \\brack k",
+        @"n \\brace k",
+        @"\\binom{n}{k}",
+        @"a",
+        @"b",
+        @"n",
+        @"k",
+        @"\\dfrac1c",
+        @"\\tfrac1c",
+        @"\\dbinom{n}{k}",
+        @"\\tbinom{n}{k}",
+        @"\\cfrac{a}{b}",
+        @"\\cfrac[l]{a}{b}",
+        @"\\cfrac[r]{a}{b}",
+        @"\\cfrac[c]{a}{b}",
+        @"\\cfrac[zzz]{a}{b}",
+        @"\\dfrac{1}{x+\\dfrac{1}{y}}",
+        @"\\iint\\limits_a^b",
+        @"\\int",
+        @"\\overline 2",
+        @"\\underline 2",
+        @"\\bar x",
+        @"\\!",
+        @"\\textstyle y \\scriptstyle x",
+        @"\\begin{matrix} x & y \\\\ z & w \\end{matrix}",
+        @"\\begin{smallmatrix} x & y \\\\ z & w \\end{smallmatrix}",
+        @"\\begin{pmatrix} x & y \\\\ z & w \\end{pmatrix}",
+        @"x \\\\ y",
+        @"x & y \\\\ z & w",
+        @"\\begin{gathered} x \\\\ y \\end{gathered}",
+        @"\\begin{alignedat}{2} 10&x +& 3&y \\\\ 3&x +& 13&y \\end{alignedat}",
+        @"\\begin{alignedat}{1} x&y \\end{alignedat}",
+        @"\\begin{alignedat}{2} x&&z&w \\end{alignedat}",
+        @"\\left( \\begin{alignedat}{1} x&y \\end{alignedat} \\right)",
+        @"\\begin{alignedat}{ 2 } 10&x +& 3&y \\end{alignedat}",
+        @"x^{1 \\over y}",
+        @"\\lcm(a,b)",
+        @"\\mathbf x",
+        @"\\cal xy",
+        @"\\frak{xy}",
+        @"\\sqrt \\mathrm x y",
+        @"\\text{x y}",
+        @"\\int\\limits",
+        @"\\sum",
+        @"\\sum\\nolimits",
+        @"\\bigl(^2",
+        @"a \\big( b",
+        @"\\overfoo{x}",
+        @"f^2'",
+        @"f^{2'}",
+        @"\\triangle",
+        @"\\bigtriangleup",
+        @"\\diamond",
+        @"\\diamondsuit",
+        @"\\stackrel{\\frown}{AD}",
+        @"\\restriction",
+        @"a\\restriction b",
+        @"\\square",
+        @"\\Box",
+        @"\\text{}",
+        @"\\text{abc}",
+        @"\\textbf abc",
+        @"\\textit\\%",
+        @"\\text 你",
+        @"\\text{你好}",
+        @"\\text{Привет}",
+        @"\\textbf{Привет}",
+        @"\\textit{Привет}",
+        @"\\text{नमस्ते}",
+        @"\\text{שלום}",
+        @"\\text{مرحبا}",
+        @"\\text{Hello 你好 שלום}",
+        @"\\textbf{a b}",
+        @"\\text{hello\\ world}",
+        @"\\textbf{hello\\ world}",
+        @"\\text{a {b} c}",
+        @"\\text{{{x}}}",
+        @"\\textbf{abc}^2",
+        @"\\textbf{abc}_i^{n+1}",
+        @"\\textbf{你好}^{2}",
+        @"\\text{50\\% \\$5}",
+        @"\\textbf",
+        @"\\text{abc",
+        @"\\text{a{b}",
+        @"\\textbf{\\textit{x}}",
+        @"\\text{$x$}",
+        @"\\text{a\\foo b}",
+        @"Привет",
+        @"\\underset{b}{\\overset{a}{X}}",
+        @"\\color{#ff0000}x",
+        @"\\color{#f00}x",
+        @"\\textcolor{#FF0000}{x}",
+        @"\\color{#FF0000}{x}",
+        @"\\textcolor{red}{x}",
+        @"\\colorbox{#00ff00}x",
+        @"\\color{red}x",
+        @"\\color{ff0000}x",
+        @"\\color{#gg0000}x",
+        @"\\color{#ff00}x",
+        @"\\colorbox{red}x",
+        @"\\color{#ff 00}x",
+        @"\\color{#ff00é}x",
+        @"\\langle x \\rangle",
+        @"\\left< x \\right>",
+        @"\\kern-1em",
+        @"\\kern{.5em}",
+        @"\\mkern3mu",
+        @"\\hspace{ -.2em }",
+        @"\\hspace*{1em}",
+        @"\\hspace *{1em}",
+        @"\\hskip 1em",
+        @"\\mskip 4mu",
+        @"\\mspace{4mu}",
+        @"\\mkern 3mu plus 1mu",
+        @"\\phantom{x}",
+        @"\\phantom x",
+        @"\\hphantom{x}",
+        @"\\vphantom{x}",
+        @"\\mathstrut",
+        @"\\smash{x}",
+        @"\\smash[t]{x}",
+        @"\\smash[b]{x}",
+        @"\\smash[q]{x}",
+        @"\\cancel{x+y}",
+        @"\\cancel{\\frac{a}{b}}",
+        @"\\cancel x",
+        @"\\cancel",
+        @"\\phantom",
+        @"\\phantom{\\alpha}",
+        @"\\cancel{\\alpha}",
+        @"\\cancel{x}^2",
+        @"\\cancel{x",
+        @"x{\\scriptstyle y}z",
+        @"{x}^2",
+        @"{a+b}c",
+        @"{{x}}",
+        @"{}",
+        @"x^{\\scriptstyle y}z",
+        @"{{a \\over b}c}",
+        @"{{a \\over b}\\scriptstyle c}z",
+        @"{a \\over b}^2",
+        @"\\begin{array}{rcl} a & b & c \\end{array}",
+        @"\\begin{array}{||c||c|} a & b \\end{array}",
+        @"\\begin{array}{c | c} a & b \\end{array}",
+        @"\\begin{array}{||} a \\end{array}",
+        @"\\begin{array}{c} \\hline a \\\\ \\hline b \\\\ \\hline \\end{array}",
+        @"\\begin{array}{|r|c|l|} 10 & = & 7 + 3 \\end{array}",
+        @"\\begin{array}{|c|} \\hline a \\\\ b \\end{array}"
+    ];
+}
+
+// Every input of MTMathListBuilderTest, including the ones that do not parse.
+static inline NSArray<NSString*>* MTBuilderTestInputs(void)
+{
+    NSMutableArray<NSString*>* inputs = [NSMutableArray array];
+    for (NSArray* table in @[ getTestData(), getTestDataSuperScript(), getTestDataSubScript(), getTestDataSuperSubScript(),
+                              getTestDataLeftRight(), getTestDataParseErrors(), getTestDataLargeDelimiters() ]) {
+        for (NSArray* testCase in table) {
+            [inputs addObject:testCase[0]];
+        }
+    }
+    [inputs addObjectsFromArray:MTBuilderTestFormulas()];
+    return inputs;
+}
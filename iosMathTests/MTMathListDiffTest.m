@@ -0,0 +1,123 @@
+//
+//  MTMathListDiffTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTMathListDiff.h"
+#import "MTMathListBuilder.h"
+#import "MTPersistentMathList.h"
+
+@interface MTMathListDiffTest : XCTestCase
+
+@end
+
+@implementation MTMathListDiffTest
+
+- (NSArray<MTMathListChange*>*) changesFrom:(NSString*) from to:(NSString*) to
+{
+    MTMathList* fromList = [MTMathListBuilder buildFromString:from];
+    MTMathList* toList = [MTMathListBuilder buildFromString:to];
+    XCTAssertNotNil(fromList, @"%@", from);
+    XCTAssertNotNil(toList, @"%@", to);
+    NSArray<MTMathListChange*>* changes = [MTMathListDiff changesFromMathList:fromList toMathList:toList];
+    // Applying the changes gives the new list.
+    MTPersistentMathList* applied = [[[MTPersistentMathList alloc] initWithMathList:fromList] listByApplyingChanges:changes];
+    XCTAssertNotNil(applied, @"%@ -> %@", from, to);
+    XCTAssertEqualObjects([MTMathListBuilder mathListToString:applied.mathList], [MTMathListBuilder mathListToString:toList],
+                          @"%@ -> %@: %@", from, to, changes);
+    return changes;
+}
+
+- (void)testIdenticalLists
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:@"x^{2}+\\frac{a}{b}"];
+    XCTAssertEqual([MTMathListDiff changesFromMathList:list toMathList:list].count, 0u);
+    XCTAssertEqual([self changesFrom:@"x^{2}+\\frac{a}{b}" to:@"x^{2}+\\frac{a}{b}"].count, 0u);
+    XCTAssertNil([MTMathListDiff changedIndexForChanges:@[]]);
+}
+
+- (void)testChangeInScript
+{
+    NSArray<MTMathListChange*>* changes = [self changesFrom:@"a^{b+c}+x" to:@"a^{b+d}+x"];
+    XCTAssertEqual(changes.count, 1u);
+    XCTAssertEqual(changes[0].type, kMTMathListChangeReplace);
+    XCTAssertEqualObjects(changes[0].index.description, @"[0, 2:[2]]");
+    XCTAssertEqualObjects(changes[0].atom.nucleus, @"d");
+    XCTAssertEqualObjects([MTMathListDiff changedIndexForChanges:changes], changes[0].index);
+}
+
+- (void)testInsertionsAndDeletions
+{
+    NSArray<MTMathListChange*>* inserted = [self changesFrom:@"abcdef" to:@"abXYcdef"];
+    XCTAssertEqual(inserted.count, 2u);
+    for (MTMathListChange* change in inserted) {
+        XCTAssertEqual(change.type, kMTMathListChangeInsert);
+        XCTAssertEqualObjects(change.index.description, @"[2]");
+    }
+    XCTAssertEqualObjects([MTMathListDiff changedIndexForChanges:inserted].description, @"[2]");
+
+    NSArray<MTMathListChange*>* deleted = [self changesFrom:@"abcdef" to:@"abef"];
+    XCTAssertEqual(deleted.count, 2u);
+    XCTAssertEqual(deleted[0].type, kMTMathListChangeDelete);
+    XCTAssertEqualObjects(deleted[0].index.description, @"[3]");
+    XCTAssertEqualObjects(deleted[1].index.description, @"[2]");
+    XCTAssertEqualObjects([MTMathListDiff changedIndexForChanges:deleted].description, @"[2]");
+}
+
+- (void)testChangesApply
+{
+    NSArray<NSArray<NSString*>*>* pairs = @[
+        @[ @"", @"abc" ],
+        @[ @"abc", @"" ],
+        @[ @"\\frac{a}{b}+\\sqrt[3]{x}", @"\\frac{a}{c}+\\sqrt{x}" ],
+        @[ @"x_{1}^{2}", @"x_{1}" ],
+        @[ @"x_{1}^{2}", @"y_{1}^{2}" ],
+        @[ @"\\left(a+b\\right)", @"\\left(a-b\\right)" ],
+        @[ @"\\left(a+b\\right)", @"\\left[a+b\\right]" ],
+        @[ @"\\begin{matrix}a&b\\end{matrix}", @"\\begin{matrix}a&c\\end{matrix}" ],
+        @[ @"\\color{red}{x+y}", @"\\color{blue}{x+y}" ],
+        @[ @"a+b+c+d", @"d+c+b+a" ],
+        @[ @"\\sum_{i=0}^{n} i^{2} = \\frac{n(n+1)(2n+1)}{6}", @"\\sum_{i=1}^{m} i^{3} = \\left(\\frac{m(m+1)}{2}\\right)^{2}" ],
+    ];
+    for (NSArray<NSString*>* pair in pairs) {
+        [self changesFrom:pair[0] to:pair[1]];
+    }
+}
+
+- (void)testListsThatDifferEverywhere
+{
+    // Too different to align, so the atoms are diffed position by position.
+    NSMutableString* from = [NSMutableString string];
+    NSMutableString* to = [NSMutableString string];
+    for (NSUInteger i = 0; i < 300; i++) {
+        [from appendString:@"a"];
+        [to appendString:(i % 2) ? @"b^{2}" : @"b"];
+    }
+    NSArray<MTMathListChange*>* changes = [self changesFrom:from to:to];
+    XCTAssertEqual(changes.count, 300u);
+    XCTAssertNil([MTMathListDiff changedIndexForChanges:changes]);
+}
+
+- (void)testChangedIndex
+{
+    // Both scripts of the first atom.
+    NSArray<MTMathListChange*>* scripts = [self changesFrom:@"x_{1}^{2}+y" to:@"x_{3}^{4}+y"];
+    XCTAssertEqual(scripts.count, 2u);
+    XCTAssertEqualObjects([MTMathListDiff changedIndexForChanges:scripts].description, @"[0]");
+    // Two places in a numerator.
+    NSArray<MTMathListChange*>* numerator = [self changesFrom:@"\\frac{a+b+c}{d}" to:@"\\frac{z+b+w}{d}"];
+    XCTAssertEqual(numerator.count, 2u);
+    XCTAssertEqualObjects([MTMathListDiff changedIndexForChanges:numerator].description, @"[0]");
+    // A replace and an insertion right after it.
+    NSArray<MTMathListChange*>* replaced = [self changesFrom:@"a+b" to:@"a-cb"];
+    XCTAssertEqualObjects([MTMathListDiff changedIndexForChanges:replaced].description, @"[1]");
+    // Two places at the top.
+    XCTAssertNil([MTMathListDiff changedIndexForChanges:[self changesFrom:@"a+b+c" to:@"z+b+w"]]);
+}
+
+@end
@@ -0,0 +1,261 @@
+//
+//  MTMathListFingerprintTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTMathList.h"
+#import "MTMathListBuilder.h"
+#import "MTMathAtomFactory.h"
+#import "MTPersistentMathList.h"
+#import "MTMathListHasher.h"
+#import "MTMathListInternal.h"
+
+// Counts the atoms and lists whose fingerprints are computed rather than taken from their caches.
+@interface MTCountingHasher : MTMathListHasher
+
+@property (nonatomic) NSUInteger count;
+
+@end
+
+@implementation MTCountingHasher
+
+- (uint64_t)hashOfAtom:(MTMathAtom *)atom
+{
+    self.count++;
+    return [super hashOfAtom:atom];
+}
+
+- (uint64_t)hashOfList:(MTMathList *)list
+{
+    self.count++;
+    return [super hashOfList:list];
+}
+
+@end
+
+@interface MTMathListFingerprintTest : XCTestCase
+
+@end
+
+@implementation MTMathListFingerprintTest
+
+- (MTMathList*) listForLaTeX:(NSString*) latex
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:latex];
+    XCTAssertNotNil(list, @"%@", latex);
+    return list;
+}
+
+- (id) atomOfClass:(Class) cls inList:(MTMathList*) list
+{
+    for (MTMathAtom* atom in list.atoms) {
+        if ([atom isKindOfClass:cls]) {
+            return atom;
+        }
+    }
+    XCTFail(@"No %@ in %@", cls, list);
+    return nil;
+}
+
+- (void)testEqualStructures
+{
+    NSString* latex = @"\\sum_{i=0}^{n} \\frac{\\sqrt[3]{x_{i}}}{\\left( y \\right)} + \\color{red}{\\text{if } z}";
+    MTMathList* list = [self listForLaTeX:latex];
+    XCTAssertEqual(list.fingerprint, [self listForLaTeX:latex].fingerprint);
+    XCTAssertEqual(list.fingerprint, [list.copy fingerprint]);
+    XCTAssertEqual(list.fingerprint, [MTMathList mathListWithArchivedData:list.archivedData].fingerprint);
+    XCTAssertEqual([list.atoms[0] fingerprint], [[self listForLaTeX:latex].atoms[0] fingerprint]);
+    XCTAssertNotEqual(list.fingerprint, [MTMathList new].fingerprint);
+}
+
+- (void)testFieldsAreCovered
+{
+    // Each differs from the others in one field.
+    NSArray<NSString*>* formulas = @[
+        @"x", @"y", @"xy", @"yx", @"x+y", @"x-y", @"x^{2}", @"x_{2}", @"x_{2}^{2}", @"x^{3}",
+        @"\\mathbf{x}", @"\\mathrm{x}", @"\\text{x}", @"\\textbf{x}",
+        @"\\frac{a}{b}", @"\\frac{b}{a}", @"{a \\atop b}", @"{a \\choose b}",
+        @"\\sqrt{x}", @"\\sqrt[3]{x}", @"\\sqrt[2]{x}",
+        @"\\left( x \\right)", @"\\left[ x \\right]", @"\\overline{x}", @"\\underline{x}", @"\\hat{x}", @"\\tilde{x}",
+        @"\\color{red}{x}", @"\\color{blue}{x}", @"\\colorbox{red}{x}",
+        @"\\phantom{x}", @"\\hphantom{x}", @"\\rlap{x}", @"\\llap{x}",
+        @"\\overbrace{x}", @"\\underbrace{x}", @"\\overset{a}{x}", @"\\underset{a}{x}",
+        @"\\begin{matrix} a & b \\end{matrix}", @"\\begin{pmatrix} a & b \\end{pmatrix}",
+        @"\\begin{matrix} a \\\\ b \\end{matrix}", @"\\begin{array}{lc} a & b \\end{array}",
+        @"\\begin{array}{cc} a & b \\end{array}", @"\\begin{array}{c|c} a & b \\end{array}",
+        @"\\sum_{i} x", @"\\lim_{x} y", @"\\,x", @"\\;x", @"\\displaystyle x", @"\\textstyle x",
+    ];
+    NSMutableDictionary<NSNumber*, NSString*>* seen = [NSMutableDictionary dictionary];
+    for (NSString* latex in formulas) {
+        NSNumber* fingerprint = @([self listForLaTeX:latex].fingerprint);
+        XCTAssertNil(seen[fingerprint], @"%@ and %@", latex, seen[fingerprint]);
+        seen[fingerprint] = latex;
+    }
+}
+
+- (void)testNoCollisions
+{
+    NSMutableSet<NSNumber*>* fingerprints = [NSMutableSet set];
+    NSUInteger count = 0;
+    for (NSUInteger i = 0; i < 100; i++) {
+        for (NSUInteger j = 0; j < 100; j++) {
+            NSString* latex = [NSString stringWithFormat:@"x_{%lu}^{%lu}+\\frac{%lu}{y}", (unsigned long) i, (unsigned long) j, (unsigned long) (i + j)];
+            MTMathList* list = [MTMathListBuilder buildFromString:latex];
+            [fingerprints addObject:@(list.fingerprint)];
+            // And the first atom on its own.
+            [fingerprints addObject:@([list.atoms[0] fingerprint])];
+            count += 2;
+        }
+    }
+    XCTAssertEqual(fingerprints.count, count);
+}
+
+- (void)testChangesInvalidate
+{
+    MTMathList* list = [self listForLaTeX:@"x^{2}+\\frac{a}{b}"];
+    uint64_t before = list.fingerprint;
+    MTMathAtom* x = list.atoms[0];
+    uint64_t xBefore = x.fingerprint;
+
+    [x.superScript addAtom:[MTMathAtomFactory atomForCharacter:'3']];
+    XCTAssertNotEqual(list.fingerprint, before);
+    XCTAssertNotEqual(x.fingerprint, xBefore);
+    [x.superScript removeLastAtom];
+    XCTAssertEqual(list.fingerprint, before);
+    XCTAssertEqual(x.fingerprint, xBefore);
+
+    x.fontStyle = kMTFontStyleBold;
+    XCTAssertNotEqual(list.fingerprint, before);
+    x.fontStyle = kMTFontStyleDefault;
+    x.nucleus = @"z";
+    XCTAssertNotEqual(list.fingerprint, before);
+    x.nucleus = @"x";
+    XCTAssertEqual(list.fingerprint, before);
+
+    MTFraction* frac = list.atoms[2];
+    frac.isContinuedFraction = YES;
+    XCTAssertNotEqual(list.fingerprint, before);
+    frac.isContinuedFraction = NO;
+    frac.denominator = [self listForLaTeX:@"c"];
+    XCTAssertNotEqual(list.fingerprint, before);
+    frac.denominator = [self listForLaTeX:@"b"];
+    XCTAssertEqual(list.fingerprint, before);
+}
+
+- (void)testChangesToOtherAtomsInvalidate
+{
+    MTMathList* table = [self listForLaTeX:@"\\begin{matrix} a & b \\end{matrix}"];
+    uint64_t tableBefore = table.fingerprint;
+    MTMathTable* matrix = [self atomOfClass:[MTMathTable class] inList:table];
+    [matrix setAlignment:kMTColumnAlignmentLeft forColumn:0];
+    XCTAssertNotEqual(table.fingerprint, tableBefore);
+    uint64_t aligned = table.fingerprint;
+    [matrix setCell:[self listForLaTeX:@"c"] forRow:0 column:1];
+    XCTAssertNotEqual(table.fingerprint, aligned);
+
+    MTMathList* phantom = [self listForLaTeX:@"\\phantom{x}"];
+    uint64_t phantomBefore = phantom.fingerprint;
+    MTMathBox* box = [self atomOfClass:[MTMathBox class] inList:phantom];
+    box.drawChild = !box.drawChild;
+    XCTAssertNotEqual(phantom.fingerprint, phantomBefore);
+
+    MTMathList* brace = [self listForLaTeX:@"\\overbrace{x}"];
+    uint64_t braceBefore = brace.fingerprint;
+    MTMathStack* stack = [self atomOfClass:[MTMathStack class] inList:brace];
+    stack.over = nil;
+    XCTAssertNotEqual(brace.fingerprint, braceBefore);
+
+    MTMathList* color = [self listForLaTeX:@"\\color{red}{x}"];
+    uint64_t colorBefore = color.fingerprint;
+    MTMathColor* colorAtom = [self atomOfClass:[MTMathColor class] inList:color];
+    colorAtom.colorString = @"blue";
+    XCTAssertNotEqual(color.fingerprint, colorBefore);
+    colorAtom.colorString = @"red";
+    XCTAssertEqual(color.fingerprint, colorBefore);
+}
+
+- (void)testChangesInvalidateOnlyAncestors
+{
+    MTMathList* list = [self listForLaTeX:@"x^{2}+\\frac{a}{b}"];
+    MTMathList* other = [self listForLaTeX:@"y^{2}"];
+    uint64_t otherBefore = other.fingerprint;
+    (void) list.fingerprint;
+
+    // The root, the fraction, its numerator and the atom changed are computed again.
+    MTFraction* frac = list.atomsForReading[2];
+    frac.numerator.atoms[0].nucleus = @"c";
+    MTCountingHasher* hasher = [MTCountingHasher new];
+    XCTAssertEqual([list fingerprintWithHasher:hasher], [self listForLaTeX:@"x^{2}+\\frac{c}{b}"].fingerprint);
+    XCTAssertEqual(hasher.count, 4u);
+
+    hasher.count = 0;
+    XCTAssertEqual([other fingerprintWithHasher:hasher], otherBefore);
+    XCTAssertEqual(hasher.count, 0u);
+}
+
+- (void)testChangesToSharedListsInvalidate
+{
+    // A list held by two atoms invalidates both.
+    MTMathList* script = [self listForLaTeX:@"2"];
+    MTMathList* first = [self listForLaTeX:@"x"];
+    MTMathList* second = [self listForLaTeX:@"y"];
+    first.atoms[0].superScript = script;
+    second.atoms[0].superScript = script;
+    uint64_t firstBefore = first.fingerprint;
+    uint64_t secondBefore = second.fingerprint;
+    [script addAtom:[MTMathAtomFactory atomForCharacter:'3']];
+    XCTAssertNotEqual(first.fingerprint, firstBefore);
+    XCTAssertNotEqual(second.fingerprint, secondBefore);
+    XCTAssertEqual(first.fingerprint, [first.copy fingerprint]);
+    XCTAssertEqual(second.fingerprint, [second.copy fingerprint]);
+}
+
+- (void)testMovedAtomsInvalidateTheirNewList
+{
+    MTMathList* from = [self listForLaTeX:@"a+b"];
+    MTMathList* to = [self listForLaTeX:@"c"];
+    MTMathAtom* b = from.atoms[2];
+    (void) from.fingerprint;
+    uint64_t toBefore = to.fingerprint;
+    [from removeLastAtom];
+    [to addAtom:b];
+    uint64_t fromAfter = from.fingerprint;
+    uint64_t toAfter = to.fingerprint;
+    XCTAssertNotEqual(toAfter, toBefore);
+
+    b.nucleus = @"d";
+    XCTAssertNotEqual(to.fingerprint, toAfter);
+    XCTAssertEqual(to.fingerprint, [to.copy fingerprint]);
+    // The list that the atom left is still cached.
+    MTCountingHasher* hasher = [MTCountingHasher new];
+    XCTAssertEqual([from fingerprintWithHasher:hasher], fromAfter);
+    XCTAssertEqual(hasher.count, 0u);
+}
+
+- (void)testVersionsShareFingerprints
+{
+    MTPersistentMathList* version = [[MTPersistentMathList alloc] initWithMathList:[self listForLaTeX:@"a^{b}+c"]];
+    uint64_t before = version.mathList.fingerprint;
+    MTMathListIndex* b = [MTMathListIndex indexAtLocation:0 withSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeSuperscript];
+    MTPersistentMathList* edited = [version listByReplacingAtomAtListIndex:b withAtom:[MTMathAtomFactory atomForCharacter:'d']];
+    XCTAssertNotEqual(edited.mathList.fingerprint, before);
+    XCTAssertEqual(version.mathList.fingerprint, before);
+    XCTAssertEqual(edited.mathList.fingerprint, [self listForLaTeX:@"a^{d}+c"].fingerprint);
+}
+
+- (void)testFingerprintsAcrossThreads
+{
+    MTMathList* list = [self listForLaTeX:@"\\sum_{i=0}^{n} \\frac{x_{i}^{2}}{\\sqrt{1+y_{i}}}"];
+    MTMathList* expected = [self listForLaTeX:@"\\sum_{i=0}^{n} \\frac{x_{i}^{2}}{\\sqrt{1+y_{i}}}"];
+    uint64_t fingerprint = expected.fingerprint;
+    dispatch_apply(100, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+        XCTAssertEqual(list.fingerprint, fingerprint);
+    });
+}
+
+@end
@@ -0,0 +1,154 @@
+//
+//  MTMathListIndexTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTMathListIndex.h"
+#import "MTMathList.h"
+#import "MTMathListBuilder.h"
+#import "MTMathAtomFactory.h"
+
+@interface MTMathListIndexTest : XCTestCase
+
+@end
+
+@implementation MTMathListIndexTest
+
+// (1, superscript) -> (0, denominator) -> (0, none)
+- (MTMathListIndex*) denominatorIndex
+{
+    MTMathListIndex* denominator = [MTMathListIndex indexAtLocation:0 withSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeDenominator];
+    return [MTMathListIndex indexAtLocation:1 withSubIndex:denominator type:kMTSubIndexTypeSuperscript];
+}
+
+- (void)testNavigation
+{
+    MTMathListIndex* index = [self denominatorIndex];
+    XCTAssertEqualObjects(index.description, @"[1, 2:[0, 5:[0]]]");
+    XCTAssertEqual(index.depth, 3u);
+    XCTAssertEqual(index.subIndex.atomIndex, 0u);
+    XCTAssertEqual(index.subIndex.subIndexType, kMTSubIndexTypeDenominator);
+    XCTAssertEqual(index.subIndex, index.subIndex);
+    XCTAssertEqual(index.finalSubIndexType, kMTSubIndexTypeDenominator);
+    XCTAssertTrue([index hasSubIndexOfType:kMTSubIndexTypeSuperscript]);
+    XCTAssertFalse([index hasSubIndexOfType:kMTSubIndexTypeNumerator]);
+    XCTAssertTrue(index.isAtBeginningOfLine);
+
+    XCTAssertEqualObjects(index.next.description, @"[1, 2:[0, 5:[1]]]");
+    XCTAssertNil(index.previous);
+    XCTAssertEqualObjects(index.next.previous, index);
+    XCTAssertEqualObjects(index.levelDown.description, @"[1, 2:[0]]");
+    XCTAssertEqualObjects(index.levelDown.levelDown.description, @"[1]");
+    XCTAssertNil(index.levelDown.levelDown.levelDown);
+    XCTAssertEqualObjects([index levelUpWithSubIndex:[MTMathListIndex level0Index:2] type:kMTSubIndexTypeInner].description,
+                          @"[1, 2:[0, 5:[0, 8:[2]]]]");
+
+    // Past a nucleus the rest of the index is kept.
+    MTMathListIndex* nucleus = [MTMathListIndex indexAtLocation:3 withSubIndex:[MTMathListIndex level0Index:1] type:kMTSubIndexTypeNucleus];
+    XCTAssertEqualObjects(nucleus.next.description, @"[4, 1:[1]]");
+}
+
+- (void)testEqualityAndHash
+{
+    MTMathListIndex* index = [self denominatorIndex];
+    MTMathListIndex* same = [[[MTMathListIndex level0Index:1] levelUpWithSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeSuperscript]
+                             levelUpWithSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeDenominator];
+    XCTAssertEqualObjects(index, same);
+    XCTAssertEqual(index.hash, same.hash);
+    XCTAssertNotEqualObjects(index, index.next);
+    XCTAssertNotEqualObjects(index, index.levelDown);
+    NSSet* set = [NSSet setWithObjects:index, same, index.next, nil];
+    XCTAssertEqual(set.count, 2u);
+}
+
+- (void)testPaths
+{
+    MTMathListIndex* index = [self denominatorIndex];
+    MTMathListIndexPath path;
+    XCTAssertTrue([index getPath:&path]);
+    XCTAssertEqual(path.depth, 3u);
+    XCTAssertEqual(MTMathListIndexPathAtomIndex(path, 0), 1u);
+    XCTAssertEqual(MTMathListIndexPathSubIndexType(path, 1), kMTSubIndexTypeDenominator);
+    XCTAssertEqualObjects([MTMathListIndex indexWithPath:path], index);
+    XCTAssertEqual(MTMathListIndexPathHash(path), index.hash);
+
+    MTMathListIndexPath built = MTMathListIndexPathMake(1);
+    MTMathListIndexPath level0 = MTMathListIndexPathMake(0);
+    XCTAssertTrue(MTMathListIndexPathLevelUp(&built, &level0, kMTSubIndexTypeSuperscript));
+    XCTAssertTrue(MTMathListIndexPathLevelUp(&built, &level0, kMTSubIndexTypeDenominator));
+    XCTAssertTrue(MTMathListIndexPathEqualToPath(built, path));
+
+    MTMathListIndexPath next = path;
+    MTMathListIndexPathNext(&next);
+    XCTAssertEqualObjects([MTMathListIndex indexWithPath:next], index.next);
+    XCTAssertTrue(MTMathListIndexPathPrevious(&next));
+    XCTAssertTrue(MTMathListIndexPathEqualToPath(next, path));
+    XCTAssertFalse(MTMathListIndexPathPrevious(&next));
+    XCTAssertTrue(MTMathListIndexPathEqualToPath(next, path));
+
+    // Levels that are gone are cleared, so the paths stay comparable.
+    MTMathListIndexPath down = path;
+    XCTAssertTrue(MTMathListIndexPathLevelDown(&down));
+    XCTAssertTrue(MTMathListIndexPathLevelDown(&down));
+    XCTAssertFalse(MTMathListIndexPathLevelDown(&down));
+    XCTAssertTrue(MTMathListIndexPathEqualToPath(down, MTMathListIndexPathMake(1)));
+    XCTAssertEqual(MTMathListIndexPathFinalSubIndexType(path), index.finalSubIndexType);
+    XCTAssertTrue(MTMathListIndexPathHasSubIndexOfType(path, kMTSubIndexTypeSuperscript));
+    XCTAssertTrue(MTMathListIndexPathIsAtBeginningOfLine(path));
+}
+
+- (void)testDeepIndexes
+{
+    MTMathListIndex* index = [MTMathListIndex level0Index:0];
+    MTMathListIndexPath path = MTMathListIndexPathMake(0);
+    MTMathListIndexPath level0 = MTMathListIndexPathMake(0);
+    for (NSUInteger i = 1; i < kMTMathListIndexPathCapacity; i++) {
+        index = [index levelUpWithSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeSuperscript];
+        XCTAssertTrue(MTMathListIndexPathLevelUp(&path, &level0, kMTSubIndexTypeSuperscript));
+    }
+    XCTAssertEqualObjects([MTMathListIndex indexWithPath:path], index);
+    XCTAssertFalse(MTMathListIndexPathLevelUp(&path, &level0, kMTSubIndexTypeSuperscript));
+    XCTAssertEqual(path.depth, (uint32_t) kMTMathListIndexPathCapacity);
+
+    // Indexes have no limit, only their paths do.
+    MTMathListIndex* deeper = [index levelUpWithSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeSuperscript];
+    XCTAssertEqual(deeper.depth, kMTMathListIndexPathCapacity + 1);
+    XCTAssertFalse([deeper getPath:&path]);
+    XCTAssertEqualObjects(deeper.levelDown, index);
+    XCTAssertEqual(deeper.next.depth, deeper.depth);
+}
+
+- (void)testAtomAtIndex
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:@"25^{\\frac{2}{4}} + \\sqrt[3]{x} \\left( y \\right)"];
+    MTMathAtom* four = [list atomAtListIndex:[self denominatorIndex]];
+    XCTAssertEqualObjects(four.nucleus, @"4");
+    XCTAssertEqualObjects([list atomAtListIndex:[MTMathListIndex level0Index:1]].nucleus, @"5");
+    XCTAssertEqual([list atomAtListIndex:[MTMathListIndex indexAtLocation:1 withSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeSuperscript]].type, kMTMathAtomFraction);
+
+    MTMathListIndex* degree = [MTMathListIndex indexAtLocation:3 withSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeDegree];
+    XCTAssertEqualObjects([list atomAtListIndex:degree].nucleus, @"3");
+    MTMathListIndex* inner = [MTMathListIndex indexAtLocation:4 withSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeInner];
+    XCTAssertEqualObjects([list atomAtListIndex:inner].nucleus, @"y");
+
+    MTMathListIndexPath path;
+    XCTAssertTrue([degree getPath:&path]);
+    XCTAssertEqual([list atomAtIndexPath:path], [list atomAtListIndex:degree]);
+
+    // Out of range, and into branches the atom does not have.
+    XCTAssertNil([list atomAtListIndex:[MTMathListIndex level0Index:5]]);
+    XCTAssertNil([list atomAtListIndex:[MTMathListIndex indexAtLocation:0 withSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeSuperscript]]);
+    XCTAssertNil([list atomAtListIndex:[MTMathListIndex indexAtLocation:1 withSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeRadicand]]);
+
+    // The lists keep the atoms they share.
+    MTMathAtom* x = [MTMathAtomFactory sharedAtomForCharacter:'x'];
+    XCTAssertEqual([list atomAtListIndex:[MTMathListIndex indexAtLocation:3 withSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeRadicand]], x);
+    XCTAssertEqual(((MTRadical*) list.atomsForReading[3]).radicand.atomsForReading[0], x);
+}
+
+@end
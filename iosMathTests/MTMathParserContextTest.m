@@ -0,0 +1,153 @@
+//
+//  MTMathParserContextTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTMathParserContext.h"
+#import "MTMathListBuilder.h"
+#import "MTMathAtomFactory.h"
+
+@interface MTMathParserContextTest : XCTestCase
+
+@end
+
+@implementation MTMathParserContextTest
+
+- (NSString*) latexForString:(NSString*) str context:(nullable MTMathParserContext*) context
+{
+    NSError* error = nil;
+    MTMathList* list = [MTMathListBuilder buildFromString:str context:context error:&error];
+    XCTAssertNotNil(list, @"%@: %@", str, error);
+    return [MTMathListBuilder mathListToString:list context:context];
+}
+
+- (void)testSymbols
+{
+    MTMathParserContext* context = [MTMathParserContext.defaultContext contextByAddingSymbol:@"lcmx"
+                                                                                      value:[MTMathAtomFactory operatorWithName:@"lcm" limits:NO]];
+    NSError* error = nil;
+    XCTAssertNil([MTMathListBuilder buildFromString:@"\\lcmx(a,b)" context:MTMathParserContext.defaultContext error:&error]);
+    XCTAssertEqual(error.code, MTParseErrorInvalidCommand);
+
+    MTMathList* list = [MTMathListBuilder buildFromString:@"\\lcmx(a,b) \\le \\alpha" context:context error:&error];
+    XCTAssertNotNil(list, @"%@", error);
+    XCTAssertEqual(list.atoms[0].type, kMTMathAtomLargeOperator);
+    XCTAssertEqualObjects(list.atoms[0].nucleus, @"lcm");
+    XCTAssertEqualObjects([MTMathListBuilder mathListToString:list context:context], @"\\lcmx (a,b)\\leq \\alpha ");
+    XCTAssertEqualObjects([context latexSymbolNameForAtom:list.atoms[0]], @"lcmx");
+    XCTAssertNil([MTMathParserContext.defaultContext latexSymbolNameForAtom:list.atoms[0]]);
+
+    // The context does not change the atoms it was given, nor the context it was made from.
+    XCTAssertNotEqual([context atomForLatexSymbolName:@"lcmx"], [context atomForLatexSymbolName:@"lcmx"]);
+    XCTAssertEqual(MTMathParserContext.defaultContext.symbols.count, 0u);
+    XCTAssertEqual(context.copy, context);
+}
+
+- (void)testOverrides
+{
+    MTMathAtom* varepsilon = [MTMathAtomFactory atomForLatexSymbolName:@"varepsilon"];
+    MTMathAtom* epsilon = [MTMathAtomFactory atomForLatexSymbolName:@"epsilon"];
+    MTMathParserContext* context = [[MTMathParserContext alloc] initWithSymbols:@{ @"epsilon" : varepsilon } macros:nil];
+    XCTAssertEqualObjects([context atomForLatexSymbolName:@"epsilon"].nucleus, varepsilon.nucleus);
+    XCTAssertEqualObjects([context latexSymbolNameForAtom:varepsilon], @"epsilon");
+    // The built-in name would read back as the new symbol.
+    XCTAssertNil([context latexSymbolNameForAtom:epsilon]);
+    XCTAssertEqualObjects([MTMathParserContext.defaultContext latexSymbolNameForAtom:varepsilon], @"varepsilon");
+    XCTAssertEqualObjects([self latexForString:@"\\epsilon" context:context], @"\\epsilon ");
+    XCTAssertEqualObjects([self latexForString:@"\\epsilon" context:nil], @"\\epsilon ");
+}
+
+- (void)testMacros
+{
+    MTMathParserContext* context = [[MTMathParserContext alloc] initWithSymbols:nil
+                                                                         macros:@{ @"R" : @"\\mathbb{R}",
+                                                                                   @"RR" : @"\\R\\times\\R",
+                                                                                   @"half" : @"\\frac{1}{2}" }];
+    XCTAssertEqualObjects([self latexForString:@"x\\in\\R^2" context:context],
+                          [self latexForString:@"x\\in\\mathbb{R}^2" context:nil]);
+    XCTAssertEqualObjects([self latexForString:@"f:\\RR\\to\\R" context:context],
+                          [self latexForString:@"f:\\mathbb{R}\\times\\mathbb{R}\\to\\mathbb{R}" context:nil]);
+    XCTAssertEqualObjects([self latexForString:@"x^\\half + {\\half}" context:context],
+                          [self latexForString:@"x^{\\frac{1}{2}} + {\\frac{1}{2}}" context:nil]);
+
+    // A macro shadows the symbol of the same name.
+    MTMathParserContext* shadowing = [context contextByAddingMacro:@"alpha" expansion:@"a"];
+    XCTAssertEqualObjects([self latexForString:@"\\alpha" context:shadowing], @"a");
+    XCTAssertNil([shadowing latexSymbolNameForAtom:[MTMathAtomFactory atomForLatexSymbolName:@"alpha"]]);
+    XCTAssertEqual(context.macros.count, 3u);
+
+    NSError* error = nil;
+    XCTAssertNil([MTMathListBuilder buildFromString:@"\\R" error:&error]);
+    XCTAssertEqual(error.code, MTParseErrorInvalidCommand);
+}
+
+- (void)testRecursiveMacro
+{
+    MTMathParserContext* context = [[MTMathParserContext alloc] initWithSymbols:nil macros:@{ @"loop" : @"x\\loop",
+                                                                                              @"twice" : @"\\twice\\twice" }];
+    for (NSString* str in @[ @"\\loop", @"a+\\twice" ]) {
+        NSError* error = nil;
+        XCTAssertNil([MTMathListBuilder buildFromString:str context:context error:&error], @"%@", str);
+        XCTAssertEqual(error.code, MTParseErrorMacroExpansionTooDeep, @"%@", str);
+    }
+}
+
+- (void)testLongMacroExpansion
+{
+    NSString* lots = [@"" stringByPaddingToLength:2000 withString:@"x" startingAtIndex:0];
+    NSString* wide = [@"" stringByPaddingToLength:60 * 5 withString:@"\\lots" startingAtIndex:0];
+    MTMathParserContext* context = [[MTMathParserContext alloc] initWithSymbols:nil macros:@{ @"lots" : lots, @"wide" : wide }];
+    XCTAssertEqual([MTMathListBuilder buildFromString:@"\\lots" context:context error:nil].atomsForReading.count, 2000u);
+
+    // Far fewer expansions than the limit, but they add 120000 characters.
+    NSError* error = nil;
+    XCTAssertNil([MTMathListBuilder buildFromString:@"\\wide" context:context error:&error]);
+    XCTAssertEqual(error.code, MTParseErrorMacroExpansionTooDeep);
+}
+
+- (void)testGlobalSymbolsAreNotInContexts
+{
+    [MTMathAtomFactory addLatexSymbol:@"ctxglobalop" value:[MTMathAtomFactory operatorWithName:@"glob" limits:NO]];
+    XCTAssertNotNil([MTMathListBuilder buildFromString:@"\\ctxglobalop x"]);
+    XCTAssertNil([MTMathParserContext.defaultContext atomForLatexSymbolName:@"ctxglobalop"]);
+    XCTAssertNil([MTMathListBuilder buildFromString:@"\\ctxglobalop x" context:MTMathParserContext.defaultContext error:nil]);
+}
+
+- (void)testConcurrentContexts
+{
+    const NSUInteger contextCount = 16;
+    const NSUInteger parseCount = 800;
+    NSMutableArray<MTMathParserContext*>* contexts = [NSMutableArray array];
+    NSMutableArray<NSString*>* expected = [NSMutableArray array];
+    for (NSUInteger i = 0; i < contextCount; i++) {
+        NSString* value = [NSString stringWithFormat:@"%lu", (unsigned long) i];
+        MTMathParserContext* context = [[MTMathParserContext.defaultContext contextByAddingMacro:@"N" expansion:value]
+                                        contextByAddingSymbol:@"op" value:[MTMathAtomFactory operatorWithName:value limits:YES]];
+        [contexts addObject:context];
+        [expected addObject:[NSString stringWithFormat:@"\\op ^{%@}_{n=%@}\\alpha _{n}", value, value]];
+    }
+
+    NSMutableArray* results = [NSMutableArray arrayWithCapacity:parseCount];
+    for (NSUInteger i = 0; i < parseCount; i++) {
+        [results addObject:[NSNull null]];
+    }
+    NSObject* lock = [NSObject new];
+    dispatch_apply(parseCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+        MTMathParserContext* context = contexts[i % contextCount];
+        MTMathList* list = [MTMathListBuilder buildFromString:@"\\op_{n=\\N}^{\\N} \\alpha_n" context:context error:nil];
+        NSString* latex = list ? [MTMathListBuilder mathListToString:list context:context] : @"";
+        @synchronized (lock) {
+            results[i] = latex;
+        }
+    });
+    for (NSUInteger i = 0; i < parseCount; i++) {
+        XCTAssertEqualObjects(results[i], expected[i % contextCount]);
+    }
+}
+
+@end
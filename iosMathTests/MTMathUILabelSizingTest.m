@@ -126,4 +126,34 @@
     XCTAssertNotEqualWithAccuracy(sizeAt3x.width, sizeAt1x.width, 0.001, @"re-query did not adopt the new scale");
 }
 
+// A scalable label reports the same size as a regular one and keeps its layout across
+// font size changes.
+- (void)testScalesLayoutKeepsLayoutAcrossFontSizes {
+    MTScaledLabel* regular = [[MTScaledLabel alloc] init];
+    MTScaledLabel* scalable = [[MTScaledLabel alloc] init];
+    regular.forcedScale = scalable.forcedScale = 2;
+    scalable.scalesLayout = YES;
+    regular.latex = scalable.latex = @"\\frac{1}{2} + \\sqrt{x}";
+
+    MTMathListDisplay* layout = nil;
+    for (NSNumber* fontSize in @[@20, @33, @12.5]) {
+        regular.fontSize = scalable.fontSize = fontSize.doubleValue;
+        CGSize expected = [regular sizeThatFits:CGSizeZero];
+        CGSize size = [scalable sizeThatFits:CGSizeZero];
+        XCTAssertEqualWithAccuracy(size.width, expected.width, 0.5 + 0.001, @"%@pt", fontSize);
+        XCTAssertEqualWithAccuracy(size.height, expected.height, 0.5 + 0.001, @"%@pt", fontSize);
+
+        scalable.frame = CGRectMake(0, 0, size.width, size.height);
+        [scalable layoutSubviews];
+        if (layout) {
+            XCTAssertEqual(scalable.displayList, layout, @"font size change typeset the formula again");
+        }
+        layout = scalable.displayList;
+    }
+
+    scalable.latex = @"x";
+    [scalable layoutSubviews];
+    XCTAssertNotEqual(scalable.displayList, layout);
+}
+
 @end
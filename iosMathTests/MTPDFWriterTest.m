@@ -0,0 +1,169 @@
+//
+//  MTPDFWriterTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+#import "MTPDFWriter.h"
+#import "MTTypesetter.h"
+#import "MTFontManager.h"
+#import "MTMathListDisplay.h"
+#import "MTMathListBuilder.h"
+#import "../MathExamples.h"
+
+static const CGSize kLetterSize = { 612, 792 };
+
+@interface MTPDFWriterTest : XCTestCase
+
+@property (nonatomic) NSArray<MTMathListDisplay*>* displays;
+
+@end
+
+@implementation MTPDFWriterTest
+
+- (void)setUp {
+    [super setUp];
+    MTFont* font = MTFontManager.fontManager.defaultFont;
+    NSMutableArray<MTMathListDisplay*>* displays = [NSMutableArray array];
+    for (NSString* latex in [MathDemoFormulas() arrayByAddingObjectsFromArray:MathTestFormulas()]) {
+        MTMathList* list = [MTMathListBuilder buildFromString:latex];
+        if (list) {
+            [displays addObject:[MTTypesetter createLineForMathList:list font:font style:kMTLineStyleDisplay]];
+        }
+    }
+    self.displays = displays;
+}
+
+- (NSData*)PDFWithDisplayCount:(NSUInteger)count writer:(MTPDFWriter* __autoreleasing *)writerOut
+{
+    NSOutputStream* stream = [NSOutputStream outputStreamToMemory];
+    [stream open];
+    MTPDFWriter* writer = [[MTPDFWriter alloc] initWithStream:stream pageSize:kLetterSize];
+    for (NSUInteger i = 0; i < count; i++) {
+        [writer addDisplay:self.displays[i % self.displays.count]];
+    }
+    NSError* error = nil;
+    XCTAssertTrue([writer finishWithError:&error], @"%@", error);
+    NSData* data = [stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+    [stream close];
+    if (writerOut) {
+        *writerOut = writer;
+    }
+    return data;
+}
+
+static CGPDFDocumentRef createDocument(NSData* data)
+{
+    CGDataProviderRef provider = CGDataProviderCreateWithCFData((__bridge CFDataRef) data);
+    CGPDFDocumentRef document = CGPDFDocumentCreateWithProvider(provider);
+    CGDataProviderRelease(provider);
+    return document;
+}
+
+- (void)testFlowsOntoPages
+{
+    MTPDFWriter* writer = nil;
+    NSData* data = [self PDFWithDisplayCount:200 writer:&writer];
+    XCTAssertGreaterThan(writer.pageCount, 1u);
+    CGPDFDocumentRef document = createDocument(data);
+    XCTAssertTrue(document != NULL);
+    XCTAssertEqual((NSUInteger) CGPDFDocumentGetNumberOfPages(document), writer.pageCount);
+    CGRect mediaBox = CGPDFPageGetBoxRect(CGPDFDocumentGetPage(document, 1), kCGPDFMediaBox);
+    XCTAssertEqual(mediaBox.size.width, kLetterSize.width);
+    XCTAssertEqual(mediaBox.size.height, kLetterSize.height);
+    CGPDFDocumentRelease(document);
+}
+
+// Every page holds as many displays as fit between the margins.
+- (void)testPageBreaks
+{
+    NSOutputStream* stream = [NSOutputStream outputStreamToMemory];
+    [stream open];
+    MTPDFWriter* writer = [[MTPDFWriter alloc] initWithStream:stream pageSize:CGSizeMake(300, 200)];
+    writer.margins = (MTEdgeInsets) { 10, 10, 10, 10 };
+    writer.spacing = 0;
+    MTMathListDisplay* display = self.displays[0];
+    CGFloat height = display.ascent + display.descent;
+    NSUInteger perPage = (NSUInteger) floor(180 / height);
+    XCTAssertGreaterThan(perPage, 0u);
+    for (NSUInteger i = 0; i < perPage * 3; i++) {
+        [writer addDisplay:display];
+    }
+    XCTAssertEqual(writer.pageCount, 3u);
+    [writer addDisplay:display];
+    XCTAssertEqual(writer.pageCount, 4u);
+    [writer beginPage];
+    [writer drawDisplay:display atPoint:CGPointMake(10, 100)];
+    XCTAssertEqual(writer.pageCount, 5u);
+    XCTAssertTrue([writer finishWithError:NULL]);
+    [stream close];
+}
+
+// The fonts are embedded once for the document, not once per formula.
+- (void)testFontsAreShared
+{
+    NSUInteger count = self.displays.count;
+    NSData* single = [self PDFWithDisplayCount:1 writer:NULL];
+    NSData* all = [self PDFWithDisplayCount:count writer:NULL];
+    XCTAssertLessThan(all.length, single.length * count / 4);
+
+    // The pages refer to the same font objects.
+    CGPDFDocumentRef document = createDocument(all);
+    NSMutableSet<NSValue*>* fonts = [NSMutableSet set];
+    NSMutableSet<NSString*>* fontNames = [NSMutableSet set];
+    for (size_t p = 1; p <= CGPDFDocumentGetNumberOfPages(document); p++) {
+        CGPDFDictionaryRef resources = NULL;
+        CGPDFDictionaryRef fontDictionary = NULL;
+        if (!CGPDFDictionaryGetDictionary(CGPDFPageGetDictionary(CGPDFDocumentGetPage(document, p)), "Resources", &resources)
+            || !CGPDFDictionaryGetDictionary(resources, "Font", &fontDictionary)) {
+            continue;
+        }
+        CGPDFDictionaryApplyBlock(fontDictionary, ^bool(const char* key, CGPDFObjectRef value, void* info) {
+            CGPDFDictionaryRef font = NULL;
+            const char* baseFont = NULL;
+            if (CGPDFObjectGetValue(value, kCGPDFObjectTypeDictionary, &font)) {
+                [fonts addObject:[NSValue valueWithPointer:font]];
+                if (CGPDFDictionaryGetName(font, "BaseFont", &baseFont)) {
+                    [fontNames addObject:@(baseFont)];
+                }
+            }
+            return true;
+        }, NULL);
+    }
+    XCTAssertGreaterThan(fontNames.count, 0u);
+    XCTAssertEqual(fonts.count, fontNames.count);
+    CGPDFDocumentRelease(document);
+}
+
+- (void)testWritesFile
+{
+    NSURL* url = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"MTPDFWriterTest.pdf"]];
+    MTPDFWriter* writer = [[MTPDFWriter alloc] initWithURL:url pageSize:kLetterSize];
+    XCTAssertNotNil(writer);
+    for (MTMathListDisplay* display in self.displays) {
+        [writer addDisplay:display];
+    }
+    XCTAssertTrue([writer finishWithError:NULL]);
+    CGPDFDocumentRef document = CGPDFDocumentCreateWithURL((__bridge CFURLRef) url);
+    XCTAssertEqual((NSUInteger) CGPDFDocumentGetNumberOfPages(document), writer.pageCount);
+    CGPDFDocumentRelease(document);
+    [[NSFileManager defaultManager] removeItemAtURL:url error:NULL];
+}
+
+- (void)testStreamErrorIsReported
+{
+    // Never opened, so every write fails.
+    NSOutputStream* stream = [NSOutputStream outputStreamToMemory];
+    MTPDFWriter* writer = [[MTPDFWriter alloc] initWithStream:stream pageSize:kLetterSize];
+    [writer addDisplay:self.displays[0]];
+    NSError* error = nil;
+    XCTAssertFalse([writer finishWithError:&error]);
+    XCTAssertNotNil(error);
+}
+
+@end
@@ -0,0 +1,122 @@
+//
+//  MTPersistentMathListTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTPersistentMathList.h"
+#import "MTMathListBuilder.h"
+#import "MTMathAtomFactory.h"
+#import "MTRetainedSize.h"
+
+@interface MTPersistentMathListTest : XCTestCase
+
+@end
+
+@implementation MTPersistentMathListTest
+
+- (MTPersistentMathList*) versionForLaTeX:(NSString*) latex
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:latex];
+    XCTAssertNotNil(list, @"%@", latex);
+    return [[MTPersistentMathList alloc] initWithMathList:list];
+}
+
+- (void) assertVersion:(MTPersistentMathList*) version isLaTeX:(NSString*) latex
+{
+    XCTAssertNotNil(version);
+    XCTAssertEqualObjects([MTMathListBuilder mathListToString:version.mathList],
+                          [MTMathListBuilder mathListToString:[MTMathListBuilder buildFromString:latex]]);
+}
+
+// (0, superscript) -> (i, none)
+- (MTMathListIndex*) superscriptIndex:(NSUInteger) i
+{
+    return [MTMathListIndex indexAtLocation:0 withSubIndex:[MTMathListIndex level0Index:i] type:kMTSubIndexTypeSuperscript];
+}
+
+- (void)testEdits
+{
+    MTPersistentMathList* version = [self versionForLaTeX:@"a^{b+c}+\\frac{x}{y}"];
+    MTMathAtom* d = [MTMathAtomFactory atomForCharacter:'d'];
+
+    MTPersistentMathList* replaced = [version listByReplacingAtomAtListIndex:[self superscriptIndex:2] withAtom:d];
+    [self assertVersion:replaced isLaTeX:@"a^{b+d}+\\frac{x}{y}"];
+    MTPersistentMathList* inserted = [version listByInsertingAtom:d atListIndex:[self superscriptIndex:3]];
+    [self assertVersion:inserted isLaTeX:@"a^{b+cd}+\\frac{x}{y}"];
+    MTPersistentMathList* removed = [version listByRemovingAtomAtListIndex:[MTMathListIndex level0Index:2]];
+    [self assertVersion:removed isLaTeX:@"a^{b+c}+"];
+    MTMathListIndex* denominator = [MTMathListIndex indexAtLocation:2 withSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeDenominator];
+    [self assertVersion:[version listByReplacingAtomAtListIndex:denominator withAtom:d] isLaTeX:@"a^{b+c}+\\frac{x}{d}"];
+
+    // The version that was edited does not change.
+    [self assertVersion:version isLaTeX:@"a^{b+c}+\\frac{x}{y}"];
+    XCTAssertEqualObjects([version atomAtListIndex:[self superscriptIndex:2]].nucleus, @"c");
+    XCTAssertEqualObjects([replaced atomAtListIndex:[self superscriptIndex:2]].nucleus, @"d");
+    // Nor do the versions when the atom they were given changes.
+    d.nucleus = @"e";
+    [self assertVersion:replaced isLaTeX:@"a^{b+d}+\\frac{x}{y}"];
+}
+
+- (void)testEditsShareUntouchedAtoms
+{
+    MTPersistentMathList* version = [self versionForLaTeX:@"a^{b+c}_{n}+\\frac{x}{y}"];
+    MTPersistentMathList* edited = [version listByRemovingAtomAtListIndex:[self superscriptIndex:0]];
+    MTMathAtom* before = version.mathList.atoms[0];
+    MTMathAtom* after = edited.mathList.atoms[0];
+    // The atom on the path is new, the rest is shared.
+    XCTAssertNotEqual(after, before);
+    XCTAssertEqual(after.subScript, before.subScript);
+    XCTAssertEqual(after.superScript.atoms[0], before.superScript.atoms[1]);
+    XCTAssertEqual(edited.mathList.atoms[1], version.mathList.atoms[1]);
+    XCTAssertEqual(edited.mathList.atoms[2], version.mathList.atoms[2]);
+    XCTAssertEqual([version copy], version);
+
+    // Two versions take little more memory than one.
+    MTRetainedSizeCounter* one = [MTRetainedSizeCounter new];
+    [one addObject:version.mathList];
+    MTRetainedSizeCounter* both = [MTRetainedSizeCounter new];
+    [both addObject:@[ version.mathList, edited.mathList ]];
+    MTRetainedSizeCounter* copies = [MTRetainedSizeCounter new];
+    [copies addObject:@[ version.mathList, edited.mutableMathList ]];
+    XCTAssertLessThan(both.size, copies.size);
+    XCTAssertLessThan(both.size - one.size, one.size);
+}
+
+- (void)testMissingLists
+{
+    MTPersistentMathList* version = [self versionForLaTeX:@"a+\\sqrt{x}"];
+    MTMathAtom* two = [MTMathAtomFactory atomForCharacter:'2'];
+    [self assertVersion:[version listByInsertingAtom:two atListIndex:[self superscriptIndex:0]] isLaTeX:@"a^{2}+\\sqrt{x}"];
+    MTMathListIndex* degree = [MTMathListIndex indexAtLocation:2 withSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeDegree];
+    [self assertVersion:[version listByInsertingAtom:two atListIndex:degree] isLaTeX:@"a+\\sqrt[2]{x}"];
+
+    // Lists the atoms cannot have, and atoms that are not there.
+    MTMathListIndex* numerator = [MTMathListIndex indexAtLocation:0 withSubIndex:[MTMathListIndex level0Index:0] type:kMTSubIndexTypeNumerator];
+    XCTAssertNil([version listByInsertingAtom:two atListIndex:numerator]);
+    XCTAssertNil([version listByInsertingAtom:two atListIndex:[MTMathListIndex level0Index:4]]);
+    XCTAssertNil([version listByRemovingAtomAtListIndex:[MTMathListIndex level0Index:3]]);
+    XCTAssertNil([version listByRemovingAtomAtListIndex:degree]);
+    XCTAssertNotNil([version listByInsertingAtom:two atListIndex:[MTMathListIndex level0Index:3]]);
+}
+
+- (void)testMutableConversion
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:@"x^{2}"];
+    MTPersistentMathList* version = [[MTPersistentMathList alloc] initWithMathList:list];
+    [list addAtom:[MTMathAtomFactory atomForCharacter:'y']];
+    [self assertVersion:version isLaTeX:@"x^{2}"];
+
+    MTMathList* mutable = version.mutableMathList;
+    MTMathAtom* x = mutable.atoms[0];
+    [x.superScript addAtom:[MTMathAtomFactory atomForCharacter:'3']];
+    [self assertVersion:version isLaTeX:@"x^{2}"];
+    [self assertVersion:[[MTPersistentMathList alloc] initWithMathList:mutable] isLaTeX:@"x^{23}"];
+    [self assertVersion:[MTPersistentMathList new] isLaTeX:@""];
+}
+
+@end
@@ -0,0 +1,76 @@
+//
+//  MTRGBAColorTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTRGBAColor.h"
+#import "MTColorCache.h"
+
+@interface MTRGBAColorTest : XCTestCase
+
+@end
+
+@implementation MTRGBAColorTest
+
+- (void)testHexColors
+{
+    MTRGBAColor color = 0;
+    XCTAssertTrue(MTRGBAColorFromString(@"#44AA99", &color));
+    XCTAssertEqual(color, 0x44AA99FFu);
+    XCTAssertTrue(MTRGBAColorFromString(@"#4a9", &color));
+    XCTAssertEqual(color, 0x44AA99FFu);
+    XCTAssertTrue(MTRGBAColorFromString(@"#000000", &color));
+    XCTAssertEqual(color, 0x000000FFu);
+}
+
+- (void)testNamedColorsIgnoreCase
+{
+    MTRGBAColor lower = 0, upper = 0, mixed = 0;
+    XCTAssertTrue(MTRGBAColorFromString(@"cornflowerblue", &lower));
+    XCTAssertTrue(MTRGBAColorFromString(@"CORNFLOWERBLUE", &upper));
+    XCTAssertTrue(MTRGBAColorFromString(@"CornflowerBlue", &mixed));
+    XCTAssertEqual(lower, 0x6495EDFFu);
+    XCTAssertEqual(upper, lower);
+    XCTAssertEqual(mixed, lower);
+
+    MTRGBAColor gray = 0, grey = 0;
+    XCTAssertTrue(MTRGBAColorFromString(@"lightslategray", &gray));
+    XCTAssertTrue(MTRGBAColorFromString(@"lightslategrey", &grey));
+    XCTAssertEqual(gray, grey);
+}
+
+- (void)testRejectedStrings
+{
+    NSArray<NSString*>* strings = @[ @"", @"#", @"#ff00", @"ff0000", @"#gg0000", @"#ff00001",
+                                     @"reddish", @"re", @"lightgoldenrodyellowish", @"rød", @"#ff 00" ];
+    for (NSString* string in strings) {
+        MTRGBAColor color = 0x12345678;
+        XCTAssertFalse(MTRGBAColorFromString(string, &color), @"%@", string);
+        XCTAssertEqual(color, 0x12345678u, @"%@", string);
+    }
+}
+
+- (void)testColorsAreShared
+{
+    XCTAssertNil(MTColorForRGBA(0));
+    MTColor* first = MTColorForRGBA(0xFF8000FF);
+    MTColor* second = MTColorForRGBA(0xFF8000FF);
+    XCTAssertNotNil(first);
+    XCTAssertEqual(first, second);
+    XCTAssertEqual(first.CGColor, second.CGColor);
+    XCTAssertNotEqual(MTColorForRGBA(0xFF8001FF), first);
+
+    const CGFloat* components = CGColorGetComponents(first.CGColor);
+    XCTAssertEqual(CGColorGetNumberOfComponents(first.CGColor), 4u);
+    XCTAssertEqualWithAccuracy(components[0], 1, 0.001);
+    XCTAssertEqualWithAccuracy(components[1], 128 / 255.0, 0.001);
+    XCTAssertEqualWithAccuracy(components[2], 0, 0.001);
+    XCTAssertEqualWithAccuracy(components[3], 1, 0.001);
+}
+
+@end
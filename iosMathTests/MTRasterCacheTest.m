@@ -0,0 +1,233 @@
+//
+//  MTRasterCacheTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+#import "MTRasterCache.h"
+#import "MTTypesetter.h"
+#import "MTFontManager.h"
+#import "MTMathListDisplay.h"
+#import "MTMathListBuilder.h"
+#import "MTMathUILabel.h"
+#import "MTMathUILabelInternal.h"
+
+static NSArray<NSString*>* rasterLaTeX(void)
+{
+    return @[@"x^2 + y_1 = \\alpha",
+             @"\\frac{1}{2} + \\sqrt[3]{x+1}",
+             @"\\sum_{i=0}^{n} i^2 + \\int_0^1 x\\,dx",
+             @"\\color{red}{x+y} + \\colorbox{yellow}{z} + w",
+             @"V",
+             @"\\begin{pmatrix} 1 & 0 \\\\ 0 & 1 \\end{pmatrix}"];
+}
+
+// A transparent RGBA bitmap context, with `scale` pixels per point.
+static CGContextRef createContext(size_t width, size_t height, CGFloat scale)
+{
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, width * 4, colorSpace,
+                                                 (CGBitmapInfo) kCGImageAlphaPremultipliedLast);
+    CGColorSpaceRelease(colorSpace);
+    CGContextScaleCTM(context, scale, scale);
+    return context;
+}
+
+@interface MTRasterCacheTest : XCTestCase
+
+@property (nonatomic) MTFont* font;
+
+@end
+
+@implementation MTRasterCacheTest
+
+- (void)setUp {
+    [super setUp];
+    self.font = MTFontManager.fontManager.defaultFont;
+}
+
+- (MTMathListDisplay*)displayForLaTeX:(NSString*)latex
+{
+    MTMathListDisplay* display = [MTTypesetter createLineForMathList:[MTMathListBuilder buildFromString:latex]
+                                                                font:self.font style:kMTLineStyleDisplay];
+    display.textColor = [MTColor blackColor];
+    display.position = CGPointMake(10, 10 + display.descent);
+    return display;
+}
+
+- (MTRasterKey*)keyForLaTeX:(NSString*)latex
+{
+    return [[MTRasterKey alloc] initWithLatex:latex font:self.font style:kMTLineStyleDisplay
+                                    textColor:[MTColor blackColor] scale:2];
+}
+
+// Drawing the bitmap gives the same pixels as drawing the display.
+- (void)testImageMatchesLiveDrawing
+{
+    CGFloat scale = 2;
+    for (NSString* latex in rasterLaTeX()) {
+        MTMathListDisplay* display = [self displayForLaTeX:latex];
+        MTRasterImage* image = [MTRasterImage imageWithDisplay:display scale:scale];
+        XCTAssertNotNil(image, @"%@", latex);
+        XCTAssertEqual(image.scale, scale);
+        XCTAssertEqual(image.byteCount, CGImageGetBytesPerRow(image.image) * CGImageGetHeight(image.image));
+        // The bitmap covers the ink, which is at least the typographic width here.
+        XCTAssertGreaterThanOrEqual(CGRectGetWidth(image.rect), display.width, @"%@", latex);
+
+        size_t width = (size_t) ceil((display.position.x + display.inkWidth + 10) * scale);
+        size_t height = (size_t) ceil((display.position.y + display.ascent + 10) * scale);
+        CGContextRef expected = createContext(width, height, scale);
+        [display draw:expected];
+        CGContextRef actual = createContext(width, height, scale);
+        [image drawAtPosition:display.position context:actual];
+
+        const uint8_t* expectedBytes = CGBitmapContextGetData(expected);
+        const uint8_t* actualBytes = CGBitmapContextGetData(actual);
+        NSUInteger differing = 0;
+        for (size_t i = 0; i < width * height * 4; i++) {
+            if (abs((int) expectedBytes[i] - (int) actualBytes[i]) > 2) {
+                differing++;
+            }
+        }
+        XCTAssertEqual(differing, 0u, @"%@", latex);
+        CGContextRelease(expected);
+        CGContextRelease(actual);
+    }
+}
+
+// The bitmap does not depend on where the display is positioned.
+- (void)testImageRectIsRelativeToPosition
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@"\\frac{a}{b}"];
+    MTRasterImage* image = [MTRasterImage imageWithDisplay:display scale:2];
+    display.position = CGPointMake(100, 50);
+    MTRasterImage* moved = [MTRasterImage imageWithDisplay:display scale:2];
+    XCTAssertTrue(CGRectEqualToRect(image.rect, moved.rect));
+}
+
+- (void)testEmptyDisplayHasNoImage
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@""];
+    XCTAssertNil([MTRasterImage imageWithDisplay:display scale:2]);
+}
+
+- (void)testKeyEquality
+{
+    MTRasterKey* key = [self keyForLaTeX:@"x^2"];
+    XCTAssertEqualObjects(key, [self keyForLaTeX:@"x^2"]);
+    XCTAssertEqual(key.hash, [self keyForLaTeX:@"x^2"].hash);
+    XCTAssertNotEqualObjects(key, [self keyForLaTeX:@"x^3"]);
+    MTColor* red = [MTColor redColor];
+    XCTAssertNotEqualObjects(key, [[MTRasterKey alloc] initWithLatex:@"x^2" font:self.font style:kMTLineStyleDisplay textColor:red scale:2]);
+    XCTAssertNotEqualObjects(key, [[MTRasterKey alloc] initWithLatex:@"x^2" font:self.font style:kMTLineStyleText textColor:[MTColor blackColor] scale:2]);
+    XCTAssertNotEqualObjects(key, [[MTRasterKey alloc] initWithLatex:@"x^2" font:self.font style:kMTLineStyleDisplay textColor:[MTColor blackColor] scale:3]);
+    MTFont* larger = [self.font copyFontWithSize:self.font.fontSize * 2];
+    XCTAssertNotEqualObjects(key, [[MTRasterKey alloc] initWithLatex:@"x^2" font:larger style:kMTLineStyleDisplay textColor:[MTColor blackColor] scale:2]);
+}
+
+- (void)testLeastRecentlyUsedIsEvicted
+{
+    // The same bitmap under four keys, so that every entry takes the same memory.
+    MTRasterImage* image = [MTRasterImage imageWithDisplay:[self displayForLaTeX:@"x"] scale:2];
+    NSUInteger size = image.byteCount;
+    MTRasterCache* cache = [[MTRasterCache alloc] initWithByteLimit:3 * size];
+    for (NSString* latex in @[@"a", @"b", @"c"]) {
+        [cache setImage:image forKey:[self keyForLaTeX:latex]];
+    }
+    XCTAssertEqual(cache.count, 3u);
+    XCTAssertEqual(cache.byteCount, 3 * size);
+
+    // Using "a" makes "b" the least recently used one.
+    XCTAssertEqual([cache imageForKey:[self keyForLaTeX:@"a"]], image);
+    [cache setImage:image forKey:[self keyForLaTeX:@"d"]];
+    XCTAssertEqual(cache.count, 3u);
+    XCTAssertNil([cache imageForKey:[self keyForLaTeX:@"b"]]);
+    XCTAssertNotNil([cache imageForKey:[self keyForLaTeX:@"a"]]);
+    XCTAssertNotNil([cache imageForKey:[self keyForLaTeX:@"c"]]);
+    XCTAssertNotNil([cache imageForKey:[self keyForLaTeX:@"d"]]);
+
+    // Lowering the limit evicts right away, from the least recently used end ("a").
+    cache.byteLimit = 2 * size;
+    XCTAssertEqual(cache.count, 2u);
+    XCTAssertNil([cache imageForKey:[self keyForLaTeX:@"a"]]);
+
+    // Replacing an image does not count it twice.
+    [cache setImage:image forKey:[self keyForLaTeX:@"c"]];
+    XCTAssertEqual(cache.byteCount, 2 * size);
+    [cache removeImageForKey:[self keyForLaTeX:@"c"]];
+    XCTAssertEqual(cache.count, 1u);
+    XCTAssertEqual(cache.byteCount, size);
+    [cache removeAllImages];
+    XCTAssertEqual(cache.count, 0u);
+    XCTAssertEqual(cache.byteCount, 0u);
+}
+
+- (void)testImageLargerThanLimitIsNotCached
+{
+    MTRasterImage* image = [MTRasterImage imageWithDisplay:[self displayForLaTeX:@"x"] scale:2];
+    MTRasterCache* cache = [[MTRasterCache alloc] initWithByteLimit:image.byteCount - 1];
+    [cache setImage:image forKey:[self keyForLaTeX:@"x"]];
+    XCTAssertEqual(cache.count, 0u);
+    XCTAssertEqual(cache.byteCount, 0u);
+}
+
+- (void)testImageForKeyRendersOnMiss
+{
+    MTRasterCache* cache = [[MTRasterCache alloc] init];
+    MTRasterKey* key = [self keyForLaTeX:@"\\sqrt{2}"];
+    MTMathListDisplay* display = [self displayForLaTeX:@"\\sqrt{2}"];
+    MTRasterImage* image = [cache imageForKey:key display:display];
+    XCTAssertNotNil(image);
+    XCTAssertEqual(cache.count, 1u);
+    XCTAssertEqual([cache imageForKey:key display:display], image);
+}
+
+- (void)testConcurrentAccess
+{
+    MTRasterCache* cache = [[MTRasterCache alloc] init];
+    NSArray<NSString*>* formulas = rasterLaTeX();
+    NSMutableArray<MTMathListDisplay*>* displays = [NSMutableArray array];
+    for (NSString* latex in formulas) {
+        [displays addObject:[self displayForLaTeX:latex]];
+    }
+    // Small enough that images are evicted while the others are being looked up.
+    MTRasterImage* first = [MTRasterImage imageWithDisplay:displays[0] scale:2];
+    cache.byteLimit = first.byteCount * 3;
+    dispatch_apply(64, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+        // Each worker renders its own display, they are not safe to share.
+        NSString* latex = formulas[i % formulas.count];
+        MTMathListDisplay* display = [MTTypesetter createLineForMathList:[MTMathListBuilder buildFromString:latex]
+                                                                    font:self.font style:kMTLineStyleDisplay];
+        display.textColor = [MTColor blackColor];
+        for (NSUInteger j = 0; j < 20; j++) {
+            (void)[cache imageForKey:[self keyForLaTeX:latex] display:display];
+        }
+    });
+    XCTAssertLessThanOrEqual(cache.byteCount, cache.byteLimit);
+}
+
+// An asynchronous label renders its bitmap on the background queue.
+- (void)testAsyncLabelFillsCache
+{
+    MTRasterCache* cache = [[MTRasterCache alloc] init];
+    MTMathUILabel* label = [[MTMathUILabel alloc] init];
+    label.rasterCache = cache;
+    label.layoutsAsynchronously = YES;
+    label.latex = @"\\frac{1}{2}";
+    (void)[label sizeThatFits:CGSizeZero];
+    NSDate* deadline = [NSDate dateWithTimeIntervalSinceNow:10];
+    while (label.asynchronousLayoutPending && [deadline timeIntervalSinceNow] > 0) {
+        [[NSRunLoop mainRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    XCTAssertEqual(cache.count, 1u);
+    MTRasterKey* key = [[MTRasterKey alloc] initWithLatex:label.latex font:label.font style:kMTLineStyleDisplay
+                                                textColor:label.textColor scale:[label screenScale]];
+    XCTAssertNotNil([cache imageForKey:key]);
+}
+
+@end
@@ -0,0 +1,155 @@
+//
+//  MTRetainedSizeTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTTypesetter.h"
+#import "MTFontManager.h"
+#import "MTMathListDisplay.h"
+#import "MTMathListBuilder.h"
+#import "MTMathUILabel.h"
+#import "../MathExamples.h"
+
+@interface MTRetainedSizeTest : XCTestCase
+
+@property (nonatomic) MTFont* font;
+
+@end
+
+@implementation MTRetainedSizeTest
+
+- (void)setUp {
+    [super setUp];
+    self.font = MTFontManager.fontManager.defaultFont;
+}
+
+- (MTMathListDisplay*)displayForLaTeX:(NSString*)latex
+{
+    return [self displayForLaTeX:latex retainsAtoms:YES];
+}
+
+- (MTMathListDisplay*)displayForLaTeX:(NSString*)latex retainsAtoms:(BOOL)retainsAtoms
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:latex];
+    XCTAssertNotNil(list, @"%@", latex);
+    return [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay retainsAtoms:retainsAtoms];
+}
+
+- (void)testMathListSize
+{
+    MTMathList* empty = [MTMathList new];
+    MTMathList* small = [MTMathListBuilder buildFromString:@"x"];
+    MTMathList* large = [MTMathListBuilder buildFromString:@"\\frac{x^2+y^2}{\\sqrt{z_1 + z_2}}"];
+    XCTAssertGreaterThan(empty.retainedSize, 0u);
+    XCTAssertGreaterThan(small.retainedSize, empty.retainedSize);
+    XCTAssertGreaterThan(large.retainedSize, small.retainedSize);
+    // The scripts and inner lists are counted.
+    MTMathList* scripted = [MTMathListBuilder buildFromString:@"x^{a+b+c+d}"];
+    XCTAssertGreaterThan(scripted.retainedSize, small.retainedSize + 4 * sizeof(void*));
+}
+
+- (void)testDisplaySize
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@"\\frac{1}{2} + \\left( \\begin{matrix} 1 \\\\ 2 \\\\ 3 \\\\ 4 \\\\ 5 \\end{matrix} \\right)"];
+    NSUInteger size = display.retainedSize;
+    XCTAssertGreaterThan(size, 0u);
+    NSUInteger children = 0;
+    for (MTDisplay* sub in display.subDisplays) {
+        XCTAssertGreaterThan(sub.retainedSize, 0u);
+        children += sub.retainedSize;
+    }
+    XCTAssertGreaterThan(size, children);
+    // Measuring does not change anything.
+    XCTAssertEqual(display.retainedSize, size);
+}
+
+- (void)testAtomsAreOptional
+{
+    NSString* latex = @"x+\\sin y = \\frac{ab}{c} \\sum_i z_i";
+    MTMathListDisplay* withAtoms = [self displayForLaTeX:latex];
+    MTMathListDisplay* withoutAtoms = [self displayForLaTeX:latex retainsAtoms:NO];
+
+    MTCTLineDisplay* line = (MTCTLineDisplay*) withoutAtoms.subDisplays[0];
+    XCTAssertTrue([line isKindOfClass:[MTCTLineDisplay class]]);
+    XCTAssertEqual(line.atoms.count, 0u);
+    XCTAssertGreaterThan(((MTCTLineDisplay*) withAtoms.subDisplays[0]).atoms.count, 0u);
+    XCTAssertLessThan(withoutAtoms.retainedSize, withAtoms.retainedSize);
+    // Nor do the lines of the inner lists.
+    NSUInteger fractions = 0;
+    for (MTDisplay* sub in withoutAtoms.subDisplays) {
+        if ([sub isKindOfClass:[MTFractionDisplay class]]) {
+            MTFractionDisplay* fraction = (MTFractionDisplay*) sub;
+            XCTAssertEqual(((MTCTLineDisplay*) fraction.numerator.subDisplays[0]).atoms.count, 0u);
+            XCTAssertEqual(((MTCTLineDisplay*) fraction.denominator.subDisplays[0]).atoms.count, 0u);
+            fractions++;
+        }
+    }
+    XCTAssertEqual(fractions, 1u);
+
+    // Hit testing does not need the atoms.
+    for (CGFloat x = -5; x < withAtoms.width + 5; x += 1) {
+        CGPoint point = CGPointMake(x, 0);
+        CGFloat offset1 = 0, offset2 = 0;
+        XCTAssertEqualObjects([withAtoms closestIndexToPoint:point caretOffset:&offset1],
+                              [withoutAtoms closestIndexToPoint:point caretOffset:&offset2], @"%f", x);
+        XCTAssertEqual(offset1, offset2);
+    }
+}
+
+- (void)testLabelRetainsAtoms
+{
+    MTMathUILabel* label = [[MTMathUILabel alloc] init];
+    label.latex = @"x+y";
+    XCTAssertTrue(label.retainsAtoms);
+    [label layoutSubviews];
+    XCTAssertGreaterThan(((MTCTLineDisplay*) label.displayList.subDisplays[0]).atoms.count, 0u);
+
+    label.retainsAtoms = NO;
+    [label layoutSubviews];
+    XCTAssertEqual(((MTCTLineDisplay*) label.displayList.subDisplays[0]).atoms.count, 0u);
+    // Other layouts are not affected.
+    XCTAssertGreaterThan(((MTCTLineDisplay*) [self displayForLaTeX:@"x+y"].subDisplays[0]).atoms.count, 0u);
+}
+
+- (void)testColorsAreShared
+{
+    MTMathListDisplay* first = [self displayForLaTeX:@"x+1"];
+    MTMathListDisplay* second = [self displayForLaTeX:@"\\frac{1}{y}"];
+    first.textColor = [MTColor colorWithRed:0.25 green:0.5 blue:0.75 alpha:1];
+    second.textColor = [MTColor colorWithRed:0.25 green:0.5 blue:0.75 alpha:1];
+    XCTAssertEqual(first.textColor, second.textColor);
+    XCTAssertEqual(first.subDisplays[0].textColor, second.subDisplays[0].textColor);
+
+    first.localBackgroundColor = [MTColor yellowColor];
+    XCTAssertEqualObjects(first.localBackgroundColor, [MTColor yellowColor]);
+    XCTAssertEqualObjects(first.textColor, second.textColor);
+    XCTAssertNil(second.localBackgroundColor);
+    first.localBackgroundColor = nil;
+    XCTAssertNil(first.localBackgroundColor);
+    XCTAssertEqual(first.textColor, second.textColor);
+}
+
+// The displays of the example formulas are smaller without the atoms. The sizes are logged by the
+// retained size benchmark.
+- (void)testExampleFootprint
+{
+    NSUInteger count = 0, displayBytes = 0, slimBytes = 0;
+    for (NSString* latex in MathDemoFormulas()) {
+        MTMathList* list = [MTMathListBuilder buildFromString:latex];
+        if (!list) {
+            continue;
+        }
+        count++;
+        displayBytes += [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay retainsAtoms:YES].retainedSize;
+        slimBytes += [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay retainsAtoms:NO].retainedSize;
+    }
+    XCTAssertGreaterThan(count, 0u);
+    XCTAssertLessThan(slimBytes, displayBytes);
+}
+
+@end
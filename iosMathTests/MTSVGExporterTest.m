@@ -0,0 +1,180 @@
+//
+//  MTSVGExporterTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTSVGExporter.h"
+#import "MTTypesetter.h"
+#import "MTFontManager.h"
+#import "MTMathListDisplay.h"
+#import "MTMathListBuilder.h"
+#import "../MathExamples.h"
+
+// Counts the elements of an SVG document and checks that every <use> refers to a <path> of
+// the <defs>.
+@interface MTSVGElementCounter : NSObject <NSXMLParserDelegate>
+@property (nonatomic) NSCountedSet<NSString*>* elements;
+@property (nonatomic) NSMutableSet<NSString*>* definedIds;
+@property (nonatomic) NSMutableSet<NSString*>* usedIds;
+@property (nonatomic) NSMutableArray<NSDictionary<NSString*, NSString*>*>* paths;
+@property (nonatomic) NSDictionary<NSString*, NSString*>* rootAttributes;
+@end
+
+@implementation MTSVGElementCounter
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _elements = [NSCountedSet set];
+        _definedIds = [NSMutableSet set];
+        _usedIds = [NSMutableSet set];
+        _paths = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void)parser:(NSXMLParser *)parser didStartElement:(NSString *)elementName namespaceURI:(NSString *)namespaceURI
+ qualifiedName:(NSString *)qName attributes:(NSDictionary<NSString *,NSString *> *)attributeDict
+{
+    [_elements addObject:elementName];
+    if ([elementName isEqualToString:@"svg"]) {
+        _rootAttributes = attributeDict;
+    } else if ([elementName isEqualToString:@"path"]) {
+        if (attributeDict[@"id"]) {
+            [_definedIds addObject:attributeDict[@"id"]];
+        } else {
+            [_paths addObject:attributeDict];
+        }
+    } else if ([elementName isEqualToString:@"use"]) {
+        [_usedIds addObject:[attributeDict[@"xlink:href"] substringFromIndex:1]];
+    }
+}
+
+@end
+
+@interface MTSVGExporterTest : XCTestCase
+
+@property (nonatomic) MTFont* font;
+@property (nonatomic) MTSVGExporter* exporter;
+
+@end
+
+@implementation MTSVGExporterTest
+
+- (void)setUp {
+    [super setUp];
+    self.font = MTFontManager.fontManager.defaultFont;
+    self.exporter = [[MTSVGExporter alloc] init];
+}
+
+- (MTMathListDisplay*)displayForLaTeX:(NSString*)latex
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:latex];
+    if (!list) {
+        return nil;
+    }
+    return [MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay];
+}
+
+- (MTSVGElementCounter*)parse:(NSData*)svg
+{
+    MTSVGElementCounter* counter = [[MTSVGElementCounter alloc] init];
+    NSXMLParser* parser = [[NSXMLParser alloc] initWithData:svg];
+    parser.delegate = counter;
+    XCTAssertTrue([parser parse], @"%@", parser.parserError);
+    return counter;
+}
+
+- (void)testWellFormedForAllExamples
+{
+    NSArray<NSString*>* formulas = [MathDemoFormulas() arrayByAddingObjectsFromArray:MathTestFormulas()];
+    for (NSString* latex in formulas) {
+        MTMathListDisplay* display = [self displayForLaTeX:latex];
+        if (!display) {
+            continue;
+        }
+        MTSVGElementCounter* counter = [self parse:[self.exporter SVGDataForDisplay:display]];
+        XCTAssertEqual([counter.elements countForObject:@"svg"], 1u, @"%@", latex);
+        XCTAssertEqual([counter.elements countForObject:@"defs"], 1u, @"%@", latex);
+        XCTAssertTrue([counter.usedIds isSubsetOfSet:counter.definedIds], @"%@", latex);
+        XCTAssertEqualObjects(counter.usedIds, counter.definedIds, @"unused glyph outline in %@", latex);
+    }
+}
+
+- (void)testRepeatedGlyphsAreDefinedOnce
+{
+    MTSVGElementCounter* counter = [self parse:[self.exporter SVGDataForDisplay:[self displayForLaTeX:@"xxxx"]]];
+    XCTAssertEqual(counter.definedIds.count, 1u);
+    XCTAssertEqual([counter.elements countForObject:@"use"], 4u);
+
+    counter = [self parse:[self.exporter SVGDataForDisplay:[self displayForLaTeX:@"x^x + x_x"]]];
+    // x, the smaller script x and +.
+    XCTAssertEqual(counter.definedIds.count, 3u);
+    XCTAssertEqual([counter.elements countForObject:@"use"], 5u);
+}
+
+- (void)testRulesBecomeStrokedPaths
+{
+    MTSVGElementCounter* counter = [self parse:[self.exporter SVGDataForDisplay:[self displayForLaTeX:@"\\frac{a}{\\sqrt{b}} + \\cancel{c}"]]];
+    // The fraction bar, the radical overline and the strike.
+    XCTAssertEqual(counter.paths.count, 3u);
+    for (NSDictionary<NSString*, NSString*>* path in counter.paths) {
+        XCTAssertEqualObjects(path[@"fill"], @"none");
+        XCTAssertEqualObjects(path[@"stroke"], @"currentColor");
+        XCTAssertGreaterThan(path[@"stroke-width"].doubleValue, 0);
+        XCTAssertTrue([path[@"d"] hasPrefix:@"M"]);
+    }
+}
+
+- (void)testColors
+{
+    NSString* svg = [self.exporter SVGStringForDisplay:[self displayForLaTeX:@"\\color{#ff0000}{x} + \\colorbox{#00ff00}{y}"]];
+    XCTAssertTrue([svg containsString:@"fill=\"#ff0000\""], @"%@", svg);
+    XCTAssertTrue([svg containsString:@"<rect"], @"%@", svg);
+    XCTAssertTrue([svg containsString:@"fill=\"#00ff00\""], @"%@", svg);
+}
+
+// The box covers the display, with the baseline at y = 0.
+- (void)testViewBox
+{
+    MTMathListDisplay* display = [self displayForLaTeX:@"\\frac{1}{2}"];
+    display.position = CGPointMake(30, 40);
+    MTSVGElementCounter* counter = [self parse:[self.exporter SVGDataForDisplay:display]];
+    NSArray<NSString*>* viewBox = [counter.rootAttributes[@"viewBox"] componentsSeparatedByString:@" "];
+    XCTAssertEqual(viewBox.count, 4u);
+    XCTAssertLessThanOrEqual(viewBox[0].doubleValue, 0.01);
+    XCTAssertLessThanOrEqual(viewBox[1].doubleValue, -display.ascent + 0.01);
+    XCTAssertGreaterThanOrEqual(viewBox[2].doubleValue, display.width - 0.01);
+    XCTAssertGreaterThanOrEqual(viewBox[3].doubleValue, display.ascent + display.descent - 0.01);
+    XCTAssertEqualObjects(counter.rootAttributes[@"width"], viewBox[2]);
+    XCTAssertEqualObjects(counter.rootAttributes[@"height"], viewBox[3]);
+}
+
+- (void)testStreamMatchesData
+{
+    MTMathListDisplay* display = [self displayForLaTeX:MathDemoFormulas()[0]];
+    NSOutputStream* stream = [NSOutputStream outputStreamToMemory];
+    [stream open];
+    NSError* error = nil;
+    XCTAssertTrue([self.exporter writeDisplay:display toStream:stream error:&error]);
+    XCTAssertNil(error);
+    NSData* streamed = [stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+    [stream close];
+    XCTAssertEqualObjects(streamed, [self.exporter SVGDataForDisplay:display]);
+}
+
+- (void)testClosedStreamFails
+{
+    NSOutputStream* stream = [NSOutputStream outputStreamToMemory];
+    NSError* error = nil;
+    XCTAssertFalse([self.exporter writeDisplay:[self displayForLaTeX:@"x"] toStream:stream error:&error]);
+    XCTAssertNotNil(error);
+}
+
+@end
@@ -0,0 +1,195 @@
+//
+//  MTSharedAtomTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTMathList.h"
+#import "MTMathListBuilder.h"
+#import "MTMathAtomFactory.h"
+#import "MTMathParserContext.h"
+#import "MTMathListInternal.h"
+#import "MTInstrumentation.h"
+
+@interface MTSharedAtomTest : XCTestCase
+
+@end
+
+@implementation MTSharedAtomTest
+
+- (void)testSharedAtomsAreFrozen
+{
+    MTMathAtom* x = [MTMathAtomFactory sharedAtomForCharacter:'x'];
+    XCTAssertTrue(x.frozen);
+    XCTAssertEqual([MTMathAtomFactory sharedAtomForCharacter:'x'], x);
+    XCTAssertNil([MTMathAtomFactory sharedAtomForCharacter:'^']);
+    XCTAssertNil([MTMathAtomFactory sharedAtomForCharacter:0x3B1]);
+    XCTAssertThrows(x.nucleus = @"y");
+
+    MTMathAtom* alpha = [MTMathAtomFactory sharedAtomForLatexSymbolName:@"alpha"];
+    XCTAssertTrue(alpha.frozen);
+    XCTAssertEqual([MTMathAtomFactory sharedAtomForLatexSymbolName:@"alpha"], alpha);
+    XCTAssertThrows(alpha.superScript = [MTMathList new]);
+    XCTAssertThrows(alpha.fontStyle = kMTFontStyleBold);
+    XCTAssertEqual(alpha.fontStyle, kMTFontStyleDefault);
+    // An alias shares the atom of its symbol.
+    XCTAssertEqual([MTMathAtomFactory sharedAtomForLatexSymbolName:@"le"], [MTMathAtomFactory sharedAtomForLatexSymbolName:@"leq"]);
+
+    // The atoms that are made anew can be changed, and do not change the shared one.
+    MTMathAtom* copy = [MTMathAtomFactory atomForLatexSymbolName:@"alpha"];
+    XCTAssertFalse(copy.frozen);
+    copy.nucleus = @"a";
+    XCTAssertEqualObjects(alpha.nucleus, @"\u03B1");
+
+    MTMathParserContext* context = [MTMathParserContext.defaultContext contextByAddingSymbol:@"lcmx"
+                                                                                      value:[MTMathAtomFactory operatorWithName:@"lcm" limits:NO]];
+    XCTAssertTrue([context sharedAtomForLatexSymbolName:@"lcmx"].frozen);
+    XCTAssertEqual([context sharedAtomForLatexSymbolName:@"alpha"], alpha);
+}
+
+- (void)testParsedListsShareAtoms
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:@"x+\\alpha"];
+    NSArray<MTMathAtom*>* shared = list.atomsForReading;
+    XCTAssertEqual(shared[0], [MTMathAtomFactory sharedAtomForCharacter:'x']);
+    XCTAssertEqual(shared[2], [MTMathAtomFactory sharedAtomForLatexSymbolName:@"alpha"]);
+    uint64_t fingerprint = list.fingerprint;
+
+    // The atoms of the list are its own once it is asked for them.
+    NSArray<MTMathAtom*>* atoms = list.atoms;
+    XCTAssertEqual(atoms.count, 3u);
+    for (NSUInteger i = 0; i < atoms.count; i++) {
+        XCTAssertFalse(atoms[i].frozen);
+        XCTAssertNotEqual(atoms[i], shared[i]);
+        XCTAssertEqualObjects(atoms[i].nucleus, shared[i].nucleus);
+    }
+    XCTAssertEqual(list.atoms[0], atoms[0]);
+    XCTAssertEqual(list.fingerprint, fingerprint);
+    atoms[0].nucleus = @"y";
+    XCTAssertEqualObjects([MTMathAtomFactory sharedAtomForCharacter:'x'].nucleus, @"x");
+    XCTAssertEqualObjects([MTMathListBuilder mathListToString:list], @"y+\\alpha ");
+
+    // And so are the atoms of a copy.
+    MTMathList* copy = [[MTMathListBuilder buildFromString:@"x+\\alpha"] copy];
+    for (MTMathAtom* atom in copy.atomsForReading) {
+        XCTAssertFalse(atom.frozen);
+    }
+}
+
+- (void)testChangesCopySharedAtoms
+{
+    MTMathAtom* x = [MTMathAtomFactory sharedAtomForCharacter:'x'];
+    MTLargeOperator* integral = [MTMathAtomFactory sharedAtomForLatexSymbolName:@"int"];
+    MTMathList* list = [MTMathListBuilder buildFromString:@"x^2 \\alpha_i x' \\int\\limits \\mathbf{x}"];
+    NSArray<MTMathAtom*>* atoms = list.atomsForReading;
+    XCTAssertEqual(atoms.count, 5u);
+    for (MTMathAtom* atom in atoms) {
+        XCTAssertFalse(atom.frozen, @"%@", atom);
+    }
+    XCTAssertEqualObjects(atoms[0].superScript.stringValue, @"2");
+    XCTAssertEqualObjects(atoms[1].subScript.stringValue, @"i");
+    XCTAssertEqual(atoms[2].superScript.atomsForReading.count, 1u);
+    XCTAssertTrue(((MTLargeOperator*) atoms[3]).limits);
+    XCTAssertEqual(atoms[4].fontStyle, kMTFontStyleBold);
+
+    // The shared atoms are unchanged.
+    XCTAssertNil(x.superScript);
+    XCTAssertEqual(x.fontStyle, kMTFontStyleDefault);
+    XCTAssertNil([MTMathAtomFactory sharedAtomForLatexSymbolName:@"alpha"].subScript);
+    XCTAssertFalse(integral.limits);
+    XCTAssertEqualObjects([MTMathListBuilder mathListToString:list], @"x^{2}\\alpha _{i}x^{\\prime }\\int \\limits \\mathbf{x}");
+}
+
+- (void)testStyledPrimesAreDistinct
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:@"\\mathbf{f''}"];
+    XCTAssertEqual(list.atomsForReading.count, 1u);
+    NSArray<MTMathAtom*>* primes = list.atomsForReading[0].superScript.atomsForReading;
+    XCTAssertEqual(primes.count, 2u);
+    XCTAssertNotEqual(primes[0], primes[1]);
+    for (MTMathAtom* prime in primes) {
+        XCTAssertFalse(prime.frozen);
+        XCTAssertEqual(prime.fontStyle, kMTFontStyleBold);
+    }
+    primes[0].nucleus = @"x";
+    XCTAssertEqualObjects(primes[1].nucleus, [MTMathAtomFactory sharedAtomForLatexSymbolName:@"prime"].nucleus);
+
+    // Unstyled primes share the frozen atom.
+    primes = [MTMathListBuilder buildFromString:@"f''"].atomsForReading[0].superScript.atomsForReading;
+    XCTAssertEqual(primes[0], primes[1]);
+    XCTAssertTrue(primes[0].frozen);
+}
+
+- (void)testParsingAllocatesNoSymbolAtoms
+{
+    NSMutableString* latex = [NSMutableString string];
+    for (int i = 0; i < 250; i++) {
+        [latex appendString:@"x+\\alpha="];
+    }
+    // The shared atoms are made on first use.
+    XCTAssertNotNil([MTMathListBuilder buildFromString:latex]);
+
+    [MTInstrumentation resetStatistics];
+    MTInstrumentation.enabled = YES;
+    MTMathList* list = [MTMathListBuilder buildFromString:latex];
+    XCTAssertEqual(list.atomsForReading.count, 1000u);
+    XCTAssertEqual([[MTInstrumentation statistics] valueOfCounter:kMTLayoutCounterAtoms], 0u);
+
+    // A font style makes one copy for each atom.
+    [MTInstrumentation resetStatistics];
+    list = [MTMathListBuilder buildFromString:[NSString stringWithFormat:@"\\mathbf{%@}", latex]];
+    XCTAssertEqual(list.atomsForReading.count, 1000u);
+    XCTAssertEqual([[MTInstrumentation statistics] valueOfCounter:kMTLayoutCounterAtoms], 1000u);
+    MTInstrumentation.enabled = NO;
+    [MTInstrumentation resetStatistics];
+}
+
+- (void)testMutableAtom
+{
+    MTMathList* list = [MTMathList new];
+    MTMathAtom* x = [MTMathAtomFactory sharedAtomForCharacter:'x'];
+    MTMathAtom* y = [MTMathAtomFactory atomForCharacter:'y'];
+    [list addAtom:x];
+    [list addAtom:y];
+    XCTAssertEqual([list mutableAtom:y], y);
+    MTMathAtom* copy = [list mutableAtom:x];
+    XCTAssertNotEqual(copy, x);
+    XCTAssertFalse(copy.frozen);
+    XCTAssertEqual(list.atomsForReading[0], copy);
+    XCTAssertEqual(list.atoms[1], y);
+}
+
+- (void)testChangesAfterCopyingInvalidateFingerprints
+{
+    MTMathList* list = [MTMathListBuilder buildFromString:@"x+\\alpha"];
+    uint64_t before = list.fingerprint;
+    list.atoms[0].nucleus = @"y";
+    XCTAssertNotEqual(list.fingerprint, before);
+    XCTAssertEqual(list.fingerprint, [MTMathListBuilder buildFromString:@"y+\\alpha"].fingerprint);
+
+    // The lists above the one whose atoms are copied are invalidated too.
+    MTMathList* fraction = [MTMathListBuilder buildFromString:@"\\frac{x}{2}"];
+    before = fraction.fingerprint;
+    MTFraction* frac = (MTFraction*) fraction.atomsForReading[0];
+    frac.numerator.atoms[0].nucleus = @"y";
+    XCTAssertNotEqual(fraction.fingerprint, before);
+    XCTAssertEqual(fraction.fingerprint, [MTMathListBuilder buildFromString:@"\\frac{y}{2}"].fingerprint);
+}
+
+- (void)testFrozenListsKeepSharedAtoms
+{
+    MTMathList* frozen = [[MTMathListBuilder buildFromString:@"x+\\alpha"] frozenCopy];
+    NSArray<MTMathAtom*>* atoms = frozen.atoms;
+    XCTAssertEqual(atoms, frozen.atomsForReading);
+    for (MTMathAtom* atom in atoms) {
+        XCTAssertTrue(atom.frozen);
+    }
+    XCTAssertThrows(atoms[0].nucleus = @"y");
+    XCTAssertEqualObjects([MTMathListBuilder mathListToString:frozen], @"x+\\alpha ");
+}
+
+@end
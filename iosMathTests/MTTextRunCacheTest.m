@@ -0,0 +1,181 @@
+//
+//  MTTextRunCacheTest.m
+//  iosMath
+//
+//  This software may be modified and distributed under the terms of the
+//  MIT license. See the LICENSE file for details.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MTTextRunCache.h"
+#import "MTFontManager.h"
+#import "MTTypesetter.h"
+#import "MTMathListBuilder.h"
+#import "MTMathListDisplayInternal.h"
+#import "MTDrawCommandList.h"
+#import "MTInstrumentation.h"
+
+@interface MTTextRunCacheTest : XCTestCase
+
+@end
+
+@implementation MTTextRunCacheTest
+
+- (void)testTextFontsAreCached
+{
+    CTFontRef first = [MTFontManager textCTFontForStyle:kMTTextStyleBold size:21];
+    CTFontRef second = [MTFontManager textCTFontForStyle:kMTTextStyleBold size:21];
+    CTFontRef other = [MTFontManager textCTFontForStyle:kMTTextStyleBold size:22];
+    XCTAssertEqual(first, second);
+    XCTAssertNotEqual(first, other);
+    XCTAssertEqualWithAccuracy(CTFontGetSize(other), 22, 0.001);
+    CFRelease(first);
+    CFRelease(second);
+    CFRelease(other);
+}
+
+- (void)testTextFontsAcrossThreads
+{
+    // More sizes than the cache holds, so fonts are replaced while others use them.
+    dispatch_apply(200, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+        MTTextStyle style = (i % 2) ? kMTTextStyleItalic : kMTTextStyleRoman;
+        CGFloat size = 10 + (i % 50);
+        CTFontRef font = [MTFontManager textCTFontForStyle:style size:size];
+        XCTAssertEqualWithAccuracy(CTFontGetSize(font), size, 0.001);
+        CFRelease(font);
+    });
+}
+
+- (void)testRunsAreShared
+{
+    MTTextRunCache* cache = [[MTTextRunCache alloc] init];
+    MTTextRun* run = [cache runForText:@"for all" style:kMTTextStyleRoman size:20];
+    XCTAssertEqual([cache runForText:@"for all" style:kMTTextStyleRoman size:20], run);
+    XCTAssertNotEqual([cache runForText:@"for all" style:kMTTextStyleBold size:20], run);
+    XCTAssertNotEqual([cache runForText:@"for all" style:kMTTextStyleRoman size:10], run);
+    XCTAssertNotEqual([cache runForText:@"for any" style:kMTTextStyleRoman size:20], run);
+    XCTAssertEqual(cache.count, 4u);
+
+    // The same metrics as a run shaped on its own.
+    CTFontRef font = [MTFontManager textCTFontForStyle:kMTTextStyleRoman size:20];
+    MTTextRun* uncached = [MTTextRun runWithText:@"for all" font:font];
+    CFRelease(font);
+    XCTAssertEqual(run.width, uncached.width);
+    XCTAssertEqual(run.ascent, uncached.ascent);
+    XCTAssertEqual(run.descent, uncached.descent);
+    XCTAssertEqual(run.inkMaxX, uncached.inkMaxX);
+}
+
+- (void)testLeastRecentlyUsedRunsAreEvicted
+{
+    MTTextRunCache* cache = [[MTTextRunCache alloc] initWithCountLimit:2];
+    MTTextRun* a = [cache runForText:@"a" style:kMTTextStyleRoman size:20];
+    MTTextRun* b = [cache runForText:@"b" style:kMTTextStyleRoman size:20];
+    // Use a, so that b is the oldest.
+    XCTAssertEqual([cache runForText:@"a" style:kMTTextStyleRoman size:20], a);
+    [cache runForText:@"c" style:kMTTextStyleRoman size:20];
+    XCTAssertEqual(cache.count, 2u);
+    XCTAssertEqual([cache runForText:@"a" style:kMTTextStyleRoman size:20], a);
+    XCTAssertNotEqual([cache runForText:@"b" style:kMTTextStyleRoman size:20], b);
+
+    cache.countLimit = 1;
+    XCTAssertEqual(cache.count, 1u);
+    [cache removeAllRuns];
+    XCTAssertEqual(cache.count, 0u);
+    cache.countLimit = 0;
+    [cache runForText:@"a" style:kMTTextStyleRoman size:20];
+    XCTAssertEqual(cache.count, 0u);
+}
+
+- (void)testDisplaysShareTheSharedRuns
+{
+    MTFont* font = MTFontManager.fontManager.defaultFont;
+    NSString* latex = @"x \\text{ if } y > 0";
+    MTMathListDisplay* first = [MTTypesetter createLineForMathList:[MTMathListBuilder buildFromString:latex] font:font style:kMTLineStyleDisplay];
+    MTMathListDisplay* second = [MTTypesetter createLineForMathList:[MTMathListBuilder buildFromString:latex] font:font style:kMTLineStyleDisplay];
+    MTTextDisplay* firstText = nil;
+    MTTextDisplay* secondText = nil;
+    for (MTDisplay* display in first.subDisplays) {
+        if ([display isKindOfClass:[MTTextDisplay class]]) {
+            firstText = (MTTextDisplay*) display;
+        }
+    }
+    for (MTDisplay* display in second.subDisplays) {
+        if ([display isKindOfClass:[MTTextDisplay class]]) {
+            secondText = (MTTextDisplay*) display;
+        }
+    }
+    XCTAssertNotNil(firstText);
+    XCTAssertNotNil(secondText);
+    XCTAssertEqual(firstText.width, secondText.width);
+    XCTAssertEqual(first.width, second.width);
+
+    // Coloring a display leaves the shared run alone, and shapes nothing: the color is applied when drawing.
+    MTTextRun* run = [MTTextRunCache.sharedCache runForText:firstText.text style:firstText.textStyle size:font.fontSize];
+    MTInstrumentation.enabled = YES;
+    [MTInstrumentation resetStatistics];
+    firstText.textColor = [MTColor redColor];
+    XCTAssertEqual([[MTInstrumentation statistics] valueOfCounter:kMTLayoutCounterCTLines], 0u);
+    MTInstrumentation.enabled = NO;
+    [MTInstrumentation resetStatistics];
+    XCTAssertEqual([MTTextRunCache.sharedCache runForText:firstText.text style:firstText.textStyle size:font.fontSize], run);
+    XCTAssertEqual(firstText.width, run.width);
+}
+
+- (void)testTextIsDrawnInItsColor
+{
+    MTFont* font = MTFontManager.fontManager.defaultFont;
+    MTMathListDisplay* display = [MTTypesetter createLineForMathList:[MTMathListBuilder buildFromString:@"\text{MMM}"]
+                                                                font:font style:kMTLineStyleDisplay];
+    display.textColor = [MTColor redColor];
+    size_t width = (size_t) ceil(display.width) + 4;
+    size_t height = (size_t) ceil(display.ascent + display.descent) + 4;
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, width * 4, colorSpace,
+                                                 (CGBitmapInfo) kCGImageAlphaPremultipliedLast);
+    CGColorSpaceRelease(colorSpace);
+    CGContextTranslateCTM(context, 2, 2 + display.descent);
+    // A fill color the text must not take.
+    CGContextSetRGBFillColor(context, 0, 0, 1, 1);
+    [display draw:context];
+
+    // Both the display tree and the draw commands draw the run in red.
+    const uint8_t* pixels = CGBitmapContextGetData(context);
+    NSUInteger red = 0;
+    NSUInteger blue = 0;
+    for (size_t i = 0; i < width * height; i++) {
+        red += pixels[i * 4] > 128;
+        blue += pixels[i * 4 + 2] > 128;
+    }
+    XCTAssertGreaterThan(red, 0u);
+    XCTAssertEqual(blue, 0u);
+
+    memset(CGBitmapContextGetData(context), 0, width * height * 4);
+    [[[MTDrawCommandList alloc] initWithDisplay:display] draw:context];
+    red = 0;
+    blue = 0;
+    for (size_t i = 0; i < width * height; i++) {
+        red += pixels[i * 4] > 128;
+        blue += pixels[i * 4 + 2] > 128;
+    }
+    XCTAssertGreaterThan(red, 0u);
+    XCTAssertEqual(blue, 0u);
+    CGContextRelease(context);
+}
+
+- (void)testRunsAcrossThreads
+{
+    MTTextRunCache* cache = [[MTTextRunCache alloc] initWithCountLimit:8];
+    NSArray<NSString*>* words = @[ @"if", @"for all", @"then", @"otherwise", @"中文", @"العربية",
+                                   @"हिन्दी", @"where", @"and", @"or", @"not", @"such that" ];
+    dispatch_apply(400, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+        NSString* word = words[i % words.count];
+        MTTextRun* run = [cache runForText:word style:kMTTextStyleRoman size:20];
+        XCTAssertEqualObjects(run.attributedString.string, word);
+        XCTAssertGreaterThan(run.width, 0);
+    });
+    XCTAssertLessThanOrEqual(cache.count, 8u);
+}
+
+@end
@@ -3607,4 +3607,61 @@
     XCTAssertEqualWithAccuracy(botLine, contentBot - padding, 0.01);
 }
 
+#pragma mark - Scalable layout
+
+// Compares a scalable layout, scaled to the size of `native`'s font, against the native layout.
+- (void)assertScaledDisplay:(MTDisplay*)scaled scale:(CGFloat)scale equalsDisplay:(MTDisplay*)native latex:(NSString*)latex
+{
+    XCTAssertEqualObjects([scaled class], [native class], @"%@", latex);
+    XCTAssertEqualWithAccuracy(scaled.ascent * scale, native.ascent, 0.01, @"%@", latex);
+    XCTAssertEqualWithAccuracy(scaled.descent * scale, native.descent, 0.01, @"%@", latex);
+    XCTAssertEqualWithAccuracy(scaled.width * scale, native.width, 0.01, @"%@", latex);
+    XCTAssertEqualWithAccuracy(scaled.position.x * scale, native.position.x, 0.01, @"%@", latex);
+    XCTAssertEqualWithAccuracy(scaled.position.y * scale, native.position.y, 0.01, @"%@", latex);
+    if ([scaled isKindOfClass:[MTMathListDisplay class]]) {
+        NSArray<MTDisplay*>* scaledSubs = ((MTMathListDisplay*) scaled).subDisplays;
+        NSArray<MTDisplay*>* nativeSubs = ((MTMathListDisplay*) native).subDisplays;
+        XCTAssertEqual(scaledSubs.count, nativeSubs.count, @"%@", latex);
+        for (NSUInteger i = 0; i < MIN(scaledSubs.count, nativeSubs.count); i++) {
+            [self assertScaledDisplay:scaledSubs[i] scale:scale equalsDisplay:nativeSubs[i] latex:latex];
+        }
+    }
+}
+
+- (void)testScalableLayoutScalesToNativeLayout
+{
+    NSArray<NSString*>* formulas = @[@"x^2 + y_1", @"\\frac{a+b}{\\sqrt[3]{c}}", @"\\sum_{i=0}^{n} i^2",
+                                     @"\\overline{xy} + \\hat{a}", @"\\begin{pmatrix} a & b \\\\ c & d \\end{pmatrix}"];
+    for (NSString* latex in formulas) {
+        MTMathList* list = [MTMathListBuilder buildFromString:latex];
+        MTMathListDisplay* scalable = [MTTypesetter createScalableLineForMathList:list font:self.font style:kMTLineStyleDisplay];
+        for (NSNumber* size in @[@10, @20, @37.5]) {
+            MTFont* font = [self.font copyFontWithSize:size.doubleValue];
+            MTMathListDisplay* native = [MTTypesetter createLineForMathList:list font:font style:kMTLineStyleDisplay];
+            [self assertScaledDisplay:scalable scale:size.doubleValue / MTTypesetterReferenceFontSize equalsDisplay:native latex:latex];
+        }
+    }
+}
+
+- (void)testScalableLayoutDelimiterShortfall
+{
+    // The 5pt delimiter shortfall of plain.tex is 0.5em in a scalable layout, so the two agree at 10pt.
+    MTMathList* list = [MTMathListBuilder buildFromString:@"\\left(\\frac{\\frac{a}{b}}{c}\\right)"];
+    MTMathListDisplay* scalable = [MTTypesetter createScalableLineForMathList:list font:self.font style:kMTLineStyleDisplay];
+    MTMathListDisplay* native = [MTTypesetter createLineForMathList:list font:[self.font copyFontWithSize:10] style:kMTLineStyleDisplay];
+    [self assertScaledDisplay:scalable scale:10 / MTTypesetterReferenceFontSize equalsDisplay:native latex:@"\\left( \\right) at 10pt"];
+}
+
+- (void)testLayoutKeepsSharedAtoms
+{
+    // Laying out a list only reads it, so the atoms it shares with other lists stay shared.
+    MTMathList* list = [MTMathListBuilder buildFromString:@"\\hat{x}^{2}+y"];
+    MTMathAtom* x = [MTMathAtomFactory sharedAtomForCharacter:'x'];
+    MTAccent* accent = list.atomsForReading[0];
+    XCTAssertEqual(accent.innerList.atomsForReading[0], x);
+    XCTAssertNotNil([MTTypesetter createLineForMathList:list font:self.font style:kMTLineStyleDisplay]);
+    XCTAssertEqual(accent.innerList.atomsForReading[0], x);
+    XCTAssertEqual(list.atomsForReading[2], [MTMathAtomFactory sharedAtomForCharacter:'y']);
+}
+
 @end